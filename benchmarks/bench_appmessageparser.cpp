@@ -0,0 +1,147 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures AppMessageParser throughput on a stream of AVDECC_FROM_APS
+/// messages, delivered in TCP segment sized blocks, for both the octet at a
+/// time and the block parse() entry points.
+///
+/// Usage: bench_appmessageparser [megabytes] [segment_size]
+///
+
+class CountingHandler : public AppMessageHandler
+{
+  public:
+    CountingHandler() : m_messages( 0 ), m_payload_octets( 0 ) {}
+
+    virtual void onAppNop( AppMessage const &msg ) override { count( msg ); }
+    virtual void onAppEntityIdRequest( AppMessage const &msg ) override { count( msg ); }
+    virtual void onAppEntityIdResponse( AppMessage const &msg ) override { count( msg ); }
+    virtual void onAppLinkUp( AppMessage const &msg ) override { count( msg ); }
+    virtual void onAppLinkDown( AppMessage const &msg ) override { count( msg ); }
+    virtual void onAppAvdeccFromAps( AppMessage const &msg ) override { count( msg ); }
+    virtual void onAppAvdeccFromApc( AppMessage const &msg ) override { count( msg ); }
+    virtual void onAppVendor( AppMessage const &msg ) override { count( msg ); }
+    virtual void onAppUnknown( AppMessage const &msg ) override { count( msg ); }
+
+    void count( AppMessage const &msg )
+    {
+        ++m_messages;
+        m_payload_octets += msg.getPayloadLength();
+    }
+
+    uint64_t m_messages;
+    uint64_t m_payload_octets;
+};
+
+static std::vector<uint8_t> makeStream( size_t target_size )
+{
+    // Typical AVDECC PDU sizes: ADP, ACMP, small and large AECP
+    static const uint16_t sizes[] = {68, 56, 70, 44, 120, 300, 524};
+    std::vector<uint8_t> stream;
+    FixedBufferWithSize<AppMessageParser::max_appdu_message_size> buf;
+    size_t n = 0;
+
+    while ( stream.size() < target_size )
+    {
+        FrameWithMTU frame( 0,
+                            Eui48( 0x91, 0xe0, 0xf0, 0x01, 0x00, 0x00 ),
+                            Eui48( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 ),
+                            JDKSAVDECC_AVTP_ETHERTYPE );
+        uint16_t size = sizes[n++ % ( sizeof( sizes ) / sizeof( sizes[0] ) )];
+        for ( uint16_t i = 0; i < size; ++i )
+        {
+            frame.putOctet( uint8_t( i + n ) );
+        }
+
+        AppMessage msg;
+        msg.setAvdeccFromAps( frame );
+        msg.store( &buf );
+        stream.insert( stream.end(), buf.getBuf(), buf.getBuf() + buf.getLength() );
+    }
+    return stream;
+}
+
+struct Result
+{
+    double m_seconds;
+    uint64_t m_messages;
+    int m_errors;
+};
+
+static Result run( std::vector<uint8_t> const &stream, size_t total_octets, size_t segment_size, bool bulk )
+{
+    CountingHandler handler;
+    AppMessageParser parser( handler );
+    Result result;
+    result.m_errors = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    size_t done = 0;
+    while ( done < total_octets )
+    {
+        for ( size_t pos = 0; pos < stream.size(); pos += segment_size )
+        {
+            size_t len = std::min( segment_size, stream.size() - pos );
+            uint8_t const *data = &stream[pos];
+            if ( bulk )
+            {
+                result.m_errors |= parser.parse( data, len );
+            }
+            else
+            {
+                for ( size_t i = 0; i < len; ++i )
+                {
+                    result.m_errors |= parser.parse( data[i] );
+                }
+            }
+        }
+        done += stream.size();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.m_seconds = elapsed.count();
+    result.m_messages = handler.m_messages;
+    return result;
+}
+
+static void report( char const *name, Result const &result, size_t total_octets )
+{
+    BenchReport( name, result.m_seconds ).mebibytes( double( total_octets ) ).gigabits( double( total_octets ) )
+        .rate( double( result.m_messages ), "msg/s" )
+        << ( result.m_errors ? " ERRORS" : "" );
+}
+
+int main( int argc, char **argv )
+{
+    size_t megabytes = argc > 1 ? size_t( atoi( argv[1] ) ) : 256;
+    size_t segment_size = argc > 2 ? size_t( atoi( argv[2] ) ) : 1448;
+
+    std::vector<uint8_t> stream = makeStream( 4 * 1024 * 1024 );
+    size_t repeats = ( megabytes * 1024 * 1024 + stream.size() - 1 ) / stream.size();
+    size_t total_octets = repeats * stream.size();
+
+    std::cout << "AppMessageParser: " << total_octets << " octets in " << segment_size << " octet segments" << std::endl;
+
+    Result octet = run( stream, total_octets, segment_size, false );
+    report( "octet", octet, total_octets );
+
+    Result bulk = run( stream, total_octets, segment_size, true );
+    report( "bulk", bulk, total_octets );
+
+    if ( octet.m_messages != bulk.m_messages || octet.m_errors || bulk.m_errors )
+    {
+        std::cout << "Mismatch: " << octet.m_messages << " vs " << bulk.m_messages << " messages" << std::endl;
+        return 1;
+    }
+
+    // 1 Gbit/s of AVDECC over TCP
+    bool fast_enough = double( total_octets ) * 8.0 / bulk.m_seconds >= 1e9;
+    std::cout << "bulk parse " << ( fast_enough ? "sustains" : "does not sustain" ) << " 1 Gbit/s" << std::endl;
+    return 0;
+}
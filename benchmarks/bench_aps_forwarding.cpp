@@ -0,0 +1,244 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures APS forwarding throughput in both directions.
+///
+/// TCP to L2: a stream of AVDECC_FROM_APC messages in TCP segment sized
+/// blocks is fed to an ApsStateMachine, which sends each one to layer 2.
+/// "copy" has the parser copy every payload into an AppMessage first,
+/// "view" forwards the payload from the receive buffer.
+///
+/// L2 to TCP: received frames are encoded as AVDECC_FROM_APS for the APC.
+/// "struct" copies the whole AppMessage structure once on the way, as
+/// AppMessage copies did before, "copy" copies only the used payload and
+/// "view" encodes straight from the frame.
+///
+/// Usage: bench_aps_forwarding [megabytes] [segment_size]
+///
+
+static const uint16_t sizes[] = {68, 56, 70, 44, 120, 300, 524};
+static const size_t size_count = sizeof( sizes ) / sizeof( sizes[0] );
+
+class BenchEvents : public ApsStateEvents
+{
+  public:
+    BenchEvents( HttpServerParser *http_parser, bool use_views ) : ApsStateEvents( http_parser, "/" ), m_use_views( use_views )
+    {
+    }
+
+    virtual bool onAppMessageView( AppMessageView const &view ) override
+    {
+        return m_use_views && ApsStateEvents::onAppMessageView( view );
+    }
+
+    bool m_use_views;
+};
+
+class BenchAps : public ApsStateMachine
+{
+  public:
+    BenchAps( bool use_views )
+        : ApsStateMachine( &m_bench_variables,
+                           &m_bench_actions,
+                           &m_bench_events,
+                           &m_bench_states,
+                           m_active_entity_id_count,
+                           m_active_connections )
+        , m_bench_events( &m_http_parser, use_views )
+        , m_http_parser( &m_bench_events )
+        , m_active_entity_id_count( 0 )
+        , m_frames( 0 )
+        , m_octets( 0 )
+    {
+    }
+
+    virtual void sendTcpData( uint8_t const *data, ssize_t len ) override
+    {
+        (void)data;
+        (void)len;
+    }
+
+    virtual void sendAvdeccToL2( Frame const &frame ) override
+    {
+        ++m_frames;
+        m_octets += frame.getLength();
+    }
+
+    ApsStateVariables m_bench_variables;
+    ApsStateActions m_bench_actions;
+    BenchEvents m_bench_events;
+    ApsStates m_bench_states;
+    HttpServerParserInPlace m_http_parser;
+    uint16_t m_active_entity_id_count;
+    active_connections_type m_active_connections;
+    uint64_t m_frames;
+    uint64_t m_octets;
+};
+
+static FrameWithMTU makeFrame( size_t n )
+{
+    FrameWithMTU frame( 0,
+                        Eui48( 0x91, 0xe0, 0xf0, 0x01, 0x00, 0x00 ),
+                        Eui48( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 ),
+                        JDKSAVDECC_AVTP_ETHERTYPE );
+    uint16_t size = sizes[n % size_count];
+    for ( uint16_t i = 0; i < size; ++i )
+    {
+        frame.putOctet( uint8_t( i + n ) );
+    }
+    return frame;
+}
+
+static std::vector<uint8_t> makeStream( size_t target_size )
+{
+    std::vector<uint8_t> stream;
+    FixedBufferWithSize<AppMessageParser::max_appdu_message_size> buf;
+
+    for ( size_t n = 0; stream.size() < target_size; ++n )
+    {
+        AppMessage msg;
+        msg.setAvdeccFromApc( makeFrame( n ) );
+        msg.store( &buf );
+        stream.insert( stream.end(), buf.getBuf(), buf.getBuf() + buf.getLength() );
+    }
+    return stream;
+}
+
+struct Result
+{
+    double m_seconds;
+    uint64_t m_messages;
+    uint64_t m_octets;
+};
+
+static Result runTcpToL2( std::vector<uint8_t> const &stream, size_t repeats, size_t segment_size, bool use_views )
+{
+    BenchAps aps( use_views );
+    static char const connect[] = "CONNECT / HTTP/1.1\r\n\r\n";
+
+    aps.setup();
+    aps.setLinkMac( Eui48( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 ) );
+    aps.run();
+    aps.onIncomingTcpConnection();
+    aps.run();
+    aps.onIncomingTcpData( reinterpret_cast<uint8_t const *>( connect ), sizeof( connect ) - 1 );
+    aps.run();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for ( size_t r = 0; r < repeats; ++r )
+    {
+        for ( size_t pos = 0; pos < stream.size(); pos += segment_size )
+        {
+            size_t len = std::min( segment_size, stream.size() - pos );
+            aps.onIncomingTcpData( &stream[pos], ssize_t( len ) );
+            aps.run();
+        }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    Result result;
+    result.m_seconds = elapsed.count();
+    result.m_messages = aps.m_frames;
+    result.m_octets = aps.m_octets;
+    return result;
+}
+
+enum L2Mode
+{
+    L2_STRUCT,
+    L2_COPY,
+    L2_VIEW
+};
+
+static Result runL2ToTcp( std::vector<FrameWithMTU> const &frames, size_t count, L2Mode mode )
+{
+    FixedBufferWithSize<AppMessageParser::max_appdu_message_size> buf;
+    AppMessage in;
+    Result result;
+    result.m_messages = 0;
+    result.m_octets = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for ( size_t n = 0; n < count; ++n )
+    {
+        Frame const &frame = frames[n % frames.size()];
+
+        if ( mode == L2_VIEW )
+        {
+            AppMessageView view;
+            view.setAvdeccFromAps( frame );
+            view.store( &buf );
+        }
+        else
+        {
+            AppMessage msg;
+            msg.setAvdeccFromAps( frame );
+            if ( mode == L2_STRUCT )
+            {
+                in.m_appdu = msg.m_appdu;
+                in.m_appdu.base.payload = in.m_appdu.payload_buffer;
+            }
+            else
+            {
+                in = msg;
+            }
+            in.store( &buf );
+        }
+        ++result.m_messages;
+        result.m_octets += buf.getLength();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.m_seconds = elapsed.count();
+    return result;
+}
+
+static void report( char const *name, Result const &result )
+{
+    BenchReport( name, result.m_seconds ).mebibytes( double( result.m_octets ) ).gigabits( double( result.m_octets ) )
+        .rate( double( result.m_messages ), "msg/s" );
+}
+
+int main( int argc, char **argv )
+{
+    size_t megabytes = argc > 1 ? size_t( atoi( argv[1] ) ) : 256;
+    size_t segment_size = argc > 2 ? size_t( atoi( argv[2] ) ) : 1448;
+
+    std::vector<uint8_t> stream = makeStream( 4 * 1024 * 1024 );
+    size_t repeats = ( megabytes * 1024 * 1024 + stream.size() - 1 ) / stream.size();
+
+    std::cout << "APS TCP to L2: " << repeats * stream.size() << " octets in " << segment_size << " octet segments"
+              << std::endl;
+
+    Result copy = runTcpToL2( stream, repeats, segment_size, false );
+    report( "copy", copy );
+
+    Result view = runTcpToL2( stream, repeats, segment_size, true );
+    report( "view", view );
+
+    if ( copy.m_messages != view.m_messages || copy.m_octets != view.m_octets )
+    {
+        std::cout << "Mismatch: " << copy.m_messages << " vs " << view.m_messages << " messages" << std::endl;
+        return 1;
+    }
+
+    std::vector<FrameWithMTU> frames;
+    for ( size_t n = 0; n < size_count; ++n )
+    {
+        frames.push_back( makeFrame( n ) );
+    }
+    size_t count = copy.m_messages;
+
+    std::cout << "APS L2 to TCP: " << count << " messages" << std::endl;
+    report( "struct", runL2ToTcp( frames, count, L2_STRUCT ) );
+    report( "copy", runL2ToTcp( frames, count, L2_COPY ) );
+    report( "view", runL2ToTcp( frames, count, L2_VIEW ) );
+    return 0;
+}
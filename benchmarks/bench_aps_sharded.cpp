@@ -0,0 +1,384 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures how APS forwarding scales with the number of worker
+/// threads of an ApsServerSharded.
+///
+/// Client threads open the connections to a localhost port, do the
+/// HTTP upgrade and then write a pre-encoded stream of AVDECC_FROM_APC
+/// messages as fast as the sockets accept it, reading and discarding
+/// whatever comes back. The main thread owns the "network": it sends
+/// the frames that the workers queue for layer 2 with processTx() and
+/// injects layer 2 frames at down_rate, which every worker encodes
+/// once for all of its connections.
+///
+/// The run is repeated with 1, 2, 4 ... max_workers workers. Up is the
+/// rate of frames that reached layer 2, down the octets received by
+/// all clients. Speedup is relative to one worker and can only be
+/// near-linear when there are cores for the workers, the clients and
+/// the main thread.
+///
+/// Exits with 1 if a connection fails or nothing is forwarded.
+///
+/// Usage: bench_aps_sharded [seconds] [connections] [max_workers] [down_rate] [client_threads]
+///
+
+#if JDKSAVDECCMCU_ENABLE_EPOLL && JDKSAVDECCMCU_ENABLE_THREADS
+
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static uint16_t const sizes[] = {68, 56, 70, 44, 120, 300, 524};
+static size_t const size_count = sizeof( sizes ) / sizeof( sizes[0] );
+
+static FrameWithMTU makeFrame( size_t n )
+{
+    FrameWithMTU frame( 0,
+                        Eui48( 0x91, 0xe0, 0xf0, 0x01, 0x00, 0x00 ),
+                        Eui48( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 ),
+                        JDKSAVDECC_AVTP_ETHERTYPE );
+    uint16_t size = sizes[n % size_count];
+
+    frame.putOctet( JDKSAVDECC_1722A_SUBTYPE_AECP );
+    for ( uint16_t i = 1; i < size; ++i )
+    {
+        frame.putOctet( uint8_t( i + n ) );
+    }
+    return frame;
+}
+
+static std::vector<uint8_t> makeStream( size_t target_size )
+{
+    std::vector<uint8_t> stream;
+    FixedBufferWithSize<AppMessageParser::max_appdu_message_size> buf;
+
+    for ( size_t n = 0; stream.size() < target_size; ++n )
+    {
+        AppMessage msg;
+        msg.setAvdeccFromApc( makeFrame( n ) );
+        msg.store( &buf );
+        stream.insert( stream.end(), buf.getBuf(), buf.getBuf() + buf.getLength() );
+    }
+    return stream;
+}
+
+class BenchServer : public ApsServerSharded
+{
+  public:
+    BenchServer( size_t workers ) : ApsServerSharded( Eui48( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 ), 0, workers ), m_up( 0 ) {}
+
+    virtual void sendAvdeccToL2( Frame const &frame ) override
+    {
+        (void)frame;
+        ++m_up;
+    }
+
+    uint64_t m_up;
+};
+
+///
+/// A thread that drives a share of the connections
+///
+class Clients
+{
+  public:
+    Clients( std::vector<uint8_t> const &stream )
+        : m_stream( stream ), m_epoll_fd( epoll_create1( EPOLL_CLOEXEC ) ), m_received( 0 )
+    {
+        m_running.store( false );
+    }
+
+    ~Clients()
+    {
+        stop();
+        for ( size_t i = 0; i < m_fds.size(); ++i )
+        {
+            ::close( m_fds[i] );
+        }
+        ::close( m_epoll_fd );
+    }
+
+    ///
+    /// Connect and upgrade one connection, before start()
+    ///
+    bool connect( uint16_t port )
+    {
+        struct sockaddr_in sa;
+        memset( &sa, 0, sizeof( sa ) );
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons( port );
+        inet_pton( AF_INET, "127.0.0.1", &sa.sin_addr );
+
+        int fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+        if ( fd < 0 )
+        {
+            return false;
+        }
+
+        static char const request[] = "CONNECT / HTTP/1.1\r\n\r\n";
+        std::string response;
+        char buf[256];
+        struct timeval tv = {5, 0};
+
+        setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+        if ( ::connect( fd, (struct sockaddr *)&sa, sizeof( sa ) ) == 0
+             && write( fd, request, sizeof( request ) - 1 ) == ssize_t( sizeof( request ) - 1 ) )
+        {
+            while ( response.find( "\r\n\r\n" ) == std::string::npos )
+            {
+                ssize_t n = read( fd, buf, sizeof( buf ) );
+                if ( n <= 0 )
+                {
+                    break;
+                }
+                response.append( buf, size_t( n ) );
+            }
+        }
+
+        struct epoll_event ev;
+        memset( &ev, 0, sizeof( ev ) );
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.u64 = m_fds.size();
+
+        if ( response.compare( 0, 12, "HTTP/1.1 200" ) != 0 || fcntl( fd, F_SETFL, O_NONBLOCK ) != 0
+             || epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, fd, &ev ) != 0 )
+        {
+            ::close( fd );
+            return false;
+        }
+        m_fds.push_back( fd );
+        m_positions.push_back( 0 );
+        return true;
+    }
+
+    void start()
+    {
+        m_running.store( true );
+        m_thread = std::thread( &Clients::run, this );
+    }
+
+    void stop()
+    {
+        m_running.store( false );
+        if ( m_thread.joinable() )
+        {
+            m_thread.join();
+        }
+    }
+
+    std::vector<uint8_t> const &m_stream;
+    int m_epoll_fd;
+    std::vector<int> m_fds;
+    std::vector<size_t> m_positions;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+    uint64_t m_received;
+
+  private:
+    void run()
+    {
+        struct epoll_event events[64];
+        std::vector<uint8_t> buf( 65536 );
+
+        while ( m_running.load() )
+        {
+            int n = epoll_wait( m_epoll_fd, events, 64, 10 );
+            for ( int i = 0; i < n; ++i )
+            {
+                size_t c = size_t( events[i].data.u64 );
+                int fd = m_fds[c];
+
+                if ( events[i].events & EPOLLIN )
+                {
+                    ssize_t r;
+                    while ( ( r = read( fd, &buf[0], buf.size() ) ) > 0 )
+                    {
+                        m_received += uint64_t( r );
+                    }
+                }
+                if ( events[i].events & EPOLLOUT )
+                {
+                    // The stream holds whole messages so it may wrap at its end
+                    size_t &pos = m_positions[c];
+                    ssize_t r = write( fd, &m_stream[pos], std::min( m_stream.size() - pos, size_t( 65536 ) ) );
+                    if ( r > 0 )
+                    {
+                        pos = ( pos + size_t( r ) ) % m_stream.size();
+                    }
+                }
+            }
+        }
+    }
+};
+
+struct Result
+{
+    double m_seconds;
+    uint64_t m_up;
+    uint64_t m_down_octets;
+    uint64_t m_injected;
+    uint32_t m_rx_dropped;
+    uint32_t m_tx_dropped;
+    std::vector<size_t> m_connections;
+    bool m_ok;
+};
+
+static Result run( size_t workers,
+                   double seconds,
+                   size_t connections,
+                   double down_rate,
+                   size_t client_threads,
+                   std::vector<uint8_t> const &stream )
+{
+    Result result;
+    result.m_seconds = seconds;
+    result.m_up = 0;
+    result.m_down_octets = 0;
+    result.m_injected = 0;
+    result.m_ok = false;
+
+    BenchServer server( workers );
+    std::vector<Clients *> clients;
+
+    if ( server.listen( 0, "127.0.0.1" ) && server.start() )
+    {
+        result.m_ok = true;
+        for ( size_t i = 0; i < client_threads; ++i )
+        {
+            clients.push_back( new Clients( stream ) );
+        }
+        for ( size_t i = 0; i < connections && result.m_ok; ++i )
+        {
+            result.m_ok = clients[i % client_threads]->connect( server.getPort() );
+        }
+    }
+
+    if ( result.m_ok )
+    {
+        int epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+        struct epoll_event ev;
+        memset( &ev, 0, sizeof( ev ) );
+        ev.events = EPOLLIN;
+        epoll_ctl( epoll_fd, EPOLL_CTL_ADD, server.getTxEventFd(), &ev );
+
+        for ( size_t i = 0; i < clients.size(); ++i )
+        {
+            clients[i]->start();
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double elapsed = 0.0;
+
+        while ( elapsed < seconds )
+        {
+            epoll_wait( epoll_fd, &ev, 1, 1 );
+            server.processTx();
+
+            elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+            while ( result.m_injected < uint64_t( elapsed * down_rate ) )
+            {
+                FrameWithMTU frame = makeFrame( size_t( result.m_injected++ ) );
+                server.onNetAvdeccMessageReceived( frame );
+            }
+        }
+        result.m_seconds = elapsed;
+        result.m_up = server.m_up;
+
+        for ( size_t i = 0; i < clients.size(); ++i )
+        {
+            clients[i]->stop();
+            result.m_down_octets += clients[i]->m_received;
+        }
+
+        // Let the workers finish what they read so they are not stopped while waiting to send
+        while ( epoll_wait( epoll_fd, &ev, 1, 100 ) > 0 )
+        {
+            server.processTx();
+        }
+        ::close( epoll_fd );
+    }
+
+    server.stop();
+    result.m_rx_dropped = server.getRxDroppedCount();
+    result.m_tx_dropped = server.getTxDroppedCount();
+    for ( size_t i = 0; i < server.getWorkerCount(); ++i )
+    {
+        result.m_connections.push_back( server.getWorker( i )->getConnectionCount() );
+    }
+    for ( size_t i = 0; i < clients.size(); ++i )
+    {
+        delete clients[i];
+    }
+    return result;
+}
+
+int main( int argc, char **argv )
+{
+    double seconds = argc > 1 ? atof( argv[1] ) : 5.0;
+    size_t connections = argc > 2 ? size_t( atoi( argv[2] ) ) : 256;
+    size_t max_workers = argc > 3 ? size_t( atoi( argv[3] ) ) : std::max( 1u, std::thread::hardware_concurrency() / 2 );
+    double down_rate = argc > 4 ? atof( argv[4] ) : 1000.0;
+    size_t client_threads = argc > 5 ? size_t( atoi( argv[5] ) ) : std::max( size_t( 1 ), max_workers / 2 );
+
+    connections = std::max( size_t( 1 ), connections );
+    max_workers = std::max( size_t( 1 ), max_workers );
+
+    std::vector<uint8_t> stream = makeStream( 256 * 1024 );
+
+    std::cout << "APS sharded: " << connections << " connections, " << seconds << " s per run, down " << down_rate
+              << " msg/s to each APC, " << client_threads << " client threads, " << std::thread::hardware_concurrency()
+              << " cores" << std::endl;
+
+    double base = 0.0;
+    bool ok = true;
+
+    for ( size_t workers = 1; workers <= max_workers; workers *= 2 )
+    {
+        Result r = run( workers, seconds, connections, down_rate, client_threads, stream );
+        double up = double( r.m_up ) / r.m_seconds;
+
+        if ( workers == 1 )
+        {
+            base = up;
+        }
+
+        {
+            std::string name = std::to_string( workers ) + " workers";
+            BenchReport line( name.c_str(), r.m_seconds, 12 );
+            line.rate( double( r.m_up ), "up msg/s", 10 )
+                .column( base > 0.0 ? up / base : 0.0, "x", 6, 2 )
+                .mebibytes( double( r.m_down_octets ) )
+                << " down, rx drops " << r.m_rx_dropped << " tx drops " << r.m_tx_dropped << " connections";
+            for ( size_t i = 0; i < r.m_connections.size(); ++i )
+            {
+                line << ( i ? "/" : " " ) << r.m_connections[i];
+            }
+        }
+
+        if ( !r.m_ok || r.m_up == 0 )
+        {
+            std::cout << "Run with " << workers << " workers failed" << std::endl;
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+#else
+
+int main()
+{
+    std::cout << "bench_aps_sharded needs JDKSAVDECCMCU_ENABLE_EPOLL and JDKSAVDECCMCU_ENABLE_THREADS" << std::endl;
+    return 0;
+}
+
+#endif
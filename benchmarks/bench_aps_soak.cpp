@@ -0,0 +1,739 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Soak and throughput test of an APS serving many APCs.
+///
+/// An ApsServerEpoll listens on a localhost TCP port and N
+/// ApcStateMachines in the same process connect to it, so no network
+/// interface is needed. Once every APC has its entity_id, AVDECC
+/// messages are driven at a fixed rate in both directions:
+///
+///   up:   APC network -> APC -> TCP -> APS -> layer 2
+///   down: layer 2 -> APS -> TCP -> every APC
+///
+/// Each message carries its origin, a sequence number and its send time.
+/// The receiving end uses them for forwarding latency percentiles and
+/// for drops (gaps in the sequence). Memory per connection is the growth
+/// of the resident set size while the connections are set up, APS and
+/// APC sides together.
+///
+/// Exits with 1 if a connection fails or a message is lost, so a short
+/// run works as a CI check.
+///
+/// Usage: bench_aps_soak [seconds] [connections] [up_rate] [down_rate] [size]
+///
+/// up_rate is the total rate of messages from all APCs, down_rate the
+/// rate of layer 2 messages, each of which goes to every APC. size is
+/// the AVDECC payload size in octets.
+///
+
+#if JDKSAVDECCMCU_ENABLE_EPOLL
+
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+/// Payload layout of the test messages
+enum
+{
+    ORIGIN_OFFSET = 2,
+    SEQUENCE_OFFSET = 4,
+    TIME_OFFSET = 8,
+    HEADER_SIZE = 16
+};
+
+static const uint8_t soak_subtype = JDKSAVDECC_1722A_SUBTYPE_AECP;
+
+static uint64_t nowNs()
+{
+    return uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+static size_t residentSetSize()
+{
+    size_t pages = 0;
+    size_t resident = 0;
+    FILE *f = fopen( "/proc/self/statm", "r" );
+    if ( f )
+    {
+        if ( fscanf( f, "%zu %zu", &pages, &resident ) != 2 )
+        {
+            resident = 0;
+        }
+        fclose( f );
+    }
+    return resident * size_t( sysconf( _SC_PAGESIZE ) );
+}
+
+static void formMessage( Frame *frame, uint16_t origin, uint32_t sequence, uint16_t size )
+{
+    frame->putOctet( soak_subtype );
+    frame->putOctet( 0 );
+    frame->putDoublet( origin );
+    frame->putQuadlet( sequence );
+    frame->putOctlet( nowNs() );
+    frame->putZeros( size > HEADER_SIZE ? uint16_t( size - HEADER_SIZE ) : 0 );
+}
+
+///
+/// Forwarding latencies of one direction, in nanoseconds
+///
+class Latency
+{
+  public:
+    void add( uint64_t ns ) { m_samples.push_back( ns ); }
+
+    uint64_t percentile( double p )
+    {
+        if ( m_samples.empty() )
+        {
+            return 0;
+        }
+        size_t n = std::min( m_samples.size() - 1, size_t( p * double( m_samples.size() ) ) );
+        std::nth_element( m_samples.begin(), m_samples.begin() + n, m_samples.end() );
+        return m_samples[n];
+    }
+
+    uint64_t max() const { return m_samples.empty() ? 0 : *std::max_element( m_samples.begin(), m_samples.end() ); }
+
+    std::vector<uint64_t> m_samples;
+};
+
+///
+/// Sequence tracking of the messages from one origin
+///
+class Sequence
+{
+  public:
+    Sequence() : m_next( 0 ), m_received( 0 ), m_lost( 0 ), m_late( 0 ) {}
+
+    void receive( uint32_t sequence )
+    {
+        ++m_received;
+        if ( sequence >= m_next )
+        {
+            m_lost += sequence - m_next;
+            m_next = sequence + 1;
+        }
+        else
+        {
+            ++m_late;
+        }
+    }
+
+    uint32_t m_next;
+    uint64_t m_received;
+    uint64_t m_lost;
+    uint64_t m_late;
+};
+
+class SoakHarness;
+
+///
+/// An APC connected to the APS over a non-blocking localhost TCP socket
+///
+class SoakApc : public ApcStateMachine
+{
+  public:
+    SoakApc( SoakHarness *harness, uint16_t origin );
+
+    virtual ~SoakApc();
+
+    virtual void connectToProxy( std::string const &addr ) override;
+
+    virtual void closeTcpConnection() override;
+
+    virtual void notifyProxyAvailable() override { m_available = true; }
+
+    virtual void notifyProxyUnavailable() override { m_available = false; }
+
+    virtual void processMsg( AppMessage const &apsMsg ) override;
+
+    virtual void sendTcpData( uint8_t const *data, ssize_t len ) override;
+
+    void onSocketEvent( uint32_t events );
+
+    void flush();
+
+    void updateEvents();
+
+    ApcStateVariables m_soak_variables;
+    ApcStateActions m_soak_actions;
+    ApcStates m_soak_states;
+    ApcStateEvents m_soak_events;
+    HttpClientParserInPlace m_http_parser;
+
+    SoakHarness *m_harness;
+    uint16_t m_origin;
+    int m_fd;
+    bool m_connecting;
+    bool m_available;
+    bool m_failed;
+    bool m_epollout;
+    std::vector<uint8_t> m_output;
+    uint32_t m_up_sequence;
+    Sequence m_down;
+};
+
+///
+/// The APS, which delivers the messages from the APCs to the harness
+/// instead of a network port
+///
+class SoakServer : public ApsServerEpoll
+{
+  public:
+    SoakServer( SoakHarness *harness, size_t connections )
+        : ApsServerEpoll( Eui48( 0x02, 0x00, 0x00, 0xff, 0xff, 0xfe ), 0, "/", connections, 4096 ), m_harness( harness )
+    {
+    }
+
+    virtual void sendAvdeccToL2( Frame const &frame ) override;
+
+    SoakHarness *m_harness;
+};
+
+class SoakHarness
+{
+  public:
+    SoakHarness( size_t connections, uint16_t size );
+
+    ~SoakHarness();
+
+    bool connect( double timeout );
+
+    void soak( double seconds, double up_rate, double down_rate );
+
+    void drain( double timeout );
+
+    bool report( double seconds );
+
+    void service( int timeout_ms );
+
+    void sendUp();
+
+    void sendDown();
+
+    void onUp( Frame const &frame );
+
+    void onDown( SoakApc *apc, AppMessage const &msg );
+
+    SoakServer m_server;
+    int m_epoll_fd;
+    uint16_t m_size;
+    std::vector<SoakApc *> m_apcs;
+    uint32_t m_current_time;
+    uint64_t m_start;
+
+    double m_connect_seconds;
+    size_t m_rss_before;
+    size_t m_rss_connected;
+
+    size_t m_next_up;
+    uint64_t m_sent_up;
+    uint64_t m_unavailable_up;
+    std::vector<Sequence> m_up;
+    Latency m_up_latency;
+
+    uint32_t m_down_sequence;
+    Latency m_down_latency;
+
+    /// The message counts that the rates asked for, for comparison with what was sent
+    uint64_t m_offered_up;
+    uint64_t m_offered_down;
+};
+
+SoakApc::SoakApc( SoakHarness *harness, uint16_t origin )
+    : ApcStateMachine( &m_soak_variables, &m_soak_actions, &m_soak_events, &m_soak_states )
+    , m_soak_events( &m_http_parser, "/" )
+    , m_http_parser( &m_soak_events )
+    , m_harness( harness )
+    , m_origin( origin )
+    , m_fd( -1 )
+    , m_connecting( false )
+    , m_available( false )
+    , m_failed( false )
+    , m_epollout( false )
+    , m_up_sequence( 0 )
+{
+}
+
+SoakApc::~SoakApc()
+{
+    if ( m_fd >= 0 )
+    {
+        ::close( m_fd );
+    }
+}
+
+void SoakApc::connectToProxy( std::string const &addr )
+{
+    struct sockaddr_in sa;
+    memset( &sa, 0, sizeof( sa ) );
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons( m_harness->m_server.getPort() );
+    inet_pton( AF_INET, addr.c_str(), &sa.sin_addr );
+
+    m_fd = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if ( m_fd >= 0 )
+    {
+        int on = 1;
+        setsockopt( m_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+
+        if ( ::connect( m_fd, (struct sockaddr *)&sa, sizeof( sa ) ) == 0 || errno == EINPROGRESS )
+        {
+            struct epoll_event ev;
+            memset( &ev, 0, sizeof( ev ) );
+            ev.events = EPOLLIN | EPOLLOUT;
+            ev.data.ptr = this;
+            if ( epoll_ctl( m_harness->m_epoll_fd, EPOLL_CTL_ADD, m_fd, &ev ) == 0 )
+            {
+                m_connecting = true;
+                m_epollout = true;
+                return;
+            }
+        }
+        ::close( m_fd );
+        m_fd = -1;
+    }
+    m_failed = true;
+}
+
+void SoakApc::closeTcpConnection()
+{
+    ApcStateMachine::closeTcpConnection();
+    if ( m_fd >= 0 )
+    {
+        ::close( m_fd );
+        m_fd = -1;
+    }
+    m_available = false;
+}
+
+void SoakApc::processMsg( AppMessage const &apsMsg )
+{
+    if ( apsMsg.getMessageType() == AppMessage::AVDECC_FROM_APS )
+    {
+        m_harness->onDown( this, apsMsg );
+    }
+}
+
+void SoakApc::sendTcpData( uint8_t const *data, ssize_t len )
+{
+    m_output.insert( m_output.end(), data, data + len );
+    if ( !m_connecting )
+    {
+        flush();
+    }
+}
+
+void SoakApc::flush()
+{
+    size_t pos = 0;
+    while ( m_fd >= 0 && pos < m_output.size() )
+    {
+        ssize_t r = send( m_fd, &m_output[pos], m_output.size() - pos, MSG_NOSIGNAL );
+        if ( r > 0 )
+        {
+            pos += size_t( r );
+        }
+        else if ( r < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        else
+        {
+            if ( r < 0 && errno != EAGAIN && errno != EWOULDBLOCK )
+            {
+                m_failed = true;
+                closeTcpConnection();
+            }
+            break;
+        }
+    }
+    m_output.erase( m_output.begin(), m_output.begin() + pos );
+    updateEvents();
+}
+
+void SoakApc::updateEvents()
+{
+    bool want = m_fd >= 0 && ( m_connecting || !m_output.empty() );
+    if ( m_fd >= 0 && want != m_epollout )
+    {
+        struct epoll_event ev;
+        memset( &ev, 0, sizeof( ev ) );
+        ev.events = EPOLLIN | ( want ? EPOLLOUT : 0 );
+        ev.data.ptr = this;
+        epoll_ctl( m_harness->m_epoll_fd, EPOLL_CTL_MOD, m_fd, &ev );
+        m_epollout = want;
+    }
+}
+
+void SoakApc::onSocketEvent( uint32_t events )
+{
+    if ( m_connecting && ( events & ( EPOLLOUT | EPOLLERR | EPOLLHUP ) ) )
+    {
+        int err = 0;
+        socklen_t err_len = sizeof( err );
+        getsockopt( m_fd, SOL_SOCKET, SO_ERROR, &err, &err_len );
+        m_connecting = false;
+        if ( err != 0 )
+        {
+            m_failed = true;
+            closeTcpConnection();
+            return;
+        }
+        getEvents()->onIncomingTcpConnection();
+        run();
+    }
+
+    if ( m_fd >= 0 && ( events & ( EPOLLIN | EPOLLERR | EPOLLHUP ) ) )
+    {
+        uint8_t buf[16384];
+        for ( ;; )
+        {
+            ssize_t len = read( m_fd, buf, sizeof( buf ) );
+            if ( len > 0 )
+            {
+                onIncomingTcpData( buf, len );
+                run();
+            }
+            else if ( len < 0 && errno == EINTR )
+            {
+                continue;
+            }
+            else
+            {
+                if ( len == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK ) )
+                {
+                    m_failed = true;
+                    closeTcpConnection();
+                    onTcpConnectionClosed();
+                    run();
+                }
+                break;
+            }
+        }
+    }
+
+    flush();
+}
+
+void SoakServer::sendAvdeccToL2( Frame const &frame ) { m_harness->onUp( frame ); }
+
+SoakHarness::SoakHarness( size_t connections, uint16_t size )
+    : m_server( this, connections )
+    , m_epoll_fd( epoll_create1( EPOLL_CLOEXEC ) )
+    , m_size( size )
+    , m_current_time( 0 )
+    , m_start( nowNs() )
+    , m_connect_seconds( 0 )
+    , m_rss_before( 0 )
+    , m_rss_connected( 0 )
+    , m_next_up( 0 )
+    , m_sent_up( 0 )
+    , m_unavailable_up( 0 )
+    , m_up( connections )
+    , m_down_sequence( 0 )
+    , m_offered_up( 0 )
+    , m_offered_down( 0 )
+{
+    struct epoll_event ev;
+    memset( &ev, 0, sizeof( ev ) );
+    ev.events = EPOLLIN;
+    ev.data.ptr = 0;
+
+    if ( m_server.listen( 0, "127.0.0.1" ) )
+    {
+        // The server's epoll set is nested in ours
+        epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, m_server.getEpollFd(), &ev );
+    }
+
+    for ( size_t i = 0; i < connections; ++i )
+    {
+        m_apcs.push_back( new SoakApc( this, uint16_t( i ) ) );
+    }
+}
+
+SoakHarness::~SoakHarness()
+{
+    for ( size_t i = 0; i < m_apcs.size(); ++i )
+    {
+        m_apcs[i]->closeTcpConnection();
+    }
+    m_server.close();
+    for ( size_t i = 0; i < m_apcs.size(); ++i )
+    {
+        delete m_apcs[i];
+    }
+    ::close( m_epoll_fd );
+}
+
+bool SoakHarness::connect( double timeout )
+{
+    uint64_t start = nowNs();
+    uint64_t deadline = start + uint64_t( timeout * 1e9 );
+    size_t available = 0;
+
+    m_rss_before = residentSetSize();
+
+    for ( size_t i = 0; i < m_apcs.size(); ++i )
+    {
+        SoakApc *apc = m_apcs[i];
+        uint16_t origin = apc->m_origin;
+
+        apc->setup();
+        apc->setPrimaryMac( Eui48( 0x02, 0x00, 0x00, 0x00, uint8_t( origin >> 8 ), uint8_t( origin ) ) );
+        apc->setEntityId( Eui64( 0x02, 0x00, 0x00, 0xff, 0xfe, 0x00, uint8_t( origin >> 8 ), uint8_t( origin ) ) );
+        apc->setApsAddress( "127.0.0.1" );
+        apc->setPath( "/" );
+        apc->run();
+    }
+
+    while ( available < m_apcs.size() && nowNs() < deadline )
+    {
+        service( 1 );
+        available = 0;
+        for ( size_t i = 0; i < m_apcs.size(); ++i )
+        {
+            available += m_apcs[i]->m_available ? 1 : 0;
+        }
+    }
+
+    m_connect_seconds = double( nowNs() - start ) / 1e9;
+    m_rss_connected = residentSetSize();
+    return available == m_apcs.size();
+}
+
+void SoakHarness::service( int timeout_ms )
+{
+    struct epoll_event events[64];
+
+    int n = epoll_wait( m_epoll_fd, events, 64, timeout_ms );
+    for ( int i = 0; i < n; ++i )
+    {
+        SoakApc *apc = static_cast<SoakApc *>( events[i].data.ptr );
+        if ( apc )
+        {
+            apc->onSocketEvent( events[i].events );
+        }
+    }
+
+    m_server.poll( 0 );
+
+    uint32_t time_in_seconds = uint32_t( ( nowNs() - m_start ) / 1000000000 );
+    if ( time_in_seconds != m_current_time )
+    {
+        m_current_time = time_in_seconds;
+        m_server.onTimeTick( time_in_seconds );
+        for ( size_t i = 0; i < m_apcs.size(); ++i )
+        {
+            m_apcs[i]->onTimeTick( time_in_seconds );
+            m_apcs[i]->run();
+        }
+    }
+}
+
+void SoakHarness::sendUp()
+{
+    SoakApc *apc = m_apcs[m_next_up++ % m_apcs.size()];
+
+    if ( apc->m_available )
+    {
+        FrameWithMTU frame(
+            0, Eui48( jdksavdecc_multicast_adp_acmp ), apc->getVariables()->m_primaryMac, JDKSAVDECC_AVTP_ETHERTYPE );
+        formMessage( &frame, apc->m_origin, apc->m_up_sequence++, m_size );
+        apc->onNetAvdeccMessageReceived( frame );
+        apc->run();
+        ++m_sent_up;
+    }
+    else
+    {
+        ++m_unavailable_up;
+    }
+}
+
+void SoakHarness::sendDown()
+{
+    FrameWithMTU frame(
+        0, Eui48( jdksavdecc_multicast_adp_acmp ), Eui48( 0x02, 0x00, 0x00, 0xff, 0xff, 0xff ), JDKSAVDECC_AVTP_ETHERTYPE );
+    formMessage( &frame, 0xffff, m_down_sequence++, m_size );
+    m_server.onNetAvdeccMessageReceived( frame );
+}
+
+void SoakHarness::onUp( Frame const &frame )
+{
+    uint8_t const *p = frame.getPayload();
+    uint16_t origin = jdksavdecc_uint16_get( p, ORIGIN_OFFSET );
+
+    if ( frame.getPayloadLength() >= HEADER_SIZE && p[0] == soak_subtype && origin < m_up.size() )
+    {
+        m_up[origin].receive( jdksavdecc_uint32_get( p, SEQUENCE_OFFSET ) );
+        m_up_latency.add( nowNs() - jdksavdecc_uint64_get( p, TIME_OFFSET ) );
+    }
+}
+
+void SoakHarness::onDown( SoakApc *apc, AppMessage const &msg )
+{
+    uint8_t const *p = msg.getPayload();
+
+    if ( msg.getPayloadLength() >= HEADER_SIZE && p[0] == soak_subtype )
+    {
+        apc->m_down.receive( jdksavdecc_uint32_get( p, SEQUENCE_OFFSET ) );
+        m_down_latency.add( nowNs() - jdksavdecc_uint64_get( p, TIME_OFFSET ) );
+    }
+}
+
+void SoakHarness::soak( double seconds, double up_rate, double down_rate )
+{
+    uint64_t start = nowNs();
+    uint64_t end = start + uint64_t( seconds * 1e9 );
+    uint64_t sent_down = 0;
+    uint64_t now;
+
+    while ( ( now = nowNs() ) < end )
+    {
+        double elapsed = double( now - start ) / 1e9;
+        uint64_t target_up = uint64_t( elapsed * up_rate );
+        uint64_t target_down = uint64_t( elapsed * down_rate );
+
+        // Bound the bursts so that a stall does not turn into a flood
+        for ( int burst = 0; m_sent_up + m_unavailable_up < target_up && burst < 256; ++burst )
+        {
+            sendUp();
+        }
+        for ( int burst = 0; sent_down < target_down && burst < 256; ++burst )
+        {
+            sendDown();
+            ++sent_down;
+        }
+
+        bool behind = m_sent_up + m_unavailable_up < target_up || sent_down < target_down;
+        service( behind ? 0 : 1 );
+    }
+
+    m_offered_up = uint64_t( seconds * up_rate );
+    m_offered_down = uint64_t( seconds * down_rate );
+}
+
+void SoakHarness::drain( double timeout )
+{
+    uint64_t deadline = nowNs() + uint64_t( timeout * 1e9 );
+    bool done = false;
+
+    while ( !done && nowNs() < deadline )
+    {
+        service( 1 );
+
+        done = true;
+        for ( size_t i = 0; i < m_apcs.size() && done; ++i )
+        {
+            done = m_up[i].m_next == m_apcs[i]->m_up_sequence && m_apcs[i]->m_down.m_next == m_down_sequence;
+        }
+    }
+}
+
+static void reportLatency( char const *name,
+                           uint64_t offered,
+                           uint64_t sent,
+                           uint64_t received,
+                           uint64_t lost,
+                           double seconds,
+                           Latency &latency )
+{
+    BenchReport( name, seconds, 6 )
+        .rate( double( received ), "msg/s", 10 )
+        .column( double( latency.percentile( 0.5 ) ) / 1e3, "us p50", 8, 1 )
+        .column( double( latency.percentile( 0.99 ) ) / 1e3, "us p99", 8, 1 )
+        .column( double( latency.percentile( 0.999 ) ) / 1e3, "us p999", 8, 1 )
+        .column( double( latency.max() ) / 1e3, "us max", 8, 1 )
+        << ", offered " << offered << " sent " << sent << " received " << received << " lost " << lost;
+}
+
+bool SoakHarness::report( double seconds )
+{
+    uint64_t up_received = 0;
+    uint64_t up_lost = 0;
+    uint64_t down_received = 0;
+    uint64_t down_lost = 0;
+    uint32_t shared_dropped = 0;
+    size_t failed = 0;
+
+    for ( size_t i = 0; i < m_apcs.size(); ++i )
+    {
+        SoakApc *apc = m_apcs[i];
+
+        // Messages that never arrived at all count as lost as well
+        up_received += m_up[i].m_received;
+        up_lost += m_up[i].m_lost + ( apc->m_up_sequence - m_up[i].m_next );
+        down_received += apc->m_down.m_received;
+        down_lost += apc->m_down.m_lost + ( m_down_sequence - apc->m_down.m_next );
+        failed += apc->m_failed ? 1 : 0;
+    }
+    for ( size_t i = 0; i < m_server.getConnectionCount(); ++i )
+    {
+        shared_dropped += m_server.getConnection( i )->getSharedDroppedCount();
+    }
+
+    size_t n = m_apcs.size();
+    std::cout << "connect " << std::fixed << std::setprecision( 3 ) << m_connect_seconds << " s  memory "
+              << ( m_rss_connected - m_rss_before ) / n << " octets/connection (APC object " << sizeof( SoakApc ) << ")"
+              << std::endl;
+    reportLatency( "up", m_offered_up, m_sent_up, up_received, up_lost, seconds, m_up_latency );
+    reportLatency(
+        "down", m_offered_down * n, uint64_t( m_down_sequence ) * n, down_received, down_lost, seconds, m_down_latency );
+    std::cout << "server encoded " << m_server.getEncodedCount() << " delivered " << m_server.getDeliveredCount()
+              << " shared drops " << shared_dropped << " slow consumers " << m_server.getSlowConsumerCount()
+              << " failed connections " << failed << " rss " << residentSetSize() / 1024 << " KiB" << std::endl;
+
+    return up_lost == 0 && down_lost == 0 && failed == 0 && m_unavailable_up == 0;
+}
+
+int main( int argc, char **argv )
+{
+    double seconds = argc > 1 ? atof( argv[1] ) : 10.0;
+    size_t connections = argc > 2 ? size_t( atoi( argv[2] ) ) : 64;
+    double up_rate = argc > 3 ? atof( argv[3] ) : 10000.0;
+    double down_rate = argc > 4 ? atof( argv[4] ) : 1000.0;
+    uint16_t size = argc > 5 ? uint16_t( atoi( argv[5] ) ) : 64;
+
+    connections = std::max( size_t( 1 ), std::min( connections, size_t( JDKSAVDECCMCU_APS_ENTITY_ID_MAX ) ) );
+    size = std::max( uint16_t( HEADER_SIZE ), std::min( size, uint16_t( 1500 ) ) );
+
+    std::cout << "APS soak: " << connections << " connections, " << seconds << " s, up " << up_rate << " msg/s, down "
+              << down_rate << " msg/s to each APC, " << size << " octet payloads" << std::endl;
+
+    SoakHarness harness( connections, size );
+    if ( harness.m_server.getPort() == 0 )
+    {
+        std::cout << "Unable to listen on 127.0.0.1" << std::endl;
+        return 1;
+    }
+    if ( !harness.connect( 10.0 ) )
+    {
+        std::cout << "Not all APCs connected" << std::endl;
+        harness.report( harness.m_connect_seconds );
+        return 1;
+    }
+
+    harness.soak( seconds, up_rate, down_rate );
+    harness.drain( 2.0 );
+    return harness.report( seconds ) ? 0 : 1;
+}
+
+#else
+
+int main()
+{
+    std::cout << "bench_aps_soak needs JDKSAVDECCMCU_ENABLE_EPOLL" << std::endl;
+    return 0;
+}
+
+#endif
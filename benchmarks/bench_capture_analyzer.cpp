@@ -0,0 +1,318 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures CaptureAnalyzer on a capture of one controller and many
+/// entities.
+///
+/// The controller sends every entity an AEM command every 100 ms. Most
+/// get a response within 5 ms, some are retried with the same
+/// sequence_id after the timeout, some get an IN_PROGRESS response
+/// first, some respond late and some never. Every entity also sends an
+/// unsolicited response every second, advertises every two seconds and
+/// gets an ACMP CONNECT_RX_COMMAND every five seconds.
+///
+/// The capture is analyzed in one range, in one range per thread, and
+/// in many small ranges so that commands cross the ends of the ranges.
+/// All of them have to give the same statistics, and the totals have to
+/// be the ones the capture was made with.
+///
+/// Usage: bench_capture_analyzer [entities] [seconds] [threads]
+///
+
+static Eui48 const controller_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf1 );
+static Eui64 const controller_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf1 );
+
+static Eui64 entityId( uint32_t n ) { return Eui64( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xee, uint8_t( n >> 8 ), uint8_t( n ) ); }
+
+static Eui48 entityMac( uint32_t n ) { return Eui48( 0x70, 0xb3, 0xd5, 0xee, uint8_t( n >> 8 ), uint8_t( n ) ); }
+
+enum Kind
+{
+    KIND_ADP,
+    KIND_COMMAND,
+    KIND_RESPONSE,
+    KIND_IN_PROGRESS,
+    KIND_UNSOLICITED,
+    KIND_CONNECT_RX_COMMAND,
+    KIND_CONNECT_RX_RESPONSE
+};
+
+struct Event
+{
+    uint64_t m_time;
+    uint32_t m_entity;
+    uint16_t m_sequence_id;
+    uint8_t m_kind;
+
+    bool operator<( Event const &other ) const { return m_time < other.m_time; }
+};
+
+/// The totals the capture is made with
+struct Expected
+{
+    uint64_t m_commands;
+    uint64_t m_responses;
+    uint64_t m_timeouts;
+    uint64_t m_retries;
+    uint64_t m_late;
+    uint64_t m_in_progress;
+    uint64_t m_unsolicited;
+    uint64_t m_connects;
+};
+
+static void writeFrame( PcapFileWriter &writer, uint64_t time_in_us, Frame const &frame )
+{
+    uint8_t const *part = frame.getBuf();
+    size_t length = frame.getLength();
+    writer.WritePacketParts( ( uint64_t( 1400000000000000ULL ) + time_in_us ) * 1000, 0, &part, &length, 1 );
+}
+
+static void writeEvent( PcapFileWriter &writer, Event const &event )
+{
+    Eui48 adp_multicast_addr = JDKSAVDECC_MULTICAST_ADP_ACMP_MAC;
+    Eui48 mac = entityMac( event.m_entity );
+    Eui64 id = entityId( event.m_entity );
+
+    if ( event.m_kind == KIND_ADP )
+    {
+        FrameWithSize<82> adp( 0, adp_multicast_addr, mac, JDKSAVDECC_AVTP_ETHERTYPE );
+        adp.putOctet( 0x80 + JDKSAVDECC_SUBTYPE_ADP );
+        adp.putOctet( 0x00 + JDKSAVDECC_ADP_MESSAGE_TYPE_ENTITY_AVAILABLE );
+        adp.putOctet( 10 << 3 );
+        adp.putOctet( JDKSAVDECC_ADPDU_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+        adp.putEUI64( id );
+        adp.putZeros( JDKSAVDECC_ADPDU_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN - 8 );
+        writeFrame( writer, event.m_time, adp );
+    }
+    else if ( event.m_kind == KIND_CONNECT_RX_COMMAND || event.m_kind == KIND_CONNECT_RX_RESPONSE )
+    {
+        FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_ACMPDU_LEN> pdu;
+        jdksavdecc_acmpdu acmpdu;
+        memset( &acmpdu, 0, sizeof( acmpdu ) );
+        acmpdu.header.message_type = event.m_kind == KIND_CONNECT_RX_COMMAND ? JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND
+                                                                             : JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_RESPONSE;
+        acmpdu.controller_entity_id = controller_id;
+        acmpdu.talker_entity_id = entityId( 0 );
+        acmpdu.listener_entity_id = id;
+        acmpdu.sequence_id = event.m_sequence_id;
+        formACMP( &pdu, event.m_kind == KIND_CONNECT_RX_COMMAND ? controller_mac : mac, acmpdu );
+        writeFrame( writer, event.m_time, pdu );
+    }
+    else
+    {
+        bool command = event.m_kind == KIND_COMMAND;
+        FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AECPDU_AEM_LEN> pdu(
+            0, command ? mac : controller_mac, command ? controller_mac : mac, JDKSAVDECC_AVTP_ETHERTYPE );
+        uint8_t status = event.m_kind == KIND_IN_PROGRESS ? JDKSAVDECC_AEM_STATUS_IN_PROGRESS : JDKSAVDECC_AEM_STATUS_SUCCESS;
+        pdu.putOctet( JDKSAVDECC_1722A_SUBTYPE_AECP );
+        pdu.putOctet( command ? JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND : JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE );
+        pdu.putOctet( uint8_t( status << 3 ) );
+        pdu.putOctet( JDKSAVDECC_AECPDU_AEM_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+        pdu.putEUI64( id );
+        pdu.putEUI64( controller_id );
+        pdu.putDoublet( event.m_sequence_id );
+        pdu.putDoublet( event.m_kind == KIND_UNSOLICITED ? uint16_t( 0x8000 | JDKSAVDECC_AEM_COMMAND_GET_CONTROL )
+                                                         : uint16_t( JDKSAVDECC_AEM_COMMAND_GET_CONTROL ) );
+        writeFrame( writer, event.m_time, pdu );
+    }
+}
+
+static Expected makeCapture( char const *name, uint32_t entities, double seconds )
+{
+    Expected expected = {0, 0, 0, 0, 0, 0, 0, 0};
+    std::vector<Event> events;
+    uint64_t end = uint64_t( seconds * 1e6 );
+    uint32_t seed = 1;
+
+    for ( uint32_t n = 0; n < entities; ++n )
+    {
+        uint16_t sequence_id = 0;
+        uint16_t acmp_sequence_id = 0;
+        uint64_t offset = uint64_t( n ) * 997 % 100000;
+
+        // The last second only has the responses of the commands before it
+        for ( uint64_t t = offset; t + 1000000 < end; t += 100000 )
+        {
+            seed = seed * 1103515245 + 12345;
+            uint32_t outcome = ( seed >> 16 ) % 100;
+            uint64_t latency = 200 + ( seed >> 8 ) % 5000;
+            Event command = {t, n, ++sequence_id, KIND_COMMAND};
+            Event response = {t + latency, n, sequence_id, KIND_RESPONSE};
+            events.push_back( command );
+            ++expected.m_commands;
+
+            if ( outcome < 4 )
+            {
+                // Retried after the timeout
+                command.m_time = t + 251000;
+                response.m_time = command.m_time + latency;
+                events.push_back( command );
+                events.push_back( response );
+                ++expected.m_commands;
+                ++expected.m_retries;
+                ++expected.m_timeouts;
+                ++expected.m_responses;
+            }
+            else if ( outcome < 6 )
+            {
+                Event in_progress = {t + 100000, n, sequence_id, KIND_IN_PROGRESS};
+                response.m_time = t + 300000;
+                events.push_back( in_progress );
+                events.push_back( response );
+                ++expected.m_in_progress;
+                ++expected.m_responses;
+            }
+            else if ( outcome < 8 )
+            {
+                response.m_time = t + 400000;
+                events.push_back( response );
+                ++expected.m_late;
+                ++expected.m_timeouts;
+            }
+            else if ( outcome < 10 )
+            {
+                ++expected.m_timeouts;
+            }
+            else
+            {
+                events.push_back( response );
+                ++expected.m_responses;
+            }
+
+            if ( ( t - offset ) % 1000000 == 0 )
+            {
+                Event unsolicited = {t + 50000, n, 0, KIND_UNSOLICITED};
+                events.push_back( unsolicited );
+                ++expected.m_unsolicited;
+            }
+            if ( ( t - offset ) % 2000000 == 0 )
+            {
+                Event adp = {t + 20000, n, 0, KIND_ADP};
+                events.push_back( adp );
+            }
+            if ( ( t - offset ) % 5000000 == 0 )
+            {
+                Event connect = {t + 30000, n, ++acmp_sequence_id, KIND_CONNECT_RX_COMMAND};
+                events.push_back( connect );
+                connect.m_time += 2000 + latency * 3;
+                connect.m_kind = KIND_CONNECT_RX_RESPONSE;
+                events.push_back( connect );
+                ++expected.m_connects;
+            }
+        }
+    }
+    // So that the commands without a response time out before the capture ends
+    Event last = {end, 0, 0, KIND_ADP};
+    events.push_back( last );
+    std::stable_sort( events.begin(), events.end() );
+
+    PcapFileWriter writer( name, PcapFileWriter::Settings() );
+    for ( size_t i = 0; i < events.size(); ++i )
+    {
+        writeEvent( writer, events[i] );
+    }
+    return expected;
+}
+
+static double run( PcapMappedReader const &reader, uint32_t threads, size_t min_packets, CaptureAnalyzer **analyzer )
+{
+    CaptureAnalyzer::Settings settings;
+    settings.m_thread_count = threads;
+    settings.m_min_packets_per_thread = min_packets;
+    *analyzer = new CaptureAnalyzer( reader, settings );
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ( *analyzer )->run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static void report( char const *name, CaptureAnalyzer const &analyzer, double seconds )
+{
+    BenchReport( name, seconds ).rate( double( analyzer.getTotals().m_packets ), "packets/s" )
+        << ", " << analyzer.getShardCount() << " ranges";
+}
+
+static bool check( CaptureAnalyzer const &analyzer, Expected const &expected )
+{
+    Expected found = {0, 0, 0, 0, 0, 0, 0, 0};
+    uint64_t unmatched = 0;
+    CaptureAnalyzer::entities_type const &entities = analyzer.getEntities();
+    for ( CaptureAnalyzer::entities_type::const_iterator i = entities.begin(); i != entities.end(); ++i )
+    {
+        CaptureAnalyzer::EntityStats const &e = i->second;
+        found.m_commands += e.m_aem.m_commands;
+        found.m_responses += e.m_aem.m_responses;
+        found.m_timeouts += e.m_aem.m_timeouts;
+        found.m_retries += e.m_aem.m_retries;
+        found.m_late += e.m_aem.m_late_responses;
+        found.m_in_progress += e.m_aem.m_in_progress;
+        found.m_unsolicited += e.m_unsolicited;
+        found.m_connects += e.m_connect_time.getCount();
+        unmatched += e.m_aem.m_unmatched_responses + e.m_acmp.m_unmatched_responses + e.m_acmp.m_timeouts;
+    }
+
+    bool ok = memcmp( &found, &expected, sizeof( found ) ) == 0 && unmatched == 0;
+    if ( !ok )
+    {
+        std::cout << "Expected " << expected.m_commands << " commands, " << expected.m_responses << " responses, "
+                  << expected.m_timeouts << " timeouts, " << expected.m_retries << " retries, " << expected.m_late << " late, "
+                  << expected.m_in_progress << " in progress, " << expected.m_unsolicited << " unsolicited, "
+                  << expected.m_connects << " connects" << std::endl;
+        std::cout << "Found    " << found.m_commands << " commands, " << found.m_responses << " responses, "
+                  << found.m_timeouts << " timeouts, " << found.m_retries << " retries, " << found.m_late << " late, "
+                  << found.m_in_progress << " in progress, " << found.m_unsolicited << " unsolicited, " << found.m_connects
+                  << " connects, " << unmatched << " unmatched" << std::endl;
+    }
+    return ok;
+}
+
+int main( int argc, char **argv )
+{
+    uint32_t entities = argc > 1 ? uint32_t( atoi( argv[1] ) ) : 200;
+    double seconds = argc > 2 ? atof( argv[2] ) : 600.0;
+    uint32_t threads = argc > 3 ? uint32_t( atoi( argv[3] ) ) : 4;
+    char const *name = "bench_capture_analyzer.pcap";
+
+    Expected expected = makeCapture( name, entities, seconds );
+    bool ok = true;
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        PcapMappedReader reader( name );
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Capture analyzer: " << entities << " entities, " << seconds << " s, " << reader.getPacketCount()
+                  << " packets, indexed in " << std::fixed << std::setprecision( 3 ) << elapsed.count() << " s" << std::endl;
+
+        CaptureAnalyzer *single;
+        double single_seconds = run( reader, 1, 0, &single );
+        report( "single", *single, single_seconds );
+        ok = check( *single, expected ) && ok;
+
+        CaptureAnalyzer *threaded;
+        double threaded_seconds = run( reader, threads, 0, &threaded );
+        report( "threads", *threaded, threaded_seconds );
+        ok = check( *threaded, expected ) && ok;
+
+        CaptureAnalyzer *ranges;
+        double ranges_seconds = run( reader, 64, 0, &ranges );
+        report( "ranges", *ranges, ranges_seconds );
+        ok = check( *ranges, expected ) && ok;
+
+        if ( single->getEntities() != threaded->getEntities() || single->getEntities() != ranges->getEntities() )
+        {
+            std::cout << "The statistics of the entities differ" << std::endl;
+            ok = false;
+        }
+
+        delete single;
+        delete threaded;
+        delete ranges;
+    }
+    remove( name );
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,582 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+#include "jdksavdecc_descriptor_storage.h"
+#include "jdksavdecc_descriptor_storage_gen.h"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures READ_DESCRIPTOR lookups in descriptor storage.
+///
+/// A storage for a large DSP model is made with one configuration full of
+/// AUDIO_CLUSTER, CONTROL, SIGNAL_SELECTOR, MIXER and MATRIX descriptors.
+/// It is written as "AEM1" and, with the generator's descriptor index, as
+/// "AEM2". The same random lookups are then done with:
+///
+/// "file"  : binary search of the table of contents then fseek() and fread()
+/// "buffer": binary search then memcpy() from a buffer
+/// "mmap"  : binary search in the mapped file, no copy
+/// "index" : one perfect hash probe in the mapped "AEM2" file, no copy
+///
+/// The generator then writes the storage with and without pre-built
+/// READ_DESCRIPTOR responses, and an Entity answers the same lookups as
+/// READ_DESCRIPTOR commands:
+///
+/// "copy"    : the descriptor is copied from the storage into the response
+/// "prebuilt": the command's AECP header is sent with the pre-built
+///             response from the storage, no copy
+///
+/// Every CONTROL descriptor has a symbol with a handler. The symbol is read
+/// from the storage and its handler found with:
+///
+/// "sorted"  : binary search of the sorted dispatch table
+/// "hashed"  : one hash probe of the dispatch table
+///
+/// Usage: bench_descriptor_storage [descriptors] [lookups]
+///
+
+struct Descriptor
+{
+    uint16_t m_type;
+    uint16_t m_index;
+    std::vector<uint8_t> m_data;
+};
+
+static std::vector<uint8_t> makeStorage( std::vector<Descriptor> const &descriptors )
+{
+    uint32_t toc_offset = JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH;
+    uint32_t data_offset = toc_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH * uint32_t( descriptors.size() );
+    std::vector<uint8_t> storage( data_offset );
+
+    jdksavdecc_descriptor_storage_header header;
+    header.magic = JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC_VALUE;
+    header.toc_count = uint32_t( descriptors.size() );
+    header.toc_offset = toc_offset;
+    header.symbol_count = 0;
+    header.symbol_offset = 0;
+    header.index_count = 0;
+    header.index_offset = 0;
+    jdksavdecc_descriptor_storage_header_write( &header, &storage[0], 0, storage.size() );
+
+    for ( size_t n = 0; n < descriptors.size(); ++n )
+    {
+        jdksavdecc_descriptor_storage_item item;
+        item.configuration_index = 0;
+        item.descriptor_type = descriptors[n].m_type;
+        item.descriptor_index = descriptors[n].m_index;
+        item.length = uint16_t( descriptors[n].m_data.size() );
+        item.offset = uint32_t( storage.size() );
+        jdksavdecc_descriptor_storage_item_write(
+            &item, &storage[0], toc_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH * n, storage.size() );
+        storage.insert( storage.end(), descriptors[n].m_data.begin(), descriptors[n].m_data.end() );
+    }
+    return storage;
+}
+
+static bool writeFile( char const *file_name, std::vector<uint8_t> const &data )
+{
+    FILE *f = fopen( file_name, "wb" );
+    bool r = f && fwrite( &data[0], 1, data.size(), f ) == data.size();
+    if ( f )
+    {
+        r = fclose( f ) == 0 && r;
+    }
+    return r;
+}
+
+enum Mode
+{
+    MODE_FILE,
+    MODE_BUFFER,
+    MODE_ZERO_COPY
+};
+
+struct Result
+{
+    double m_seconds;
+    uint64_t m_checksum;
+    uint64_t m_found;
+};
+
+static Result run( jdksavdecc_descriptor_storage *storage,
+                   FILE *file,
+                   Mode mode,
+                   std::vector<Descriptor> const &descriptors,
+                   std::vector<uint32_t> const &lookups )
+{
+    Result result;
+    uint8_t buf[JDKSAVDECC_AEM_DESCRIPTOR_SIZE];
+    result.m_checksum = 0;
+    result.m_found = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for ( size_t n = 0; n < lookups.size(); ++n )
+    {
+        // Every eighth lookup is for a descriptor that does not exist
+        uint16_t type = JDKSAVDECC_DESCRIPTOR_CONTROL;
+        uint16_t index = 0xfff0;
+        if ( lookups[n] < descriptors.size() )
+        {
+            type = descriptors[lookups[n]].m_type;
+            index = descriptors[lookups[n]].m_index;
+        }
+
+        uint8_t const *p = 0;
+        uint16_t length = 0;
+
+        if ( mode == MODE_ZERO_COPY )
+        {
+            p = jdksavdecc_descriptor_storage_buffer_get_descriptor( storage, 0, type, index, &length );
+        }
+        else if ( mode == MODE_BUFFER )
+        {
+            length = jdksavdecc_descriptor_storage_buffer_read_descriptor( &storage->base, 0, type, index, buf, sizeof( buf ) );
+            p = length ? buf : 0;
+        }
+        else
+        {
+            jdksavdecc_descriptor_storage_item item;
+            if ( jdksavdecc_descriptor_storage_buffer_find_item( storage, 0, type, index, &item )
+                 && fseek( file, long( item.offset ), SEEK_SET ) == 0 && fread( buf, 1, item.length, file ) == item.length )
+            {
+                length = item.length;
+                p = buf;
+            }
+        }
+
+        if ( p )
+        {
+            ++result.m_found;
+            result.m_checksum += length + p[0] + p[length - 1] * 3;
+        }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.m_seconds = elapsed.count();
+    return result;
+}
+
+/// Counts the READ_DESCRIPTOR responses of an Entity and sums their descriptors the way run() does
+class ResponseCounter : public RawSocket
+{
+  public:
+    ResponseCounter() : m_mac_address( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf1 ), m_octets( 0 )
+    {
+        m_result.m_checksum = 0;
+        m_result.m_found = 0;
+    }
+
+    virtual void setHandlerGroup( HandlerGroup *handler_group ) override { (void)handler_group; }
+
+    virtual jdksavdecc_timestamp_in_milliseconds getTimeInMilliseconds() const override { return 0; }
+
+    virtual bool recvFrame( Frame *frame ) override
+    {
+        (void)frame;
+        return false;
+    }
+
+    virtual bool sendFrame( Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        (void)frame;
+        (void)data1;
+        (void)len1;
+        (void)data2;
+        (void)len2;
+        return false;
+    }
+
+    virtual bool sendReplyFrame( Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        uint8_t const *aecpdu = frame.getBuf() + JDKSAVDECC_FRAME_HEADER_LEN;
+        uint16_t pdu_length = uint16_t( frame.getLength() - JDKSAVDECC_FRAME_HEADER_LEN );
+        m_octets += frame.getLength() + len1 + len2;
+
+        if ( jdksavdecc_common_control_header_get_status( aecpdu, 0 ) == JDKSAVDECC_AEM_STATUS_SUCCESS )
+        {
+            // The descriptor is in the frame or, after configuration_index and reserved, in the first data
+            uint16_t control_data_length = jdksavdecc_common_control_header_get_control_data_length( aecpdu, 0 );
+            uint16_t length = uint16_t( control_data_length + JDKSAVDECC_COMMON_CONTROL_HEADER_LEN
+                                        - JDKSAVDECC_AEM_COMMAND_READ_DESCRIPTOR_RESPONSE_LEN );
+            uint8_t const *p = data1 ? data1 + 4 : aecpdu + JDKSAVDECC_AEM_COMMAND_READ_DESCRIPTOR_RESPONSE_OFFSET_DESCRIPTOR;
+            uint16_t available = data1 ? uint16_t( len1 - 4 )
+                                       : uint16_t( pdu_length - JDKSAVDECC_AEM_COMMAND_READ_DESCRIPTOR_RESPONSE_OFFSET_DESCRIPTOR );
+            if ( length > 0 && length == available )
+            {
+                ++m_result.m_found;
+                m_result.m_checksum += length + p[0] + p[length - 1] * 3;
+            }
+        }
+        (void)data2;
+        return true;
+    }
+
+    virtual bool joinMulticast( const Eui48 &multicast_mac ) override
+    {
+        (void)multicast_mac;
+        return false;
+    }
+
+    virtual Eui48 const &getMACAddress() const override { return m_mac_address; }
+
+    Eui48 m_mac_address;
+    Result m_result;
+    uint64_t m_octets;
+};
+
+/// Make an "AEM2" storage with the generator, with a symbol for every CONTROL
+static std::vector<uint8_t> makeGenStorage( std::vector<Descriptor> const &descriptors, uint32_t flags )
+{
+    std::vector<jdksavdecc_descriptor_storage_gen_descriptor> descriptor_space( descriptors.size() );
+    std::vector<jdksavdecc_descriptor_storage_gen_symbol> symbol_space( descriptors.size() );
+    jdksavdecc_descriptor_storage_gen gen;
+    std::vector<uint8_t> storage;
+
+    jdksavdecc_descriptor_storage_gen_init(
+        &gen, &descriptor_space[0], uint32_t( descriptors.size() ), &symbol_space[0], uint32_t( descriptors.size() ) );
+    gen.flags = flags;
+
+    for ( size_t n = 0; n < descriptors.size(); ++n )
+    {
+        Descriptor const &d = descriptors[n];
+        gen.add_descriptor( &gen, 0, d.m_type, d.m_index, &d.m_data[0], uint16_t( d.m_data.size() ) );
+        if ( d.m_type == JDKSAVDECC_DESCRIPTOR_CONTROL )
+        {
+            gen.add_symbol( &gen, 0, d.m_type, d.m_index, 0x10000 + d.m_index );
+        }
+    }
+
+    storage.resize( jdksavdecc_descriptor_storage_gen_get_export_length( &gen ) );
+    storage.resize( jdksavdecc_descriptor_storage_gen_export_buffer( &gen, &storage[0], uint32_t( storage.size() ) ) );
+    gen.base.destroy( &gen.base );
+    return storage;
+}
+
+static Result runResponses( jdksavdecc_descriptor_storage *storage,
+                            std::vector<Descriptor> const &descriptors,
+                            std::vector<uint32_t> const &lookups,
+                            uint64_t *octets )
+{
+    ResponseCounter net;
+    Eui64 entity_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf1 );
+    ADPManager adp( net, entity_id, ADPCoreInfo( Eui64(), JDKSAVDECC_ADP_ENTITY_CAPABILITY_AEM_SUPPORTED ) );
+    RegisteredControllersStorage<1> registered_controllers;
+    EntityState state;
+    Entity entity( adp, &registered_controllers, &state );
+    FrameWithMTU command;
+
+    state.setDescriptorStorage( storage );
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for ( size_t n = 0; n < lookups.size(); ++n )
+    {
+        uint16_t type = JDKSAVDECC_DESCRIPTOR_CONTROL;
+        uint16_t index = 0xfff0;
+        if ( lookups[n] < descriptors.size() )
+        {
+            type = descriptors[lookups[n]].m_type;
+            index = descriptors[lookups[n]].m_index;
+        }
+
+        // The entity turns the command into its response in place
+        command.setLength( 0 );
+        command.putEUI48( net.getMACAddress() );
+        command.putEUI48( Eui48( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 ) );
+        command.putDoublet( JDKSAVDECC_AVTP_ETHERTYPE );
+        command.putOctet( 0x80 + JDKSAVDECC_SUBTYPE_AECP );
+        command.putOctet( JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND );
+        command.putDoublet( JDKSAVDECC_AEM_COMMAND_READ_DESCRIPTOR_COMMAND_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+        command.putEUI64( entity_id );
+        command.putEUI64( Eui64( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf0 ) );
+        command.putDoublet( uint16_t( n ) );
+        command.putDoublet( JDKSAVDECC_AEM_COMMAND_READ_DESCRIPTOR );
+        command.putDoublet( 0 );
+        command.putDoublet( 0 );
+        command.putDoublet( type );
+        command.putDoublet( index );
+
+        entity.receivedPDU( &net, command );
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    Result result = net.m_result;
+    result.m_seconds = elapsed.count();
+    *octets = net.m_octets;
+    return result;
+}
+
+static uint16_t dispatchControl( void *context,
+                                 jdksavdecc_descriptor_storage *storage,
+                                 uint16_t configuration_number,
+                                 uint16_t descriptor_type,
+                                 uint16_t descriptor_index,
+                                 uint8_t *aecpdu,
+                                 ssize_t pos,
+                                 ssize_t len )
+{
+    (void)storage;
+    (void)configuration_number;
+    (void)descriptor_type;
+    (void)aecpdu;
+    (void)pos;
+    (void)len;
+    *static_cast<uint64_t *>( context ) += descriptor_index;
+    return JDKSAVDECC_AEM_STATUS_SUCCESS;
+}
+
+static Result runDispatch( jdksavdecc_descriptor_storage *storage,
+                           jdksavdecc_descriptor_storage_symbols *symbols,
+                           std::vector<Descriptor> const &descriptors,
+                           std::vector<uint32_t> const &lookups )
+{
+    Result result;
+    result.m_checksum = 0;
+    result.m_found = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for ( size_t n = 0; n < lookups.size(); ++n )
+    {
+        uint16_t type = JDKSAVDECC_DESCRIPTOR_CONTROL;
+        uint16_t index = 0xfff0;
+        uint32_t symbol = 0;
+        if ( lookups[n] < descriptors.size() )
+        {
+            type = descriptors[lookups[n]].m_type;
+            index = descriptors[lookups[n]].m_index;
+        }
+
+        if ( storage->base.read_symbol( &storage->base, 0, type, index, &symbol ) && symbol != 0 )
+        {
+            jdksavdecc_descriptor_storage_symbol_dispatch_proc handler = jdksavdecc_descriptor_storage_symbols_find(
+                symbols, symbol, JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND, JDKSAVDECC_AEM_COMMAND_SET_CONTROL );
+            if ( handler && handler( &result.m_checksum, storage, 0, type, index, 0, 0, 0 ) == JDKSAVDECC_AEM_STATUS_SUCCESS )
+            {
+                ++result.m_found;
+            }
+        }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.m_seconds = elapsed.count();
+    return result;
+}
+
+static void report( char const *name, Result const &result, size_t lookups )
+{
+    BenchReport( name, result.m_seconds ).nanoseconds( double( lookups ), "lookup" ).rate( double( lookups ), "lookups/s" );
+}
+
+int main( int argc, char **argv )
+{
+    uint32_t descriptor_count = argc > 1 ? uint32_t( atoi( argv[1] ) ) : 20000;
+    size_t lookup_count = argc > 2 ? size_t( atoi( argv[2] ) ) : 2000000;
+    static uint16_t const types[] = {JDKSAVDECC_DESCRIPTOR_AUDIO_CLUSTER,
+                                     JDKSAVDECC_DESCRIPTOR_CONTROL,
+                                     JDKSAVDECC_DESCRIPTOR_SIGNAL_SELECTOR,
+                                     JDKSAVDECC_DESCRIPTOR_MIXER,
+                                     JDKSAVDECC_DESCRIPTOR_MATRIX};
+    static size_t const type_count = sizeof( types ) / sizeof( types[0] );
+
+    // Mostly controls. Sorted by type then index, as the table of contents must be
+    std::vector<Descriptor> descriptors;
+    uint32_t seed = 1;
+    for ( size_t t = 0; t < type_count; ++t )
+    {
+        uint32_t count = descriptor_count / 4 / uint32_t( type_count - 1 );
+        if ( types[t] == JDKSAVDECC_DESCRIPTOR_CONTROL )
+        {
+            count = descriptor_count - descriptor_count / 4;
+        }
+        for ( uint32_t i = 0; i < count; ++i )
+        {
+            Descriptor d;
+            d.m_type = types[t];
+            d.m_index = uint16_t( i );
+            seed = seed * 1103515245 + 12345;
+            d.m_data.resize( 64 + ( seed >> 16 ) % 300 );
+            for ( size_t j = 0; j < d.m_data.size(); ++j )
+            {
+                d.m_data[j] = uint8_t( seed + j * 7 );
+            }
+            descriptors.push_back( d );
+        }
+    }
+    if ( descriptor_count > 0xffff || descriptors.empty() )
+    {
+        std::cout << "Bad descriptor count" << std::endl;
+        return 1;
+    }
+
+    std::vector<uint8_t> aem1 = makeStorage( descriptors );
+    std::vector<uint8_t> aem2( aem1.size() + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER2_LENGTH
+                               + jdksavdecc_descriptor_storage_index_get_length( uint32_t( descriptors.size() ) ) + 4 );
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint32_t aem2_length
+        = jdksavdecc_descriptor_storage_gen_add_index( &aem1[0], uint32_t( aem1.size() ), &aem2[0], uint32_t( aem2.size() ) );
+    std::chrono::duration<double> index_time = std::chrono::steady_clock::now() - start;
+    aem2.resize( aem2_length );
+
+    char const *aem1_name = "bench_descriptor_storage_aem1.bin";
+    char const *aem2_name = "bench_descriptor_storage_aem2.bin";
+    if ( !aem2_length || !writeFile( aem1_name, aem1 ) || !writeFile( aem2_name, aem2 ) )
+    {
+        std::cout << "Unable to make the storage files" << std::endl;
+        return 1;
+    }
+
+    std::vector<uint32_t> lookups( lookup_count );
+    for ( size_t n = 0; n < lookup_count; ++n )
+    {
+        seed = seed * 1103515245 + 12345;
+        lookups[n] = ( n % 8 == 7 ) ? uint32_t( descriptors.size() ) : ( seed >> 8 ) % uint32_t( descriptors.size() );
+    }
+
+    std::cout << "Descriptor storage: " << descriptors.size() << " descriptors, " << aem1.size() << " octets, index "
+              << aem2.size() - aem1.size() << " octets built in " << std::setprecision( 3 ) << index_time.count() * 1000.0
+              << " ms, " << lookup_count << " lookups" << std::endl;
+
+    jdksavdecc_descriptor_storage buffer;
+    jdksavdecc_descriptor_storage mapped;
+    jdksavdecc_descriptor_storage indexed;
+    FILE *file = fopen( aem1_name, "rb" );
+    bool ok = file && jdksavdecc_descriptor_storage_buffer_init( &buffer, &aem1[0], uint32_t( aem1.size() ) )
+              && jdksavdecc_descriptor_storage_mmap_init( &mapped, aem1_name )
+              && jdksavdecc_descriptor_storage_mmap_init( &indexed, aem2_name ) && indexed.index_bucket_count > 0;
+
+    if ( ok )
+    {
+        Result results[4];
+        results[0] = run( &buffer, file, MODE_FILE, descriptors, lookups );
+        report( "file", results[0], lookup_count );
+        results[1] = run( &buffer, file, MODE_BUFFER, descriptors, lookups );
+        report( "buffer", results[1], lookup_count );
+        results[2] = run( &mapped, file, MODE_ZERO_COPY, descriptors, lookups );
+        report( "mmap", results[2], lookup_count );
+        results[3] = run( &indexed, file, MODE_ZERO_COPY, descriptors, lookups );
+        report( "index", results[3], lookup_count );
+
+        for ( size_t n = 1; n < 4; ++n )
+        {
+            if ( results[n].m_checksum != results[0].m_checksum || results[n].m_found != results[0].m_found )
+            {
+                std::cout << "Mismatch in result " << n << std::endl;
+                ok = false;
+            }
+        }
+        if ( results[0].m_found != lookup_count - lookup_count / 8 )
+        {
+            std::cout << "Found " << results[0].m_found << " descriptors" << std::endl;
+            ok = false;
+        }
+
+        mapped.base.destroy( &mapped.base );
+        indexed.base.destroy( &indexed.base );
+        buffer.base.destroy( &buffer.base );
+    }
+    else
+    {
+        std::cout << "Unable to open the storage" << std::endl;
+    }
+
+    std::vector<uint8_t> plain = makeGenStorage( descriptors, 0 );
+    std::vector<uint8_t> responses = makeGenStorage( descriptors, JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES );
+    jdksavdecc_descriptor_storage plain_storage;
+    jdksavdecc_descriptor_storage response_storage;
+
+    if ( ok && !plain.empty() && !responses.empty()
+         && jdksavdecc_descriptor_storage_buffer_init( &plain_storage, &plain[0], uint32_t( plain.size() ) )
+         && jdksavdecc_descriptor_storage_buffer_init( &response_storage, &responses[0], uint32_t( responses.size() ) ) )
+    {
+        uint64_t octets[2];
+        Result results[2];
+
+        std::cout << "READ_DESCRIPTOR responses: storage " << plain.size() << " octets, with pre-built responses "
+                  << responses.size() << " octets" << std::endl;
+        results[0] = runResponses( &plain_storage, descriptors, lookups, &octets[0] );
+        report( "copy", results[0], lookup_count );
+        results[1] = runResponses( &response_storage, descriptors, lookups, &octets[1] );
+        report( "prebuilt", results[1], lookup_count );
+
+        if ( results[0].m_checksum != results[1].m_checksum || results[0].m_found != results[1].m_found
+             || results[0].m_found != lookup_count - lookup_count / 8 || octets[0] != octets[1] )
+        {
+            std::cout << "Mismatch in the responses: " << results[0].m_found << " vs " << results[1].m_found << std::endl;
+            ok = false;
+        }
+
+        // One SET_CONTROL handler for each CONTROL symbol
+        uint32_t control_count = descriptor_count - descriptor_count / 4;
+        std::vector<jdksavdecc_descriptor_storage_symbol_dispatch_item> sorted_items( control_count );
+        std::vector<jdksavdecc_descriptor_storage_symbol_dispatch_item> hashed_items( control_count );
+        std::vector<uint16_t> hash_slots( 2 );
+        while ( hash_slots.size() < 2 * control_count )
+        {
+            hash_slots.resize( hash_slots.size() * 2 );
+        }
+        jdksavdecc_descriptor_storage_symbols sorted;
+        jdksavdecc_descriptor_storage_symbols hashed;
+        jdksavdecc_descriptor_storage_symbols_init( &sorted, &sorted_items[0], int( control_count ), 0 );
+        jdksavdecc_descriptor_storage_symbols_init_hashed(
+            &hashed, &hashed_items[0], int( control_count ), &hash_slots[0], int( hash_slots.size() ) );
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for ( uint32_t i = 0; i < control_count; ++i )
+        {
+            jdksavdecc_descriptor_storage_symbols_add( &sorted,
+                                                       i + 1 == control_count,
+                                                       0x10000 + i,
+                                                       JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND,
+                                                       JDKSAVDECC_AEM_COMMAND_SET_CONTROL,
+                                                       dispatchControl );
+        }
+        std::chrono::duration<double> sorted_time = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for ( uint32_t i = 0; i < control_count; ++i )
+        {
+            jdksavdecc_descriptor_storage_symbols_add( &hashed,
+                                                       false,
+                                                       0x10000 + i,
+                                                       JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND,
+                                                       JDKSAVDECC_AEM_COMMAND_SET_CONTROL,
+                                                       dispatchControl );
+        }
+        std::chrono::duration<double> hashed_time = std::chrono::steady_clock::now() - start;
+
+        std::cout << "Symbol dispatch: " << control_count << " handlers, built sorted in " << std::setprecision( 3 )
+                  << sorted_time.count() * 1000.0 << " ms, hashed in " << hashed_time.count() * 1000.0 << " ms" << std::endl;
+        results[0] = runDispatch( &response_storage, &sorted, descriptors, lookups );
+        report( "sorted", results[0], lookup_count );
+        results[1] = runDispatch( &response_storage, &hashed, descriptors, lookups );
+        report( "hashed", results[1], lookup_count );
+
+        if ( results[0].m_checksum != results[1].m_checksum || results[0].m_found != results[1].m_found
+             || results[0].m_found == 0 )
+        {
+            std::cout << "Mismatch in the dispatch: " << results[0].m_found << " vs " << results[1].m_found << std::endl;
+            ok = false;
+        }
+
+        plain_storage.base.destroy( &plain_storage.base );
+        response_storage.base.destroy( &response_storage.base );
+    }
+    else
+    {
+        std::cout << "Unable to generate the storage" << std::endl;
+        ok = false;
+    }
+
+    if ( file )
+    {
+        fclose( file );
+    }
+    remove( aem1_name );
+    remove( aem2_name );
+    return ok ? 0 : 1;
+}
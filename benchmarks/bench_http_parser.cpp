@@ -0,0 +1,104 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures the APS side of the APC CONNECT handshake, as during a
+/// connection storm, with HttpServerParserSimple and with
+/// HttpServerParserInPlace, delivering each request either in one
+/// segment or split in two.
+///
+/// Usage: bench_http_parser [handshakes]
+///
+
+class AcceptingHandler : public HttpServerHandler
+{
+  public:
+    AcceptingHandler() : m_accepted( 0 ) {}
+
+    virtual bool onIncomingHttpConnectRequest( HttpRequest const &request ) override
+    {
+        m_accepted += request.m_path == "/" ? 1 : 0;
+        return true;
+    }
+
+    virtual bool onIncomingHttpRequestHead( HttpHead const &head ) override
+    {
+        m_accepted += head.getMethod().equals( "CONNECT" ) && head.getPath().equals( "/" ) ? 1 : 0;
+        return true;
+    }
+
+    uint64_t m_accepted;
+};
+
+static char const request[] = "CONNECT / HTTP/1.1\r\n"
+                              "Host: aps.local:17221\r\n"
+                              "User-Agent: avdecc-remote/2.1\r\n"
+                              "Accept: */*\r\n"
+                              "Proxy-Connection: Keep-Alive\r\n"
+                              "\r\n";
+
+static double run( HttpServerParser &parser, AcceptingHandler &handler, size_t count, size_t split )
+{
+    uint8_t const *data = reinterpret_cast<uint8_t const *>( request );
+    ssize_t len = ssize_t( sizeof( request ) - 1 );
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+        parser.clear();
+        if ( split )
+        {
+            parser.onIncomingHttpData( data, ssize_t( split ) );
+            parser.onIncomingHttpData( data + split, len - ssize_t( split ) );
+        }
+        else
+        {
+            parser.onIncomingHttpData( data, len );
+        }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static void report( char const *name, double seconds, size_t count, AcceptingHandler const &handler )
+{
+    BenchReport( name, seconds, 16 ).rate( double( count ), "handshakes/s" ) << ( handler.m_accepted != count ? " ERRORS" : "" );
+}
+
+int main( int argc, char **argv )
+{
+    size_t count = argc > 1 ? size_t( atoi( argv[1] ) ) : 1000000;
+    size_t split = ( sizeof( request ) - 1 ) / 2;
+
+    std::cout << "HTTP CONNECT parse: " << count << " handshakes of " << sizeof( request ) - 1 << " octets" << std::endl;
+
+    {
+        AcceptingHandler handler;
+        HttpRequest req;
+        HttpServerParserSimple parser( &req, &handler );
+        report( "simple", run( parser, handler, count, 0 ), count, handler );
+    }
+    {
+        AcceptingHandler handler;
+        HttpServerParserInPlace parser( &handler );
+        report( "in place", run( parser, handler, count, 0 ), count, handler );
+    }
+    {
+        AcceptingHandler handler;
+        HttpRequest req;
+        HttpServerParserSimple parser( &req, &handler );
+        report( "simple split", run( parser, handler, count, split ), count, handler );
+    }
+    {
+        AcceptingHandler handler;
+        HttpServerParserInPlace parser( &handler );
+        report( "in place split", run( parser, handler, count, split ), count, handler );
+    }
+    return 0;
+}
@@ -0,0 +1,312 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures printing AVDECC PDUs as text and as JSON.
+///
+/// The PDUs are ENTITY_AVAILABLE advertisements, READ_DESCRIPTOR
+/// commands and responses and CONNECT_RX_COMMAND messages, in frames
+/// as they come from a capture. They are printed:
+///
+/// "text"  : read and printed with the jdksavdecc_printer functions,
+///           one PDU at a time into one buffer
+/// "ndjson": jdksavdecc_json_printer_print_frame() with one object
+///           per line, flushed to a sink when the buffer is full
+/// "json"  : as "ndjson", as one JSON array
+///
+/// The JSON output has to have one object per PDU, be framed as NDJSON
+/// or as an array and name the command of every AEM PDU.
+///
+/// Usage: bench_json_print [pdus] [buffer_kib]
+///
+
+static Eui48 const entity_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 );
+static Eui64 const entity_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf0 );
+static Eui48 const controller_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf1 );
+static Eui64 const controller_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf1 );
+
+typedef std::vector<uint8_t> Packet;
+
+static Packet toPacket( Frame const &frame ) { return Packet( frame.getBuf(), frame.getBuf() + frame.getLength() ); }
+
+static Packet makeAdp( uint32_t n )
+{
+    Eui48 mac( 0x70, 0xb3, 0xd5, 0xee, uint8_t( n >> 8 ), uint8_t( n ) );
+    FrameWithSize<82> adp( 0, JDKSAVDECC_MULTICAST_ADP_ACMP_MAC, mac, JDKSAVDECC_AVTP_ETHERTYPE );
+    adp.putOctet( JDKSAVDECC_1722A_SUBTYPE_ADP );
+    adp.putOctet( 0x00 + JDKSAVDECC_ADP_MESSAGE_TYPE_ENTITY_AVAILABLE );
+    adp.putOctet( 10 << 3 );
+    adp.putOctet( JDKSAVDECC_ADPDU_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+    adp.putEUI64( Eui64( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xee, uint8_t( n >> 8 ), uint8_t( n ) ) );
+    adp.putEUI64( Eui64( 0x70, 0xb3, 0xd5, 0xed, 0xc0, 0x00, 0x00, 0x01 ) );
+    adp.putQuadlet( JDKSAVDECC_ADP_ENTITY_CAPABILITY_AEM_SUPPORTED | JDKSAVDECC_ADP_ENTITY_CAPABILITY_CLASS_A_SUPPORTED );
+    adp.putDoublet( 2 );
+    adp.putDoublet( JDKSAVDECC_ADP_TALKER_CAPABILITY_IMPLEMENTED | JDKSAVDECC_ADP_TALKER_CAPABILITY_AUDIO_SOURCE );
+    adp.putDoublet( 2 );
+    adp.putDoublet( JDKSAVDECC_ADP_LISTENER_CAPABILITY_IMPLEMENTED | JDKSAVDECC_ADP_LISTENER_CAPABILITY_AUDIO_SINK );
+    adp.putQuadlet( 0 );
+    adp.putQuadlet( n );
+    adp.putZeros( JDKSAVDECC_ADPDU_LEN - ( adp.getLength() - JDKSAVDECC_FRAME_HEADER_LEN ) );
+    return toPacket( adp );
+}
+
+static Packet makeAem( uint8_t message_type, uint16_t sequence_id, uint16_t payload_length )
+{
+    FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AECPDU_AEM_LEN + 512> pdu(
+        0, entity_mac, controller_mac, JDKSAVDECC_AVTP_ETHERTYPE );
+    uint16_t control_data_length = JDKSAVDECC_AECPDU_AEM_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN + payload_length;
+    pdu.putOctet( JDKSAVDECC_1722A_SUBTYPE_AECP );
+    pdu.putOctet( message_type );
+    pdu.putOctet( uint8_t( JDKSAVDECC_AEM_STATUS_SUCCESS << 3 ) | uint8_t( control_data_length >> 8 ) );
+    pdu.putOctet( uint8_t( control_data_length ) );
+    pdu.putEUI64( entity_id );
+    pdu.putEUI64( controller_id );
+    pdu.putDoublet( sequence_id );
+    pdu.putDoublet( JDKSAVDECC_AEM_COMMAND_READ_DESCRIPTOR );
+    for ( uint16_t i = 0; i < payload_length; ++i )
+    {
+        pdu.putOctet( uint8_t( i * 7 + sequence_id ) );
+    }
+    return toPacket( pdu );
+}
+
+static Packet makeAcmp( uint16_t sequence_id )
+{
+    FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_ACMPDU_LEN> acmp(
+        0, JDKSAVDECC_MULTICAST_ADP_ACMP_MAC, controller_mac, JDKSAVDECC_AVTP_ETHERTYPE );
+    acmp.putOctet( JDKSAVDECC_1722A_SUBTYPE_ACMP );
+    acmp.putOctet( JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND );
+    acmp.putOctet( 0 );
+    acmp.putOctet( JDKSAVDECC_ACMPDU_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+    acmp.putEUI64( Eui64( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xee, 0x00, 0x01 ) );
+    acmp.putEUI64( controller_id );
+    acmp.putEUI64( Eui64( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xee, 0x00, 0x01 ) );
+    acmp.putEUI64( entity_id );
+    acmp.putDoublet( 0 );
+    acmp.putDoublet( 1 );
+    acmp.putEUI48( Eui48( 0x91, 0xe0, 0xf0, 0x00, 0x01, 0x02 ) );
+    acmp.putDoublet( 0 );
+    acmp.putDoublet( sequence_id );
+    acmp.putDoublet( JDKSAVDECC_ACMP_FLAG_CLASS_B | JDKSAVDECC_ACMP_FLAG_STREAMING_WAIT );
+    acmp.putDoublet( 2 );
+    acmp.putDoublet( 0 );
+    return toPacket( acmp );
+}
+
+/// Eight PDUs in every group: two advertisements, three commands, two responses and one ACMP message
+static std::vector<Packet> makePackets( size_t count, size_t *aem_count )
+{
+    std::vector<Packet> packets;
+    *aem_count = 0;
+    for ( size_t n = 0; n < count; ++n )
+    {
+        uint16_t sequence_id = uint16_t( n / 8 );
+        switch ( n % 8 )
+        {
+        case 0:
+        case 4:
+            packets.push_back( makeAdp( uint32_t( n % 64 ) ) );
+            break;
+        case 1:
+        case 3:
+        case 5:
+            packets.push_back( makeAem( JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND, sequence_id, 4 ) );
+            ++*aem_count;
+            break;
+        case 2:
+        case 6:
+            packets.push_back( makeAem( JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE, sequence_id, 100 + uint16_t( n % 200 ) ) );
+            ++*aem_count;
+            break;
+        default:
+            packets.push_back( makeAcmp( sequence_id ) );
+            break;
+        }
+    }
+    return packets;
+}
+
+static uint64_t packetTime( size_t n ) { return uint64_t( 1400000000 ) * 1000000 + uint64_t( n ) * 125; }
+
+static void report( char const *name, double seconds, size_t pdus, uint64_t octets )
+{
+    BenchReport( name, seconds ).rate( double( pdus ), "PDUs/s" ).mebibytes( double( octets ) );
+}
+
+static uint64_t runText( std::vector<Packet> const &packets )
+{
+    std::vector<char> buf( 16384 );
+    jdksavdecc_printer printer;
+    uint64_t octets = 0;
+
+    for ( size_t n = 0; n < packets.size(); ++n )
+    {
+        uint8_t const *p = &packets[n][0];
+        size_t len = packets[n].size();
+        ssize_t pos = JDKSAVDECC_FRAME_HEADER_LEN;
+
+        jdksavdecc_printer_init( &printer, &buf[0], buf.size() );
+        switch ( p[pos] )
+        {
+        case JDKSAVDECC_1722A_SUBTYPE_ADP:
+        {
+            jdksavdecc_adpdu adpdu;
+            if ( jdksavdecc_adpdu_read( &adpdu, p, pos, len ) > 0 )
+            {
+                jdksavdecc_adpdu_print( &printer, &adpdu );
+            }
+            break;
+        }
+        case JDKSAVDECC_1722A_SUBTYPE_ACMP:
+        {
+            jdksavdecc_acmpdu acmpdu;
+            if ( jdksavdecc_acmpdu_read( &acmpdu, p, pos, len ) > 0 )
+            {
+                jdksavdecc_acmpdu_print( &printer, &acmpdu );
+            }
+            break;
+        }
+        default:
+        {
+            jdksavdecc_aecpdu_common aecpdu;
+            if ( jdksavdecc_aecpdu_common_read( &aecpdu, p, pos, len ) > 0 )
+            {
+                jdksavdecc_aecp_print( &printer, &aecpdu, p, pos, len );
+            }
+            break;
+        }
+        }
+        octets += printer.pos;
+    }
+    return octets;
+}
+
+/// Where the JSON printer flushes to, checking the output as it goes
+struct Sink
+{
+    Sink( std::string const &expected ) : m_expected( expected ), m_octets( 0 ), m_lines( 0 ), m_matches( 0 ), m_bad_lines( 0 ) {}
+
+    static int flush( void *context, char const *buf, size_t len )
+    {
+        Sink *self = static_cast<Sink *>( context );
+        if ( self->m_head.size() < 2 )
+        {
+            self->m_head.append( buf, std::min( len, size_t( 2 ) - self->m_head.size() ) );
+        }
+        self->m_tail.append( buf, len );
+        if ( self->m_tail.size() > 3 )
+        {
+            self->m_tail.erase( 0, self->m_tail.size() - 3 );
+        }
+
+        /* A flush can come between an array element and the "," after it, so lines are checked across flushes */
+        char const *line = buf;
+        char const *end = buf + len;
+        while ( line < end )
+        {
+            char const *eol = static_cast<char const *>( memchr( line, '\n', size_t( end - line ) ) );
+            if ( eol != line )
+            {
+                self->m_line.append( line, size_t( ( eol ? eol : end ) - line ) );
+            }
+            if ( !eol )
+            {
+                break;
+            }
+            self->checkLine();
+            line = eol + 1;
+        }
+
+        for ( char const *p = buf; ( p = std::search( p, end, self->m_expected.begin(), self->m_expected.end() ) ) != end;
+              p += self->m_expected.size() )
+        {
+            ++self->m_matches;
+        }
+        self->m_octets += len;
+        return 1;
+    }
+
+    /// A record is a well formed object, followed by a "," in an array, or the "[" or "]" around the array
+    void checkLine()
+    {
+        std::string const &v = m_line;
+        size_t n = v.size();
+        bool object = n > 1 && v[0] == '{' && ( v[n - 1] == '}' || ( v[n - 1] == ',' && v[n - 2] == '}' ) );
+        if ( ( !object && v != "[" && v != "]" ) || v.find( "\"malformed\"" ) != std::string::npos )
+        {
+            ++m_bad_lines;
+        }
+        ++m_lines;
+        m_line.clear();
+    }
+
+    std::string m_expected;
+    uint64_t m_octets;
+    uint64_t m_lines;
+    uint64_t m_matches;
+    uint64_t m_bad_lines;
+    std::string m_head;
+    std::string m_tail;
+    std::string m_line;
+};
+
+static bool runJson( char const *name, std::vector<Packet> const &packets, size_t buffer_kib, bool ndjson, size_t aem_count )
+{
+    std::vector<char> buf( buffer_kib * 1024 );
+    Sink sink( "\"command_type\":\"READ_DESCRIPTOR\"" );
+    jdksavdecc_json_printer printer;
+    size_t printed = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    jdksavdecc_json_printer_init( &printer, &buf[0], buf.size(), ndjson ? 1 : 0, Sink::flush, &sink );
+    for ( size_t n = 0; n < packets.size(); ++n )
+    {
+        printed += size_t(
+            jdksavdecc_json_printer_print_frame( &printer, packetTime( n ), &packets[n][0], packets[n].size() ) );
+    }
+    jdksavdecc_json_printer_finish( &printer );
+    report( name, benchSince( start ), packets.size(), sink.m_octets );
+
+    /* NDJSON has a line per PDU, the array one more for "[" and one for "]" */
+    uint64_t lines = packets.size() + ( ndjson ? 0 : 2 );
+    bool framed = ndjson ? sink.m_tail[2] == '\n' : sink.m_head == "[\n" && sink.m_tail == "\n]\n";
+    bool ok = printed == packets.size() && printer.count == packets.size() && sink.m_lines == lines && framed
+              && sink.m_bad_lines == 0 && sink.m_matches == aem_count && printer.flush_errors == 0;
+    if ( !ok )
+    {
+        std::cout << name << ": " << printed << " printed, " << sink.m_lines << " lines, " << sink.m_bad_lines << " bad, "
+                  << sink.m_matches << " AEM PDUs, framed " << framed << std::endl;
+    }
+    return ok;
+}
+
+int main( int argc, char **argv )
+{
+    size_t count = argc > 1 ? size_t( atoi( argv[1] ) ) : 2000000;
+    size_t buffer_kib = argc > 2 ? size_t( atoi( argv[2] ) ) : 256;
+    size_t aem_count;
+    bool ok = true;
+
+    std::vector<Packet> packets = makePackets( count, &aem_count );
+    std::cout << "print: " << count << " PDUs, " << buffer_kib << " KiB buffer" << std::endl;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t octets = runText( packets );
+    report( "text", benchSince( start ), packets.size(), octets );
+
+    ok = runJson( "ndjson", packets, buffer_kib, true, aem_count ) && ok;
+    ok = runJson( "json", packets, buffer_kib, false, aem_count ) && ok;
+
+    /* A command as it is printed */
+    char line[JDKSAVDECC_JSON_PRINTER_MIN_BUFFER];
+    jdksavdecc_json_printer printer;
+    jdksavdecc_json_printer_init( &printer, line, sizeof( line ), 1, 0, 0 );
+    jdksavdecc_json_printer_print_frame( &printer, packetTime( 0 ), &packets[1][0], packets[1].size() );
+    std::cout << line;
+
+    return ok ? 0 : 1;
+}
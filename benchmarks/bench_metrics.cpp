@@ -0,0 +1,349 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+#include <sstream>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures the cost of the metrics of HandlerGroup, Entity and RawSocket
+/// and checks what they count.
+///
+/// A HandlerGroup with a handler that handles nothing, an Entity and its
+/// ADPManager receives AEM commands: SET_CONTROL commands to controls
+/// that exist and that do not, GET_NAME commands that the entity does
+/// not implement, and commands to another entity that the ADPManager
+/// takes.
+///
+/// "direct"   : Entity::receivedPDU() of the frames, no HandlerGroup
+/// "group"    : HandlerGroup::receivedPDU() of the same frames
+/// "record"   : MetricsHistogram::record() alone
+///
+/// The difference between "group" and "direct" is the cost of the
+/// dispatch, build with -DMETRICS=OFF to compare it without the metrics.
+/// Only one in JDKSAVDECCMCU_METRICS_LATENCY_SAMPLE_INTERVAL frames is
+/// timed.
+/// The counts of the snapshot have to match the frames that were sent and
+/// the Prometheus text has to be well formed.
+///
+/// Usage: bench_metrics [frames] [--prometheus]
+///
+
+static Eui48 const entity_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 );
+static Eui64 const entity_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf0 );
+static Eui64 const other_entity_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf2 );
+static Eui48 const controller_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf1 );
+static Eui64 const controller_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf1 );
+
+static uint16_t const control_count = 8;
+
+enum Kind
+{
+    KIND_SET_CONTROL,
+    KIND_SET_MISSING_CONTROL,
+    KIND_GET_NAME,
+    KIND_OTHER_ENTITY,
+    KIND_COUNT
+};
+
+static void putCommand( FixedBuffer &buf, Kind kind, uint16_t sequence_id )
+{
+    uint16_t command_type = kind == KIND_GET_NAME ? JDKSAVDECC_AEM_COMMAND_GET_NAME : JDKSAVDECC_AEM_COMMAND_SET_CONTROL;
+    buf.putEUI48( entity_mac );
+    buf.putEUI48( controller_mac );
+    buf.putDoublet( JDKSAVDECC_AVTP_ETHERTYPE );
+    buf.putOctet( JDKSAVDECC_1722A_SUBTYPE_AECP );
+    buf.putOctet( JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND );
+    buf.putDoublet( JDKSAVDECC_AEM_COMMAND_SET_CONTROL_COMMAND_LEN + 2 - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+    buf.putEUI64( kind == KIND_OTHER_ENTITY ? other_entity_id : entity_id );
+    buf.putEUI64( controller_id );
+    buf.putDoublet( sequence_id );
+    buf.putDoublet( command_type );
+    buf.putDoublet( JDKSAVDECC_DESCRIPTOR_CONTROL );
+    buf.putDoublet( kind == KIND_SET_MISSING_CONTROL ? control_count : uint16_t( sequence_id % control_count ) );
+    buf.putDoublet( sequence_id );
+}
+
+/// Takes the responses of the Entity and counts them as sent
+class ResponseSocket : public RawSocket
+{
+  public:
+    ResponseSocket() : m_now( 0 ) {}
+
+    virtual void setHandlerGroup( HandlerGroup *handler_group ) override { (void)handler_group; }
+
+    virtual jdksavdecc_timestamp_in_milliseconds getTimeInMilliseconds() const override { return m_now; }
+
+    virtual bool recvFrame( Frame *frame ) override
+    {
+        (void)frame;
+        return false;
+    }
+
+    virtual bool sendFrame( Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        (void)data1;
+        (void)data2;
+        countTxFrame( frame, len1, len2 );
+        return true;
+    }
+
+    virtual bool sendReplyFrame( Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        return sendFrame( frame, data1, len1, data2, len2 );
+    }
+
+    virtual bool joinMulticast( const Eui48 &multicast_mac ) override
+    {
+        (void)multicast_mac;
+        return false;
+    }
+
+    virtual Eui48 const &getMACAddress() const override { return entity_mac; }
+
+    jdksavdecc_timestamp_in_milliseconds m_now;
+};
+
+/// An entity state with doublet controls set by SET_CONTROL
+class ControlsState : public EntityState
+{
+  public:
+    ControlsState() : m_sum( 0 ) {}
+
+    virtual uint8_t receiveSetControlCommand( Frame &pdu, uint16_t descriptor_index ) override
+    {
+        uint8_t status = JDKSAVDECC_AEM_STATUS_NO_SUCH_DESCRIPTOR;
+        if ( descriptor_index < control_count )
+        {
+            m_sum += pdu.getDoublet( JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_SET_CONTROL_COMMAND_OFFSET_VALUES );
+            status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+        }
+        return status;
+    }
+
+    uint64_t m_sum;
+};
+
+/// Handles nothing, so that every frame goes on to the next handlers
+class PassHandler : public Handler
+{
+  public:
+    virtual bool receivedPDU( RawSocket *incoming_socket, Frame &frame ) override
+    {
+        (void)incoming_socket;
+        (void)frame;
+        return false;
+    }
+};
+
+static void report( char const *name, double seconds, size_t count )
+{
+    BenchReport( name, seconds ).nanoseconds( double( count ), "frame" );
+}
+
+/// The frames of one kind among n frames
+static size_t countOf( Kind kind, size_t frames ) { return frames / KIND_COUNT + ( size_t( kind ) < frames % KIND_COUNT ); }
+
+static bool check( char const *what, uint64_t value, uint64_t expected )
+{
+    if ( value != expected )
+    {
+        std::cout << what << ": " << value << ", expected " << expected << std::endl;
+    }
+    return value == expected;
+}
+
+#if JDKSAVDECCMCU_ENABLE_METRICS
+
+/// Every line is a comment or "name{labels} value", the buckets of a histogram never go down
+static bool checkPrometheus( std::string const &text )
+{
+    std::istringstream lines( text );
+    std::string line;
+    uint64_t previous_bucket = 0;
+    size_t samples = 0;
+    while ( std::getline( lines, line ) )
+    {
+        if ( line.empty() || line[0] == '#' )
+        {
+            continue;
+        }
+        size_t close = line.rfind( "} " );
+        if ( line.find( '{' ) == std::string::npos || close == std::string::npos )
+        {
+            std::cout << "Malformed sample: " << line << std::endl;
+            return false;
+        }
+        char *end;
+        double value = strtod( line.c_str() + close + 2, &end );
+        if ( *end != '\0' || value < 0 )
+        {
+            std::cout << "Malformed value: " << line << std::endl;
+            return false;
+        }
+        if ( line.find( "_bucket{" ) == std::string::npos )
+        {
+            previous_bucket = 0;
+        }
+        else if ( uint64_t( value ) < previous_bucket )
+        {
+            std::cout << "Bucket count goes down: " << line << std::endl;
+            return false;
+        }
+        else
+        {
+            previous_bucket = uint64_t( value );
+        }
+        ++samples;
+    }
+    return samples > 0;
+}
+
+#endif
+
+int main( int argc, char **argv )
+{
+    size_t frames = 2000000;
+    bool prometheus = false;
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( strcmp( argv[i], "--prometheus" ) == 0 )
+        {
+            prometheus = true;
+        }
+        else
+        {
+            frames = size_t( atoi( argv[i] ) );
+        }
+    }
+    bool ok = true;
+
+    std::vector<FrameWithMTU> commands( 64 );
+    for ( size_t i = 0; i < commands.size(); ++i )
+    {
+        putCommand( commands[i], Kind( i % KIND_COUNT ), uint16_t( i ) );
+    }
+    FrameWithMTU frame;
+
+    ResponseSocket net;
+    ADPManager adp( net, entity_id, ADPCoreInfo( Eui64(), JDKSAVDECC_ADP_ENTITY_CAPABILITY_AEM_SUPPORTED ) );
+    RegisteredControllersStorage<1> registered_controllers;
+    ControlsState state;
+    Entity entity( adp, &registered_controllers, &state );
+    PassHandler pass;
+    HandlerGroupWithSize<3> handlers( &frame );
+    handlers.add( &pass );
+    handlers.add( &entity );
+    handlers.add( &adp );
+
+    std::cout << "metrics: " << frames << " frames, metrics " << ( JDKSAVDECCMCU_ENABLE_METRICS ? "enabled" : "disabled" )
+              << std::endl;
+
+    // The entity turns each command into its response in place, so it is copied first
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for ( size_t n = 0; n < frames; ++n )
+    {
+        frame.setLength( 0 );
+        frame.putBuf( commands[n % commands.size()].getBuf(), commands[n % commands.size()].getLength() );
+        entity.receivedPDU( &net, frame );
+    }
+    report( "direct", benchSince( start ), frames );
+    uint64_t direct_sum = state.m_sum;
+    state.m_sum = 0;
+
+    start = std::chrono::steady_clock::now();
+    for ( size_t n = 0; n < frames; ++n )
+    {
+        frame.setLength( 0 );
+        frame.putBuf( commands[n % commands.size()].getBuf(), commands[n % commands.size()].getLength() );
+        handlers.receivedPDU( &net, frame );
+    }
+    report( "group", benchSince( start ), frames );
+    ok = check( "control sum", state.m_sum, direct_sum ) && ok;
+
+    size_t answered = frames - countOf( KIND_OTHER_ENTITY, frames );
+    ok = check( "rx count", handlers.getRxCount(), frames ) && ok;
+    ok = check( "handled count", handlers.getHandledCount(), frames ) && ok;
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    // Every command to the entity is answered
+    ok = check( "tx frames", net.getTxFrameCount(), 2 * answered ) && ok;
+#else
+    (void)answered;
+#endif
+
+    // A command that is never answered times out
+    entity.sendCommand( controller_id, controller_mac, JDKSAVDECC_AEM_COMMAND_GET_NAME );
+    ok = check( "commands in flight", entity.getCommandsInFlight(), 1 ) && ok;
+    net.m_now += JDKSAVDECC_AEM_TIMEOUT_IN_MS + 1;
+    handlers.tick( net.m_now );
+    ok = check( "commands in flight after the timeout", entity.getCommandsInFlight(), 0 ) && ok;
+
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    {
+        MetricsHistogram histogram;
+        start = std::chrono::steady_clock::now();
+        for ( size_t n = 0; n < frames; ++n )
+        {
+            histogram.record( ( n * 2654435761u ) & 0xfffff );
+        }
+        report( "record", benchSince( start ), frames );
+        ok = check( "histogram count", histogram.getCount(), frames ) && ok;
+    }
+
+    MetricsSnapshot snapshot;
+    snapshot.addHandlerGroup( "main", handlers );
+    snapshot.addEntity( "entity", entity );
+    snapshot.addRawSocket( "net", net );
+
+    MetricsSnapshot::HandlerGroupEntry const &group = snapshot.m_handler_groups[0];
+    MetricsHistogram const &latency = group.m_latency;
+    std::cout << "group latency: p50 " << latency.getPercentile( 50 ) << " ns, p99 " << latency.getPercentile( 99 )
+              << " ns, p99.9 " << latency.getPercentile( 99.9 ) << " ns, max " << latency.getMax() << " ns" << std::endl;
+
+    ok = check( "latency count", latency.getCount(), frames / JDKSAVDECCMCU_METRICS_LATENCY_SAMPLE_INTERVAL ) && ok;
+    ok = check( "handlers", group.m_handlers.size(), 3 ) && ok;
+    if ( group.m_handlers.size() == 3 )
+    {
+        ok = check( "pass invocations", group.m_handlers[0].m_invocations, frames ) && ok;
+        ok = check( "pass handled", group.m_handlers[0].m_handled, 0 ) && ok;
+        ok = check( "entity invocations", group.m_handlers[1].m_invocations, frames ) && ok;
+        ok = check( "entity handled", group.m_handlers[1].m_handled, answered ) && ok;
+        ok = check( "adp invocations", group.m_handlers[2].m_invocations, frames - answered ) && ok;
+    }
+
+    // The direct and the grouped frames are both counted by the entity
+    EntityMetrics const &metrics = snapshot.m_entities[0].m_metrics;
+    size_t set_control = 2 * ( countOf( KIND_SET_CONTROL, frames ) + countOf( KIND_SET_MISSING_CONTROL, frames ) );
+    size_t get_name = 2 * countOf( KIND_GET_NAME, frames );
+    ok = check( "SET_CONTROL commands", metrics.m_aem_commands[JDKSAVDECC_AEM_COMMAND_SET_CONTROL], set_control ) && ok;
+    ok = check( "SET_CONTROL failures",
+                metrics.m_aem_failures[JDKSAVDECC_AEM_COMMAND_SET_CONTROL],
+                2 * countOf( KIND_SET_MISSING_CONTROL, frames ) )
+         && ok;
+    ok = check( "GET_NAME commands", metrics.m_aem_commands[JDKSAVDECC_AEM_COMMAND_GET_NAME], get_name ) && ok;
+    ok = check( "GET_NAME failures", metrics.m_aem_failures[JDKSAVDECC_AEM_COMMAND_GET_NAME], get_name ) && ok;
+    ok = check( "commands sent", metrics.m_commands_sent, 1 ) && ok;
+    ok = check( "command timeouts", metrics.m_command_timeouts, 1 ) && ok;
+    ok = check( "snapshot tx frames", snapshot.m_raw_sockets[0].m_tx_frames, net.getTxFrameCount() ) && ok;
+
+    std::ostringstream text;
+    snapshot.writePrometheus( text );
+    if ( !checkPrometheus( text.str() ) )
+    {
+        ok = false;
+    }
+    if ( prometheus )
+    {
+        std::cout << text.str();
+    }
+#else
+    (void)prometheus;
+#endif
+
+    if ( !ok )
+    {
+        std::cout << "Mismatch" << std::endl;
+    }
+    return ok ? 0 : 1;
+}
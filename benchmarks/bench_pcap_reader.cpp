@@ -0,0 +1,243 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures reading captures with PcapFileReader and PcapMappedReader.
+///
+/// The same AVDECC sized packets are written as a pcap file and as a
+/// pcapng file whose packets alternate between a microsecond and a
+/// nanosecond interface. Then:
+///
+/// "fread"   : PcapFileReader reads the pcap file, one copy per packet
+/// "index"   : PcapMappedReader maps and indexes the file
+/// "iterate" : readPacket() goes through the mapped file, no copy
+/// "seek"    : random seekToTime() and readPacket() in the mapped file
+///
+/// Every way of reading has to see the same timestamps and octets.
+///
+/// Usage: bench_pcap_reader [packets] [seeks]
+///
+
+static const uint16_t sizes[] = {64, 82, 90, 128, 300, 524, 1514};
+static const size_t size_count = sizeof( sizes ) / sizeof( sizes[0] );
+
+static void put32( std::vector<uint8_t> &v, uint32_t x )
+{
+    v.insert( v.end(), reinterpret_cast<uint8_t const *>( &x ), reinterpret_cast<uint8_t const *>( &x ) + 4 );
+}
+
+static void put16( std::vector<uint8_t> &v, uint16_t x )
+{
+    v.insert( v.end(), reinterpret_cast<uint8_t const *>( &x ), reinterpret_cast<uint8_t const *>( &x ) + 2 );
+}
+
+static uint64_t packetTime( size_t n ) { return uint64_t( 1400000000 ) * 1000000 + n * 125 + ( n % 7 ); }
+
+static void putPacket( std::vector<uint8_t> &v, size_t n )
+{
+    uint16_t size = sizes[n % size_count];
+    for ( uint16_t i = 0; i < size; ++i )
+    {
+        v.push_back( uint8_t( i ^ n ) );
+    }
+}
+
+static void writeFile( char const *name, std::vector<uint8_t> const &v )
+{
+    FILE *f = fopen( name, "wb" );
+    if ( !f || fwrite( &v[0], v.size(), 1, f ) != 1 )
+    {
+        throw std::runtime_error( std::string( "Error writing " ) + name );
+    }
+    fclose( f );
+}
+
+static void makePcap( char const *name, size_t packets )
+{
+    std::vector<uint8_t> v;
+    put32( v, 0xa1b2c3d4 );
+    put16( v, 2 );
+    put16( v, 4 );
+    put32( v, 0 );
+    put32( v, 0 );
+    put32( v, 65535 );
+    put32( v, 1 );
+
+    for ( size_t n = 0; n < packets; ++n )
+    {
+        uint64_t t = packetTime( n );
+        put32( v, uint32_t( t / 1000000 ) );
+        put32( v, uint32_t( t % 1000000 ) );
+        put32( v, sizes[n % size_count] );
+        put32( v, sizes[n % size_count] );
+        putPacket( v, n );
+    }
+    writeFile( name, v );
+}
+
+static void makePcapng( char const *name, size_t packets )
+{
+    std::vector<uint8_t> v;
+
+    put32( v, 0x0a0d0d0a );
+    put32( v, 28 );
+    put32( v, 0x1a2b3c4d );
+    put16( v, 1 );
+    put16( v, 0 );
+    put32( v, 0xffffffff );
+    put32( v, 0xffffffff );
+    put32( v, 28 );
+
+    put32( v, 1 );
+    put32( v, 20 );
+    put16( v, 1 );
+    put16( v, 0 );
+    put32( v, 65535 );
+    put32( v, 20 );
+
+    put32( v, 1 );
+    put32( v, 32 );
+    put16( v, 1 );
+    put16( v, 0 );
+    put32( v, 65535 );
+    put16( v, 9 );
+    put16( v, 1 );
+    put32( v, 9 );
+    put32( v, 0 );
+    put32( v, 32 );
+
+    for ( size_t n = 0; n < packets; ++n )
+    {
+        uint32_t interface = uint32_t( n & 1 );
+        uint64_t t = packetTime( n ) * ( interface ? 1000 : 1 );
+        uint32_t size = sizes[n % size_count];
+        uint32_t block_length = 32 + ( ( size + 3 ) & ~3 );
+        put32( v, 6 );
+        put32( v, block_length );
+        put32( v, interface );
+        put32( v, uint32_t( t >> 32 ) );
+        put32( v, uint32_t( t ) );
+        put32( v, size );
+        put32( v, size );
+        putPacket( v, n );
+        v.resize( v.size() + ( ( 4 - size % 4 ) & 3 ) );
+        put32( v, block_length );
+    }
+    writeFile( name, v );
+}
+
+static uint64_t checksum( uint64_t sum, uint64_t timestamp, uint8_t const *data, size_t len )
+{
+    sum = sum * 31 + timestamp + len;
+    size_t i = 0;
+    for ( ; i + 8 <= len; i += 8 )
+    {
+        uint64_t word;
+        memcpy( &word, data + i, 8 );
+        sum += word;
+    }
+    for ( ; i < len; ++i )
+    {
+        sum = sum * 31 + data[i];
+    }
+    return sum;
+}
+
+static void report( char const *name, double seconds, size_t count, uint64_t octets )
+{
+    BenchReport( name, seconds, 10 ).mebibytes( double( octets ) ).nanoseconds( double( count ), "packet" );
+}
+
+static bool runMapped( char const *name, size_t packets, size_t seeks, uint64_t expected_sum )
+{
+    bool ok = true;
+    uint64_t octets = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    PcapMappedReader reader( name );
+    report( "index", benchSince( start ), packets, 0 );
+
+    start = std::chrono::steady_clock::now();
+    uint64_t sum = 0;
+    uint64_t timestamp;
+    uint8_t *data;
+    uint32_t len;
+    while ( reader.readPacket( &timestamp, &data, &len ) )
+    {
+        sum = checksum( sum, timestamp, data, len );
+        octets += len;
+    }
+    report( "iterate", benchSince( start ), packets, octets );
+
+    if ( reader.getPacketCount() != packets || sum != expected_sum )
+    {
+        std::cout << "Mismatch: " << reader.getPacketCount() << " packets" << std::endl;
+        ok = false;
+    }
+
+    uint64_t last = reader.getTimestamp( packets - 1 );
+    uint32_t seed = 1;
+    octets = 0;
+    start = std::chrono::steady_clock::now();
+    for ( size_t n = 0; n < seeks; ++n )
+    {
+        seed = seed * 1103515245 + 12345;
+        uint64_t target = uint64_t( seed ) % ( last + 1 );
+        size_t found = reader.seekToTime( target );
+        if ( !reader.readPacket( &timestamp, &data, &len ) || timestamp < target
+             || ( found > 0 && reader.getTimestamp( found - 1 ) >= target ) )
+        {
+            std::cout << "Seek to " << target << " found packet " << found << std::endl;
+            ok = false;
+            break;
+        }
+        octets += len;
+    }
+    report( "seek", benchSince( start ), seeks, octets );
+    return ok;
+}
+
+int main( int argc, char **argv )
+{
+    size_t packets = argc > 1 ? size_t( atoi( argv[1] ) ) : 2000000;
+    size_t seeks = argc > 2 ? size_t( atoi( argv[2] ) ) : 1000000;
+    char const *pcap_name = "bench_pcap_reader.pcap";
+    char const *pcapng_name = "bench_pcap_reader.pcapng";
+    bool ok = true;
+
+    makePcap( pcap_name, packets );
+    makePcapng( pcapng_name, packets );
+
+    std::cout << "pcap: " << packets << " packets" << std::endl;
+
+    uint64_t expected_sum = 0;
+    uint64_t octets = 0;
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        PcapFileReader reader( pcap_name );
+        PcapFilePacket packet;
+        uint64_t timestamp;
+        size_t count = 0;
+        while ( reader.ReadPacket( &timestamp, packet ) )
+        {
+            expected_sum = checksum( expected_sum, timestamp, &packet[0], packet.size() );
+            octets += packet.size();
+            ++count;
+        }
+        report( "fread", benchSince( start ), count, octets );
+        ok = count == packets;
+    }
+
+    ok = runMapped( pcap_name, packets, seeks, expected_sum ) && ok;
+
+    std::cout << "pcapng: " << packets << " packets" << std::endl;
+    ok = runMapped( pcapng_name, packets, seeks, expected_sum ) && ok;
+
+    remove( pcap_name );
+    remove( pcapng_name );
+    return ok ? 0 : 1;
+}
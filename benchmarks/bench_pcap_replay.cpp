@@ -0,0 +1,267 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Replays a long capture against an Entity with RawSocketPcapFile.
+///
+/// The capture has the ENTITY_AVAILABLE advertisements of other
+/// entities every two seconds, an AEM ENTITY_AVAILABLE command to the
+/// Entity every second and an IPv4 frame every ten seconds, which is
+/// skipped. It is replayed two ways:
+///
+/// "polled": the loop of the examples, every getTimeInMilliseconds()
+///           advances the clock by the time granularity
+/// "replay": replay() jumps the clock to the next frame or to the next
+///           tick time of the handlers
+///
+/// Both have to deliver the same frames and answer every command.
+///
+/// Usage: bench_pcap_replay [hours] [entities] [granularity_ms]
+///
+
+static Eui48 const entity_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 );
+static Eui64 const entity_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf0 );
+static Eui48 const controller_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf1 );
+static Eui64 const controller_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf1 );
+
+static void writeFrame( PcapFileWriter &writer, uint64_t time_in_ms, Frame const &frame )
+{
+    uint8_t const *part = frame.getBuf();
+    size_t length = frame.getLength();
+    writer.WritePacketParts( ( uint64_t( 1400000000000ULL ) + time_in_ms ) * 1000000, 0, &part, &length, 1 );
+}
+
+enum Kind
+{
+    KIND_ADP,
+    KIND_COMMAND,
+    KIND_IP
+};
+
+static size_t makeCapture( char const *name, double hours, uint32_t entities )
+{
+    PcapFileWriter writer( name, PcapFileWriter::Settings() );
+    Eui48 adp_multicast_addr = JDKSAVDECC_MULTICAST_ADP_ACMP_MAC;
+    uint64_t end = uint64_t( hours * 3600.0 * 1000.0 );
+    uint16_t sequence_id = 0;
+    size_t commands = 0;
+
+    // Every entity advertises once in each 2 second window, the commands come twice a window
+    for ( uint64_t window = 0; window < end; window += 2000 )
+    {
+        std::vector<std::pair<uint64_t, uint32_t> > events;
+        for ( uint32_t n = 0; n < entities; ++n )
+        {
+            events.push_back( std::make_pair( window + ( n * 97 ) % 2000, ( n << 2 ) | KIND_ADP ) );
+        }
+        events.push_back( std::make_pair( window + 500, uint32_t( KIND_COMMAND ) ) );
+        events.push_back( std::make_pair( window + 1500, uint32_t( KIND_COMMAND ) ) );
+        if ( window % 10000 == 0 )
+        {
+            events.push_back( std::make_pair( window + 1234, uint32_t( KIND_IP ) ) );
+        }
+        std::stable_sort( events.begin(), events.end() );
+
+        for ( size_t i = 0; i < events.size() && events[i].first < end; ++i )
+        {
+            uint64_t t = events[i].first;
+            uint32_t n = events[i].second >> 2;
+
+            if ( ( events[i].second & 3 ) == KIND_ADP )
+            {
+                Eui48 mac( 0x70, 0xb3, 0xd5, 0xee, uint8_t( n >> 8 ), uint8_t( n ) );
+                FrameWithSize<82> adp( 0, adp_multicast_addr, mac, JDKSAVDECC_AVTP_ETHERTYPE );
+                adp.putOctet( 0x80 + JDKSAVDECC_SUBTYPE_ADP );
+                adp.putOctet( 0x00 + JDKSAVDECC_ADP_MESSAGE_TYPE_ENTITY_AVAILABLE );
+                adp.putOctet( 10 << 3 );
+                adp.putOctet( JDKSAVDECC_ADPDU_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+                adp.putEUI64( Eui64( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xee, uint8_t( n >> 8 ), uint8_t( n ) ) );
+                adp.putZeros( JDKSAVDECC_ADPDU_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN - 8 );
+                writeFrame( writer, t, adp );
+            }
+            else if ( ( events[i].second & 3 ) == KIND_COMMAND )
+            {
+                FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AECPDU_AEM_LEN> pdu(
+                    0, entity_mac, controller_mac, JDKSAVDECC_AVTP_ETHERTYPE );
+                pdu.putOctet( JDKSAVDECC_1722A_SUBTYPE_AECP );
+                pdu.putOctet( 0x00 + JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND );
+                pdu.putOctet( JDKSAVDECC_AEM_STATUS_SUCCESS << 3 );
+                pdu.putOctet( JDKSAVDECC_AECPDU_AEM_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+                pdu.putEUI64( entity_id );
+                pdu.putEUI64( controller_id );
+                pdu.putDoublet( ++sequence_id );
+                pdu.putDoublet( JDKSAVDECC_AEM_COMMAND_ENTITY_AVAILABLE );
+                writeFrame( writer, t, pdu );
+                ++commands;
+            }
+            else
+            {
+                FrameWithSize<64> ip( 0, controller_mac, entity_mac, 0x0800 );
+                ip.putZeros( 46 );
+                writeFrame( writer, t, ip );
+            }
+        }
+    }
+    return commands;
+}
+
+/// Counts what the handlers receive and how often they are ticked
+class CountingHandler : public Handler
+{
+  public:
+    CountingHandler() : m_frames( 0 ), m_ticks( 0 ) {}
+
+    virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp ) override
+    {
+        (void)timestamp;
+        ++m_ticks;
+    }
+
+    virtual bool receivedPDU( RawSocket *incoming_socket, Frame &frame ) override
+    {
+        (void)incoming_socket;
+        (void)frame;
+        ++m_frames;
+        return false;
+    }
+
+    /// Only the other handlers decide when to be ticked
+    virtual jdksavdecc_timestamp_in_milliseconds nextTickTime( jdksavdecc_timestamp_in_milliseconds timestamp ) override
+    {
+        (void)timestamp;
+        return ~jdksavdecc_timestamp_in_milliseconds( 0 );
+    }
+
+    uint64_t m_frames;
+    uint64_t m_ticks;
+};
+
+/// Counts the frames sent and the AEM responses among them
+class CountingSocket : public RawSocketPcapFile
+{
+  public:
+    CountingSocket( std::string const &input, std::string const &output, jdksavdecc_timestamp_in_milliseconds granularity )
+        : RawSocketPcapFile( JDKSAVDECC_AVTP_ETHERTYPE,
+                             entity_mac,
+                             JDKSAVDECC_MULTICAST_ADP_ACMP_MAC,
+                             JDKSAVDECC_MULTICAST_ADP_ACMP_MAC,
+                             input,
+                             output,
+                             granularity )
+        , m_sent( 0 )
+        , m_responses( 0 )
+    {
+    }
+
+    virtual bool sendFrame( Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        ++m_sent;
+        return RawSocketPcapFile::sendFrame( frame, data1, len1, data2, len2 );
+    }
+
+    virtual bool sendReplyFrame( Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        ++m_sent;
+        if ( frame.getOctet( JDKSAVDECC_FRAME_HEADER_LEN + 1 ) == JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE )
+        {
+            ++m_responses;
+        }
+        return RawSocketPcapFile::sendReplyFrame( frame, data1, len1, data2, len2 );
+    }
+
+    uint64_t m_sent;
+    uint64_t m_responses;
+};
+
+struct Result
+{
+    double m_seconds;
+    uint64_t m_frames;
+    uint64_t m_ticks;
+    uint64_t m_sent;
+    uint64_t m_responses;
+};
+
+static Result run( char const *input, char const *output, jdksavdecc_timestamp_in_milliseconds granularity, bool replay )
+{
+    remove( output );
+    Result result;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+        CountingSocket net( input, output, granularity );
+        ADPManager adp( net, entity_id, ADPCoreInfo( Eui64( 0x70, 0xb3, 0xd5, 0xed, 0xc0, 0x00, 0x00, 0x01 ),
+                                                     JDKSAVDECC_ADP_ENTITY_CAPABILITY_AEM_SUPPORTED ) );
+        RegisteredControllersStorage<1> registered_controllers;
+        Entity entity( adp, &registered_controllers, 0 );
+        CountingHandler counter;
+        FrameWithMTU frame;
+        HandlerGroupWithSize<3> handlers( &frame );
+        handlers.add( &counter );
+        handlers.add( &entity );
+        handlers.add( &adp );
+
+        if ( replay )
+        {
+            net.setHandlerGroup( &handlers );
+            net.replay();
+        }
+        else
+        {
+            while ( net.hasPendingFrame() )
+            {
+                jdksavdecc_timestamp_in_milliseconds t = net.getTimeInMilliseconds();
+                while ( net.recvFrame( &frame ) )
+                {
+                    handlers.receivedPDU( &net, frame );
+                }
+                handlers.tick( t );
+            }
+        }
+
+        result.m_frames = counter.m_frames;
+        result.m_ticks = counter.m_ticks;
+        result.m_sent = net.m_sent;
+        result.m_responses = net.m_responses;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.m_seconds = elapsed.count();
+    remove( output );
+    return result;
+}
+
+static void report( char const *name, Result const &result, double hours )
+{
+    BenchReport( name, result.m_seconds ).rate( hours * 3600.0, "x real time", 10 )
+        << ", " << result.m_frames << " frames, " << result.m_ticks << " ticks, " << result.m_sent << " sent, "
+        << result.m_responses << " responses";
+}
+
+int main( int argc, char **argv )
+{
+    double hours = argc > 1 ? atof( argv[1] ) : 12.0;
+    uint32_t entities = argc > 2 ? uint32_t( atoi( argv[2] ) ) : 20;
+    jdksavdecc_timestamp_in_milliseconds granularity = argc > 3 ? jdksavdecc_timestamp_in_milliseconds( atoi( argv[3] ) ) : 10;
+    char const *input_name = "bench_pcap_replay_in.pcap";
+    char const *output_name = "bench_pcap_replay_out.pcap";
+
+    size_t commands = makeCapture( input_name, hours, entities );
+    std::cout << "Replay of " << hours << " hours, " << entities << " entities, " << commands << " commands, " << granularity
+              << " ms granularity when polled" << std::endl;
+
+    Result polled = run( input_name, output_name, granularity, false );
+    report( "polled", polled, hours );
+    Result replay = run( input_name, output_name, granularity, true );
+    report( "replay", replay, hours );
+    remove( input_name );
+
+    bool ok = polled.m_frames == replay.m_frames && polled.m_responses == commands && replay.m_responses == commands;
+    if ( !ok )
+    {
+        std::cout << "Mismatch" << std::endl;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures capturing AVDECC traffic from a 16 port gateway to a file.
+///
+/// Every packet is an Ethernet header plus a payload, as
+/// RawSocketPcapFile writes them. The ways of writing are:
+///
+/// "stdio"   : a std::vector is built per packet and each record is
+///             written with two fwrite() calls, as before PcapFileWriter
+///             buffered its records
+/// "buffered": PcapFileWriter writes its buffer when it is full
+/// "async"   : PcapFileWriter hands full buffers to its flush thread
+/// "pcapng"  : as "async", pcapng with one interface per port
+/// "rotate"  : as "pcapng", rotating every 4 MiB and keeping 3 files
+///
+/// Reports the throughput, the slowest single write and the dropped
+/// packets. The files are read back with PcapMappedReader and every
+/// packet that was not dropped has to be there.
+///
+/// Usage: bench_pcap_writer [packets] [buffer_kib]
+///
+
+static const uint16_t sizes[] = {68, 56, 70, 44, 120, 300, 524};
+static const size_t size_count = sizeof( sizes ) / sizeof( sizes[0] );
+static const uint32_t port_count = 16;
+
+struct Result
+{
+    double m_seconds;
+    double m_worst_seconds;
+    uint64_t m_octets;
+    uint64_t m_dropped;
+
+    /// The files that were written and kept
+    std::vector<std::string> m_names;
+};
+
+static uint64_t packetTime( size_t n ) { return uint64_t( 1400000000 ) * 1000000000 + uint64_t( n ) * 2000; }
+
+static Result runStdio( char const *name, std::vector<uint8_t> const &payload, size_t packets )
+{
+    Result result = {0.0, 0.0, 0, 0, std::vector<std::string>( 1, name )};
+    uint8_t header[14] = {0x91, 0xe0, 0xf0, 0x01, 0x00, 0x00, 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0, 0x22, 0xf0};
+    FILE *f = fopen( name, "wb" );
+    pcap_hdr_t file_header = {0xa1b2c3d4, 2, 4, 0, 0, 0xffff, 1};
+    fwrite( &file_header, sizeof( file_header ), 1, f );
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for ( size_t n = 0; n < packets; ++n )
+    {
+        std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+        uint16_t size = sizes[n % size_count];
+        std::vector<uint8_t> packet;
+        packet.reserve( 14 + size );
+        packet.insert( packet.end(), header, header + 14 );
+        packet.insert( packet.end(), payload.begin(), payload.begin() + size );
+
+        uint64_t t = packetTime( n ) / 1000;
+        pcaprec_hdr_t record;
+        record.ts_sec = uint32_t( t / 1000000 );
+        record.ts_usec = uint32_t( t % 1000000 );
+        record.incl_len = int32_t( packet.size() );
+        record.orig_len = record.incl_len;
+        fwrite( &record, sizeof( record ), 1, f );
+        fwrite( &packet[0], packet.size(), 1, f );
+        result.m_octets += packet.size();
+
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - before;
+        result.m_worst_seconds = std::max( result.m_worst_seconds, took.count() );
+    }
+    fclose( f );
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.m_seconds = elapsed.count();
+    return result;
+}
+
+static Result runWriter( char const *name, std::vector<uint8_t> const &payload, size_t packets, PcapFileWriter::Settings settings )
+{
+    Result result = {0.0, 0.0, 0, 0, std::vector<std::string>()};
+    uint8_t header[14] = {0x91, 0xe0, 0xf0, 0x01, 0x00, 0x00, 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0, 0x22, 0xf0};
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+        PcapFileWriter writer( name, settings );
+        uint32_t ports[port_count];
+        for ( uint32_t i = 0; i < port_count; ++i )
+        {
+            ports[i] = writer.AddInterface( "port" + std::to_string( i ) );
+        }
+
+        for ( size_t n = 0; n < packets; ++n )
+        {
+            std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+            uint8_t const *parts[2] = {header, &payload[0]};
+            size_t lengths[2] = {sizeof( header ), sizes[n % size_count]};
+            if ( writer.WritePacketParts( packetTime( n ), ports[n % port_count], parts, lengths, 2 ) )
+            {
+                result.m_octets += lengths[0] + lengths[1];
+            }
+            std::chrono::duration<double> took = std::chrono::steady_clock::now() - before;
+            result.m_worst_seconds = std::max( result.m_worst_seconds, took.count() );
+        }
+        result.m_dropped = writer.GetDroppedCount();
+
+        uint32_t last = writer.GetFileNumber();
+        uint32_t first = settings.m_max_files && last >= settings.m_max_files ? uint32_t( last + 1 - settings.m_max_files ) : 0;
+        for ( uint32_t i = first; i <= last; ++i )
+        {
+            result.m_names.push_back( writer.GetFileName( i ) );
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.m_seconds = elapsed.count();
+    return result;
+}
+
+static void report( char const *name, Result const &result, size_t packets )
+{
+    BenchReport( name, result.m_seconds, 10 ).mebibytes( double( result.m_octets ) ).nanoseconds( double( packets ), "packet" )
+        << ", worst " << std::setprecision( 1 ) << result.m_worst_seconds * 1e6 << " us, dropped " << result.m_dropped;
+}
+
+/// Count the packets in the files and check that they are in time order
+static size_t countPackets( std::vector<std::string> const &names, uint64_t *octets )
+{
+    size_t count = 0;
+    *octets = 0;
+    for ( size_t i = 0; i < names.size(); ++i )
+    {
+        PcapMappedReader reader( names[i] );
+        uint64_t timestamp;
+        uint64_t previous = 0;
+        uint8_t *data;
+        uint32_t len;
+        while ( reader.readPacket( &timestamp, &data, &len ) )
+        {
+            if ( timestamp < previous )
+            {
+                return 0;
+            }
+            previous = timestamp;
+            *octets += len;
+            ++count;
+        }
+    }
+    return count;
+}
+
+static bool verify( char const *what, Result const &result, size_t packets )
+{
+    std::vector<std::string> const &names = result.m_names;
+    uint64_t octets;
+    size_t count = countPackets( names, &octets );
+    bool ok = count + result.m_dropped == packets && octets == result.m_octets;
+    if ( !ok )
+    {
+        std::cout << what << ": read back " << count << " packets, " << octets << " octets, expected "
+                  << packets - result.m_dropped << " packets, " << result.m_octets << " octets" << std::endl;
+    }
+    for ( size_t i = 0; i < names.size(); ++i )
+    {
+        remove( names[i].c_str() );
+    }
+    return ok;
+}
+
+int main( int argc, char **argv )
+{
+    size_t packets = argc > 1 ? size_t( atoi( argv[1] ) ) : 4000000;
+    size_t buffer_kib = argc > 2 ? size_t( atoi( argv[2] ) ) : 1024;
+    char const *pcap_name = "bench_pcap_writer.pcap";
+    char const *pcapng_name = "bench_pcap_writer.pcapng";
+    bool ok = true;
+
+    std::vector<uint8_t> payload( 1500 );
+    for ( size_t i = 0; i < payload.size(); ++i )
+    {
+        payload[i] = uint8_t( i );
+    }
+
+    std::cout << "pcap writer: " << packets << " packets from " << port_count << " ports, " << buffer_kib << " KiB buffers"
+              << std::endl;
+
+    Result stdio = runStdio( pcap_name, payload, packets );
+    report( "stdio", stdio, packets );
+    ok = verify( "stdio", stdio, packets ) && ok;
+
+    PcapFileWriter::Settings settings;
+    settings.m_buffer_size = buffer_kib * 1024;
+
+    Result buffered = runWriter( pcap_name, payload, packets, settings );
+    report( "buffered", buffered, packets );
+    ok = verify( "buffered", buffered, packets ) && ok;
+
+    settings.m_async = true;
+    Result async = runWriter( pcap_name, payload, packets, settings );
+    report( "async", async, packets );
+    ok = verify( "async", async, packets ) && ok;
+
+    settings.m_format = PcapFileWriter::FORMAT_PCAPNG;
+    Result pcapng = runWriter( pcapng_name, payload, packets, settings );
+    report( "pcapng", pcapng, packets );
+    ok = verify( "pcapng", pcapng, packets ) && ok;
+
+    settings.m_rotate_size = 4 * 1024 * 1024;
+    settings.m_max_files = 3;
+    Result rotate = runWriter( pcapng_name, payload, packets, settings );
+    report( "rotate", rotate, packets );
+
+    /* Only the newest files are kept, and the one before them is gone */
+    uint64_t octets;
+    size_t kept = countPackets( rotate.m_names, &octets );
+    FILE *deleted = fopen( pcapng_name, "rb" );
+    if ( rotate.m_names.size() != 3 || kept == 0 || kept + rotate.m_dropped >= packets || deleted )
+    {
+        if ( deleted )
+        {
+            fclose( deleted );
+            remove( pcapng_name );
+        }
+        std::cout << "rotate: " << rotate.m_names.size() << " files with " << kept << " packets kept" << std::endl;
+        ok = false;
+    }
+    for ( size_t i = 0; i < rotate.m_names.size(); ++i )
+    {
+        remove( rotate.m_names[i].c_str() );
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "JDKSAvdeccMCU.hpp"
+
+#include <chrono>
+
+///
+/// Timing and report lines shared by the benchmarks. Each run prints one
+/// line: its name, its time in seconds, and the columns the benchmark
+/// adds, e.g.
+///
+///     BenchReport( "copy", seconds ).mebibytes( octets ).rate( messages, "msg/s" );
+///
+
+/// Seconds since start
+inline double benchSince( std::chrono::steady_clock::time_point start )
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+///
+/// \brief The BenchReport class
+///
+/// Prints the name and time of a run when made, and ends the line when
+/// destroyed, so that one expression prints one line
+///
+class BenchReport
+{
+  public:
+    BenchReport( char const *name, double seconds, int name_width = 8 ) : m_seconds( seconds )
+    {
+        std::cout << std::left << std::setw( name_width ) << name << std::right << std::fixed << std::setprecision( 4 )
+                  << std::setw( 10 ) << seconds << " s";
+    }
+
+    ~BenchReport() { std::cout << std::endl; }
+
+    /// One column: value and unit
+    BenchReport &column( double value, char const *unit, int width, int precision )
+    {
+        std::cout << " " << std::setw( width ) << std::setprecision( precision ) << value << " " << unit;
+        return *this;
+    }
+
+    /// count per second of the run
+    BenchReport &rate( double count, char const *unit, int width = 12, int precision = 0 )
+    {
+        return column( count / m_seconds, unit, width, precision );
+    }
+
+    /// octets per second of the run in MiB/s
+    BenchReport &mebibytes( double octets ) { return rate( octets / ( 1024.0 * 1024.0 ), "MiB/s", 10, 1 ); }
+
+    /// octets per second of the run in Gbit/s
+    BenchReport &gigabits( double octets ) { return rate( octets * 8.0 / 1e9, "Gbit/s", 8, 3 ); }
+
+    /// Nanoseconds per item of the run, printed as ns/item
+    BenchReport &nanoseconds( double count, char const *item )
+    {
+        std::cout << " " << std::setw( 8 ) << std::setprecision( 1 ) << m_seconds * 1e9 / count << " ns/" << item;
+        return *this;
+    }
+
+    /// Free text after the columns
+    template <typename T>
+    BenchReport &operator<<( T const &v )
+    {
+        std::cout << v;
+        return *this;
+    }
+
+  private:
+    double m_seconds;
+};
@@ -0,0 +1,807 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "jdksavdecc_descriptor_storage.h"
+#include "jdksavdecc_descriptor_storage_gen.h"
+
+#include <chrono>
+#include <fstream>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Microbenchmarks of the protocol hot paths, with results that can be
+/// kept and compared between commits.
+///
+/// Every case does a fixed count of operations on fixed data, so a run
+/// does the same work every time, and returns a checksum of what it did.
+/// Each case is run several times, the best and the median time per
+/// operation are reported and the checksums of the runs have to agree.
+///
+/// "fixedbuffer_put"     : a SET_CONTROL command written with FixedBuffer put*()
+/// "fixedbuffer_get"     : the same command read back with FixedBuffer get*()
+/// "parse_aem"           : parseAEM() of AEM commands
+/// "parse_acmp"          : parseACMP() of ACMP commands
+/// "entity_controls_8"   : Entity::receivedPDU() of SET_CONTROL commands to an
+///                         entity with 8 controls, answered in place
+/// "entity_controls_256" : as "entity_controls_8", with 256 controls
+/// "ranged_value_encode" : RangedValue setValueWithClamp() and getEncodedValue()
+/// "app_message_parse"   : AppMessageParser::parse() of AVDECC_FROM_APS messages
+///                         in TCP segment sized blocks
+/// "http_parser_simple"  : HttpServerParserSimple of an APC CONNECT request
+/// "descriptor_lookup"   : random descriptor lookups in a descriptor storage buffer
+/// "pcap_file_reader"    : PcapFileReader::ReadPacket() of a pcap file
+///
+/// The results are printed as a table and can be written as JSON or CSV.
+/// With a baseline, the JSON written by an earlier run, a case whose best
+/// time per operation got slower by more than the tolerance fails the run.
+///
+/// Usage: bench_suite [--scale factor] [--repeat count] [--filter text] [--json file]
+///                    [--csv file] [--baseline file] [--tolerance percent]
+///
+
+/// Times the part of a case that is measured
+class Stopwatch
+{
+  public:
+    Stopwatch() : m_seconds( 0.0 ), m_operations( 0 ) {}
+
+    void start() { m_start = std::chrono::steady_clock::now(); }
+
+    void stop()
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+        m_seconds += elapsed.count();
+    }
+
+    double m_seconds;
+
+    /// The operations done, when a case rounds up the operations it was asked for
+    size_t m_operations;
+
+  private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+typedef uint64_t ( *RunProc )( size_t operations, Stopwatch &stopwatch );
+
+struct Case
+{
+    char const *m_name;
+    char const *m_unit;
+    size_t m_operations;
+    RunProc m_run;
+};
+
+struct Result
+{
+    std::string m_name;
+    std::string m_unit;
+    size_t m_operations;
+    double m_best_ns;
+    double m_median_ns;
+    uint64_t m_checksum;
+    bool m_reproducible;
+};
+
+static Eui48 const entity_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 );
+static Eui64 const entity_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf0 );
+static Eui48 const controller_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf1 );
+static Eui64 const controller_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf1 );
+
+/// A SET_CONTROL command with one doublet value, as a controller sends it
+static void putSetControl( FixedBuffer &buf, uint16_t sequence_id, uint16_t descriptor_index, uint16_t value )
+{
+    buf.putEUI48( entity_mac );
+    buf.putEUI48( controller_mac );
+    buf.putDoublet( JDKSAVDECC_AVTP_ETHERTYPE );
+    buf.putOctet( JDKSAVDECC_1722A_SUBTYPE_AECP );
+    buf.putOctet( JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND );
+    buf.putDoublet( JDKSAVDECC_AEM_COMMAND_SET_CONTROL_COMMAND_LEN + 2 - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+    buf.putEUI64( entity_id );
+    buf.putEUI64( controller_id );
+    buf.putDoublet( sequence_id );
+    buf.putDoublet( JDKSAVDECC_AEM_COMMAND_SET_CONTROL );
+    buf.putDoublet( JDKSAVDECC_DESCRIPTOR_CONTROL );
+    buf.putDoublet( descriptor_index );
+    buf.putDoublet( value );
+}
+
+static uint64_t runFixedBufferPut( size_t operations, Stopwatch &stopwatch )
+{
+    FixedBufferWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_SET_CONTROL_COMMAND_LEN + 2> buf;
+    uint64_t sum = 0;
+
+    stopwatch.start();
+    for ( size_t n = 0; n < operations; ++n )
+    {
+        buf.setLength( 0 );
+        putSetControl( buf, uint16_t( n ), uint16_t( n & 0xff ), uint16_t( n * 3 ) );
+        sum += buf.getLength() + buf.getOctet( uint16_t( buf.getLength() - 1 ) );
+    }
+    stopwatch.stop();
+    return sum;
+}
+
+static uint64_t runFixedBufferGet( size_t operations, Stopwatch &stopwatch )
+{
+    static size_t const buf_count = 16;
+    FixedBufferWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_SET_CONTROL_COMMAND_LEN + 2> bufs[buf_count];
+    uint16_t const pos = JDKSAVDECC_FRAME_HEADER_LEN;
+    uint64_t sum = 0;
+
+    for ( size_t i = 0; i < buf_count; ++i )
+    {
+        putSetControl( bufs[i], uint16_t( 0x1234 + i ), uint16_t( i ), uint16_t( 0x5678 * i ) );
+    }
+
+    stopwatch.start();
+    for ( size_t n = 0; n < operations; ++n )
+    {
+        FixedBuffer &buf = bufs[n % buf_count];
+        sum += buf.getEUI48( 0 ).value[5] + buf.getDoublet( JDKSAVDECC_FRAME_HEADER_ETHERTYPE_OFFSET );
+        sum += buf.getOctet( pos ) + buf.getQuadlet( pos );
+        sum += buf.getEUI64( pos + JDKSAVDECC_AECPDU_AEM_OFFSET_CONTROLLER_ENTITY_ID ).value[7];
+        sum += buf.getDoublet( pos + JDKSAVDECC_AECPDU_AEM_OFFSET_SEQUENCE_ID );
+        sum += buf.getDoublet( pos + JDKSAVDECC_AECPDU_AEM_OFFSET_COMMAND_TYPE );
+        sum += buf.getDoublet( pos + JDKSAVDECC_AEM_COMMAND_SET_CONTROL_COMMAND_OFFSET_DESCRIPTOR_INDEX );
+        sum += buf.getDoublet( uint16_t( pos + JDKSAVDECC_AEM_COMMAND_SET_CONTROL_COMMAND_OFFSET_VALUES ) );
+    }
+    stopwatch.stop();
+    return sum;
+}
+
+static uint64_t runParseAem( size_t operations, Stopwatch &stopwatch )
+{
+    static size_t const frame_count = 16;
+    FrameWithMTU frames[frame_count];
+    uint64_t sum = 0;
+
+    for ( size_t i = 0; i < frame_count; ++i )
+    {
+        putSetControl( frames[i], uint16_t( i ), uint16_t( i ), uint16_t( i * 5 ) );
+    }
+
+    stopwatch.start();
+    for ( size_t n = 0; n < operations; ++n )
+    {
+        jdksavdecc_aecpdu_aem aem;
+        if ( parseAEM( &aem, frames[n % frame_count] ) )
+        {
+            sum += aem.aecpdu_header.sequence_id + aem.command_type;
+        }
+    }
+    stopwatch.stop();
+    return sum;
+}
+
+static uint64_t runParseAcmp( size_t operations, Stopwatch &stopwatch )
+{
+    static size_t const frame_count = 16;
+    FrameWithMTU frames[frame_count];
+    uint64_t sum = 0;
+
+    for ( size_t i = 0; i < frame_count; ++i )
+    {
+        Frame &frame = frames[i];
+        frame.putEUI48( Eui48( JDKSAVDECC_MULTICAST_ADP_ACMP_MAC ) );
+        frame.putEUI48( controller_mac );
+        frame.putDoublet( JDKSAVDECC_AVTP_ETHERTYPE );
+        frame.putOctet( JDKSAVDECC_1722A_SUBTYPE_ACMP );
+        frame.putOctet( JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND );
+        frame.putDoublet( JDKSAVDECC_ACMPDU_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+        frame.putEUI64( Eui64( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xee, 0x00, uint8_t( i ) ) );
+        frame.putEUI64( controller_id );
+        frame.putEUI64( Eui64( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xee, 0x00, uint8_t( i ) ) );
+        frame.putEUI64( entity_id );
+        frame.putDoublet( uint16_t( i ) );
+        frame.putDoublet( 0 );
+        frame.putEUI48( Eui48( 0x91, 0xe0, 0xf0, 0x00, 0x01, uint8_t( i ) ) );
+        frame.putDoublet( 0 );
+        frame.putDoublet( uint16_t( i * 3 ) );
+        frame.putDoublet( JDKSAVDECC_ACMP_FLAG_CLASS_B );
+        frame.putDoublet( 2 );
+        frame.putDoublet( 0 );
+    }
+
+    stopwatch.start();
+    for ( size_t n = 0; n < operations; ++n )
+    {
+        jdksavdecc_acmpdu acmpdu;
+        if ( parseACMP( &acmpdu, frames[n % frame_count] ) )
+        {
+            sum += acmpdu.sequence_id + acmpdu.talker_unique_id + acmpdu.flags;
+        }
+    }
+    stopwatch.stop();
+    return sum;
+}
+
+/// Takes the responses of an Entity and counts the successful ones
+class ResponseCounter : public RawSocket
+{
+  public:
+    ResponseCounter() : m_responses( 0 ) {}
+
+    virtual void setHandlerGroup( HandlerGroup *handler_group ) override { (void)handler_group; }
+
+    virtual jdksavdecc_timestamp_in_milliseconds getTimeInMilliseconds() const override { return 0; }
+
+    virtual bool recvFrame( Frame *frame ) override
+    {
+        (void)frame;
+        return false;
+    }
+
+    virtual bool sendFrame( Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        (void)frame;
+        (void)data1;
+        (void)len1;
+        (void)data2;
+        (void)len2;
+        return false;
+    }
+
+    virtual bool sendReplyFrame( Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        (void)data1;
+        (void)len1;
+        (void)data2;
+        (void)len2;
+        if ( jdksavdecc_common_control_header_get_status( frame.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN )
+             == JDKSAVDECC_AEM_STATUS_SUCCESS )
+        {
+            ++m_responses;
+        }
+        return true;
+    }
+
+    virtual bool joinMulticast( const Eui48 &multicast_mac ) override
+    {
+        (void)multicast_mac;
+        return false;
+    }
+
+    virtual Eui48 const &getMACAddress() const override { return entity_mac; }
+
+    uint64_t m_responses;
+};
+
+/// An entity state with a number of doublet controls set by SET_CONTROL
+class ControlsState : public EntityState
+{
+  public:
+    ControlsState( size_t count )
+    {
+        for ( size_t i = 0; i < count; ++i )
+        {
+            m_controls.push_back( new ControlValueHolderWithStorage<uint16_t, 1>() );
+        }
+    }
+
+    virtual ~ControlsState()
+    {
+        for ( size_t i = 0; i < m_controls.size(); ++i )
+        {
+            delete m_controls[i];
+        }
+    }
+
+    virtual uint8_t receiveSetControlCommand( Frame &pdu, uint16_t descriptor_index ) override
+    {
+        uint8_t status = JDKSAVDECC_AEM_STATUS_NO_SUCH_DESCRIPTOR;
+        if ( descriptor_index < m_controls.size() )
+        {
+            m_controls[descriptor_index]->setValue(
+                pdu.getBuf( JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_SET_CONTROL_COMMAND_OFFSET_VALUES ) );
+            status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+        }
+        return status;
+    }
+
+    uint64_t getSum() const
+    {
+        uint64_t sum = 0;
+        for ( size_t i = 0; i < m_controls.size(); ++i )
+        {
+            sum += m_controls[i]->getDoublet( 0 ) * ( i + 1 );
+        }
+        return sum;
+    }
+
+  private:
+    std::vector<ControlValueHolderWithStorage<uint16_t, 1> *> m_controls;
+};
+
+static uint64_t runEntity( size_t operations, Stopwatch &stopwatch, size_t control_count )
+{
+    ResponseCounter net;
+    ADPManager adp( net, entity_id, ADPCoreInfo( Eui64(), JDKSAVDECC_ADP_ENTITY_CAPABILITY_AEM_SUPPORTED ) );
+    RegisteredControllersStorage<1> registered_controllers;
+    ControlsState state( control_count );
+    Entity entity( adp, &registered_controllers, &state );
+    FrameWithMTU command;
+
+    stopwatch.start();
+    for ( size_t n = 0; n < operations; ++n )
+    {
+        // The entity turns the command into its response in place
+        command.setLength( 0 );
+        putSetControl( command, uint16_t( n ), uint16_t( ( n * 7 ) % control_count ), uint16_t( n ) );
+        entity.receivedPDU( &net, command );
+    }
+    stopwatch.stop();
+    return net.m_responses + state.getSum();
+}
+
+static uint64_t runEntity8( size_t operations, Stopwatch &stopwatch ) { return runEntity( operations, stopwatch, 8 ); }
+
+static uint64_t runEntity256( size_t operations, Stopwatch &stopwatch ) { return runEntity( operations, stopwatch, 256 ); }
+
+static uint64_t runRangedValue( size_t operations, Stopwatch &stopwatch )
+{
+    // A gain from -144.0 dB to +24.0 dB in 0.1 dB steps, sent as tenths of a dB
+    RangedValue<UnitsCode::LEVEL_DB, -1440, 240, 0, 1, -1, int16_t, float> gain( 0.0f );
+    uint64_t sum = 0;
+
+    stopwatch.start();
+    for ( size_t n = 0; n < operations; ++n )
+    {
+        int16_t encoded = 0;
+        gain.setValueWithClamp( float( int( n % 2000 ) - 1600 ) * 0.1f );
+        gain.getEncodedValue( &encoded );
+        sum += uint16_t( encoded );
+    }
+    stopwatch.stop();
+    return sum;
+}
+
+class CountingAppHandler : public AppMessageHandler
+{
+  public:
+    CountingAppHandler() : m_messages( 0 ), m_payload_octets( 0 ) {}
+
+    virtual void onAppNop( AppMessage const &msg ) override { (void)msg; }
+    virtual void onAppEntityIdRequest( AppMessage const &msg ) override { (void)msg; }
+    virtual void onAppEntityIdResponse( AppMessage const &msg ) override { (void)msg; }
+    virtual void onAppLinkUp( AppMessage const &msg ) override { (void)msg; }
+    virtual void onAppLinkDown( AppMessage const &msg ) override { (void)msg; }
+    virtual void onAppAvdeccFromApc( AppMessage const &msg ) override { (void)msg; }
+    virtual void onAppVendor( AppMessage const &msg ) override { (void)msg; }
+    virtual void onAppUnknown( AppMessage const &msg ) override { (void)msg; }
+
+    virtual void onAppAvdeccFromAps( AppMessage const &msg ) override
+    {
+        ++m_messages;
+        m_payload_octets += msg.getPayloadLength();
+    }
+
+    uint64_t m_messages;
+    uint64_t m_payload_octets;
+};
+
+static uint64_t runAppMessageParse( size_t operations, Stopwatch &stopwatch )
+{
+    static const uint16_t sizes[] = {68, 56, 70, 44, 120, 300, 524};
+    static size_t const stream_messages = 1024;
+    static size_t const segment_size = 1448;
+    std::vector<uint8_t> stream;
+    FixedBufferWithSize<AppMessageParser::max_appdu_message_size> buf;
+
+    for ( size_t n = 0; n < stream_messages; ++n )
+    {
+        FrameWithMTU frame( 0, Eui48( JDKSAVDECC_MULTICAST_ADP_ACMP_MAC ), entity_mac, JDKSAVDECC_AVTP_ETHERTYPE );
+        uint16_t size = sizes[n % ( sizeof( sizes ) / sizeof( sizes[0] ) )];
+        for ( uint16_t i = 0; i < size; ++i )
+        {
+            frame.putOctet( uint8_t( i + n ) );
+        }
+        AppMessage msg;
+        msg.setAvdeccFromAps( frame );
+        buf.setLength( 0 );
+        msg.store( &buf );
+        stream.insert( stream.end(), buf.getBuf(), buf.getBuf() + buf.getLength() );
+    }
+
+    CountingAppHandler handler;
+    AppMessageParser parser( handler );
+    size_t passes = ( operations + stream_messages - 1 ) / stream_messages;
+    uint64_t errors = 0;
+
+    stopwatch.start();
+    for ( size_t pass = 0; pass < passes; ++pass )
+    {
+        for ( size_t pos = 0; pos < stream.size(); pos += segment_size )
+        {
+            errors += parser.parse( &stream[pos], std::min( segment_size, stream.size() - pos ) ) != 0;
+        }
+    }
+    stopwatch.stop();
+    stopwatch.m_operations = passes * stream_messages;
+    return handler.m_messages + handler.m_payload_octets + errors * 1000000007ULL;
+}
+
+class AcceptingHandler : public HttpServerHandler
+{
+  public:
+    AcceptingHandler() : m_accepted( 0 ) {}
+
+    virtual bool onIncomingHttpConnectRequest( HttpRequest const &request ) override
+    {
+        m_accepted += request.m_path == "/" ? 1 : 0;
+        return true;
+    }
+
+    uint64_t m_accepted;
+};
+
+static uint64_t runHttpParserSimple( size_t operations, Stopwatch &stopwatch )
+{
+    static char const request[] = "CONNECT / HTTP/1.1\r\n"
+                                  "Host: aps.local:17221\r\n"
+                                  "User-Agent: avdecc-remote/2.1\r\n"
+                                  "Accept: */*\r\n"
+                                  "Proxy-Connection: Keep-Alive\r\n"
+                                  "\r\n";
+    AcceptingHandler handler;
+    HttpRequest req;
+    HttpServerParserSimple parser( &req, &handler );
+
+    stopwatch.start();
+    for ( size_t n = 0; n < operations; ++n )
+    {
+        parser.clear();
+        parser.onIncomingHttpData( reinterpret_cast<uint8_t const *>( request ), ssize_t( sizeof( request ) - 1 ) );
+    }
+    stopwatch.stop();
+    return handler.m_accepted;
+}
+
+static uint64_t runDescriptorLookup( size_t operations, Stopwatch &stopwatch )
+{
+    static uint16_t const types[] = {JDKSAVDECC_DESCRIPTOR_AUDIO_CLUSTER,
+                                     JDKSAVDECC_DESCRIPTOR_CONTROL,
+                                     JDKSAVDECC_DESCRIPTOR_CONTROL,
+                                     JDKSAVDECC_DESCRIPTOR_CONTROL,
+                                     JDKSAVDECC_DESCRIPTOR_MIXER};
+    static uint32_t const per_type = 1024;
+    static uint32_t const count = per_type * 3;
+    std::vector<jdksavdecc_descriptor_storage_gen_descriptor> descriptor_space( count );
+    jdksavdecc_descriptor_storage_gen gen;
+    std::vector<uint8_t> data( 256 );
+    uint64_t sum = 0;
+
+    jdksavdecc_descriptor_storage_gen_init( &gen, &descriptor_space[0], count, 0, 0 );
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        for ( size_t j = 0; j < data.size(); ++j )
+        {
+            data[j] = uint8_t( i + j * 7 );
+        }
+        gen.add_descriptor( &gen, 0, types[i / per_type * 2], uint16_t( i % per_type ), &data[0], uint16_t( 64 + i % 192 ) );
+    }
+    std::vector<uint8_t> buffer( jdksavdecc_descriptor_storage_gen_get_export_length( &gen ) );
+    buffer.resize( jdksavdecc_descriptor_storage_gen_export_buffer( &gen, &buffer[0], uint32_t( buffer.size() ) ) );
+    gen.base.destroy( &gen.base );
+
+    jdksavdecc_descriptor_storage storage;
+    if ( buffer.empty() || !jdksavdecc_descriptor_storage_buffer_init( &storage, &buffer[0], uint32_t( buffer.size() ) ) )
+    {
+        return 0;
+    }
+
+    uint32_t seed = 1;
+    stopwatch.start();
+    for ( size_t n = 0; n < operations; ++n )
+    {
+        seed = seed * 1103515245 + 12345;
+        uint32_t i = ( seed >> 8 ) % count;
+        uint16_t length = 0;
+        uint8_t const *p = jdksavdecc_descriptor_storage_buffer_get_descriptor(
+            &storage, 0, types[i / per_type * 2], uint16_t( i % per_type ), &length );
+        if ( p )
+        {
+            sum += length + p[0];
+        }
+    }
+    stopwatch.stop();
+    storage.base.destroy( &storage.base );
+    return sum;
+}
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1
+
+static uint64_t runPcapFileReader( size_t operations, Stopwatch &stopwatch )
+{
+    static const uint16_t sizes[] = {68, 56, 70, 44, 120, 300, 524};
+    char const *name = "bench_suite.pcap";
+    std::vector<uint8_t> packet( 1514 );
+    uint64_t sum = 0;
+
+    for ( size_t i = 0; i < packet.size(); ++i )
+    {
+        packet[i] = uint8_t( i * 3 );
+    }
+    {
+        PcapFileWriter writer( name, PcapFileWriter::Settings() );
+        for ( size_t n = 0; n < operations; ++n )
+        {
+            uint8_t const *part = &packet[0];
+            size_t length = JDKSAVDECC_FRAME_HEADER_LEN + sizes[n % ( sizeof( sizes ) / sizeof( sizes[0] ) )];
+            writer.WritePacketParts( ( uint64_t( 1400000000 ) * 1000000 + n * 125 ) * 1000, 0, &part, &length, 1 );
+        }
+    }
+
+    stopwatch.start();
+    {
+        PcapFileReader reader( name );
+        PcapFilePacket data;
+        uint64_t timestamp;
+        while ( reader.ReadPacket( &timestamp, data ) )
+        {
+            sum += timestamp + data.size() + data[data.size() - 1];
+        }
+    }
+    stopwatch.stop();
+    remove( name );
+    return sum;
+}
+
+#endif
+
+static Case const cases[] = {{"fixedbuffer_put", "pdu", 8000000, runFixedBufferPut},
+                             {"fixedbuffer_get", "pdu", 8000000, runFixedBufferGet},
+                             {"parse_aem", "pdu", 8000000, runParseAem},
+                             {"parse_acmp", "pdu", 8000000, runParseAcmp},
+                             {"entity_controls_8", "command", 2000000, runEntity8},
+                             {"entity_controls_256", "command", 2000000, runEntity256},
+                             {"ranged_value_encode", "value", 8000000, runRangedValue},
+                             {"app_message_parse", "message", 2000000, runAppMessageParse},
+                             {"http_parser_simple", "request", 500000, runHttpParserSimple},
+                             {"descriptor_lookup", "lookup", 4000000, runDescriptorLookup},
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1
+                             {"pcap_file_reader", "packet", 1000000, runPcapFileReader},
+#endif
+};
+
+static size_t const case_count = sizeof( cases ) / sizeof( cases[0] );
+
+static Result runCase( Case const &c, double scale, size_t repeat )
+{
+    Result result;
+    std::vector<double> ns;
+    size_t operations = std::max( size_t( double( c.m_operations ) * scale ), size_t( 1 ) );
+
+    result.m_name = c.m_name;
+    result.m_unit = c.m_unit;
+    result.m_operations = operations;
+    result.m_checksum = 0;
+    result.m_reproducible = true;
+
+    for ( size_t r = 0; r < repeat; ++r )
+    {
+        Stopwatch stopwatch;
+        stopwatch.m_operations = operations;
+        uint64_t checksum = c.m_run( operations, stopwatch );
+        if ( r == 0 )
+        {
+            result.m_checksum = checksum;
+            result.m_operations = stopwatch.m_operations;
+        }
+        else if ( checksum != result.m_checksum || stopwatch.m_operations != result.m_operations )
+        {
+            result.m_reproducible = false;
+        }
+        ns.push_back( stopwatch.m_seconds * 1e9 / double( stopwatch.m_operations ) );
+    }
+    std::sort( ns.begin(), ns.end() );
+    result.m_best_ns = ns.front();
+    result.m_median_ns = ns[ns.size() / 2];
+    return result;
+}
+
+static void report( Result const &result, std::ostream &os )
+{
+    os << std::left << std::setw( 22 ) << result.m_name << std::right << std::fixed << std::setw( 12 ) << result.m_operations
+       << std::setprecision( 2 ) << std::setw( 12 ) << result.m_best_ns << std::setw( 12 ) << result.m_median_ns
+       << std::setprecision( 0 ) << std::setw( 14 ) << 1e9 / result.m_best_ns << " " << result.m_unit << "/s"
+       << ( result.m_reproducible ? "" : " NOT REPRODUCIBLE" ) << std::endl;
+}
+
+static char const *getBuildType()
+{
+#ifdef NDEBUG
+    return "release";
+#else
+    return "debug";
+#endif
+}
+
+/// One result per line, so a baseline can be read back without a JSON parser
+static void writeJson( std::ostream &os, std::vector<Result> const &results, double scale, size_t repeat )
+{
+    os << "{\n";
+    os << "\"suite\":\"JDKSAvdeccMCU\",\n";
+#ifdef __VERSION__
+    os << "\"compiler\":\"" << __VERSION__ << "\",\n";
+#endif
+    os << "\"build\":\"" << getBuildType() << "\",\n";
+    os << "\"scale\":" << scale << ",\n";
+    os << "\"repeat\":" << repeat << ",\n";
+    os << "\"results\":[\n";
+    for ( size_t i = 0; i < results.size(); ++i )
+    {
+        Result const &r = results[i];
+        os << "{\"name\":\"" << r.m_name << "\",\"unit\":\"" << r.m_unit << "\",\"operations\":" << r.m_operations
+           << ",\"best_ns_per_op\":" << std::fixed << std::setprecision( 3 ) << r.m_best_ns
+           << ",\"median_ns_per_op\":" << r.m_median_ns << ",\"ops_per_second\":" << std::setprecision( 0 )
+           << 1e9 / r.m_best_ns << ",\"checksum\":" << r.m_checksum
+           << ",\"reproducible\":" << ( r.m_reproducible ? "true" : "false" ) << "}"
+           << ( i + 1 < results.size() ? "," : "" ) << "\n";
+        os.unsetf( std::ios::floatfield );
+    }
+    os << "]\n";
+    os << "}\n";
+}
+
+static void writeCsv( std::ostream &os, std::vector<Result> const &results )
+{
+    os << "name,unit,operations,best_ns_per_op,median_ns_per_op,ops_per_second,checksum,reproducible\n";
+    for ( size_t i = 0; i < results.size(); ++i )
+    {
+        Result const &r = results[i];
+        os << r.m_name << "," << r.m_unit << "," << r.m_operations << "," << std::fixed << std::setprecision( 3 ) << r.m_best_ns
+           << "," << r.m_median_ns << "," << std::setprecision( 0 ) << 1e9 / r.m_best_ns << "," << r.m_checksum << ","
+           << ( r.m_reproducible ? 1 : 0 ) << "\n";
+        os.unsetf( std::ios::floatfield );
+    }
+}
+
+/// Read the best time per operation of each case from JSON written by writeJson()
+static bool readBaseline( std::string const &name, std::map<std::string, double> *baseline )
+{
+    std::ifstream f( name.c_str() );
+    std::string line;
+    while ( std::getline( f, line ) )
+    {
+        char case_name[64];
+        double best_ns;
+        if ( sscanf( line.c_str(),
+                     "{\"name\":\"%63[^\"]\",\"unit\":\"%*[^\"]\",\"operations\":%*u,\"best_ns_per_op\":%lf",
+                     case_name,
+                     &best_ns ) == 2 )
+        {
+            ( *baseline )[case_name] = best_ns;
+        }
+    }
+    return f.eof() && !baseline->empty();
+}
+
+static bool writeFile( std::string const &name, std::string const &contents )
+{
+    if ( name == "-" )
+    {
+        std::cout << contents;
+        return true;
+    }
+    std::ofstream f( name.c_str() );
+    f << contents;
+    return bool( f );
+}
+
+static int usage()
+{
+    std::cerr << "Usage: bench_suite [--scale factor] [--repeat count] [--filter text] [--json file] [--csv file]"
+              << " [--baseline file] [--tolerance percent]" << std::endl;
+    return 1;
+}
+
+int main( int argc, char **argv )
+{
+    double scale = 1.0;
+    size_t repeat = 5;
+    double tolerance = 10.0;
+    std::string filter;
+    std::string json_name;
+    std::string csv_name;
+    std::string baseline_name;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string arg( argv[i] );
+        if ( i + 1 >= argc )
+        {
+            return usage();
+        }
+        else if ( arg == "--scale" )
+        {
+            scale = atof( argv[++i] );
+        }
+        else if ( arg == "--repeat" )
+        {
+            repeat = std::max( size_t( atoi( argv[++i] ) ), size_t( 1 ) );
+        }
+        else if ( arg == "--filter" )
+        {
+            filter = argv[++i];
+        }
+        else if ( arg == "--json" )
+        {
+            json_name = argv[++i];
+        }
+        else if ( arg == "--csv" )
+        {
+            csv_name = argv[++i];
+        }
+        else if ( arg == "--baseline" )
+        {
+            baseline_name = argv[++i];
+        }
+        else if ( arg == "--tolerance" )
+        {
+            tolerance = atof( argv[++i] );
+        }
+        else
+        {
+            return usage();
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if ( !baseline_name.empty() && !readBaseline( baseline_name, &baseline ) )
+    {
+        std::cerr << "Unable to read the baseline " << baseline_name << std::endl;
+        return 1;
+    }
+
+    // The table goes to stderr when the JSON or CSV goes to stdout
+    std::ostream &table = json_name == "-" || csv_name == "-" ? std::cerr : std::cout;
+    table << "bench_suite: " << getBuildType() << " build, scale " << scale << ", best of " << repeat << std::endl;
+    table << std::left << std::setw( 22 ) << "case" << std::right << std::setw( 12 ) << "operations" << std::setw( 12 )
+          << "best ns" << std::setw( 12 ) << "median ns" << std::setw( 14 ) << "best rate" << std::endl;
+
+    std::vector<Result> results;
+    bool ok = true;
+    for ( size_t i = 0; i < case_count; ++i )
+    {
+        if ( filter.empty() || std::string( cases[i].m_name ).find( filter ) != std::string::npos )
+        {
+            Result result = runCase( cases[i], scale, repeat );
+            report( result, table );
+            ok = ok && result.m_reproducible && result.m_checksum != 0;
+            results.push_back( result );
+        }
+    }
+
+    if ( !baseline.empty() )
+    {
+        table << "against " << baseline_name << ", tolerance " << tolerance << "%" << std::endl;
+        for ( size_t i = 0; i < results.size(); ++i )
+        {
+            std::map<std::string, double>::const_iterator b = baseline.find( results[i].m_name );
+            if ( b != baseline.end() && b->second > 0.0 )
+            {
+                double change = ( results[i].m_best_ns / b->second - 1.0 ) * 100.0;
+                bool regressed = change > tolerance;
+                table << std::left << std::setw( 22 ) << results[i].m_name << std::right << std::fixed << std::setprecision( 1 )
+                      << std::setw( 8 ) << std::showpos << change << std::noshowpos << "%"
+                      << ( regressed ? " REGRESSION" : "" ) << std::endl;
+                table.unsetf( std::ios::floatfield );
+                ok = ok && !regressed;
+            }
+        }
+    }
+
+    if ( !json_name.empty() )
+    {
+        std::ostringstream os;
+        writeJson( os, results, scale, repeat );
+        ok = writeFile( json_name, os.str() ) && ok;
+    }
+    if ( !csv_name.empty() )
+    {
+        std::ostringstream os;
+        writeCsv( os, results );
+        ok = writeFile( csv_name, os.str() ) && ok;
+    }
+    return ok ? 0 : 1;
+}
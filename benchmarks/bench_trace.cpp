@@ -0,0 +1,357 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+#if JDKSAVDECCMCU_ENABLE_TRACE
+#include <thread>
+#endif
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Measures the cost of recording trace events and checks what the
+/// trace files hold.
+///
+/// "disabled": Trace::record() while recording is disabled
+/// "record"  : Trace::record() on one thread, each event reads the clock
+/// "loop"    : the same in iterations of an event loop of 16 events
+///             that share the timestamp of Trace::beginLoop()
+/// "threads" : Trace::record() on several threads at once while the
+///             main thread takes snapshots, an event that is torn by
+///             the writer must never be in a snapshot
+/// "off"     : an Entity answers ENTITY_AVAILABLE commands through a
+///             HandlerGroup with recording disabled
+/// "on"      : the same with recording enabled, three events per frame
+///             that share the timestamp of the received frame
+///
+/// The trace file written at the end has to hold the newest events of
+/// every thread in order, and the events of the Entity in the order it
+/// recorded them. The file is kept if a name is given, to read with
+/// JDKSAvdeccMCU_DecodeTrace.
+///
+/// Usage: bench_trace [events] [threads] [trace_file]
+///
+
+#if JDKSAVDECCMCU_ENABLE_TRACE
+
+static Eui48 const entity_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 );
+static Eui64 const entity_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf0 );
+static Eui48 const controller_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf1 );
+static Eui64 const controller_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf1 );
+
+/// The sources of the events of the "threads" run are thread_source + the thread number
+static uint64_t const thread_source = 0x1000;
+
+/// The id of an event is a function of its value and source, so that a torn event shows
+static uint64_t threadEventId( uint64_t source, uint32_t value ) { return ( uint64_t( value ) << 16 ) ^ ( source * 0x9e3779b9 ); }
+
+/// Takes the responses of the Entity, which traces them
+class ResponseSocket : public RawSocket
+{
+  public:
+    ResponseSocket() : m_sent( 0 ) {}
+
+    virtual void setHandlerGroup( HandlerGroup *handler_group ) override { (void)handler_group; }
+
+    virtual jdksavdecc_timestamp_in_milliseconds getTimeInMilliseconds() const override { return 0; }
+
+    virtual bool recvFrame( Frame *frame ) override
+    {
+        (void)frame;
+        return false;
+    }
+
+    virtual bool sendFrame( Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        (void)data1;
+        (void)data2;
+        countTxFrame( frame, len1, len2 );
+        ++m_sent;
+        return true;
+    }
+
+    /// A reply goes back to the SA of the frame
+    virtual bool sendReplyFrame( Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        (void)data1;
+        (void)data2;
+        Eui48 da = frame.getSA();
+        countTxFrame( frame, len1, len2, &da );
+        ++m_sent;
+        return true;
+    }
+
+    virtual bool joinMulticast( const Eui48 &multicast_mac ) override
+    {
+        (void)multicast_mac;
+        return false;
+    }
+
+    virtual Eui48 const &getMACAddress() const override { return entity_mac; }
+
+    uint64_t m_sent;
+};
+
+static void putCommand( FixedBuffer &buf, uint16_t command_type, uint16_t sequence_id )
+{
+    buf.putEUI48( entity_mac );
+    buf.putEUI48( controller_mac );
+    buf.putDoublet( JDKSAVDECC_AVTP_ETHERTYPE );
+    buf.putOctet( JDKSAVDECC_1722A_SUBTYPE_AECP );
+    buf.putOctet( JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND );
+    if ( command_type == JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY )
+    {
+        buf.putDoublet( JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY_COMMAND_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+    }
+    else
+    {
+        buf.putDoublet( JDKSAVDECC_AECPDU_AEM_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+    }
+    buf.putEUI64( entity_id );
+    buf.putEUI64( controller_id );
+    buf.putDoublet( sequence_id );
+    buf.putDoublet( command_type );
+    if ( command_type == JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY )
+    {
+        buf.putQuadlet( 0 );
+        buf.putEUI64( Eui64() );
+        buf.putDoublet( JDKSAVDECC_DESCRIPTOR_ENTITY );
+        buf.putDoublet( 0 );
+    }
+}
+
+static void report( char const *name, double seconds, size_t count, char const *unit )
+{
+    BenchReport( name, seconds, 10 ).nanoseconds( double( count ), unit );
+}
+
+static bool check( char const *what, uint64_t value, uint64_t expected )
+{
+    if ( value != expected )
+    {
+        std::cout << what << ": " << value << ", expected " << expected << std::endl;
+    }
+    return value == expected;
+}
+
+/// The thread events of a snapshot must be whole and in order, complete says that none may be missing
+static bool checkThreadEvents( TraceDump const &dump, size_t threads, size_t events, bool complete )
+{
+    size_t kept = std::min<size_t>( events, JDKSAVDECCMCU_TRACE_BUFFER_EVENTS );
+    size_t found = 0;
+    for ( size_t t = 0; t < dump.m_threads.size(); ++t )
+    {
+        std::vector<TraceEvent> const &e = dump.m_threads[t].m_events;
+        if ( e.empty() || e[0].m_source < thread_source || e[0].m_source >= thread_source + threads )
+        {
+            continue;
+        }
+        ++found;
+        for ( size_t i = 0; i < e.size(); ++i )
+        {
+            bool whole = e[i].m_source == e[0].m_source && e[i].m_id == threadEventId( e[i].m_source, e[i].m_value );
+            bool ordered = i == 0 || ( e[i].m_value > e[i - 1].m_value && e[i].m_sequence > e[i - 1].m_sequence );
+            if ( !whole || !ordered || ( complete && i > 0 && e[i].m_value != e[i - 1].m_value + 1 ) )
+            {
+                std::cout << "Thread event " << i << " of buffer " << dump.m_threads[t].m_buffer_index << " is "
+                          << ( whole ? "out of order" : "torn" ) << std::endl;
+                return false;
+            }
+        }
+        if ( complete
+             && ( !check( "thread events kept", e.size(), kept )
+                  || !check( "thread events lost", dump.m_threads[t].m_lost, events - kept )
+                  || !check( "last thread event", e.back().m_value, events - 1 ) ) )
+        {
+            return false;
+        }
+    }
+    return !complete || check( "threads in the trace", found, threads );
+}
+
+static void recordThreadEvents( uint64_t source, size_t events, std::atomic<size_t> *started, size_t threads, double *seconds )
+{
+    // Wait for all threads, so that each gets its own buffer
+    ++*started;
+    while ( *started < threads )
+    {
+        std::this_thread::yield();
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for ( size_t n = 0; n < events; ++n )
+    {
+        Trace::record( TRACE_NONE, uint16_t( source ), source, threadEventId( source, uint32_t( n ) ), uint32_t( n ) );
+    }
+    *seconds = benchSince( start );
+    ++*started;
+    while ( *started < 2 * threads )
+    {
+        std::this_thread::yield();
+    }
+}
+
+int main( int argc, char **argv )
+{
+    size_t events = argc > 1 ? size_t( atoi( argv[1] ) ) : 10000000;
+    size_t threads = argc > 2 ? size_t( atoi( argv[2] ) ) : 4;
+    std::string trace_name = argc > 3 ? argv[3] : "bench_trace.trace";
+    bool ok = true;
+
+    std::cout << "trace: " << events << " events, " << threads << " threads, " << JDKSAVDECCMCU_TRACE_BUFFER_EVENTS
+              << " events per thread" << std::endl;
+
+    ok = check( "recording enabled from the start", Trace::isEnabled(), 1 ) && ok;
+    Trace::setEnabled( false );
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for ( size_t n = 0; n < events; ++n )
+    {
+        Trace::record( TRACE_NONE, 0, 0, n, uint32_t( n ) );
+    }
+    report( "disabled", benchSince( start ), events, "event" );
+    Trace::setEnabled( true );
+
+    start = std::chrono::steady_clock::now();
+    for ( size_t n = 0; n < events; ++n )
+    {
+        Trace::record( TRACE_NONE, 0, 0, n, uint32_t( n ) );
+    }
+    report( "record", benchSince( start ), events, "event" );
+
+    start = std::chrono::steady_clock::now();
+    for ( size_t n = 0; n < events; n += 16 )
+    {
+        Trace::beginLoop();
+        for ( size_t i = n; i < n + 16; ++i )
+        {
+            Trace::record( TRACE_NONE, 0, 0, i, uint32_t( i ) );
+        }
+        Trace::endLoop();
+    }
+    report( "loop", benchSince( start ), events, "event" );
+
+    // Each thread records all events, the snapshots are taken until the threads are done
+    {
+        std::atomic<size_t> started( 0 );
+        std::vector<double> seconds( threads );
+        std::vector<std::thread> workers;
+        for ( size_t i = 0; i < threads; ++i )
+        {
+            workers.push_back( std::thread( recordThreadEvents, thread_source + i, events, &started, threads, &seconds[i] ) );
+        }
+        size_t snapshots = 0;
+        uint64_t snapshot_events = 0;
+        while ( started < 2 * threads )
+        {
+            TraceDump dump;
+            Trace::snapshot( &dump );
+            ok = checkThreadEvents( dump, threads, events, false ) && ok;
+            snapshot_events += dump.getEventCount();
+            ++snapshots;
+        }
+        for ( size_t i = 0; i < threads; ++i )
+        {
+            workers[i].join();
+        }
+        report( "threads", *std::max_element( seconds.begin(), seconds.end() ), events, "event" );
+        std::cout << "          " << snapshots << " snapshots of " << ( snapshots ? snapshot_events / snapshots : 0 )
+                  << " events" << std::endl;
+    }
+
+    // An Entity with recording disabled and enabled
+    size_t frames = events / 10;
+    ResponseSocket net;
+    ADPManager adp( net, entity_id, ADPCoreInfo( Eui64(), JDKSAVDECC_ADP_ENTITY_CAPABILITY_AEM_SUPPORTED ) );
+    RegisteredControllersStorage<1> registered_controllers;
+    Entity entity( adp, &registered_controllers, 0 );
+    FrameWithMTU frame;
+    HandlerGroupWithSize<2> handlers( &frame );
+    handlers.add( &entity );
+    handlers.add( &adp );
+
+    FrameWithMTU acquire;
+    putCommand( acquire, JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY, 0 );
+    frame.setLength( 0 );
+    frame.putBuf( acquire.getBuf(), acquire.getLength() );
+    handlers.receivedPDU( &net, frame );
+
+    std::vector<FrameWithMTU> commands( 64 );
+    for ( size_t i = 0; i < commands.size(); ++i )
+    {
+        putCommand( commands[i], JDKSAVDECC_AEM_COMMAND_ENTITY_AVAILABLE, uint16_t( i + 1 ) );
+    }
+    for ( int enabled = 0; enabled < 2; ++enabled )
+    {
+        Trace::setEnabled( enabled != 0 );
+        start = std::chrono::steady_clock::now();
+        for ( size_t n = 0; n < frames; ++n )
+        {
+            frame.setLength( 0 );
+            frame.putBuf( commands[n % commands.size()].getBuf(), commands[n % commands.size()].getLength() );
+            handlers.receivedPDU( &net, frame );
+        }
+        report( enabled ? "on" : "off", benchSince( start ), frames, "frame" );
+    }
+    ok = check( "responses", net.m_sent, 1 + 2 * frames ) && ok;
+
+    Trace::dump( trace_name );
+    TraceDump dump;
+    dump.read( trace_name );
+    if ( argc <= 3 )
+    {
+        remove( trace_name.c_str() );
+    }
+    ok = checkThreadEvents( dump, threads, events, true ) && ok;
+
+    // The main thread ends with RX, TX and ACCEPTED of each command
+    std::vector<TraceEvent> const *main_events = 0;
+    for ( size_t t = 0; t < dump.m_threads.size(); ++t )
+    {
+        std::vector<TraceEvent> const &e = dump.m_threads[t].m_events;
+        if ( !e.empty() && e.back().m_type == TRACE_AEM_COMMAND_ACCEPTED )
+        {
+            main_events = &e;
+        }
+    }
+    if ( !main_events || main_events->size() < 3 * commands.size() )
+    {
+        std::cout << "No events of the Entity in the trace" << std::endl;
+        return 1;
+    }
+    std::vector<TraceEvent> const &e = *main_events;
+    for ( size_t i = e.size() - 3 * commands.size(); i < e.size(); i += 3 )
+    {
+        bool rx = e[i].m_type == TRACE_FRAME_RX && e[i].m_id == controller_mac.convertToUint64()
+                  && e[i].m_source == entity_mac.convertToUint64() && e[i].m_arg == JDKSAVDECC_AVTP_ETHERTYPE;
+        bool tx = e[i + 1].m_type == TRACE_FRAME_TX && e[i + 1].m_id == controller_mac.convertToUint64();
+        bool accepted = e[i + 2].m_type == TRACE_AEM_COMMAND_ACCEPTED && e[i + 2].m_arg == JDKSAVDECC_AEM_COMMAND_ENTITY_AVAILABLE
+                        && e[i + 2].m_source == entity_id.convertToUint64() && e[i + 2].m_id == controller_id.convertToUint64();
+        bool timed = e[i].m_time == e[i + 1].m_time && e[i + 1].m_time == e[i + 2].m_time
+                     && ( i == 0 || e[i - 1].m_time <= e[i].m_time );
+        if ( !rx || !tx || !accepted || !timed )
+        {
+            std::cout << "Entity events at " << i << ": rx " << rx << ", tx " << tx << ", accepted " << accepted << ", timed "
+                      << timed << std::endl;
+            ok = false;
+            break;
+        }
+    }
+    uint64_t first_ns = dump.getNanoseconds( e.front().m_time );
+    uint64_t last_ns = dump.getNanoseconds( e.back().m_time );
+    if ( first_ns < dump.m_start_ns || last_ns > dump.m_end_ns || first_ns > last_ns )
+    {
+        std::cout << "Event times are outside of the trace" << std::endl;
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
+
+#else
+
+int main()
+{
+    std::cout << "bench_trace needs JDKSAVDECCMCU_ENABLE_TRACE" << std::endl;
+    return 0;
+}
+
+#endif
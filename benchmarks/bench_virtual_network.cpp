@@ -0,0 +1,240 @@
+#include "JDKSAvdeccMCU.hpp"
+#include "bench_report.hpp"
+
+#include <chrono>
+#include <map>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Runs many simulated entities against one controller on a
+/// VirtualNetwork.
+///
+/// Every entity is an Entity with its own ADPManager and RawSocketVirtual.
+/// The controller sends an ENTITY_DISCOVER, counts the entities whose
+/// ENTITY_AVAILABLE it sees and then sends each of them an AEM
+/// ENTITY_AVAILABLE command and counts the responses. The controller
+/// keeps one command in flight, as Entity does, and sends the next one
+/// when the response arrives. The network keeps
+/// running with the usual ADP advertisements until the simulated time
+/// is over. Every ADP message goes to every entity, so the work grows
+/// with the square of the number of entities.
+///
+/// Reports the simulated time the discovery and the commands took, the
+/// wall clock time and the frame deliveries per second.
+///
+/// Exits with 1 if, without loss, not every entity was discovered or
+/// did not respond.
+///
+/// Usage: bench_virtual_network [entities] [simulated_seconds] [loss_ppm] [bandwidth_mbps]
+///
+
+static Eui64 makeEntityId( uint32_t n )
+{
+    return Eui64( 0x70, 0xb3, 0xd5, 0xff, 0xfe, uint8_t( n >> 16 ), uint8_t( n >> 8 ), uint8_t( n ) );
+}
+
+class SimEntity
+{
+  public:
+    SimEntity( VirtualNetwork &network, uint32_t n, Frame *frame )
+        : m_net( network, JDKSAVDECC_AVTP_ETHERTYPE, Eui48(), &multicast() )
+        , m_adp( m_net,
+                 makeEntityId( n ),
+                 ADPCoreInfo( Eui64( 0x70, 0xb3, 0xd5, 0xed, 0xc0, 0x00, 0x00, 0x01 ),
+                              JDKSAVDECC_ADP_ENTITY_CAPABILITY_AEM_SUPPORTED ) )
+        , m_entity( m_adp, &m_registered_controllers, 0 )
+        , m_handlers( frame )
+    {
+        m_handlers.add( &m_entity );
+        m_handlers.add( &m_adp );
+        m_net.setHandlerGroup( &m_handlers );
+    }
+
+    static Eui48 const &multicast()
+    {
+        static Eui48 mc( JDKSAVDECC_MULTICAST_ADP_ACMP_MAC );
+        return mc;
+    }
+
+    RawSocketVirtual m_net;
+    ADPManager m_adp;
+    RegisteredControllersStorage<1> m_registered_controllers;
+    Entity m_entity;
+    HandlerGroupWithSize<2> m_handlers;
+};
+
+class SimControllerAdp : public ADPManager
+{
+  public:
+    SimControllerAdp( RawSocket &net, Eui64 const &entity_id )
+        : ADPManager( net,
+                      entity_id,
+                      ADPCoreInfo( Eui64(), 0, JDKSAVDECC_ADP_CONTROLLER_CAPABILITY_IMPLEMENTED ) )
+        , m_discovered_time( 0 )
+        , m_expected( 0 )
+    {
+    }
+
+    virtual void receivedEntityAvailable( jdksavdecc_adpdu_common_control_header const &header, Frame &frame ) override
+    {
+        if ( m_entities.insert( std::make_pair( jdksavdecc_eui64_convert_to_uint64( &header.entity_id ), frame.getSA() ) ).second
+             && m_entities.size() == m_expected )
+        {
+            m_discovered_time = frame.getTimeInMilliseconds();
+        }
+    }
+
+    /// Ask every entity to advertise
+    void sendDiscover()
+    {
+        Eui48 adp_multicast_addr = JDKSAVDECC_MULTICAST_ADP_ACMP_MAC;
+        FrameWithSize<82> adp( 0, adp_multicast_addr, m_net.getMACAddress(), JDKSAVDECC_AVTP_ETHERTYPE );
+        adp.putOctet( 0x80 + JDKSAVDECC_SUBTYPE_ADP );
+        adp.putOctet( 0x00 + JDKSAVDECC_ADP_MESSAGE_TYPE_ENTITY_DISCOVER );
+        adp.putOctet( 0 );
+        adp.putOctet( JDKSAVDECC_ADPDU_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+        adp.putZeros( JDKSAVDECC_ADPDU_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+        m_net.sendFrame( adp );
+    }
+
+    std::map<uint64_t, Eui48> m_entities;
+    jdksavdecc_timestamp_in_milliseconds m_discovered_time;
+    size_t m_expected;
+};
+
+class SimController : public ControllerEntity
+{
+  public:
+    typedef std::map<uint64_t, Eui48> targets_type;
+
+    SimController( ADPManager &adp )
+        : ControllerEntity( adp, &m_registered_controllers, 0 ), m_targets( 0 ), m_responses( 0 ), m_done_time( 0 ), m_expected( 0 )
+    {
+    }
+
+    /// Send ENTITY_AVAILABLE to every target, one after the other
+    void start( targets_type const &targets )
+    {
+        m_targets = &targets;
+        m_next = targets.begin();
+        sendNext();
+    }
+
+    void sendNext()
+    {
+        if ( m_targets && m_next != m_targets->end() )
+        {
+            sendEntityAvailable( Eui64( m_next->first ), m_next->second );
+            ++m_next;
+        }
+    }
+
+    virtual bool receiveEntityAvailableResponse( jdksavdecc_aecpdu_aem const &aem, Frame &pdu ) override
+    {
+        (void)aem;
+        if ( ++m_responses == m_expected )
+        {
+            m_done_time = pdu.getTimeInMilliseconds();
+        }
+        sendNext();
+        return true;
+    }
+
+    /// A lost command or response times out, go on with the next one
+    virtual void commandTimedOut( Eui64 const &target_entity_id, uint16_t command_type, uint16_t sequence_id ) override
+    {
+        Entity::commandTimedOut( target_entity_id, command_type, sequence_id );
+        sendNext();
+    }
+
+    RegisteredControllersStorage<1> m_registered_controllers;
+    targets_type const *m_targets;
+    targets_type::const_iterator m_next;
+    size_t m_responses;
+    jdksavdecc_timestamp_in_milliseconds m_done_time;
+    size_t m_expected;
+};
+
+int main( int argc, char **argv )
+{
+    uint32_t entity_count = argc > 1 ? uint32_t( atoi( argv[1] ) ) : 5000;
+    double simulated_seconds = argc > 2 ? atof( argv[2] ) : 30.0;
+    uint32_t loss_ppm = argc > 3 ? uint32_t( atoi( argv[3] ) ) : 0;
+    uint64_t bandwidth_mbps = argc > 4 ? uint64_t( atoi( argv[4] ) ) : 1000;
+
+    VirtualNetwork::Settings settings;
+    settings.m_latency_us = 20;
+    settings.m_jitter_us = 5;
+    settings.m_loss_ppm = loss_ppm;
+    settings.m_bandwidth_bps = bandwidth_mbps * 1000000;
+    VirtualNetwork network( settings );
+
+    std::cout << "Virtual network: " << entity_count << " entities, " << simulated_seconds << " simulated s, loss "
+              << loss_ppm << " ppm, " << bandwidth_mbps << " Mbit/s links" << std::endl;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    FrameWithMTU frame;
+    std::vector<SimEntity *> entities;
+    for ( uint32_t n = 0; n < entity_count; ++n )
+    {
+        entities.push_back( new SimEntity( network, n + 1, &frame ) );
+    }
+
+    RawSocketVirtual controller_net( network, JDKSAVDECC_AVTP_ETHERTYPE, Eui48(), &SimEntity::multicast() );
+    SimControllerAdp controller_adp( controller_net, makeEntityId( 0xffffff ) );
+    SimController controller( controller_adp );
+    HandlerGroupWithSize<2> controller_handlers( &frame );
+    controller_handlers.add( &controller );
+    controller_handlers.add( &controller_adp );
+    controller_net.setHandlerGroup( &controller_handlers );
+    controller_adp.m_expected = entity_count;
+    controller.m_expected = entity_count;
+
+    std::chrono::duration<double> setup = std::chrono::steady_clock::now() - start;
+
+    jdksavdecc_timestamp_in_milliseconds end = jdksavdecc_timestamp_in_milliseconds( simulated_seconds * 1000.0 );
+    bool commands_sent = false;
+
+    start = std::chrono::steady_clock::now();
+    network.tick( 1 );
+    controller_adp.sendDiscover();
+
+    for ( jdksavdecc_timestamp_in_milliseconds t = 10; t <= end; t += 10 )
+    {
+        network.tick( t );
+
+        if ( !commands_sent && ( controller_adp.m_discovered_time || t >= end / 2 ) )
+        {
+            controller.start( controller_adp.m_entities );
+            commands_sent = true;
+        }
+    }
+
+    BenchReport( "run", benchSince( start ), 4 )
+        .rate( simulated_seconds, "x real time", 10, 1 )
+        .rate( double( network.getDeliveredCount() ), "deliveries/s" )
+        << ", setup " << std::setprecision( 3 ) << setup.count() << " s";
+    std::cout << "sent " << network.getSentCount() << " delivered " << network.getDeliveredCount() << " lost "
+              << network.getLostCount() << " congestion drops " << network.getCongestionDropCount() << std::endl;
+    std::cout << "discovered " << controller_adp.m_entities.size() << " entities";
+    if ( controller_adp.m_discovered_time )
+    {
+        std::cout << " in " << controller_adp.m_discovered_time - 1 << " ms";
+    }
+    std::cout << ", " << controller.m_responses << " ENTITY_AVAILABLE responses";
+    if ( controller.m_done_time )
+    {
+        std::cout << ", the last at " << controller.m_done_time << " ms";
+    }
+    std::cout << std::endl;
+
+    bool ok = loss_ppm > 0 || ( controller_adp.m_entities.size() == entity_count && controller.m_responses == entity_count );
+
+    for ( size_t n = 0; n < entities.size(); ++n )
+    {
+        delete entities[n];
+    }
+    return ok ? 0 : 1;
+}
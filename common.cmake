@@ -5,6 +5,7 @@ option(TESTS "Enable building of extended test code in library" ON)
 option(EXAMPLES "Enable building of example programs" ON)
 option(TOOLS "Enable building of tools" ON)
 option(TOOLS_DEV "Enable building of tools-dev" ON)
+option(BENCHMARKS "Enable building of benchmark programs" ON)
 
 enable_testing()
 
@@ -110,6 +111,38 @@ if(TOOLS_DEV MATCHES "ON")
     endforeach(item)
 endif()
 
+if(BENCHMARKS MATCHES "ON")
+    file(GLOB PROJECT_BENCHMARKS "benchmarks/*.c" "benchmarks/*.cpp")
+    foreach(item ${PROJECT_BENCHMARKS})
+      GET_FILENAME_COMPONENT(benchmarkname ${item} NAME_WE )
+      add_executable(${benchmarkname} ${item})
+      target_link_libraries(${benchmarkname} ${LIBS} )
+    endforeach(item)
+
+    # A short loopback soak of the APS and APCs, it needs no network interface
+    add_test(NAME bench_aps_soak COMMAND bench_aps_soak 2 32 5000 500 )
+    add_test(NAME bench_aps_sharded COMMAND bench_aps_sharded 1 32 2 )
+    add_test(NAME bench_virtual_network COMMAND bench_virtual_network 500 5 )
+    add_test(NAME bench_descriptor_storage COMMAND bench_descriptor_storage 20000 200000 )
+    add_test(NAME bench_pcap_reader COMMAND bench_pcap_reader 100000 100000 )
+    add_test(NAME bench_pcap_writer COMMAND bench_pcap_writer 500000 )
+    add_test(NAME bench_pcap_replay COMMAND bench_pcap_replay 0.5 20 1 )
+    add_test(NAME bench_capture_analyzer COMMAND bench_capture_analyzer 50 60 4 )
+    add_test(NAME bench_json_print COMMAND bench_json_print 200000 64 )
+    add_test(NAME bench_suite COMMAND bench_suite --scale 0.02 --repeat 2 )
+    add_test(NAME bench_metrics COMMAND bench_metrics 200000 )
+    add_test(NAME bench_trace COMMAND bench_trace 200000 4 )
+
+    # "make benchmarks" writes the results of bench_suite as JSON, compared with BENCHMARK_BASELINE if it is set
+    set(BENCHMARK_RESULTS "${CMAKE_BINARY_DIR}/benchmark_results.json" CACHE FILEPATH "Results of the benchmarks target")
+    set(BENCHMARK_BASELINE "" CACHE FILEPATH "Results of an earlier benchmarks run to compare with")
+    set(BENCHMARK_ARGS --json ${BENCHMARK_RESULTS})
+    if(BENCHMARK_BASELINE)
+        list(APPEND BENCHMARK_ARGS --baseline ${BENCHMARK_BASELINE})
+    endif()
+    add_custom_target(benchmarks COMMAND bench_suite ${BENCHMARK_ARGS} DEPENDS bench_suite USES_TERMINAL )
+endif()
+
 if(TESTS MATCHES "ON")
    file(GLOB PROJECT_TESTS "tests/*.c" "tests/*.cpp")
    foreach(item ${PROJECT_TESTS})
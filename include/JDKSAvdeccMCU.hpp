@@ -34,26 +34,43 @@
 #include "JDKSAvdeccMCU/ControlDescription.hpp"
 #include "JDKSAvdeccMCU/ControlReceiver.hpp"
 #include "JDKSAvdeccMCU/ControlSender.hpp"
+#include "JDKSAvdeccMCU/ControlSenderGroup.hpp"
 #include "JDKSAvdeccMCU/ControlValueHolder.hpp"
 #include "JDKSAvdeccMCU/ControllerEntity.hpp"
+#include "JDKSAvdeccMCU/PersistentStorage.hpp"
 #include "JDKSAvdeccMCU/EEPromStorage.hpp"
 #include "JDKSAvdeccMCU/Entity.hpp"
+#include "JDKSAvdeccMCU/ACMPPersistentState.hpp"
 #include "JDKSAvdeccMCU/Frame.hpp"
 #include "JDKSAvdeccMCU/Handler.hpp"
 #include "JDKSAvdeccMCU/HandlerGroup.hpp"
+#include "JDKSAvdeccMCU/Metrics.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
 #include "JDKSAvdeccMCU/Helpers.hpp"
 #include "JDKSAvdeccMCU/RangedValue.hpp"
 #include "JDKSAvdeccMCU/PcapFile.hpp"
 #include "JDKSAvdeccMCU/PcapFileReader.hpp"
 #include "JDKSAvdeccMCU/PcapFileWriter.hpp"
+#include "JDKSAvdeccMCU/PcapMappedReader.hpp"
+#include "JDKSAvdeccMCU/CaptureAnalyzer.hpp"
 #include "JDKSAvdeccMCU/RawSocket.hpp"
 #include "JDKSAvdeccMCU/RawSocketRunner.hpp"
 #include "JDKSAvdeccMCU/RawSocketPcapFile.hpp"
 #include "JDKSAvdeccMCU/RawSocketWizNet.hpp"
+#include "JDKSAvdeccMCU/VirtualNetwork.hpp"
+#include "JDKSAvdeccMCU/RawSocketVirtual.hpp"
 #include "JDKSAvdeccMCU/MDNSRegister.hpp"
 #include "JDKSAvdeccMCU/Http.hpp"
 #include "JDKSAvdeccMCU/AppMessage.hpp"
 #include "JDKSAvdeccMCU/AppMessageParser.hpp"
 #include "JDKSAvdeccMCU/AppMessageHandler.hpp"
+#include "JDKSAvdeccMCU/AppMessageQueue.hpp"
 #include "JDKSAvdeccMCU/Apc.hpp"
+#include "JDKSAvdeccMCU/ApsEntityIdAllocator.hpp"
 #include "JDKSAvdeccMCU/Aps.hpp"
+#include "JDKSAvdeccMCU/ApsSharedMessage.hpp"
+#include "JDKSAvdeccMCU/TimerWheel.hpp"
+#include "JDKSAvdeccMCU/TcpOutputBuffer.hpp"
+#include "JDKSAvdeccMCU/LockFreeQueue.hpp"
+#include "JDKSAvdeccMCU/ApsServer.hpp"
+#include "JDKSAvdeccMCU/ApsServerSharded.hpp"
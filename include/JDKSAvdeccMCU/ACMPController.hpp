@@ -39,6 +39,15 @@
 #include "JDKSAvdeccMCU/Handler.hpp"
 #include "JDKSAvdeccMCU/Entity.hpp"
 
+#ifndef JDKSAVDECCMCU_ACMP_CONTROLLER_SCAN_PER_IN_FLIGHT
+///
+/// The number of queued commands that an ACMPControllerGroupHandler looks
+/// through per in flight slot when it sends pending commands, so that a
+/// long queue for one busy listener costs a bounded amount per tick
+///
+#define JDKSAVDECCMCU_ACMP_CONTROLLER_SCAN_PER_IN_FLIGHT ( 32 )
+#endif
+
 namespace JDKSAvdeccMCU
 {
 class ACMPControllerGroupHandlerBase
@@ -46,6 +55,8 @@ class ACMPControllerGroupHandlerBase
   public:
     ACMPControllerGroupHandlerBase( Entity *entity ) : m_entity( entity ) {}
 
+    virtual ~ACMPControllerGroupHandlerBase() {}
+
     virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp ) = 0;
 
     virtual uint8_t receivedACMPDU( RawSocket *incoming_socket, const jdksavdecc_acmpdu &acmpdu, Frame &frame ) = 0;
@@ -53,4 +64,304 @@ class ACMPControllerGroupHandlerBase
   protected:
     Entity *m_entity;
 };
+
+///
+/// \brief The ACMPConnection struct
+///
+/// One talker stream source to listener stream sink connection
+///
+struct ACMPConnection
+{
+    ACMPConnection() : m_talker_unique_id( 0 ), m_listener_unique_id( 0 ) {}
+
+    ACMPConnection( Eui64 const &talker_entity_id,
+                    uint16_t talker_unique_id,
+                    Eui64 const &listener_entity_id,
+                    uint16_t listener_unique_id )
+        : m_talker_entity_id( talker_entity_id )
+        , m_talker_unique_id( talker_unique_id )
+        , m_listener_entity_id( listener_entity_id )
+        , m_listener_unique_id( listener_unique_id )
+    {
+    }
+
+    Eui64 m_talker_entity_id;
+    uint16_t m_talker_unique_id;
+    Eui64 m_listener_entity_id;
+    uint16_t m_listener_unique_id;
+};
+
+bool operator<( ACMPConnection const &lhs, ACMPConnection const &rhs );
+
+bool operator==( ACMPConnection const &lhs, ACMPConnection const &rhs );
+
+///
+/// \brief The ACMPControllerCommand struct
+///
+/// One queued CONNECT_RX or DISCONNECT_RX command and its progress
+///
+struct ACMPControllerCommand
+{
+    enum State
+    {
+        STATE_PENDING,
+        STATE_IN_FLIGHT,
+        STATE_SUCCEEDED,
+        STATE_FAILED,
+        STATE_TIMED_OUT
+    };
+
+    ACMPControllerCommand()
+        : m_message_type( JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND )
+        , m_flags( 0 )
+        , m_state( STATE_PENDING )
+        , m_status( JDKSAVDECC_ACMP_STATUS_SUCCESS )
+        , m_retry_count( 0 )
+        , m_sequence_id( 0 )
+        , m_sent_time( 0 )
+    {
+    }
+
+    bool isDone() const { return m_state == STATE_SUCCEEDED || m_state == STATE_FAILED || m_state == STATE_TIMED_OUT; }
+
+    /// JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND or
+    /// JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_RX_COMMAND
+    uint8_t m_message_type;
+    ACMPConnection m_connection;
+    uint16_t m_flags;
+
+    State m_state;
+
+    /// The ACMP status of the response, when the state is STATE_SUCCEEDED or
+    /// STATE_FAILED, or LISTENER_TALKER_TIMEOUT when it is STATE_TIMED_OUT
+    uint8_t m_status;
+
+    /// The number of times the command was re-sent after a time out
+    uint8_t m_retry_count;
+
+    uint16_t m_sequence_id;
+    jdksavdecc_timestamp_in_milliseconds m_sent_time;
+};
+
+class ACMPControllerGroupHandler;
+
+class ACMPControllerEvents
+{
+  public:
+    virtual ~ACMPControllerEvents() {}
+
+    ///
+    /// \brief acmpCommandCompleted
+    ///
+    /// Notification that a queued command succeeded, failed or timed out
+    ///
+    /// \param handler The controller state machine
+    /// \param command The command, with its final state and status
+    ///
+    virtual void acmpCommandCompleted( ACMPControllerGroupHandler *handler, ACMPControllerCommand const &command ) = 0;
+
+    ///
+    /// \brief acmpAllCommandsCompleted
+    ///
+    /// Notification that the last queued command completed
+    ///
+    /// \param handler The controller state machine
+    ///
+    virtual void acmpAllCommandsCompleted( ACMPControllerGroupHandler *handler ) = 0;
+};
+
+///
+/// \brief The ACMPControllerGroupHandler class
+///
+/// ACMP Controller state machine that works through a queue of CONNECT_RX and
+/// DISCONNECT_RX commands. See IEEE Std 1722.1-2013 Clause 8.2.2.4.
+///
+/// Commands are pipelined: up to max_in_flight commands are outstanding at
+/// once, with at most max_in_flight_per_listener to any one listener entity
+/// and never two to the same listener stream sink. A command that times out
+/// is re-sent up to max_retries times.
+///
+/// The ACMPControllerGroupHandler does not contain the storage for the
+/// commands. See ACMPControllerGroupHandlerWithSize and
+/// ACMPControllerGroupHandlerDynamic.
+///
+class ACMPControllerGroupHandler : public ACMPControllerGroupHandlerBase
+{
+  public:
+    ///
+    /// \brief ACMPControllerGroupHandler
+    /// \param entity The controller entity
+    /// \param event_target The object to notify of progress, may be 0
+    /// \param command_storage Pointer to array of ACMPControllerCommand
+    /// \param max_commands Size of the command_storage array
+    /// \param in_flight_storage Pointer to array of uint32_t
+    /// \param max_in_flight Size of the in_flight_storage array
+    /// \param max_in_flight_per_listener The maximum number of commands
+    /// awaiting a response from any one listener entity
+    /// \param max_retries The number of times a timed out command is re-sent
+    ///
+    ACMPControllerGroupHandler( Entity *entity,
+                                ACMPControllerEvents *event_target,
+                                ACMPControllerCommand *command_storage,
+                                uint32_t max_commands,
+                                uint32_t *in_flight_storage,
+                                uint16_t max_in_flight,
+                                uint16_t max_in_flight_per_listener = 1,
+                                uint8_t max_retries = 1 );
+
+    virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp ) override;
+
+    virtual uint8_t receivedACMPDU( RawSocket *incoming_socket, const jdksavdecc_acmpdu &acmpdu, Frame &frame ) override;
+
+    ///
+    /// \brief connectStream Queue a CONNECT_RX command
+    /// \return false if the queue is full
+    ///
+    bool connectStream( ACMPConnection const &connection, uint16_t flags = 0 )
+    {
+        return queueCommand( JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND, connection, flags );
+    }
+
+    ///
+    /// \brief disconnectStream Queue a DISCONNECT_RX command
+    /// \return false if the queue is full
+    ///
+    bool disconnectStream( ACMPConnection const &connection )
+    {
+        return queueCommand( JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_RX_COMMAND, connection, 0 );
+    }
+
+#if JDKSAVDECCMCU_ENABLE_VECTOR
+    ///
+    /// \brief applyConnectionMatrix Queue the commands that change the
+    /// connections from current to desired
+    ///
+    /// Connections only in current are disconnected and connections only in
+    /// desired are connected. All the disconnects are queued before the
+    /// connects.
+    ///
+    /// \param current The connections that exist now
+    /// \param desired The connections that should exist
+    /// \param flags The flags for the CONNECT_RX commands
+    /// \return false if the queue does not have room for all of the commands,
+    /// in which case nothing is queued
+    ///
+    bool applyConnectionMatrix( std::vector<ACMPConnection> const &current,
+                                std::vector<ACMPConnection> const &desired,
+                                uint16_t flags = 0 );
+#endif
+
+    ///
+    /// \brief clear Forget all queued commands, including ones in flight
+    ///
+    void clear();
+
+    uint32_t getCommandCount() const { return m_num_commands; }
+
+    ACMPControllerCommand const &getCommand( uint32_t index ) const { return m_commands[index]; }
+
+    uint32_t getCompletedCount() const { return m_succeeded_count + m_failed_count + m_timed_out_count; }
+
+    uint32_t getSucceededCount() const { return m_succeeded_count; }
+
+    uint32_t getFailedCount() const { return m_failed_count; }
+
+    uint32_t getTimedOutCount() const { return m_timed_out_count; }
+
+    uint32_t getRetryCount() const { return m_retry_count; }
+
+    uint16_t getInFlightCount() const { return m_num_in_flight; }
+
+    bool isIdle() const { return getCompletedCount() == m_num_commands; }
+
+  protected:
+    bool queueCommand( uint8_t message_type, ACMPConnection const &connection, uint16_t flags );
+
+    bool canSend( ACMPControllerCommand const &command ) const;
+
+    void sendCommand( uint32_t index, jdksavdecc_timestamp_in_milliseconds timestamp );
+
+    void sendPending( jdksavdecc_timestamp_in_milliseconds timestamp );
+
+    void completeInFlight( uint16_t in_flight_index, ACMPControllerCommand::State state, uint8_t status );
+
+    void traceCommand( ACMPControllerCommand const &command ) const;
+
+    ACMPControllerEvents *m_event_target;
+    ACMPControllerCommand *m_commands;
+    uint32_t m_num_commands;
+    uint32_t m_max_commands;
+
+    /// The indexes of the commands in flight
+    uint32_t *m_in_flight;
+    uint16_t m_num_in_flight;
+    uint16_t m_max_in_flight;
+
+    uint16_t m_max_in_flight_per_listener;
+    uint8_t m_max_retries;
+
+    /// Every command before this index has been sent at least once
+    uint32_t m_first_pending;
+
+    uint16_t m_next_sequence_id;
+
+    uint32_t m_succeeded_count;
+    uint32_t m_failed_count;
+    uint32_t m_timed_out_count;
+    uint32_t m_retry_count;
+};
+
+///
+/// \brief The ACMPControllerGroupHandlerWithSize class
+///
+/// ACMPControllerGroupHandler that contains the storage for MaxCommands
+/// queued commands with MaxInFlight in flight at once
+///
+template <uint32_t MaxCommands, uint16_t MaxInFlight = 8>
+class ACMPControllerGroupHandlerWithSize : public ACMPControllerGroupHandler
+{
+  public:
+    ACMPControllerGroupHandlerWithSize( Entity *entity,
+                                        ACMPControllerEvents *event_target,
+                                        uint16_t max_in_flight_per_listener = 1,
+                                        uint8_t max_retries = 1 )
+        : ACMPControllerGroupHandler( entity,
+                                      event_target,
+                                      m_command_storage,
+                                      MaxCommands,
+                                      m_in_flight_storage,
+                                      MaxInFlight,
+                                      max_in_flight_per_listener,
+                                      max_retries )
+    {
+    }
+
+  private:
+    ACMPControllerCommand m_command_storage[MaxCommands];
+    uint32_t m_in_flight_storage[MaxInFlight];
+};
+
+#if JDKSAVDECCMCU_ENABLE_VECTOR
+
+///
+/// \brief The ACMPControllerGroupHandlerDynamic class
+///
+/// ACMPControllerGroupHandler with heap storage sized at run time, for
+/// recalling routing presets with thousands of connections
+///
+class ACMPControllerGroupHandlerDynamic : public ACMPControllerGroupHandler
+{
+  public:
+    ACMPControllerGroupHandlerDynamic( Entity *entity,
+                                       ACMPControllerEvents *event_target,
+                                       uint32_t max_commands,
+                                       uint16_t max_in_flight = 64,
+                                       uint16_t max_in_flight_per_listener = 1,
+                                       uint8_t max_retries = 1 );
+
+  protected:
+    std::vector<ACMPControllerCommand> m_command_storage;
+    std::vector<uint32_t> m_in_flight_storage;
+};
+#endif
 }
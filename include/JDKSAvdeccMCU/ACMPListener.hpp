@@ -47,7 +47,7 @@ namespace JDKSAvdeccMCU
 class ACMPListenerEvents;
 
 struct ACMPListenerStreamInfo;
-class ACMPListenerHandlerBase;
+class ACMPListenerHandler;
 
 class ACMPListenerEvents
 {
@@ -57,61 +57,69 @@ class ACMPListenerEvents
     ///
     /// \brief listenerConnected
     ///
-    /// Notification that ACMP Talker State Machine has successfully connected a
-    /// stream
+    /// Notification that ACMP Listener State Machine has successfully
+    /// connected a stream
     ///
     /// \param entity
-    /// \param talker_unique_id
-    /// \param talker_handler
-    /// \param stream_info
-    /// \param listener_pair
+    /// \param listener_unique_id
+    /// \param listener_handler
     ///
-    virtual void listenerConnected( Entity *entity, uint16_t listener_unique_id, ACMPListenerHandlerBase const *listener_handler )
-        = 0;
+    virtual void listenerConnected( Entity *entity, uint16_t listener_unique_id, ACMPListenerHandler const *listener_handler ) = 0;
 
     ///
     /// \brief listenerDisconnected
     ///
-    /// Notification that ACMP Talker State Machine has successfully
-    /// disconnected a stream
+    /// Notification that ACMP Listener State Machine has disconnected a
+    /// stream
     ///
     /// \param entity
-    /// \param talker_unique_id
-    /// \param talker_handler
-    /// \param stream_info
-    /// \param listener_pair
+    /// \param listener_unique_id
+    /// \param listener_handler
     ///
-    virtual void
-        listenerDisconnected( Entity *entity, uint16_t listener_unique_id, ACMPListenerHandlerBase const *listener_handler ) = 0;
+    virtual void listenerDisconnected( Entity *entity, uint16_t listener_unique_id, ACMPListenerHandler const *listener_handler )
+        = 0;
+};
+
+///
+/// See IEEE Std 1722.1-2013 Clause 8.2.2.2.5 ListenerStreamInfo
+///
+struct ACMPListenerStreamInfo
+{
+    ACMPListenerStreamInfo() : m_talker_unique_id( 0 ), m_connected( false ), m_flags( 0 ), m_stream_vlan_id( 0 ) {}
+
+    Eui64 m_talker_entity_id;
+    uint16_t m_talker_unique_id;
+    bool m_connected;
+    Eui64 m_stream_id;
+    Eui48 m_stream_dest_mac;
+    Eui64 m_controller_entity_id;
+    uint16_t m_flags;
+    uint16_t m_stream_vlan_id;
 };
 
 ///
-/// \brief The ACMPListenerHandlerBase class
+/// \brief The ACMPListenerHandler class
 ///
-/// Manages a single Listener unique_id state machine
+/// Manages a single Listener unique_id state machine. See IEEE Std
+/// 1722.1-2013 Clause 8.2.2.5 ACMP Listener State Machine
+///
+/// Each listener unique_id has at most one CONNECT_TX or DISCONNECT_TX
+/// command in flight to its talker. A command that is not answered is sent
+/// once more before the controller is told LISTENER_TALKER_TIMEOUT.
 ///
 class ACMPListenerHandler
 {
   public:
-    ///
-    /// \brief ACMPListenerHandler
-    ///
-    /// See IEEE Std 1722.1-2013, "Clause 8.2.2.2.4 TalkerStreamInfo" and
-    /// IEEE Std 1722.1-2013 "Clause 8.2.2.6 ACMP Talker State Machine"
-    ///
-    /// \param listener_pair_storage Pointer to an array of
-    /// ACMPListenerListenerPair objects,
-    ///        one for each listener
-    ///
-    /// \param max_connected_listeners Size of the array in count of objects
-    ///
-    ACMPListenerHandler() {}
+    ACMPListenerHandler();
 
     virtual ~ACMPListenerHandler();
 
     ///
     /// \brief tick
     ///
+    /// Re-send or time out the command in flight to the talker, and send
+    /// the CONNECT_TX command of a restored connection
+    ///
     /// \param entity
     /// \param unique_id
     /// \param eventTarget
@@ -122,13 +130,81 @@ class ACMPListenerHandler
 
     ///
     /// \brief receivedACMPDU
-    /// \param entity
-    /// \param unique_id
-    /// \param eventTarget
-    /// \param frame
-    /// \return
     ///
-    virtual uint8_t receivedACMPDU( Entity *entity, uint16_t unique_id, ACMPListenerEvents *eventTarget, Frame &frame );
+    /// Handle a CONNECT_RX, DISCONNECT_RX or GET_RX_STATE command from a
+    /// controller or a CONNECT_TX or DISCONNECT_TX response from a talker
+    ///
+    /// \param entity The entity that owns this listener
+    /// \param unique_id The listener unique_id
+    /// \param eventTarget The object to notify of connection changes, may be 0
+    /// \param acmpdu The parsed ACMP message
+    /// \param frame The received frame
+    /// \return The ACMP status code
+    ///
+    virtual uint8_t receivedACMPDU(
+        Entity *entity, uint16_t unique_id, ACMPListenerEvents *eventTarget, jdksavdecc_acmpdu const &acmpdu, Frame &frame );
+
+    ///
+    /// \brief restoreConnection
+    ///
+    /// Re-establish a connection that existed before a restart. The
+    /// CONNECT_TX command is sent with the FAST_CONNECT flag on the next
+    /// tick and is repeated until the talker answers or a controller
+    /// connects or disconnects this listener. See IEEE Std 1722.1-2013 Clause
+    /// 8.2.2.5.2.4 fast connect
+    ///
+    /// \param talker_entity_id
+    /// \param talker_unique_id
+    /// \param flags The flags of the original connection
+    ///
+    void restoreConnection( Eui64 const &talker_entity_id, uint16_t talker_unique_id, uint16_t flags );
+
+    ACMPListenerStreamInfo const &getStreamInfo() const { return m_stream_info; }
+
+    bool isConnected() const { return m_stream_info.m_connected; }
+
+    bool isRestoring() const { return m_restoring; }
+
+  protected:
+    void sendTxCommand( Entity *entity, uint16_t unique_id, jdksavdecc_timestamp_in_milliseconds timestamp );
+
+    void sendRxResponse( Entity *entity, uint16_t unique_id, uint8_t message_type, uint8_t status );
+
+    void finishPending( Entity *entity, uint16_t unique_id, uint8_t status );
+
+  public:
+    ACMPListenerStreamInfo m_stream_info;
+
+    enum State
+    {
+        STATE_WAITING,
+        STATE_CONNECT,
+        STATE_DISCONNECT
+    } m_state;
+
+  protected:
+    /// Go to a state and trace the transition
+    void setState( Entity *entity, uint16_t unique_id, State state );
+
+    /// true while a restored connection is being re-established
+    bool m_restoring;
+
+    /// true if the command in flight was requested by a controller that
+    /// is waiting for a response
+    bool m_pending_from_controller;
+
+    /// The number of times the command in flight was re-sent
+    uint8_t m_pending_retries;
+
+    uint16_t m_pending_sequence_id;
+    jdksavdecc_timestamp_in_milliseconds m_pending_sent_time;
+
+    /// The controller and sequence_id of the CONNECT_RX or DISCONNECT_RX
+    /// command being serviced
+    Eui64 m_pending_controller_entity_id;
+    uint16_t m_pending_controller_sequence_id;
+
+    uint16_t m_next_sequence_id;
 };
 
 class ACMPListenerGroupHandlerBase
@@ -139,13 +215,15 @@ class ACMPListenerGroupHandlerBase
     {
     }
 
+    virtual ~ACMPListenerGroupHandlerBase() {}
+
     virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp );
 
     virtual uint8_t receivedACMPDU( RawSocket *incoming_socket, const jdksavdecc_acmpdu &acmpdu, Frame &frame );
 
-    virtual ACMPListenerHandlerBase *getTalkerHandler( uint16_t talker_unique_id ) = 0;
+    virtual ACMPListenerHandler *getListenerHandler( uint16_t listener_unique_id ) = 0;
 
-    virtual ACMPListenerHandlerBase const *getTalkerHandler( uint16_t talker_unique_id ) const = 0;
+    virtual ACMPListenerHandler const *getListenerHandler( uint16_t listener_unique_id ) const = 0;
 
     virtual uint16_t getListenerStreamSinkCount() const = 0;
 
@@ -163,12 +241,12 @@ class ACMPListenerGroupHandler : public ACMPListenerGroupHandlerBase
     {
     }
 
-    virtual ACMPListenerHandlerBase *getTalkerHandler( uint16_t listener_unique_id ) override
+    virtual ACMPListenerHandler *getListenerHandler( uint16_t listener_unique_id ) override
     {
         return &m_listener_storage[listener_unique_id];
     }
 
-    virtual ACMPListenerHandlerBase const *getTalkerHandler( uint16_t listener_unique_id ) const override
+    virtual ACMPListenerHandler const *getListenerHandler( uint16_t listener_unique_id ) const override
     {
         return &m_listener_storage[listener_unique_id];
     }
@@ -0,0 +1,188 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/PersistentStorage.hpp"
+#include "JDKSAvdeccMCU/ACMPListener.hpp"
+#include "JDKSAvdeccMCU/ACMPTalker.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The ACMPPersistentState class
+///
+/// Keeps a compact binary snapshot of the ACMP listener and talker
+/// connections in PersistentStorage and restores it after a restart.
+///
+/// The snapshot is a 16 byte header followed by one 16 byte record for each
+/// listener unique_id and one for each listener slot of each talker. Each
+/// connection change rewrites only its own record, and each record carries
+/// a CRC-8 so a write torn by a power failure loses only that record.
+///
+/// The ACMPPersistentState is the event target of the listener and talker
+/// group handlers and forwards all events to the application's event
+/// targets.
+///
+class ACMPPersistentState : public ACMPListenerEvents, public ACMPTalkerEvents
+{
+  public:
+    enum
+    {
+        MAGIC = 0x41434d50, // 'ACMP'
+        VERSION = 1,
+        HEADER_SIZE = 16,
+        RECORD_SIZE = 16
+    };
+
+    enum RecordKind
+    {
+        RECORD_EMPTY = 0,
+        RECORD_LISTENER = 1,
+        RECORD_TALKER = 2
+    };
+
+    ///
+    /// \brief ACMPPersistentState
+    /// \param storage Where the snapshot is kept
+    /// \param base_offset The offset of the snapshot in the storage
+    /// \param listener_event_target Listener events are forwarded here, may
+    /// be 0
+    /// \param talker_event_target Talker events are forwarded here, may be 0
+    ///
+    ACMPPersistentState( PersistentStorage &storage,
+                         uint32_t base_offset = 0,
+                         ACMPListenerEvents *listener_event_target = 0,
+                         ACMPTalkerEvents *talker_event_target = 0 );
+
+    ///
+    /// \brief attach Set the state machines whose state is kept
+    ///
+    /// Must be called before restore() or saveAll()
+    ///
+    /// \param listeners The listener state machines, may be 0
+    /// \param talkers The talker state machines, may be 0
+    ///
+    void attach( ACMPListenerGroupHandlerBase *listeners, ACMPTalkerGroupHandlerBase *talkers );
+
+    ///
+    /// \brief restore Restore the saved connections
+    ///
+    /// Talkers get their connected listeners back immediately. Listeners
+    /// re-issue CONNECT_TX to their talkers on the next tick, all in
+    /// parallel. A snapshot that does not match the attached state machines
+    /// is erased.
+    ///
+    /// \return The number of connections restored
+    ///
+    uint32_t restore();
+
+    ///
+    /// \brief saveAll Write the complete snapshot
+    ///
+    void saveAll();
+
+    ///
+    /// \brief clear Write an empty snapshot
+    ///
+    void clear();
+
+    ///
+    /// \brief getStorageSize
+    /// \return The number of bytes of storage the snapshot needs
+    ///
+    uint32_t getStorageSize() const { return HEADER_SIZE + getRecordCount() * RECORD_SIZE; }
+
+    uint32_t getRecordCount() const { return m_listener_count + m_talker_slot_count; }
+
+    uint32_t getWriteCount() const { return m_write_count; }
+
+    virtual void listenerConnected( Entity *entity, uint16_t listener_unique_id, ACMPListenerHandler const *listener_handler )
+        override;
+
+    virtual void listenerDisconnected( Entity *entity, uint16_t listener_unique_id, ACMPListenerHandler const *listener_handler )
+        override;
+
+    virtual void talkerConnected( Entity *entity,
+                                  uint16_t talker_unique_id,
+                                  ACMPTalkerHandlerBase const *talker_handler,
+                                  ACMPTalkerStreamInfo const &stream_info,
+                                  ACMPTalkerListenerPair const &listener_pair ) override;
+
+    virtual void talkerDisconnected( Entity *entity,
+                                     uint16_t talker_unique_id,
+                                     ACMPTalkerHandlerBase const *talker_handler,
+                                     ACMPTalkerStreamInfo const &stream_info,
+                                     ACMPTalkerListenerPair const &listener_pair ) override;
+
+    virtual void talkerSlotChanged( Entity *entity,
+                                    uint16_t talker_unique_id,
+                                    ACMPTalkerHandlerBase const *talker_handler,
+                                    uint16_t slot ) override;
+
+  protected:
+    struct Record
+    {
+        uint8_t m_kind;
+        Eui64 m_entity_id;
+        uint16_t m_unique_id;
+        uint16_t m_flags;
+    };
+
+    bool readHeader();
+
+    void writeHeader();
+
+    bool readRecord( uint32_t index, Record &record );
+
+    void writeRecord( uint32_t index, Record const &record );
+
+    void writeListenerRecord( uint16_t listener_unique_id, ACMPListenerHandler const *listener_handler );
+
+    void writeTalkerRecord( uint16_t talker_unique_id, ACMPTalkerHandlerBase const *talker_handler, uint16_t slot );
+
+    /// The record index of the first slot of a talker, after the listener
+    /// records
+    uint32_t getTalkerRecordBase( uint16_t talker_unique_id ) const;
+
+    PersistentStorage &m_storage;
+    uint32_t m_base_offset;
+    ACMPListenerEvents *m_listener_event_target;
+    ACMPTalkerEvents *m_talker_event_target;
+    ACMPListenerGroupHandlerBase *m_listeners;
+    ACMPTalkerGroupHandlerBase *m_talkers;
+    uint16_t m_listener_count;
+    uint16_t m_talker_count;
+    uint32_t m_talker_slot_count;
+    uint32_t m_write_count;
+};
+}
@@ -89,6 +89,29 @@ class ACMPTalkerEvents
                                      ACMPTalkerHandlerBase const *talker_handler,
                                      ACMPTalkerStreamInfo const &stream_info,
                                      ACMPTalkerListenerPair const &listener_pair ) = 0;
+
+    ///
+    /// \brief talkerSlotChanged
+    ///
+    /// Notification that a listener slot of a talker was taken or freed by a
+    /// CONNECT_TX or DISCONNECT_TX command. Used to keep a persistent copy of
+    /// the connections up to date one slot at a time.
+    ///
+    /// \param entity
+    /// \param talker_unique_id
+    /// \param talker_handler
+    /// \param slot The slot number, see ACMPTalkerHandlerBase::getListener()
+    ///
+    virtual void talkerSlotChanged( Entity *entity,
+                                    uint16_t talker_unique_id,
+                                    ACMPTalkerHandlerBase const *talker_handler,
+                                    uint16_t slot )
+    {
+        (void)entity;
+        (void)talker_unique_id;
+        (void)talker_handler;
+        (void)slot;
+    }
 };
 
 ///
@@ -96,10 +119,45 @@ class ACMPTalkerEvents
 ///
 struct ACMPTalkerListenerPair
 {
-    ACMPTalkerListenerPair() : m_listener_unique_id( 0 ) {}
+    ACMPTalkerListenerPair() : m_listener_unique_id( 0 ), m_connected( false ), m_next_free( 0 ) {}
 
     Eui64 m_listener_entity_id;
     uint16_t m_listener_unique_id;
+
+    /// true if this slot holds a connected listener
+    bool m_connected;
+
+    /// The next free slot when this slot is not connected
+    uint16_t m_next_free;
+};
+
+///
+/// See IEEE Std 1722.1-2013 Clause 8.2.2.2.4 TalkerStreamInfo
+///
+struct ACMPTalkerStreamInfo
+{
+    ACMPTalkerStreamInfo() : m_stream_vlan_id( 0 ) {}
+
+    Eui64 m_stream_id;
+    Eui48 m_stream_dest_mac;
+    uint16_t m_stream_vlan_id;
+};
+
+///
+/// \brief The ACMPTalkerHashTableSize template
+///
+/// Calculates at compile time the smallest power of two that is at least N
+///
+template <uint32_t N, uint32_t P = 1, bool Done = ( P >= N )>
+struct ACMPTalkerHashTableSize
+{
+    static const uint32_t value = ACMPTalkerHashTableSize<N, P * 2>::value;
+};
+
+template <uint32_t N, uint32_t P>
+struct ACMPTalkerHashTableSize<N, P, true>
+{
+    static const uint32_t value = P;
 };
 
 ///
@@ -107,9 +165,22 @@ struct ACMPTalkerListenerPair
 ///
 /// Manages a single Talker unique_id state machine
 ///
+/// The connected listeners are kept in slots of the listener pair storage.
+/// A listener keeps its slot for as long as it is connected, and the slot
+/// number is the index used by GET_TX_CONNECTION. The slots are found via
+/// an open addressed hash table of slot numbers keyed on
+/// ( listener_entity_id, listener_unique_id ), so connect, disconnect and
+/// lookup are O(1) regardless of the number of connected listeners.
+///
 class ACMPTalkerHandlerBase
 {
   public:
+    enum
+    {
+        /// Marks an empty hash table entry, and a slot number that was not found
+        NO_SLOT = 0xffff
+    };
+
     ///
     /// \brief ACMPTalkerHandlerBase
     ///
@@ -120,16 +191,19 @@ class ACMPTalkerHandlerBase
     /// ACMPTalkerListenerPair objects,
     ///        one for each listener
     ///
-    /// \param max_connected_listeners Size of the array in count of objects
+    /// \param max_connected_listeners Size of the array in count of objects,
+    /// at most 65534
     ///
-    ACMPTalkerHandlerBase( ACMPTalkerListenerPair *listener_pair_storage, uint16_t max_connected_listeners )
-        : m_connection_count( 0 )
-        , m_connected_listeners( listener_pair_storage )
-        , m_stream_vlan_id( 0 )
-        , m_max_connected_listeners( max_connected_listeners )
-        , m_state( STATE_WAITING )
-    {
-    }
+    /// \param hash_storage Pointer to an array of uint16_t for the hash
+    /// table
+    ///
+    /// \param hash_table_size Size of the hash table array, a power of two
+    /// which is larger than max_connected_listeners
+    ///
+    ACMPTalkerHandlerBase( ACMPTalkerListenerPair *listener_pair_storage,
+                           uint16_t max_connected_listeners,
+                           uint16_t *hash_storage,
+                           uint32_t hash_table_size );
 
     virtual ~ACMPTalkerHandlerBase();
 
@@ -146,24 +220,130 @@ class ACMPTalkerHandlerBase
 
     ///
     /// \brief receivedACMPDU
-    /// \param entity
-    /// \param unique_id
-    /// \param eventTarget
-    /// \param frame
-    /// \return
     ///
-    virtual uint8_t receivedACMPDU( Entity *entity, uint16_t unique_id, ACMPTalkerEvents *eventTarget, Frame &frame );
+    /// Handle a CONNECT_TX, DISCONNECT_TX, GET_TX_STATE or GET_TX_CONNECTION
+    /// command for this talker unique_id and send the response
+    ///
+    /// \param entity The entity that owns this talker
+    /// \param unique_id The talker unique_id
+    /// \param eventTarget The object to notify of connection changes, may be 0
+    /// \param acmpdu The parsed ACMP command
+    /// \param frame The received frame which is converted to the response in
+    /// place
+    /// \return The ACMP status code of the response
+    ///
+    virtual uint8_t receivedACMPDU(
+        Entity *entity, uint16_t unique_id, ACMPTalkerEvents *eventTarget, jdksavdecc_acmpdu const &acmpdu, Frame &frame );
+
+    ///
+    /// \brief connectListener Add a listener to the connected listeners
+    ///
+    /// See IEEE Std 1722.1-2013 Clause 8.2.2.6.2.2 connectTalker
+    ///
+    /// \param listener_entity_id
+    /// \param listener_unique_id
+    /// \return JDKSAVDECC_ACMP_STATUS_SUCCESS if it is now connected,
+    /// JDKSAVDECC_ACMP_STATUS_TALKER_NO_BANDWIDTH if there is no room
+    ///
+    uint8_t connectListener( Eui64 const &listener_entity_id, uint16_t listener_unique_id );
+
+    ///
+    /// \brief disconnectListener Remove a listener from the connected
+    /// listeners
+    ///
+    /// See IEEE Std 1722.1-2013 Clause 8.2.2.6.2.3 disconnectTalker
+    ///
+    /// \param listener_entity_id
+    /// \param listener_unique_id
+    /// \return JDKSAVDECC_ACMP_STATUS_SUCCESS
+    ///
+    uint8_t disconnectListener( Eui64 const &listener_entity_id, uint16_t listener_unique_id );
+
+    ///
+    /// \brief disconnectAllListeners Remove all connected listeners
+    ///
+    void disconnectAllListeners();
+
+    ///
+    /// \brief findListener
+    /// \param listener_entity_id
+    /// \param listener_unique_id
+    /// \return The slot of the listener or NO_SLOT if it is not connected
+    ///
+    uint16_t findListener( Eui64 const &listener_entity_id, uint16_t listener_unique_id ) const;
+
+    ///
+    /// \brief getListener Get the listener at a slot
+    /// \param slot The slot number, as used by GET_TX_CONNECTION
+    /// \return pointer to the listener pair or 0 if the slot is not in use
+    ///
+    ACMPTalkerListenerPair const *getListener( uint16_t slot ) const
+    {
+        return ( slot < m_slot_count && m_connected_listeners[slot].m_connected ) ? &m_connected_listeners[slot] : 0;
+    }
+
+    ///
+    /// \brief getConnectionCount
+    /// \return the number of connected listeners
+    ///
+    uint16_t getConnectionCount() const { return m_connection_count; }
+
+    ///
+    /// \brief getSlotCount
+    /// \return one more than the highest slot number that was used since the
+    /// last packListeners()
+    ///
+    uint16_t getSlotCount() const { return m_slot_count; }
+
+    uint16_t getMaxConnectedListeners() const { return m_max_connected_listeners; }
+
+    ACMPTalkerStreamInfo const &getStreamInfo() const { return m_stream_info; }
+
+    ///
+    /// \brief setStreamInfo Set the stream parameters that are reported
+    /// to listeners and controllers
+    ///
+    void setStreamInfo( Eui64 const &stream_id, Eui48 const &stream_dest_mac, uint16_t stream_vlan_id )
+    {
+        m_stream_info.m_stream_id = stream_id;
+        m_stream_info.m_stream_dest_mac = stream_dest_mac;
+        m_stream_info.m_stream_vlan_id = stream_vlan_id;
+    }
 
     ///
     /// \brief packListeners
     ///
+    /// Move the connected listeners into the lowest slots, removing the holes
+    /// left by disconnected listeners. This changes the GET_TX_CONNECTION
+    /// indexes of the moved listeners.
+    ///
     void packListeners();
 
-    Eui64 m_stream_id;
-    Eui48 m_stream_dest_mac;
+  protected:
+    ///
+    /// \brief setStorage Attach the listener pair and hash table storage and
+    /// clear all connections
+    ///
+    void setStorage( ACMPTalkerListenerPair *listener_pair_storage,
+                     uint16_t max_connected_listeners,
+                     uint16_t *hash_storage,
+                     uint32_t hash_table_size );
+
+    uint32_t hashOf( Eui64 const &listener_entity_id, uint16_t listener_unique_id ) const;
+
+    uint32_t findHashPosition( Eui64 const &listener_entity_id, uint16_t listener_unique_id ) const;
+
+    void removeHashPosition( uint32_t pos );
+
+    void insertHash( uint16_t slot );
+
+
+    void sendResponse( Entity *entity, uint8_t message_type, uint8_t status, jdksavdecc_acmpdu &response, Frame &frame );
+
+  public:
+    ACMPTalkerStreamInfo m_stream_info;
     uint16_t m_connection_count;
     ACMPTalkerListenerPair *m_connected_listeners;
-    uint16_t m_stream_vlan_id;
 
     uint16_t m_max_connected_listeners;
 
@@ -175,18 +355,58 @@ class ACMPTalkerHandlerBase
         STATE_GET_STATE,
         STATE_GET_CONNECTION
     } m_state;
+
+  protected:
+    uint16_t *m_hash;
+    uint32_t m_hash_mask;
+    uint16_t m_slot_count;
+    uint16_t m_first_free;
 };
 
+///
+/// \brief The ACMPTalkerHandler class
+///
+/// Compile time bounded talker state machine with storage for
+/// MaxListenersPerTalker listeners
+///
 template <uint16_t MaxListenersPerTalker>
 class ACMPTalkerHandler : public ACMPTalkerHandlerBase
 {
   public:
-    ACMPTalkerHandler() : ACMPTalkerHandlerBase( &m_listener_pairs_storage[0], MaxListenersPerTalker ) {}
+    enum
+    {
+        HashTableSize = ACMPTalkerHashTableSize<uint32_t( MaxListenersPerTalker ) * 2>::value
+    };
+
+    ACMPTalkerHandler() : ACMPTalkerHandlerBase( 0, 0, 0, 0 )
+    {
+        setStorage( &m_listener_pairs_storage[0], MaxListenersPerTalker, &m_hash_storage[0], HashTableSize );
+    }
 
   protected:
     ACMPTalkerListenerPair m_listener_pairs_storage[MaxListenersPerTalker];
+    uint16_t m_hash_storage[HashTableSize];
 };
 
+#if JDKSAVDECCMCU_ENABLE_VECTOR
+
+///
+/// \brief The ACMPTalkerHandlerDynamic class
+///
+/// Talker state machine with heap storage sized at run time, for talkers
+/// with thousands of listeners
+///
+class ACMPTalkerHandlerDynamic : public ACMPTalkerHandlerBase
+{
+  public:
+    ACMPTalkerHandlerDynamic( uint16_t max_connected_listeners );
+
+  protected:
+    std::vector<ACMPTalkerListenerPair> m_listener_pairs_storage;
+    std::vector<uint16_t> m_hash_storage;
+};
+#endif
+
 class ACMPTalkerGroupHandlerBase
 {
   public:
@@ -195,6 +415,8 @@ class ACMPTalkerGroupHandlerBase
     {
     }
 
+    virtual ~ACMPTalkerGroupHandlerBase() {}
+
     virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp );
 
     virtual uint8_t receivedACMPDU( RawSocket *incoming_socket, const jdksavdecc_acmpdu &acmpdu, Frame &frame );
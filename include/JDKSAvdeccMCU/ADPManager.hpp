@@ -156,6 +156,12 @@ class ADPManager : public Handler
      */
     virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp ) override;
 
+    /**
+     * @brief nextTickTime is the time of the next scheduled or triggered ADP message
+     * @param timestamp The current time in milliseconds
+     */
+    virtual jdksavdecc_timestamp_in_milliseconds nextTickTime( jdksavdecc_timestamp_in_milliseconds timestamp ) override;
+
     /**
      * @brief receivedPDU is called to handle any incoming ADPDU.
      * @param frame Reference to the incoming frame
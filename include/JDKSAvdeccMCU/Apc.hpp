@@ -144,6 +144,13 @@ class ApcStateVariables
      */
     AppMessage m_apsMsg;
 
+    /**
+     * When set, the message to process instead of m_apsMsg. It is the
+     * parser's message and is only set while
+     * ApcStateEvents::onAppAvdeccFromAps() runs the state machine.
+     */
+    AppMessage const *m_apsMsgBorrowed;
+
     /**
      * See IEEE 1722.1 Annex C.5.3.1.5
      */
@@ -638,6 +645,15 @@ class ApcStates
     ///
     virtual void doFinish();
 
+    ///
+    /// \brief traceState
+    ///
+    /// Trace a transition to a state, called by the goTo functions
+    ///
+    /// \param state the TraceApcState of the new state
+    ///
+    void traceState( uint16_t state );
+
   protected:
     ApcStateMachine *m_owner;
     state_proc m_current_state;
@@ -773,6 +789,17 @@ class ApcStateEvents : public AppMessageHandler, public HttpClientHandler
     ///
     virtual bool onIncomingHttpResponse( HttpResponse const &request );
 
+    ///
+    /// \brief onIncomingHttpResponseHead
+    ///
+    /// Accept the response from an in place parser without
+    /// building an HttpResponse
+    ///
+    /// \param head The response head
+    /// \return true if the response was accepted
+    ///
+    virtual bool onIncomingHttpResponseHead( HttpHead const &head );
+
     ///
     /// \brief onIncomingTcpAppData
     ///
@@ -834,7 +861,9 @@ class ApcStateEvents : public AppMessageHandler, public HttpClientHandler
     ///
     /// \brief onAppAvdeccFromAps
     ///
-    /// Received AVDECC_FROM_APS from APS
+    /// Received AVDECC_FROM_APS from APS. The state machine is run so
+    /// that the message is processed before the next one in the same
+    /// block of TCP data replaces it.
     ///
     /// \param msg
     ///
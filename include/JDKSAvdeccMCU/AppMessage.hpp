@@ -37,11 +37,18 @@
 namespace JDKSAvdeccMCU
 {
 
+class AppMessageView;
+
 ///
 /// \brief The AppMessage AVDECC Proxy Protocol Message
 ///
 /// See IEEE Std 1722.1-2013 Annex C.4 and Annex C.5
 ///
+/// The payload is stored inside the message so that no heap is needed.
+/// Copies only copy the header and the payload_length octets of the
+/// payload that are in use, which is all that a move could save. Use an
+/// AppMessageView to pass a message on without copying its payload.
+///
 struct AppMessage
 {
     ///
@@ -78,7 +85,13 @@ struct AppMessage
     /// \brief AppMessage Copy Constructor
     /// \param other the AppMessage to copy
     ///
-    AppMessage( const AppMessage &other ) : m_appdu( other.m_appdu ) { m_appdu.base.payload = m_appdu.payload_buffer; }
+    AppMessage( const AppMessage &other ) { assign( other.m_appdu.base ); }
+
+    ///
+    /// \brief AppMessage Construct from an AppMessageView
+    /// \param view The message to copy, including its borrowed payload
+    ///
+    AppMessage( const AppMessageView &view );
 
     ///
     /// \brief operator =
@@ -88,11 +101,41 @@ struct AppMessage
     ///
     const AppMessage &operator=( const AppMessage &other )
     {
-        m_appdu = other.m_appdu;
-        m_appdu.base.payload = m_appdu.payload_buffer;
+        assign( other.m_appdu.base );
         return *this;
     }
 
+    ///
+    /// \brief operator =
+    /// Assign from an AppMessageView
+    /// \param view the message to copy, including its borrowed payload
+    /// \return *this
+    ///
+    const AppMessage &operator=( const AppMessageView &view );
+
+    ///
+    /// \brief assign
+    ///
+    /// Copy the header and the payload of an APPDU
+    ///
+    /// \param appdu The APPDU, its payload may be anywhere
+    ///
+    void assign( jdksavdecc_appdu const &appdu )
+    {
+        uint16_t payload_length = appdu.payload_length;
+        if ( payload_length > sizeof( m_appdu.payload_buffer ) )
+        {
+            payload_length = sizeof( m_appdu.payload_buffer );
+        }
+        if ( payload_length > 0 && appdu.payload != m_appdu.payload_buffer )
+        {
+            memcpy( m_appdu.payload_buffer, appdu.payload, payload_length );
+        }
+        m_appdu.base = appdu;
+        m_appdu.base.payload_length = payload_length;
+        m_appdu.base.payload = m_appdu.payload_buffer;
+    }
+
     ///
     /// \brief clear
     ///
@@ -181,7 +224,7 @@ struct AppMessage
     ///
     void setAvdeccFromApc( const Frame &frame )
     {
-        jdksavdecc_appdu_set_avdecc_from_apc( &m_appdu.base, frame.getSA(), frame.getPayloadLength(), frame.getPayload() );
+        jdksavdecc_appdu_set_avdecc_from_apc( &m_appdu.base, frame.getDA(), frame.getPayloadLength(), frame.getPayload() );
     }
 
     ///
@@ -313,4 +356,125 @@ struct AppMessage
     ///
     jdksavdecc_fullappdu m_appdu;
 };
+
+///
+/// \brief The AppMessageView class
+///
+/// An APPDU header with a payload that is borrowed from elsewhere, such
+/// as an AppMessage, the payload of a received Frame or the TCP receive
+/// buffer. A view is only valid as long as the octets it borrows.
+///
+class AppMessageView
+{
+  public:
+    ///
+    /// \brief AppMessageView
+    ///
+    /// Creates a view of a NOP
+    ///
+    AppMessageView()
+    {
+        jdksavdecc_appdu_init( &m_appdu );
+        jdksavdecc_appdu_set_nop( &m_appdu );
+    }
+
+    ///
+    /// \brief AppMessageView
+    /// \param msg The message to view
+    ///
+    AppMessageView( AppMessage const &msg ) : m_appdu( msg.m_appdu.base ) {}
+
+    ///
+    /// \brief AppMessageView
+    /// \param appdu The header, pointing to the payload to view
+    ///
+    AppMessageView( jdksavdecc_appdu const &appdu ) : m_appdu( appdu ) {}
+
+    ///
+    /// \brief setAvdeccFromAps
+    ///
+    /// Set the message type to AVDECC_FROM_APS, borrowing the payload
+    /// of the frame. See IEEE Std 1722.1-2013 Annex C.5.1.6
+    ///
+    /// \param frame The AVDECC message from APS
+    ///
+    void setAvdeccFromAps( Frame const &frame )
+    {
+        setFromFrame( JDKSAVDECC_APPDU_MESSAGE_TYPE_AVDECC_FROM_APS, frame.getSA(), frame );
+    }
+
+    ///
+    /// \brief setAvdeccFromApc
+    ///
+    /// Set the message type to AVDECC_FROM_APC, borrowing the payload
+    /// of the frame. See IEEE Std 1722.1-2013 Annex C.5.1.7
+    ///
+    /// \param frame The AVDECC message from APC
+    ///
+    void setAvdeccFromApc( Frame const &frame )
+    {
+        setFromFrame( JDKSAVDECC_APPDU_MESSAGE_TYPE_AVDECC_FROM_APC, frame.getDA(), frame );
+    }
+
+    uint8_t const *getPayload() const { return m_appdu.payload; }
+
+    Eui48 getAddress() const { return Eui48( m_appdu.address ); }
+
+    uint16_t getPayloadLength() const { return m_appdu.payload_length; }
+
+    uint8_t getVersion() const { return m_appdu.version; }
+
+    AppMessage::MessageType getMessageType() const { return AppMessage::MessageType( m_appdu.message_type ); }
+
+    ///
+    /// \brief getSize
+    /// \return The size of the APPDU including the header
+    ///
+    uint16_t getSize() const { return uint16_t( JDKSAVDECC_APPDU_HEADER_LEN + m_appdu.payload_length ); }
+
+    ///
+    /// \brief store the APPDU into the destination FixedBuffer
+    /// \param dest Destination FixedBuffer to store to
+    /// \param offset Offset within FixedBuffer to store to
+    ///
+    /// \return true if the APPDU fit in the FixedBuffer
+    ///
+    bool store( FixedBuffer *dest, uint16_t offset = 0 ) const
+    {
+        ssize_t r;
+        dest->clear();
+        r = jdksavdecc_appdu_write( &m_appdu, dest->getBuf(), offset, dest->getMaxLength() );
+        if ( r > 0 )
+        {
+            dest->setLength( uint16_t( r ) );
+        }
+        return r > 0;
+    }
+
+    ///
+    /// \brief m_appdu
+    /// The header and a pointer to the borrowed payload, which is
+    /// never written through
+    ///
+    jdksavdecc_appdu m_appdu;
+
+  private:
+    void setFromFrame( uint8_t message_type, Eui48 const &address, Frame const &frame )
+    {
+        m_appdu.version = JDKSAVDECC_APPDU_VERSION;
+        m_appdu.message_type = message_type;
+        m_appdu.payload_length = frame.getPayloadLength();
+        m_appdu.address = address;
+        m_appdu.reserved = 0;
+        m_appdu.payload = const_cast<uint8_t *>( frame.getPayload() );
+    }
+};
+
+inline AppMessage::AppMessage( const AppMessageView &view ) { assign( view.m_appdu ); }
+
+inline const AppMessage &AppMessage::operator=( const AppMessageView &view )
+{
+    assign( view.m_appdu );
+    return *this;
+}
 }
@@ -128,5 +128,24 @@ class AppMessageHandler
     /// \param msg The AppMessage
     ///
     virtual void onAppUnknown( AppMessage const &msg ) = 0;
+
+    ///
+    /// \brief onAppMessageView
+    ///
+    /// Called by AppMessageParser::parse( data, len ) for a message with a
+    /// payload that arrived whole within the block, before the payload is
+    /// copied. A handler that is done with the message when this returns
+    /// can take it here and save the copy.
+    ///
+    /// \param view The message, valid only during the call
+    ///
+    /// \return true if the message was handled, false to have it
+    /// dispatched as an AppMessage
+    ///
+    virtual bool onAppMessageView( AppMessageView const &view )
+    {
+        (void)view;
+        return false;
+    }
 };
 }
@@ -74,6 +74,23 @@ class AppMessageParser
     ///
     int parse( uint8_t octet );
 
+    ///
+    /// \brief parse parses a block of octets from a TCP stream
+    /// and dispatch each complete message to an AppMessageHandler
+    ///
+    /// Headers that are entirely within the block are decoded in place and
+    /// payloads are copied with memcpy. Only headers that are split across
+    /// blocks go through the header buffer. A message that is entirely
+    /// within the block is first offered to
+    /// AppMessageHandler::onAppMessageView() without copying its payload.
+    ///
+    /// \param data The incoming octets
+    /// \param len The number of octets
+    ///
+    /// \return 0 on success, -1 on error
+    ///
+    int parse( uint8_t const *data, size_t len );
+
     ///
     /// \brief getErrorCount get the current error count
     /// \return error count
@@ -98,6 +115,18 @@ class AppMessageParser
     ///
     int dispatchMsg( AppMessage const &msg );
 
+    ///
+    /// \brief dispatchView
+    ///
+    /// Offer the current message with its payload in place to the
+    /// AppMessageHandler
+    ///
+    /// \param payload The payload octets, m_octets_left_in_payload of them
+    ///
+    /// \return true if the handler took the message
+    ///
+    bool dispatchView( uint8_t const *payload );
+
     ///
     /// \brief parseHeader
     /// \param octet
@@ -105,6 +134,12 @@ class AppMessageParser
     ///
     AppMessage *parseHeader( uint8_t octet );
 
+    ///
+    /// \brief decodeHeader Fill in the current message's header fields
+    /// \param header Pointer to JDKSAVDECC_APPDU_HEADER_LEN octets
+    ///
+    void decodeHeader( uint8_t const *header );
+
     ///
     /// \brief validateHeader
     /// \return
@@ -0,0 +1,267 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Frame.hpp"
+#include "JDKSAvdeccMCU/AppMessage.hpp"
+
+#if __cplusplus >= 201103L || ( defined( _MSC_VER ) && _MSC_VER >= 1700 )
+#include <atomic>
+#define JDKSAVDECCMCU_APPMESSAGEQUEUE_ATOMIC 1
+#else
+#define JDKSAVDECCMCU_APPMESSAGEQUEUE_ATOMIC 0
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+#if JDKSAVDECCMCU_APPMESSAGEQUEUE_ATOMIC
+typedef std::atomic<uint32_t> AppMessageQueueIndex;
+#else
+///
+/// \brief The AppMessageQueueIndex class
+///
+/// Stand-in for std::atomic<uint32_t> on pre-C++11 compilers.
+/// Only the subset used by AppMessageQueue is provided and it is
+/// NOT thread safe; the producer and consumer must then run in the
+/// same thread.
+///
+class AppMessageQueueIndex
+{
+  public:
+    AppMessageQueueIndex( uint32_t v = 0 ) : m_value( v ) {}
+    uint32_t load() const { return m_value; }
+    void store( uint32_t v ) { m_value = v; }
+    bool compare_exchange_strong( uint32_t &expected, uint32_t desired )
+    {
+        if ( m_value == expected )
+        {
+            m_value = desired;
+            return true;
+        }
+        expected = m_value;
+        return false;
+    }
+
+  private:
+    volatile uint32_t m_value;
+};
+#endif
+
+///
+/// \brief The AppMessageQueue class
+///
+/// A bounded single producer / single consumer ring of AppMessage
+/// objects. The producer (the layer 2 network receive path) and the
+/// consumer (the APS state machine) may run in different threads;
+/// no locks are taken.
+///
+/// Each slot carries a sequence number in the manner of a bounded
+/// Vyukov queue, so a slot is only ever written by the side that
+/// owns it. This also lets the producer discard the oldest message
+/// when the ring is full, without racing a concurrent pop().
+///
+/// The capacity is rounded down to a power of two.
+///
+class AppMessageQueue
+{
+  public:
+    ///
+    /// \brief The OverflowPolicy enum
+    ///
+    /// What push() does when the ring is full
+    ///
+    enum OverflowPolicy
+    {
+        /// Discard the oldest queued message to make room and
+        /// count it in getDroppedCount()
+        OVERFLOW_DROP_OLDEST,
+
+        /// Refuse the new message, count it in getRejectedCount()
+        /// and return false so the producer can stop reading
+        /// from the network until isFull() is false again
+        OVERFLOW_BACKPRESSURE
+    };
+
+    ///
+    /// \brief The Slot struct
+    ///
+    /// Storage for one queued message
+    ///
+    struct Slot
+    {
+        AppMessageQueueIndex m_sequence;
+        AppMessage m_msg;
+    };
+
+    ///
+    /// \brief AppMessageQueue constructor
+    /// \param storage Pointer to array of Slot, may be 0 and set later with setStorage()
+    /// \param capacity Number of entries in storage
+    /// \param policy The overflow policy
+    ///
+    AppMessageQueue( Slot *storage, uint32_t capacity, OverflowPolicy policy = OVERFLOW_DROP_OLDEST );
+
+    virtual ~AppMessageQueue() {}
+
+    ///
+    /// \brief setStorage
+    ///
+    /// Set the slot storage and empty the queue. Must not be called
+    /// while a producer or consumer is active.
+    ///
+    /// \param storage Pointer to array of Slot
+    /// \param capacity Number of entries in storage
+    ///
+    void setStorage( Slot *storage, uint32_t capacity );
+
+    ///
+    /// \brief clear
+    ///
+    /// Discard all queued messages and reset the counters. Must not be
+    /// called while a producer or consumer is active.
+    ///
+    void clear();
+
+    ///
+    /// \brief push a layer 2 frame as an AVDECC_FROM_APS message
+    ///
+    /// The message is formed directly in the ring slot. Producer side only.
+    ///
+    /// \param frame The AVDECC frame received from the network
+    /// \return true if the message was queued
+    ///
+    bool push( const Frame &frame );
+
+    ///
+    /// \brief push a copy of an AppMessage. Producer side only.
+    /// \param msg The message
+    /// \return true if the message was queued
+    ///
+    bool push( const AppMessage &msg );
+
+    ///
+    /// \brief pop the oldest message. Consumer side only.
+    /// \param msg Where to copy the message to
+    /// \return true if a message was popped, false if the queue was empty
+    ///
+    bool pop( AppMessage *msg );
+
+    ///
+    /// \brief getSize
+    /// \return The approximate number of queued messages
+    ///
+    uint32_t getSize() const;
+
+    bool isEmpty() const { return getSize() == 0; }
+
+    bool isFull() const { return getSize() >= m_capacity; }
+
+    uint32_t getCapacity() const { return m_capacity; }
+
+    OverflowPolicy getOverflowPolicy() const { return m_policy; }
+
+    void setOverflowPolicy( OverflowPolicy policy ) { m_policy = policy; }
+
+    /// \brief getPushedCount the number of messages queued since clear()
+    uint32_t getPushedCount() const { return m_pushed_count.load(); }
+
+    /// \brief getPoppedCount the number of messages popped since clear()
+    uint32_t getPoppedCount() const { return m_popped_count.load(); }
+
+    /// \brief getDroppedCount the number of queued messages discarded by OVERFLOW_DROP_OLDEST
+    uint32_t getDroppedCount() const { return m_dropped_count.load(); }
+
+    /// \brief getRejectedCount the number of new messages refused because the ring was full
+    uint32_t getRejectedCount() const { return m_rejected_count.load(); }
+
+    /// \brief getHighWaterMark the largest queue depth seen since clear()
+    uint32_t getHighWaterMark() const { return m_high_water_mark.load(); }
+
+  protected:
+    ///
+    /// \brief acquireSlot
+    ///
+    /// Find the slot for the next push, applying the overflow policy
+    ///
+    /// \return The message to fill in, or 0 if the push must be refused
+    ///
+    AppMessage *acquireSlot();
+
+    ///
+    /// \brief publishSlot
+    ///
+    /// Make the message filled in after acquireSlot() visible to the consumer
+    ///
+    void publishSlot();
+
+    Slot *m_storage;
+    uint32_t m_capacity;
+    uint32_t m_mask;
+    OverflowPolicy m_policy;
+
+    /// Next position to write, only modified by the producer
+    AppMessageQueueIndex m_head;
+
+    /// Next position to read, advanced by the consumer, or by the producer when dropping
+    AppMessageQueueIndex m_tail;
+
+    AppMessageQueueIndex m_pushed_count;
+    AppMessageQueueIndex m_popped_count;
+    AppMessageQueueIndex m_dropped_count;
+    AppMessageQueueIndex m_rejected_count;
+    AppMessageQueueIndex m_high_water_mark;
+
+  private:
+    AppMessageQueue( const AppMessageQueue & );
+    AppMessageQueue const &operator=( const AppMessageQueue & );
+};
+
+///
+/// \brief The AppMessageQueueWithSize class
+///
+/// AppMessageQueue that contains the storage for Capacity messages.
+/// Capacity must be a power of two.
+///
+template <uint32_t Capacity>
+class AppMessageQueueWithSize : public AppMessageQueue
+{
+  public:
+    AppMessageQueueWithSize( OverflowPolicy policy = OVERFLOW_DROP_OLDEST ) : AppMessageQueue( 0, 0, policy )
+    {
+        setStorage( m_slot_storage, Capacity );
+    }
+
+  private:
+    Slot m_slot_storage[Capacity];
+};
+}
@@ -34,8 +34,27 @@
 #include "JDKSAvdeccMCU/Eui.hpp"
 #include "JDKSAvdeccMCU/AppMessage.hpp"
 #include "JDKSAvdeccMCU/AppMessageParser.hpp"
+#include "JDKSAvdeccMCU/AppMessageQueue.hpp"
+#include "JDKSAvdeccMCU/ApsEntityIdAllocator.hpp"
 #include "JDKSAvdeccMCU/Http.hpp"
 
+#ifndef JDKSAVDECCMCU_APS_L2_QUEUE_DEPTH
+///
+/// The number of layer 2 messages that may be pending for
+/// each APC connection. Must be a power of two.
+///
+#define JDKSAVDECCMCU_APS_L2_QUEUE_DEPTH ( 32 )
+#endif
+
+#ifndef JDKSAVDECCMCU_APS_APC_QUEUE_DEPTH
+///
+/// The number of AVDECC_FROM_APC messages that may wait for the
+/// state machine to reach TRANSFER_TO_L2, for each APC connection.
+/// Must be a power of two.
+///
+#define JDKSAVDECCMCU_APS_APC_QUEUE_DEPTH ( 8 )
+#endif
+
 namespace JDKSAvdeccMCU
 {
 
@@ -226,13 +245,29 @@ class ApsStateMachine
     ///
     /// Method is called whenever an APC requests an entity_id
     ///
+    /// With an ApsEntityIdAllocator the entity_id comes from it and is
+    /// released by closeTcpConnection(), otherwise from the shared
+    /// active entity id count.
+    ///
     /// \param server_link_mac The primary MAC address of the server
     /// \param apc_link_mac The primary MAC address of the APC
     /// \param requested_entity_id The enity_id that the client is requesting
-    /// \return the Eui64 entity_id that the client will be assigned
+    /// \return the Eui64 entity_id that the client will be assigned, not set
+    /// if the allocator has none left
     ///
     virtual Eui64 assignEntityId( Eui48 server_link_mac, Eui48 apc_link_mac, Eui64 requested_entity_id );
 
+    ///
+    /// \brief setEntityIdAllocator
+    ///
+    /// Use an allocator shared by all connections of the server to assign entity_ids
+    ///
+    /// \param allocator The allocator, or 0 to use the active entity id count
+    ///
+    void setEntityIdAllocator( ApsEntityIdAllocator *allocator ) { m_entity_id_allocator = allocator; }
+
+    ApsEntityIdAllocator *getEntityIdAllocator() { return m_entity_id_allocator; }
+
     ///
     /// \brief getVariables
     ///
@@ -313,6 +348,7 @@ class ApsStateMachine
     uint16_t m_assigned_count;
     uint16_t &m_active_entity_id_count;
     active_connections_type &m_active_connections;
+    ApsEntityIdAllocator *m_entity_id_allocator;
 };
 
 
@@ -422,8 +458,32 @@ class ApsStateVariables
     /// layer 2 network with the AVTPDU subtype field matching
     /// one of the subtypes listed in Table C.6.
     ///
+    /// Messages received from the network are queued in m_L2Queue
+    /// and moved into m_in one at a time, so m_L2Msg only needs
+    /// to be set by code that fills in m_in directly.
+    ///
     bool m_L2Msg;
 
+    ///
+    /// \brief m_L2Queue
+    ///
+    /// The AVDECC PDUs received from the layer 2 network that
+    /// have not been sent to the APC yet
+    ///
+    AppMessageQueueWithSize<JDKSAVDECCMCU_APS_L2_QUEUE_DEPTH> m_L2Queue;
+
+    ///
+    /// \brief hasL2Msg
+    /// \return true if m_in holds a message or any are queued
+    ///
+    virtual bool hasL2Msg() const { return m_L2Msg || !m_L2Queue.isEmpty(); }
+
+    ///
+    /// \brief getL2BatchLimit
+    /// \return The maximum number of layer 2 messages to send to the APC per run()
+    ///
+    virtual uint32_t getL2BatchLimit() const { return m_L2Queue.getCapacity() + 1; }
+
     ///
     /// \brief m_assignIdRequest See Annex C.5.2.1.3
     ///
@@ -458,6 +518,21 @@ class ApsStateVariables
     ///
     uint32_t m_nopTimeout;
 
+    ///
+    /// \brief restartNopTimer
+    ///
+    /// Called whenever a message is sent to the APC. The default sets
+    /// nopTimeout to ten seconds after currentTime, as in Annex C.
+    /// Hosts with a finer timer may keep their own deadline instead.
+    ///
+    virtual void restartNopTimer() { m_nopTimeout = m_currentTime + 10; }
+
+    ///
+    /// \brief isNopDue
+    /// \return true if a NOP message has to be sent to the APC
+    ///
+    virtual bool isNopDue() const { return ( (int)m_nopTimeout - (int)m_currentTime ) < 0; }
+
     ///
     /// \brief m_currentTime See Annex C.5.2.1.4
     ///
@@ -474,6 +549,24 @@ class ApsStateVariables
     ///
     AppMessage m_out;
 
+    ///
+    /// \brief m_outView
+    ///
+    /// When set, the message to transfer to layer 2 before the queued
+    /// ones. It points into the TCP receive buffer and is only set
+    /// while ApsStateEvents::transferToL2() runs the state machine.
+    ///
+    AppMessageView const *m_outView;
+
+    ///
+    /// \brief m_outQueue
+    ///
+    /// The AVDECC_FROM_APC messages that arrived while the state
+    /// machine could not send them, in the order that they arrived.
+    /// m_apcMsg is true while any are queued.
+    ///
+    AppMessageQueueWithSize<JDKSAVDECCMCU_APS_APC_QUEUE_DEPTH> m_outQueue;
+
     ///
     /// \brief m_in See Annex C.5.2.1.7
     ///
@@ -606,6 +699,15 @@ class ApsStateActions
     ///
     virtual void sendAvdeccToL2( AppMessage const *msg );
 
+    ///
+    /// \brief sendAvdeccToL2
+    ///
+    /// Send the AVDECC PDU that the view points to, see above
+    ///
+    /// \param msg AppMessageView of the AVDECC msg to send to network
+    ///
+    virtual void sendAvdeccToL2( AppMessageView const &msg );
+
     ///
     /// \brief sendAvdeccToApc See Annex C.5.2.2.3
     ///
@@ -1043,9 +1145,27 @@ class ApsStates
     ///
     virtual void doFinish();
 
+    ///
+    /// \brief traceState
+    ///
+    /// Trace a transition to a state, called by the goTo functions
+    ///
+    /// \param state the TraceApsState of the new state
+    ///
+    void traceState( uint16_t state );
+
   protected:
     ApsStateMachine *m_owner;
     state_proc m_current_state;
+
+    ///
+    /// \brief m_L2_transfer_budget
+    ///
+    /// The number of layer 2 messages that may still be sent to
+    /// the APC during the current run(), so that a producer in
+    /// another thread can not keep run() from returning
+    ///
+    uint32_t m_L2_transfer_budget;
 };
 
 class ApsStateEvents : public AppMessageHandler, public HttpServerHandler
@@ -1187,6 +1307,17 @@ class ApsStateEvents : public AppMessageHandler, public HttpServerHandler
     ///
     virtual bool onIncomingHttpConnectRequest( HttpRequest const &request );
 
+    ///
+    /// \brief onIncomingHttpRequestHead
+    ///
+    /// Accept the CONNECT request from an in place parser without
+    /// building an HttpRequest
+    ///
+    /// \param head The request head
+    /// \return true if the request was accepted
+    ///
+    virtual bool onIncomingHttpRequestHead( HttpHead const &head );
+
     ///
     /// \brief onIncomingTcpAppData
     ///
@@ -1281,7 +1412,31 @@ class ApsStateEvents : public AppMessageHandler, public HttpServerHandler
     ///
     virtual void onAppUnknown( AppMessage const &msg );
 
+    ///
+    /// \brief onAppMessageView
+    ///
+    /// Takes AVDECC_FROM_APC messages with their payload still in
+    /// the TCP receive buffer
+    ///
+    /// \param view The message
+    /// \return true if the message was an AVDECC_FROM_APC
+    ///
+    virtual bool onAppMessageView( AppMessageView const &view );
+
   protected:
+    ///
+    /// \brief transferToL2
+    ///
+    /// Set the out variable and run the state machine so that the
+    /// message is sent before the next one in the same block of TCP
+    /// data replaces it. If it could not be sent yet, or older messages
+    /// are still waiting, it is copied to the end of m_outQueue. When
+    /// that is full the oldest queued message is dropped.
+    ///
+    /// \param view The AVDECC_FROM_APC message
+    ///
+    virtual void transferToL2( AppMessageView const &view );
+
     ApsStateMachine *m_owner;
 
     bool m_in_http;
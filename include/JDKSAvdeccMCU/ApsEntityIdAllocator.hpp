@@ -0,0 +1,333 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Eui.hpp"
+#include "JDKSAvdeccMCU/Frame.hpp"
+#include "JDKSAvdeccMCU/PersistentStorage.hpp"
+
+#include <deque>
+
+#ifndef JDKSAVDECCMCU_APS_ENTITY_ID_MAX
+///
+/// The default number of entity_ids that an ApsEntityIdAllocator
+/// can hand out, at most 65535
+///
+#define JDKSAVDECCMCU_APS_ENTITY_ID_MAX ( 4096 )
+#endif
+
+#ifndef JDKSAVDECCMCU_APS_ENTITY_ID_LEASE_TIME
+///
+/// The default time in seconds that a released entity_id stays
+/// reserved for the APC that had it
+///
+#define JDKSAVDECCMCU_APS_ENTITY_ID_LEASE_TIME ( 3600 )
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The ApsEntityIdAllocator class
+///
+/// Hands out the entity_ids of the APCs of one APS, see Annex C.5.2.2.5.
+///
+/// The entity_ids are formed from the primary MAC address of the
+/// server with a 16 bit index inserted in the middle, as
+/// mac[0..2], index, mac[3..5]. Index 0 is never used.
+///
+/// Free indexes are kept in a FIFO list so that a released index is
+/// the last to be reused, an index that is taken in any other way
+/// leaves the list at once. When an APC disconnects its index is leased to
+/// the APC's MAC address for the lease time, and an APC that
+/// reconnects within that time gets the same entity_id back. Leases
+/// expire in the order that they were made. If there are no free
+/// indexes left the oldest lease is taken. Assigning and releasing are
+/// O(1).
+///
+/// When an ADP ENTITY_AVAILABLE from some other station advertises an
+/// entity_id in our range, the index is taken out of use for the lease
+/// time. An index that is in use when the collision is seen is taken out
+/// of use when its APC disconnects.
+///
+/// If PersistentStorage is given, each index has its own 8 byte record
+/// with a CRC-8 after a 16 byte header, and every change rewrites only its
+/// record. restore() turns the saved records into leases so that APCs
+/// keep their entity_ids over a restart of the server.
+///
+class ApsEntityIdAllocator
+{
+  public:
+    enum
+    {
+        MAGIC = 0x45494441, // 'EIDA'
+        VERSION = 1,
+        HEADER_SIZE = 16,
+        RECORD_SIZE = 8
+    };
+
+    enum IndexState
+    {
+        INDEX_FREE = 0,
+        INDEX_ASSIGNED,
+        INDEX_LEASED,
+        INDEX_COLLIDED
+    };
+
+    ///
+    /// \brief ApsEntityIdAllocator
+    /// \param max_ids The number of entity_ids, indexes 1 to max_ids
+    /// \param lease_time_in_seconds How long released entity_ids are kept
+    /// \param storage Where the leases are kept, may be 0
+    /// \param base_offset The offset of the leases in the storage
+    ///
+    ApsEntityIdAllocator( uint16_t max_ids = JDKSAVDECCMCU_APS_ENTITY_ID_MAX,
+                          uint32_t lease_time_in_seconds = JDKSAVDECCMCU_APS_ENTITY_ID_LEASE_TIME,
+                          PersistentStorage *storage = 0,
+                          uint32_t base_offset = 0 );
+
+    virtual ~ApsEntityIdAllocator() {}
+
+    ///
+    /// \brief restore Restore the saved leases
+    ///
+    /// Must be called before the first assign(). Saved leases that do not
+    /// match max_ids are erased.
+    ///
+    /// \param time_in_seconds The current time, the restored leases expire
+    /// a lease time after it
+    /// \return The number of leases restored
+    ///
+    uint32_t restore( uint32_t time_in_seconds );
+
+    ///
+    /// \brief assign Assign an index to an APC
+    ///
+    /// The APC gets its leased index if it has one, otherwise the
+    /// requested index if that is free, otherwise the oldest free index,
+    /// otherwise the index of the oldest lease.
+    ///
+    /// \param apc_link_mac The primary MAC address of the APC
+    /// \param requested_index The index of the entity_id that the APC
+    /// requested, or 0
+    /// \param time_in_seconds The current time
+    /// \return The assigned index or 0 if all are in use
+    ///
+    virtual uint16_t assign( Eui48 const &apc_link_mac, uint16_t requested_index, uint32_t time_in_seconds );
+
+    ///
+    /// \brief reassign Release the index that an APC has and assign it one again
+    ///
+    /// Like release() followed by assign(), but the storage is flushed
+    /// once, so the lease of the APC is never saved as released.
+    ///
+    /// \param index The index that the APC has, or 0
+    /// \param apc_link_mac The primary MAC address of the APC
+    /// \param requested_index The index of the entity_id that the APC
+    /// requested, or 0
+    /// \param time_in_seconds The current time
+    /// \return The assigned index or 0 if all are in use
+    ///
+    virtual uint16_t
+        reassign( uint16_t index, Eui48 const &apc_link_mac, uint16_t requested_index, uint32_t time_in_seconds );
+
+    ///
+    /// \brief release Release the index of a disconnected APC
+    /// \param index The index returned by assign()
+    /// \param time_in_seconds The current time
+    ///
+    virtual void release( uint16_t index, uint32_t time_in_seconds );
+
+    ///
+    /// \brief observeEntityId Note an entity_id seen on the network
+    /// \param server_link_mac The primary MAC address of the server
+    /// \param entity_id The advertised entity_id
+    /// \param source_mac The source MAC address of the advertisement
+    /// \param time_in_seconds The current time
+    /// \return true if the entity_id collides with one of ours
+    ///
+    virtual bool observeEntityId( Eui48 const &server_link_mac,
+                                  Eui64 const &entity_id,
+                                  Eui48 const &source_mac,
+                                  uint32_t time_in_seconds );
+
+    ///
+    /// \brief observeFrame Check an ADP ENTITY_AVAILABLE frame for collisions
+    /// \param server_link_mac The primary MAC address of the server
+    /// \param frame The frame received from the network
+    /// \param time_in_seconds The current time
+    /// \return true if the advertised entity_id collides with one of ours
+    ///
+    bool observeFrame( Eui48 const &server_link_mac, Frame const &frame, uint32_t time_in_seconds );
+
+    ///
+    /// \brief onTimeTick Expire leases and collisions
+    /// \param time_in_seconds The current time
+    ///
+    virtual void onTimeTick( uint32_t time_in_seconds );
+
+    ///
+    /// \brief makeEntityId
+    /// \param server_link_mac The primary MAC address of the server
+    /// \param index The index
+    /// \return The entity_id for the index
+    ///
+    static Eui64 makeEntityId( Eui48 const &server_link_mac, uint16_t index );
+
+    ///
+    /// \brief getIndex
+    /// \param server_link_mac The primary MAC address of the server
+    /// \param entity_id The entity_id
+    /// \return The index of the entity_id, or 0 if it is not one of ours
+    ///
+    uint16_t getIndex( Eui48 const &server_link_mac, Eui64 const &entity_id ) const;
+
+    IndexState getState( uint16_t index ) const { return IndexState( m_slots[index].m_state ); }
+
+    Eui48 const &getApcLinkMac( uint16_t index ) const { return m_slots[index].m_apc_link_mac; }
+
+    uint16_t getMaxIds() const { return m_max_ids; }
+
+    uint32_t getLeaseTime() const { return m_lease_time; }
+
+    uint16_t getAssignedCount() const { return m_assigned_count; }
+
+    uint16_t getLeasedCount() const { return m_leased_count; }
+
+    ///
+    /// \brief getStorageSize
+    /// \return The number of bytes of storage the leases need
+    ///
+    uint32_t getStorageSize() const { return HEADER_SIZE + uint32_t( m_max_ids ) * RECORD_SIZE; }
+
+    ///
+    /// \brief getReclaimedCount
+    /// \return The number of leases taken before they expired
+    ///
+    uint32_t getReclaimedCount() const { return m_reclaimed_count; }
+
+    ///
+    /// \brief getExhaustedCount
+    /// \return The number of times assign() had nothing to give
+    ///
+    uint32_t getExhaustedCount() const { return m_exhausted_count; }
+
+    ///
+    /// \brief getCollisionCount
+    /// \return The number of advertisements that collided with our entity_ids
+    ///
+    uint32_t getCollisionCount() const { return m_collision_count; }
+
+    uint32_t getWriteCount() const { return m_write_count; }
+
+  protected:
+    struct Slot
+    {
+        Eui48 m_apc_link_mac;
+        uint8_t m_state;
+        bool m_collided;
+        bool m_in_free_list;
+        uint16_t m_free_prev;
+        uint16_t m_free_next;
+        uint32_t m_expires;
+    };
+
+    struct Expiry
+    {
+        uint16_t m_index;
+        uint32_t m_expires;
+    };
+
+    /// assign() without writing the record
+    uint16_t assignSlot( Eui48 const &apc_link_mac, uint16_t requested_index, uint32_t time_in_seconds );
+
+    /// release() without writing the record, false if the index was not assigned
+    bool releaseSlot( uint16_t index, uint32_t time_in_seconds );
+
+    /// Take the slot out of the free, leased or collided state
+    void take( uint16_t index );
+
+    /// Put the slot at the end of the free list
+    void makeFree( uint16_t index );
+
+    /// Take the slot out of the free list if it is in it
+    void unlinkFree( uint16_t index );
+
+    /// Start the lease time or collision time of the slot
+    void startExpiry( uint16_t index, uint8_t state, uint32_t time_in_seconds );
+
+    /// true if the expiry entry is still the current one of its slot
+    bool isLive( Expiry const &e ) const;
+
+    /// Find the slot leased to an APC, 0 if none
+    uint16_t findLease( Eui48 const &apc_link_mac ) const;
+
+    void insertLease( uint16_t index );
+
+    void eraseLease( uint16_t index );
+
+    size_t hashMac( Eui48 const &mac ) const;
+
+    bool readHeader();
+
+    void writeHeader();
+
+    void writeRecord( uint16_t index );
+
+    uint16_t m_max_ids;
+    uint32_t m_lease_time;
+    PersistentStorage *m_storage;
+    uint32_t m_base_offset;
+
+    /// Indexed by index, slot 0 is unused
+    std::vector<Slot> m_slots;
+
+    /// List of free indexes through Slot::m_free_next, oldest first
+    uint16_t m_free_first;
+    uint16_t m_free_last;
+    size_t m_free_count;
+
+    /// Leases and collisions in the order that they expire
+    std::deque<Expiry> m_expiries;
+
+    /// Open addressed table from APC MAC address to leased or assigned index
+    std::vector<uint16_t> m_lease_table;
+    size_t m_lease_table_mask;
+
+    uint16_t m_assigned_count;
+    uint16_t m_leased_count;
+    uint32_t m_reclaimed_count;
+    uint32_t m_exhausted_count;
+    uint32_t m_collision_count;
+    uint32_t m_write_count;
+};
+}
@@ -0,0 +1,745 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Aps.hpp"
+#include "JDKSAvdeccMCU/ApsSharedMessage.hpp"
+#include "JDKSAvdeccMCU/TcpOutputBuffer.hpp"
+#include "JDKSAvdeccMCU/TimerWheel.hpp"
+#include "JDKSAvdeccMCU/Handler.hpp"
+#include "JDKSAvdeccMCU/RawSocket.hpp"
+
+#ifndef JDKSAVDECCMCU_APS_SERVER_SHARED_QUEUE_DEPTH
+///
+/// The number of shared layer 2 messages that may be pending
+/// for each APC connection of an ApsServerCore
+///
+#define JDKSAVDECCMCU_APS_SERVER_SHARED_QUEUE_DEPTH ( 256 )
+#endif
+
+#ifndef JDKSAVDECCMCU_APS_SERVER_TIMER_SLOTS
+///
+/// The number of one millisecond slots in the timer wheel
+/// of an ApsServerCore
+///
+#define JDKSAVDECCMCU_APS_SERVER_TIMER_SLOTS ( 1024 )
+#endif
+
+#ifndef JDKSAVDECCMCU_APS_NOP_INTERVAL_MS
+///
+/// The time after the last message sent to an APC at which
+/// a NOP is sent to it. Ten seconds, as in Annex C
+///
+#define JDKSAVDECCMCU_APS_NOP_INTERVAL_MS ( 10000 )
+#endif
+
+#ifndef JDKSAVDECCMCU_APS_LIVENESS_TIMEOUT_MS
+///
+/// The default time without any data from an APC after which
+/// an ApsServerCore closes the connection. APCs send a NOP at
+/// least every ten seconds. 0 disables the check
+///
+#define JDKSAVDECCMCU_APS_LIVENESS_TIMEOUT_MS ( 30000 )
+#endif
+
+#ifndef JDKSAVDECCMCU_APS_SERVER_READS_PER_POLL
+///
+/// The number of 16 KiB reads from one APC connection in each
+/// poll() of an ApsServerEpoll
+///
+#define JDKSAVDECCMCU_APS_SERVER_READS_PER_POLL ( 4 )
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+class ApsServerCore;
+
+///
+/// \brief The ApsServerConnection class
+///
+/// The APS state machine for one APC connection of an ApsServerCore.
+///
+/// Layer 2 messages arrive from the server already encoded, as
+/// references to ApsSharedMessage objects, and are written to the
+/// TCP connection as is. When more than
+/// JDKSAVDECCMCU_APS_SERVER_SHARED_QUEUE_DEPTH messages are pending,
+/// the oldest is dropped and counted.
+///
+/// NOPs and the liveness check are scheduled in the server's
+/// TimerWheel with millisecond resolution, and the state machine
+/// only runs when there is something for it to do, so an idle
+/// connection costs nothing per tick.
+///
+/// Subclasses implement sendTcpData() for their transport.
+///
+class ApsServerConnection : public ApsStateMachine
+{
+  public:
+    ///
+    /// \brief ApsServerConnection
+    /// \param server The server that this connection belongs to
+    /// \param path The HTTP path that the APC must request
+    ///
+    ApsServerConnection( ApsServerCore *server, std::string const &path );
+
+    virtual ~ApsServerConnection();
+
+    virtual void clear();
+
+    ///
+    /// \brief run
+    ///
+    /// Bring currentTime up to date, then run the state machine
+    ///
+    /// \return true if there was activity
+    ///
+    virtual bool run();
+
+    virtual void onIncomingTcpConnection();
+
+    virtual ssize_t onIncomingTcpData( uint8_t const *data, ssize_t len );
+
+    ///
+    /// \brief isTransferring
+    /// \return true once the APC's HTTP request has been accepted and until the connection closes
+    ///
+    bool isTransferring() const;
+
+    ///
+    /// \brief isClosed
+    /// \return true after the state machine closed the TCP connection
+    ///
+    bool isClosed() const { return m_closed; }
+
+    ///
+    /// \brief enqueueShared
+    ///
+    /// Queue a reference to a shared message for sending to the APC
+    ///
+    /// \param msg The message, a reference is added
+    /// \return false if the oldest pending message had to be dropped
+    ///
+    bool enqueueShared( ApsSharedMessage *msg );
+
+    ///
+    /// \brief popShared
+    /// \return The oldest pending shared message, or 0. The caller owns the reference
+    ///
+    ApsSharedMessage *popShared();
+
+    bool hasSharedMessages() const { return m_shared_head != m_shared_tail; }
+
+    uint32_t getSharedQueueSize() const { return m_shared_head - m_shared_tail; }
+
+    uint32_t getSharedDroppedCount() const { return m_shared_dropped_count; }
+
+    uint32_t getSharedHighWaterMark() const { return m_shared_high_water_mark; }
+
+    ///
+    /// \brief clearShared Release all pending shared messages
+    ///
+    void clearShared();
+
+    ///
+    /// \brief sendSharedMessage
+    ///
+    /// Send an encoded shared message to the APC. The default copies
+    /// it with sendTcpData(), transports with an output queue may
+    /// keep a reference instead.
+    ///
+    /// \param msg The message, the caller keeps its reference
+    ///
+    virtual void sendSharedMessage( ApsSharedMessage *msg );
+
+    ///
+    /// \brief isOutputBackpressured
+    ///
+    /// While true, shared messages stay queued in the connection
+    /// (and the oldest are dropped) instead of being sent
+    ///
+    /// \return true if the transport can not take more output for now
+    ///
+    virtual bool isOutputBackpressured() const { return false; }
+
+    ///
+    /// \brief getOutputBuffer
+    /// \return The transport's output buffer, or 0 if it has none
+    ///
+    virtual TcpOutputBuffer const *getOutputBuffer() const { return 0; }
+
+    virtual void sendAvdeccToL2( Frame const &frame );
+
+    virtual void closeTcpConnection();
+
+    ApsServerCore *getServer() { return m_server; }
+
+  protected:
+    friend class ApsServerCore;
+
+    ///
+    /// \brief The Variables class
+    ///
+    /// Includes the shared message queue in the L2Msg condition and
+    /// takes the NOP deadline from the connection's timer
+    ///
+    class Variables : public ApsStateVariables
+    {
+      public:
+        virtual bool hasL2Msg() const;
+
+        virtual uint32_t getL2BatchLimit() const;
+
+        virtual void restartNopTimer();
+
+        virtual bool isNopDue() const;
+    };
+
+    ///
+    /// \brief The ConnectionTimer class
+    ///
+    /// A Timer that calls a method of the connection
+    ///
+    class ConnectionTimer : public Timer
+    {
+      public:
+        typedef void ( ApsServerConnection::*timer_proc )( jdksavdecc_timestamp_in_milliseconds now );
+
+        ConnectionTimer( ApsServerConnection *owner, timer_proc proc ) : m_owner( owner ), m_proc( proc ) {}
+
+        virtual void onTimerExpired( jdksavdecc_timestamp_in_milliseconds now ) { ( m_owner->*m_proc )( now ); }
+
+      protected:
+        ApsServerConnection *m_owner;
+        timer_proc m_proc;
+    };
+
+    ///
+    /// \brief restartNopTimer
+    ///
+    /// Push the NOP deadline to JDKSAVDECCMCU_APS_NOP_INTERVAL_MS from now.
+    /// The timer is only moved when it expires, so this is cheap enough
+    /// to call for every message
+    ///
+    void restartNopTimer();
+
+    void onNopTimer( jdksavdecc_timestamp_in_milliseconds now );
+
+    void onLivenessTimer( jdksavdecc_timestamp_in_milliseconds now );
+
+    ///
+    /// \brief cancelTimers Remove the connection's timers from the server's wheel
+    ///
+    void cancelTimers();
+
+    ///
+    /// \brief The States class
+    ///
+    /// Sends pending shared messages in the TRANSFER_TO_APC state
+    ///
+    class States : public ApsStates
+    {
+      public:
+        virtual void goToTransferToApc();
+    };
+
+    ApsServerCore *m_server;
+    Variables m_server_variables;
+    ApsStateActions m_server_actions;
+    States m_server_states;
+    ApsStateEvents m_server_events;
+    HttpServerParserInPlace m_http_parser;
+
+    ApsSharedMessage *m_shared[JDKSAVDECCMCU_APS_SERVER_SHARED_QUEUE_DEPTH];
+    uint32_t m_shared_head;
+    uint32_t m_shared_tail;
+    uint32_t m_shared_dropped_count;
+    uint32_t m_shared_high_water_mark;
+    bool m_closed;
+
+    ConnectionTimer m_nop_timer;
+    ConnectionTimer m_liveness_timer;
+    jdksavdecc_timestamp_in_milliseconds m_last_sent_time;
+    jdksavdecc_timestamp_in_milliseconds m_last_received_time;
+    bool m_nop_due;
+
+    /// The connection is in the server's list of connections to run
+    bool m_ready;
+};
+
+///
+/// \brief The ApsServerCore class
+///
+/// Transport independent part of an APS that serves many APC
+/// connections. Each AVDECC frame received from the layer 2
+/// network is encoded into an AVDECC_FROM_APS message only once
+/// and the encoded octets are shared by all of the connections.
+///
+/// The server is a Handler so it may be added to the HandlerGroup
+/// of the RawSocket on the AVDECC network. It does not consume the
+/// frames it receives.
+///
+/// All connections get their entity_ids from one ApsEntityIdAllocator,
+/// which sees every ADP message received so that it can avoid
+/// entity_ids that are in use by other stations.
+///
+/// tick() advances the server's TimerWheel, which drives the NOP
+/// and liveness timers of the connections, and then runs only the
+/// connections that were woken by an event.
+///
+class ApsServerCore : public Handler
+{
+  public:
+    ///
+    /// \brief ApsServerCore
+    /// \param link_mac The MAC address of the network port
+    /// \param net The network port to send AVDECC messages from the APCs to, may be 0
+    /// \param shared_message_count The number of encoded messages that may be in flight
+    ///
+    ApsServerCore( Eui48 link_mac, RawSocket *net = 0, size_t shared_message_count = 1024 );
+
+    virtual ~ApsServerCore();
+
+    ///
+    /// \brief addConnection
+    ///
+    /// Set up a new connection and add it to the fan-out. The
+    /// caller keeps ownership and calls onIncomingTcpConnection()
+    /// on it afterwards.
+    ///
+    /// \param connection The connection
+    ///
+    virtual void addConnection( ApsServerConnection *connection );
+
+    ///
+    /// \brief removeConnection
+    /// \param connection The connection to remove from the fan-out
+    ///
+    virtual void removeConnection( ApsServerConnection *connection );
+
+    size_t getConnectionCount() const { return m_connections.size(); }
+
+    ApsServerConnection *getConnection( size_t n ) { return m_connections[n]; }
+
+    ///
+    /// \brief onNetAvdeccMessageReceived
+    ///
+    /// Encode the frame once and queue it for every transferring connection
+    ///
+    /// \param frame The AVDECC frame received from the network
+    ///
+    virtual void onNetAvdeccMessageReceived( Frame const &frame );
+
+    ///
+    /// \brief onNetLinkStatusUpdated
+    /// \param link_mac The MAC address of the network port
+    /// \param link_status True if the port has link up
+    ///
+    virtual void onNetLinkStatusUpdated( Eui48 link_mac, bool link_status );
+
+    ///
+    /// \brief onTimeTick
+    /// \param time_in_seconds The current time in seconds
+    ///
+    virtual void onTimeTick( uint32_t time_in_seconds );
+
+    ///
+    /// \brief run Run the state machines of all connections
+    ///
+    virtual void run();
+
+    ///
+    /// \brief wake
+    ///
+    /// Have the connection's state machine run on the next tick()
+    ///
+    /// \param connection The connection
+    ///
+    void wake( ApsServerConnection *connection );
+
+    ///
+    /// \brief runReady Run the state machines of the connections that were woken
+    ///
+    virtual void runReady();
+
+    ///
+    /// \brief onLivenessTimeout
+    ///
+    /// Called when nothing was received on a connection for the
+    /// liveness timeout. The default counts it and tells the state
+    /// machine that the TCP connection closed.
+    ///
+    /// \param connection The connection
+    ///
+    virtual void onLivenessTimeout( ApsServerConnection *connection );
+
+    ///
+    /// \brief sendAvdeccToL2
+    ///
+    /// Send a message from an APC to the network. The default sends it via the RawSocket, if any.
+    ///
+    /// \param frame The frame to send
+    ///
+    virtual void sendAvdeccToL2( Frame const &frame );
+
+    ///
+    /// \brief tick
+    ///
+    /// Advance the timers to the timestamp and run the connections that were woken
+    ///
+    /// \param timestamp The current time in milliseconds
+    ///
+    virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp );
+
+    virtual bool receivedPDU( RawSocket *incoming_socket, Frame &frame );
+
+    uint16_t &getActiveEntityIdCount() { return m_active_entity_id_count; }
+
+    TimerWheel &getTimers() { return m_timers; }
+
+    ///
+    /// \brief getNow
+    /// \return The time in milliseconds of the last tick()
+    ///
+    jdksavdecc_timestamp_in_milliseconds getNow() const { return m_now; }
+
+    ///
+    /// \brief getCurrentTime
+    /// \return The time in seconds of the last onTimeTick()
+    ///
+    uint32_t getCurrentTime() const { return m_current_time; }
+
+    ///
+    /// \brief setLivenessTimeout
+    ///
+    /// Applies to connections that are set up afterwards
+    ///
+    /// \param timeout_ms The time without any data from an APC after which the connection is closed, 0 for never
+    ///
+    void setLivenessTimeout( uint32_t timeout_ms ) { m_liveness_timeout = timeout_ms; }
+
+    uint32_t getLivenessTimeout() const { return m_liveness_timeout; }
+
+    ///
+    /// \brief getLivenessTimeoutCount
+    /// \return The number of connections that were closed because the APC went silent
+    ///
+    uint32_t getLivenessTimeoutCount() const { return m_liveness_timeout_count; }
+
+    ///
+    /// \brief setEntityIdAllocator
+    ///
+    /// Replace the default allocator, for instance by one with
+    /// PersistentStorage. Must be called before any connection is added.
+    ///
+    /// \param allocator The allocator to use
+    ///
+    void setEntityIdAllocator( ApsEntityIdAllocator *allocator ) { m_entity_id_allocator = allocator; }
+
+    ApsEntityIdAllocator *getEntityIdAllocator() { return m_entity_id_allocator; }
+
+    ApsStateMachine::active_connections_type &getActiveConnections() { return m_active_connections; }
+
+    ApsSharedMessagePool &getSharedMessagePool() { return m_pool; }
+
+    ///
+    /// \brief getEncodedCount
+    /// \return The number of layer 2 frames encoded for fan-out
+    ///
+    uint32_t getEncodedCount() const { return m_encoded_count; }
+
+    ///
+    /// \brief getDeliveredCount
+    /// \return The number of references queued to connections
+    ///
+    uint32_t getDeliveredCount() const { return m_delivered_count; }
+
+  protected:
+    Eui48 m_link_mac;
+    bool m_link_status;
+    RawSocket *m_net;
+    ApsSharedMessagePool m_pool;
+    std::vector<ApsServerConnection *> m_connections;
+    uint16_t m_active_entity_id_count;
+    ApsStateMachine::active_connections_type m_active_connections;
+    ApsEntityIdAllocator m_default_entity_id_allocator;
+    ApsEntityIdAllocator *m_entity_id_allocator;
+    uint32_t m_current_time;
+    jdksavdecc_timestamp_in_milliseconds m_now;
+    uint32_t m_encoded_count;
+    uint32_t m_delivered_count;
+    TimerWheelWithSize<JDKSAVDECCMCU_APS_SERVER_TIMER_SLOTS> m_timers;
+
+    /// The connections to run on the next tick(), and the ones being run
+    std::vector<ApsServerConnection *> m_ready;
+    std::vector<ApsServerConnection *> m_running;
+
+    uint32_t m_liveness_timeout;
+    uint32_t m_liveness_timeout_count;
+};
+
+#if JDKSAVDECCMCU_ENABLE_EPOLL
+
+///
+/// \brief The ApsServerEpoll class
+///
+/// An ApsServerCore that accepts APC connections on a TCP port and
+/// services all of them from one epoll set.
+///
+/// Output to each APC goes through a TcpOutputBuffer; everything the
+/// state machines produce during one poll() is written with a single
+/// sendmsg() per connection, subject to the coalescing settings.
+/// A backpressured connection stops taking shared messages from the
+/// fan-out and is closed if it stays backpressured for too long.
+///
+/// Only connections with pending output are visited when flushing,
+/// and the poll timeout comes from the flush deadlines of those and
+/// from the TimerWheel, so idle connections cost nothing per poll.
+///
+class ApsServerEpoll : public ApsServerCore
+{
+  public:
+    ///
+    /// \brief ApsServerEpoll
+    /// \param link_mac The MAC address of the network port
+    /// \param net The network port to send AVDECC messages from the APCs to, may be 0
+    /// \param path The HTTP path that APCs must request
+    /// \param max_connections The maximum number of simultaneous APC connections
+    /// \param shared_message_count The number of encoded messages that may be in flight
+    /// \param output_buffer_count The number of buffers for octets copied into the output of the connections
+    ///
+    ApsServerEpoll( Eui48 link_mac,
+                    RawSocket *net = 0,
+                    std::string const &path = "/",
+                    size_t max_connections = 512,
+                    size_t shared_message_count = 1024,
+                    size_t output_buffer_count = 1024 );
+
+    virtual ~ApsServerEpoll();
+
+    ///
+    /// \brief listen
+    /// \param port The TCP port
+    /// \param bind_address The address to bind to, or 0 for all
+    /// \return true on success
+    ///
+    bool listen( uint16_t port = JDKSAVDECC_APPDU_TCP_PORT, char const *bind_address = 0 );
+
+    ///
+    /// \brief setReusePort
+    ///
+    /// Let several servers listen on the same port with SO_REUSEPORT,
+    /// the kernel then spreads the incoming connections across them.
+    /// Must be called before listen().
+    ///
+    /// \param reuse_port true to share the port
+    ///
+    void setReusePort( bool reuse_port ) { m_reuse_port = reuse_port; }
+
+    ///
+    /// \brief getPort
+    /// \return The TCP port that the server listens on, useful after listen( 0 ), or 0 if not listening
+    ///
+    uint16_t getPort() const;
+
+    ///
+    /// \brief poll
+    ///
+    /// Wait up to timeout_ms for socket activity, service it, then
+    /// run all connection state machines
+    ///
+    /// \param timeout_ms The maximum time to wait, -1 for forever
+    /// \return The number of socket events handled, or -1 on error
+    ///
+    int poll( int timeout_ms );
+
+    ///
+    /// \brief setOutputSettings
+    ///
+    /// Set the coalescing and watermark settings for new connections
+    ///
+    /// \param settings The settings
+    ///
+    void setOutputSettings( TcpOutputBuffer::Settings const &settings ) { m_output_settings = settings; }
+
+    TcpOutputBuffer::Settings const &getOutputSettings() const { return m_output_settings; }
+
+    ///
+    /// \brief getOutputPool
+    /// \return The pool that the TcpOutputBuffers take buffers for copied octets from
+    ///
+    ApsSharedMessagePool &getOutputPool() { return m_output_pool; }
+
+    ///
+    /// \brief getSlowConsumerCount
+    /// \return The number of connections closed because they stayed backpressured for too long
+    ///
+    uint32_t getSlowConsumerCount() const { return m_slow_consumer_count; }
+
+    ///
+    /// \brief getEpollFd
+    ///
+    /// The epoll file descriptor becomes readable when poll() has
+    /// work to do, so it may be nested in another event loop
+    ///
+    /// \return the file descriptor
+    ///
+    int getEpollFd() const { return m_epoll_fd; }
+
+    ///
+    /// \brief wakeup
+    ///
+    /// Make the current or next poll() return and call onWakeup().
+    /// May be called from any thread.
+    ///
+    void wakeup();
+
+    ///
+    /// \brief close Close the listening socket and all connections
+    ///
+    void close();
+
+    virtual void onLivenessTimeout( ApsServerConnection *connection );
+
+  protected:
+    ///
+    /// \brief onWakeup Called from poll() after wakeup()
+    ///
+    virtual void onWakeup() {}
+
+    ///
+    /// \brief The Connection class
+    ///
+    /// An ApsServerConnection over a non-blocking TCP socket
+    ///
+    class Connection : public ApsServerConnection
+    {
+      public:
+        Connection( ApsServerEpoll *server, int fd );
+
+        virtual ~Connection();
+
+        virtual void sendTcpData( uint8_t const *data, ssize_t len );
+
+        virtual void sendSharedMessage( ApsSharedMessage *msg );
+
+        virtual void closeTcpConnection();
+
+        virtual bool isOutputBackpressured() const { return m_output.isBackpressured(); }
+
+        virtual TcpOutputBuffer const *getOutputBuffer() const { return &m_output; }
+
+        ///
+        /// \brief flush Write as much queued output as the socket accepts with one sendmsg()
+        /// \param now The current time in milliseconds
+        /// \return false on a socket error
+        ///
+        bool flush( jdksavdecc_timestamp_in_milliseconds now );
+
+        int m_fd;
+        bool m_peer_closed;
+
+        /// The output could not be queued, closePeer() once the state machine has returned
+        bool m_close_pending;
+
+        /// The last flush stopped because the socket was full
+        bool m_want_write;
+
+        /// EPOLLOUT is enabled for the socket
+        bool m_epollout;
+
+        /// The connection is in the server's list of connections with output
+        bool m_output_pending;
+
+        TcpOutputBuffer m_output;
+    };
+
+    void acceptConnections();
+
+    void readConnection( Connection *c );
+
+    void updateEvents( Connection *c );
+
+    ///
+    /// \brief addPendingOutput Add the connection to the list of connections with output
+    ///
+    void addPendingOutput( Connection *c );
+
+    void removePendingOutput( Connection *c );
+
+    ///
+    /// \brief afterFlush Wake the connection if the flush made room for more shared messages
+    ///
+    void afterFlush( Connection *c );
+
+    ///
+    /// \brief flushConnections
+    ///
+    /// Flush the connections with pending output whose coalescing size
+    /// or latency budget has been reached and close slow consumers
+    ///
+    void flushConnections();
+
+    ///
+    /// \brief getPollTimeout
+    /// \param timeout_ms The caller's timeout
+    /// \return timeout_ms, shortened to the nearest flush deadline or timer
+    ///
+    int getPollTimeout( int timeout_ms ) const;
+
+    void closePeer( Connection *c );
+
+    void reapClosedConnections();
+
+    int m_epoll_fd;
+    int m_listen_fd;
+
+    /// The eventfd that wakeup() signals
+    int m_wakeup_fd;
+    bool m_reuse_port;
+    std::string m_path;
+    size_t m_max_connections;
+    TcpOutputBuffer::Settings m_output_settings;
+
+    /// The buffers for copied output, kept apart from the shared messages of the fan-out
+    ApsSharedMessagePool m_output_pool;
+    uint32_t m_slow_consumer_count;
+
+    /// The connections with output that is not written yet
+    std::vector<Connection *> m_pending_output;
+
+    /// A connection closed since the last reap
+    bool m_reap_pending;
+};
+
+#endif
+}
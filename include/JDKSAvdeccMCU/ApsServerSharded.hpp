@@ -0,0 +1,298 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/ApsServer.hpp"
+#include "JDKSAvdeccMCU/LockFreeQueue.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_EPOLL && JDKSAVDECCMCU_ENABLE_THREADS
+
+#include <mutex>
+#include <thread>
+
+#ifndef JDKSAVDECCMCU_APS_SHARDED_QUEUE_DEPTH
+///
+/// The number of layer 2 frames that may be queued to each worker
+/// of an ApsServerSharded, and from all workers to the network
+///
+#define JDKSAVDECCMCU_APS_SHARDED_QUEUE_DEPTH ( 1024 )
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The ApsEntityIdAllocatorLocked class
+///
+/// An ApsEntityIdAllocator that may be shared by APS servers running
+/// in different threads. Every change is made with a mutex held;
+/// the statistics getters read without it.
+///
+class ApsEntityIdAllocatorLocked : public ApsEntityIdAllocator
+{
+  public:
+    ApsEntityIdAllocatorLocked( uint16_t max_ids = JDKSAVDECCMCU_APS_ENTITY_ID_MAX,
+                                uint32_t lease_time_in_seconds = JDKSAVDECCMCU_APS_ENTITY_ID_LEASE_TIME,
+                                PersistentStorage *storage = 0,
+                                uint32_t base_offset = 0 )
+        : ApsEntityIdAllocator( max_ids, lease_time_in_seconds, storage, base_offset )
+    {
+    }
+
+    virtual uint16_t assign( Eui48 const &apc_link_mac, uint16_t requested_index, uint32_t time_in_seconds ) override;
+
+    virtual uint16_t
+        reassign( uint16_t index, Eui48 const &apc_link_mac, uint16_t requested_index, uint32_t time_in_seconds ) override;
+
+    virtual void release( uint16_t index, uint32_t time_in_seconds ) override;
+
+    virtual bool observeEntityId( Eui48 const &server_link_mac,
+                                  Eui64 const &entity_id,
+                                  Eui48 const &source_mac,
+                                  uint32_t time_in_seconds ) override;
+
+    virtual void onTimeTick( uint32_t time_in_seconds ) override;
+
+  protected:
+    std::mutex m_mutex;
+};
+
+///
+/// \brief The ApsServerSharded class
+///
+/// An APS that spreads its APC connections over a number of worker
+/// threads. Each worker is an ApsServerEpoll with its own epoll set,
+/// timers and shared message pool, listening on the same TCP port
+/// with SO_REUSEPORT so that the kernel balances the connections.
+///
+/// The ApsServerSharded itself is a Handler for the RawSocket on the
+/// AVDECC network and stays in the thread that owns the RawSocket.
+/// Each received AVDECC frame is copied once into the SpscQueue of
+/// every worker, which encodes it once for all of its connections.
+/// Frames from the APCs come back through one MpscQueue and are sent
+/// by processTx() in the owner thread, which tick() calls and which
+/// should also be called when getTxEventFd() becomes readable. A worker
+/// waits while that queue is full, which pushes back on the APCs via TCP.
+///
+/// All workers get their entity_ids from one ApsEntityIdAllocatorLocked.
+///
+class ApsServerSharded : public Handler
+{
+  public:
+    ///
+    /// \brief The L2Frame struct
+    ///
+    /// A copy of a layer 2 frame in a queue between threads
+    ///
+    struct L2Frame
+    {
+        jdksavdecc_timestamp_in_milliseconds m_time;
+        uint16_t m_length;
+        uint8_t m_data[1500 + JDKSAVDECC_FRAME_HEADER_LEN];
+    };
+
+    ///
+    /// \brief ApsServerSharded
+    /// \param link_mac The MAC address of the network port
+    /// \param net The network port to send AVDECC messages from the APCs to, may be 0
+    /// \param worker_count The number of worker threads
+    /// \param path The HTTP path that APCs must request
+    /// \param max_connections The maximum number of simultaneous APC connections of each worker
+    /// \param shared_message_count The number of encoded messages that may be in flight in each worker
+    /// \param queue_depth The number of frames that may be queued to each worker and to the network
+    ///
+    ApsServerSharded( Eui48 link_mac,
+                      RawSocket *net,
+                      size_t worker_count,
+                      std::string const &path = "/",
+                      size_t max_connections = 512,
+                      size_t shared_message_count = 1024,
+                      size_t queue_depth = JDKSAVDECCMCU_APS_SHARDED_QUEUE_DEPTH );
+
+    ///
+    /// \brief ~ApsServerSharded Stops the workers and closes all connections
+    ///
+    virtual ~ApsServerSharded();
+
+    ///
+    /// \brief listen Have every worker listen on the port
+    /// \param port The TCP port, 0 to have the first worker pick one
+    /// \param bind_address The address to bind to, or 0 for all
+    /// \return true on success
+    ///
+    bool listen( uint16_t port = JDKSAVDECC_APPDU_TCP_PORT, char const *bind_address = 0 );
+
+    ///
+    /// \brief getPort
+    /// \return The TCP port that the workers listen on, or 0 if not listening
+    ///
+    uint16_t getPort() const;
+
+    ///
+    /// \brief start Start the worker threads
+    /// \return true if all threads started
+    ///
+    bool start();
+
+    ///
+    /// \brief stop Stop and join the worker threads, the connections stay open
+    ///
+    void stop();
+
+    bool isRunning() const { return m_running.load(); }
+
+    ///
+    /// \brief onNetAvdeccMessageReceived
+    ///
+    /// Queue a copy of the frame to every worker. A worker whose
+    /// queue is full misses the frame.
+    ///
+    /// \param frame The AVDECC frame received from the network
+    ///
+    virtual void onNetAvdeccMessageReceived( Frame const &frame );
+
+    ///
+    /// \brief onNetLinkStatusUpdated
+    ///
+    /// The workers pick up the latest link status when they wake
+    ///
+    /// \param link_mac The MAC address of the network port
+    /// \param link_status True if the port has link up
+    ///
+    virtual void onNetLinkStatusUpdated( Eui48 link_mac, bool link_status );
+
+    ///
+    /// \brief processTx Send the frames that the workers queued for the network
+    /// \return The number of frames sent
+    ///
+    size_t processTx();
+
+    ///
+    /// \brief sendAvdeccToL2
+    ///
+    /// Called by processTx() for each frame from an APC. The default sends it via the RawSocket, if any.
+    ///
+    /// \param frame The frame to send
+    ///
+    virtual void sendAvdeccToL2( Frame const &frame );
+
+    ///
+    /// \brief getTxEventFd
+    ///
+    /// An eventfd that becomes readable when frames are queued for
+    /// processTx(), for the owner thread's event loop
+    ///
+    /// \return the file descriptor
+    ///
+    int getTxEventFd() const { return m_tx_event_fd; }
+
+    ///
+    /// \brief tick Send the queued frames
+    /// \param timestamp The current time in milliseconds
+    ///
+    virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp );
+
+    virtual bool receivedPDU( RawSocket *incoming_socket, Frame &frame );
+
+    ///
+    /// \brief setEntityIdAllocator
+    ///
+    /// Replace the default allocator of all workers, for instance by one
+    /// with PersistentStorage. Must be called before listen().
+    ///
+    /// \param allocator The allocator to use
+    ///
+    void setEntityIdAllocator( ApsEntityIdAllocatorLocked *allocator );
+
+    ApsEntityIdAllocatorLocked *getEntityIdAllocator() { return m_entity_id_allocator; }
+
+    size_t getWorkerCount() const { return m_workers.size(); }
+
+    ///
+    /// \brief getWorker
+    ///
+    /// A worker may only be used from other threads while stopped,
+    /// for instance to change its settings before start()
+    ///
+    /// \param n The worker number
+    /// \return The worker's server
+    ///
+    ApsServerEpoll *getWorker( size_t n );
+
+    ///
+    /// \brief getRxDroppedCount
+    /// \return The number of frames that a worker missed because its queue was full
+    ///
+    uint32_t getRxDroppedCount() const { return m_rx_dropped_count; }
+
+    ///
+    /// \brief getTxDroppedCount
+    /// \return The number of frames from APCs dropped because they were too big or the workers were stopped
+    ///
+    uint32_t getTxDroppedCount() const { return m_tx_dropped_count.load(); }
+
+    uint32_t getTxCount() const { return m_tx_count; }
+
+  protected:
+    class Worker;
+    friend class Worker;
+
+    ///
+    /// \brief pushTx Queue a frame for processTx(), called by the workers
+    /// \param frame The frame from an APC
+    ///
+    void pushTx( Frame const &frame );
+
+    Eui48 m_link_mac;
+    RawSocket *m_net;
+    ApsEntityIdAllocatorLocked m_default_entity_id_allocator;
+    ApsEntityIdAllocatorLocked *m_entity_id_allocator;
+    std::vector<Worker *> m_workers;
+    std::atomic<bool> m_running;
+
+    /// The link MAC address in the low 48 bits and the status in bit 48
+    std::atomic<uint64_t> m_link_state;
+
+    MpscQueue<L2Frame> m_tx;
+    int m_tx_event_fd;
+
+    /// The owner thread has not yet been signalled for the queued frames
+    std::atomic<bool> m_tx_wakeup_pending;
+
+    uint32_t m_current_time;
+    uint32_t m_rx_dropped_count;
+    std::atomic<uint32_t> m_tx_dropped_count;
+    uint32_t m_tx_count;
+};
+}
+
+#endif
@@ -0,0 +1,160 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Frame.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+class ApsSharedMessagePool;
+
+///
+/// \brief The ApsSharedMessage class
+///
+/// Octets of one or more APPDU messages in wire format, typically an
+/// AVDECC_FROM_APS message that is encoded once and then shared, by
+/// reference count, between all of the APC connections that it is
+/// sent to. When the last reference is released the message returns
+/// to its ApsSharedMessagePool.
+///
+class ApsSharedMessage
+{
+  public:
+    ApsSharedMessage() : m_pool( 0 ), m_next_free( 0 ), m_refcount( 0 ), m_length( 0 ) {}
+
+    ///
+    /// \brief setAvdeccFromAps
+    ///
+    /// Encode the frame as an AVDECC_FROM_APS message.
+    /// See IEEE Std 1722.1-2013 Annex C.5.1.6
+    ///
+    /// \param frame The AVDECC frame received from the network
+    /// \return false if the frame payload is too large
+    ///
+    bool setAvdeccFromAps( const Frame &frame );
+
+    ///
+    /// \brief append
+    ///
+    /// Append already encoded octets
+    ///
+    /// \param data The octets
+    /// \param len The number of octets
+    /// \return false if they do not fit
+    ///
+    bool append( uint8_t const *data, uint16_t len );
+
+    ///
+    /// \brief clear Remove all octets
+    ///
+    void clear() { m_length = 0; }
+
+    ///
+    /// \brief addRef Add a reference
+    ///
+    void addRef() { ++m_refcount; }
+
+    ///
+    /// \brief release Release a reference, recycling the message when
+    /// the last one is released
+    ///
+    void release();
+
+    uint32_t getRefCount() const { return m_refcount; }
+
+    uint8_t const *getData() const { return m_data; }
+
+    uint16_t getLength() const { return m_length; }
+
+    uint16_t getCapacity() const { return uint16_t( sizeof( m_data ) ); }
+
+  protected:
+    friend class ApsSharedMessagePool;
+
+    ApsSharedMessagePool *m_pool;
+    ApsSharedMessage *m_next_free;
+    uint32_t m_refcount;
+    uint16_t m_length;
+    uint8_t m_data[JDKSAVDECC_APPDU_HEADER_LEN + JDKSAVDECC_APPDU_MAX_PAYLOAD_LENGTH];
+};
+
+///
+/// \brief The ApsSharedMessagePool class
+///
+/// A fixed number of ApsSharedMessage objects, allocated up front
+/// and kept on a free list
+///
+class ApsSharedMessagePool
+{
+  public:
+    ApsSharedMessagePool( size_t count );
+
+    virtual ~ApsSharedMessagePool() {}
+
+    ///
+    /// \brief allocate
+    /// \return A message holding one reference, or 0 if all messages are in use
+    ///
+    ApsSharedMessage *allocate();
+
+    ///
+    /// \brief recycle
+    ///
+    /// Return a message with no references to the free list.
+    /// Called by ApsSharedMessage::release()
+    ///
+    /// \param msg The message
+    ///
+    void recycle( ApsSharedMessage *msg );
+
+    size_t getCapacity() const { return m_messages.size(); }
+
+    size_t getAvailableCount() const { return m_available_count; }
+
+    ///
+    /// \brief getExhaustedCount
+    /// \return The number of times allocate() failed because all messages were in use
+    ///
+    uint32_t getExhaustedCount() const { return m_exhausted_count; }
+
+  protected:
+    std::vector<ApsSharedMessage> m_messages;
+    ApsSharedMessage *m_free_list;
+    size_t m_available_count;
+    uint32_t m_exhausted_count;
+
+  private:
+    ApsSharedMessagePool( ApsSharedMessagePool const & );
+    ApsSharedMessagePool const &operator=( ApsSharedMessagePool const & );
+};
+}
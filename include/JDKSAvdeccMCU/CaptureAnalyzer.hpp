@@ -0,0 +1,341 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Frame.hpp"
+#include "JDKSAvdeccMCU/PcapMappedReader.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1 && JDKSAVDECCMCU_ENABLE_MMAP == 1
+
+#include <map>
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The CaptureAnalyzer class
+///
+/// Decodes the ADP, AECP and ACMP messages of a capture read with
+/// PcapMappedReader and gathers statistics per entity: the command to
+/// response latencies, matched by controller, target and sequence_id,
+/// the commands that timed out, the retries that were sent with the same
+/// sequence_id, the unsolicited responses and the ACMP CONNECT_RX times.
+///
+/// The packets are split into ranges by packet number and each range is
+/// analyzed by its own thread. A range can not know what was in flight
+/// when it starts, so the first message of every command in a range is
+/// kept aside and resolved when the ranges are merged, in order, against
+/// the commands that were still pending at the end of the ranges before
+/// it. The results are the same for any number of threads.
+///
+class CaptureAnalyzer
+{
+  public:
+    ///
+    /// \brief The Settings struct
+    ///
+    struct Settings
+    {
+        Settings()
+            : m_thread_count( 4 )
+            , m_aecp_timeout_in_microseconds( JDKSAVDECC_AEM_TIMEOUT_IN_MS * 1000 )
+            , m_min_packets_per_thread( 65536 )
+        {
+        }
+
+        /// The most threads to use, 0 or 1 to analyze in the calling thread
+        uint32_t m_thread_count;
+
+        /// A response to an AEM or AA command that comes later than this is counted as a timeout.
+        /// ACMP commands use the timeouts of IEEE Std 1722.1 for each command
+        uint64_t m_aecp_timeout_in_microseconds;
+
+        /// Fewer threads are used when a range would have less packets than this
+        size_t m_min_packets_per_thread;
+    };
+
+    ///
+    /// \brief The LatencyHistogram class
+    ///
+    /// Counts latencies in microseconds in buckets of a quarter octave,
+    /// so a percentile is within 25% of the real value
+    ///
+    class LatencyHistogram
+    {
+      public:
+        enum
+        {
+            bucket_count = 8 + 4 * 33
+        };
+
+        LatencyHistogram();
+
+        void add( uint64_t latency_in_microseconds );
+
+        void merge( LatencyHistogram const &other );
+
+        uint64_t getCount() const { return m_count; }
+
+        uint64_t getMin() const { return m_count ? m_min : 0; }
+
+        uint64_t getMax() const { return m_max; }
+
+        uint64_t getMean() const { return m_count ? m_sum / m_count : 0; }
+
+        /// The upper bound of the bucket that holds the percentile, 0 to 100
+        uint64_t getPercentile( double percentile ) const;
+
+        bool operator==( LatencyHistogram const &other ) const;
+
+      private:
+        static size_t bucketOf( uint64_t latency_in_microseconds );
+        static uint64_t bucketUpperBound( size_t bucket );
+
+        uint64_t m_count;
+        uint64_t m_sum;
+        uint64_t m_min;
+        uint64_t m_max;
+        uint32_t m_buckets[bucket_count];
+    };
+
+    ///
+    /// \brief The CommandStats struct
+    ///
+    /// The commands of one protocol sent to an entity
+    ///
+    struct CommandStats
+    {
+        CommandStats();
+
+        void merge( CommandStats const &other );
+
+        bool operator==( CommandStats const &other ) const;
+
+        /// Commands, including retries
+        uint64_t m_commands;
+
+        /// Responses matched to a command in time
+        uint64_t m_responses;
+
+        /// Commands without a response in time, including those that were retried
+        uint64_t m_timeouts;
+
+        /// Commands sent again with the sequence_id of a command that had no response
+        uint64_t m_retries;
+
+        /// Responses matched to a command after its timeout
+        uint64_t m_late_responses;
+
+        /// Solicited responses that match no command in the capture
+        uint64_t m_unmatched_responses;
+
+        /// AEM responses with the IN_PROGRESS status, the final response is matched
+        uint64_t m_in_progress;
+
+        /// From the last transmission of the command to its response
+        LatencyHistogram m_latency;
+    };
+
+    ///
+    /// \brief The EntityStats struct
+    ///
+    struct EntityStats
+    {
+        EntityStats();
+
+        void merge( EntityStats const &other );
+
+        bool operator==( EntityStats const &other ) const;
+
+        /// ENTITY_AVAILABLE messages
+        uint64_t m_adp_available;
+
+        /// ENTITY_DEPARTING messages
+        uint64_t m_adp_departing;
+
+        /// AEM commands sent to the entity
+        CommandStats m_aem;
+
+        /// ADDRESS_ACCESS commands sent to the entity
+        CommandStats m_aa;
+
+        /// ACMP commands sent to the entity as a talker or a listener
+        CommandStats m_acmp;
+
+        /// AEM responses that the entity sent unsolicited
+        uint64_t m_unsolicited;
+
+        /// CONNECT_RX_COMMAND to a successful CONNECT_RX_RESPONSE of the entity as a listener
+        LatencyHistogram m_connect_time;
+
+        /// Time of the first and the last message about the entity, in microseconds after the first packet
+        uint64_t m_first_seen;
+        uint64_t m_last_seen;
+    };
+
+    typedef std::map<uint64_t, EntityStats> entities_type;
+
+    ///
+    /// \brief The Totals struct
+    ///
+    struct Totals
+    {
+        Totals();
+
+        void merge( Totals const &other );
+
+        uint64_t m_packets;
+        uint64_t m_adp;
+        uint64_t m_aecp;
+        uint64_t m_acmp;
+
+        /// AVTP packets that are not AVDECC and packets of other EtherTypes
+        uint64_t m_other;
+
+        /// AVDECC packets that could not be parsed
+        uint64_t m_malformed;
+    };
+
+    ///
+    /// \brief CaptureAnalyzer
+    /// \param reader The capture to analyze, it is only read and must outlive the analyzer
+    /// \param settings The analyzer settings
+    ///
+    CaptureAnalyzer( PcapMappedReader const &reader, Settings const &settings = Settings() );
+
+    ///
+    /// \brief run Analyze every packet of the capture
+    ///
+    /// Throws std::runtime_error if a thread can not be started
+    ///
+    void run();
+
+    /// The number of ranges that the last run() used
+    size_t getShardCount() const { return m_shard_count; }
+
+    entities_type const &getEntities() const { return m_entities; }
+
+    Totals const &getTotals() const { return m_totals; }
+
+    /// The time from the first to the last packet in microseconds
+    uint64_t getDuration() const;
+
+    ///
+    /// \brief print Write a report of the totals and of every entity
+    /// \param o The stream to write to
+    ///
+    void print( std::ostream &o ) const;
+
+  private:
+    enum Protocol
+    {
+        PROTOCOL_AEM,
+        PROTOCOL_AA,
+        PROTOCOL_ACMP
+    };
+
+    /// A command is identified by the controller, the target, the protocol and command and the sequence_id
+    struct CommandKey
+    {
+        uint64_t m_controller_entity_id;
+        uint64_t m_target_entity_id;
+        uint16_t m_sequence_id;
+        uint8_t m_protocol;
+        uint16_t m_command;
+
+        bool operator<( CommandKey const &other ) const;
+    };
+
+    /// A command that is waiting for its response
+    struct Pending
+    {
+        uint64_t m_time;
+        uint64_t m_timeout;
+    };
+
+    enum HeadKind
+    {
+        HEAD_COMMAND,
+        HEAD_RESPONSE,
+        HEAD_IN_PROGRESS
+    };
+
+    /// A message of a command that depends on what was pending before the range, resolved when the ranges are merged
+    struct Head
+    {
+        CommandKey m_key;
+        uint64_t m_time;
+        uint8_t m_kind;
+        bool m_success;
+    };
+
+    typedef std::map<CommandKey, Pending> pending_type;
+
+    struct Shard
+    {
+        size_t m_begin;
+        size_t m_end;
+        Totals m_totals;
+        entities_type m_entities;
+        std::vector<Head> m_heads;
+
+        /// The commands that were seen in the range, the bool is set if the command is pending
+        std::map<CommandKey, std::pair<bool, Pending> > m_state;
+    };
+
+    static void analyzeShard( PcapMappedReader const *reader, Settings const *settings, Shard *shard );
+
+    static void analyzePacket( Settings const &settings, Shard &shard, uint64_t time, Frame const &frame );
+
+    static void command( Shard &shard, CommandKey const &key, uint64_t time, uint64_t timeout );
+
+    static void response( Shard &shard, CommandKey const &key, uint64_t time, bool success );
+
+    static void inProgress( Settings const &settings, Shard &shard, CommandKey const &key, uint64_t time );
+
+    static EntityStats &entity( entities_type &entities, uint64_t entity_id, uint64_t time );
+
+    static CommandStats &commandStats( EntityStats &entity, uint8_t protocol );
+
+    static void matched( EntityStats &entity, CommandKey const &key, Pending const &pending, uint64_t time, bool success );
+
+    void merge( std::vector<Shard> &shards );
+
+    PcapMappedReader const &m_reader;
+    Settings m_settings;
+    size_t m_shard_count;
+    Totals m_totals;
+    entities_type m_entities;
+};
+}
+
+#endif
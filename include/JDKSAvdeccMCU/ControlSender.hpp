@@ -74,6 +74,10 @@ class ControlSender : public Handler
 
     Eui48 const &getTargetMACAddress() const { return m_target_mac_address; }
 
+    uint16_t getTargetDescriptorIndex() const { return m_target_descriptor_index; }
+
+    jdksavdecc_timestamp_in_milliseconds getUpdateRateInMillis() const { return m_update_rate_in_millis; }
+
     ControlValueHolder *getHolder() { return m_holder; }
 
     ControlValueHolder const *getHolder() const { return m_holder; }
@@ -0,0 +1,308 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/RawSocket.hpp"
+#include "JDKSAvdeccMCU/Frame.hpp"
+#include "JDKSAvdeccMCU/Handler.hpp"
+#include "JDKSAvdeccMCU/Helpers.hpp"
+#include "JDKSAvdeccMCU/ControllerEntity.hpp"
+#include "JDKSAvdeccMCU/ControlSender.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The ControlSenderGroup class
+///
+/// Drives a set of ControlSender objects that share one ControllerEntity.
+/// Dirty senders are gathered per target entity and their SET_CONTROL
+/// commands are pipelined, with up to max_in_flight_per_target commands
+/// outstanding for each target at once. Each sender has at most one
+/// SET_CONTROL in flight; value changes that happen while it is in flight
+/// or before it could be sent are coalesced so only the newest value is sent.
+///
+/// The ControlSender objects that are added to a ControlSenderGroup must not
+/// also be added to a HandlerGroup; the ControlSenderGroup ticks them.
+///
+/// The SET_CONTROL responses are matched by sequence_id and the latency from
+/// the observed value change to the ACK is tracked per target entity.
+///
+/// The ControlSenderGroup does not contain the storage of the sender state or
+/// the target statistics. See ControlSenderGroupWithSize.
+///
+class ControlSenderGroup : public Handler
+{
+  public:
+    ///
+    /// \brief The TargetStatistics struct
+    ///
+    /// Pipelining state and latency statistics for one target entity
+    ///
+    struct TargetStatistics
+    {
+        TargetStatistics() { clear(); }
+
+        void clear()
+        {
+            m_in_flight_count = 0;
+            clearCounters();
+        }
+
+        void clearCounters()
+        {
+            m_sent_count = 0;
+            m_ack_count = 0;
+            m_error_count = 0;
+            m_timeout_count = 0;
+            m_superseded_count = 0;
+            m_latency_min = 0;
+            m_latency_max = 0;
+            m_latency_total = 0;
+        }
+
+        ///
+        /// \brief getLatencyAverage
+        /// \return The average latency from value change to ACK in
+        /// milliseconds
+        ///
+        jdksavdecc_timestamp_in_milliseconds getLatencyAverage() const
+        {
+            return m_ack_count > 0 ? m_latency_total / m_ack_count : 0;
+        }
+
+        /// The target entity
+        Eui64 m_target_entity_id;
+
+        /// The number of SET_CONTROL commands currently awaiting a response
+        uint16_t m_in_flight_count;
+
+        /// The number of SET_CONTROL commands sent
+        uint32_t m_sent_count;
+
+        /// The number of SET_CONTROL commands that were acknowledged with
+        /// SUCCESS
+        uint32_t m_ack_count;
+
+        /// The number of SET_CONTROL commands that were responded to with an
+        /// error status
+        uint32_t m_error_count;
+
+        /// The number of SET_CONTROL commands that timed out and were
+        /// re-sent
+        uint32_t m_timeout_count;
+
+        /// The number of value changes that were replaced by a newer value
+        /// before they were sent
+        uint32_t m_superseded_count;
+
+        /// The minimum latency from value change to ACK in milliseconds
+        jdksavdecc_timestamp_in_milliseconds m_latency_min;
+
+        /// The maximum latency from value change to ACK in milliseconds
+        jdksavdecc_timestamp_in_milliseconds m_latency_max;
+
+        /// The sum of all latencies from value change to ACK in milliseconds
+        jdksavdecc_timestamp_in_milliseconds m_latency_total;
+    };
+
+    ///
+    /// \brief The SenderState struct
+    ///
+    /// The pipelining state of one ControlSender
+    ///
+    struct SenderState
+    {
+        SenderState()
+            : m_sender( 0 )
+            , m_target_index( 0 )
+            , m_pending( false )
+            , m_in_flight( false )
+            , m_sequence_id( 0 )
+            , m_change_time( 0 )
+            , m_in_flight_change_time( 0 )
+            , m_sent_time( 0 )
+        {
+        }
+
+        /// The sender
+        ControlSender *m_sender;
+
+        /// The index of the TargetStatistics for the sender's target
+        uint16_t m_target_index;
+
+        /// A value change has been observed that has not been sent yet
+        bool m_pending;
+
+        /// A SET_CONTROL is in flight for this sender
+        bool m_in_flight;
+
+        /// The sequence_id of the SET_CONTROL in flight
+        uint16_t m_sequence_id;
+
+        /// The time that the oldest value change that has not been sent was observed
+        jdksavdecc_timestamp_in_milliseconds m_change_time;
+
+        /// The time that the value change sent by the SET_CONTROL in flight was observed
+        jdksavdecc_timestamp_in_milliseconds m_in_flight_change_time;
+
+        /// The time that the last SET_CONTROL was sent
+        jdksavdecc_timestamp_in_milliseconds m_sent_time;
+    };
+
+    ///
+    /// \brief ControlSenderGroup
+    /// \param controller_entity The ControllerEntity to send the commands with
+    /// \param sender_storage pointer to array of SenderState objects
+    /// \param max_senders the number of items in sender_storage
+    /// \param target_storage pointer to array of TargetStatistics objects
+    /// \param max_targets the number of items in target_storage
+    /// \param max_in_flight_per_target the number of SET_CONTROL commands that
+    /// may be awaiting a response from each target entity at once
+    ///
+    ControlSenderGroup( ControllerEntity &controller_entity,
+                        SenderState *sender_storage,
+                        uint16_t max_senders,
+                        TargetStatistics *target_storage,
+                        uint16_t max_targets,
+                        uint16_t max_in_flight_per_target );
+
+    ///
+    /// \brief add Add a ControlSender to the group
+    /// \param sender pointer to the ControlSender
+    /// \return true on success, false if there is no room for the sender or
+    /// its target
+    ///
+    bool add( ControlSender *sender );
+
+    ///
+    /// \brief tick Expire timed out commands, gather value changes and send
+    /// pending SET_CONTROL commands within the in-flight window of each target
+    /// \param time_in_millis the current time in milliseconds
+    ///
+    virtual void tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override;
+
+    ///
+    /// \brief receivedPDU Match SET_CONTROL responses to the commands in
+    /// flight
+    /// \param incoming_socket The socket that the frame was received on
+    /// \param frame reference to received Frame object
+    /// \return true if the frame was a response to one of our SET_CONTROL
+    /// commands
+    ///
+    virtual bool receivedPDU( RawSocket *incoming_socket, Frame &frame ) override;
+
+    ///
+    /// \brief addToHandlerGroup Register with HandlerGroup
+    ///
+    /// The ControlSenderGroup must be before the ControllerEntity in the
+    /// HandlerGroup so that it sees the SET_CONTROL responses
+    ///
+    /// \param group HandlerGroup to add to
+    ///
+    virtual void addToHandlerGroup( HandlerGroup &group ) override;
+
+    ///
+    /// \brief setMaxInFlightPerTarget
+    /// \param max_in_flight_per_target the new in-flight window size, minimum
+    /// 1
+    ///
+    void setMaxInFlightPerTarget( uint16_t max_in_flight_per_target )
+    {
+        m_max_in_flight_per_target = max_in_flight_per_target > 0 ? max_in_flight_per_target : 1;
+    }
+
+    uint16_t getMaxInFlightPerTarget() const { return m_max_in_flight_per_target; }
+
+    uint16_t getSenderCount() const { return m_num_senders; }
+
+    uint16_t getTargetCount() const { return m_num_targets; }
+
+    ///
+    /// \brief getTargetStatistics
+    /// \param index index of the target, 0 to getTargetCount()-1
+    /// \return the statistics for the target
+    ///
+    TargetStatistics const &getTargetStatistics( uint16_t index ) const { return m_targets[index]; }
+
+    ///
+    /// \brief findTargetStatistics
+    /// \param target_entity_id the target entity to look up
+    /// \return pointer to the statistics, or 0 if the target is not known
+    ///
+    TargetStatistics const *findTargetStatistics( Eui64 const &target_entity_id ) const;
+
+    ///
+    /// \brief clearStatistics Reset the counters and latencies of all targets
+    ///
+    void clearStatistics();
+
+  protected:
+    uint16_t findTarget( Eui64 const &target_entity_id ) const;
+
+    void sendPending( jdksavdecc_timestamp_in_milliseconds time_in_millis );
+
+    ControllerEntity &m_controller_entity;
+    SenderState *m_senders;
+    uint16_t m_num_senders;
+    uint16_t m_max_senders;
+    TargetStatistics *m_targets;
+    uint16_t m_num_targets;
+    uint16_t m_max_targets;
+    uint16_t m_max_in_flight_per_target;
+
+    /// The sender index to start the next send pass from, so that a busy
+    /// sender can not starve the others for the same target
+    uint16_t m_next_sender;
+};
+
+///
+/// \brief The ControlSenderGroupWithSize class
+///
+/// ControlSenderGroup that contains the storage for MaxSenders senders
+/// and MaxTargets distinct target entities
+///
+template <uint16_t MaxSenders, uint16_t MaxTargets = 1>
+class ControlSenderGroupWithSize : public ControlSenderGroup
+{
+  public:
+    ControlSenderGroupWithSize( ControllerEntity &controller_entity, uint16_t max_in_flight_per_target = 4 )
+        : ControlSenderGroup(
+              controller_entity, m_sender_storage, MaxSenders, m_target_storage, MaxTargets, max_in_flight_per_target )
+    {
+    }
+
+  private:
+    SenderState m_sender_storage[MaxSenders];
+    TargetStatistics m_target_storage[MaxTargets];
+};
+}
@@ -31,14 +31,42 @@
 #pragma once
 
 #include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/PersistentStorage.hpp"
+
+#ifndef JDKSAVDECCMCU_EEPROM_SIZE
+#define JDKSAVDECCMCU_EEPROM_SIZE ( 1024 )
+#endif
 
 namespace JDKSAvdeccMCU
 {
 
-template <typename T>
-class EEPromStorage
+///
+/// \brief The EEPromStorage class
+///
+/// PersistentStorage in a region of the microcontroller's EEPROM. Writes
+/// only touch the bytes that changed, to save EEPROM wear.
+///
+/// On targets without an EEPROM the region is emulated in RAM, so that the
+/// same code can run on the desktop.
+///
+class EEPromStorage : public PersistentStorage
 {
   public:
-    EEPromStorage( uint32_t magic_number );
+    ///
+    /// \brief EEPromStorage
+    /// \param base_address The first EEPROM address of the region
+    /// \param size The size of the region in bytes
+    ///
+    EEPromStorage( uint32_t base_address, uint32_t size );
+
+    virtual uint32_t getSize() const override { return m_size; }
+
+    virtual bool read( uint32_t offset, uint8_t *buf, uint16_t len ) override;
+
+    virtual bool write( uint32_t offset, uint8_t const *buf, uint16_t len ) override;
+
+  private:
+    uint32_t m_base_address;
+    uint32_t m_size;
 };
 }
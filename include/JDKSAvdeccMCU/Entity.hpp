@@ -41,6 +41,7 @@
 #include "JDKSAvdeccMCU/ACMPController.hpp"
 #include "JDKSAvdeccMCU/RegisteredController.hpp"
 #include "JDKSAvdeccMCU/EntityState.hpp"
+#include "JDKSAvdeccMCU/Metrics.hpp"
 
 namespace JDKSAvdeccMCU
 {
@@ -64,6 +65,9 @@ class Entity : public Handler
     /// Run periodic state machines (from Handler)
     virtual void tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override;
 
+    /// The time of the next lock or command timeout (from Handler)
+    virtual jdksavdecc_timestamp_in_milliseconds nextTickTime( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override;
+
     /// Handle received AECPDU's (from Handler)
     virtual bool receivedPDU( RawSocket *incoming_socket, Frame &frame ) override;
 
@@ -104,6 +108,22 @@ class Entity : public Handler
         return m_last_sent_command_type != JDKSAVDECC_AEM_COMMAND_EXPANSION;
     }
 
+    /// Get the sequence_id that was used for the most recently sent command
+    uint16_t getOutgoingSequenceId() const { return m_outgoing_sequence_id; }
+
+    /// Get the count of sent commands that wait for a response, 0 or 1
+    uint32_t getCommandsInFlight() const
+    {
+        bool in_flight
+            = m_last_sent_command_type != JDKSAVDECC_AEM_COMMAND_EXPANSION && isSet( m_last_sent_command_target_entity_id );
+        return in_flight ? 1 : 0;
+    }
+
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    /// Get the counts of the received messages and of the sent commands
+    EntityMetrics const &getMetrics() const { return m_metrics; }
+#endif
+
     void sendCommand( Eui64 const &target_entity_id,
                       Eui48 const &target_mac_address,
                       uint16_t aem_command_type,
@@ -245,5 +265,10 @@ class Entity : public Handler
 
     /// The ACMP Listener state machines (if any)
     ACMPListenerGroupHandlerBase *m_acmp_listener_group_handler;
+
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    /// The counts of the received messages and of the sent commands
+    EntityMetrics m_metrics;
+#endif
 };
 }
@@ -35,6 +35,7 @@
 #include "JDKSAvdeccMCU/Handler.hpp"
 #include "JDKSAvdeccMCU/Helpers.hpp"
 #include "JDKSAvdeccMCU/Frame.hpp"
+#include "jdksavdecc_descriptor_storage.h"
 
 namespace JDKSAvdeccMCU
 {
@@ -43,9 +44,15 @@ class Entity;
 class EntityState : public Handler
 {
   public:
-    EntityState() {}
+    EntityState() : m_descriptor_storage( 0 ) {}
     virtual ~EntityState();
 
+    /// Answer READ_DESCRIPTOR commands from a buffer or mapped descriptor
+    /// storage. The storage is not owned and must stay valid while it is set
+    void setDescriptorStorage( jdksavdecc_descriptor_storage *storage ) { m_descriptor_storage = storage; }
+
+    jdksavdecc_descriptor_storage *getDescriptorStorage() const { return m_descriptor_storage; }
+
     /// Run periodic state machines
     virtual void tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) override;
 
@@ -64,6 +71,18 @@ class EntityState : public Handler
                                                   uint16_t descriptor_type,
                                                   uint16_t descriptor_index );
 
+    /// Get the pre-built READ_DESCRIPTOR response payload of a descriptor,
+    /// from the configuration_index field to the end of the descriptor, so
+    /// the response can be sent as the AECP header of the command followed
+    /// by the payload without copying it. Sets control_data_length and
+    /// payload_length. Returns 0 if there is none, then
+    /// receiveReadDescriptorCommand() fills in the response
+    virtual uint8_t const *getReadDescriptorResponse( uint16_t configuration_index,
+                                                      uint16_t descriptor_type,
+                                                      uint16_t descriptor_index,
+                                                      uint16_t *control_data_length,
+                                                      uint16_t *payload_length );
+
     /// The pdu contains a valid Set Configuration Command
     /// Fill in the response in place in the pdu and return an AECP AEM status
     /// code
@@ -196,5 +215,8 @@ class EntityState : public Handler
     /// Fill in the response in place in the pdu and return an AECP AA status
     /// code
     virtual uint8_t receiveAAExecute( uint32_t virtual_base_address, uint16_t length, uint8_t const *request );
+
+  protected:
+    jdksavdecc_descriptor_storage *m_descriptor_storage;
 };
 }
@@ -230,23 +230,15 @@ class FixedBuffer
     ///
     void putBuf( const uint8_t *buf, uint16_t len )
     {
-        for ( uint16_t i = 0; i < len; ++i )
-        {
-            m_buf[m_length++] = buf[i];
-        }
+        memcpy( &m_buf[m_length], buf, len );
+        m_length += len;
     }
 
     ///
     /// \brief putBuf append a FixedBuffer to the buffer
     /// \param buf the FixedBuffer to copy
     ///
-    void putBuf( FixedBuffer const &buf )
-    {
-        for ( uint16_t i = 0; i < buf.getLength(); ++i )
-        {
-            m_buf[m_length++] = buf.getOctet( i );
-        }
-    }
+    void putBuf( FixedBuffer const &buf ) { putBuf( buf.getBuf(), buf.getLength() ); }
 
     ///
     /// \brief setOctet Set an Octet in the buffer
@@ -33,6 +33,14 @@
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/RawSocket.hpp"
 
+#ifndef JDKSAVDECCMCU_HANDLER_MAX_TICK_INTERVAL_MS
+///
+/// The longest time that an event driven loop lets pass between
+/// tick() calls to a Handler that does not know its next deadline
+///
+#define JDKSAVDECCMCU_HANDLER_MAX_TICK_INTERVAL_MS ( 1000 )
+#endif
+
 namespace JDKSAvdeccMCU
 {
 
@@ -58,6 +66,17 @@ class Handler
     ///
     virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp );
 
+    ///
+    /// \brief nextTickTime Ask when tick() next has something to do
+    ///
+    /// Lets an event driven loop skip the time in between. The default
+    /// is JDKSAVDECCMCU_HANDLER_MAX_TICK_INTERVAL_MS from now.
+    ///
+    /// \param timestamp the current monotonic time in milliseconds
+    /// \return the time of the next tick() that may do something
+    ///
+    virtual jdksavdecc_timestamp_in_milliseconds nextTickTime( jdksavdecc_timestamp_in_milliseconds timestamp );
+
     ///
     /// \brief receivedPDU Notification of received raw PDU.
     /// \param incoming_socket The socket that the frame was received on
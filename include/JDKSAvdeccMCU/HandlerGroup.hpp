@@ -33,6 +33,7 @@
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/RawSocket.hpp"
 #include "JDKSAvdeccMCU/Handler.hpp"
+#include "JDKSAvdeccMCU/Metrics.hpp"
 
 namespace JDKSAvdeccMCU
 {
@@ -45,6 +46,14 @@ namespace JDKSAvdeccMCU
 /// It does not contain the storage of the handlers
 /// No bounds checking is done
 ///
+/// With JDKSAVDECCMCU_ENABLE_METRICS it also counts the frames given to
+/// and handled by each Handler and records the time that receivedPDU()
+/// takes in a MetricsHistogram, for one in every
+/// JDKSAVDECCMCU_METRICS_LATENCY_SAMPLE_INTERVAL frames
+///
+/// With JDKSAVDECCMCU_ENABLE_TRACE it traces every received frame, the
+/// events recorded while the handlers run share its timestamp
+///
 class HandlerGroup : public Handler
 {
   protected:
@@ -54,6 +63,10 @@ class HandlerGroup : public Handler
     uint32_t m_rx_count;
     uint32_t m_handled_count;
     Frame *m_frame;
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    HandlerMetrics *m_item_metrics;
+    MetricsHistogram m_latency;
+#endif
 
   public:
     ///
@@ -97,6 +110,32 @@ class HandlerGroup : public Handler
     ///
     uint32_t getHandledCount() const { return m_handled_count; }
 
+    ///
+    /// \brief getHandlerCount get the count of handlers in the list
+    /// \return count
+    ///
+    uint16_t getHandlerCount() const { return m_num_items; }
+
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    ///
+    /// \brief getHandlerMetrics get the counts of each handler
+    /// \return pointer to getHandlerCount() counts, or 0 if there is no storage for them
+    ///
+    HandlerMetrics const *getHandlerMetrics() const { return m_item_metrics; }
+
+    ///
+    /// \brief getLatencyHistogram get the times that receivedPDU() took for the sampled frames
+    /// \return the histogram in nanoseconds
+    ///
+    MetricsHistogram const &getLatencyHistogram() const { return m_latency; }
+
+    ///
+    /// \brief setHandlerMetricsStorage set the storage of the per handler counts
+    /// \param item_metrics pointer to an array of max_items HandlerMetrics
+    ///
+    void setHandlerMetricsStorage( HandlerMetrics *item_metrics ) { m_item_metrics = item_metrics; }
+#endif
+
     ///
     /// \brief tick
     /// Send Tick() messages to all encapsulated Handlers
@@ -105,6 +144,13 @@ class HandlerGroup : public Handler
     ///
     virtual void tick( jdksavdecc_timestamp_in_milliseconds timestamp ) override;
 
+    ///
+    /// \brief nextTickTime The earliest next tick time of all encapsulated Handlers
+    /// \param timestamp
+    /// \return The time
+    ///
+    virtual jdksavdecc_timestamp_in_milliseconds nextTickTime( jdksavdecc_timestamp_in_milliseconds timestamp ) override;
+
     ///
     /// \brief receivedPDU Notification of received raw PDU.
     /// Send ReceivedPDU message to each handler until one returns true.
@@ -119,7 +165,8 @@ class HandlerGroup : public Handler
 /// \brief The HandlerGroupWithSize class
 ///
 /// HandlerGroup is a HandlerGroupBase and contains
-/// the storage of the contained Handler pointers.
+/// the storage of the contained Handler pointers
+/// and of their HandlerMetrics.
 /// The HandlerGroup is templatelized by the MaxItem count.
 ///
 template <uint16_t MaxItems>
@@ -127,8 +174,16 @@ class HandlerGroupWithSize : public HandlerGroup
 {
   private:
     Handler *m_item_storage[MaxItems];
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    HandlerMetrics m_item_metrics_storage[MaxItems];
+#endif
 
   public:
-    HandlerGroupWithSize( Frame *frame ) : HandlerGroup( frame, m_item_storage, MaxItems ) {}
+    HandlerGroupWithSize( Frame *frame ) : HandlerGroup( frame, m_item_storage, MaxItems )
+    {
+#if JDKSAVDECCMCU_ENABLE_METRICS
+        setHandlerMetricsStorage( m_item_metrics_storage );
+#endif
+    }
 };
 }
@@ -307,6 +307,17 @@ void setAAReply( uint8_t status_code, uint16_t new_length, uint8_t *buf, uint16_
 ///
 bool parseACMP( jdksavdecc_acmpdu *acmpdu, Frame const &pdu );
 
+///
+/// \brief formACMP Formulate an ACMP message addressed to the ACMP multicast
+/// address
+/// \param frame Pointer to the Frame to clear and fill in
+/// \param src_mac Source MAC Address
+/// \param acmpdu The ACMP message contents. The control_data_length is filled
+/// in automatically
+/// \return true if the formed message fit in the frame
+///
+bool formACMP( Frame *frame, Eui48 const &src_mac, jdksavdecc_acmpdu const &acmpdu );
+
 ///
 /// \brief isACMPInvolvingTarget
 /// \param acmpdu
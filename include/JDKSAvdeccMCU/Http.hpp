@@ -34,6 +34,21 @@
 
 #if JDKSAVDECCMCU_ENABLE_HTTP
 
+#ifndef JDKSAVDECCMCU_HTTP_MAX_HEAD_LENGTH
+///
+/// The maximum length of an HTTP request or response head
+/// (start line and header fields) for the in place parsers
+///
+#define JDKSAVDECCMCU_HTTP_MAX_HEAD_LENGTH ( 4096 )
+#endif
+
+#ifndef JDKSAVDECCMCU_HTTP_MAX_HEADER_FIELDS
+///
+/// The maximum number of header fields for the in place parsers
+///
+#define JDKSAVDECCMCU_HTTP_MAX_HEADER_FIELDS ( 32 )
+#endif
+
 namespace JDKSAvdeccMCU
 {
 
@@ -262,6 +277,120 @@ class HttpResponse
     std::vector<uint8_t> m_content;
 };
 
+///
+/// \brief The HttpSpan struct
+///
+/// A run of characters that is not owned by the span
+///
+struct HttpSpan
+{
+    char const *m_data;
+    uint16_t m_length;
+
+    ///
+    /// \brief equals
+    /// \param s nul terminated string
+    /// \return true if the span is exactly s
+    ///
+    bool equals( char const *s ) const;
+
+    ///
+    /// \brief equalsIgnoreCase
+    /// \param s nul terminated string
+    /// \return true if the span is s, ignoring ASCII case
+    ///
+    bool equalsIgnoreCase( char const *s ) const;
+
+    ///
+    /// \brief startsWith
+    /// \param s nul terminated string
+    /// \return true if the span starts with s
+    ///
+    bool startsWith( char const *s ) const;
+
+    std::string toString() const { return std::string( m_data, m_length ); }
+};
+
+///
+/// \brief The HttpHeaderField struct
+///
+struct HttpHeaderField
+{
+    HttpSpan m_name;
+    HttpSpan m_value;
+};
+
+///
+/// \brief The HttpHead class
+///
+/// The start line and header fields of an HTTP/1.x request or
+/// response, tokenized in place. The spans point into the buffer
+/// that was parsed and are only valid while it is.
+///
+class HttpHead
+{
+  public:
+    HttpHead() { clear(); }
+
+    void clear();
+
+    ///
+    /// \brief parse
+    ///
+    /// Tokenize a complete head, including the terminating blank line
+    ///
+    /// \param data The head
+    /// \param len The length of the head
+    /// \param is_request true for a request, false for a response
+    /// \return false if the head is malformed or has too many fields
+    ///
+    bool parse( char const *data, size_t len, bool is_request );
+
+    /// \brief getMethod the request method
+    HttpSpan const &getMethod() const { return m_start[0]; }
+
+    /// \brief getPath the request target
+    HttpSpan const &getPath() const { return m_start[1]; }
+
+    /// \brief getVersion the HTTP version of the request or response
+    HttpSpan const &getVersion() const { return m_is_request ? m_start[2] : m_start[0]; }
+
+    /// \brief getStatusCode the response status code
+    HttpSpan const &getStatusCode() const { return m_start[1]; }
+
+    /// \brief getReasonPhrase the response reason phrase
+    HttpSpan const &getReasonPhrase() const { return m_start[2]; }
+
+    uint16_t getFieldCount() const { return m_field_count; }
+
+    HttpHeaderField const &getField( uint16_t n ) const { return m_fields[n]; }
+
+    ///
+    /// \brief findField
+    /// \param name The field name, matched ignoring case
+    /// \return The value of the first field with the name, or 0
+    ///
+    HttpSpan const *findField( char const *name ) const;
+
+    ///
+    /// \brief getRequest copy into an HttpRequest, which allocates
+    /// \param request The destination
+    ///
+    void getRequest( HttpRequest *request ) const;
+
+    ///
+    /// \brief getResponse copy into an HttpResponse, which allocates
+    /// \param response The destination
+    ///
+    void getResponse( HttpResponse *response ) const;
+
+  protected:
+    bool m_is_request;
+    HttpSpan m_start[3];
+    HttpHeaderField m_fields[JDKSAVDECCMCU_HTTP_MAX_HEADER_FIELDS];
+    uint16_t m_field_count;
+};
+
 class HttpServerHandler
 {
   public:
@@ -274,6 +403,15 @@ class HttpServerHandler
     ///
     virtual bool onIncomingHttpRequest( HttpRequest const &request );
 
+    ///
+    /// \brief onIncomingHttpRequestHead
+    ///
+    /// Called by the in place parser. The default copies the head
+    /// into an HttpRequest and calls onIncomingHttpRequest(); override
+    /// it to handle the request without allocating.
+    ///
+    virtual bool onIncomingHttpRequestHead( HttpHead const &head );
+
     virtual bool onIncomingHttpConnectRequest( HttpRequest const &request ) { return false; }
 
     virtual bool onIncomingHttpHeadRequest( HttpRequest const &request ) { return false; }
@@ -298,6 +436,15 @@ class HttpClientHandler
     virtual ~HttpClientHandler() {}
 
     virtual bool onIncomingHttpResponse( HttpResponse const &response ) = 0;
+
+    ///
+    /// \brief onIncomingHttpResponseHead
+    ///
+    /// Called by the in place parser. The default copies the head
+    /// into an HttpResponse and calls onIncomingHttpResponse(); override
+    /// it to handle the response without allocating.
+    ///
+    virtual bool onIncomingHttpResponseHead( HttpHead const &head );
 };
 
 class HttpServerParser
@@ -379,6 +526,90 @@ class HttpClientParserSimple : public HttpClientParser
 
     std::string m_cur_line;
 };
+
+///
+/// \brief The HttpHeadParser class
+///
+/// Finds the end of an HTTP head in data that arrives in pieces and
+/// tokenizes it with HttpHead without allocating. If the whole head
+/// arrives in one piece it is tokenized in place in the caller's
+/// buffer, otherwise the pieces are gathered in a fixed buffer of
+/// JDKSAVDECCMCU_HTTP_MAX_HEAD_LENGTH octets.
+///
+/// Message bodies are not supported; these parsers are meant for
+/// the APS/APC CONNECT handshake.
+///
+class HttpHeadParser
+{
+  public:
+    HttpHeadParser( bool is_request ) : m_is_request( is_request ) { clear(); }
+
+    void clear();
+
+    ///
+    /// \brief parse
+    /// \param data The received octets
+    /// \param len The number of received octets
+    /// \return The number of octets consumed, with isComplete() true once
+    /// the head is tokenized, or -1 on error
+    ///
+    ssize_t parse( uint8_t const *data, ssize_t len );
+
+    bool isComplete() const { return m_complete; }
+
+    HttpHead const &getHead() const { return m_head; }
+
+  protected:
+    bool m_is_request;
+    bool m_complete;
+    uint16_t m_buffered;
+    uint16_t m_line_length;
+    char m_line_last;
+    HttpHead m_head;
+    char m_buf[JDKSAVDECCMCU_HTTP_MAX_HEAD_LENGTH];
+};
+
+///
+/// \brief The HttpServerParserInPlace class
+///
+/// HttpServerParser that calls HttpServerHandler::onIncomingHttpRequestHead()
+/// without building an HttpRequest
+///
+class HttpServerParserInPlace : public HttpServerParser
+{
+  public:
+    HttpServerParserInPlace( HttpServerHandler *handler ) : HttpServerParser( 0, handler ), m_parser( true ) {}
+
+    virtual ~HttpServerParserInPlace() {}
+
+    virtual void clear();
+
+    virtual ssize_t onIncomingHttpData( uint8_t const *data, ssize_t len );
+
+  protected:
+    HttpHeadParser m_parser;
+};
+
+///
+/// \brief The HttpClientParserInPlace class
+///
+/// HttpClientParser that calls HttpClientHandler::onIncomingHttpResponseHead()
+/// without building an HttpResponse
+///
+class HttpClientParserInPlace : public HttpClientParser
+{
+  public:
+    HttpClientParserInPlace( HttpClientHandler *handler ) : HttpClientParser( 0, handler ), m_parser( false ) {}
+
+    virtual ~HttpClientParserInPlace() {}
+
+    virtual void clear();
+
+    virtual ssize_t onIncomingHttpData( uint8_t const *data, ssize_t len );
+
+  protected:
+    HttpHeadParser m_parser;
+};
 }
 
 #endif
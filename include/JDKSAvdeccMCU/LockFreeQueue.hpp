@@ -0,0 +1,300 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_THREADS
+
+#include <atomic>
+
+#ifndef JDKSAVDECCMCU_CACHE_LINE_SIZE
+///
+/// The size that producer and consumer state of the lock free
+/// queues are padded to, so that they do not share cache lines
+///
+#define JDKSAVDECCMCU_CACHE_LINE_SIZE ( 64 )
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The SpscQueue class
+///
+/// A bounded lock free queue with one producer thread and one
+/// consumer thread. The items are allocated once and are written and
+/// read in place, so pushing and popping never allocate or copy
+/// more than the caller does.
+///
+/// The producer calls beginPush(), fills in the item and calls
+/// commitPush(). The consumer calls front(), uses the item and
+/// calls pop().
+///
+template <typename T>
+class SpscQueue
+{
+  public:
+    ///
+    /// \brief SpscQueue
+    /// \param capacity The number of items, rounded up to a power of two
+    ///
+    explicit SpscQueue( size_t capacity ) : m_mask( roundUp( capacity ) - 1 ), m_items( m_mask + 1 )
+    {
+        m_head.store( 0, std::memory_order_relaxed );
+        m_tail.store( 0, std::memory_order_relaxed );
+        m_producer_head = 0;
+        m_consumer_tail = 0;
+    }
+
+    ///
+    /// \brief beginPush Producer only
+    /// \return The item to fill in, or 0 if the queue is full
+    ///
+    T *beginPush()
+    {
+        size_t tail = m_tail.load( std::memory_order_relaxed );
+        if ( tail - m_producer_head > m_mask )
+        {
+            // Only look at the consumer's position when the cached one says full
+            m_producer_head = m_head.load( std::memory_order_acquire );
+            if ( tail - m_producer_head > m_mask )
+            {
+                return 0;
+            }
+        }
+        return &m_items[tail & m_mask];
+    }
+
+    ///
+    /// \brief commitPush Producer only, publish the item from beginPush()
+    ///
+    void commitPush() { m_tail.store( m_tail.load( std::memory_order_relaxed ) + 1, std::memory_order_release ); }
+
+    ///
+    /// \brief front Consumer only
+    /// \return The oldest item, or 0 if the queue is empty
+    ///
+    T *front()
+    {
+        size_t head = m_head.load( std::memory_order_relaxed );
+        if ( head == m_consumer_tail )
+        {
+            m_consumer_tail = m_tail.load( std::memory_order_acquire );
+            if ( head == m_consumer_tail )
+            {
+                return 0;
+            }
+        }
+        return &m_items[head & m_mask];
+    }
+
+    ///
+    /// \brief pop Consumer only, release the item from front()
+    ///
+    void pop() { m_head.store( m_head.load( std::memory_order_relaxed ) + 1, std::memory_order_release ); }
+
+    size_t getCapacity() const { return m_mask + 1; }
+
+    ///
+    /// \brief getSize
+    /// \return The number of items, only a snapshot when the other thread is running
+    ///
+    size_t getSize() const { return m_tail.load( std::memory_order_acquire ) - m_head.load( std::memory_order_acquire ); }
+
+  private:
+    SpscQueue( SpscQueue const & );
+    SpscQueue &operator=( SpscQueue const & );
+
+    static size_t roundUp( size_t n )
+    {
+        size_t r = 2;
+        while ( r < n )
+        {
+            r <<= 1;
+        }
+        return r;
+    }
+
+    size_t const m_mask;
+    std::vector<T> m_items;
+
+    char m_pad0[JDKSAVDECCMCU_CACHE_LINE_SIZE];
+
+    /// Written by the consumer
+    std::atomic<size_t> m_head;
+    size_t m_consumer_tail;
+
+    char m_pad1[JDKSAVDECCMCU_CACHE_LINE_SIZE];
+
+    /// Written by the producer
+    std::atomic<size_t> m_tail;
+    size_t m_producer_head;
+
+    char m_pad2[JDKSAVDECCMCU_CACHE_LINE_SIZE];
+};
+
+///
+/// \brief The MpscQueue class
+///
+/// A bounded lock free queue with any number of producer threads and
+/// one consumer thread. Each item has a sequence number that tells
+/// whether it is free, being written or ready to read, so producers
+/// only contend on the one compare and swap that claims an item.
+///
+/// A producer calls beginPush(), fills in the item and calls
+/// commitPush() with the ticket. The consumer calls front(), uses
+/// the item and calls pop(). An item that is claimed but not yet
+/// committed holds back the items after it.
+///
+template <typename T>
+class MpscQueue
+{
+  public:
+    ///
+    /// \brief MpscQueue
+    /// \param capacity The number of items, rounded up to a power of two
+    ///
+    explicit MpscQueue( size_t capacity ) : m_mask( roundUp( capacity ) - 1 ), m_cells( m_mask + 1 )
+    {
+        for ( size_t i = 0; i <= m_mask; ++i )
+        {
+            m_cells[i].m_sequence.store( i, std::memory_order_relaxed );
+        }
+        m_tail.store( 0, std::memory_order_relaxed );
+        m_head = 0;
+    }
+
+    ///
+    /// \brief beginPush Any producer
+    /// \param ticket Set to the ticket to pass to commitPush()
+    /// \return The item to fill in, or 0 if the queue is full
+    ///
+    T *beginPush( size_t &ticket )
+    {
+        size_t pos = m_tail.load( std::memory_order_relaxed );
+        for ( ;; )
+        {
+            Cell &cell = m_cells[pos & m_mask];
+            size_t sequence = cell.m_sequence.load( std::memory_order_acquire );
+            ptrdiff_t diff = ptrdiff_t( sequence ) - ptrdiff_t( pos );
+
+            if ( diff == 0 )
+            {
+                if ( m_tail.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                {
+                    ticket = pos;
+                    return &cell.m_item;
+                }
+            }
+            else if ( diff < 0 )
+            {
+                return 0;
+            }
+            else
+            {
+                pos = m_tail.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    ///
+    /// \brief commitPush Publish the item from beginPush()
+    /// \param ticket The ticket from beginPush()
+    ///
+    void commitPush( size_t ticket ) { m_cells[ticket & m_mask].m_sequence.store( ticket + 1, std::memory_order_release ); }
+
+    ///
+    /// \brief front Consumer only
+    /// \return The oldest item, or 0 if there is no committed item
+    ///
+    T *front()
+    {
+        Cell &cell = m_cells[m_head & m_mask];
+        if ( cell.m_sequence.load( std::memory_order_acquire ) != m_head + 1 )
+        {
+            return 0;
+        }
+        return &cell.m_item;
+    }
+
+    ///
+    /// \brief pop Consumer only, give the item from front() back to the producers
+    ///
+    void pop()
+    {
+        m_cells[m_head & m_mask].m_sequence.store( m_head + m_mask + 1, std::memory_order_release );
+        ++m_head;
+    }
+
+    size_t getCapacity() const { return m_mask + 1; }
+
+  private:
+    MpscQueue( MpscQueue const & );
+    MpscQueue &operator=( MpscQueue const & );
+
+    static size_t roundUp( size_t n )
+    {
+        size_t r = 2;
+        while ( r < n )
+        {
+            r <<= 1;
+        }
+        return r;
+    }
+
+    struct Cell
+    {
+        Cell() {}
+        Cell( Cell const & ) {}
+
+        std::atomic<size_t> m_sequence;
+        T m_item;
+    };
+
+    size_t const m_mask;
+    std::vector<Cell> m_cells;
+
+    char m_pad0[JDKSAVDECCMCU_CACHE_LINE_SIZE];
+
+    /// Claimed by the producers
+    std::atomic<size_t> m_tail;
+
+    char m_pad1[JDKSAVDECCMCU_CACHE_LINE_SIZE];
+
+    /// Only used by the consumer
+    size_t m_head;
+
+    char m_pad2[JDKSAVDECCMCU_CACHE_LINE_SIZE];
+};
+}
+
+#endif
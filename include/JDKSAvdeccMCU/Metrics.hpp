@@ -0,0 +1,312 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_METRICS
+#include <chrono>
+#endif
+
+/// A HandlerGroup times one in this many received frames, reading the clock costs more than the counting
+#ifndef JDKSAVDECCMCU_METRICS_LATENCY_SAMPLE_INTERVAL
+#define JDKSAVDECCMCU_METRICS_LATENCY_SAMPLE_INTERVAL 16
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+class HandlerGroup;
+class Entity;
+class RawSocket;
+
+///
+/// \brief The HandlerMetrics struct
+///
+/// The counts of one Handler of a HandlerGroup
+///
+struct HandlerMetrics
+{
+    HandlerMetrics() : m_invocations( 0 ), m_handled( 0 ) {}
+
+    /// The frames that were given to the handler
+    uint32_t m_invocations;
+
+    /// The frames that the handler returned true for
+    uint32_t m_handled;
+};
+
+///
+/// \brief The EntityMetrics struct
+///
+/// The counts of the messages that an Entity received and of the
+/// commands that it sent
+///
+struct EntityMetrics
+{
+    enum
+    {
+        /// One count per AEM command type up to GET_STREAM_BACKUP, the last one counts all others
+        aem_command_type_count = JDKSAVDECC_AEM_COMMAND_GET_STREAM_BACKUP + 2
+    };
+
+    EntityMetrics() { clear(); }
+
+    void clear()
+    {
+        for ( size_t i = 0; i < aem_command_type_count; ++i )
+        {
+            m_aem_commands[i] = 0;
+            m_aem_failures[i] = 0;
+        }
+        m_aa_commands = 0;
+        m_acmp_messages = 0;
+        m_commands_sent = 0;
+        m_command_timeouts = 0;
+    }
+
+    /// Count a received AEM command and the status of its response
+    void countAEMCommand( uint16_t command_type, uint8_t status )
+    {
+        size_t i = command_type < aem_command_type_count - 1 ? command_type : aem_command_type_count - 1;
+        ++m_aem_commands[i];
+        if ( status != JDKSAVDECC_AEM_STATUS_SUCCESS )
+        {
+            ++m_aem_failures[i];
+        }
+    }
+
+    /// The received AEM commands by command type
+    uint32_t m_aem_commands[aem_command_type_count];
+
+    /// The received AEM commands that were responded to with a status other than SUCCESS
+    uint32_t m_aem_failures[aem_command_type_count];
+
+    /// The received Address Access commands
+    uint32_t m_aa_commands;
+
+    /// The received ACMP messages that involved the entity
+    uint32_t m_acmp_messages;
+
+    /// The AEM commands sent by the entity that wait for a response
+    uint32_t m_commands_sent;
+
+    /// The sent commands that were not answered in time
+    uint32_t m_command_timeouts;
+};
+
+#if JDKSAVDECCMCU_ENABLE_METRICS
+
+///
+/// \brief metricsTimeInNanoseconds
+///
+/// The monotonic time that the handling latencies are measured with
+///
+inline uint64_t metricsTimeInNanoseconds()
+{
+    return uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+///
+/// \brief The MetricsHistogram class
+///
+/// A high dynamic range histogram of durations in nanoseconds. Each
+/// power of two is split into 16 linear buckets, so a value is known to
+/// within 1/16 of itself from 16 ns up to 2^40 ns, about 18 minutes.
+/// Longer durations go in the last bucket. Recording a value is a few
+/// shifts and an increment, there is no allocation.
+///
+class MetricsHistogram
+{
+  public:
+    enum
+    {
+        sub_bucket_bits = 4,
+        sub_bucket_count = 1 << sub_bucket_bits,
+        max_value_bits = 40,
+        bucket_count = sub_bucket_count + ( max_value_bits - sub_bucket_bits ) * sub_bucket_count
+    };
+
+    MetricsHistogram() { clear(); }
+
+    void clear();
+
+    void record( uint64_t value_in_nanoseconds )
+    {
+        ++m_buckets[bucketOf( value_in_nanoseconds )];
+        ++m_count;
+        m_sum += value_in_nanoseconds;
+        if ( value_in_nanoseconds < m_min )
+        {
+            m_min = value_in_nanoseconds;
+        }
+        if ( value_in_nanoseconds > m_max )
+        {
+            m_max = value_in_nanoseconds;
+        }
+    }
+
+    void merge( MetricsHistogram const &other );
+
+    uint64_t getCount() const { return m_count; }
+
+    uint64_t getSum() const { return m_sum; }
+
+    uint64_t getMin() const { return m_count ? m_min : 0; }
+
+    uint64_t getMax() const { return m_max; }
+
+    uint64_t getMean() const { return m_count ? m_sum / m_count : 0; }
+
+    /// The highest value that the bucket holding the percentile, 0 to 100, can hold
+    uint64_t getPercentile( double percentile ) const;
+
+    /// The count of the values in the buckets that only hold values up to value_in_nanoseconds
+    uint64_t getCountAtOrBelow( uint64_t value_in_nanoseconds ) const;
+
+    uint64_t getBucketCount( size_t bucket ) const { return m_buckets[bucket]; }
+
+    /// The lowest value that goes in the bucket
+    static uint64_t getBucketLowerBound( size_t bucket );
+
+    /// The highest value that goes in the bucket
+    static uint64_t getBucketUpperBound( size_t bucket );
+
+    static size_t bucketOf( uint64_t value_in_nanoseconds )
+    {
+        size_t r = size_t( value_in_nanoseconds );
+        if ( value_in_nanoseconds >= sub_bucket_count )
+        {
+            // The highest bit set picks the power of two, the next four bits the linear bucket in it
+            size_t msb = highestBit( value_in_nanoseconds );
+            if ( msb >= max_value_bits )
+            {
+                r = bucket_count - 1;
+            }
+            else
+            {
+                size_t shift = msb - sub_bucket_bits;
+                r = sub_bucket_count + shift * sub_bucket_count
+                    + size_t( ( value_in_nanoseconds >> shift ) & ( sub_bucket_count - 1 ) );
+            }
+        }
+        return r;
+    }
+
+  private:
+    static size_t highestBit( uint64_t v )
+    {
+#if defined( __GNUC__ )
+        return size_t( 63 - __builtin_clzll( v ) );
+#else
+        size_t r = 0;
+        while ( v >>= 1 )
+        {
+            ++r;
+        }
+        return r;
+#endif
+    }
+
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+    uint64_t m_buckets[bucket_count];
+};
+
+///
+/// \brief The MetricsSnapshot struct
+///
+/// A copy of the counters of HandlerGroups, Entities and RawSockets taken
+/// at one time. The counters are not synchronized, take the snapshot in
+/// the thread that runs the handlers and export it from anywhere.
+///
+struct MetricsSnapshot
+{
+    struct HandlerGroupEntry
+    {
+        std::string m_name;
+        uint32_t m_rx_count;
+        uint32_t m_handled_count;
+
+        /// Empty when the HandlerGroup has no storage for per handler counts
+        std::vector<HandlerMetrics> m_handlers;
+
+        /// The time that receivedPDU() took for the sampled frames, in nanoseconds
+        MetricsHistogram m_latency;
+    };
+
+    struct EntityEntry
+    {
+        std::string m_name;
+        Eui64 m_entity_id;
+        EntityMetrics m_metrics;
+
+        /// The commands sent that wait for a response, an Entity tracks one at a time
+        uint32_t m_commands_in_flight;
+    };
+
+    struct RawSocketEntry
+    {
+        std::string m_name;
+        Eui48 m_mac_address;
+        uint64_t m_tx_frames;
+        uint64_t m_tx_octets;
+    };
+
+    void addHandlerGroup( std::string const &name, HandlerGroup const &group );
+
+    void addEntity( std::string const &name, Entity const &entity );
+
+    void addRawSocket( std::string const &name, RawSocket const &socket );
+
+    ///
+    /// \brief writePrometheus
+    ///
+    /// Write the snapshot in the Prometheus text exposition format. The
+    /// latencies are written as a histogram in seconds with fixed bounds
+    /// from 1 us to 1 s, each bound counts the HDR buckets that lie
+    /// entirely below it.
+    ///
+    /// \param o The stream to write to
+    /// \param prefix The prefix of every metric name
+    ///
+    void writePrometheus( std::ostream &o, std::string const &prefix = "jdksavdecc" ) const;
+
+    std::vector<HandlerGroupEntry> m_handler_groups;
+    std::vector<EntityEntry> m_entities;
+    std::vector<RawSocketEntry> m_raw_sockets;
+};
+
+#endif
+}
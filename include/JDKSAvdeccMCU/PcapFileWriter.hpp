@@ -28,17 +28,118 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/PcapFile.hpp"
+#include "JDKSAvdeccMCU/LockFreeQueue.hpp"
 
 #if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1
 
+#if JDKSAVDECCMCU_ENABLE_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
 namespace JDKSAvdeccMCU
 {
+
+///
+/// \brief The PcapFileWriter class
+///
+/// Writes packets to a pcap or pcapng capture. Records are formatted
+/// into a preallocated buffer and the buffer is written to the file
+/// when it is full, when Flush() is called or when its oldest packet is
+/// older than the flush interval.
+///
+/// With Settings::m_async the full buffers are handed to a flush thread
+/// through a lock free queue and the thread writing packets never waits
+/// for the disk. When every buffer is waiting for the disk, packets are
+/// dropped and counted instead.
+///
+/// The capture can be rotated to a new file by size or by packet time.
+/// The first file has the given name, the next ones have "-1", "-2"...
+/// inserted before the extension.
+///
 class PcapFileWriter
 {
   public:
+    enum Format
+    {
+        FORMAT_PCAP,
+        FORMAT_PCAPNG
+    };
+
+    ///
+    /// \brief The Settings struct
+    ///
+    struct Settings
+    {
+        Settings()
+            : m_format( FORMAT_PCAP )
+            , m_buffer_size( 1024 * 1024 )
+            , m_buffer_count( 8 )
+            , m_async( false )
+            , m_rotate_size( 0 )
+            , m_rotate_interval_in_microseconds( 0 )
+            , m_max_files( 0 )
+            , m_flush_interval_in_microseconds( 0 )
+        {
+        }
+
+        /// pcap with microsecond timestamps, or pcapng with nanosecond timestamps
+        Format m_format;
+
+        /// The size of each write buffer in octets, at least 128 KiB is used
+        size_t m_buffer_size;
+
+        /// The number of write buffers when m_async is set
+        size_t m_buffer_count;
+
+        /// Write the buffers from a flush thread, needs JDKSAVDECCMCU_ENABLE_THREADS
+        bool m_async;
+
+        /// Start a new file when the current one would grow past this many octets, 0 for never
+        uint64_t m_rotate_size;
+
+        /// Start a new file when a packet is this much later than the file's first packet, 0 for never
+        uint64_t m_rotate_interval_in_microseconds;
+
+        /// Delete the oldest rotated file when there would be more than this many, 0 to keep all
+        size_t m_max_files;
+
+        /// Write the buffer when a packet is this much later than the buffer's first packet, 0 for only when full
+        uint64_t m_flush_interval_in_microseconds;
+    };
+
+    ///
+    /// \brief PcapFileWriter Append to a pcap file, or create it
+    ///
     PcapFileWriter( std::string const &filename );
+
+    ///
+    /// \brief PcapFileWriter Create or truncate the file
+    ///
+    /// Throws std::runtime_error if the file can not be created
+    ///
+    PcapFileWriter( std::string const &filename, Settings const &settings );
+
+    ///
+    /// \brief ~PcapFileWriter Write what is buffered and stop the flush thread
+    ///
     virtual ~PcapFileWriter();
 
+    ///
+    /// \brief AddInterface Describe another capture interface
+    ///
+    /// Interface 0 is an Ethernet interface and always exists. A pcap
+    /// file has only that one and this returns 0. When no buffer is
+    /// left for the interface block it is counted as dropped, the
+    /// interface is not added and this returns 0 too.
+    ///
+    /// \param name The interface name recorded in pcapng files
+    /// \param link_type The data link type, 1 for Ethernet
+    /// \return The interface number for WritePacketParts()
+    ///
+    uint32_t AddInterface( std::string const &name, uint16_t link_type = 1 );
+
     void WritePacket( PcapFilePacket const &packet );
     void WritePacket( uint64_t time_in_micros, PcapFilePacket const &packet );
     void WritePacket( uint8_t const da[6], uint8_t const sa[6], uint16_t ethertype, PcapFilePacket const &packet_payload );
@@ -48,9 +149,111 @@ class PcapFileWriter
                       uint16_t ethertype,
                       PcapFilePacket const &packet_payload );
 
+    ///
+    /// \brief WritePacketParts Write one packet made of several parts, without copying them first
+    /// \param time_in_nanoseconds The packet time since the epoch
+    /// \param interface_id The interface from AddInterface(), or 0
+    /// \param parts The parts of the packet, in order
+    /// \param lengths The length of each part
+    /// \param count The number of parts
+    /// \return false if the packet was dropped because every buffer is waiting for the disk
+    ///
+    bool WritePacketParts( uint64_t time_in_nanoseconds,
+                           uint32_t interface_id,
+                           uint8_t const *const *parts,
+                           size_t const *lengths,
+                           size_t count );
+
+    ///
+    /// \brief Flush Write what is buffered, or with m_async hand it to the flush thread
+    ///
+    void Flush();
+
+    ///
+    /// \brief Rotate Start the next file now
+    ///
+    void Rotate();
+
+    uint64_t GetPacketCount() const { return m_packet_count; }
+
+    uint64_t GetDroppedCount() const { return m_dropped_count; }
+
+    uint32_t GetFileNumber() const { return m_file_number; }
+
+    std::string GetFileName( uint32_t file_number ) const;
+
   private:
-    PcapFile m_file;
+    PcapFileWriter( PcapFileWriter const & );
+    PcapFileWriter &operator=( PcapFileWriter const & );
+
+    /// A buffer of formatted records on its way to the file
+    struct Buffer
+    {
+        Buffer() : m_length( 0 ), m_new_file( false ), m_file_number( 0 ) {}
+
+        std::vector<uint8_t> m_data;
+        size_t m_length;
+
+        /// Open file m_file_number before writing the buffer
+        bool m_new_file;
+        uint32_t m_file_number;
+    };
+
+    struct Interface
+    {
+        std::string m_name;
+        uint16_t m_link_type;
+    };
+
+    void init( bool append );
+    bool startFile();
+    void putFileHeader();
+    void putInterfaceBlock( Interface const &interface );
+    void put( void const *data, size_t length );
+    void put16( uint16_t v ) { put( &v, sizeof( v ) ); }
+    void put32( uint32_t v ) { put( &v, sizeof( v ) ); }
+
+    /// Make m_current a buffer with room for length more octets, false if there is none
+    bool reserve( size_t length, bool wait );
+
+    /// Send m_current to the file and take the next free buffer, if any
+    void handOff();
+
+    /// Write a buffer to the file, from the flush thread when m_async is set
+    void output( Buffer *buffer );
+    void checkFailed();
+
     std::string m_filename;
+    Settings m_settings;
+    std::vector<Interface> m_interfaces;
+    PcapFile *m_file;
+
+    std::vector<Buffer> m_buffers;
+
+    /// The buffer being filled, 0 when every buffer is waiting for the disk
+    Buffer *m_current;
+
+    uint32_t m_file_number;
+    uint64_t m_file_length;
+    uint64_t m_file_first_time_in_microseconds;
+    bool m_file_has_packets;
+    uint64_t m_buffer_first_time_in_microseconds;
+    bool m_buffer_has_packets;
+    uint64_t m_packet_count;
+    uint64_t m_dropped_count;
+
+#if JDKSAVDECCMCU_ENABLE_THREADS
+    void threadMain();
+
+    SpscQueue<Buffer *> *m_full;
+    SpscQueue<Buffer *> *m_free;
+    std::thread m_thread;
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_failed;
+    std::string m_failure;
+#endif
 };
 }
 #endif
@@ -0,0 +1,140 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/PcapFile.hpp"
+#include "JDKSAvdeccMCU/Frame.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1 && JDKSAVDECCMCU_ENABLE_MMAP == 1
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The PcapMappedReader class
+///
+/// Reads a pcap or pcapng capture through a memory mapping of the whole
+/// file. The constructor indexes every packet in one sequential pass,
+/// after that any packet is found in constant time and read without
+/// copying it. Timestamps are in microseconds after the first packet, the
+/// same as PcapFileReader.
+///
+/// The mapping is copy on write, so a handler may change a Frame in place
+/// without changing the file.
+///
+/// pcapng Enhanced Packet Blocks and the older Packet Blocks are indexed,
+/// in any number of sections and interfaces. Simple Packet Blocks have no
+/// timestamp and are skipped.
+///
+class PcapMappedReader
+{
+  public:
+    enum Format
+    {
+        FORMAT_PCAP,
+        FORMAT_PCAPNG
+    };
+
+    /// Map and index the file. Throws std::runtime_error if the file can
+    /// not be mapped or is not a pcap or pcapng file
+    PcapMappedReader( std::string const &filename );
+
+    virtual ~PcapMappedReader();
+
+    Format getFormat() const { return m_format; }
+
+    /// Count of packets in the file
+    size_t getPacketCount() const { return m_index.size(); }
+
+    /// Absolute time of the first packet in microseconds since the epoch
+    uint64_t getFirstTimestamp() const { return m_first_timestamp_in_microseconds; }
+
+    /// Time of a packet in microseconds after the first packet
+    uint64_t getTimestamp( size_t packet_number ) const;
+
+    /// Data link type of a packet, 1 for Ethernet
+    uint16_t getLinkType( size_t packet_number ) const;
+
+    /// Get a pointer to a packet's captured octets in the mapping
+    uint8_t *getPacket( size_t packet_number, uint32_t *captured_length ) const;
+
+    /// Get a Frame viewing a packet in the mapping, with its time in
+    /// milliseconds after the first packet. Packets longer than a Frame
+    /// can hold are cut short
+    Frame getFrame( size_t packet_number ) const;
+
+    /// Number of the packet that readPacket() reads next
+    size_t getPosition() const { return m_position; }
+
+    /// Make readPacket() read packet_number next
+    void seekToPacket( size_t packet_number ) { m_position = std::min( packet_number, m_index.size() ); }
+
+    /// Make readPacket() read the first packet at or after
+    /// timestamp_in_microseconds after the first packet next, and return
+    /// its number. Captures are expected to be in time order
+    size_t seekToTime( uint64_t timestamp_in_microseconds );
+
+    /// Read the next packet without copying it. Returns false at the end
+    bool readPacket( uint64_t *timestamp_in_microseconds, uint8_t **data, uint32_t *captured_length );
+
+  private:
+    struct Interface
+    {
+        uint16_t m_link_type;
+        bool m_swap;
+        uint64_t m_ticks_per_second;
+    };
+
+    /// Index entries hold the offset of the record in the low 48 bits and
+    /// the interface number in the high 16 bits
+    static uint64_t const offset_mask = 0xffffffffffffULL;
+
+    void indexPcap();
+    void indexPcapng();
+    void addPacket( uint64_t offset, size_t interface_number );
+
+    uint64_t getRecord( size_t packet_number, Interface const **interface, uint32_t *captured_length ) const;
+    uint64_t getTicks( size_t packet_number ) const;
+    uint64_t ticksToMicroseconds( uint64_t ticks, Interface const &interface ) const;
+
+    std::string m_filename;
+    uint8_t *m_data;
+    size_t m_length;
+    Format m_format;
+    std::vector<Interface> m_interfaces;
+    std::vector<uint64_t> m_index;
+    uint64_t m_first_timestamp_in_microseconds;
+    size_t m_position;
+};
+}
+
+#endif
@@ -0,0 +1,122 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The PersistentStorage class
+///
+/// Byte addressed non-volatile storage, such as an EEPROM or a file
+///
+class PersistentStorage
+{
+  public:
+    virtual ~PersistentStorage() {}
+
+    ///
+    /// \brief getSize
+    /// \return The number of bytes that can be stored
+    ///
+    virtual uint32_t getSize() const = 0;
+
+    ///
+    /// \brief read Read bytes from storage
+    /// \param offset The byte offset in the storage
+    /// \param buf The destination buffer
+    /// \param len The number of bytes to read
+    /// \return false if the range is outside of the storage
+    ///
+    virtual bool read( uint32_t offset, uint8_t *buf, uint16_t len ) = 0;
+
+    ///
+    /// \brief write Write bytes to storage
+    ///
+    /// Implementations only need to guarantee that the bytes are stored after
+    /// flush() returns
+    ///
+    /// \param offset The byte offset in the storage
+    /// \param buf The source buffer
+    /// \param len The number of bytes to write
+    /// \return false if the range is outside of the storage
+    ///
+    virtual bool write( uint32_t offset, uint8_t const *buf, uint16_t len ) = 0;
+
+    ///
+    /// \brief flush Commit all written bytes
+    ///
+    virtual bool flush() { return true; }
+
+    ///
+    /// \brief crc8 The CRC-8 that guards records kept in storage
+    ///
+    /// Polynomial x^8 + x^2 + x + 1, initial value 0xff
+    ///
+    /// \param p The bytes to check
+    /// \param len The number of bytes
+    /// \return The CRC
+    ///
+    static uint8_t crc8( uint8_t const *p, uint16_t len );
+};
+
+#if JDKSAVDECCMCU_ENABLE_STRING
+
+///
+/// \brief The PersistentStorageFile class
+///
+/// PersistentStorage of a fixed size in a file. Bytes past the end of an
+/// existing file read as zero.
+///
+class PersistentStorageFile : public PersistentStorage
+{
+  public:
+    PersistentStorageFile( std::string const &filename, uint32_t size );
+
+    virtual ~PersistentStorageFile();
+
+    virtual uint32_t getSize() const override { return m_size; }
+
+    virtual bool read( uint32_t offset, uint8_t *buf, uint16_t len ) override;
+
+    virtual bool write( uint32_t offset, uint8_t const *buf, uint16_t len ) override;
+
+    virtual bool flush() override;
+
+  private:
+    FILE *m_f;
+    std::string m_filename;
+    uint32_t m_size;
+};
+#endif
+}
@@ -81,6 +81,12 @@
 #ifndef JDKSAVDECCMCU_ENABLE_HTTP
 #define JDKSAVDECCMCU_ENABLE_HTTP 1
 #endif
+#ifndef JDKSAVDECCMCU_ENABLE_MMAP
+#define JDKSAVDECCMCU_ENABLE_MMAP 1
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_METRICS
+#define JDKSAVDECCMCU_ENABLE_METRICS 1
+#endif
 
 #if JDKSAVDECCMCU_ENABLE_PCAP
 #define JDKSAVDECCMCU_ENABLE_RAWSOCKETMACOSX 1
@@ -87,6 +87,12 @@
 #ifndef JDKSAVDECCMCU_ENABLE_RAWSOCKETLIBUV
 #define JDKSAVDECCMCU_ENABLE_RAWSOCKETLIBUV 0
 #endif
+#ifndef JDKSAVDECCMCU_ENABLE_METRICS
+#define JDKSAVDECCMCU_ENABLE_METRICS 0
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_TRACE
+#define JDKSAVDECCMCU_ENABLE_TRACE 0
+#endif
 
 #if JDKSAVDECCMCU_ENABLE_STDIO
 #include <stdio.h>
@@ -72,6 +72,25 @@
 #ifndef JDKSAVDECCMCU_ENABLE_HTTP
 #define JDKSAVDECCMCU_ENABLE_HTTP 1
 #endif
+#ifndef JDKSAVDECCMCU_ENABLE_EPOLL
+#define JDKSAVDECCMCU_ENABLE_EPOLL 1
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_MMAP
+#define JDKSAVDECCMCU_ENABLE_MMAP 1
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_METRICS
+#define JDKSAVDECCMCU_ENABLE_METRICS 1
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_THREADS
+#if __cplusplus >= 201103L
+#define JDKSAVDECCMCU_ENABLE_THREADS 1
+#else
+#define JDKSAVDECCMCU_ENABLE_THREADS 0
+#endif
+#endif
+#ifndef JDKSAVDECCMCU_ENABLE_TRACE
+#define JDKSAVDECCMCU_ENABLE_TRACE JDKSAVDECCMCU_ENABLE_THREADS
+#endif
 
 #include <sys/time.h>
 #include <sys/types.h>
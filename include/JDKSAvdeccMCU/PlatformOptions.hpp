@@ -49,4 +49,11 @@
 #define JDKSAVDECCMCU_ENABLE_MDNSREGISTER 0
 #define JDKSAVDECCMCU_ENABLE_HTTP 0
 #define JDKSAVDECCMCU_ENABLE_RAWSOCKETLIBUV 0
+#define JDKSAVDECCMCU_ENABLE_EPOLL 0
+#define JDKSAVDECCMCU_ENABLE_THREADS 0
+#define JDKSAVDECCMCU_ENABLE_MMAP 0
+#define JDKSAVDECCMCU_ENABLE_METRICS 0
+#define JDKSAVDECCMCU_METRICS_LATENCY_SAMPLE_INTERVAL 16
+#define JDKSAVDECCMCU_ENABLE_TRACE 0
+#define JDKSAVDECCMCU_TRACE_BUFFER_EVENTS 4096
 #endif
@@ -74,6 +74,9 @@
 #ifndef JDKSAVDECCMCU_ENABLE_HTTP
 #define JDKSAVDECCMCU_ENABLE_HTTP 1
 #endif
+#ifndef JDKSAVDECCMCU_ENABLE_METRICS
+#define JDKSAVDECCMCU_ENABLE_METRICS 1
+#endif
 
 #include <WS2tcpip.h>
 #include <winsock2.h>
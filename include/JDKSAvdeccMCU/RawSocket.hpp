@@ -32,6 +32,7 @@
 
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/Frame.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
 
 #define JDKSAVDECCMCU_RAWSOCKET_MIN_PAYLOAD_LENGTH ( 64 )
 #define JDKSAVDECCMCU_RAWSOCKET_MIN_FRAME_LENGTH ( JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECCMCU_RAWSOCKET_MIN_PAYLOAD_LENGTH )
@@ -43,7 +44,13 @@ class HandlerGroup;
 class RawSocket
 {
   public:
-    RawSocket() {}
+    RawSocket()
+    {
+#if JDKSAVDECCMCU_ENABLE_METRICS
+        m_tx_frame_count = 0;
+        m_tx_octet_count = 0;
+#endif
+    }
 
     virtual ~RawSocket() {}
 
@@ -70,5 +77,38 @@ class RawSocket
      * Get the MAC address of the ethernet port
      */
     virtual Eui48 const &getMACAddress() const = 0;
+
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    /**
+     * Get the count of frames sent
+     */
+    uint64_t getTxFrameCount() const { return m_tx_frame_count; }
+
+    /**
+     * Get the count of octets sent, without padding
+     */
+    uint64_t getTxOctetCount() const { return m_tx_octet_count; }
+#endif
+
+  protected:
+    /**
+     * Count and trace a sent frame, implementations call it when
+     * sendFrame() or sendReplyFrame() succeed. da is the destination
+     * when it is not the DA of the frame
+     */
+    void countTxFrame( Frame const &frame, uint16_t len1, uint16_t len2, Eui48 const *da = 0 )
+    {
+#if JDKSAVDECCMCU_ENABLE_METRICS
+        ++m_tx_frame_count;
+        m_tx_octet_count += uint32_t( frame.getLength() ) + len1 + len2;
+#endif
+        Trace::recordFrame( TRACE_FRAME_TX, this, frame, uint32_t( frame.getLength() ) + len1 + len2, da );
+    }
+
+#if JDKSAVDECCMCU_ENABLE_METRICS
+  private:
+    uint64_t m_tx_frame_count;
+    uint64_t m_tx_octet_count;
+#endif
 };
 }
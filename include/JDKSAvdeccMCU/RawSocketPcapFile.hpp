@@ -29,22 +29,48 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/RawSocket.hpp"
 #include "JDKSAvdeccMCU/PcapFileReader.hpp"
+#include "JDKSAvdeccMCU/PcapMappedReader.hpp"
 #include "JDKSAvdeccMCU/PcapFileWriter.hpp"
 
 #if JDKSAVDECCMCU_ENABLE_RAWSOCKETPCAPFILE && JDKSAVDECCMCU_ENABLE_PCAPFILE
 namespace JDKSAvdeccMCU
 {
+
+///
+/// \brief The RawSocketPcapFile class
+///
+/// Reads the frames of the input capture as if they were received and
+/// writes the frames that are sent to the output capture.
+///
+/// Polled with recvFrame(), every getTimeInMilliseconds() call
+/// advances the clock by the time granularity. replay() instead runs
+/// the HandlerGroup as fast as possible: the clock jumps straight to the
+/// next frame or to the next tick time of the HandlerGroup.
+///
+/// Where JDKSAVDECCMCU_ENABLE_MMAP is set the input is read with a
+/// PcapMappedReader, so it may also be a pcapng file. Either way the
+/// clock starts at the time of the first frame of the input, in
+/// milliseconds since the epoch.
+///
 class RawSocketPcapFile : public RawSocket
 {
     uint16_t m_ethertype;
     Eui48 m_my_mac;
     Eui48 m_default_dest_mac;
     Eui48 m_join_multicast;
+#if JDKSAVDECCMCU_ENABLE_MMAP
+    /// 0 when the input file does not exist or is shorter than a pcap header
+    PcapMappedReader *m_pcap_file_reader;
+#else
     PcapFileReader m_pcap_file_reader;
+#endif
     PcapFileWriter m_pcap_file_writer;
     mutable jdksavdecc_timestamp_in_milliseconds m_current_time;
     jdksavdecc_timestamp_in_milliseconds m_time_granularity_in_ms;
     FrameWithSize<1500> m_next_incoming_frame;
+    PcapFilePacket m_next_incoming_packet;
+    bool m_event_driven;
+    uint64_t m_replayed_count;
 
     RawSocketPcapFile( RawSocketPcapFile const &other );
 
@@ -77,8 +103,36 @@ class RawSocketPcapFile : public RawSocket
 
     virtual const Eui48 &getMACAddress() const override;
 
+    ///
+    /// \brief replayStep Run the HandlerGroup at the current time, then move the clock to the next event
+    ///
+    /// Every frame due at the current time is passed to the HandlerGroup
+    /// before it is ticked. The next event is the next frame or the
+    /// HandlerGroup's nextTickTime(), whichever comes first.
+    ///
+    /// \param end_time Stop before the clock passes this time. With the
+    /// default, stop after the last frame of the input
+    /// \return false when the replay is over
+    ///
+    bool replayStep( jdksavdecc_timestamp_in_milliseconds end_time = ~jdksavdecc_timestamp_in_milliseconds( 0 ) );
+
+    ///
+    /// \brief replay Run replayStep() until the replay is over
+    /// \param end_time As for replayStep()
+    /// \return The number of frames passed to the HandlerGroup
+    ///
+    uint64_t replay( jdksavdecc_timestamp_in_milliseconds end_time = ~jdksavdecc_timestamp_in_milliseconds( 0 ) );
+
+    uint64_t getReplayedCount() const { return m_replayed_count; }
+
+    /// True while frames of the input are still to be received
+    bool hasPendingFrame() const { return m_next_incoming_frame.getLength() > 0; }
+
   private:
     bool readNextIncomingFrame();
+    bool readPacket( uint64_t *timestamp_in_microseconds, uint8_t const **data, size_t *len );
+    void writeFrame(
+        Eui48 const &da, Frame const &frame, const uint8_t *data1, uint16_t len1, const uint8_t *data2, uint16_t len2 );
     HandlerGroup *m_handler_group;
 };
 }
@@ -0,0 +1,132 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/RawSocket.hpp"
+#include "JDKSAvdeccMCU/VirtualNetwork.hpp"
+
+#include <deque>
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The RawSocketVirtual class
+///
+/// A RawSocket on a port of a VirtualNetwork. Time is the network's
+/// virtual time. With a HandlerGroup set, frames are passed to it
+/// as they are delivered, otherwise they wait for recvFrame().
+///
+class RawSocketVirtual : public RawSocket
+{
+  public:
+    ///
+    /// \brief RawSocketVirtual
+    /// \param network The network to attach to
+    /// \param ethertype The ethertype to send and receive
+    /// \param mac_address The MAC address of the port, unset for one made up by the network
+    /// \param multicast_to_join A multicast address to join, may be 0
+    ///
+    RawSocketVirtual( VirtualNetwork &network,
+                      uint16_t ethertype = JDKSAVDECC_AVTP_ETHERTYPE,
+                      Eui48 const &mac_address = Eui48(),
+                      Eui48 const *multicast_to_join = 0 );
+
+    virtual ~RawSocketVirtual();
+
+    virtual void setHandlerGroup( HandlerGroup *handler_group ) override { m_handler_group = handler_group; }
+
+    HandlerGroup *getHandlerGroup() const { return m_handler_group; }
+
+    virtual jdksavdecc_timestamp_in_milliseconds getTimeInMilliseconds() const override
+    {
+        return m_network.getTimeInMilliseconds();
+    }
+
+    virtual bool recvFrame( Frame *frame ) override;
+
+    ///
+    /// \brief sendFrame
+    ///
+    /// An unset destination address is replaced by the default one,
+    /// the source address and ethertype are replaced by the socket's
+    /// and short frames are padded
+    ///
+    virtual bool sendFrame( Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override;
+
+    ///
+    /// \brief sendReplyFrame Send the frame back to its source address, which is never multicast
+    ///
+    virtual bool sendReplyFrame( Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override;
+
+    virtual bool joinMulticast( const Eui48 &multicast_mac ) override;
+
+    virtual Eui48 const &getMACAddress() const override { return m_mac_address; }
+
+    void setDefaultDestination( Eui48 const &mac ) { m_default_dest_mac_address = mac; }
+
+    uint16_t getEtherType() const { return m_ethertype; }
+
+    VirtualNetwork &getNetwork() { return m_network; }
+
+    uint64_t getSentCount() const { return m_sent_count; }
+
+    uint64_t getReceivedCount() const { return m_received_count; }
+
+  protected:
+    friend class VirtualNetwork;
+
+    bool send( Frame const &frame,
+               Eui48 const &da,
+               uint8_t const *data1,
+               uint16_t len1,
+               uint8_t const *data2,
+               uint16_t len2 );
+
+    VirtualNetwork &m_network;
+    uint16_t m_ethertype;
+    Eui48 m_mac_address;
+    Eui48 m_default_dest_mac_address;
+    HandlerGroup *m_handler_group;
+    uint32_t m_port;
+
+    /// Packets of the network waiting for recvFrame()
+    std::deque<uint32_t> m_queue;
+
+    uint64_t m_sent_count;
+    uint64_t m_received_count;
+
+  private:
+    RawSocketVirtual( RawSocketVirtual const & );
+    RawSocketVirtual &operator=( RawSocketVirtual const & );
+};
+}
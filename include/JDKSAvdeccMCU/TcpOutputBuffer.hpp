@@ -0,0 +1,252 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/ApsSharedMessage.hpp"
+
+#include <deque>
+
+namespace JDKSAvdeccMCU
+{
+
+///
+/// \brief The TcpOutputBuffer class
+///
+/// The pending output of one APS or APC TCP connection.
+///
+/// Shared messages are queued by reference and other octets are
+/// copied, coalescing consecutive small messages into one buffer.
+/// The buffers for copies come from a pool of their own, separate from
+/// the one the shared messages come from, and each TcpOutputBuffer
+/// holds at most m_max_copy_buffers of them, so a stalled connection
+/// can not starve the fan-out or the other connections.
+///
+/// The transport gathers the queue into an iovec style array, writes
+/// as much as the socket takes in one call and then calls consume().
+///
+/// Output is held back until m_coalesce_bytes are queued or the
+/// oldest queued octet has waited m_latency_budget_ms. Crossing
+/// m_high_watermark marks the buffer backpressured until it drains
+/// to m_low_watermark; a buffer that stays backpressured for
+/// m_slow_consumer_timeout_ms belongs to a slow consumer.
+///
+class TcpOutputBuffer
+{
+  public:
+    ///
+    /// \brief The Settings struct
+    ///
+    struct Settings
+    {
+        Settings()
+            : m_coalesce_bytes( 1448 )
+            , m_latency_budget_ms( 0 )
+            , m_high_watermark( 256 * 1024 )
+            , m_low_watermark( 64 * 1024 )
+            , m_slow_consumer_timeout_ms( 5000 )
+            , m_max_copy_buffers( 16 )
+        {
+        }
+
+        /// Flush as soon as this many octets are queued
+        size_t m_coalesce_bytes;
+
+        /// Flush when the oldest queued octet has waited this long, 0 to flush on every opportunity
+        uint32_t m_latency_budget_ms;
+
+        /// Queued octets above which the connection is backpressured
+        size_t m_high_watermark;
+
+        /// Queued octets at or below which the backpressure is released
+        size_t m_low_watermark;
+
+        /// How long a connection may stay backpressured before it is a slow consumer, 0 for forever
+        uint32_t m_slow_consumer_timeout_ms;
+
+        /// The most pool buffers that copied octets may hold at once, 0 for no limit
+        size_t m_max_copy_buffers;
+    };
+
+    ///
+    /// \brief The Segment struct
+    ///
+    /// One contiguous run of queued octets
+    ///
+    struct Segment
+    {
+        uint8_t const *m_data;
+        size_t m_length;
+    };
+
+    ///
+    /// \brief TcpOutputBuffer
+    /// \param pool The pool to take buffers for copied octets from, not the one shared messages come from
+    /// \param settings The coalescing and watermark settings
+    ///
+    TcpOutputBuffer( ApsSharedMessagePool &pool, Settings const &settings = Settings() );
+
+    virtual ~TcpOutputBuffer();
+
+    void setSettings( Settings const &settings ) { m_settings = settings; }
+
+    Settings const &getSettings() const { return m_settings; }
+
+    ///
+    /// \brief clear Release all queued octets, keeping the counters
+    ///
+    void clear();
+
+    ///
+    /// \brief append Copy octets into the queue
+    /// \param data The octets
+    /// \param len The number of octets
+    /// \param now The current time in milliseconds
+    /// \return false if the pool has no buffer for them or m_max_copy_buffers are in use
+    ///
+    bool append( uint8_t const *data, size_t len, jdksavdecc_timestamp_in_milliseconds now );
+
+    ///
+    /// \brief append Queue a reference to a shared message
+    /// \param msg The message, a reference is added
+    /// \param now The current time in milliseconds
+    ///
+    void append( ApsSharedMessage *msg, jdksavdecc_timestamp_in_milliseconds now );
+
+    bool isEmpty() const { return m_entries.empty(); }
+
+    size_t getQueuedBytes() const { return m_queued_bytes; }
+
+    /// \brief getCopyBufferCount the number of pool buffers holding copied octets
+    size_t getCopyBufferCount() const { return m_copy_buffer_count; }
+
+    ///
+    /// \brief shouldFlush
+    /// \param now The current time in milliseconds
+    /// \return true if the coalescing size or the latency budget has been reached
+    ///
+    bool shouldFlush( jdksavdecc_timestamp_in_milliseconds now ) const;
+
+    ///
+    /// \brief getFlushDelay
+    /// \param now The current time in milliseconds
+    /// \return The milliseconds until shouldFlush() becomes true, or -1 if the buffer is empty
+    ///
+    int32_t getFlushDelay( jdksavdecc_timestamp_in_milliseconds now ) const;
+
+    ///
+    /// \brief gather
+    /// \param segments Array to fill in
+    /// \param max_segments Size of the array
+    /// \return The number of segments filled in, oldest first
+    ///
+    size_t gather( Segment *segments, size_t max_segments ) const;
+
+    ///
+    /// \brief consume Remove octets that were written
+    /// \param len The number of octets written
+    /// \param now The current time in milliseconds
+    ///
+    void consume( size_t len, jdksavdecc_timestamp_in_milliseconds now );
+
+    bool isBackpressured() const { return m_backpressured; }
+
+    ///
+    /// \brief isSlowConsumer
+    /// \param now The current time in milliseconds
+    /// \return true if the buffer has been backpressured for longer than m_slow_consumer_timeout_ms
+    ///
+    bool isSlowConsumer( jdksavdecc_timestamp_in_milliseconds now ) const;
+
+    /// \brief getTotalQueuedBytes the number of octets ever queued
+    uint64_t getTotalQueuedBytes() const { return m_total_queued_bytes; }
+
+    /// \brief getTotalWrittenBytes the number of octets ever consumed
+    uint64_t getTotalWrittenBytes() const { return m_total_written_bytes; }
+
+    /// \brief getMaxQueuedBytes the largest number of octets queued at once
+    size_t getMaxQueuedBytes() const { return m_max_queued_bytes; }
+
+    /// \brief getWriteCount the number of consume() calls
+    uint32_t getWriteCount() const { return m_write_count; }
+
+    /// \brief getBackpressureCount the number of times the high watermark was crossed
+    uint32_t getBackpressureCount() const { return m_backpressure_count; }
+
+    /// \brief getCopyFailureCount the number of appends refused for lack of pool buffers or over m_max_copy_buffers
+    uint32_t getCopyFailureCount() const { return m_copy_failure_count; }
+
+    /// \brief getFlushLatencyCount the number of queued messages fully written
+    uint32_t getFlushLatencyCount() const { return m_flush_latency_count; }
+
+    /// \brief getFlushLatencyMax the longest any message waited to be written, in milliseconds
+    uint32_t getFlushLatencyMax() const { return m_flush_latency_max; }
+
+    /// \brief getFlushLatencyAverage the average time messages waited to be written, in milliseconds
+    uint32_t getFlushLatencyAverage() const
+    {
+        return m_flush_latency_count ? uint32_t( m_flush_latency_sum / m_flush_latency_count ) : 0;
+    }
+
+  protected:
+    struct Entry
+    {
+        ApsSharedMessage *m_msg;
+        uint16_t m_offset;
+        bool m_private;
+        jdksavdecc_timestamp_in_milliseconds m_queued_time;
+    };
+
+    void updateBackpressure( jdksavdecc_timestamp_in_milliseconds now );
+
+    ApsSharedMessagePool &m_pool;
+    Settings m_settings;
+    std::deque<Entry> m_entries;
+    size_t m_queued_bytes;
+    size_t m_copy_buffer_count;
+    bool m_backpressured;
+    jdksavdecc_timestamp_in_milliseconds m_backpressured_since;
+
+    uint64_t m_total_queued_bytes;
+    uint64_t m_total_written_bytes;
+    size_t m_max_queued_bytes;
+    uint32_t m_write_count;
+    uint32_t m_backpressure_count;
+    uint32_t m_copy_failure_count;
+    uint32_t m_flush_latency_count;
+    uint32_t m_flush_latency_max;
+    uint64_t m_flush_latency_sum;
+
+  private:
+    TcpOutputBuffer( TcpOutputBuffer const & );
+    TcpOutputBuffer const &operator=( TcpOutputBuffer const & );
+};
+}
@@ -0,0 +1,214 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+class TimerWheel;
+
+///
+/// \brief The Timer class
+///
+/// A timer that can be scheduled in a TimerWheel. The timer is linked
+/// into the wheel itself, so scheduling and cancelling never allocate.
+/// Subclasses implement onTimerExpired().
+///
+class Timer
+{
+  public:
+    Timer() : m_wheel( 0 ), m_next( 0 ), m_pprev( 0 ), m_expiry( 0 ), m_serial( 0 ) {}
+
+    ///
+    /// \brief ~Timer Cancels the timer if it is scheduled
+    ///
+    virtual ~Timer();
+
+    ///
+    /// \brief onTimerExpired
+    ///
+    /// Called by TimerWheel::advance() once the expiry time has passed.
+    /// The timer is no longer scheduled and may be scheduled again.
+    ///
+    /// \param now The time in milliseconds given to TimerWheel::advance()
+    ///
+    virtual void onTimerExpired( jdksavdecc_timestamp_in_milliseconds now ) = 0;
+
+    bool isScheduled() const { return m_wheel != 0; }
+
+    jdksavdecc_timestamp_in_milliseconds getExpiry() const { return m_expiry; }
+
+    ///
+    /// \brief cancel Remove the timer from its wheel, if any
+    ///
+    void cancel();
+
+  private:
+    friend class TimerWheel;
+
+    TimerWheel *m_wheel;
+    Timer *m_next;
+    Timer **m_pprev;
+    jdksavdecc_timestamp_in_milliseconds m_expiry;
+    uint32_t m_serial;
+
+    Timer( Timer const & );
+    Timer const &operator=( Timer const & );
+};
+
+///
+/// \brief The TimerWheel class
+///
+/// A hashed timing wheel. Time is divided into ticks of
+/// resolution_ms and each timer is kept in the slot of the tick that
+/// it expires in, modulo the slot count. Scheduling and cancelling
+/// are O(1). advance() visits only the slots of the ticks that passed
+/// and of the current tick, so timers that are far in the future cost
+/// one check per revolution of the wheel and nothing else.
+///
+class TimerWheel
+{
+  public:
+    ///
+    /// \brief TimerWheel
+    /// \param slots Storage for slot_count slot pointers
+    /// \param slot_count The number of slots
+    /// \param resolution_ms The length of one tick in milliseconds
+    ///
+    TimerWheel( Timer **slots, uint16_t slot_count, uint32_t resolution_ms = 1 );
+
+    ///
+    /// \brief ~TimerWheel Cancels all timers
+    ///
+    virtual ~TimerWheel();
+
+    ///
+    /// \brief schedule
+    ///
+    /// Schedule the timer, rescheduling it if it is already scheduled.
+    /// A timer with an expiry time that has passed fires on the next
+    /// advance()
+    ///
+    /// \param timer The timer
+    /// \param expiry The time in milliseconds
+    ///
+    void schedule( Timer *timer, jdksavdecc_timestamp_in_milliseconds expiry );
+
+    ///
+    /// \brief scheduleIn
+    /// \param timer The timer
+    /// \param delay_ms The delay from the time of the last advance(), in milliseconds
+    ///
+    void scheduleIn( Timer *timer, uint32_t delay_ms ) { schedule( timer, m_now + delay_ms ); }
+
+    ///
+    /// \brief cancel
+    /// \param timer The timer to remove from the wheel
+    ///
+    void cancel( Timer *timer );
+
+    ///
+    /// \brief cancelAll Remove every timer from the wheel
+    ///
+    void cancelAll();
+
+    ///
+    /// \brief advance
+    ///
+    /// Move the wheel to the current time and call onTimerExpired()
+    /// for every timer whose expiry time has passed. Timers that are
+    /// scheduled by the callbacks expire on a later advance() at the
+    /// earliest.
+    ///
+    /// \param now The current time in milliseconds
+    /// \return The number of timers that expired
+    ///
+    uint32_t advance( jdksavdecc_timestamp_in_milliseconds now );
+
+    ///
+    /// \brief getNextDelay
+    ///
+    /// The time until advance() has work to do. Only one revolution
+    /// of the wheel is searched; if no timer is due within it, the
+    /// time until the end of the revolution is returned, which is
+    /// soon enough to advance the wheel without missing anything.
+    ///
+    /// \param now The current time in milliseconds
+    /// \return The delay in milliseconds, 0 if a timer is due, or -1 if no timers are scheduled
+    ///
+    int32_t getNextDelay( jdksavdecc_timestamp_in_milliseconds now ) const;
+
+    ///
+    /// \brief getNow
+    /// \return The time given to the last advance()
+    ///
+    jdksavdecc_timestamp_in_milliseconds getNow() const { return m_now; }
+
+    size_t getCount() const { return m_count; }
+
+    uint32_t getResolution() const { return m_resolution; }
+
+  protected:
+    uint16_t getSlot( uint64_t tick ) const { return uint16_t( tick % m_slot_count ); }
+
+    void link( Timer *timer );
+
+    void unlink( Timer *timer );
+
+    Timer **m_slots;
+    uint16_t m_slot_count;
+    uint32_t m_resolution;
+    jdksavdecc_timestamp_in_milliseconds m_now;
+
+    /// The last tick that had fully passed at the last advance(), the slot of the next one is visited every time
+    uint64_t m_tick;
+    size_t m_count;
+
+    /// Incremented for every schedule(), so advance() can tell new timers from old ones
+    uint32_t m_serial;
+
+  private:
+    TimerWheel( TimerWheel const & );
+    TimerWheel const &operator=( TimerWheel const & );
+};
+
+template <uint16_t SlotCount, uint32_t ResolutionMs = 1>
+class TimerWheelWithSize : public TimerWheel
+{
+  public:
+    TimerWheelWithSize() : TimerWheel( m_slots_storage, SlotCount, ResolutionMs ) {}
+
+  protected:
+    Timer *m_slots_storage[SlotCount];
+};
+}
@@ -0,0 +1,388 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_TRACE
+#include <atomic>
+#include <chrono>
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <intrin.h>
+#endif
+#endif
+
+/// The number of events that each thread keeps, a power of two. An
+/// event takes 40 bytes
+#ifndef JDKSAVDECCMCU_TRACE_BUFFER_EVENTS
+#define JDKSAVDECCMCU_TRACE_BUFFER_EVENTS 4096
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+class Frame;
+class RawSocket;
+
+///
+/// \brief The TraceEventType enum
+///
+/// What a trace event records. The m_source, m_id, m_arg and m_value
+/// fields of each type are:
+///
+/// FRAME_RX, FRAME_TX: socket MAC, peer MAC (SA or DA), ethertype,
+///     length | octet 14 << 16 | octet 15 << 24
+/// AEM_COMMAND_ACCEPTED, AEM_COMMAND_REJECTED: entity_id,
+///     controller_entity_id, command_type, status | sequence_id << 16
+/// ENTITY_*: entity_id, controller_entity_id, 0, AEM status or 0
+/// ACMP_LISTENER_STATE: listener entity_id, talker entity_id,
+///     listener_unique_id, old state | new state << 8 | connected << 16
+/// ACMP_TALKER_STATE: talker entity_id, listener entity_id,
+///     talker_unique_id, state | status << 8 | message_type << 16
+/// ACMP_CONTROLLER_STATE: controller entity_id, listener entity_id,
+///     listener_unique_id, state | status << 8 | message_type << 16 | retries << 24
+/// APS_STATE, APC_STATE: the state machine, entity_id, the new
+///     TraceApsState or TraceApcState, 0
+///
+enum TraceEventType
+{
+    TRACE_NONE,
+    TRACE_FRAME_RX,
+    TRACE_FRAME_TX,
+    TRACE_AEM_COMMAND_ACCEPTED,
+    TRACE_AEM_COMMAND_REJECTED,
+    TRACE_ENTITY_ACQUIRED,
+    TRACE_ENTITY_RELEASED,
+    TRACE_ENTITY_ACQUIRE_IN_PROGRESS,
+    TRACE_ENTITY_ACQUIRE_TRANSFERRED,
+    TRACE_ENTITY_ACQUIRE_CANCELLED,
+    TRACE_ENTITY_LOCK_TIMED_OUT,
+    TRACE_ACMP_LISTENER_STATE,
+    TRACE_ACMP_TALKER_STATE,
+    TRACE_ACMP_CONTROLLER_STATE,
+    TRACE_APS_STATE,
+    TRACE_APC_STATE,
+    TRACE_EVENT_TYPE_COUNT
+};
+
+///
+/// \brief The TraceApsState enum
+///
+/// The states of Figure C.2 that ApsStates goes to
+///
+enum TraceApsState
+{
+    TRACE_APS_INITIALIZE,
+    TRACE_APS_WAIT_FOR_CONNECT,
+    TRACE_APS_ACCEPT,
+    TRACE_APS_REJECT,
+    TRACE_APS_CLOSED,
+    TRACE_APS_START_TRANSFER,
+    TRACE_APS_WAITING,
+    TRACE_APS_LINK_STATUS,
+    TRACE_APS_TRANSFER_TO_L2,
+    TRACE_APS_TRANSFER_TO_APC,
+    TRACE_APS_ASSIGN_ENTITY_ID,
+    TRACE_APS_SEND_NOP,
+    TRACE_APS_CLOSE_AND_FINISH,
+    TRACE_APS_FINISH,
+    TRACE_APS_STATE_COUNT
+};
+
+///
+/// \brief The TraceApcState enum
+///
+/// The states of Figure C.3 that ApcStates goes to
+///
+enum TraceApcState
+{
+    TRACE_APC_INITIALIZE,
+    TRACE_APC_WAIT_FOR_CONNECT,
+    TRACE_APC_CONNECTED,
+    TRACE_APC_START_TRANSFER,
+    TRACE_APC_WAITING,
+    TRACE_APC_CLOSED,
+    TRACE_APC_LINK_STATUS,
+    TRACE_APC_RECEIVE_MSG,
+    TRACE_APC_SEND_MSG,
+    TRACE_APC_ENTITY_ID_ASSIGNED,
+    TRACE_APC_SEND_NOP,
+    TRACE_APC_FINISH,
+    TRACE_APC_STATE_COUNT
+};
+
+#if JDKSAVDECCMCU_ENABLE_TRACE
+
+/// The name of a TraceEventType without the TRACE_ prefix, or 0
+char const *getTraceEventTypeName( uint16_t type );
+
+/// The name of a TraceApsState without the TRACE_APS_ prefix, or 0
+char const *getTraceApsStateName( uint16_t state );
+
+/// The name of a TraceApcState without the TRACE_APC_ prefix, or 0
+char const *getTraceApcStateName( uint16_t state );
+
+///
+/// \brief The TraceEvent struct
+///
+/// One event as it is in a trace file
+///
+struct TraceEvent
+{
+    /// The number of the event in the buffer of its thread, starting at 0
+    uint64_t m_sequence;
+
+    /// Trace::getTicks() when the event was recorded, when the frame that
+    /// it was recorded for was received or when its loop iteration began
+    uint64_t m_time;
+
+    uint64_t m_source;
+    uint64_t m_id;
+    uint32_t m_value;
+    uint16_t m_type;
+    uint16_t m_arg;
+};
+
+///
+/// \brief The TraceThreadEvents struct
+///
+/// The events of one thread buffer in the order they were recorded
+///
+struct TraceThreadEvents
+{
+    /// The buffer, a buffer is reused by a new thread after its thread exits
+    uint32_t m_buffer_index;
+
+    /// The events recorded in the buffer that were overwritten before
+    /// or while they were read
+    uint64_t m_lost;
+
+    std::vector<TraceEvent> m_events;
+};
+
+///
+/// \brief The TraceDump struct
+///
+/// The events of all threads and the pairs of ticks and wall clock
+/// times that convert their timestamps.
+///
+/// A trace file is a header of the magic "JDKSTRC1", the version and
+/// the size of an event as uint32_t, the start and end ticks and
+/// nanoseconds as uint64_t and the thread count and a reserved word
+/// as uint32_t. Each thread follows with its buffer index and a
+/// reserved word as uint32_t, its lost and event counts as uint64_t
+/// and its TraceEvent records. The words are in the byte order of the
+/// machine that wrote the file.
+///
+struct TraceDump
+{
+    enum
+    {
+        file_version = 1
+    };
+
+    TraceDump() : m_start_ticks( 0 ), m_start_ns( 0 ), m_end_ticks( 0 ), m_end_ns( 0 ) {}
+
+    /// Convert Trace::getTicks() to nanoseconds since the epoch
+    uint64_t getNanoseconds( uint64_t ticks ) const;
+
+    /// The count of events of all threads
+    uint64_t getEventCount() const;
+
+    /// Write the trace file, throws std::runtime_error
+    void write( std::string const &filename ) const;
+
+    /// Read a trace file, throws std::runtime_error
+    void read( std::string const &filename );
+
+    uint64_t m_start_ticks;
+    uint64_t m_start_ns;
+    uint64_t m_end_ticks;
+    uint64_t m_end_ns;
+    std::vector<TraceThreadEvents> m_threads;
+};
+
+///
+/// \brief The Trace class
+///
+/// Records events in a ring of JDKSAVDECCMCU_TRACE_BUFFER_EVENTS
+/// events per thread. The recording thread is the only writer of its
+/// buffer and overwrites the oldest events, it never waits or
+/// allocates after its first event. snapshot() copies the buffers
+/// from any thread and skips the events that are overwritten while it
+/// reads them.
+///
+/// The timestamps are the time stamp counter on x86 and the steady
+/// clock in nanoseconds elsewhere, a TraceDump converts them. The
+/// events that a thread records between beginFrame() and endFrame()
+/// share the timestamp of the received frame, and the events between
+/// beginLoop() and endLoop() share the time that the iteration of the
+/// event loop began, so that they read the clock once.
+///
+class Trace
+{
+  public:
+    static bool isEnabled() { return m_enabled.load( std::memory_order_relaxed ); }
+
+    ///
+    /// Recording is enabled from the start so that the events before a
+    /// problem are there when it is looked at. A disabled Trace only
+    /// tests a flag for each event, about 0.5 ns.
+    ///
+    /// An event that shares the timestamp of its frame or loop iteration
+    /// costs a few ns, an event outside of them also reads the clock,
+    /// which is about 7 ns on bare x86 hardware and 20 ns or more in a
+    /// virtual machine that traps the time stamp counter
+    ///
+    static void setEnabled( bool enabled ) { m_enabled.store( enabled, std::memory_order_relaxed ); }
+
+    static uint64_t getTicks()
+    {
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+        return __builtin_ia32_rdtsc();
+#elif defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+        return __rdtsc();
+#else
+        return uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() )
+                .count() );
+#endif
+    }
+
+    static void record( TraceEventType type, uint16_t arg, uint64_t source, uint64_t id, uint32_t value )
+    {
+        if ( isEnabled() )
+        {
+            recordEvent( type, arg, source, id, value );
+        }
+    }
+
+    /// Record a FRAME_RX or FRAME_TX of length octets, the socket may be 0.
+    /// The peer is the SA or DA of the frame unless it is given
+    static void
+        recordFrame( TraceEventType type, RawSocket const *socket, Frame const &frame, uint32_t length, Eui48 const *peer = 0 )
+    {
+        if ( isEnabled() )
+        {
+            recordFrameEvent( type, socket, frame, length, peer );
+        }
+    }
+
+    /// Record the FRAME_RX of a received frame of length octets and keep
+    /// its timestamp for the events of this thread until endFrame()
+    static void beginFrame( RawSocket const *socket, Frame const &frame, uint32_t length )
+    {
+        if ( isEnabled() )
+        {
+            beginFrameEvent( socket, frame, length );
+        }
+    }
+
+    /// The events after this read the clock again, also when recording
+    /// was disabled after beginFrame()
+    static void endFrame();
+
+    /// Read the clock once for the events of this thread until endLoop(),
+    /// called when an iteration of an event loop begins
+    static void beginLoop()
+    {
+        if ( isEnabled() )
+        {
+            beginLoopTime();
+        }
+    }
+
+    /// The events after this read the clock again
+    static void endLoop();
+
+    /// Copy the events of all threads
+    static void snapshot( TraceDump *dump );
+
+    /// Write the events of all threads to a trace file, throws std::runtime_error
+    static void dump( std::string const &filename );
+
+  private:
+    static void recordEvent( TraceEventType type, uint16_t arg, uint64_t source, uint64_t id, uint32_t value );
+
+    static void
+        recordFrameEvent( TraceEventType type, RawSocket const *socket, Frame const &frame, uint32_t length, Eui48 const *peer );
+
+    static void beginFrameEvent( RawSocket const *socket, Frame const &frame, uint32_t length );
+
+    static void beginLoopTime();
+
+    static std::atomic<bool> m_enabled;
+};
+
+#else
+
+class Trace
+{
+  public:
+    static bool isEnabled() { return false; }
+
+    static void setEnabled( bool enabled ) { (void)enabled; }
+
+    static void record( TraceEventType type, uint16_t arg, uint64_t source, uint64_t id, uint32_t value )
+    {
+        (void)type;
+        (void)arg;
+        (void)source;
+        (void)id;
+        (void)value;
+    }
+
+    static void
+        recordFrame( TraceEventType type, RawSocket const *socket, Frame const &frame, uint32_t length, Eui48 const *peer = 0 )
+    {
+        (void)type;
+        (void)socket;
+        (void)frame;
+        (void)length;
+        (void)peer;
+    }
+
+    static void beginFrame( RawSocket const *socket, Frame const &frame, uint32_t length )
+    {
+        (void)socket;
+        (void)frame;
+        (void)length;
+    }
+
+    static void endFrame() {}
+
+    static void beginLoop() {}
+
+    static void endLoop() {}
+};
+
+#endif
+}
@@ -0,0 +1,277 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Frame.hpp"
+
+#include <deque>
+#include <map>
+
+#ifndef JDKSAVDECCMCU_VIRTUALNETWORK_RECV_QUEUE_DEPTH
+///
+/// The number of frames that wait for recvFrame() on a RawSocketVirtual
+/// that has no HandlerGroup
+///
+#define JDKSAVDECCMCU_VIRTUALNETWORK_RECV_QUEUE_DEPTH ( 1024 )
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+class RawSocketVirtual;
+
+///
+/// \brief The VirtualNetwork class
+///
+/// An in-process Ethernet switch for simulating many AVDECC endpoints
+/// without hardware. Each RawSocketVirtual is attached to one port of
+/// the switch and has its own MAC address. Frames go to the port with
+/// the destination MAC address, to every port that joined the multicast
+/// address, or to all ports for broadcast, never back to the sender.
+///
+/// The network runs on its own virtual clock, which only moves when
+/// advance() or tick() is called, so a simulation runs as fast as the
+/// CPU allows and is repeatable for a given seed. A sent frame takes
+/// the serialization time of the sender's link plus the latency and up
+/// to the jitter, and waits in the switch while the receiver's link is
+/// busy with earlier frames. Frames from one sender are never
+/// reordered. A frame that would wait for a link for longer than the
+/// maximum queueing time is dropped, and each delivery is lost with the
+/// configured probability.
+///
+/// Each frame is stored once however many ports it goes to. Ports with
+/// a HandlerGroup get the frame passed to receivedPDU() directly, the
+/// others queue it for recvFrame().
+///
+class VirtualNetwork
+{
+  public:
+    ///
+    /// \brief The Settings struct
+    ///
+    struct Settings
+    {
+        Settings()
+            : m_latency_us( 10 ), m_jitter_us( 0 ), m_loss_ppm( 0 ), m_bandwidth_bps( 1000000000ULL ), m_max_queue_us( 0 )
+        {
+        }
+
+        /// The time from the end of transmission until the frame reaches the receiver's link
+        uint32_t m_latency_us;
+
+        /// Up to this many microseconds are added to the latency at random
+        uint32_t m_jitter_us;
+
+        /// The probability in parts per million that a delivery is lost
+        uint32_t m_loss_ppm;
+
+        /// The bit rate of every link, 0 for unlimited
+        uint64_t m_bandwidth_bps;
+
+        /// The longest time a frame may wait for a busy link before it is dropped, 0 for no limit
+        uint32_t m_max_queue_us;
+    };
+
+    ///
+    /// \brief VirtualNetwork
+    /// \param settings The link settings
+    /// \param seed The seed for jitter and loss
+    ///
+    VirtualNetwork( Settings const &settings = Settings(), uint32_t seed = 1 );
+
+    ///
+    /// \brief ~VirtualNetwork The RawSocketVirtuals must be destroyed first
+    ///
+    virtual ~VirtualNetwork();
+
+    void setSettings( Settings const &settings ) { m_settings = settings; }
+
+    Settings const &getSettings() const { return m_settings; }
+
+    ///
+    /// \brief advance Deliver every frame that is due, in time order, up to the time
+    /// \param time_in_microseconds The new time of the network, never less than the current time
+    ///
+    void advance( uint64_t time_in_microseconds );
+
+    ///
+    /// \brief tick
+    ///
+    /// Advance to the timestamp, then tick the HandlerGroup of every
+    /// port that has one
+    ///
+    /// \param timestamp The new time in milliseconds
+    ///
+    void tick( jdksavdecc_timestamp_in_milliseconds timestamp );
+
+    uint64_t getTimeInMicroseconds() const { return m_now; }
+
+    jdksavdecc_timestamp_in_milliseconds getTimeInMilliseconds() const { return m_now / 1000; }
+
+    ///
+    /// \brief getNextEventTime
+    /// \return The time in microseconds at which the next frame is due, or ~0 if none are in flight
+    ///
+    uint64_t getNextEventTime() const { return m_events.empty() ? ~uint64_t( 0 ) : m_events.front().m_time; }
+
+    size_t getPortCount() const { return m_port_count; }
+
+    uint64_t getSentCount() const { return m_sent_count; }
+
+    uint64_t getDeliveredCount() const { return m_delivered_count; }
+
+    ///
+    /// \brief getLostCount
+    /// \return The number of deliveries lost at random
+    ///
+    uint64_t getLostCount() const { return m_lost_count; }
+
+    ///
+    /// \brief getCongestionDropCount
+    /// \return The number of frames dropped because a link was busy for longer than the maximum queueing time
+    ///
+    uint64_t getCongestionDropCount() const { return m_congestion_drop_count; }
+
+    ///
+    /// \brief getOverflowCount
+    /// \return The number of frames dropped because a port's queue for recvFrame() was full
+    ///
+    uint64_t getOverflowCount() const { return m_overflow_count; }
+
+  protected:
+    friend class RawSocketVirtual;
+
+    enum
+    {
+        NO_PORT = 0xffffffff,
+        MAX_FRAME_SIZE = 1500 + JDKSAVDECC_FRAME_HEADER_LEN,
+
+        /// Preamble, start of frame delimiter, frame check sequence and interframe gap
+        WIRE_OVERHEAD = 24,
+        MIN_WIRE_FRAME = 60
+    };
+
+    struct Packet
+    {
+        uint32_t m_refs;
+        uint32_t m_sender;
+        uint16_t m_length;
+        uint8_t m_data[MAX_FRAME_SIZE];
+    };
+
+    ///
+    /// \brief The Event struct
+    ///
+    /// A packet arriving at its receivers, or the link to one receiver
+    /// being free for the next packet waiting for it
+    ///
+    struct Event
+    {
+        uint64_t m_time;
+        uint64_t m_sequence;
+        uint32_t m_packet;
+        uint32_t m_port;
+
+        /// Ordering for a min heap
+        bool operator<( Event const &other ) const
+        {
+            return m_time > other.m_time || ( m_time == other.m_time && m_sequence > other.m_sequence );
+        }
+    };
+
+    struct Port
+    {
+        RawSocketVirtual *m_socket;
+        uint64_t m_tx_busy_until;
+        uint64_t m_rx_busy_until;
+        uint64_t m_last_arrival;
+
+        /// Packets waiting in the switch for the receiver's link
+        std::deque<uint32_t> m_egress;
+    };
+
+    /// Give the socket a port, and a MAC address if it has none
+    uint32_t attach( RawSocketVirtual *socket );
+
+    void detach( RawSocketVirtual *socket );
+
+    void join( RawSocketVirtual *socket, Eui48 const &multicast_mac );
+
+    ///
+    /// \brief send Copy the frame into the network
+    /// \return false if it was dropped on the sender's link
+    ///
+    bool send( RawSocketVirtual *sender, uint8_t const *data, uint16_t length );
+
+    /// Hand the packet to the ports it is for
+    void dispatch( Event const &event );
+
+    /// Deliver the packet to one port, now or once its link is free
+    void deliverToPort( uint32_t port, uint32_t packet, bool queued );
+
+    /// Deliver the next packet waiting for the port's link
+    void deliverEgress( uint32_t port );
+
+    uint64_t getSerializationTime( uint16_t length ) const;
+
+    uint32_t allocatePacket();
+
+    void releasePacket( uint32_t packet );
+
+    uint32_t random();
+
+    Settings m_settings;
+    uint32_t m_random_state;
+    uint64_t m_now;
+    uint64_t m_sequence;
+
+    std::vector<Port> m_ports;
+    size_t m_port_count;
+    std::map<uint64_t, uint32_t> m_unicast;
+    std::map<uint64_t, std::vector<uint32_t> > m_multicast;
+
+    std::vector<Packet> m_packets;
+    std::vector<uint32_t> m_free_packets;
+
+    /// A min heap of Events
+    std::vector<Event> m_events;
+
+    /// The frame passed to receivedPDU(), handlers may change it
+    FrameWithMTU m_frame;
+
+    uint64_t m_sent_count;
+    uint64_t m_delivered_count;
+    uint64_t m_lost_count;
+    uint64_t m_congestion_drop_count;
+    uint64_t m_overflow_count;
+};
+}
@@ -57,6 +57,7 @@
 #include "jdksavdecc_aem_descriptor.h"
 #include "jdksavdecc_control.h"
 #include "jdksavdecc_aem_print.h"
+#include "jdksavdecc_json_print.h"
 
 #include "jdksavdecc_app.h"
 #include "jdksavdecc_app_print.h"
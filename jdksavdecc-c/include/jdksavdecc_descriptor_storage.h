@@ -34,6 +34,7 @@
 #include "jdksavdecc_world.h"
 #include "jdksavdecc_aem_descriptor.h"
 #include "jdksavdecc_entity_model.h"
+#include "jdksavdecc_aem_command.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -51,6 +52,20 @@ extern "C" {
  *  | 0x0008 |   4   |   toc_offset     | Offset of descriptors table of contents      |
  *  | 0x000c |   4   |   symbol_count   | Count of symbols                             |
  *  | 0x0010 |   4   |   symbol_offset  | Offset of symbol table                       |
+ *  | 0x0014 |   4   |   index_count    | Count of index slots, "AEM2" only            |
+ *  | 0x0018 |   4   |   index_offset   | Offset of descriptor index, "AEM2" only      |
+ *  | 0x001c |   4   |   flags          | Storage layout flags, "AEM2" only            |
+ *
+ *  An "AEM2" storage has the longer header and a minimal perfect hash index
+ *  of its descriptors, see \ref descriptor_storage_index
+ *
+ *  With JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES every descriptor is
+ *  stored as the payload of its READ_DESCRIPTOR response, see
+ *  \ref descriptor_storage_response
+ *
+ *  With JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_TOC_SYMBOLS the symbol table has
+ *  one symbol for each table of contents item, in the same order, so the
+ *  symbol of a descriptor is found with the descriptor itself
  *
  */
 
@@ -60,11 +75,24 @@ extern "C" {
 #define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC_VALUE ( 0x41454d31 )
 #define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH ( 0x0014 )
 
+/// "AEM2", as a network byte order uint32_t: 0x41454d32
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC2_VALUE ( 0x41454d32 )
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER2_LENGTH ( 0x0020 )
+
 #define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC_OFFSET ( 0x0000 )
 #define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_TOC_COUNT_OFFSET ( 0x0004 )
 #define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_TOC_OFFSET_OFFSET ( 0x0008 )
 #define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_SYMBOL_COUNT_OFFSET ( 0x000c )
 #define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_SYMBOL_OFFSET_OFFSET ( 0x0010 )
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_INDEX_COUNT_OFFSET ( 0x0014 )
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_INDEX_OFFSET_OFFSET ( 0x0018 )
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_FLAGS_OFFSET ( 0x001c )
+
+/// Descriptors are stored as READ_DESCRIPTOR response payloads
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES ( 0x00000001 )
+
+/// The symbol table is parallel to the table of contents
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_TOC_SYMBOLS ( 0x00000002 )
 
 struct jdksavdecc_descriptor_storage_header
 {
@@ -73,12 +101,23 @@ struct jdksavdecc_descriptor_storage_header
     uint32_t toc_offset;
     uint32_t symbol_count;
     uint32_t symbol_offset;
+    uint32_t index_count;
+    uint32_t index_offset;
+    uint32_t flags;
 };
 
+/// Length of the header for the magic number
+static inline uint32_t jdksavdecc_descriptor_storage_header_get_length( uint32_t magic )
+{
+    return magic == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC2_VALUE ? JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER2_LENGTH
+                                                                       : JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH;
+}
+
 /**
  * Read the descriptor_storage_header from raw memory
  *
- * Bounds checking of the buffer size is done.
+ * Bounds checking of the buffer size is done. The index and flags fields
+ * are only read for an "AEM2" header and are 0 otherwise.
  *
  * @param p pointer to jdksavdecc_descriptor_storage_header structure to fill in.
  * @param base pointer to raw memory buffer to read from.
@@ -100,6 +139,19 @@ static inline ssize_t jdksavdecc_descriptor_storage_header_read( struct jdksavde
         p->toc_offset = jdksavdecc_uint32_get( base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_TOC_OFFSET_OFFSET );
         p->symbol_count = jdksavdecc_uint32_get( base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_SYMBOL_COUNT_OFFSET );
         p->symbol_offset = jdksavdecc_uint32_get( base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_SYMBOL_OFFSET_OFFSET );
+        p->index_count = 0;
+        p->index_offset = 0;
+        p->flags = 0;
+        if ( p->magic == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC2_VALUE )
+        {
+            r = jdksavdecc_validate_range( pos, len, JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER2_LENGTH );
+            if ( r >= 0 )
+            {
+                p->index_count = jdksavdecc_uint32_get( base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_INDEX_COUNT_OFFSET );
+                p->index_offset = jdksavdecc_uint32_get( base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_INDEX_OFFSET_OFFSET );
+                p->flags = jdksavdecc_uint32_get( base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_FLAGS_OFFSET );
+            }
+        }
     }
     return r;
 }
@@ -121,7 +173,7 @@ static inline ssize_t jdksavdecc_descriptor_storage_header_write( struct jdksavd
                                                                   ssize_t pos,
                                                                   size_t len )
 {
-    ssize_t r = jdksavdecc_validate_range( pos, len, JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH );
+    ssize_t r = jdksavdecc_validate_range( pos, len, jdksavdecc_descriptor_storage_header_get_length( p->magic ) );
     if ( r >= 0 )
     {
         jdksavdecc_uint32_set( p->magic, base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC_OFFSET );
@@ -129,6 +181,12 @@ static inline ssize_t jdksavdecc_descriptor_storage_header_write( struct jdksavd
         jdksavdecc_uint32_set( p->toc_offset, base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_TOC_OFFSET_OFFSET );
         jdksavdecc_uint32_set( p->symbol_count, base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_SYMBOL_COUNT_OFFSET );
         jdksavdecc_uint32_set( p->symbol_offset, base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_SYMBOL_OFFSET_OFFSET );
+        if ( p->magic == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC2_VALUE )
+        {
+            jdksavdecc_uint32_set( p->index_count, base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_INDEX_COUNT_OFFSET );
+            jdksavdecc_uint32_set( p->index_offset, base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_INDEX_OFFSET_OFFSET );
+            jdksavdecc_uint32_set( p->flags, base, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_FLAGS_OFFSET );
+        }
     }
     return r;
 }
@@ -313,6 +371,98 @@ static inline ssize_t jdksavdecc_descriptor_storage_symbol_write( struct jdksavd
 
 /**@}*/
 
+/** \addtogroup descriptor_storage_index Descriptor index
+ *
+ *  A minimal perfect hash of the (configuration_index, descriptor_type,
+ *  descriptor_index) of every item in the table of contents, built with
+ *  hash and displace. A key hashed with seed 0 picks a bucket, the key
+ *  hashed with the bucket's displacement picks a slot, and the slot holds
+ *  the number of the item in the table of contents. A lookup reads one
+ *  displacement, one slot and one item, and compares the item to the key
+ *  since keys that are not in the table also land in some slot.
+ *
+ *  | offset            |  size             |     name        |       Description                    |
+ *  | ----------------- | ----------------- | --------------- | ------------------------------------ |
+ *  | 0x0000            |    4              |  bucket_count   |  Count of buckets                    |
+ *  | 0x0004            |    4*bucket_count |  displacements  |  Slot hash seed for each bucket      |
+ *  | 4+4*bucket_count  |    4*index_count  |  slots          |  Table of contents item of each slot |
+ *
+ *  index_count in the header is the count of slots, which is the same as
+ *  toc_count.
+ */
+/**@{*/
+
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_BUCKET_COUNT_OFFSET ( 0x0000 )
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_DISPLACEMENTS_OFFSET ( 0x0004 )
+
+/// Average number of keys in a bucket that the generator aims for
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_KEYS_PER_BUCKET ( 2 )
+
+/// Count of buckets for an index of toc_count items
+static inline uint32_t jdksavdecc_descriptor_storage_index_get_bucket_count( uint32_t toc_count )
+{
+    return ( toc_count + JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_KEYS_PER_BUCKET - 1 )
+           / JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_KEYS_PER_BUCKET;
+}
+
+/// Length of the index for toc_count items
+static inline uint32_t jdksavdecc_descriptor_storage_index_get_length( uint32_t toc_count )
+{
+    return JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_DISPLACEMENTS_OFFSET
+           + 4 * ( jdksavdecc_descriptor_storage_index_get_bucket_count( toc_count ) + toc_count );
+}
+
+/// Hash a descriptor key with a seed
+static inline uint32_t jdksavdecc_descriptor_storage_index_hash( uint16_t configuration_index,
+                                                                 uint16_t descriptor_type,
+                                                                 uint16_t descriptor_index,
+                                                                 uint32_t seed )
+{
+    uint64_t x = ( ( (uint64_t)configuration_index ) << 32 ) + ( ( (uint64_t)descriptor_type ) << 16 ) + descriptor_index;
+
+    // splitmix64 finalizer
+    x ^= ( (uint64_t)seed + 1 ) * 0x9e3779b97f4a7c15ULL;
+    x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (uint32_t)( x >> 32 );
+}
+
+/**@}*/
+
+/** \addtogroup descriptor_storage_response Descriptor response
+ *
+ *  In a storage with JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES the
+ *  octets in front of each descriptor are the rest of its READ_DESCRIPTOR
+ *  response, so the response is the AECP header of the command followed
+ *  by the storage from configuration_index to the end of the descriptor.
+ *  The table of contents offset is still the offset of the descriptor.
+ *
+ *  | offset from descriptor |  size  |     name             |       Description                          |
+ *  | ---------------------- | ------ | -------------------- | ------------------------------------------ |
+ *  | -0x0008                |    2   |  reserved            |  Padding, keeps the block 4 octet aligned  |
+ *  | -0x0006                |    2   |  control_data_length |  control_data_length of the response       |
+ *  | -0x0004                |    2   |  configuration_index |  Configuration index                       |
+ *  | -0x0002                |    2   |  reserved            |  Reserved, 0                               |
+ *  | 0x0000                 | length |  descriptor          |  Descriptor                                |
+ *
+ */
+/**@{*/
+
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_PREFIX_LENGTH ( 0x0008 )
+
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_CONTROL_DATA_LENGTH_OFFSET ( 0x0002 )
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_CONFIGURATION_INDEX_OFFSET ( 0x0004 )
+
+/// control_data_length of a READ_DESCRIPTOR response carrying a descriptor of descriptor_length octets
+static inline uint16_t jdksavdecc_descriptor_storage_response_get_control_data_length( uint16_t descriptor_length )
+{
+    return (uint16_t)( JDKSAVDECC_AEM_COMMAND_READ_DESCRIPTOR_RESPONSE_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN
+                       + descriptor_length );
+}
+
+/**@}*/
+
 /** \addtogroup jdksavdecc_descriptor_storage */
 /**@{*/
 
@@ -334,6 +484,9 @@ struct jdksavdecc_descriptor_storage
 
     /// data file length
     uint32_t storage_length;
+
+    /// Count of buckets in the descriptor index, 0 when there is no usable index
+    uint32_t index_bucket_count;
 };
 
 /// Initialize descriptor_storage object with user_ptr and storage_length.
@@ -360,6 +513,59 @@ uint32_t jdksavdecc_descriptor_storage_buffer_read_data( struct jdksavdecc_descr
 /// Destroy a descriptor_storate buffer object
 void jdksavdecc_descriptor_storage_buffer_destroy( struct jdksavdecc_entity_model *self );
 
+/// Find the table of contents item for the specified configuration,
+/// descriptor_type and descriptor_index in a buffer or mapped storage. Uses
+/// the descriptor index when there is one, and a binary search otherwise.
+/// Returns true if found.
+bool jdksavdecc_descriptor_storage_buffer_find_item( struct jdksavdecc_descriptor_storage *self,
+                                                     uint16_t configuration_index,
+                                                     uint16_t descriptor_type,
+                                                     uint16_t descriptor_index,
+                                                     struct jdksavdecc_descriptor_storage_item *result );
+
+/// Get a pointer to a descriptor in a buffer or mapped storage without
+/// copying it. Sets *result_length to the length of the descriptor.
+/// Returns 0 if there is no such descriptor.
+uint8_t const *jdksavdecc_descriptor_storage_buffer_get_descriptor( struct jdksavdecc_descriptor_storage *self,
+                                                                    uint16_t configuration_index,
+                                                                    uint16_t descriptor_type,
+                                                                    uint16_t descriptor_index,
+                                                                    uint16_t *result_length );
+
+/// Get a pointer to the pre-built READ_DESCRIPTOR response payload of a
+/// descriptor in a buffer or mapped storage with
+/// JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES. The payload starts at the
+/// configuration_index field of the response and ends with the descriptor.
+/// Sets *result_control_data_length to the control_data_length of the
+/// response and *result_length to the length of the payload.
+/// Returns 0 if there is no such descriptor or no pre-built response.
+uint8_t const *jdksavdecc_descriptor_storage_buffer_get_read_descriptor_response( struct jdksavdecc_descriptor_storage *self,
+                                                                                  uint16_t configuration_index,
+                                                                                  uint16_t descriptor_type,
+                                                                                  uint16_t descriptor_index,
+                                                                                  uint16_t *result_control_data_length,
+                                                                                  uint16_t *result_length );
+
+#ifndef JDKSAVDECC_DESCRIPTOR_STORAGE_ENABLE_MMAP
+#if defined( __unix__ ) || defined( __APPLE__ )
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_ENABLE_MMAP ( 1 )
+#else
+#define JDKSAVDECC_DESCRIPTOR_STORAGE_ENABLE_MMAP ( 0 )
+#endif
+#endif
+
+#if JDKSAVDECC_DESCRIPTOR_STORAGE_ENABLE_MMAP
+
+/// Initialize a descriptor_storage object with a read-only memory mapping
+/// of the file. It then works like a buffer object, descriptors are read
+/// from the mapping without any system calls.
+bool jdksavdecc_descriptor_storage_mmap_init( struct jdksavdecc_descriptor_storage *self, const char *file_name );
+
+/// Unmap the file and destroy the descriptor_storage mmap object
+void jdksavdecc_descriptor_storage_mmap_destroy( struct jdksavdecc_entity_model *self );
+
+#endif
+
 #ifdef FOPEN_MAX
 
 /// Initialize a descriptor_storage file object with a specified read-only file
@@ -400,7 +606,9 @@ uint16_t jdksavdecc_descriptor_storage_buffer_read_descriptor( struct jdksavdecc
                                                                uint16_t result_buffer_len );
 
 /// Read a symbol for the specified configuration, descriptor_type and
-/// descriptor_index. Returns true on success
+/// descriptor_index. With JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_TOC_SYMBOLS the
+/// symbol is next to the descriptor's item, otherwise the symbol table is
+/// searched. Returns true on success
 bool jdksavdecc_descriptor_storage_buffer_read_symbol( struct jdksavdecc_entity_model *self,
                                                        uint16_t configuration_number,
                                                        uint16_t descriptor_type,
@@ -452,6 +660,14 @@ struct jdksavdecc_descriptor_storage_symbols
     struct jdksavdecc_descriptor_storage_symbol_dispatch_item *dispatch_items;
     int max_items;
     int num_items;
+
+    /// Optional open addressing hash table of the dispatch items. Each slot
+    /// holds the item number plus one, or 0 when empty
+    uint16_t *hash_slots;
+
+    /// Count of hash slots, a power of 2 larger than max_items, or 0 for
+    /// a sorted table
+    int num_hash_slots;
 };
 
 static inline bool jdksavdecc_descriptor_storage_symbols_init( struct jdksavdecc_descriptor_storage_symbols *self,
@@ -462,9 +678,24 @@ static inline bool jdksavdecc_descriptor_storage_symbols_init( struct jdksavdecc
     self->dispatch_items = items;
     self->max_items = max_items;
     self->num_items = num_items;
+    self->hash_slots = 0;
+    self->num_hash_slots = 0;
     return true;
 }
 
+/// Initialize an empty symbol table that finds handlers with one hash
+/// probe instead of a binary search. num_hash_slots must be a power of 2
+/// larger than max_items, twice as large keeps the probes short. Returns
+/// false if the sizes are not usable.
+bool jdksavdecc_descriptor_storage_symbols_init_hashed( struct jdksavdecc_descriptor_storage_symbols *self,
+                                                        struct jdksavdecc_descriptor_storage_symbol_dispatch_item *items,
+                                                        int max_items,
+                                                        uint16_t *hash_slots,
+                                                        int num_hash_slots );
+
+/// Add a handler for a symbol, aecp_message_type and aem_command_type.
+/// A sorted table is sorted again if sort is true, a hashed table ignores
+/// sort. Returns false if the table is full.
 bool jdksavdecc_descriptor_storage_symbols_add( struct jdksavdecc_descriptor_storage_symbols *self,
                                                 bool sort,
                                                 uint32_t symbol,
@@ -472,11 +703,13 @@ bool jdksavdecc_descriptor_storage_symbols_add( struct jdksavdecc_descriptor_sto
                                                 uint16_t aem_command_type,
                                                 jdksavdecc_descriptor_storage_symbol_dispatch_proc handler );
 
+/// Find the handler for a symbol, aecp_message_type and aem_command_type.
+/// Returns 0 if there is none.
 jdksavdecc_descriptor_storage_symbol_dispatch_proc
-    jdksavdecc_descriptor_storage_find_symbol( struct jdksavdecc_descriptor_storage_symbols *self,
-                                               uint32_t symbol,
-                                               uint16_t aecp_message_type,
-                                               uint16_t aem_command_type );
+    jdksavdecc_descriptor_storage_symbols_find( struct jdksavdecc_descriptor_storage_symbols *self,
+                                                uint32_t symbol,
+                                                uint16_t aecp_message_type,
+                                                uint16_t aem_command_type );
 
 /*@}*/
 
@@ -76,6 +76,9 @@ struct jdksavdecc_descriptor_storage_gen
     uint32_t num_symbols;
     uint32_t max_symbols;
 
+    /// Layout of the exported storage, 0 or JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES
+    uint32_t flags;
+
     bool ( *add_descriptor )( struct jdksavdecc_descriptor_storage_gen *self,
                               uint16_t configuration_index,
                               uint16_t descriptor_type,
@@ -92,8 +95,7 @@ struct jdksavdecc_descriptor_storage_gen
                           uint16_t configuration_index,
                           uint16_t descriptor_type,
                           uint16_t descriptor_index,
-                          uint8_t const *descriptor_data,
-                          uint16_t descriptor_len );
+                          uint32_t symbol );
 
     void ( *sort_descriptors )( struct jdksavdecc_descriptor_storage_gen *self );
     void ( *sort_symbols )( struct jdksavdecc_descriptor_storage_gen *self );
@@ -142,6 +144,8 @@ uint16_t jdksavdecc_descriptor_storage_gen_read_localized_string( struct jdksavd
                                                                   uint16_t localized_string_id,
                                                                   struct jdksavdecc_string *result );
 
+/// Add a descriptor, or replace the descriptor with the same configuration,
+/// descriptor_type and descriptor_index. Returns false if there is no space
 bool jdksavdecc_descriptor_storage_gen_add_descriptor( struct jdksavdecc_descriptor_storage_gen *self,
                                                        uint16_t configuration_index,
                                                        uint16_t descriptor_type,
@@ -155,12 +159,13 @@ struct jdksavdecc_descriptor_storage_gen_descriptor *
                                                        uint16_t descriptor_type,
                                                        uint16_t descriptor_index );
 
+/// Set the symbol of a descriptor, replacing any earlier symbol. Returns
+/// false if there is no space
 bool jdksavdecc_descriptor_storage_gen_add_symbol( struct jdksavdecc_descriptor_storage_gen *self,
                                                    uint16_t configuration_index,
                                                    uint16_t descriptor_type,
                                                    uint16_t descriptor_index,
-                                                   uint8_t const *descriptor_data,
-                                                   uint16_t descriptor_len );
+                                                   uint32_t symbol );
 
 void jdksavdecc_descriptor_storage_gen_sort_descriptors( struct jdksavdecc_descriptor_storage_gen *self );
 
@@ -172,6 +177,41 @@ struct jdksavdecc_descriptor_storage_gen_symbol *
                                                    uint16_t descriptor_type,
                                                    uint16_t descriptor_index );
 
+/// Build the minimal perfect hash descriptor index for a table of contents
+/// of toc_count items, which must be sorted by configuration, descriptor
+/// type and descriptor index without duplicates. Returns the length of the
+/// index written to index_buffer, or 0 if it does not fit or the table of
+/// contents is not sorted.
+uint32_t jdksavdecc_descriptor_storage_gen_build_index( uint8_t const *toc,
+                                                        uint32_t toc_count,
+                                                        uint8_t *index_buffer,
+                                                        uint32_t index_buffer_length );
+
+/// Copy an "AEM1" storage into result as an "AEM2" storage with a
+/// descriptor index appended. Returns the length of the new storage, or 0
+/// if it does not fit or the storage can not be indexed.
+uint32_t jdksavdecc_descriptor_storage_gen_add_index( uint8_t const *storage,
+                                                      uint32_t storage_length,
+                                                      uint8_t *result,
+                                                      uint32_t result_length );
+
+/// Length of the storage that jdksavdecc_descriptor_storage_gen_export_buffer() makes
+uint32_t jdksavdecc_descriptor_storage_gen_get_export_length( struct jdksavdecc_descriptor_storage_gen *self );
+
+/// Sort the descriptors and symbols and write them to result as an "AEM2"
+/// storage with a descriptor index. With
+/// JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES in self->flags every
+/// descriptor is laid out as its READ_DESCRIPTOR response payload, see
+/// \ref descriptor_storage_response. When there are symbols the symbol
+/// table has one symbol for each descriptor, 0 for descriptors without
+/// one, and symbols for missing descriptors are left out. Returns the
+/// length of the storage, or 0 if it does not fit.
+uint32_t jdksavdecc_descriptor_storage_gen_export_buffer( struct jdksavdecc_descriptor_storage_gen *self,
+                                                          uint8_t *result,
+                                                          uint32_t result_length );
+
+/// Write the storage made by jdksavdecc_descriptor_storage_gen_export_buffer()
+/// to the file fname. Returns 0 on success, -1 on failure
 int jdksavdecc_descriptor_storage_gen_export_binary( struct jdksavdecc_descriptor_storage_gen *self, const char *fname );
 
 int jdksavdecc_descriptor_storage_gen_export_c( struct jdksavdecc_descriptor_storage_gen *self,
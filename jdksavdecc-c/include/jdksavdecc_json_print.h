@@ -0,0 +1,180 @@
+#pragma once
+
+/*
+  Copyright (c) 2013, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jdksavdecc_world.h"
+#include "jdksavdecc_adp.h"
+#include "jdksavdecc_acmp.h"
+#include "jdksavdecc_aecp.h"
+#include "jdksavdecc_print.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \addtogroup util Utilities */
+/*@{*/
+
+/** \addtogroup json_print JSON Print
+ *
+ * Formats ADP, AECP and ACMP PDUs as JSON objects, one per line for
+ * NDJSON or as the elements of one JSON array.
+ *
+ * The objects are appended to a buffer that is handed to a flush
+ * function when it runs out of room for the next PDU, so that a capture
+ * can be streamed to a file or a pipe. The room for a whole PDU is made
+ * before it is formatted and the fields are then written without
+ * checking the room for each character. Names are found by value in
+ * lookup tables made from the jdksavdecc_*_print tables when the printer
+ * is initialized.
+ */
+/*@{*/
+
+/** The room made in the buffer for a PDU, besides twice the length of its payload */
+#define JDKSAVDECC_JSON_PRINTER_PDU_RESERVE ( 4096 )
+
+/** Payloads longer than this are cut short */
+#define JDKSAVDECC_JSON_PRINTER_MAX_PAYLOAD ( 1500 )
+
+/** The smallest buffer a printer can use */
+#define JDKSAVDECC_JSON_PRINTER_MIN_BUFFER ( JDKSAVDECC_JSON_PRINTER_PDU_RESERVE + 2 * JDKSAVDECC_JSON_PRINTER_MAX_PAYLOAD )
+
+/**
+ * Called with the formatted text when the buffer is full and when the
+ * printer is flushed. Returns 0 if the text could not be written.
+ */
+typedef int ( *jdksavdecc_json_printer_flush_proc )( void *context, char const *buf, size_t len );
+
+struct jdksavdecc_json_printer
+{
+    char *buf;
+    size_t max_len;
+    size_t pos;
+
+    /** Non zero for one object per line, zero for a JSON array */
+    int ndjson;
+
+    /** The count of PDUs formatted */
+    uint64_t count;
+
+    /** The count of times the flush function failed */
+    uint64_t flush_errors;
+
+    jdksavdecc_json_printer_flush_proc flush;
+    void *context;
+
+    struct jdksavdecc_uint16_name_index adp_message_type;
+    struct jdksavdecc_uint16_name_index acmp_message_type;
+    struct jdksavdecc_uint16_name_index acmp_status;
+    struct jdksavdecc_uint16_name_index aecp_message_type;
+    struct jdksavdecc_uint16_name_index aem_status;
+    struct jdksavdecc_uint16_name_index aa_status;
+    struct jdksavdecc_uint16_name_index aem_command;
+    struct jdksavdecc_bit_name_index entity_capabilities;
+    struct jdksavdecc_bit_name_index talker_capabilities;
+    struct jdksavdecc_bit_name_index listener_capabilities;
+    struct jdksavdecc_bit_name_index controller_capabilities;
+    struct jdksavdecc_bit_name_index acmp_flags;
+
+    char const *adp_message_type_names[4];
+    char const *acmp_message_type_names[16];
+    char const *acmp_status_names[32];
+    char const *aecp_message_type_names[16];
+    char const *aem_status_names[32];
+    char const *aa_status_names[32];
+    char const *aem_command_names[128];
+};
+
+/**
+ * Initialize the printer and its name lookup tables.
+ *
+ * @param self pointer to the printer
+ * @param buf the buffer, at least JDKSAVDECC_JSON_PRINTER_MIN_BUFFER octets
+ * @param max_len the size of the buffer
+ * @param ndjson non zero for one object per line, zero for a JSON array
+ * @param flush the function that takes the text, or 0 to fill the buffer once
+ * @param context passed to the flush function
+ */
+void jdksavdecc_json_printer_init( struct jdksavdecc_json_printer *self,
+                                   char *buf,
+                                   size_t max_len,
+                                   int ndjson,
+                                   jdksavdecc_json_printer_flush_proc flush,
+                                   void *context );
+
+/** Hand the text in the buffer to the flush function */
+void jdksavdecc_json_printer_flush( struct jdksavdecc_json_printer *self );
+
+/** Close the JSON array if it is not NDJSON, and flush */
+void jdksavdecc_json_printer_finish( struct jdksavdecc_json_printer *self );
+
+/**
+ * Format an Ethernet frame if it holds an ADP, AECP or ACMP PDU.
+ *
+ * @param self pointer to the printer
+ * @param timestamp_in_microseconds the time of the frame, printed as "time"
+ * @param frame the frame, starting with the destination MAC address
+ * @param len the length of the frame
+ * @return 1 if the PDU was formatted, 0 if it is not an AVDECC PDU or there was no room for it
+ */
+int jdksavdecc_json_printer_print_frame( struct jdksavdecc_json_printer *self,
+                                         uint64_t timestamp_in_microseconds,
+                                         uint8_t const *frame,
+                                         size_t len );
+
+/**
+ * Format an AVDECC PDU that starts at pos in p.
+ *
+ * @param self pointer to the printer
+ * @param timestamp_in_microseconds the time of the PDU, printed as "time"
+ * @param src the source MAC address, or 0
+ * @param dest the destination MAC address, or 0
+ * @param p the buffer with the PDU
+ * @param pos the position of the PDU's subtype octet in p
+ * @param len the length of p
+ * @return 1 if the PDU was formatted, 0 if it is not an AVDECC PDU or there was no room for it
+ */
+int jdksavdecc_json_printer_print_pdu( struct jdksavdecc_json_printer *self,
+                                       uint64_t timestamp_in_microseconds,
+                                       struct jdksavdecc_eui48 const *src,
+                                       struct jdksavdecc_eui48 const *dest,
+                                       uint8_t const *p,
+                                       size_t pos,
+                                       size_t len );
+
+/*@}*/
+
+/*@}*/
+
+#ifdef __cplusplus
+}
+#endif
@@ -173,6 +173,47 @@ void jdksavdecc_printer_print_eui64_name( struct jdksavdecc_printer *self,
 
 extern char jdksavdecc_hexdig[16];
 
+/**
+ * Direct lookup of the names in a jdksavdecc_uint16_name table.
+ *
+ * The values below count are found by indexing by_value, the others
+ * by scanning the table.
+ */
+struct jdksavdecc_uint16_name_index
+{
+    struct jdksavdecc_uint16_name const *names;
+    char const **by_value;
+    uint16_t count;
+};
+
+/**
+ * Fill in by_value, which has room for count names, from the names table.
+ * The table must outlive the index.
+ */
+void jdksavdecc_uint16_name_index_init( struct jdksavdecc_uint16_name_index *self,
+                                        struct jdksavdecc_uint16_name const names[],
+                                        char const **by_value,
+                                        uint16_t count );
+
+static inline char const *jdksavdecc_uint16_name_index_get( struct jdksavdecc_uint16_name_index const *self, uint16_t v )
+{
+    return v < self->count ? self->by_value[v] : jdksavdecc_get_name_for_uint16_value( self->names, v );
+}
+
+/**
+ * The names in a jdksavdecc_16bit_name or jdksavdecc_32bit_name table by
+ * the number of their lowest bit, so that the names of the bits set in a
+ * value are found without scanning the table.
+ */
+struct jdksavdecc_bit_name_index
+{
+    char const *by_bit[32];
+};
+
+void jdksavdecc_bit_name_index_init_16bit( struct jdksavdecc_bit_name_index *self, struct jdksavdecc_16bit_name const names[] );
+
+void jdksavdecc_bit_name_index_init_32bit( struct jdksavdecc_bit_name_index *self, struct jdksavdecc_32bit_name const names[] );
+
 /*@}*/
 
 #ifdef __cplusplus
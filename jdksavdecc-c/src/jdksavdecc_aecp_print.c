@@ -55,14 +55,27 @@ struct jdksavdecc_uint16_name jdksavdecc_aecp_print_message_type[]
        {0, 0}};
 
 struct jdksavdecc_uint16_name jdksavdecc_aecp_print_status[]
-    = {{JDKSAVDECC_AECP_STATUS_SUCCESS, "SUCCESS"}, {JDKSAVDECC_AECP_STATUS_NOT_IMPLEMENTED, "IMPLEMENTED"}, {0, 0}};
+    = {{JDKSAVDECC_AECP_STATUS_SUCCESS, "SUCCESS"}, {JDKSAVDECC_AECP_STATUS_NOT_IMPLEMENTED, "NOT_IMPLEMENTED"}, {0, 0}};
 
 struct jdksavdecc_uint16_name jdksavdecc_aecp_aem_print_status[]
-    = {{JDKSAVDECC_AECP_STATUS_SUCCESS, "SUCCESS"}, {JDKSAVDECC_AECP_STATUS_NOT_IMPLEMENTED, "IMPLEMENTED"}, {0, 0}};
+    = {{JDKSAVDECC_AEM_STATUS_SUCCESS, "SUCCESS"},
+       {JDKSAVDECC_AEM_STATUS_NOT_IMPLEMENTED, "NOT_IMPLEMENTED"},
+       {JDKSAVDECC_AEM_STATUS_NO_SUCH_DESCRIPTOR, "NO_SUCH_DESCRIPTOR"},
+       {JDKSAVDECC_AEM_STATUS_ENTITY_LOCKED, "ENTITY_LOCKED"},
+       {JDKSAVDECC_AEM_STATUS_ENTITY_ACQUIRED, "ENTITY_ACQUIRED"},
+       {JDKSAVDECC_AEM_STATUS_NOT_AUTHENTICATED, "NOT_AUTHENTICATED"},
+       {JDKSAVDECC_AEM_STATUS_AUTHENTICATION_DISABLED, "AUTHENTICATION_DISABLED"},
+       {JDKSAVDECC_AEM_STATUS_BAD_ARGUMENTS, "BAD_ARGUMENTS"},
+       {JDKSAVDECC_AEM_STATUS_NO_RESOURCES, "NO_RESOURCES"},
+       {JDKSAVDECC_AEM_STATUS_IN_PROGRESS, "IN_PROGRESS"},
+       {JDKSAVDECC_AEM_STATUS_ENTITY_MISBEHAVING, "ENTITY_MISBEHAVING"},
+       {JDKSAVDECC_AEM_STATUS_NOT_SUPPORTED, "NOT_SUPPORTED"},
+       {JDKSAVDECC_AEM_STATUS_STREAM_IS_RUNNING, "STREAM_IS_RUNNING"},
+       {0, 0}};
 
 struct jdksavdecc_uint16_name jdksavdecc_aecp_aa_print_status[]
     = {{JDKSAVDECC_AECP_AA_STATUS_SUCCESS, "SUCCESS"},
-       {JDKSAVDECC_AECP_AA_STATUS_NOT_IMPLEMENTED, "IMPLEMENTED"},
+       {JDKSAVDECC_AECP_AA_STATUS_NOT_IMPLEMENTED, "NOT_IMPLEMENTED"},
        {JDKSAVDECC_AECP_AA_STATUS_ADDRESS_TOO_LOW, "ADDRESS_TOO_LOW"},
        {JDKSAVDECC_AECP_AA_STATUS_ADDRESS_TOO_HIGH, "ADDRESS_TOO_HIGH"},
        {JDKSAVDECC_AECP_AA_STATUS_ADDRESS_INVALID, "ADDRESS_INVALID"},
@@ -76,19 +89,22 @@ struct jdksavdecc_uint16_name jdksavdecc_aecp_aa_print_mode[] = {{JDKSAVDECC_AEC
                                                                  {JDKSAVDECC_AECP_AA_MODE_EXECUTE, "EXECUTE"},
                                                                  {0, 0}};
 
-struct jdksavdecc_uint16_name jdksavdecc_aecp_avc_print_status[] = {{JDKSAVDECC_AECP_AVC_STATUS_SUCCESS, "SUCCESS"},
-                                                                    {JDKSAVDECC_AECP_AVC_STATUS_NOT_IMPLEMENTED, "IMPLEMENTED"},
-                                                                    {JDKSAVDECC_AECP_AVC_STATUS_FAILURE, "FAILURE"},
-                                                                    {0, 0}};
+struct jdksavdecc_uint16_name jdksavdecc_aecp_avc_print_status[]
+    = {{JDKSAVDECC_AECP_AVC_STATUS_SUCCESS, "SUCCESS"},
+       {JDKSAVDECC_AECP_AVC_STATUS_NOT_IMPLEMENTED, "NOT_IMPLEMENTED"},
+       {JDKSAVDECC_AECP_AVC_STATUS_FAILURE, "FAILURE"},
+       {0, 0}};
 
 struct jdksavdecc_uint16_name jdksavdecc_aecp_hdcp_apm_print_status[]
     = {{JDKSAVDECC_AECP_HDCP_APM_STATUS_SUCCESS, "SUCCESS"},
-       {JDKSAVDECC_AECP_HDCP_APM_STATUS_NOT_IMPLEMENTED, "IMPLEMENTED"},
+       {JDKSAVDECC_AECP_HDCP_APM_STATUS_NOT_IMPLEMENTED, "NOT_IMPLEMENTED"},
        {JDKSAVDECC_AECP_HDCP_APM_STATUS_FRAGMENT_MISSING, "FRAGMENT_MISSING"},
        {0, 0}};
 
-struct jdksavdecc_uint16_name jdksavdecc_aecp_vendor_print_status[] = {
-    {JDKSAVDECC_AECP_VENDOR_STATUS_SUCCESS, "SUCCESS"}, {JDKSAVDECC_AECP_VENDOR_STATUS_NOT_IMPLEMENTED, "IMPLEMENTED"}, {0, 0}};
+struct jdksavdecc_uint16_name jdksavdecc_aecp_vendor_print_status[]
+    = {{JDKSAVDECC_AECP_VENDOR_STATUS_SUCCESS, "SUCCESS"},
+       {JDKSAVDECC_AECP_VENDOR_STATUS_NOT_IMPLEMENTED, "NOT_IMPLEMENTED"},
+       {0, 0}};
 
 void jdksavdecc_aecp_common_control_header_print( struct jdksavdecc_printer *self,
                                                   struct jdksavdecc_aecpdu_common_control_header const *p )
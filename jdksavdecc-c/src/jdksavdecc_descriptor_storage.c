@@ -33,6 +33,12 @@
 #include "jdksavdecc_descriptor_storage.h"
 #include "jdksavdecc_entity_model.h"
 
+#if JDKSAVDECC_DESCRIPTOR_STORAGE_ENABLE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 bool jdksavdecc_descriptor_storage_init( struct jdksavdecc_descriptor_storage *self,
                                          void const *user_ptr,
                                          uint32_t storage_length )
@@ -42,11 +48,37 @@ bool jdksavdecc_descriptor_storage_init( struct jdksavdecc_descriptor_storage *s
     self->read_data = 0;
     self->user_ptr = user_ptr;
     self->storage_length = storage_length;
+    self->index_bucket_count = 0;
     return true;
 }
 
 void jdksavdecc_descriptor_storage_destroy( struct jdksavdecc_entity_model *self ) { jdksavdecc_entity_model_destroy( self ); }
 
+/// Use the descriptor index only if all of it and the table of contents are inside the storage
+static void jdksavdecc_descriptor_storage_buffer_check_index( struct jdksavdecc_descriptor_storage *self )
+{
+    uint32_t index_count = self->header.index_count;
+    uint32_t index_offset = self->header.index_offset;
+
+    self->index_bucket_count = 0;
+
+    if ( index_count > 0 && index_count == self->header.toc_count
+         && (uint64_t)index_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_DISPLACEMENTS_OFFSET <= self->storage_length
+         && (uint64_t)self->header.toc_offset + (uint64_t)JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH * index_count
+            <= self->storage_length )
+    {
+        uint32_t bucket_count
+            = jdksavdecc_uint32_get( self->user_ptr, index_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_BUCKET_COUNT_OFFSET );
+        uint64_t index_end = (uint64_t)index_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_DISPLACEMENTS_OFFSET
+                             + 4 * ( (uint64_t)bucket_count + index_count );
+
+        if ( bucket_count > 0 && index_end <= self->storage_length )
+        {
+            self->index_bucket_count = bucket_count;
+        }
+    }
+}
+
 bool jdksavdecc_descriptor_storage_buffer_init( struct jdksavdecc_descriptor_storage *self,
                                                 void const *user_ptr,
                                                 uint32_t storage_length )
@@ -62,8 +94,10 @@ bool jdksavdecc_descriptor_storage_buffer_init( struct jdksavdecc_descriptor_sto
 
     if ( jdksavdecc_descriptor_storage_buffer_read_header( self ) )
     {
-        if ( self->header.magic == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC_VALUE )
+        if ( self->header.magic == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC_VALUE
+             || self->header.magic == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC2_VALUE )
         {
+            jdksavdecc_descriptor_storage_buffer_check_index( self );
             r = true;
         }
     }
@@ -98,7 +132,7 @@ bool jdksavdecc_descriptor_storage_buffer_read_header( struct jdksavdecc_descrip
     if ( l == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH )
     {
         ssize_t pos = jdksavdecc_descriptor_storage_header_read( &self->header, self->user_ptr, 0, self->storage_length );
-        if ( pos == l )
+        if ( pos >= l )
         {
             r = true;
         }
@@ -158,6 +192,139 @@ static int jdksavdecc_descriptor_storage_buffer_compare_item( const void *lhs_,
     return r;
 }
 
+/// Find the table of contents item and its number, the number is 0xffffffff if not found
+static uint32_t jdksavdecc_descriptor_storage_buffer_find_item_number( struct jdksavdecc_descriptor_storage *self,
+                                                                       uint16_t configuration_index,
+                                                                       uint16_t descriptor_type,
+                                                                       uint16_t descriptor_index,
+                                                                       struct jdksavdecc_descriptor_storage_item *result )
+{
+    bool r = false;
+    uint32_t item = 0xffffffff;
+
+    if ( self->index_bucket_count > 0 )
+    {
+        // One probe: the bucket's displacement, the slot, and the item it points to
+        uint32_t index_offset = self->header.index_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_DISPLACEMENTS_OFFSET;
+        uint32_t bucket = jdksavdecc_descriptor_storage_index_hash( configuration_index, descriptor_type, descriptor_index, 0 )
+                          % self->index_bucket_count;
+        uint32_t displacement = jdksavdecc_uint32_get( self->user_ptr, index_offset + 4 * bucket );
+        uint32_t slot
+            = jdksavdecc_descriptor_storage_index_hash( configuration_index, descriptor_type, descriptor_index, displacement )
+              % self->header.index_count;
+        item = jdksavdecc_uint32_get( self->user_ptr, index_offset + 4 * ( self->index_bucket_count + slot ) );
+
+        if ( item < self->header.toc_count )
+        {
+            jdksavdecc_descriptor_storage_item_read( result,
+                                                     self->user_ptr,
+                                                     self->header.toc_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH * item,
+                                                     self->storage_length );
+
+            // Keys that are not in the table land in some slot too
+            r = result->configuration_index == configuration_index && result->descriptor_type == descriptor_type
+                && result->descriptor_index == descriptor_index;
+        }
+    }
+    else
+    {
+        void *p;
+        void *descriptor_items;
+        struct jdksavdecc_descriptor_storage_item key;
+        uint8_t key_item[JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH];
+
+        descriptor_items = ( (uint8_t *)self->user_ptr ) + self->header.toc_offset;
+        key.configuration_index = configuration_index;
+        key.descriptor_type = descriptor_type;
+        key.descriptor_index = descriptor_index;
+        key.length = 0;
+        key.offset = 0;
+
+        // The compare function reads both sides as stored items
+        jdksavdecc_descriptor_storage_item_write( &key, key_item, 0, sizeof( key_item ) );
+
+        p = bsearch( key_item,
+                     descriptor_items,
+                     self->header.toc_count,
+                     JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH,
+                     jdksavdecc_descriptor_storage_buffer_compare_item );
+
+        if ( p )
+        {
+            jdksavdecc_descriptor_storage_item_read( result, p, 0, JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH );
+            item = (uint32_t)( ( (uint8_t *)p - (uint8_t *)descriptor_items ) / JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH );
+            r = true;
+        }
+    }
+
+    if ( r && (uint64_t)result->offset + result->length > self->storage_length )
+    {
+        r = false;
+    }
+    return r ? item : 0xffffffff;
+}
+
+bool jdksavdecc_descriptor_storage_buffer_find_item( struct jdksavdecc_descriptor_storage *self,
+                                                     uint16_t configuration_index,
+                                                     uint16_t descriptor_type,
+                                                     uint16_t descriptor_index,
+                                                     struct jdksavdecc_descriptor_storage_item *result )
+{
+    return jdksavdecc_descriptor_storage_buffer_find_item_number(
+               self, configuration_index, descriptor_type, descriptor_index, result ) != 0xffffffff;
+}
+
+uint8_t const *jdksavdecc_descriptor_storage_buffer_get_descriptor( struct jdksavdecc_descriptor_storage *self,
+                                                                    uint16_t configuration_index,
+                                                                    uint16_t descriptor_type,
+                                                                    uint16_t descriptor_index,
+                                                                    uint16_t *result_length )
+{
+    uint8_t const *r = 0;
+    struct jdksavdecc_descriptor_storage_item item;
+
+    if ( jdksavdecc_descriptor_storage_buffer_find_item( self, configuration_index, descriptor_type, descriptor_index, &item ) )
+    {
+        r = ( (uint8_t const *)self->user_ptr ) + item.offset;
+        *result_length = item.length;
+    }
+    return r;
+}
+
+uint8_t const *jdksavdecc_descriptor_storage_buffer_get_read_descriptor_response( struct jdksavdecc_descriptor_storage *self,
+                                                                                  uint16_t configuration_index,
+                                                                                  uint16_t descriptor_type,
+                                                                                  uint16_t descriptor_index,
+                                                                                  uint16_t *result_control_data_length,
+                                                                                  uint16_t *result_length )
+{
+    uint8_t const *r = 0;
+    struct jdksavdecc_descriptor_storage_item item;
+
+    if ( ( self->header.flags & JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES )
+         && jdksavdecc_descriptor_storage_buffer_find_item(
+                self, configuration_index, descriptor_type, descriptor_index, &item )
+         && item.offset >= JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_PREFIX_LENGTH )
+    {
+        uint8_t const *prefix
+            = ( (uint8_t const *)self->user_ptr ) + item.offset - JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_PREFIX_LENGTH;
+        uint16_t control_data_length
+            = jdksavdecc_uint16_get( prefix, JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_CONTROL_DATA_LENGTH_OFFSET );
+
+        // Only use a prefix that agrees with the table of contents
+        if ( control_data_length == jdksavdecc_descriptor_storage_response_get_control_data_length( item.length )
+             && jdksavdecc_uint16_get( prefix, JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_CONFIGURATION_INDEX_OFFSET )
+                == configuration_index )
+        {
+            r = prefix + JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_CONFIGURATION_INDEX_OFFSET;
+            *result_control_data_length = control_data_length;
+            *result_length = (uint16_t)( JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_PREFIX_LENGTH
+                                         - JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_CONFIGURATION_INDEX_OFFSET + item.length );
+        }
+    }
+    return r;
+}
+
 uint16_t jdksavdecc_descriptor_storage_buffer_read_descriptor( struct jdksavdecc_entity_model *self_,
                                                                uint16_t configuration_number,
                                                                uint16_t descriptor_type,
@@ -167,32 +334,14 @@ uint16_t jdksavdecc_descriptor_storage_buffer_read_descriptor( struct jdksavdecc
 {
     uint16_t r = 0;
     struct jdksavdecc_descriptor_storage *self = (struct jdksavdecc_descriptor_storage *)self_;
-    void *p;
-    void *descriptor_items;
-    struct jdksavdecc_descriptor_storage_item key;
-
-    descriptor_items = ( (uint8_t *)self->user_ptr ) + self->header.toc_offset;
-    key.configuration_index = configuration_number;
-    key.descriptor_type = descriptor_type;
-    key.descriptor_index = descriptor_index;
-    key.length = 0;
-    key.offset = 0;
-
-    p = bsearch( &key,
-                 descriptor_items,
-                 self->header.toc_count,
-                 JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH,
-                 jdksavdecc_descriptor_storage_buffer_compare_item );
-
-    if ( p )
+    uint16_t length = 0;
+    uint8_t const *p = jdksavdecc_descriptor_storage_buffer_get_descriptor(
+        self, configuration_number, descriptor_type, descriptor_index, &length );
+
+    if ( p && length <= result_buffer_len )
     {
-        // found the match, now get the item offset and length and give it to the caller
-        jdksavdecc_descriptor_storage_item_read( &key, p, 0, JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH );
-        if ( key.length <= result_buffer_len )
-        {
-            r = key.length;
-            memcpy( result_buffer, ( (uint8_t *)self->user_ptr ) + key.offset, key.length );
-        }
+        r = length;
+        memcpy( result_buffer, p, length );
     }
     return r;
 }
@@ -205,8 +354,8 @@ static int jdksavdecc_descriptor_storage_buffer_compare_symbol( const void *lhs_
     uint64_t lhsv;
     uint64_t rhsv;
 
-    jdksavdecc_descriptor_storage_symbol_read( &lhs, lhs_, 0, JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH );
-    jdksavdecc_descriptor_storage_symbol_read( &rhs, rhs_, 0, JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH );
+    jdksavdecc_descriptor_storage_symbol_read( &lhs, lhs_, 0, JDKSAVDECC_DESCRIPTOR_STORAGE_SYMBOL_LENGTH );
+    jdksavdecc_descriptor_storage_symbol_read( &rhs, rhs_, 0, JDKSAVDECC_DESCRIPTOR_STORAGE_SYMBOL_LENGTH );
 
     // items are expected to be ordered by configuration, then descriptor type, then descriptor index
     lhsv = ( ( (uint64_t)lhs.configuration_index ) << 32 ) + ( ( (uint64_t)lhs.descriptor_type ) << 16 )
@@ -234,28 +383,58 @@ bool jdksavdecc_descriptor_storage_buffer_read_symbol( struct jdksavdecc_entity_
 {
     bool r = false;
     struct jdksavdecc_descriptor_storage *self = (struct jdksavdecc_descriptor_storage *)self_;
-    void *p;
-    void *descriptor_items;
     struct jdksavdecc_descriptor_storage_symbol key;
+    bool symbols_inside = (uint64_t)self->header.symbol_offset
+                          + (uint64_t)JDKSAVDECC_DESCRIPTOR_STORAGE_SYMBOL_LENGTH * self->header.symbol_count
+                          <= self->storage_length;
 
-    descriptor_items = ( (uint8_t *)self->user_ptr ) + self->header.toc_offset;
-    key.configuration_index = configuration_number;
-    key.descriptor_type = descriptor_type;
-    key.descriptor_index = descriptor_index;
-    key.symbol = 0;
-
-    p = bsearch( &key,
-                 descriptor_items,
-                 self->header.toc_count,
-                 JDKSAVDECC_DESCRIPTOR_STORAGE_SYMBOL_LENGTH,
-                 jdksavdecc_descriptor_storage_buffer_compare_symbol );
+    if ( !symbols_inside || self->header.symbol_count == 0 )
+    {
+        r = false;
+    }
+    else if ( ( self->header.flags & JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_TOC_SYMBOLS )
+              && self->header.symbol_count == self->header.toc_count )
+    {
+        // The symbol has the same number as the descriptor's item
+        struct jdksavdecc_descriptor_storage_item item;
+        uint32_t n = jdksavdecc_descriptor_storage_buffer_find_item_number(
+            self, configuration_number, descriptor_type, descriptor_index, &item );
 
-    if ( p )
+        if ( n != 0xffffffff )
+        {
+            ssize_t pos = self->header.symbol_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_SYMBOL_LENGTH * n;
+            jdksavdecc_descriptor_storage_symbol_read( &key, self->user_ptr, pos, self->storage_length );
+            *result_symbol = key.symbol;
+            r = true;
+        }
+    }
+    else
     {
-        // found the match, now get the item offset and length and give it to the caller
-        jdksavdecc_descriptor_storage_symbol_read( &key, p, 0, JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH );
-        *result_symbol = key.symbol;
-        r = true;
+        void *p;
+        void *symbols;
+        uint8_t key_symbol[JDKSAVDECC_DESCRIPTOR_STORAGE_SYMBOL_LENGTH];
+
+        symbols = ( (uint8_t *)self->user_ptr ) + self->header.symbol_offset;
+        key.configuration_index = configuration_number;
+        key.descriptor_type = descriptor_type;
+        key.descriptor_index = descriptor_index;
+        key.symbol = 0;
+
+        // The compare function reads both sides as stored symbols
+        jdksavdecc_descriptor_storage_symbol_write( &key, key_symbol, 0, sizeof( key_symbol ) );
+
+        p = bsearch( key_symbol,
+                     symbols,
+                     self->header.symbol_count,
+                     JDKSAVDECC_DESCRIPTOR_STORAGE_SYMBOL_LENGTH,
+                     jdksavdecc_descriptor_storage_buffer_compare_symbol );
+
+        if ( p )
+        {
+            jdksavdecc_descriptor_storage_symbol_read( &key, p, 0, JDKSAVDECC_DESCRIPTOR_STORAGE_SYMBOL_LENGTH );
+            *result_symbol = key.symbol;
+            r = true;
+        }
     }
     return r;
 }
@@ -271,6 +450,7 @@ bool jdksavdecc_descriptor_storage_file_init( struct jdksavdecc_descriptor_stora
 #else
     FILE *f = fopen( file_name, "rb" );
 #endif
+    jdksavdecc_descriptor_storage_init( self, 0, 0 );
     self->base.destroy = jdksavdecc_descriptor_storage_file_destroy;
     self->read_data = jdksavdecc_descriptor_storage_file_read_data;
     if ( f )
@@ -284,7 +464,8 @@ bool jdksavdecc_descriptor_storage_file_init( struct jdksavdecc_descriptor_stora
                 self->storage_length = (uint32_t)pos;
                 if ( jdksavdecc_descriptor_storage_file_read_header( self ) )
                 {
-                    if ( self->header.magic == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC_VALUE )
+                    if ( self->header.magic == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC_VALUE
+                         || self->header.magic == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC2_VALUE )
                     {
                         r = true;
                     }
@@ -311,7 +492,7 @@ uint32_t jdksavdecc_descriptor_storage_file_read_data( struct jdksavdecc_descrip
 
         if ( self->storage_length >= offset + length )
         {
-            if ( fseek( f, SEEK_SET, (int)offset ) == 0 )
+            if ( fseek( f, (long)offset, SEEK_SET ) == 0 )
             {
                 if ( fread( buffer, 1, length, f ) == length )
                 {
@@ -341,12 +522,13 @@ void jdksavdecc_descriptor_storage_file_destroy( struct jdksavdecc_entity_model
 bool jdksavdecc_descriptor_storage_file_read_header( struct jdksavdecc_descriptor_storage *self )
 {
     bool r = false;
-    uint8_t buf[JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH];
-    uint32_t l = self->read_data( self, buf, 0, sizeof( buf ) );
-    if ( l == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH )
+    uint8_t buf[JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER2_LENGTH];
+    uint32_t l = self->read_data(
+        self, buf, 0, self->storage_length < sizeof( buf ) ? JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH : sizeof( buf ) );
+    if ( l >= JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH )
     {
         ssize_t pos = jdksavdecc_descriptor_storage_header_read( &self->header, buf, 0, l );
-        if ( pos == l )
+        if ( pos > 0 )
         {
             r = true;
         }
@@ -356,6 +538,53 @@ bool jdksavdecc_descriptor_storage_file_read_header( struct jdksavdecc_descripto
 
 #endif
 
+#if JDKSAVDECC_DESCRIPTOR_STORAGE_ENABLE_MMAP
+
+bool jdksavdecc_descriptor_storage_mmap_init( struct jdksavdecc_descriptor_storage *self, const char *file_name )
+{
+    bool r = false;
+    int fd = open( file_name, O_RDONLY );
+
+    jdksavdecc_descriptor_storage_init( self, 0, 0 );
+    self->base.destroy = jdksavdecc_descriptor_storage_mmap_destroy;
+
+    if ( fd >= 0 )
+    {
+        struct stat st;
+        if ( fstat( fd, &st ) == 0 && st.st_size >= JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH && st.st_size <= 0xffffffffL )
+        {
+            void *p = mmap( 0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( p != MAP_FAILED )
+            {
+                r = jdksavdecc_descriptor_storage_buffer_init( self, p, (uint32_t)st.st_size );
+                self->base.destroy = jdksavdecc_descriptor_storage_mmap_destroy;
+                if ( !r )
+                {
+                    munmap( p, (size_t)st.st_size );
+                    self->user_ptr = 0;
+                }
+            }
+        }
+        // The mapping stays valid without the descriptor
+        close( fd );
+    }
+    return r;
+}
+
+void jdksavdecc_descriptor_storage_mmap_destroy( struct jdksavdecc_entity_model *self_ )
+{
+    struct jdksavdecc_descriptor_storage *self = (struct jdksavdecc_descriptor_storage *)self_;
+
+    if ( self->user_ptr )
+    {
+        munmap( (void *)self->user_ptr, self->storage_length );
+        self->user_ptr = 0;
+    }
+    jdksavdecc_descriptor_storage_destroy( self_ );
+}
+
+#endif
+
 int jdksavdecc_descriptor_storage_symbol_dispatch_item_compare( const void *lhs_, const void *rhs_ )
 {
     int r = 0;
@@ -382,6 +611,41 @@ int jdksavdecc_descriptor_storage_symbol_dispatch_item_compare( const void *lhs_
     return r;
 }
 
+/// First hash slot to probe for a dispatch key
+static int jdksavdecc_descriptor_storage_symbols_hash( struct jdksavdecc_descriptor_storage_symbols const *self,
+                                                       uint32_t symbol,
+                                                       uint16_t aecp_message_type,
+                                                       uint16_t aem_command_type )
+{
+    return (int)( jdksavdecc_descriptor_storage_index_hash(
+                      (uint16_t)( symbol >> 16 ), (uint16_t)symbol, aem_command_type, aecp_message_type )
+                  & (uint32_t)( self->num_hash_slots - 1 ) );
+}
+
+bool jdksavdecc_descriptor_storage_symbols_init_hashed( struct jdksavdecc_descriptor_storage_symbols *self,
+                                                        struct jdksavdecc_descriptor_storage_symbol_dispatch_item *items,
+                                                        int max_items,
+                                                        uint16_t *hash_slots,
+                                                        int num_hash_slots )
+{
+    bool r = false;
+    int i;
+
+    jdksavdecc_descriptor_storage_symbols_init( self, items, max_items, 0 );
+
+    if ( num_hash_slots > max_items && max_items < 0xffff && ( num_hash_slots & ( num_hash_slots - 1 ) ) == 0 )
+    {
+        for ( i = 0; i < num_hash_slots; ++i )
+        {
+            hash_slots[i] = 0;
+        }
+        self->hash_slots = hash_slots;
+        self->num_hash_slots = num_hash_slots;
+        r = true;
+    }
+    return r;
+}
+
 bool jdksavdecc_descriptor_storage_symbols_add( struct jdksavdecc_descriptor_storage_symbols *self,
                                                 bool sort,
                                                 uint32_t symbol,
@@ -400,14 +664,25 @@ bool jdksavdecc_descriptor_storage_symbols_add( struct jdksavdecc_descriptor_sto
         item->aem_command_type = aem_command_type;
         item->handler = handler;
         self->num_items++;
-        // then qsort it into position
-        if ( sort )
+        if ( self->num_hash_slots > 0 )
         {
+            // the item stays where it is, the first free slot from its hash points to it
+            int slot = jdksavdecc_descriptor_storage_symbols_hash( self, symbol, aecp_message_type, aem_command_type );
+            while ( self->hash_slots[slot] != 0 )
+            {
+                slot = ( slot + 1 ) & ( self->num_hash_slots - 1 );
+            }
+            self->hash_slots[slot] = (uint16_t)self->num_items;
+        }
+        else if ( sort )
+        {
+            // then qsort it into position
             qsort( self->dispatch_items,
                    self->num_items,
                    sizeof( *item ),
                    jdksavdecc_descriptor_storage_symbol_dispatch_item_compare );
         }
+        r = true;
     }
     return r;
 }
@@ -416,26 +691,46 @@ jdksavdecc_descriptor_storage_symbol_dispatch_proc jdksavdecc_descriptor_storage
     struct jdksavdecc_descriptor_storage_symbols *self, uint32_t symbol, uint16_t aecp_message_type, uint16_t aem_command_type )
 {
     jdksavdecc_descriptor_storage_symbol_dispatch_proc r = 0;
-    struct jdksavdecc_descriptor_storage_symbol_dispatch_item key;
-    void *p;
 
-    key.symbol = symbol;
-    key.aecp_message_type = aecp_message_type;
-    key.aem_command_type = aem_command_type;
+    if ( self->num_hash_slots > 0 )
+    {
+        // probe from the key's slot until the item or an empty slot
+        int slot = jdksavdecc_descriptor_storage_symbols_hash( self, symbol, aecp_message_type, aem_command_type );
+        while ( self->hash_slots[slot] != 0 )
+        {
+            struct jdksavdecc_descriptor_storage_symbol_dispatch_item *item;
+            item = &self->dispatch_items[self->hash_slots[slot] - 1];
+            if ( item->symbol == symbol && item->aecp_message_type == aecp_message_type
+                 && item->aem_command_type == aem_command_type )
+            {
+                r = item->handler;
+                break;
+            }
+            slot = ( slot + 1 ) & ( self->num_hash_slots - 1 );
+        }
+    }
+    else
+    {
+        struct jdksavdecc_descriptor_storage_symbol_dispatch_item key;
+        void *p;
 
-    p = bsearch( &key,
-                 self->dispatch_items,
-                 self->num_items,
-                 sizeof( key ),
-                 jdksavdecc_descriptor_storage_symbol_dispatch_item_compare );
+        key.symbol = symbol;
+        key.aecp_message_type = aecp_message_type;
+        key.aem_command_type = aem_command_type;
 
-    if ( p )
-    {
-        struct jdksavdecc_descriptor_storage_symbol_dispatch_item *result;
-        result = (struct jdksavdecc_descriptor_storage_symbol_dispatch_item *)p;
-        r = result->handler;
+        p = bsearch( &key,
+                     self->dispatch_items,
+                     self->num_items,
+                     sizeof( key ),
+                     jdksavdecc_descriptor_storage_symbol_dispatch_item_compare );
+
+        if ( p )
+        {
+            struct jdksavdecc_descriptor_storage_symbol_dispatch_item *result;
+            result = (struct jdksavdecc_descriptor_storage_symbol_dispatch_item *)p;
+            r = result->handler;
+        }
     }
 
     return r;
 }
-
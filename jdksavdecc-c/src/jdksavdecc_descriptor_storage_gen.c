@@ -32,7 +32,235 @@
 #include "jdksavdecc_world.h"
 #include "jdksavdecc_descriptor_storage_gen.h"
 
-#ifdef TODO
+static uint64_t jdksavdecc_descriptor_storage_gen_item_key( uint8_t const *toc, uint32_t item )
+{
+    ssize_t pos = JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH * item;
+    uint16_t configuration_index
+        = jdksavdecc_uint16_get( toc, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_CONFIGURATION_INDEX_OFFSET );
+    uint16_t descriptor_type = jdksavdecc_uint16_get( toc, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_DESCRIPTOR_TYPE_OFFSET );
+    uint16_t descriptor_index = jdksavdecc_uint16_get( toc, pos + JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_DESCRIPTOR_INDEX_OFFSET );
+
+    return ( ( (uint64_t)configuration_index ) << 32 ) + ( ( (uint64_t)descriptor_type ) << 16 ) + descriptor_index;
+}
+
+static uint32_t jdksavdecc_descriptor_storage_gen_item_hash( uint64_t key, uint32_t seed )
+{
+    return jdksavdecc_descriptor_storage_index_hash(
+        (uint16_t)( key >> 32 ), (uint16_t)( key >> 16 ), (uint16_t)key, seed );
+}
+
+uint32_t jdksavdecc_descriptor_storage_gen_build_index( uint8_t const *toc,
+                                                        uint32_t toc_count,
+                                                        uint8_t *index_buffer,
+                                                        uint32_t index_buffer_length )
+{
+    uint32_t r = 0;
+    uint32_t bucket_count = jdksavdecc_descriptor_storage_index_get_bucket_count( toc_count );
+    uint32_t length = jdksavdecc_descriptor_storage_index_get_length( toc_count );
+    uint64_t *keys;
+    uint32_t *bucket_start;
+    uint32_t *bucket_items;
+    uint32_t *bucket_order;
+    uint32_t *size_start;
+    uint32_t *slots;
+    uint32_t *bucket_slots;
+    uint32_t i;
+    bool ok = true;
+
+    if ( toc_count == 0 || length > index_buffer_length )
+    {
+        return 0;
+    }
+
+    keys = (uint64_t *)malloc( sizeof( uint64_t ) * toc_count );
+    bucket_start = (uint32_t *)calloc( bucket_count + 1, sizeof( uint32_t ) );
+    bucket_items = (uint32_t *)malloc( sizeof( uint32_t ) * toc_count );
+    bucket_order = (uint32_t *)malloc( sizeof( uint32_t ) * bucket_count );
+    size_start = (uint32_t *)calloc( toc_count + 2, sizeof( uint32_t ) );
+    slots = (uint32_t *)malloc( sizeof( uint32_t ) * toc_count );
+    bucket_slots = (uint32_t *)malloc( sizeof( uint32_t ) * toc_count );
+
+    if ( keys && bucket_start && bucket_items && bucket_order && size_start && slots && bucket_slots )
+    {
+        // The keys must be strictly increasing, the same as the binary search expects
+        for ( i = 0; i < toc_count && ok; ++i )
+        {
+            keys[i] = jdksavdecc_descriptor_storage_gen_item_key( toc, i );
+            ok = ( i == 0 || keys[i] > keys[i - 1] );
+        }
+
+        if ( ok )
+        {
+            uint32_t b;
+
+            // Group the items by bucket
+            for ( i = 0; i < toc_count; ++i )
+            {
+                ++bucket_start[jdksavdecc_descriptor_storage_gen_item_hash( keys[i], 0 ) % bucket_count + 1];
+            }
+            for ( b = 0; b < bucket_count; ++b )
+            {
+                bucket_start[b + 1] += bucket_start[b];
+            }
+            for ( i = 0; i < toc_count; ++i )
+            {
+                uint32_t bucket = jdksavdecc_descriptor_storage_gen_item_hash( keys[i], 0 ) % bucket_count;
+                bucket_items[bucket_start[bucket]++] = i;
+            }
+            for ( b = bucket_count; b > 0; --b )
+            {
+                bucket_start[b] = bucket_start[b - 1];
+            }
+            bucket_start[0] = 0;
+
+            // Place the largest buckets first, while most slots are free
+            for ( b = 0; b < bucket_count; ++b )
+            {
+                ++size_start[toc_count - ( bucket_start[b + 1] - bucket_start[b] ) + 1];
+            }
+            for ( i = 0; i <= toc_count; ++i )
+            {
+                size_start[i + 1] += size_start[i];
+            }
+            for ( b = 0; b < bucket_count; ++b )
+            {
+                bucket_order[size_start[toc_count - ( bucket_start[b + 1] - bucket_start[b] )]++] = b;
+            }
+
+            for ( i = 0; i < toc_count; ++i )
+            {
+                slots[i] = 0xffffffff;
+            }
+
+            for ( b = 0; b < bucket_count && ok; ++b )
+            {
+                uint32_t bucket = bucket_order[b];
+                uint32_t first = bucket_start[bucket];
+                uint32_t count = bucket_start[bucket + 1] - first;
+                uint32_t displacement = 0;
+
+                if ( count > 0 )
+                {
+                    bool placed = false;
+
+                    // Find a displacement that puts every key of the bucket in a free slot of its own
+                    for ( displacement = 1; displacement < 0x1000000 && !placed; ++displacement )
+                    {
+                        uint32_t k;
+                        placed = true;
+                        for ( k = 0; k < count && placed; ++k )
+                        {
+                            uint32_t j;
+                            uint32_t slot
+                                = jdksavdecc_descriptor_storage_gen_item_hash( keys[bucket_items[first + k]], displacement )
+                                  % toc_count;
+                            placed = ( slots[slot] == 0xffffffff );
+                            for ( j = 0; j < k && placed; ++j )
+                            {
+                                placed = ( bucket_slots[j] != slot );
+                            }
+                            bucket_slots[k] = slot;
+                        }
+                    }
+
+                    if ( placed )
+                    {
+                        uint32_t k;
+                        --displacement;
+                        for ( k = 0; k < count; ++k )
+                        {
+                            slots[bucket_slots[k]] = bucket_items[first + k];
+                        }
+                    }
+                    ok = placed;
+                }
+
+                jdksavdecc_uint32_set(
+                    displacement, index_buffer, JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_DISPLACEMENTS_OFFSET + 4 * bucket );
+            }
+
+            if ( ok )
+            {
+                uint32_t slots_offset = JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_DISPLACEMENTS_OFFSET + 4 * bucket_count;
+                jdksavdecc_uint32_set( bucket_count, index_buffer, JDKSAVDECC_DESCRIPTOR_STORAGE_INDEX_BUCKET_COUNT_OFFSET );
+                for ( i = 0; i < toc_count; ++i )
+                {
+                    jdksavdecc_uint32_set( slots[i], index_buffer, slots_offset + 4 * i );
+                }
+                r = length;
+            }
+        }
+    }
+
+    free( keys );
+    free( bucket_start );
+    free( bucket_items );
+    free( bucket_order );
+    free( size_start );
+    free( slots );
+    free( bucket_slots );
+    return r;
+}
+
+uint32_t jdksavdecc_descriptor_storage_gen_add_index( uint8_t const *storage,
+                                                      uint32_t storage_length,
+                                                      uint8_t *result,
+                                                      uint32_t result_length )
+{
+    uint32_t r = 0;
+    uint32_t shift = JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER2_LENGTH - JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH;
+    struct jdksavdecc_descriptor_storage_header header;
+
+    if ( jdksavdecc_descriptor_storage_header_read( &header, storage, 0, storage_length ) > 0
+         && header.magic == JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC_VALUE
+         && header.toc_offset >= JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH
+         && (uint64_t)header.toc_offset + (uint64_t)JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH * header.toc_count
+            <= storage_length )
+    {
+        // The index goes at the end, 4 octet aligned
+        uint32_t index_offset = ( storage_length + shift + 3 ) & ~3u;
+        uint64_t new_length = (uint64_t)index_offset + jdksavdecc_descriptor_storage_index_get_length( header.toc_count );
+
+        if ( new_length <= result_length )
+        {
+            uint32_t i;
+
+            // Everything after the header moves up to make room for the longer header
+            memcpy( result + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER2_LENGTH,
+                    storage + JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH,
+                    storage_length - JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH );
+            memset( result + storage_length + shift, 0, index_offset - ( storage_length + shift ) );
+
+            header.magic = JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC2_VALUE;
+            header.toc_offset += shift;
+            if ( header.symbol_offset >= JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_LENGTH )
+            {
+                header.symbol_offset += shift;
+            }
+            header.index_count = header.toc_count;
+            header.index_offset = index_offset;
+            jdksavdecc_descriptor_storage_header_write( &header, result, 0, result_length );
+
+            for ( i = 0; i < header.toc_count; ++i )
+            {
+                struct jdksavdecc_descriptor_storage_item item;
+                ssize_t pos = header.toc_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH * i;
+                jdksavdecc_descriptor_storage_item_read( &item, result, pos, result_length );
+                item.offset += shift;
+                jdksavdecc_descriptor_storage_item_write( &item, result, pos, result_length );
+            }
+
+            if ( jdksavdecc_descriptor_storage_gen_build_index( result + header.toc_offset,
+                                                                header.toc_count,
+                                                                result + index_offset,
+                                                                result_length - index_offset ) > 0 )
+            {
+                r = (uint32_t)new_length;
+            }
+        }
+    }
+    return r;
+}
 
 void jdksavdecc_descriptor_storage_gen_init( struct jdksavdecc_descriptor_storage_gen *self,
                                              struct jdksavdecc_descriptor_storage_gen_descriptor *descriptor_space,
@@ -41,12 +269,14 @@ void jdksavdecc_descriptor_storage_gen_init( struct jdksavdecc_descriptor_storag
                                              uint32_t max_symbols )
 {
     jdksavdecc_entity_model_init( &self->base );
+    self->header = 0;
     self->descriptors = descriptor_space;
     self->num_descriptors = 0;
     self->max_descriptors = max_descriptors;
     self->symbols = symbol_space;
     self->num_symbols = 0;
     self->max_symbols = max_symbols;
+    self->flags = 0;
 
     self->base.destroy = jdksavdecc_descriptor_storage_gen_destroy;
     self->base.get_configuration_count = jdksavdecc_descriptor_storage_gen_get_configuration_count;
@@ -66,13 +296,64 @@ void jdksavdecc_descriptor_storage_gen_destroy( struct jdksavdecc_entity_model *
     jdksavdecc_entity_model_destroy( self );
 }
 
+static uint64_t jdksavdecc_descriptor_storage_gen_key( uint16_t configuration_index,
+                                                       uint16_t descriptor_type,
+                                                       uint16_t descriptor_index )
+{
+    return ( ( (uint64_t)configuration_index ) << 32 ) + ( ( (uint64_t)descriptor_type ) << 16 ) + descriptor_index;
+}
+
+static uint64_t jdksavdecc_descriptor_storage_gen_symbol_key( struct jdksavdecc_descriptor_storage_gen_symbol const *s )
+{
+    return jdksavdecc_descriptor_storage_gen_key( s->configuration_index, s->descriptor_type, s->descriptor_index );
+}
+
+static int jdksavdecc_descriptor_storage_gen_compare_descriptor( const void *lhs_, const void *rhs_ )
+{
+    struct jdksavdecc_descriptor_storage_gen_descriptor const *lhs;
+    struct jdksavdecc_descriptor_storage_gen_descriptor const *rhs;
+    uint64_t lhsv;
+    uint64_t rhsv;
+
+    lhs = (struct jdksavdecc_descriptor_storage_gen_descriptor const *)lhs_;
+    rhs = (struct jdksavdecc_descriptor_storage_gen_descriptor const *)rhs_;
+    lhsv = jdksavdecc_descriptor_storage_gen_key( lhs->configuration_index, lhs->descriptor_type, lhs->descriptor_index );
+    rhsv = jdksavdecc_descriptor_storage_gen_key( rhs->configuration_index, rhs->descriptor_type, rhs->descriptor_index );
+
+    return lhsv < rhsv ? -1 : ( lhsv > rhsv ? 1 : 0 );
+}
+
+static int jdksavdecc_descriptor_storage_gen_compare_symbol( const void *lhs_, const void *rhs_ )
+{
+    struct jdksavdecc_descriptor_storage_gen_symbol const *lhs;
+    struct jdksavdecc_descriptor_storage_gen_symbol const *rhs;
+    uint64_t lhsv;
+    uint64_t rhsv;
+
+    lhs = (struct jdksavdecc_descriptor_storage_gen_symbol const *)lhs_;
+    rhs = (struct jdksavdecc_descriptor_storage_gen_symbol const *)rhs_;
+    lhsv = jdksavdecc_descriptor_storage_gen_symbol_key( lhs );
+    rhsv = jdksavdecc_descriptor_storage_gen_symbol_key( rhs );
+
+    return lhsv < rhsv ? -1 : ( lhsv > rhsv ? 1 : 0 );
+}
+
 /// Read the count of configurations in the storage object
 uint16_t jdksavdecc_descriptor_storage_gen_get_configuration_count( struct jdksavdecc_entity_model *self_ )
 {
     struct jdksavdecc_descriptor_storage_gen *self = (struct jdksavdecc_descriptor_storage_gen *)self_;
-    /* TODO: */
-    (void)self;
-    return 0;
+    uint16_t r = 0;
+    uint32_t i;
+
+    // the count of configurations is one larger than the largest configuration number
+    for ( i = 0; i < self->num_descriptors; ++i )
+    {
+        if ( self->descriptors[i].configuration_index >= r )
+        {
+            r = (uint16_t)( self->descriptors[i].configuration_index + 1 );
+        }
+    }
+    return r;
 }
 
 uint16_t jdksavdecc_descriptor_storage_gen_read_descriptor( struct jdksavdecc_entity_model *self_,
@@ -83,15 +364,16 @@ uint16_t jdksavdecc_descriptor_storage_gen_read_descriptor( struct jdksavdecc_en
                                                             uint16_t result_buffer_len )
 {
     struct jdksavdecc_descriptor_storage_gen *self = (struct jdksavdecc_descriptor_storage_gen *)self_;
-    /* TODO: */
-    (void)self;
-    (void)configuration_index;
-    (void)descriptor_type;
-    (void)descriptor_index;
-    (void)result_buffer;
-    (void)result_buffer_len;
+    uint16_t r = 0;
+    struct jdksavdecc_descriptor_storage_gen_descriptor *d
+        = self->find_descriptor( self, configuration_index, descriptor_type, descriptor_index );
 
-    return 0;
+    if ( d && d->descriptor_len <= result_buffer_len )
+    {
+        memcpy( result_buffer, d->descriptor_data.data, d->descriptor_len );
+        r = d->descriptor_len;
+    }
+    return r;
 }
 
 uint16_t jdksavdecc_descriptor_storage_gen_write_descriptor( struct jdksavdecc_entity_model *self_,
@@ -102,14 +384,14 @@ uint16_t jdksavdecc_descriptor_storage_gen_write_descriptor( struct jdksavdecc_e
                                                              uint16_t descriptor_data_len )
 {
     struct jdksavdecc_descriptor_storage_gen *self = (struct jdksavdecc_descriptor_storage_gen *)self_;
-    (void)self;
-    (void)configuration_index;
-    (void)descriptor_type;
-    (void)descriptor_index;
-    (void)descriptor_data;
-    (void)descriptor_data_len;
+    uint16_t r = 0;
 
-    return 0;
+    if ( self->add_descriptor(
+             self, configuration_index, descriptor_type, descriptor_index, descriptor_data, descriptor_data_len ) )
+    {
+        r = descriptor_data_len;
+    }
+    return r;
 }
 
 uint16_t jdksavdecc_descriptor_storage_gen_read_localized_string( struct jdksavdecc_entity_model *self_,
@@ -135,14 +417,41 @@ bool jdksavdecc_descriptor_storage_gen_add_descriptor( struct jdksavdecc_descrip
                                                        uint8_t const *descriptor_data,
                                                        uint16_t descriptor_len )
 {
-    /* TODO: */
-    (void)self;
-    (void)configuration_index;
-    (void)descriptor_type;
-    (void)descriptor_index;
-    (void)descriptor_data;
-    (void)descriptor_len;
-    return false;
+    bool r = false;
+    struct jdksavdecc_descriptor_storage_gen_descriptor *d = 0;
+    uint64_t key = jdksavdecc_descriptor_storage_gen_key( configuration_index, descriptor_type, descriptor_index );
+
+    if ( descriptor_len > sizeof( d->descriptor_data.data ) )
+    {
+        return false;
+    }
+
+    // Descriptors added in order are appended without a search
+    if ( self->num_descriptors > 0 )
+    {
+        struct jdksavdecc_descriptor_storage_gen_descriptor *last = &self->descriptors[self->num_descriptors - 1];
+        if ( key <= jdksavdecc_descriptor_storage_gen_key(
+                        last->configuration_index, last->descriptor_type, last->descriptor_index ) )
+        {
+            d = self->find_descriptor( self, configuration_index, descriptor_type, descriptor_index );
+        }
+    }
+
+    if ( !d && self->num_descriptors < self->max_descriptors )
+    {
+        d = &self->descriptors[self->num_descriptors++];
+        d->configuration_index = configuration_index;
+        d->descriptor_type = descriptor_type;
+        d->descriptor_index = descriptor_index;
+    }
+
+    if ( d )
+    {
+        memcpy( d->descriptor_data.data, descriptor_data, descriptor_len );
+        d->descriptor_len = descriptor_len;
+        r = true;
+    }
+    return r;
 }
 
 struct jdksavdecc_descriptor_storage_gen_descriptor *
@@ -151,41 +460,59 @@ struct jdksavdecc_descriptor_storage_gen_descriptor *
                                                        uint16_t descriptor_type,
                                                        uint16_t descriptor_index )
 {
-    /* TODO: */
-    (void)self;
-    (void)configuration_index;
-    (void)descriptor_type;
-    (void)descriptor_index;
-    return 0;
+    struct jdksavdecc_descriptor_storage_gen_descriptor *r = 0;
+    uint32_t i;
+
+    for ( i = 0; i < self->num_descriptors; ++i )
+    {
+        struct jdksavdecc_descriptor_storage_gen_descriptor *d = &self->descriptors[i];
+        if ( d->configuration_index == configuration_index && d->descriptor_type == descriptor_type
+             && d->descriptor_index == descriptor_index )
+        {
+            r = d;
+            break;
+        }
+    }
+    return r;
 }
 
 bool jdksavdecc_descriptor_storage_gen_add_symbol( struct jdksavdecc_descriptor_storage_gen *self,
                                                    uint16_t configuration_index,
                                                    uint16_t descriptor_type,
                                                    uint16_t descriptor_index,
-                                                   uint8_t const *descriptor_data,
-                                                   uint16_t descriptor_len )
+                                                   uint32_t symbol )
 {
-    /* TODO: */
-    (void)self;
-    (void)configuration_index;
-    (void)descriptor_type;
-    (void)descriptor_index;
-    (void)descriptor_data;
-    (void)descriptor_len;
-    return false;
+    bool r = false;
+    struct jdksavdecc_descriptor_storage_gen_symbol *s
+        = self->find_symbol( self, configuration_index, descriptor_type, descriptor_index );
+
+    if ( !s && self->num_symbols < self->max_symbols )
+    {
+        s = &self->symbols[self->num_symbols++];
+        s->configuration_index = configuration_index;
+        s->descriptor_type = descriptor_type;
+        s->descriptor_index = descriptor_index;
+    }
+
+    if ( s )
+    {
+        s->symbol = symbol;
+        r = true;
+    }
+    return r;
 }
 
 void jdksavdecc_descriptor_storage_gen_sort_descriptors( struct jdksavdecc_descriptor_storage_gen *self )
 {
-    /* TODO: */
-    (void)self;
+    qsort( self->descriptors,
+           self->num_descriptors,
+           sizeof( self->descriptors[0] ),
+           jdksavdecc_descriptor_storage_gen_compare_descriptor );
 }
 
 void jdksavdecc_descriptor_storage_gen_sort_symbols( struct jdksavdecc_descriptor_storage_gen *self )
 {
-    /* TODO: */
-    (void)self;
+    qsort( self->symbols, self->num_symbols, sizeof( self->symbols[0] ), jdksavdecc_descriptor_storage_gen_compare_symbol );
 }
 
 struct jdksavdecc_descriptor_storage_gen_symbol *
@@ -194,20 +521,179 @@ struct jdksavdecc_descriptor_storage_gen_symbol *
                                                    uint16_t descriptor_type,
                                                    uint16_t descriptor_index )
 {
-    /* TODO: */
-    (void)self;
-    (void)configuration_index;
-    (void)descriptor_type;
-    (void)descriptor_index;
-    return 0;
+    struct jdksavdecc_descriptor_storage_gen_symbol *r = 0;
+    uint32_t i;
+
+    for ( i = 0; i < self->num_symbols; ++i )
+    {
+        struct jdksavdecc_descriptor_storage_gen_symbol *s = &self->symbols[i];
+        if ( s->configuration_index == configuration_index && s->descriptor_type == descriptor_type
+             && s->descriptor_index == descriptor_index )
+        {
+            r = s;
+            break;
+        }
+    }
+    return r;
+}
+
+/// Offset of the descriptor data after the table of contents and symbols
+static uint32_t jdksavdecc_descriptor_storage_gen_get_data_offset( struct jdksavdecc_descriptor_storage_gen *self )
+{
+    uint32_t r = JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER2_LENGTH
+                 + JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH * self->num_descriptors;
+
+    if ( self->num_symbols > 0 )
+    {
+        r += JDKSAVDECC_DESCRIPTOR_STORAGE_SYMBOL_LENGTH * self->num_descriptors;
+    }
+    return ( r + 3 ) & ~3u;
+}
+
+/// Offset of the descriptor that follows the data ending at offset
+static uint32_t jdksavdecc_descriptor_storage_gen_next_offset( struct jdksavdecc_descriptor_storage_gen *self, uint32_t offset )
+{
+    if ( self->flags & JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES )
+    {
+        // each response block starts 4 octet aligned with its prefix
+        offset = ( ( offset + 3 ) & ~3u ) + JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_PREFIX_LENGTH;
+    }
+    return offset;
+}
+
+uint32_t jdksavdecc_descriptor_storage_gen_get_export_length( struct jdksavdecc_descriptor_storage_gen *self )
+{
+    uint32_t offset = jdksavdecc_descriptor_storage_gen_get_data_offset( self );
+    uint32_t i;
+
+    for ( i = 0; i < self->num_descriptors; ++i )
+    {
+        offset = jdksavdecc_descriptor_storage_gen_next_offset( self, offset ) + self->descriptors[i].descriptor_len;
+    }
+    return ( ( offset + 3 ) & ~3u ) + jdksavdecc_descriptor_storage_index_get_length( self->num_descriptors );
+}
+
+uint32_t jdksavdecc_descriptor_storage_gen_export_buffer( struct jdksavdecc_descriptor_storage_gen *self,
+                                                          uint8_t *result,
+                                                          uint32_t result_length )
+{
+    uint32_t r = 0;
+    uint32_t length = jdksavdecc_descriptor_storage_gen_get_export_length( self );
+
+    if ( self->num_descriptors > 0 && length <= result_length )
+    {
+        struct jdksavdecc_descriptor_storage_header header;
+        uint32_t offset = jdksavdecc_descriptor_storage_gen_get_data_offset( self );
+        uint32_t s = 0;
+        uint32_t i;
+
+        self->sort_descriptors( self );
+        self->sort_symbols( self );
+        memset( result, 0, length );
+
+        header.magic = JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER_MAGIC2_VALUE;
+        header.toc_count = self->num_descriptors;
+        header.toc_offset = JDKSAVDECC_DESCRIPTOR_STORAGE_HEADER2_LENGTH;
+        header.symbol_count = self->num_symbols > 0 ? self->num_descriptors : 0;
+        header.symbol_offset = self->num_symbols > 0
+                                   ? header.toc_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH * self->num_descriptors
+                                   : 0;
+        header.index_count = self->num_descriptors;
+        header.index_offset = length - jdksavdecc_descriptor_storage_index_get_length( self->num_descriptors );
+        header.flags = ( self->flags & JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES )
+                       | ( self->num_symbols > 0 ? JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_TOC_SYMBOLS : 0 );
+        jdksavdecc_descriptor_storage_header_write( &header, result, 0, result_length );
+
+        for ( i = 0; i < self->num_descriptors; ++i )
+        {
+            struct jdksavdecc_descriptor_storage_gen_descriptor const *d = &self->descriptors[i];
+            struct jdksavdecc_descriptor_storage_item item;
+            uint64_t key
+                = jdksavdecc_descriptor_storage_gen_key( d->configuration_index, d->descriptor_type, d->descriptor_index );
+
+            offset = jdksavdecc_descriptor_storage_gen_next_offset( self, offset );
+
+            item.configuration_index = d->configuration_index;
+            item.descriptor_type = d->descriptor_type;
+            item.descriptor_index = d->descriptor_index;
+            item.length = d->descriptor_len;
+            item.offset = offset;
+            jdksavdecc_descriptor_storage_item_write(
+                &item, result, header.toc_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_ITEM_LENGTH * i, result_length );
+
+            if ( header.flags & JDKSAVDECC_DESCRIPTOR_STORAGE_FLAG_RESPONSES )
+            {
+                uint32_t prefix = offset - JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_PREFIX_LENGTH;
+                jdksavdecc_uint16_set( jdksavdecc_descriptor_storage_response_get_control_data_length( d->descriptor_len ),
+                                       result,
+                                       prefix + JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_CONTROL_DATA_LENGTH_OFFSET );
+                jdksavdecc_uint16_set( d->configuration_index,
+                                       result,
+                                       prefix + JDKSAVDECC_DESCRIPTOR_STORAGE_RESPONSE_CONFIGURATION_INDEX_OFFSET );
+            }
+            memcpy( result + offset, d->descriptor_data.data, d->descriptor_len );
+            offset += d->descriptor_len;
+
+            if ( header.symbol_count > 0 )
+            {
+                // Both are sorted, so the descriptor's symbol is the next one not before it
+                struct jdksavdecc_descriptor_storage_symbol symbol;
+                while ( s < self->num_symbols && jdksavdecc_descriptor_storage_gen_symbol_key( &self->symbols[s] ) < key )
+                {
+                    ++s;
+                }
+                symbol.configuration_index = d->configuration_index;
+                symbol.descriptor_type = d->descriptor_type;
+                symbol.descriptor_index = d->descriptor_index;
+                symbol.symbol = 0;
+                if ( s < self->num_symbols && jdksavdecc_descriptor_storage_gen_symbol_key( &self->symbols[s] ) == key )
+                {
+                    symbol.symbol = self->symbols[s].symbol;
+                }
+                jdksavdecc_descriptor_storage_symbol_write(
+                    &symbol, result, header.symbol_offset + JDKSAVDECC_DESCRIPTOR_STORAGE_SYMBOL_LENGTH * i, result_length );
+            }
+        }
+
+        if ( jdksavdecc_descriptor_storage_gen_build_index( result + header.toc_offset,
+                                                            header.toc_count,
+                                                            result + header.index_offset,
+                                                            result_length - header.index_offset ) > 0 )
+        {
+            r = length;
+        }
+    }
+    return r;
 }
 
 int jdksavdecc_descriptor_storage_gen_export_binary( struct jdksavdecc_descriptor_storage_gen *self, const char *fname )
 {
-    /* TODO: */
-    (void)self;
-    (void)fname;
-    return 0;
+    int r = -1;
+    uint32_t length = jdksavdecc_descriptor_storage_gen_get_export_length( self );
+    uint8_t *buffer = (uint8_t *)malloc( length );
+
+    if ( buffer && jdksavdecc_descriptor_storage_gen_export_buffer( self, buffer, length ) == length )
+    {
+#if defined( WIN32 )
+        FILE *f;
+        fopen_s( &f, fname, "wb" );
+#else
+        FILE *f = fopen( fname, "wb" );
+#endif
+        if ( f )
+        {
+            if ( fwrite( buffer, 1, length, f ) == length )
+            {
+                r = 0;
+            }
+            if ( fclose( f ) != 0 )
+            {
+                r = -1;
+            }
+        }
+    }
+    free( buffer );
+    return r;
 }
 
 int jdksavdecc_descriptor_storage_gen_export_c( struct jdksavdecc_descriptor_storage_gen *self,
@@ -230,7 +716,3 @@ int jdksavdecc_descriptor_storage_gen_export_c( struct jdksavdecc_descriptor_sto
     (void)fname_h;
     return 0;
 }
-#else
-const char *jdksavdecc_descriptor_storage_gen_file = __FILE__;
-
-#endif
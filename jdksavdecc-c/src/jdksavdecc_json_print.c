@@ -0,0 +1,591 @@
+/*
+  Copyright (c) 2013, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jdksavdecc_world.h"
+#include "jdksavdecc_json_print.h"
+#include "jdksavdecc_pdu.h"
+#include "jdksavdecc_aecp_aa.h"
+#include "jdksavdecc_aecp_aem.h"
+#include "jdksavdecc_adp_print.h"
+#include "jdksavdecc_acmp_print.h"
+#include "jdksavdecc_aecp_print.h"
+#include "jdksavdecc_aem_print.h"
+
+#define JDKSAVDECC_JSON_HEX_ROW( h )                                                                                          \
+    h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" h "8" h "9" h "A" h "B" h "C" h "D" h "E" h "F"
+
+#define JDKSAVDECC_JSON_DEC_ROW( d ) d "0" d "1" d "2" d "3" d "4" d "5" d "6" d "7" d "8" d "9"
+
+/** The two hex digits of every octet value */
+static char const jdksavdecc_json_hex_pairs[] = JDKSAVDECC_JSON_HEX_ROW( "0" )
+    JDKSAVDECC_JSON_HEX_ROW( "1" )
+    JDKSAVDECC_JSON_HEX_ROW( "2" )
+    JDKSAVDECC_JSON_HEX_ROW( "3" )
+    JDKSAVDECC_JSON_HEX_ROW( "4" )
+    JDKSAVDECC_JSON_HEX_ROW( "5" )
+    JDKSAVDECC_JSON_HEX_ROW( "6" )
+    JDKSAVDECC_JSON_HEX_ROW( "7" )
+    JDKSAVDECC_JSON_HEX_ROW( "8" )
+    JDKSAVDECC_JSON_HEX_ROW( "9" )
+    JDKSAVDECC_JSON_HEX_ROW( "A" )
+    JDKSAVDECC_JSON_HEX_ROW( "B" )
+    JDKSAVDECC_JSON_HEX_ROW( "C" )
+    JDKSAVDECC_JSON_HEX_ROW( "D" )
+    JDKSAVDECC_JSON_HEX_ROW( "E" )
+    JDKSAVDECC_JSON_HEX_ROW( "F" );
+
+/** The two decimal digits of 0 to 99 */
+static char const jdksavdecc_json_dec_pairs[] = JDKSAVDECC_JSON_DEC_ROW( "0" )
+    JDKSAVDECC_JSON_DEC_ROW( "1" )
+    JDKSAVDECC_JSON_DEC_ROW( "2" )
+    JDKSAVDECC_JSON_DEC_ROW( "3" )
+    JDKSAVDECC_JSON_DEC_ROW( "4" )
+    JDKSAVDECC_JSON_DEC_ROW( "5" )
+    JDKSAVDECC_JSON_DEC_ROW( "6" )
+    JDKSAVDECC_JSON_DEC_ROW( "7" )
+    JDKSAVDECC_JSON_DEC_ROW( "8" )
+    JDKSAVDECC_JSON_DEC_ROW( "9" );
+
+/* The room for the text has been made, nothing below checks it */
+
+static inline void jdksavdecc_json_put( struct jdksavdecc_json_printer *self, char const *s, size_t len )
+{
+    memcpy( self->buf + self->pos, s, len );
+    self->pos += len;
+}
+
+/** Append a string literal, its length is known when compiling */
+#define JDKSAVDECC_JSON_PUT_LITERAL( self, s ) jdksavdecc_json_put( ( self ), ( s ), sizeof( s ) - 1 )
+
+static inline void jdksavdecc_json_put_string( struct jdksavdecc_json_printer *self, char const *s )
+{
+    self->buf[self->pos++] = '\"';
+    jdksavdecc_json_put( self, s, strlen( s ) );
+    self->buf[self->pos++] = '\"';
+}
+
+static void jdksavdecc_json_put_uint( struct jdksavdecc_json_printer *self, uint64_t v )
+{
+    char tmp[20];
+    size_t n = sizeof( tmp );
+    unsigned i;
+
+    while ( v >= 100 )
+    {
+        i = (unsigned)( v % 100 ) * 2;
+        v /= 100;
+        tmp[--n] = jdksavdecc_json_dec_pairs[i + 1];
+        tmp[--n] = jdksavdecc_json_dec_pairs[i];
+    }
+    if ( v >= 10 )
+    {
+        i = (unsigned)v * 2;
+        tmp[--n] = jdksavdecc_json_dec_pairs[i + 1];
+        tmp[--n] = jdksavdecc_json_dec_pairs[i];
+    }
+    else
+    {
+        tmp[--n] = (char)( '0' + v );
+    }
+    jdksavdecc_json_put( self, tmp + n, sizeof( tmp ) - n );
+}
+
+static inline void jdksavdecc_json_put_hex_octet( struct jdksavdecc_json_printer *self, uint8_t v )
+{
+    self->buf[self->pos++] = jdksavdecc_json_hex_pairs[v * 2];
+    self->buf[self->pos++] = jdksavdecc_json_hex_pairs[v * 2 + 1];
+}
+
+static void jdksavdecc_json_put_hex_octets( struct jdksavdecc_json_printer *self, uint8_t const *p, size_t len )
+{
+    char *out = self->buf + self->pos;
+    size_t i;
+    for ( i = 0; i < len; ++i )
+    {
+        memcpy( out + i * 2, jdksavdecc_json_hex_pairs + p[i] * 2, 2 );
+    }
+    self->pos += len * 2;
+}
+
+static void jdksavdecc_json_put_eui48( struct jdksavdecc_json_printer *self, struct jdksavdecc_eui48 const *v )
+{
+    size_t i;
+    self->buf[self->pos++] = '\"';
+    for ( i = 0; i < sizeof( v->value ); ++i )
+    {
+        if ( i )
+        {
+            self->buf[self->pos++] = '-';
+        }
+        jdksavdecc_json_put_hex_octet( self, v->value[i] );
+    }
+    self->buf[self->pos++] = '\"';
+}
+
+static void jdksavdecc_json_put_eui64( struct jdksavdecc_json_printer *self, struct jdksavdecc_eui64 const *v )
+{
+    size_t i;
+    self->buf[self->pos++] = '\"';
+    for ( i = 0; i < sizeof( v->value ); ++i )
+    {
+        if ( i )
+        {
+            self->buf[self->pos++] = ':';
+        }
+        jdksavdecc_json_put_hex_octet( self, v->value[i] );
+    }
+    self->buf[self->pos++] = '\"';
+}
+
+/** The name of the value as a string, or the value as a number if it has no name */
+static inline void jdksavdecc_json_put_name( struct jdksavdecc_json_printer *self,
+                                             struct jdksavdecc_uint16_name_index const *index,
+                                             uint16_t v )
+{
+    char const *name = jdksavdecc_uint16_name_index_get( index, v );
+    if ( name )
+    {
+        jdksavdecc_json_put_string( self, name );
+    }
+    else
+    {
+        jdksavdecc_json_put_uint( self, v );
+    }
+}
+
+/** An array of the names of the bits set, the bits without a name as hex strings */
+static void jdksavdecc_json_put_bits( struct jdksavdecc_json_printer *self,
+                                      struct jdksavdecc_bit_name_index const *index,
+                                      uint32_t v )
+{
+    int bit;
+    int first = 1;
+
+    self->buf[self->pos++] = '[';
+    for ( bit = 0; v; ++bit, v >>= 1 )
+    {
+        if ( v & 1 )
+        {
+            if ( !first )
+            {
+                self->buf[self->pos++] = ',';
+            }
+            first = 0;
+            if ( index->by_bit[bit] )
+            {
+                jdksavdecc_json_put_string( self, index->by_bit[bit] );
+            }
+            else
+            {
+                uint32_t mask = (uint32_t)1 << bit;
+                JDKSAVDECC_JSON_PUT_LITERAL( self, "\"0x" );
+                jdksavdecc_json_put_hex_octet( self, (uint8_t)( mask >> 24 ) );
+                jdksavdecc_json_put_hex_octet( self, (uint8_t)( mask >> 16 ) );
+                jdksavdecc_json_put_hex_octet( self, (uint8_t)( mask >> 8 ) );
+                jdksavdecc_json_put_hex_octet( self, (uint8_t)mask );
+                self->buf[self->pos++] = '\"';
+            }
+        }
+    }
+    self->buf[self->pos++] = ']';
+}
+
+/** The octets of the PDU after its header as a hex string */
+static void jdksavdecc_json_put_payload( struct jdksavdecc_json_printer *self,
+                                         uint8_t const *p,
+                                         size_t pos,
+                                         size_t len,
+                                         size_t header_len,
+                                         uint16_t control_data_length )
+{
+    size_t start = pos + header_len;
+    size_t end = pos + JDKSAVDECC_COMMON_CONTROL_HEADER_LEN + control_data_length;
+
+    if ( end > len )
+    {
+        end = len;
+    }
+    if ( end > start )
+    {
+        if ( end - start > JDKSAVDECC_JSON_PRINTER_MAX_PAYLOAD )
+        {
+            end = start + JDKSAVDECC_JSON_PRINTER_MAX_PAYLOAD;
+        }
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"payload\":\"" );
+        jdksavdecc_json_put_hex_octets( self, p + start, end - start );
+        self->buf[self->pos++] = '\"';
+    }
+}
+
+/** Flush if there is not enough room for len more octets, return non zero if there is room */
+static int jdksavdecc_json_make_room( struct jdksavdecc_json_printer *self, size_t len )
+{
+    if ( self->max_len - self->pos < len + 1 )
+    {
+        jdksavdecc_json_printer_flush( self );
+    }
+    return self->max_len - self->pos >= len + 1;
+}
+
+void jdksavdecc_json_printer_init( struct jdksavdecc_json_printer *self,
+                                   char *buf,
+                                   size_t max_len,
+                                   int ndjson,
+                                   jdksavdecc_json_printer_flush_proc flush,
+                                   void *context )
+{
+    self->buf = buf;
+    self->max_len = max_len;
+    self->pos = 0;
+    self->ndjson = ndjson;
+    self->count = 0;
+    self->flush_errors = 0;
+    self->flush = flush;
+    self->context = context;
+
+    jdksavdecc_uint16_name_index_init( &self->adp_message_type,
+                                       jdksavdecc_adpdu_print_message_type,
+                                       self->adp_message_type_names,
+                                       sizeof( self->adp_message_type_names ) / sizeof( self->adp_message_type_names[0] ) );
+    jdksavdecc_uint16_name_index_init( &self->acmp_message_type,
+                                       jdksavdecc_acmpdu_print_message_type,
+                                       self->acmp_message_type_names,
+                                       sizeof( self->acmp_message_type_names ) / sizeof( self->acmp_message_type_names[0] ) );
+    jdksavdecc_uint16_name_index_init( &self->acmp_status,
+                                       jdksavdecc_acmpdu_print_status,
+                                       self->acmp_status_names,
+                                       sizeof( self->acmp_status_names ) / sizeof( self->acmp_status_names[0] ) );
+    jdksavdecc_uint16_name_index_init( &self->aecp_message_type,
+                                       jdksavdecc_aecp_print_message_type,
+                                       self->aecp_message_type_names,
+                                       sizeof( self->aecp_message_type_names ) / sizeof( self->aecp_message_type_names[0] ) );
+    jdksavdecc_uint16_name_index_init( &self->aem_status,
+                                       jdksavdecc_aecp_aem_print_status,
+                                       self->aem_status_names,
+                                       sizeof( self->aem_status_names ) / sizeof( self->aem_status_names[0] ) );
+    jdksavdecc_uint16_name_index_init( &self->aa_status,
+                                       jdksavdecc_aecp_aa_print_status,
+                                       self->aa_status_names,
+                                       sizeof( self->aa_status_names ) / sizeof( self->aa_status_names[0] ) );
+    jdksavdecc_uint16_name_index_init( &self->aem_command,
+                                       jdksavdecc_aem_print_command,
+                                       self->aem_command_names,
+                                       sizeof( self->aem_command_names ) / sizeof( self->aem_command_names[0] ) );
+
+    jdksavdecc_bit_name_index_init_32bit( &self->entity_capabilities, jdksavdecc_adpdu_print_entity_capabilities );
+    jdksavdecc_bit_name_index_init_16bit( &self->talker_capabilities, jdksavdecc_adpdu_print_talker_capabilities );
+    jdksavdecc_bit_name_index_init_16bit( &self->listener_capabilities, jdksavdecc_adpdu_print_listener_capabilities );
+    jdksavdecc_bit_name_index_init_32bit( &self->controller_capabilities, jdksavdecc_adpdu_print_controller_capabilities );
+    jdksavdecc_bit_name_index_init_16bit( &self->acmp_flags, jdksavdecc_acmpdu_print_flags );
+}
+
+void jdksavdecc_json_printer_flush( struct jdksavdecc_json_printer *self )
+{
+    if ( self->pos > 0 && self->flush )
+    {
+        if ( !self->flush( self->context, self->buf, self->pos ) )
+        {
+            self->flush_errors++;
+        }
+        self->pos = 0;
+    }
+}
+
+void jdksavdecc_json_printer_finish( struct jdksavdecc_json_printer *self )
+{
+    if ( !self->ndjson && jdksavdecc_json_make_room( self, 8 ) )
+    {
+        if ( self->count == 0 )
+        {
+            self->buf[self->pos++] = '[';
+        }
+        JDKSAVDECC_JSON_PUT_LITERAL( self, "\n]\n" );
+    }
+    jdksavdecc_json_printer_flush( self );
+}
+
+static void jdksavdecc_json_print_adpdu( struct jdksavdecc_json_printer *self, uint8_t const *p, size_t pos, size_t len )
+{
+    struct jdksavdecc_adpdu adpdu;
+
+    JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"subtype\":\"ADP\"" );
+    if ( jdksavdecc_adpdu_read( &adpdu, p, (ssize_t)pos, len ) > 0 )
+    {
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"message_type\":" );
+        jdksavdecc_json_put_name( self, &self->adp_message_type, (uint16_t)adpdu.header.message_type );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"valid_time\":" );
+        jdksavdecc_json_put_uint( self, adpdu.header.valid_time );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"control_data_length\":" );
+        jdksavdecc_json_put_uint( self, adpdu.header.control_data_length );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"entity_id\":" );
+        jdksavdecc_json_put_eui64( self, &adpdu.header.entity_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"entity_model_id\":" );
+        jdksavdecc_json_put_eui64( self, &adpdu.entity_model_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"entity_capabilities\":" );
+        jdksavdecc_json_put_bits( self, &self->entity_capabilities, adpdu.entity_capabilities );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"talker_stream_sources\":" );
+        jdksavdecc_json_put_uint( self, adpdu.talker_stream_sources );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"talker_capabilities\":" );
+        jdksavdecc_json_put_bits( self, &self->talker_capabilities, adpdu.talker_capabilities );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"listener_stream_sinks\":" );
+        jdksavdecc_json_put_uint( self, adpdu.listener_stream_sinks );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"listener_capabilities\":" );
+        jdksavdecc_json_put_bits( self, &self->listener_capabilities, adpdu.listener_capabilities );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"controller_capabilities\":" );
+        jdksavdecc_json_put_bits( self, &self->controller_capabilities, adpdu.controller_capabilities );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"available_index\":" );
+        jdksavdecc_json_put_uint( self, adpdu.available_index );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"gptp_grandmaster_id\":" );
+        jdksavdecc_json_put_eui64( self, &adpdu.gptp_grandmaster_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"gptp_domain_number\":" );
+        jdksavdecc_json_put_uint( self, adpdu.gptp_domain_number );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"identify_control_index\":" );
+        jdksavdecc_json_put_uint( self, adpdu.identify_control_index );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"interface_index\":" );
+        jdksavdecc_json_put_uint( self, adpdu.interface_index );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"association_id\":" );
+        jdksavdecc_json_put_eui64( self, &adpdu.association_id );
+    }
+    else
+    {
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"malformed\":true" );
+    }
+}
+
+static void jdksavdecc_json_print_acmpdu( struct jdksavdecc_json_printer *self, uint8_t const *p, size_t pos, size_t len )
+{
+    struct jdksavdecc_acmpdu acmpdu;
+
+    JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"subtype\":\"ACMP\"" );
+    if ( jdksavdecc_acmpdu_read( &acmpdu, p, (ssize_t)pos, len ) > 0 )
+    {
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"message_type\":" );
+        jdksavdecc_json_put_name( self, &self->acmp_message_type, (uint16_t)acmpdu.header.message_type );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"status\":" );
+        jdksavdecc_json_put_name( self, &self->acmp_status, (uint16_t)acmpdu.header.status );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"control_data_length\":" );
+        jdksavdecc_json_put_uint( self, acmpdu.header.control_data_length );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"stream_id\":" );
+        jdksavdecc_json_put_eui64( self, &acmpdu.header.stream_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"controller_entity_id\":" );
+        jdksavdecc_json_put_eui64( self, &acmpdu.controller_entity_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"talker_entity_id\":" );
+        jdksavdecc_json_put_eui64( self, &acmpdu.talker_entity_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"listener_entity_id\":" );
+        jdksavdecc_json_put_eui64( self, &acmpdu.listener_entity_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"talker_unique_id\":" );
+        jdksavdecc_json_put_uint( self, acmpdu.talker_unique_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"listener_unique_id\":" );
+        jdksavdecc_json_put_uint( self, acmpdu.listener_unique_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"stream_dest_mac\":" );
+        jdksavdecc_json_put_eui48( self, &acmpdu.stream_dest_mac );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"connection_count\":" );
+        jdksavdecc_json_put_uint( self, acmpdu.connection_count );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"sequence_id\":" );
+        jdksavdecc_json_put_uint( self, acmpdu.sequence_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"flags\":" );
+        jdksavdecc_json_put_bits( self, &self->acmp_flags, acmpdu.flags );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"stream_vlan_id\":" );
+        jdksavdecc_json_put_uint( self, acmpdu.stream_vlan_id );
+    }
+    else
+    {
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"malformed\":true" );
+    }
+}
+
+static void jdksavdecc_json_print_aecpdu( struct jdksavdecc_json_printer *self, uint8_t const *p, size_t pos, size_t len )
+{
+    struct jdksavdecc_aecpdu_common aecpdu;
+
+    JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"subtype\":\"AECP\"" );
+    if ( jdksavdecc_aecpdu_common_read( &aecpdu, p, (ssize_t)pos, len ) > 0 )
+    {
+        uint8_t message_type = aecpdu.header.message_type;
+        uint16_t control_data_length = aecpdu.header.control_data_length;
+
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"message_type\":" );
+        jdksavdecc_json_put_name( self, &self->aecp_message_type, message_type );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"status\":" );
+        switch ( message_type )
+        {
+        case JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND:
+        case JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE:
+            jdksavdecc_json_put_name( self, &self->aem_status, aecpdu.header.status );
+            break;
+        case JDKSAVDECC_AECP_MESSAGE_TYPE_ADDRESS_ACCESS_COMMAND:
+        case JDKSAVDECC_AECP_MESSAGE_TYPE_ADDRESS_ACCESS_RESPONSE:
+            jdksavdecc_json_put_name( self, &self->aa_status, aecpdu.header.status );
+            break;
+        default:
+            jdksavdecc_json_put_uint( self, aecpdu.header.status );
+            break;
+        }
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"control_data_length\":" );
+        jdksavdecc_json_put_uint( self, control_data_length );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"target_entity_id\":" );
+        jdksavdecc_json_put_eui64( self, &aecpdu.header.target_entity_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"controller_entity_id\":" );
+        jdksavdecc_json_put_eui64( self, &aecpdu.controller_entity_id );
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"sequence_id\":" );
+        jdksavdecc_json_put_uint( self, aecpdu.sequence_id );
+
+        if ( ( message_type == JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND
+               || message_type == JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE ) && len >= pos + JDKSAVDECC_AECPDU_AEM_LEN )
+        {
+            uint16_t command_type = jdksavdecc_aecpdu_aem_get_command_type( p, (ssize_t)pos );
+            if ( command_type & 0x8000 )
+            {
+                JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"unsolicited\":true" );
+            }
+            JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"command_type\":" );
+            jdksavdecc_json_put_name( self, &self->aem_command, (uint16_t)( command_type & 0x7fff ) );
+            jdksavdecc_json_put_payload( self, p, pos, len, JDKSAVDECC_AECPDU_AEM_LEN, control_data_length );
+        }
+        else if ( ( message_type == JDKSAVDECC_AECP_MESSAGE_TYPE_ADDRESS_ACCESS_COMMAND
+                    || message_type == JDKSAVDECC_AECP_MESSAGE_TYPE_ADDRESS_ACCESS_RESPONSE )
+                  && len >= pos + JDKSAVDECC_AECPDU_AA_LEN )
+        {
+            JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"tlv_count\":" );
+            jdksavdecc_json_put_uint( self, jdksavdecc_aecp_aa_get_tlv_count( p, (ssize_t)pos ) );
+            jdksavdecc_json_put_payload( self, p, pos, len, JDKSAVDECC_AECPDU_AA_LEN, control_data_length );
+        }
+        else
+        {
+            jdksavdecc_json_put_payload( self, p, pos, len, JDKSAVDECC_AECPDU_COMMON_LEN, control_data_length );
+        }
+    }
+    else
+    {
+        JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"malformed\":true" );
+    }
+}
+
+int jdksavdecc_json_printer_print_pdu( struct jdksavdecc_json_printer *self,
+                                       uint64_t timestamp_in_microseconds,
+                                       struct jdksavdecc_eui48 const *src,
+                                       struct jdksavdecc_eui48 const *dest,
+                                       uint8_t const *p,
+                                       size_t pos,
+                                       size_t len )
+{
+    int r = 0;
+    uint8_t subtype = pos < len ? p[pos] : 0;
+
+    if ( subtype == JDKSAVDECC_1722A_SUBTYPE_ADP || subtype == JDKSAVDECC_1722A_SUBTYPE_AECP
+         || subtype == JDKSAVDECC_1722A_SUBTYPE_ACMP )
+    {
+        size_t payload_len = len - pos;
+        if ( payload_len > JDKSAVDECC_JSON_PRINTER_MAX_PAYLOAD )
+        {
+            payload_len = JDKSAVDECC_JSON_PRINTER_MAX_PAYLOAD;
+        }
+
+        if ( jdksavdecc_json_make_room( self, JDKSAVDECC_JSON_PRINTER_PDU_RESERVE + payload_len * 2 ) )
+        {
+            if ( !self->ndjson )
+            {
+                if ( self->count == 0 )
+                {
+                    JDKSAVDECC_JSON_PUT_LITERAL( self, "[\n" );
+                }
+                else
+                {
+                    JDKSAVDECC_JSON_PUT_LITERAL( self, ",\n" );
+                }
+            }
+            JDKSAVDECC_JSON_PUT_LITERAL( self, "{\"time\":" );
+            jdksavdecc_json_put_uint( self, timestamp_in_microseconds );
+            if ( src )
+            {
+                JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"src\":" );
+                jdksavdecc_json_put_eui48( self, src );
+            }
+            if ( dest )
+            {
+                JDKSAVDECC_JSON_PUT_LITERAL( self, ",\"dest\":" );
+                jdksavdecc_json_put_eui48( self, dest );
+            }
+
+            if ( subtype == JDKSAVDECC_1722A_SUBTYPE_ADP )
+            {
+                jdksavdecc_json_print_adpdu( self, p, pos, len );
+            }
+            else if ( subtype == JDKSAVDECC_1722A_SUBTYPE_ACMP )
+            {
+                jdksavdecc_json_print_acmpdu( self, p, pos, len );
+            }
+            else
+            {
+                jdksavdecc_json_print_aecpdu( self, p, pos, len );
+            }
+
+            self->buf[self->pos++] = '}';
+            if ( self->ndjson )
+            {
+                self->buf[self->pos++] = '\n';
+            }
+            self->buf[self->pos] = '\0';
+            self->count++;
+            r = 1;
+        }
+    }
+    return r;
+}
+
+int jdksavdecc_json_printer_print_frame( struct jdksavdecc_json_printer *self,
+                                         uint64_t timestamp_in_microseconds,
+                                         uint8_t const *frame,
+                                         size_t len )
+{
+    int r = 0;
+    size_t pos = JDKSAVDECC_FRAME_HEADER_ETHERTYPE_OFFSET;
+
+    if ( len > pos + 2 )
+    {
+        uint16_t ethertype = jdksavdecc_uint16_get( frame, (ssize_t)pos );
+
+        /* One VLAN tag */
+        if ( ethertype == 0x8100 && len > pos + 6 )
+        {
+            pos += 4;
+            ethertype = jdksavdecc_uint16_get( frame, (ssize_t)pos );
+        }
+
+        if ( ethertype == JDKSAVDECC_AVTP_ETHERTYPE )
+        {
+            struct jdksavdecc_eui48 dest = jdksavdecc_eui48_get( frame, JDKSAVDECC_FRAME_HEADER_DA_OFFSET );
+            struct jdksavdecc_eui48 src = jdksavdecc_eui48_get( frame, JDKSAVDECC_FRAME_HEADER_SA_OFFSET );
+            r = jdksavdecc_json_printer_print_pdu( self, timestamp_in_microseconds, &src, &dest, frame, pos + 2, len );
+        }
+    }
+    return r;
+}
@@ -643,3 +643,71 @@ void jdksavdecc_printer_print_eui64_name( struct jdksavdecc_printer *self,
         jdksavdecc_printer_print( self, s );
     }
 }
+
+void jdksavdecc_uint16_name_index_init( struct jdksavdecc_uint16_name_index *self,
+                                        struct jdksavdecc_uint16_name const names[],
+                                        char const **by_value,
+                                        uint16_t count )
+{
+    size_t i;
+
+    self->names = names;
+    self->by_value = by_value;
+    self->count = count;
+
+    for ( i = 0; i < count; ++i )
+    {
+        by_value[i] = 0;
+    }
+
+    /* The first name wins, as when scanning the table */
+    for ( i = 0; names[i].name; ++i )
+    {
+        if ( names[i].value < count && !by_value[names[i].value] )
+        {
+            by_value[names[i].value] = names[i].name;
+        }
+    }
+}
+
+static int jdksavdecc_bit_name_index_lowest_bit( uint32_t v )
+{
+    int bit = 0;
+    while ( bit < 32 && !( v & ( (uint32_t)1 << bit ) ) )
+    {
+        ++bit;
+    }
+    return bit;
+}
+
+void jdksavdecc_bit_name_index_init_16bit( struct jdksavdecc_bit_name_index *self, struct jdksavdecc_16bit_name const names[] )
+{
+    size_t i;
+    int bit;
+
+    memset( self, 0, sizeof( *self ) );
+    for ( i = 0; names[i].name; ++i )
+    {
+        bit = jdksavdecc_bit_name_index_lowest_bit( names[i].bit_value );
+        if ( bit < 32 && !self->by_bit[bit] )
+        {
+            self->by_bit[bit] = names[i].name;
+        }
+    }
+}
+
+void jdksavdecc_bit_name_index_init_32bit( struct jdksavdecc_bit_name_index *self, struct jdksavdecc_32bit_name const names[] )
+{
+    size_t i;
+    int bit;
+
+    memset( self, 0, sizeof( *self ) );
+    for ( i = 0; names[i].name; ++i )
+    {
+        bit = jdksavdecc_bit_name_index_lowest_bit( names[i].bit_value );
+        if ( bit < 32 && !self->by_bit[bit] )
+        {
+            self->by_bit[bit] = names[i].name;
+        }
+    }
+}
@@ -31,7 +31,347 @@
 
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/ACMPController.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_VECTOR
+#include <iterator>
+#endif
 
 namespace JDKSAvdeccMCU
 {
+
+bool operator<( ACMPConnection const &lhs, ACMPConnection const &rhs )
+{
+    if ( !( lhs.m_listener_entity_id == rhs.m_listener_entity_id ) )
+    {
+        return lhs.m_listener_entity_id < rhs.m_listener_entity_id;
+    }
+    if ( lhs.m_listener_unique_id != rhs.m_listener_unique_id )
+    {
+        return lhs.m_listener_unique_id < rhs.m_listener_unique_id;
+    }
+    if ( !( lhs.m_talker_entity_id == rhs.m_talker_entity_id ) )
+    {
+        return lhs.m_talker_entity_id < rhs.m_talker_entity_id;
+    }
+    return lhs.m_talker_unique_id < rhs.m_talker_unique_id;
+}
+
+bool operator==( ACMPConnection const &lhs, ACMPConnection const &rhs )
+{
+    return lhs.m_listener_entity_id == rhs.m_listener_entity_id && lhs.m_listener_unique_id == rhs.m_listener_unique_id
+           && lhs.m_talker_entity_id == rhs.m_talker_entity_id && lhs.m_talker_unique_id == rhs.m_talker_unique_id;
+}
+
+ACMPControllerGroupHandler::ACMPControllerGroupHandler( Entity *entity,
+                                                        ACMPControllerEvents *event_target,
+                                                        ACMPControllerCommand *command_storage,
+                                                        uint32_t max_commands,
+                                                        uint32_t *in_flight_storage,
+                                                        uint16_t max_in_flight,
+                                                        uint16_t max_in_flight_per_listener,
+                                                        uint8_t max_retries )
+    : ACMPControllerGroupHandlerBase( entity )
+    , m_event_target( event_target )
+    , m_commands( command_storage )
+    , m_num_commands( 0 )
+    , m_max_commands( max_commands )
+    , m_in_flight( in_flight_storage )
+    , m_num_in_flight( 0 )
+    , m_max_in_flight( max_in_flight )
+    , m_max_in_flight_per_listener( max_in_flight_per_listener )
+    , m_max_retries( max_retries )
+    , m_first_pending( 0 )
+    , m_next_sequence_id( 0 )
+    , m_succeeded_count( 0 )
+    , m_failed_count( 0 )
+    , m_timed_out_count( 0 )
+    , m_retry_count( 0 )
+{
+}
+
+void ACMPControllerGroupHandler::clear()
+{
+    m_num_commands = 0;
+    m_num_in_flight = 0;
+    m_first_pending = 0;
+    m_succeeded_count = 0;
+    m_failed_count = 0;
+    m_timed_out_count = 0;
+    m_retry_count = 0;
+}
+
+bool ACMPControllerGroupHandler::queueCommand( uint8_t message_type, ACMPConnection const &connection, uint16_t flags )
+{
+    bool r = false;
+
+    // Start a new batch if the previous one is finished
+    if ( m_num_commands > 0 && isIdle() )
+    {
+        clear();
+    }
+
+    if ( m_num_commands < m_max_commands )
+    {
+        ACMPControllerCommand &command = m_commands[m_num_commands];
+        command = ACMPControllerCommand();
+        command.m_message_type = message_type;
+        command.m_connection = connection;
+        command.m_flags = flags;
+        ++m_num_commands;
+        r = true;
+    }
+    return r;
+}
+
+#if JDKSAVDECCMCU_ENABLE_VECTOR
+bool ACMPControllerGroupHandler::applyConnectionMatrix( std::vector<ACMPConnection> const &current,
+                                                        std::vector<ACMPConnection> const &desired,
+                                                        uint16_t flags )
+{
+    std::vector<ACMPConnection> sorted_current( current );
+    std::vector<ACMPConnection> sorted_desired( desired );
+    std::sort( sorted_current.begin(), sorted_current.end() );
+    std::sort( sorted_desired.begin(), sorted_desired.end() );
+
+    std::vector<ACMPConnection> to_disconnect;
+    std::vector<ACMPConnection> to_connect;
+    std::set_difference( sorted_current.begin(),
+                         sorted_current.end(),
+                         sorted_desired.begin(),
+                         sorted_desired.end(),
+                         std::back_inserter( to_disconnect ) );
+    std::set_difference( sorted_desired.begin(),
+                         sorted_desired.end(),
+                         sorted_current.begin(),
+                         sorted_current.end(),
+                         std::back_inserter( to_connect ) );
+
+    if ( m_num_commands > 0 && isIdle() )
+    {
+        clear();
+    }
+
+    if ( m_num_commands + to_disconnect.size() + to_connect.size() > m_max_commands )
+    {
+        return false;
+    }
+
+    for ( size_t i = 0; i < to_disconnect.size(); ++i )
+    {
+        disconnectStream( to_disconnect[i] );
+    }
+    for ( size_t i = 0; i < to_connect.size(); ++i )
+    {
+        connectStream( to_connect[i], flags );
+    }
+    return true;
+}
+#endif
+
+void ACMPControllerGroupHandler::tick( jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    // Retry or give up on the commands that have timed out
+    uint16_t i = 0;
+    while ( i < m_num_in_flight )
+    {
+        ACMPControllerCommand &command = m_commands[m_in_flight[i]];
+        uint32_t timeout = command.m_message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND
+                               ? JDKSAVDECC_ACMP_TIMEOUT_CONNECT_RX_COMMAND_MS
+                               : JDKSAVDECC_ACMP_TIMEOUT_DISCONNECT_RX_COMMAND_MS;
+
+        if ( wasTimeOutHit( timestamp, command.m_sent_time, timeout ) )
+        {
+            if ( command.m_retry_count < m_max_retries )
+            {
+                ++command.m_retry_count;
+                ++m_retry_count;
+                sendCommand( m_in_flight[i], timestamp );
+            }
+            else
+            {
+                // completeInFlight moves the last in flight entry to i
+                completeInFlight( i, ACMPControllerCommand::STATE_TIMED_OUT, JDKSAVDECC_ACMP_STATUS_LISTENER_TALKER_TIMEOUT );
+                continue;
+            }
+        }
+        ++i;
+    }
+
+    sendPending( timestamp );
+}
+
+uint8_t ACMPControllerGroupHandler::receivedACMPDU( RawSocket *incoming_socket, const jdksavdecc_acmpdu &acmpdu, Frame &frame )
+{
+    (void)frame;
+    uint8_t status = JDKSAVDECC_ACMP_STATUS_NOT_SUPPORTED;
+
+    if ( acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_RESPONSE
+         || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_RX_RESPONSE )
+    {
+        for ( uint16_t i = 0; i < m_num_in_flight; ++i )
+        {
+            ACMPControllerCommand const &command = m_commands[m_in_flight[i]];
+
+            if ( command.m_sequence_id == acmpdu.sequence_id
+                 && uint8_t( command.m_message_type + 1 ) == acmpdu.header.message_type
+                 && command.m_connection.m_listener_unique_id == acmpdu.listener_unique_id
+                 && command.m_connection.m_listener_entity_id == acmpdu.listener_entity_id )
+            {
+                status = acmpdu.header.status;
+                completeInFlight( i,
+                                  status == JDKSAVDECC_ACMP_STATUS_SUCCESS ? ACMPControllerCommand::STATE_SUCCEEDED
+                                                                           : ACMPControllerCommand::STATE_FAILED,
+                                  status );
+
+                // Keep the pipeline full without waiting for the next tick
+                sendPending( incoming_socket->getTimeInMilliseconds() );
+                break;
+            }
+        }
+    }
+    return status;
+}
+
+bool ACMPControllerGroupHandler::canSend( ACMPControllerCommand const &command ) const
+{
+    uint16_t listener_count = 0;
+
+    for ( uint16_t i = 0; i < m_num_in_flight; ++i )
+    {
+        ACMPControllerCommand const &other = m_commands[m_in_flight[i]];
+
+        if ( other.m_connection.m_listener_entity_id == command.m_connection.m_listener_entity_id )
+        {
+            // Commands to the same stream sink are strictly ordered
+            if ( other.m_connection.m_listener_unique_id == command.m_connection.m_listener_unique_id )
+            {
+                return false;
+            }
+            if ( ++listener_count >= m_max_in_flight_per_listener )
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void ACMPControllerGroupHandler::sendCommand( uint32_t index, jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    ACMPControllerCommand &command = m_commands[index];
+    jdksavdecc_acmpdu acmpdu;
+    memset( &acmpdu, 0, sizeof( acmpdu ) );
+
+    acmpdu.header.message_type = command.m_message_type;
+    acmpdu.header.status = JDKSAVDECC_ACMP_STATUS_SUCCESS;
+    acmpdu.controller_entity_id = m_entity->getEntityID();
+    acmpdu.talker_entity_id = command.m_connection.m_talker_entity_id;
+    acmpdu.talker_unique_id = command.m_connection.m_talker_unique_id;
+    acmpdu.listener_entity_id = command.m_connection.m_listener_entity_id;
+    acmpdu.listener_unique_id = command.m_connection.m_listener_unique_id;
+    acmpdu.flags = command.m_flags;
+
+    // A retry gets a new sequence_id so that a late response to the first
+    // attempt is not mistaken for the response to the retry
+    command.m_sequence_id = m_next_sequence_id++;
+    acmpdu.sequence_id = command.m_sequence_id;
+    command.m_sent_time = timestamp;
+    command.m_state = ACMPControllerCommand::STATE_IN_FLIGHT;
+    traceCommand( command );
+
+    FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_ACMPDU_LEN> frame;
+    if ( formACMP( &frame, m_entity->getRawSocket().getMACAddress(), acmpdu ) )
+    {
+        m_entity->getRawSocket().sendFrame( frame );
+    }
+}
+
+void ACMPControllerGroupHandler::traceCommand( ACMPControllerCommand const &command ) const
+{
+    Trace::record( TRACE_ACMP_CONTROLLER_STATE,
+                   command.m_connection.m_listener_unique_id,
+                   m_entity->getEntityID().convertToUint64(),
+                   command.m_connection.m_listener_entity_id.convertToUint64(),
+                   uint32_t( command.m_state ) | ( uint32_t( command.m_status ) << 8 )
+                   | ( uint32_t( command.m_message_type ) << 16 ) | ( uint32_t( command.m_retry_count ) << 24 ) );
+}
+
+void ACMPControllerGroupHandler::sendPending( jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    // Skip over the commands that have already been sent
+    while ( m_first_pending < m_num_commands && m_commands[m_first_pending].m_state != ACMPControllerCommand::STATE_PENDING )
+    {
+        ++m_first_pending;
+    }
+
+    // Bound the search past commands that are blocked behind their listener
+    // so that a long queue for one listener costs a fixed amount per call
+    uint32_t scan_limit = m_first_pending + JDKSAVDECCMCU_ACMP_CONTROLLER_SCAN_PER_IN_FLIGHT * uint32_t( m_max_in_flight );
+    if ( scan_limit > m_num_commands )
+    {
+        scan_limit = m_num_commands;
+    }
+
+    for ( uint32_t index = m_first_pending; index < scan_limit && m_num_in_flight < m_max_in_flight; ++index )
+    {
+        ACMPControllerCommand const &command = m_commands[index];
+
+        if ( command.m_state == ACMPControllerCommand::STATE_PENDING && canSend( command ) )
+        {
+            m_in_flight[m_num_in_flight++] = index;
+            sendCommand( index, timestamp );
+        }
+    }
+}
+
+void ACMPControllerGroupHandler::completeInFlight( uint16_t in_flight_index, ACMPControllerCommand::State state, uint8_t status )
+{
+    ACMPControllerCommand &command = m_commands[m_in_flight[in_flight_index]];
+    command.m_state = state;
+    command.m_status = status;
+    traceCommand( command );
+
+    switch ( state )
+    {
+    case ACMPControllerCommand::STATE_SUCCEEDED:
+        ++m_succeeded_count;
+        break;
+    case ACMPControllerCommand::STATE_FAILED:
+        ++m_failed_count;
+        break;
+    default:
+        ++m_timed_out_count;
+        break;
+    }
+
+    m_in_flight[in_flight_index] = m_in_flight[--m_num_in_flight];
+
+    if ( m_event_target )
+    {
+        m_event_target->acmpCommandCompleted( this, command );
+        if ( isIdle() )
+        {
+            m_event_target->acmpAllCommandsCompleted( this );
+        }
+    }
+}
+
+#if JDKSAVDECCMCU_ENABLE_VECTOR
+ACMPControllerGroupHandlerDynamic::ACMPControllerGroupHandlerDynamic( Entity *entity,
+                                                                      ACMPControllerEvents *event_target,
+                                                                      uint32_t max_commands,
+                                                                      uint16_t max_in_flight,
+                                                                      uint16_t max_in_flight_per_listener,
+                                                                      uint8_t max_retries )
+    : ACMPControllerGroupHandler( entity, event_target, 0, 0, 0, 0, max_in_flight_per_listener, max_retries )
+    , m_command_storage( max_commands )
+    , m_in_flight_storage( max_in_flight )
+{
+    m_commands = m_command_storage.empty() ? 0 : &m_command_storage[0];
+    m_max_commands = max_commands;
+    m_in_flight = m_in_flight_storage.empty() ? 0 : &m_in_flight_storage[0];
+    m_max_in_flight = max_in_flight;
+}
+#endif
 }
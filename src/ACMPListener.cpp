@@ -31,7 +31,333 @@
 
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/ACMPListener.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
 
 namespace JDKSAvdeccMCU
 {
+
+ACMPListenerHandler::ACMPListenerHandler()
+    : m_state( STATE_WAITING )
+    , m_restoring( false )
+    , m_pending_from_controller( false )
+    , m_pending_retries( 0 )
+    , m_pending_sequence_id( 0 )
+    , m_pending_sent_time( 0 )
+    , m_pending_controller_sequence_id( 0 )
+    , m_next_sequence_id( 0 )
+{
+}
+
+ACMPListenerHandler::~ACMPListenerHandler() {}
+
+void ACMPListenerHandler::restoreConnection( Eui64 const &talker_entity_id, uint16_t talker_unique_id, uint16_t flags )
+{
+    m_stream_info.m_talker_entity_id = talker_entity_id;
+    m_stream_info.m_talker_unique_id = talker_unique_id;
+    m_stream_info.m_connected = false;
+    m_stream_info.m_flags = flags;
+    m_restoring = true;
+    m_pending_from_controller = false;
+    m_state = STATE_WAITING;
+}
+
+void ACMPListenerHandler::tick( Entity *entity,
+                                uint16_t unique_id,
+                                ACMPListenerEvents *eventTarget,
+                                jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    (void)eventTarget;
+
+    if ( m_state == STATE_WAITING )
+    {
+        // All restored listeners send their CONNECT_TX on the first tick
+        if ( m_restoring )
+        {
+            setState( entity, unique_id, STATE_CONNECT );
+            m_pending_retries = 0;
+            sendTxCommand( entity, unique_id, timestamp );
+        }
+    }
+    else
+    {
+        uint32_t timeout = m_state == STATE_CONNECT ? JDKSAVDECC_ACMP_TIMEOUT_CONNECT_TX_COMMAND_MS
+                                                    : JDKSAVDECC_ACMP_TIMEOUT_DISCONNECT_TX_COMMAND_MS;
+
+        if ( wasTimeOutHit( timestamp, m_pending_sent_time, timeout ) )
+        {
+            // A restored connection keeps trying, the talker may still be
+            // booting
+            if ( m_restoring || m_pending_retries < 1 )
+            {
+                ++m_pending_retries;
+                sendTxCommand( entity, unique_id, timestamp );
+            }
+            else
+            {
+                finishPending( entity, unique_id, JDKSAVDECC_ACMP_STATUS_LISTENER_TALKER_TIMEOUT );
+            }
+        }
+    }
+}
+
+uint8_t ACMPListenerHandler::receivedACMPDU(
+    Entity *entity, uint16_t unique_id, ACMPListenerEvents *eventTarget, jdksavdecc_acmpdu const &acmpdu, Frame &frame )
+{
+    (void)frame;
+    uint8_t status = JDKSAVDECC_ACMP_STATUS_NOT_SUPPORTED;
+    jdksavdecc_acmpdu response = acmpdu;
+    Eui64 controller_entity_id( acmpdu.controller_entity_id );
+    Eui64 talker_entity_id( acmpdu.talker_entity_id );
+    bool same_talker = m_stream_info.m_talker_entity_id == talker_entity_id
+                       && m_stream_info.m_talker_unique_id == acmpdu.talker_unique_id;
+
+    // A controller that re-sends the command being serviced gets the
+    // response when the talker answers
+    if ( ( acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND
+           || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_RX_COMMAND )
+         && m_state != STATE_WAITING && m_pending_from_controller && m_pending_controller_entity_id == controller_entity_id
+         && m_pending_controller_sequence_id == acmpdu.sequence_id )
+    {
+        return JDKSAVDECC_ACMP_STATUS_SUCCESS;
+    }
+
+    switch ( acmpdu.header.message_type )
+    {
+    case JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND:
+        if ( m_state != STATE_WAITING && m_pending_from_controller )
+        {
+            status = JDKSAVDECC_ACMP_STATUS_STATE_UNAVAILABLE;
+        }
+        else if ( m_stream_info.m_connected && !same_talker )
+        {
+            m_stream_info.m_talker_entity_id.store( response.talker_entity_id.value, 0 );
+            response.talker_unique_id = m_stream_info.m_talker_unique_id;
+            status = JDKSAVDECC_ACMP_STATUS_LISTENER_EXCLUSIVE;
+        }
+        else
+        {
+            // A controller's request replaces any restore in progress
+            m_restoring = false;
+            m_stream_info.m_talker_entity_id = talker_entity_id;
+            m_stream_info.m_talker_unique_id = acmpdu.talker_unique_id;
+            m_stream_info.m_controller_entity_id = controller_entity_id;
+            m_stream_info.m_flags = acmpdu.flags;
+            m_pending_from_controller = true;
+            m_pending_controller_entity_id = controller_entity_id;
+            m_pending_controller_sequence_id = acmpdu.sequence_id;
+            m_pending_retries = 0;
+            setState( entity, unique_id, STATE_CONNECT );
+            sendTxCommand( entity, unique_id, entity->getRawSocket().getTimeInMilliseconds() );
+            return JDKSAVDECC_ACMP_STATUS_SUCCESS;
+        }
+        break;
+    case JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_RX_COMMAND:
+        if ( m_state != STATE_WAITING && m_pending_from_controller )
+        {
+            status = JDKSAVDECC_ACMP_STATUS_STATE_UNAVAILABLE;
+        }
+        else if ( ( m_stream_info.m_connected || m_restoring ) && same_talker )
+        {
+            bool was_connected = m_stream_info.m_connected;
+            m_stream_info.m_connected = false;
+            m_restoring = false;
+            if ( eventTarget )
+            {
+                eventTarget->listenerDisconnected( entity, unique_id, this );
+            }
+            if ( was_connected )
+            {
+                m_pending_from_controller = true;
+                m_pending_controller_entity_id = controller_entity_id;
+                m_pending_controller_sequence_id = acmpdu.sequence_id;
+                m_pending_retries = 0;
+                setState( entity, unique_id, STATE_DISCONNECT );
+                sendTxCommand( entity, unique_id, entity->getRawSocket().getTimeInMilliseconds() );
+                return JDKSAVDECC_ACMP_STATUS_SUCCESS;
+            }
+            setState( entity, unique_id, STATE_WAITING );
+            status = JDKSAVDECC_ACMP_STATUS_SUCCESS;
+        }
+        else
+        {
+            status = JDKSAVDECC_ACMP_STATUS_NOT_CONNECTED;
+        }
+        break;
+    case JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_RX_STATE_COMMAND:
+        m_stream_info.m_talker_entity_id.store( response.talker_entity_id.value, 0 );
+        response.talker_unique_id = m_stream_info.m_talker_unique_id;
+        m_stream_info.m_controller_entity_id.store( response.controller_entity_id.value, 0 );
+        status = JDKSAVDECC_ACMP_STATUS_SUCCESS;
+        break;
+    case JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_TX_RESPONSE:
+        status = acmpdu.header.status;
+        if ( m_state == STATE_CONNECT && acmpdu.sequence_id == m_pending_sequence_id && same_talker )
+        {
+            if ( status == JDKSAVDECC_ACMP_STATUS_SUCCESS )
+            {
+                bool was_connected = m_stream_info.m_connected;
+                m_stream_info.m_stream_id = acmpdu.header.stream_id;
+                m_stream_info.m_stream_dest_mac = acmpdu.stream_dest_mac;
+                m_stream_info.m_stream_vlan_id = acmpdu.stream_vlan_id;
+                m_stream_info.m_connected = true;
+                m_restoring = false;
+                if ( !was_connected && eventTarget )
+                {
+                    eventTarget->listenerConnected( entity, unique_id, this );
+                }
+            }
+            else
+            {
+                // The talker refused, stop trying to restore the connection
+                m_restoring = false;
+            }
+            finishPending( entity, unique_id, status );
+        }
+        return status;
+    case JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_TX_RESPONSE:
+        status = acmpdu.header.status;
+        if ( m_state == STATE_DISCONNECT && acmpdu.sequence_id == m_pending_sequence_id && same_talker )
+        {
+            finishPending( entity, unique_id, status );
+        }
+        return status;
+    default:
+        return status;
+    }
+
+    response.header.message_type = uint8_t( acmpdu.header.message_type + 1 );
+    response.header.status = status;
+    response.header.stream_id = m_stream_info.m_stream_id;
+    response.stream_dest_mac = m_stream_info.m_stream_dest_mac;
+    response.stream_vlan_id = m_stream_info.m_stream_vlan_id;
+    response.connection_count = m_stream_info.m_connected ? 1 : 0;
+
+    FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_ACMPDU_LEN> response_frame;
+    if ( formACMP( &response_frame, entity->getRawSocket().getMACAddress(), response ) )
+    {
+        entity->getRawSocket().sendFrame( response_frame );
+    }
+    return status;
+}
+
+void ACMPListenerHandler::sendTxCommand( Entity *entity, uint16_t unique_id, jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    jdksavdecc_acmpdu command;
+    memset( &command, 0, sizeof( command ) );
+
+    command.header.message_type = m_state == STATE_CONNECT ? JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_TX_COMMAND
+                                                           : JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_TX_COMMAND;
+    command.header.status = JDKSAVDECC_ACMP_STATUS_SUCCESS;
+    if ( m_pending_from_controller )
+    {
+        command.controller_entity_id = m_pending_controller_entity_id;
+    }
+    else
+    {
+        command.controller_entity_id = entity->getEntityID();
+    }
+    command.talker_entity_id = m_stream_info.m_talker_entity_id;
+    command.talker_unique_id = m_stream_info.m_talker_unique_id;
+    command.listener_entity_id = entity->getEntityID();
+    command.listener_unique_id = unique_id;
+    command.flags = m_stream_info.m_flags;
+    if ( m_restoring )
+    {
+        command.flags |= JDKSAVDECC_ACMP_FLAG_FAST_CONNECT;
+    }
+
+    m_pending_sequence_id = m_next_sequence_id++;
+    command.sequence_id = m_pending_sequence_id;
+    m_pending_sent_time = timestamp;
+
+    FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_ACMPDU_LEN> frame;
+    if ( formACMP( &frame, entity->getRawSocket().getMACAddress(), command ) )
+    {
+        entity->getRawSocket().sendFrame( frame );
+    }
+}
+
+void ACMPListenerHandler::sendRxResponse( Entity *entity, uint16_t unique_id, uint8_t message_type, uint8_t status )
+{
+    jdksavdecc_acmpdu response;
+    memset( &response, 0, sizeof( response ) );
+
+    response.header.message_type = message_type;
+    response.header.status = status;
+    response.header.stream_id = m_stream_info.m_stream_id;
+    response.controller_entity_id = m_pending_controller_entity_id;
+    response.talker_entity_id = m_stream_info.m_talker_entity_id;
+    response.talker_unique_id = m_stream_info.m_talker_unique_id;
+    response.listener_entity_id = entity->getEntityID();
+    response.listener_unique_id = unique_id;
+    response.stream_dest_mac = m_stream_info.m_stream_dest_mac;
+    response.connection_count = m_stream_info.m_connected ? 1 : 0;
+    response.sequence_id = m_pending_controller_sequence_id;
+    response.flags = m_stream_info.m_flags;
+    response.stream_vlan_id = m_stream_info.m_stream_vlan_id;
+
+    FrameWithSize<JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_ACMPDU_LEN> frame;
+    if ( formACMP( &frame, entity->getRawSocket().getMACAddress(), response ) )
+    {
+        entity->getRawSocket().sendFrame( frame );
+    }
+}
+
+void ACMPListenerHandler::finishPending( Entity *entity, uint16_t unique_id, uint8_t status )
+{
+    if ( m_pending_from_controller )
+    {
+        sendRxResponse( entity,
+                        unique_id,
+                        m_state == STATE_CONNECT ? JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_RESPONSE
+                                                 : JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_RX_RESPONSE,
+                        status );
+    }
+    m_pending_from_controller = false;
+    setState( entity, unique_id, STATE_WAITING );
+}
+
+void ACMPListenerHandler::setState( Entity *entity, uint16_t unique_id, State state )
+{
+    Trace::record( TRACE_ACMP_LISTENER_STATE,
+                   unique_id,
+                   entity->getEntityID().convertToUint64(),
+                   m_stream_info.m_talker_entity_id.convertToUint64(),
+                   uint32_t( m_state ) | ( uint32_t( state ) << 8 ) | ( uint32_t( m_stream_info.m_connected ) << 16 ) );
+    m_state = state;
+}
+
+void ACMPListenerGroupHandlerBase::tick( jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    uint16_t count = getListenerStreamSinkCount();
+    for ( uint16_t i = 0; i < count; ++i )
+    {
+        getListenerHandler( i )->tick( m_entity, i, m_event_target, timestamp );
+    }
+}
+
+uint8_t ACMPListenerGroupHandlerBase::receivedACMPDU( RawSocket *incoming_socket, const jdksavdecc_acmpdu &acmpdu, Frame &frame )
+{
+    (void)incoming_socket;
+    uint8_t status = JDKSAVDECC_ACMP_STATUS_LISTENER_UNKNOWN_ID;
+
+    if ( acmpdu.listener_unique_id < getListenerStreamSinkCount() )
+    {
+        status = getListenerHandler( acmpdu.listener_unique_id )
+                     ->receivedACMPDU( m_entity, acmpdu.listener_unique_id, m_event_target, acmpdu, frame );
+    }
+    else if ( acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND
+              || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_RX_COMMAND
+              || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_RX_STATE_COMMAND )
+    {
+        jdksavdecc_acmpdu response = acmpdu;
+        response.header.message_type = acmpdu.header.message_type + 1;
+        response.header.status = status;
+        if ( formACMP( &frame, m_entity->getRawSocket().getMACAddress(), response ) )
+        {
+            m_entity->getRawSocket().sendFrame( frame );
+        }
+    }
+    return status;
+}
 }
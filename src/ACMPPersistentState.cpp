@@ -0,0 +1,312 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/ACMPPersistentState.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+ACMPPersistentState::ACMPPersistentState( PersistentStorage &storage,
+                                          uint32_t base_offset,
+                                          ACMPListenerEvents *listener_event_target,
+                                          ACMPTalkerEvents *talker_event_target )
+    : m_storage( storage )
+    , m_base_offset( base_offset )
+    , m_listener_event_target( listener_event_target )
+    , m_talker_event_target( talker_event_target )
+    , m_listeners( 0 )
+    , m_talkers( 0 )
+    , m_listener_count( 0 )
+    , m_talker_count( 0 )
+    , m_talker_slot_count( 0 )
+    , m_write_count( 0 )
+{
+}
+
+void ACMPPersistentState::attach( ACMPListenerGroupHandlerBase *listeners, ACMPTalkerGroupHandlerBase *talkers )
+{
+    m_listeners = listeners;
+    m_talkers = talkers;
+    m_listener_count = listeners ? listeners->getListenerStreamSinkCount() : 0;
+    m_talker_count = talkers ? talkers->getTalkerStreamSourceCount() : 0;
+    m_talker_slot_count = 0;
+    for ( uint16_t i = 0; i < m_talker_count; ++i )
+    {
+        m_talker_slot_count += talkers->getTalkerHandler( i )->getMaxConnectedListeners();
+    }
+}
+
+uint32_t ACMPPersistentState::restore()
+{
+    uint32_t restored = 0;
+
+    if ( !readHeader() )
+    {
+        clear();
+        return 0;
+    }
+
+    for ( uint16_t i = 0; i < m_listener_count; ++i )
+    {
+        Record record;
+        if ( readRecord( i, record ) && record.m_kind == RECORD_LISTENER )
+        {
+            m_listeners->getListenerHandler( i )->restoreConnection( record.m_entity_id, record.m_unique_id, record.m_flags );
+            ++restored;
+        }
+    }
+
+    for ( uint16_t t = 0; t < m_talker_count; ++t )
+    {
+        ACMPTalkerHandlerBase *talker = m_talkers->getTalkerHandler( t );
+        uint32_t base = getTalkerRecordBase( t );
+        uint16_t max_slots = talker->getMaxConnectedListeners();
+        bool moved = false;
+
+        talker->disconnectAllListeners();
+        for ( uint16_t slot = 0; slot < max_slots; ++slot )
+        {
+            Record record;
+            if ( readRecord( base + slot, record ) && record.m_kind == RECORD_TALKER
+                 && talker->connectListener( record.m_entity_id, record.m_unique_id ) == JDKSAVDECC_ACMP_STATUS_SUCCESS )
+            {
+                ++restored;
+                moved = moved || talker->findListener( record.m_entity_id, record.m_unique_id ) != slot;
+            }
+        }
+
+        // Slots are handed out in order, so the restored listeners only move
+        // if there were free slots between them
+        if ( moved )
+        {
+            for ( uint16_t slot = 0; slot < max_slots; ++slot )
+            {
+                writeTalkerRecord( t, talker, slot );
+            }
+        }
+    }
+    m_storage.flush();
+    return restored;
+}
+
+void ACMPPersistentState::saveAll()
+{
+    writeHeader();
+    for ( uint16_t i = 0; i < m_listener_count; ++i )
+    {
+        writeListenerRecord( i, m_listeners->getListenerHandler( i ) );
+    }
+    for ( uint16_t t = 0; t < m_talker_count; ++t )
+    {
+        ACMPTalkerHandlerBase const *talker = m_talkers->getTalkerHandler( t );
+        uint16_t max_slots = talker->getMaxConnectedListeners();
+        for ( uint16_t slot = 0; slot < max_slots; ++slot )
+        {
+            writeTalkerRecord( t, talker, slot );
+        }
+    }
+    m_storage.flush();
+}
+
+void ACMPPersistentState::clear()
+{
+    Record empty;
+    empty.m_kind = RECORD_EMPTY;
+    empty.m_unique_id = 0;
+    empty.m_flags = 0;
+
+    writeHeader();
+    for ( uint32_t i = 0; i < getRecordCount(); ++i )
+    {
+        writeRecord( i, empty );
+    }
+    m_storage.flush();
+}
+
+void ACMPPersistentState::listenerConnected( Entity *entity,
+                                             uint16_t listener_unique_id,
+                                             ACMPListenerHandler const *listener_handler )
+{
+    writeListenerRecord( listener_unique_id, listener_handler );
+    m_storage.flush();
+    if ( m_listener_event_target )
+    {
+        m_listener_event_target->listenerConnected( entity, listener_unique_id, listener_handler );
+    }
+}
+
+void ACMPPersistentState::listenerDisconnected( Entity *entity,
+                                                uint16_t listener_unique_id,
+                                                ACMPListenerHandler const *listener_handler )
+{
+    writeListenerRecord( listener_unique_id, listener_handler );
+    m_storage.flush();
+    if ( m_listener_event_target )
+    {
+        m_listener_event_target->listenerDisconnected( entity, listener_unique_id, listener_handler );
+    }
+}
+
+void ACMPPersistentState::talkerConnected( Entity *entity,
+                                           uint16_t talker_unique_id,
+                                           ACMPTalkerHandlerBase const *talker_handler,
+                                           ACMPTalkerStreamInfo const &stream_info,
+                                           ACMPTalkerListenerPair const &listener_pair )
+{
+    if ( m_talker_event_target )
+    {
+        m_talker_event_target->talkerConnected( entity, talker_unique_id, talker_handler, stream_info, listener_pair );
+    }
+}
+
+void ACMPPersistentState::talkerDisconnected( Entity *entity,
+                                              uint16_t talker_unique_id,
+                                              ACMPTalkerHandlerBase const *talker_handler,
+                                              ACMPTalkerStreamInfo const &stream_info,
+                                              ACMPTalkerListenerPair const &listener_pair )
+{
+    if ( m_talker_event_target )
+    {
+        m_talker_event_target->talkerDisconnected( entity, talker_unique_id, talker_handler, stream_info, listener_pair );
+    }
+}
+
+void ACMPPersistentState::talkerSlotChanged( Entity *entity,
+                                             uint16_t talker_unique_id,
+                                             ACMPTalkerHandlerBase const *talker_handler,
+                                             uint16_t slot )
+{
+    writeTalkerRecord( talker_unique_id, talker_handler, slot );
+    m_storage.flush();
+    if ( m_talker_event_target )
+    {
+        m_talker_event_target->talkerSlotChanged( entity, talker_unique_id, talker_handler, slot );
+    }
+}
+
+bool ACMPPersistentState::readHeader()
+{
+    uint8_t buf[HEADER_SIZE];
+
+    return m_storage.read( m_base_offset, buf, HEADER_SIZE )
+           && PersistentStorage::crc8( buf, HEADER_SIZE - 1 ) == buf[HEADER_SIZE - 1]
+           && jdksavdecc_uint32_get( buf, 0 ) == MAGIC && buf[4] == VERSION
+           && jdksavdecc_uint16_get( buf, 6 ) == m_listener_count && jdksavdecc_uint16_get( buf, 8 ) == m_talker_count
+           && jdksavdecc_uint32_get( buf, 10 ) == m_talker_slot_count;
+}
+
+void ACMPPersistentState::writeHeader()
+{
+    uint8_t buf[HEADER_SIZE];
+
+    memset( buf, 0, sizeof( buf ) );
+    jdksavdecc_uint32_set( MAGIC, buf, 0 );
+    buf[4] = VERSION;
+    jdksavdecc_uint16_set( m_listener_count, buf, 6 );
+    jdksavdecc_uint16_set( m_talker_count, buf, 8 );
+    jdksavdecc_uint32_set( m_talker_slot_count, buf, 10 );
+    buf[HEADER_SIZE - 1] = PersistentStorage::crc8( buf, HEADER_SIZE - 1 );
+    m_storage.write( m_base_offset, buf, HEADER_SIZE );
+    ++m_write_count;
+}
+
+bool ACMPPersistentState::readRecord( uint32_t index, Record &record )
+{
+    uint8_t buf[RECORD_SIZE];
+
+    if ( !m_storage.read( m_base_offset + HEADER_SIZE + index * RECORD_SIZE, buf, RECORD_SIZE )
+         || PersistentStorage::crc8( buf, RECORD_SIZE - 1 ) != buf[RECORD_SIZE - 1] )
+    {
+        return false;
+    }
+    record.m_kind = buf[0];
+    record.m_entity_id = Eui64( &buf[1] );
+    record.m_unique_id = jdksavdecc_uint16_get( buf, 9 );
+    record.m_flags = jdksavdecc_uint16_get( buf, 11 );
+    return true;
+}
+
+void ACMPPersistentState::writeRecord( uint32_t index, Record const &record )
+{
+    uint8_t buf[RECORD_SIZE];
+
+    memset( buf, 0, sizeof( buf ) );
+    buf[0] = record.m_kind;
+    record.m_entity_id.store( buf, 1 );
+    jdksavdecc_uint16_set( record.m_unique_id, buf, 9 );
+    jdksavdecc_uint16_set( record.m_flags, buf, 11 );
+    buf[RECORD_SIZE - 1] = PersistentStorage::crc8( buf, RECORD_SIZE - 1 );
+    m_storage.write( m_base_offset + HEADER_SIZE + index * RECORD_SIZE, buf, RECORD_SIZE );
+    ++m_write_count;
+}
+
+void ACMPPersistentState::writeListenerRecord( uint16_t listener_unique_id, ACMPListenerHandler const *listener_handler )
+{
+    if ( listener_unique_id < m_listener_count )
+    {
+        ACMPListenerStreamInfo const &info = listener_handler->getStreamInfo();
+        Record record;
+        record.m_kind = info.m_connected ? RECORD_LISTENER : RECORD_EMPTY;
+        record.m_entity_id = info.m_talker_entity_id;
+        record.m_unique_id = info.m_talker_unique_id;
+        record.m_flags = info.m_flags;
+        writeRecord( listener_unique_id, record );
+    }
+}
+
+void ACMPPersistentState::writeTalkerRecord( uint16_t talker_unique_id, ACMPTalkerHandlerBase const *talker_handler, uint16_t slot )
+{
+    if ( talker_unique_id < m_talker_count && slot < talker_handler->getMaxConnectedListeners() )
+    {
+        ACMPTalkerListenerPair const *pair = talker_handler->getListener( slot );
+        Record record;
+        record.m_kind = pair ? RECORD_TALKER : RECORD_EMPTY;
+        record.m_unique_id = pair ? pair->m_listener_unique_id : 0;
+        record.m_flags = 0;
+        if ( pair )
+        {
+            record.m_entity_id = pair->m_listener_entity_id;
+        }
+        writeRecord( getTalkerRecordBase( talker_unique_id ) + slot, record );
+    }
+}
+
+uint32_t ACMPPersistentState::getTalkerRecordBase( uint16_t talker_unique_id ) const
+{
+    uint32_t base = m_listener_count;
+    for ( uint16_t i = 0; i < talker_unique_id; ++i )
+    {
+        base += m_talkers->getTalkerHandler( i )->getMaxConnectedListeners();
+    }
+    return base;
+}
+}
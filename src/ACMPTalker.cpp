@@ -31,28 +31,358 @@
 
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/ACMPTalker.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
 
 namespace JDKSAvdeccMCU
 {
 
+ACMPTalkerHandlerBase::ACMPTalkerHandlerBase( ACMPTalkerListenerPair *listener_pair_storage,
+                                              uint16_t max_connected_listeners,
+                                              uint16_t *hash_storage,
+                                              uint32_t hash_table_size )
+    : m_connection_count( 0 )
+    , m_connected_listeners( 0 )
+    , m_max_connected_listeners( 0 )
+    , m_state( STATE_WAITING )
+    , m_hash( 0 )
+    , m_hash_mask( 0 )
+    , m_slot_count( 0 )
+    , m_first_free( NO_SLOT )
+{
+    setStorage( listener_pair_storage, max_connected_listeners, hash_storage, hash_table_size );
+}
+
 ACMPTalkerHandlerBase::~ACMPTalkerHandlerBase() {}
 
+void ACMPTalkerHandlerBase::setStorage( ACMPTalkerListenerPair *listener_pair_storage,
+                                       uint16_t max_connected_listeners,
+                                       uint16_t *hash_storage,
+                                       uint32_t hash_table_size )
+{
+    m_connected_listeners = listener_pair_storage;
+    m_max_connected_listeners = max_connected_listeners < NO_SLOT ? max_connected_listeners : NO_SLOT - 1;
+    m_hash = hash_storage;
+    m_hash_mask = hash_table_size > 0 ? hash_table_size - 1 : 0;
+
+    // The hash table must always have at least one empty entry for the probes
+    // to terminate
+    if ( hash_table_size <= m_max_connected_listeners )
+    {
+        m_max_connected_listeners = hash_table_size > 0 ? uint16_t( hash_table_size - 1 ) : 0;
+    }
+    disconnectAllListeners();
+}
+
 void ACMPTalkerHandlerBase::tick( Entity *entity,
                                   uint16_t unique_id,
                                   ACMPTalkerEvents *eventTarget,
                                   jdksavdecc_timestamp_in_milliseconds timestamp )
 {
+    (void)entity;
+    (void)unique_id;
+    (void)eventTarget;
+    (void)timestamp;
+}
+
+uint8_t ACMPTalkerHandlerBase::receivedACMPDU(
+    Entity *entity, uint16_t unique_id, ACMPTalkerEvents *eventTarget, jdksavdecc_acmpdu const &acmpdu, Frame &frame )
+{
+    uint8_t status = JDKSAVDECC_ACMP_STATUS_NOT_SUPPORTED;
+    jdksavdecc_acmpdu response = acmpdu;
+    Eui64 listener_entity_id( acmpdu.listener_entity_id );
+
+    switch ( acmpdu.header.message_type )
+    {
+    case JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_TX_COMMAND:
+    {
+        m_state = STATE_CONNECT;
+        bool was_connected = findListener( listener_entity_id, acmpdu.listener_unique_id ) != NO_SLOT;
+        status = connectListener( listener_entity_id, acmpdu.listener_unique_id );
+        if ( status == JDKSAVDECC_ACMP_STATUS_SUCCESS && !was_connected && eventTarget )
+        {
+            uint16_t slot = findListener( listener_entity_id, acmpdu.listener_unique_id );
+            eventTarget->talkerConnected( entity, unique_id, this, m_stream_info, m_connected_listeners[slot] );
+            eventTarget->talkerSlotChanged( entity, unique_id, this, slot );
+        }
+        break;
+    }
+    case JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_TX_COMMAND:
+    {
+        m_state = STATE_DISCONNECT;
+        uint16_t slot = findListener( listener_entity_id, acmpdu.listener_unique_id );
+        if ( slot != NO_SLOT )
+        {
+            ACMPTalkerListenerPair pair = m_connected_listeners[slot];
+            status = disconnectListener( listener_entity_id, acmpdu.listener_unique_id );
+            if ( eventTarget )
+            {
+                eventTarget->talkerDisconnected( entity, unique_id, this, m_stream_info, pair );
+                eventTarget->talkerSlotChanged( entity, unique_id, this, slot );
+            }
+        }
+        else
+        {
+            status = JDKSAVDECC_ACMP_STATUS_SUCCESS;
+        }
+        break;
+    }
+    case JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_TX_STATE_COMMAND:
+        m_state = STATE_GET_STATE;
+        status = JDKSAVDECC_ACMP_STATUS_SUCCESS;
+        break;
+    case JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_TX_CONNECTION_COMMAND:
+    {
+        m_state = STATE_GET_CONNECTION;
+        // The connection_count field of the command is the index of the
+        // connection being asked about. See IEEE Std 1722.1-2013 Clause
+        // 8.2.2.6.2.5
+        ACMPTalkerListenerPair const *pair = getListener( acmpdu.connection_count );
+        if ( pair )
+        {
+            pair->m_listener_entity_id.store( response.listener_entity_id.value, 0 );
+            response.listener_unique_id = pair->m_listener_unique_id;
+            status = JDKSAVDECC_ACMP_STATUS_SUCCESS;
+        }
+        else
+        {
+            status = JDKSAVDECC_ACMP_STATUS_NO_SUCH_CONNECTION;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    sendResponse( entity, uint8_t( acmpdu.header.message_type + 1 ), status, response, frame );
+    Trace::record( TRACE_ACMP_TALKER_STATE,
+                   unique_id,
+                   entity->getEntityID().convertToUint64(),
+                   listener_entity_id.convertToUint64(),
+                   uint32_t( m_state ) | ( uint32_t( status ) << 8 ) | ( uint32_t( acmpdu.header.message_type ) << 16 ) );
+    m_state = STATE_WAITING;
+    return status;
+}
+
+void ACMPTalkerHandlerBase::sendResponse(
+    Entity *entity, uint8_t message_type, uint8_t status, jdksavdecc_acmpdu &response, Frame &frame )
+{
+    response.header.message_type = message_type;
+    response.header.status = status;
+    response.header.stream_id = m_stream_info.m_stream_id;
+    response.stream_dest_mac = m_stream_info.m_stream_dest_mac;
+    response.stream_vlan_id = m_stream_info.m_stream_vlan_id;
+    response.connection_count = m_connection_count;
+
+    if ( formACMP( &frame, entity->getRawSocket().getMACAddress(), response ) )
+    {
+        entity->getRawSocket().sendFrame( frame );
+    }
+}
+
+uint8_t ACMPTalkerHandlerBase::connectListener( Eui64 const &listener_entity_id, uint16_t listener_unique_id )
+{
+    uint8_t status = JDKSAVDECC_ACMP_STATUS_SUCCESS;
+
+    if ( findListener( listener_entity_id, listener_unique_id ) == NO_SLOT )
+    {
+        uint16_t slot = NO_SLOT;
+
+        // Re-use the most recently freed slot, otherwise take a new one
+        if ( m_first_free != NO_SLOT )
+        {
+            slot = m_first_free;
+            m_first_free = m_connected_listeners[slot].m_next_free;
+        }
+        else if ( m_slot_count < m_max_connected_listeners )
+        {
+            slot = m_slot_count++;
+        }
+
+        if ( slot != NO_SLOT )
+        {
+            ACMPTalkerListenerPair &pair = m_connected_listeners[slot];
+            pair.m_listener_entity_id = listener_entity_id;
+            pair.m_listener_unique_id = listener_unique_id;
+            pair.m_connected = true;
+            insertHash( slot );
+            ++m_connection_count;
+        }
+        else
+        {
+            status = JDKSAVDECC_ACMP_STATUS_TALKER_NO_BANDWIDTH;
+        }
+    }
+    return status;
 }
 
-uint8_t ACMPTalkerHandlerBase::receivedACMPDU( Entity *entity, uint16_t unique_id, ACMPTalkerEvents *eventTarget, Frame &frame ) {
-return JDKSAVDECC_ACMP_STATUS_NOT_SUPPORTED;
+uint8_t ACMPTalkerHandlerBase::disconnectListener( Eui64 const &listener_entity_id, uint16_t listener_unique_id )
+{
+    uint32_t pos = findHashPosition( listener_entity_id, listener_unique_id );
+    uint16_t slot = m_hash[pos];
+
+    if ( slot != NO_SLOT )
+    {
+        removeHashPosition( pos );
+
+        ACMPTalkerListenerPair &pair = m_connected_listeners[slot];
+        pair.m_connected = false;
+        pair.m_next_free = m_first_free;
+        m_first_free = slot;
+        --m_connection_count;
+    }
+    return JDKSAVDECC_ACMP_STATUS_SUCCESS;
 }
 
-void ACMPTalkerHandlerBase::packListeners() {}
+void ACMPTalkerHandlerBase::disconnectAllListeners()
+{
+    for ( uint32_t i = 0; m_hash && i <= m_hash_mask; ++i )
+    {
+        m_hash[i] = NO_SLOT;
+    }
+    for ( uint16_t i = 0; i < m_slot_count; ++i )
+    {
+        m_connected_listeners[i].m_connected = false;
+    }
+    m_connection_count = 0;
+    m_slot_count = 0;
+    m_first_free = NO_SLOT;
+}
 
-void ACMPTalkerGroupHandlerBase::tick( jdksavdecc_timestamp_in_milliseconds timestamp ) {}
+uint16_t ACMPTalkerHandlerBase::findListener( Eui64 const &listener_entity_id, uint16_t listener_unique_id ) const
+{
+    return m_hash ? m_hash[findHashPosition( listener_entity_id, listener_unique_id )] : uint16_t( NO_SLOT );
+}
+
+void ACMPTalkerHandlerBase::packListeners()
+{
+    uint16_t dest = 0;
+    for ( uint16_t i = 0; i < m_slot_count; ++i )
+    {
+        if ( m_connected_listeners[i].m_connected )
+        {
+            if ( dest != i )
+            {
+                m_connected_listeners[dest] = m_connected_listeners[i];
+                m_connected_listeners[i].m_connected = false;
+            }
+            ++dest;
+        }
+    }
+
+    // All slots moved, so the hash table is rebuilt from scratch
+    for ( uint32_t i = 0; m_hash && i <= m_hash_mask; ++i )
+    {
+        m_hash[i] = NO_SLOT;
+    }
+    for ( uint16_t i = 0; i < dest; ++i )
+    {
+        insertHash( i );
+    }
+    m_slot_count = dest;
+    m_first_free = NO_SLOT;
+}
+
+uint32_t ACMPTalkerHandlerBase::hashOf( Eui64 const &listener_entity_id, uint16_t listener_unique_id ) const
+{
+    // Fibonacci hashing of the entity id mixed with the unique id, the high
+    // bits of the product are the best mixed
+    uint64_t v = listener_entity_id.convertToUint64() ^ ( uint64_t( listener_unique_id ) << 48 ) ^ listener_unique_id;
+    v *= 0x9e3779b97f4a7c15ULL;
+    return uint32_t( v >> 32 ) & m_hash_mask;
+}
+
+uint32_t ACMPTalkerHandlerBase::findHashPosition( Eui64 const &listener_entity_id, uint16_t listener_unique_id ) const
+{
+    // Linear probing until the listener or an empty entry is found
+    uint32_t pos = hashOf( listener_entity_id, listener_unique_id );
+    while ( m_hash[pos] != NO_SLOT )
+    {
+        ACMPTalkerListenerPair const &pair = m_connected_listeners[m_hash[pos]];
+        if ( pair.m_listener_unique_id == listener_unique_id && pair.m_listener_entity_id == listener_entity_id )
+        {
+            break;
+        }
+        pos = ( pos + 1 ) & m_hash_mask;
+    }
+    return pos;
+}
+
+void ACMPTalkerHandlerBase::insertHash( uint16_t slot )
+{
+    ACMPTalkerListenerPair const &pair = m_connected_listeners[slot];
+    m_hash[findHashPosition( pair.m_listener_entity_id, pair.m_listener_unique_id )] = slot;
+}
+
+void ACMPTalkerHandlerBase::removeHashPosition( uint32_t pos )
+{
+    // Backward shift deletion: move later entries of the probe sequence into
+    // the hole so that no tombstones are needed
+    uint32_t hole = pos;
+    uint32_t next = ( pos + 1 ) & m_hash_mask;
+    while ( m_hash[next] != NO_SLOT )
+    {
+        ACMPTalkerListenerPair const &pair = m_connected_listeners[m_hash[next]];
+        uint32_t home = hashOf( pair.m_listener_entity_id, pair.m_listener_unique_id );
+
+        // The entry can move to the hole if its home position is not
+        // cyclically within ( hole, next ]
+        if ( ( ( next - home ) & m_hash_mask ) >= ( ( next - hole ) & m_hash_mask ) )
+        {
+            m_hash[hole] = m_hash[next];
+            hole = next;
+        }
+        next = ( next + 1 ) & m_hash_mask;
+    }
+    m_hash[hole] = NO_SLOT;
+}
+
+#if JDKSAVDECCMCU_ENABLE_VECTOR
+
+ACMPTalkerHandlerDynamic::ACMPTalkerHandlerDynamic( uint16_t max_connected_listeners ) : ACMPTalkerHandlerBase( 0, 0, 0, 0 )
+{
+    uint32_t hash_table_size = 1;
+    while ( hash_table_size < uint32_t( max_connected_listeners ) * 2 )
+    {
+        hash_table_size *= 2;
+    }
+    m_listener_pairs_storage.resize( max_connected_listeners );
+    m_hash_storage.resize( hash_table_size );
+    setStorage( m_listener_pairs_storage.empty() ? 0 : &m_listener_pairs_storage[0],
+                max_connected_listeners,
+                &m_hash_storage[0],
+                hash_table_size );
+}
+#endif
+
+void ACMPTalkerGroupHandlerBase::tick( jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    uint16_t count = getTalkerStreamSourceCount();
+    for ( uint16_t i = 0; i < count; ++i )
+    {
+        getTalkerHandler( i )->tick( m_entity, i, m_event_target, timestamp );
+    }
+}
+
+uint8_t ACMPTalkerGroupHandlerBase::receivedACMPDU( RawSocket *incoming_socket, const jdksavdecc_acmpdu &acmpdu, Frame &frame )
+{
+    (void)incoming_socket;
+    uint8_t status = JDKSAVDECC_ACMP_STATUS_TALKER_UNKNOWN_ID;
 
-uint8_t ACMPTalkerGroupHandlerBase::receivedACMPDU( RawSocket *incoming_socket, const jdksavdecc_acmpdu &acmpdu, Frame &frame ) {
-return JDKSAVDECC_ACMP_STATUS_NOT_SUPPORTED;
+    if ( acmpdu.talker_unique_id < getTalkerStreamSourceCount() )
+    {
+        status = getTalkerHandler( acmpdu.talker_unique_id )
+                     ->receivedACMPDU( m_entity, acmpdu.talker_unique_id, m_event_target, acmpdu, frame );
+    }
+    else
+    {
+        jdksavdecc_acmpdu response = acmpdu;
+        response.header.message_type = acmpdu.header.message_type + 1;
+        response.header.status = status;
+        if ( formACMP( &frame, m_entity->getRawSocket().getMACAddress(), response ) )
+        {
+            m_entity->getRawSocket().sendFrame( frame );
+        }
+    }
+    return status;
 }
 }
@@ -64,6 +64,19 @@ void ADPManager::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
     }
 }
 
+jdksavdecc_timestamp_in_milliseconds ADPManager::nextTickTime( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    // wasTimeOutHit() is true one millisecond after the timeout
+    jdksavdecc_timestamp_in_milliseconds r = m_last_send_time_in_millis + ( getValidTimeInSeconds() * ( 1000 / 4 ) ) + 1;
+
+    if ( m_trigger_send && m_trigger_send_time + 1000 + 1 < r )
+    {
+        r = m_trigger_send_time + 1000 + 1;
+    }
+    (void)time_in_millis;
+    return r;
+}
+
 void ADPManager::sendADP()
 {
     Eui48 adp_multicast_addr = JDKSAVDECC_MULTICAST_ADP_ACMP_MAC;
@@ -31,6 +31,7 @@
 
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/Apc.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
 
 namespace JDKSAvdeccMCU
 {
@@ -180,13 +181,26 @@ bool ApcStateEvents::onIncomingHttpResponse( const HttpResponse &request )
     return r;
 }
 
+bool ApcStateEvents::onIncomingHttpResponseHead( const HttpHead &head )
+{
+    bool r = false;
+    if ( head.getStatusCode().equals( "200" ) )
+    {
+        m_in_http = false;
+        getVariables()->m_responseReceived = true;
+        getVariables()->m_responseValid = true;
+        r = true;
+    }
+    return r;
+}
+
 ssize_t ApcStateEvents::onIncomingTcpAppData( const uint8_t *data, ssize_t len )
 {
-    ssize_t r = 0;
+    ssize_t r = -1;
 
-    for ( ssize_t r = 0; r < len; ++r )
+    if ( len >= 0 && m_app_parser.parse( data, size_t( len ) ) == 0 )
     {
-        m_app_parser.parse( data[r] );
+        r = len;
     }
 
     return r;
@@ -222,8 +236,17 @@ void ApcStateEvents::onAppLinkDown( const AppMessage &msg )
 
 void ApcStateEvents::onAppAvdeccFromAps( const AppMessage &msg )
 {
-    getVariables()->m_apsMsg = msg;
-    getVariables()->m_apsMsgIn = true;
+    ApcStateVariables *v = getVariables();
+
+    v->m_apsMsgBorrowed = &msg;
+    v->m_apsMsgIn = true;
+    getOwner()->run();
+    v->m_apsMsgBorrowed = 0;
+
+    if ( v->m_apsMsgIn )
+    {
+        v->m_apsMsg = msg;
+    }
 }
 
 void ApcStateEvents::onAppAvdeccFromApc( const AppMessage &msg )
@@ -292,7 +315,7 @@ void ApcStateActions::sendHttpRequest( const HttpRequest &request )
 
 void ApcStateActions::sendMsgToAps( const AppMessage &apcMsg )
 {
-    FixedBufferWithSize<1500> msg_as_octets;
+    FixedBufferWithSize<JDKSAVDECC_APPDU_HEADER_LEN + JDKSAVDECC_APPDU_MAX_PAYLOAD_LENGTH> msg_as_octets;
     if ( apcMsg.store( &msg_as_octets ) )
     {
         getEvents()->sendTcpData( msg_as_octets.getBuf(), msg_as_octets.getLength() );
@@ -318,6 +341,7 @@ void ApcStateVariables::clear()
     m_apcMsg.clear();
     m_apcMsgOut = false;
     m_apsMsg.clear();
+    m_apsMsgBorrowed = 0;
     m_apsMsgIn = false;
     m_currentTime = 0;
     m_finished = false;
@@ -362,10 +386,16 @@ bool ApcStates::run()
     return r;
 }
 
+void ApcStates::traceState( uint16_t state )
+{
+    Trace::record( TRACE_APC_STATE, state, uint64_t( uintptr_t( m_owner ) ), getVariables()->m_entityId.convertToUint64(), 0 );
+}
+
 void ApcStates::doBegin() { goToInitialize(); }
 
 void ApcStates::goToInitialize()
 {
+    traceState( TRACE_APC_INITIALIZE );
     m_current_state = &ApcStates::doInitialize;
     getActions()->initialize();
     getActions()->connectToProxy( getVariables()->m_addr );
@@ -373,7 +403,11 @@ void ApcStates::goToInitialize()
 
 void ApcStates::doInitialize() { goToWaitForConnect(); }
 
-void ApcStates::goToWaitForConnect() { m_current_state = &ApcStates::doWaitForConnect; }
+void ApcStates::goToWaitForConnect()
+{
+    traceState( TRACE_APC_WAIT_FOR_CONNECT );
+    m_current_state = &ApcStates::doWaitForConnect;
+}
 
 void ApcStates::doWaitForConnect()
 {
@@ -389,6 +423,7 @@ void ApcStates::doWaitForConnect()
 
 void ApcStates::goToConnected()
 {
+    traceState( TRACE_APC_CONNECTED );
     m_current_state = &ApcStates::doConnected;
 
     getVariables()->m_responseValid = false;
@@ -410,6 +445,7 @@ void ApcStates::doConnected()
 
 void ApcStates::goToStartTransfer()
 {
+    traceState( TRACE_APC_START_TRANSFER );
     m_current_state = &ApcStates::doStartTransfer;
     getActions()->sendIdRequest( getVariables()->m_primaryMac, getVariables()->m_entityId );
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
@@ -417,7 +453,11 @@ void ApcStates::goToStartTransfer()
 
 void ApcStates::doStartTransfer() { goToWaiting(); }
 
-void ApcStates::goToWaiting() { m_current_state = &ApcStates::doWaiting; }
+void ApcStates::goToWaiting()
+{
+    traceState( TRACE_APC_WAITING );
+    m_current_state = &ApcStates::doWaiting;
+}
 
 void ApcStates::doWaiting()
 {
@@ -453,6 +493,7 @@ void ApcStates::doWaiting()
 
 void ApcStates::goToClosed()
 {
+    traceState( TRACE_APC_CLOSED );
     m_current_state = &ApcStates::doClosed;
     getActions()->notifyProxyUnavailable();
 }
@@ -461,6 +502,7 @@ void ApcStates::doClosed() { goToFinish(); }
 
 void ApcStates::goToLinkStatus()
 {
+    traceState( TRACE_APC_LINK_STATUS );
     m_current_state = &ApcStates::doLinkStatus;
     getActions()->notifyLinkStatus( getVariables()->m_linkMsg );
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
@@ -471,14 +513,18 @@ void ApcStates::doLinkStatus() { goToWaiting(); }
 
 void ApcStates::goToReceiveMsg()
 {
-    getActions()->processMsg( getVariables()->m_apsMsg );
-    getVariables()->m_apsMsgIn = false;
+    traceState( TRACE_APC_RECEIVE_MSG );
+    ApcStateVariables *v = getVariables();
+
+    getActions()->processMsg( v->m_apsMsgBorrowed ? *v->m_apsMsgBorrowed : v->m_apsMsg );
+    v->m_apsMsgIn = false;
 }
 
 void ApcStates::doReceiveMsg() { goToWaiting(); }
 
 void ApcStates::goToSendMsg()
 {
+    traceState( TRACE_APC_SEND_MSG );
     getActions()->sendMsgToAps( getVariables()->m_apcMsg );
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
     getVariables()->m_apcMsgOut = false;
@@ -488,6 +534,7 @@ void ApcStates::doSendMsg() { goToWaiting(); }
 
 void ApcStates::goToEntityIdAssigned()
 {
+    traceState( TRACE_APC_ENTITY_ID_ASSIGNED );
     getVariables()->m_entityId = getVariables()->m_newId;
     getActions()->notifyNewEntityId( getVariables()->m_newId );
     getActions()->notifyProxyAvailable();
@@ -499,6 +546,7 @@ void ApcStates::doEntityIdAssigned() { goToWaiting(); }
 
 void ApcStates::goToSendNop()
 {
+    traceState( TRACE_APC_SEND_NOP );
     getActions()->sendNopToAps();
     getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
 }
@@ -507,6 +555,7 @@ void ApcStates::doSendNop() { goToWaiting(); }
 
 void ApcStates::goToFinish()
 {
+    traceState( TRACE_APC_FINISH );
     m_current_state = &ApcStates::doFinish;
     getActions()->closeTcpConnection();
 }
@@ -71,6 +71,15 @@ int AppMessageParser::dispatchMsg( const AppMessage &msg )
     return r;
 }
 
+bool AppMessageParser::dispatchView( uint8_t const *payload )
+{
+    AppMessageView view( m_current_message.m_appdu.base );
+
+    view.m_appdu.payload_length = uint16_t( m_octets_left_in_payload );
+    view.m_appdu.payload = const_cast<uint8_t *>( payload );
+    return m_handler.onAppMessageView( view );
+}
+
 int AppMessageParser::parse( uint8_t octet )
 {
     int r = 0;
@@ -106,6 +115,97 @@ int AppMessageParser::parse( uint8_t octet )
     return r;
 }
 
+int AppMessageParser::parse( uint8_t const *data, size_t len )
+{
+    jdksavdecc_appdu *p = &m_current_message.m_appdu.base;
+    size_t pos = 0;
+
+    while ( pos < len && m_error_count == 0 )
+    {
+        AppMessage *msg = 0;
+
+        if ( m_header_buffer.canPut() )
+        {
+            size_t have = m_header_buffer.getLength();
+
+            if ( have == 0 && len - pos >= JDKSAVDECC_APPDU_HEADER_LEN )
+            {
+                // The whole header is in the block, decode it in place and
+                // mark the header buffer as full
+                decodeHeader( data + pos );
+                m_header_buffer.setLength( JDKSAVDECC_APPDU_HEADER_LEN );
+                pos += JDKSAVDECC_APPDU_HEADER_LEN;
+                msg = validateHeader();
+
+                // The payload is in the block too, try to pass it on in place
+                if ( !msg && m_octets_left_in_payload > 0 && m_octets_left_in_payload <= len - pos
+                     && dispatchView( data + pos ) )
+                {
+                    pos += m_octets_left_in_payload;
+                    m_octets_left_in_payload = 0;
+                    m_header_buffer.clear();
+                }
+            }
+            else
+            {
+                // The header is split across blocks, collect it
+                size_t n = JDKSAVDECC_APPDU_HEADER_LEN - have;
+                if ( n > len - pos )
+                {
+                    n = len - pos;
+                }
+                m_header_buffer.putBuf( data + pos, uint16_t( n ) );
+                pos += n;
+                if ( m_header_buffer.isFull() )
+                {
+                    decodeHeader( m_header_buffer.getBuf() );
+                    msg = validateHeader();
+                }
+            }
+        }
+        else if ( m_octets_left_in_payload )
+        {
+            size_t n = m_octets_left_in_payload;
+            if ( n > len - pos )
+            {
+                n = len - pos;
+            }
+            memcpy( p->payload + p->payload_length, data + pos, n );
+            p->payload_length += uint16_t( n );
+            m_octets_left_in_payload -= n;
+            pos += n;
+
+            if ( m_octets_left_in_payload == 0 )
+            {
+                msg = &m_current_message;
+                m_header_buffer.clear();
+            }
+        }
+        else
+        {
+            break;
+        }
+
+        if ( msg )
+        {
+            dispatchMsg( *msg );
+        }
+    }
+
+    return m_error_count > 0 ? -1 : 0;
+}
+
+void AppMessageParser::decodeHeader( uint8_t const *header )
+{
+    jdksavdecc_appdu *p = &m_current_message.m_appdu.base;
+
+    p->version = header[JDKSAVDECC_APPDU_OFFSET_VERSION];
+    p->message_type = header[JDKSAVDECC_APPDU_OFFSET_MESSAGE_TYPE];
+    p->payload_length = jdksavdecc_uint16_get( header, JDKSAVDECC_APPDU_OFFSET_PAYLOAD_LENGTH );
+    p->address = jdksavdecc_eui48_get( header, JDKSAVDECC_APPDU_OFFSET_ADDRESS );
+    p->reserved = jdksavdecc_uint16_get( header, JDKSAVDECC_APPDU_OFFSET_RESERVED );
+}
+
 AppMessage *AppMessageParser::parseHeader( uint8_t octet )
 {
     AppMessage *msg = 0;
@@ -117,18 +217,7 @@ AppMessage *AppMessageParser::parseHeader( uint8_t octet )
     if ( m_header_buffer.isFull() )
     {
         // yes, try parse the header
-
-        jdksavdecc_appdu *p = &m_current_message.m_appdu.base;
-
-        p->version = m_header_buffer.getOctet( JDKSAVDECC_APPDU_OFFSET_VERSION );
-
-        p->message_type = m_header_buffer.getOctet( JDKSAVDECC_APPDU_OFFSET_MESSAGE_TYPE );
-
-        p->payload_length = m_header_buffer.getDoublet( JDKSAVDECC_APPDU_OFFSET_PAYLOAD_LENGTH );
-
-        p->address = m_header_buffer.getEUI48( JDKSAVDECC_APPDU_OFFSET_ADDRESS );
-
-        p->reserved = m_header_buffer.getDoublet( JDKSAVDECC_APPDU_OFFSET_RESERVED );
+        decodeHeader( m_header_buffer.getBuf() );
 
         // and validate the header
         msg = validateHeader();
@@ -141,6 +230,7 @@ AppMessage *AppMessageParser::validateHeader()
 {
     AppMessage *msg = 0;
     jdksavdecc_appdu *p = &m_current_message.m_appdu.base;
+    size_t error_count = m_error_count;
 
     // Is the version field recognized?
     if ( p->version == JDKSAVDECC_APPDU_VERSION )
@@ -270,6 +360,13 @@ AppMessage *AppMessageParser::validateHeader()
         // We don't know this version
         m_error_count++;
     }
+
+    // A valid message with an empty payload is complete with its header
+    if ( !msg && m_error_count == error_count && m_octets_left_in_payload == 0 )
+    {
+        msg = &m_current_message;
+        m_header_buffer.clear();
+    }
     return msg;
 }
 
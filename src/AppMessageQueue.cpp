@@ -0,0 +1,205 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/AppMessageQueue.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+AppMessageQueue::AppMessageQueue( Slot *storage, uint32_t capacity, OverflowPolicy policy )
+    : m_storage( 0 ), m_capacity( 0 ), m_mask( 0 ), m_policy( policy )
+{
+    setStorage( storage, capacity );
+}
+
+void AppMessageQueue::setStorage( Slot *storage, uint32_t capacity )
+{
+    uint32_t c = 0;
+
+    if ( storage )
+    {
+        // Round down to a power of two so that the free running
+        // positions can be masked and may wrap around safely
+        c = 1;
+        while ( c * 2 != 0 && c * 2 <= capacity )
+        {
+            c *= 2;
+        }
+        if ( c > capacity )
+        {
+            c = 0;
+        }
+    }
+
+    m_storage = storage;
+    m_capacity = c;
+    m_mask = c ? c - 1 : 0;
+    clear();
+}
+
+void AppMessageQueue::clear()
+{
+    for ( uint32_t i = 0; i < m_capacity; ++i )
+    {
+        m_storage[i].m_sequence.store( i );
+    }
+    m_head.store( 0 );
+    m_tail.store( 0 );
+    m_pushed_count.store( 0 );
+    m_popped_count.store( 0 );
+    m_dropped_count.store( 0 );
+    m_rejected_count.store( 0 );
+    m_high_water_mark.store( 0 );
+}
+
+bool AppMessageQueue::push( const Frame &frame )
+{
+    AppMessage *msg = acquireSlot();
+    if ( msg )
+    {
+        msg->setAvdeccFromAps( frame );
+        publishSlot();
+    }
+    return msg != 0;
+}
+
+bool AppMessageQueue::push( const AppMessage &msg )
+{
+    AppMessage *slot_msg = acquireSlot();
+    if ( slot_msg )
+    {
+        *slot_msg = msg;
+        publishSlot();
+    }
+    return slot_msg != 0;
+}
+
+bool AppMessageQueue::pop( AppMessage *msg )
+{
+    if ( m_capacity == 0 )
+    {
+        return false;
+    }
+
+    uint32_t pos = m_tail.load();
+    for ( ;; )
+    {
+        Slot *slot = &m_storage[pos & m_mask];
+        int32_t diff = (int32_t)( slot->m_sequence.load() - ( pos + 1 ) );
+
+        if ( diff == 0 )
+        {
+            // The slot holds the message for pos; claim it. If the
+            // producer dropped it first, pos is reloaded and we retry
+            if ( m_tail.compare_exchange_strong( pos, pos + 1 ) )
+            {
+                *msg = slot->m_msg;
+
+                // Hand the slot back to the producer for its next lap
+                slot->m_sequence.store( pos + m_capacity );
+                m_popped_count.store( m_popped_count.load() + 1 );
+                return true;
+            }
+        }
+        else if ( diff < 0 )
+        {
+            // Not written yet, the queue is empty
+            return false;
+        }
+        else
+        {
+            // Our tail position is stale
+            pos = m_tail.load();
+        }
+    }
+}
+
+uint32_t AppMessageQueue::getSize() const
+{
+    uint32_t size = m_head.load() - m_tail.load();
+    return size > m_capacity ? m_capacity : size;
+}
+
+AppMessage *AppMessageQueue::acquireSlot()
+{
+    if ( m_capacity == 0 )
+    {
+        m_rejected_count.store( m_rejected_count.load() + 1 );
+        return 0;
+    }
+
+    uint32_t pos = m_head.load();
+    Slot *slot = &m_storage[pos & m_mask];
+    uint32_t seq = slot->m_sequence.load();
+
+    if ( seq != pos )
+    {
+        // The slot still holds the message queued one lap ago
+        if ( m_policy == OVERFLOW_DROP_OLDEST )
+        {
+            uint32_t oldest = pos - m_capacity;
+            if ( m_tail.compare_exchange_strong( oldest, oldest + 1 ) )
+            {
+                // The oldest message is now ours to overwrite
+                m_dropped_count.store( m_dropped_count.load() + 1 );
+                return &slot->m_msg;
+            }
+
+            // The consumer claimed it first, the slot is free
+            // as soon as its copy has completed
+            seq = slot->m_sequence.load();
+        }
+
+        if ( seq != pos )
+        {
+            m_rejected_count.store( m_rejected_count.load() + 1 );
+            return 0;
+        }
+    }
+    return &slot->m_msg;
+}
+
+void AppMessageQueue::publishSlot()
+{
+    uint32_t pos = m_head.load();
+
+    m_storage[pos & m_mask].m_sequence.store( pos + 1 );
+    m_head.store( pos + 1 );
+    m_pushed_count.store( m_pushed_count.load() + 1 );
+
+    uint32_t depth = getSize();
+    if ( depth > m_high_water_mark.load() )
+    {
+        m_high_water_mark.store( depth );
+    }
+}
+}
@@ -31,6 +31,7 @@
 
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/Aps.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
 
 namespace JDKSAvdeccMCU
 {
@@ -45,8 +46,10 @@ ApsStateMachine::ApsStateMachine( ApsStateVariables *variables,
     , m_actions( actions )
     , m_events( events )
     , m_states( states )
+    , m_assigned_count( 0 )
     , m_active_entity_id_count( active_entity_id_count )
     , m_active_connections( active_connections )
+    , m_entity_id_allocator( 0 )
 {
 }
 
@@ -70,7 +73,19 @@ void ApsStateMachine::onTcpConnectionClosed() { m_events->onTcpConnectionClosed(
 
 void ApsStateMachine::onTimeTick( uint32_t time_in_seconds ) { getEvents()->onTimeTick( time_in_seconds ); }
 
-void ApsStateMachine::closeTcpConnection() { m_active_connections.erase( m_assigned_count ); }
+void ApsStateMachine::closeTcpConnection()
+{
+    if ( m_entity_id_allocator )
+    {
+        // The APC keeps a lease on its entity_id for when it reconnects
+        m_entity_id_allocator->release( m_assigned_count, getVariables()->m_currentTime );
+    }
+    else
+    {
+        m_active_connections.erase( m_assigned_count );
+    }
+    m_assigned_count = 0;
+}
 
 void ApsStateMachine::closeTcpServer() {}
 
@@ -89,6 +104,17 @@ void ApsStateMachine::onNetLinkStatusUpdated( Eui48 link_mac, bool link_status )
 
 Eui64 ApsStateMachine::assignEntityId( Eui48 server_link_mac, Eui48 apc_link_mac, Eui64 requested_entity_id )
 {
+    if ( m_entity_id_allocator )
+    {
+        ApsEntityIdAllocator *allocator = m_entity_id_allocator;
+        uint32_t now = getVariables()->m_currentTime;
+
+        // An APC that asks again gives up the one it has, in the same storage update
+        m_assigned_count = allocator->reassign(
+            m_assigned_count, apc_link_mac, allocator->getIndex( server_link_mac, requested_entity_id ), now );
+        return m_assigned_count != 0 ? ApsEntityIdAllocator::makeEntityId( server_link_mac, m_assigned_count ) : Eui64();
+    }
+
     // increase our count of assigned entity_id's
     ++m_active_entity_id_count;
 
@@ -101,16 +127,7 @@ Eui64 ApsStateMachine::assignEntityId( Eui48 server_link_mac, Eui48 apc_link_mac
     m_assigned_count = m_active_entity_id_count;
     m_active_connections.insert( m_assigned_count );
 
-    Eui64 r;
-    r.value[0] = server_link_mac.value[0];
-    r.value[1] = server_link_mac.value[1];
-    r.value[2] = server_link_mac.value[2];
-    r.value[3] = uint8_t( ( m_active_entity_id_count >> 8 ) & 0xff );
-    r.value[4] = uint8_t( ( m_active_entity_id_count >> 0 ) & 0xff );
-    r.value[5] = server_link_mac.value[3];
-    r.value[6] = server_link_mac.value[4];
-    r.value[7] = server_link_mac.value[5];
-    return r;
+    return ApsEntityIdAllocator::makeEntityId( server_link_mac, m_assigned_count );
 }
 
 void ApsStateMachine::clear()
@@ -198,13 +215,27 @@ bool ApsStateEvents::onIncomingHttpConnectRequest( const HttpRequest &request )
     return r;
 }
 
+bool ApsStateEvents::onIncomingHttpRequestHead( const HttpHead &head )
+{
+    bool r = false;
+    if ( head.getVersion().startsWith( "HTTP/1." ) && head.getMethod().equals( "CONNECT" )
+         && head.getPath().m_length == m_path.length()
+         && memcmp( head.getPath().m_data, m_path.data(), m_path.length() ) == 0 )
+    {
+        m_in_http = false;
+        getVariables()->m_requestValid = 200;
+        r = true;
+    }
+    return r;
+}
+
 ssize_t ApsStateEvents::onIncomingTcpAppData( const uint8_t *data, ssize_t len )
 {
-    ssize_t r = 0;
+    ssize_t r = -1;
 
-    for ( ssize_t r = 0; r < len; ++r )
+    if ( len >= 0 && m_app_parser.parse( data, size_t( len ) ) == 0 )
     {
-        m_app_parser.parse( data[r] );
+        r = len;
     }
 
     return r;
@@ -224,8 +255,9 @@ void ApsStateEvents::onNetLinkStatusUpdated( Eui48 link_mac, bool link_status )
 
 void ApsStateEvents::onNetAvdeccMessageReceived( const Frame &frame )
 {
-    getVariables()->m_in.setAvdeccFromAps( frame );
-    getVariables()->m_L2Msg = true;
+    // When full, the queue's overflow policy decides whether the
+    // oldest pending message or this one is discarded
+    getVariables()->m_L2Queue.push( frame );
 }
 
 void ApsStateEvents::onTimeTick( uint32_t time_in_seconds ) { getVariables()->m_currentTime = time_in_seconds; }
@@ -237,10 +269,9 @@ void ApsStateEvents::onAppNop( const AppMessage &msg )
 
 void ApsStateEvents::onAppEntityIdRequest( const AppMessage &msg )
 {
+    getVariables()->m_a = msg.getAddress();
     getVariables()->m_entity_id = msg.getEntityIdRequestEntityId();
     getVariables()->m_assignEntityIdRequest = true;
-
-    // TODO: assign proper entity_id
 }
 
 void ApsStateEvents::onAppEntityIdResponse( const AppMessage &msg )
@@ -263,10 +294,39 @@ void ApsStateEvents::onAppAvdeccFromAps( const AppMessage &msg )
     // Do Nothing
 }
 
-void ApsStateEvents::onAppAvdeccFromApc( const AppMessage &msg )
+void ApsStateEvents::onAppAvdeccFromApc( const AppMessage &msg ) { transferToL2( AppMessageView( msg ) ); }
+
+bool ApsStateEvents::onAppMessageView( const AppMessageView &view )
 {
-    getVariables()->m_out = msg;
-    getVariables()->m_apcMsg = true;
+    bool r = false;
+    if ( view.getMessageType() == AppMessage::AVDECC_FROM_APC )
+    {
+        transferToL2( view );
+        r = true;
+    }
+    return r;
+}
+
+void ApsStateEvents::transferToL2( const AppMessageView &view )
+{
+    ApsStateVariables *v = getVariables();
+
+    // Older messages go first, also when this is called while the state machine runs
+    if ( v->m_outQueue.isEmpty() && !v->m_outView )
+    {
+        v->m_outView = &view;
+        v->m_apcMsg = true;
+        getOwner()->run();
+        if ( !v->m_outView )
+        {
+            return;
+        }
+        v->m_outView = 0;
+    }
+
+    v->m_out = view;
+    v->m_outQueue.push( v->m_out );
+    v->m_apcMsg = true;
 }
 
 void ApsStateEvents::onAppVendor( const AppMessage &msg )
@@ -284,6 +344,7 @@ void ApsStateActions::initialize()
     ApsStateVariables *v = getVariables();
 
     v->m_apcMsg = false;
+    v->m_outQueue.clear();
     v->m_assignEntityIdRequest = false;
     v->m_currentTime = 0;
     v->m_finished = false;
@@ -295,32 +356,35 @@ void ApsStateActions::initialize()
 
 void ApsStateActions::sendHttpResponse( int requestValid )
 {
-    char statusbuf[16];
-    HttpResponse response;
+    char buf[64];
+    char const *reason = "OK";
+    int len;
 
     if ( requestValid < 0 )
     {
         requestValid = 404;
-        response.m_reason_phrase = "NOT FOUND";
     }
+    if ( requestValid != 200 )
+    {
+        reason = requestValid == 404 ? "Not Found" : "Error";
+    }
+
+    // Formed in place, a connection storm should not hit the allocator
 #if defined( _WIN32 )
-    sprintf_s( statusbuf, sizeof( statusbuf ), "%d", requestValid );
+    len = sprintf_s( buf, sizeof( buf ), "HTTP/1.1 %d %s\r\n\r\n", requestValid, reason );
 #else
-    sprintf( statusbuf, "%d", requestValid );
+    len = snprintf( buf, sizeof( buf ), "HTTP/1.1 %d %s\r\n\r\n", requestValid, reason );
 #endif
-    response.m_version = "HTTP/1.1";
-    response.m_status_code = statusbuf;
-    response.m_reason_phrase = "OK";
-
-    std::vector<uint8_t> buf;
-    response.flatten( &buf );
 
-    getEvents()->sendTcpData( buf.data(), buf.size() );
+    if ( len > 0 && len < int( sizeof( buf ) ) )
+    {
+        getEvents()->sendTcpData( reinterpret_cast<uint8_t const *>( buf ), len );
+    }
 }
 
 void ApsStateActions::sendMsgToApc( const AppMessage &apsMsg )
 {
-    FixedBufferWithSize<1500> msg_as_octets;
+    FixedBufferWithSize<JDKSAVDECC_APPDU_HEADER_LEN + JDKSAVDECC_APPDU_MAX_PAYLOAD_LENGTH> msg_as_octets;
     if ( apsMsg.store( &msg_as_octets ) )
     {
         getEvents()->sendTcpData( msg_as_octets.getBuf(), msg_as_octets.getLength() );
@@ -341,11 +405,13 @@ void ApsStateActions::sendLinkStatus( Eui48 link_mac, bool linkStatus )
     sendMsgToApc( msg );
 }
 
-void ApsStateActions::sendAvdeccToL2( const AppMessage *msg )
+void ApsStateActions::sendAvdeccToL2( const AppMessage *msg ) { sendAvdeccToL2( AppMessageView( *msg ) ); }
+
+void ApsStateActions::sendAvdeccToL2( const AppMessageView &msg )
 {
-    FrameWithMTU frame( 0, msg->getAddress(), getVariables()->m_linkMac, JDKSAVDECC_AVTP_ETHERTYPE );
+    FrameWithMTU frame( 0, msg.getAddress(), getVariables()->m_linkMac, JDKSAVDECC_AVTP_ETHERTYPE );
 
-    frame.putBuf( msg->getPayload(), msg->getPayloadLength() );
+    frame.putBuf( msg.getPayload(), msg.getPayloadLength() );
     getOwner()->sendAvdeccToL2( frame );
 }
 
@@ -386,7 +452,10 @@ void ApsStateVariables::clear()
     m_nopTimeout = 0;
     m_currentTime = 0;
     m_out.setNOP();
+    m_outView = 0;
+    m_outQueue.clear();
     m_in.setNOP();
+    m_L2Queue.clear();
 }
 
 void ApsStates::clear()
@@ -398,6 +467,8 @@ void ApsStates::clear()
     getVariables()->m_linkStatusChanged = false;
     getVariables()->m_apcMsg = false;
     getVariables()->m_L2Msg = false;
+    getVariables()->m_L2Queue.clear();
+    getVariables()->m_outQueue.clear();
     getVariables()->m_assignEntityIdRequest = false;
 }
 
@@ -407,6 +478,9 @@ bool ApsStates::run()
 
     state_proc last_state;
 
+    // Drain at most one ring's worth of layer 2 messages per run
+    m_L2_transfer_budget = getVariables()->getL2BatchLimit();
+
     // call the current state function
     do
     {
@@ -427,10 +501,16 @@ bool ApsStates::run()
     return r;
 }
 
+void ApsStates::traceState( uint16_t state )
+{
+    Trace::record( TRACE_APS_STATE, state, uint64_t( uintptr_t( m_owner ) ), getVariables()->m_entity_id.convertToUint64(), 0 );
+}
+
 void ApsStates::doBegin() { goToInitialize(); }
 
 void ApsStates::goToInitialize()
 {
+    traceState( TRACE_APS_INITIALIZE );
     m_current_state = &ApsStates::doInitialize;
     getActions()->initialize();
 }
@@ -439,6 +519,7 @@ void ApsStates::doInitialize() { goToWaitForConnect(); }
 
 void ApsStates::goToWaitForConnect()
 {
+    traceState( TRACE_APS_WAIT_FOR_CONNECT );
     m_current_state = &ApsStates::doWaitForConnect;
     getVariables()->m_tcpConnected = false;
     getVariables()->m_incomingTcpClosed = false;
@@ -458,6 +539,7 @@ void ApsStates::doWaitForConnect()
 
 void ApsStates::goToAccept()
 {
+    traceState( TRACE_APS_ACCEPT );
     m_current_state = &ApsStates::doAccept;
     getVariables()->m_requestValid = -1;
 }
@@ -478,13 +560,18 @@ void ApsStates::doAccept()
 
 void ApsStates::goToReject()
 {
+    traceState( TRACE_APS_REJECT );
     m_current_state = &ApsStates::doReject;
     getActions()->sendHttpResponse( getVariables()->m_requestValid );
 }
 
 void ApsStates::doReject() { goToClosed(); }
 
-void ApsStates::goToClosed() { m_current_state = &ApsStates::doClosed; }
+void ApsStates::goToClosed()
+{
+    traceState( TRACE_APS_CLOSED );
+    m_current_state = &ApsStates::doClosed;
+}
 
 void ApsStates::doClosed()
 {
@@ -494,18 +581,23 @@ void ApsStates::doClosed()
 
 void ApsStates::goToStartTransfer()
 {
+    traceState( TRACE_APS_START_TRANSFER );
     m_current_state = &ApsStates::doStartTransfer;
 
     getActions()->sendHttpResponse( getVariables()->m_requestValid );
 
     getActions()->sendLinkStatus( getVariables()->m_linkMac, getVariables()->m_linkStatus );
 
-    getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
+    getVariables()->restartNopTimer();
 }
 
 void ApsStates::doStartTransfer() { goToWaiting(); }
 
-void ApsStates::goToWaiting() { m_current_state = &ApsStates::doWaiting; }
+void ApsStates::goToWaiting()
+{
+    traceState( TRACE_APS_WAITING );
+    m_current_state = &ApsStates::doWaiting;
+}
 
 void ApsStates::doWaiting()
 {
@@ -525,7 +617,7 @@ void ApsStates::doWaiting()
     {
         goToTransferToL2();
     }
-    else if ( getVariables()->m_L2Msg == true )
+    else if ( getVariables()->hasL2Msg() && m_L2_transfer_budget > 0 )
     {
         goToTransferToApc();
     }
@@ -533,7 +625,7 @@ void ApsStates::doWaiting()
     {
         goToAssignEntityId();
     }
-    else if ( ( (int)getVariables()->m_nopTimeout - (int)getVariables()->m_currentTime ) < 0 )
+    else if ( getVariables()->isNopDue() )
     {
         goToSendNop();
     }
@@ -541,11 +633,12 @@ void ApsStates::doWaiting()
 
 void ApsStates::goToLinkStatus()
 {
+    traceState( TRACE_APS_LINK_STATUS );
     m_current_state = &ApsStates::doLinkStatus;
 
     getActions()->sendLinkStatus( getVariables()->m_linkMac, getVariables()->m_linkStatus );
 
-    getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
+    getVariables()->restartNopTimer();
 
     getVariables()->m_linkStatusChanged = false;
 }
@@ -554,28 +647,53 @@ void ApsStates::doLinkStatus() { goToWaiting(); }
 
 void ApsStates::goToTransferToL2()
 {
+    traceState( TRACE_APS_TRANSFER_TO_L2 );
+    ApsStateVariables *v = getVariables();
+
     m_current_state = &ApsStates::doTransferToL2;
-    getActions()->sendAvdeccToL2( &getVariables()->m_out );
-    getVariables()->m_apcMsg = false;
+
+    // The view is only set while nothing is queued, so it is the oldest
+    if ( v->m_outView )
+    {
+        AppMessageView const *view = v->m_outView;
+        v->m_outView = 0;
+        getActions()->sendAvdeccToL2( *view );
+    }
+    else if ( v->m_outQueue.pop( &v->m_out ) )
+    {
+        getActions()->sendAvdeccToL2( &v->m_out );
+    }
+    v->m_apcMsg = !v->m_outQueue.isEmpty();
 }
 
 void ApsStates::doTransferToL2() { goToWaiting(); }
 
 void ApsStates::goToTransferToApc()
 {
+    traceState( TRACE_APS_TRANSFER_TO_APC );
+    ApsStateVariables *v = getVariables();
+
     m_current_state = &ApsStates::doTransferToApc;
-    getActions()->sendAvdeccToApc( &getVariables()->m_in );
-    getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
-    getVariables()->m_L2Msg = false;
+
+    // A message placed directly in 'in' goes first, otherwise
+    // take the oldest one from the queue
+    if ( v->m_L2Msg || v->m_L2Queue.pop( &v->m_in ) )
+    {
+        getActions()->sendAvdeccToApc( &v->m_in );
+        v->restartNopTimer();
+    }
+    v->m_L2Msg = false;
+    --m_L2_transfer_budget;
 }
 
 void ApsStates::doTransferToApc() { goToWaiting(); }
 
 void ApsStates::goToAssignEntityId()
 {
+    traceState( TRACE_APS_ASSIGN_ENTITY_ID );
     m_current_state = &ApsStates::doAssignEntityId;
     getActions()->sendEntityIdAssignment( getVariables()->m_a, getVariables()->m_entity_id );
-    getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
+    getVariables()->restartNopTimer();
     getVariables()->m_assignEntityIdRequest = false;
 }
 
@@ -583,15 +701,17 @@ void ApsStates::doAssignEntityId() { goToWaiting(); }
 
 void ApsStates::goToSendNop()
 {
+    traceState( TRACE_APS_SEND_NOP );
     m_current_state = &ApsStates::doSendNop;
     getActions()->sendNopToApc();
-    getVariables()->m_nopTimeout = getVariables()->m_currentTime + 10;
+    getVariables()->restartNopTimer();
 }
 
 void ApsStates::doSendNop() { goToWaiting(); }
 
 void ApsStates::goToCloseAndFinish()
 {
+    traceState( TRACE_APS_CLOSE_AND_FINISH );
     m_current_state = &ApsStates::doCloseAndFinish;
     getActions()->closeTcpConnection();
 }
@@ -600,6 +720,7 @@ void ApsStates::doCloseAndFinish() { goToFinish(); }
 
 void ApsStates::goToFinish()
 {
+    traceState( TRACE_APS_FINISH );
     m_current_state = &ApsStates::doFinish;
     getActions()->closeTcpServer();
 }
@@ -608,7 +729,8 @@ void ApsStates::doFinish() { m_current_state = 0; }
 
 ApsStates::ApsStates()
     : m_owner( 0 ),
-    m_current_state( &ApsStates::doBegin )
+    m_current_state( &ApsStates::doBegin ),
+    m_L2_transfer_budget( 0 )
 {}
 
 }
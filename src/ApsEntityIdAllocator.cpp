@@ -0,0 +1,582 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/ApsEntityIdAllocator.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+ApsEntityIdAllocator::ApsEntityIdAllocator( uint16_t max_ids,
+                                            uint32_t lease_time_in_seconds,
+                                            PersistentStorage *storage,
+                                            uint32_t base_offset )
+    : m_max_ids( max_ids == 0 ? 1 : max_ids )
+    , m_lease_time( lease_time_in_seconds )
+    , m_storage( storage )
+    , m_base_offset( base_offset )
+    , m_free_first( 0 )
+    , m_free_last( 0 )
+    , m_free_count( 0 )
+    , m_lease_table_mask( 0 )
+    , m_assigned_count( 0 )
+    , m_leased_count( 0 )
+    , m_reclaimed_count( 0 )
+    , m_exhausted_count( 0 )
+    , m_collision_count( 0 )
+    , m_write_count( 0 )
+{
+    Slot empty;
+    empty.m_state = INDEX_FREE;
+    empty.m_collided = false;
+    empty.m_in_free_list = false;
+    empty.m_free_prev = 0;
+    empty.m_free_next = 0;
+    empty.m_expires = 0;
+    m_slots.resize( size_t( m_max_ids ) + 1, empty );
+
+    // At most half full so that probe sequences stay short
+    size_t table_size = 1;
+    while ( table_size < size_t( m_max_ids ) * 2 )
+    {
+        table_size <<= 1;
+    }
+    m_lease_table.resize( table_size, 0 );
+    m_lease_table_mask = table_size - 1;
+
+    for ( uint16_t i = 1; i <= m_max_ids; ++i )
+    {
+        makeFree( i );
+    }
+}
+
+uint32_t ApsEntityIdAllocator::restore( uint32_t time_in_seconds )
+{
+    uint32_t restored = 0;
+
+    if ( !m_storage )
+    {
+        return 0;
+    }
+
+    if ( !readHeader() )
+    {
+        writeHeader();
+        for ( uint16_t i = 1; i <= m_max_ids; ++i )
+        {
+            writeRecord( i );
+        }
+        m_storage->flush();
+        return 0;
+    }
+
+    for ( uint16_t i = 1; i <= m_max_ids; ++i )
+    {
+        uint8_t buf[RECORD_SIZE];
+        if ( m_storage->read( m_base_offset + HEADER_SIZE + uint32_t( i - 1 ) * RECORD_SIZE, buf, RECORD_SIZE )
+             && PersistentStorage::crc8( buf, RECORD_SIZE - 1 ) == buf[RECORD_SIZE - 1] && buf[0] == INDEX_LEASED
+             && m_slots[i].m_state == INDEX_FREE )
+        {
+            Eui48 apc_link_mac( &buf[1] );
+            if ( findLease( apc_link_mac ) == 0 )
+            {
+                m_slots[i].m_apc_link_mac = apc_link_mac;
+                insertLease( i );
+                ++m_leased_count;
+                startExpiry( i, INDEX_LEASED, time_in_seconds );
+                ++restored;
+            }
+        }
+    }
+    return restored;
+}
+
+uint16_t ApsEntityIdAllocator::assign( Eui48 const &apc_link_mac, uint16_t requested_index, uint32_t time_in_seconds )
+{
+    uint16_t index = assignSlot( apc_link_mac, requested_index, time_in_seconds );
+    if ( index != 0 )
+    {
+        writeRecord( index );
+        if ( m_storage )
+        {
+            m_storage->flush();
+        }
+    }
+    return index;
+}
+
+uint16_t ApsEntityIdAllocator::reassign( uint16_t index,
+                                         Eui48 const &apc_link_mac,
+                                         uint16_t requested_index,
+                                         uint32_t time_in_seconds )
+{
+    bool released = releaseSlot( index, time_in_seconds );
+    uint16_t new_index = assignSlot( apc_link_mac, requested_index, time_in_seconds );
+
+    // The records of both indexes are committed by one flush
+    if ( released && index != new_index )
+    {
+        writeRecord( index );
+    }
+    if ( new_index != 0 )
+    {
+        writeRecord( new_index );
+    }
+    if ( m_storage && ( released || new_index != 0 ) )
+    {
+        m_storage->flush();
+    }
+    return new_index;
+}
+
+void ApsEntityIdAllocator::release( uint16_t index, uint32_t time_in_seconds )
+{
+    if ( releaseSlot( index, time_in_seconds ) )
+    {
+        writeRecord( index );
+        if ( m_storage )
+        {
+            m_storage->flush();
+        }
+    }
+}
+
+uint16_t ApsEntityIdAllocator::assignSlot( Eui48 const &apc_link_mac, uint16_t requested_index, uint32_t time_in_seconds )
+{
+    // Not the virtual one, a locked subclass already holds its lock here
+    ApsEntityIdAllocator::onTimeTick( time_in_seconds );
+
+    uint16_t index = findLease( apc_link_mac );
+
+    if ( index != 0 && m_slots[index].m_state == INDEX_LEASED )
+    {
+        // A reconnecting APC gets its entity_id back
+        take( index );
+    }
+    else
+    {
+        // Either no lease or the leased index is in use by another
+        // connection from the same APC
+        index = 0;
+
+        if ( requested_index > 0 && requested_index <= m_max_ids && m_slots[requested_index].m_state == INDEX_FREE )
+        {
+            index = requested_index;
+        }
+
+        if ( index == 0 )
+        {
+            index = m_free_first;
+        }
+
+        if ( index == 0 )
+        {
+            // Take the oldest lease that has not expired yet, dropping
+            // stale entries on the way so that the next search is short
+            std::deque<Expiry>::iterator e = m_expiries.begin();
+            while ( e != m_expiries.end() )
+            {
+                bool live = isLive( *e );
+                if ( live && m_slots[e->m_index].m_state == INDEX_LEASED )
+                {
+                    index = e->m_index;
+                    eraseLease( index );
+                    ++m_reclaimed_count;
+                    break;
+                }
+                if ( !live && e == m_expiries.begin() )
+                {
+                    m_expiries.pop_front();
+                    e = m_expiries.begin();
+                }
+                else
+                {
+                    ++e;
+                }
+            }
+        }
+
+        if ( index == 0 )
+        {
+            ++m_exhausted_count;
+            return 0;
+        }
+
+        take( index );
+        m_slots[index].m_apc_link_mac = apc_link_mac;
+        if ( findLease( apc_link_mac ) == 0 )
+        {
+            insertLease( index );
+        }
+    }
+
+    m_slots[index].m_state = INDEX_ASSIGNED;
+    ++m_assigned_count;
+    return index;
+}
+
+bool ApsEntityIdAllocator::releaseSlot( uint16_t index, uint32_t time_in_seconds )
+{
+    if ( index == 0 || index > m_max_ids || m_slots[index].m_state != INDEX_ASSIGNED )
+    {
+        return false;
+    }
+
+    Slot &slot = m_slots[index];
+    --m_assigned_count;
+
+    if ( slot.m_collided )
+    {
+        if ( findLease( slot.m_apc_link_mac ) == index )
+        {
+            eraseLease( index );
+        }
+        startExpiry( index, INDEX_COLLIDED, time_in_seconds );
+    }
+    else if ( findLease( slot.m_apc_link_mac ) == index )
+    {
+        ++m_leased_count;
+        startExpiry( index, INDEX_LEASED, time_in_seconds );
+    }
+    else
+    {
+        makeFree( index );
+    }
+    return true;
+}
+
+bool ApsEntityIdAllocator::observeEntityId( Eui48 const &server_link_mac,
+                                            Eui64 const &entity_id,
+                                            Eui48 const &source_mac,
+                                            uint32_t time_in_seconds )
+{
+    uint16_t index = getIndex( server_link_mac, entity_id );
+
+    if ( index == 0 || source_mac == server_link_mac )
+    {
+        return false;
+    }
+
+    Slot &slot = m_slots[index];
+
+    // The APC that the entity_id belongs to may be seen directly
+    if ( ( slot.m_state == INDEX_ASSIGNED || slot.m_state == INDEX_LEASED ) && source_mac == slot.m_apc_link_mac )
+    {
+        return false;
+    }
+
+    ++m_collision_count;
+
+    switch ( slot.m_state )
+    {
+    case INDEX_FREE:
+        startExpiry( index, INDEX_COLLIDED, time_in_seconds );
+        break;
+    case INDEX_LEASED:
+        take( index );
+        eraseLease( index );
+        startExpiry( index, INDEX_COLLIDED, time_in_seconds );
+        writeRecord( index );
+        if ( m_storage )
+        {
+            m_storage->flush();
+        }
+        break;
+    case INDEX_ASSIGNED:
+        // Can not take it from the APC, stop using it once it is released
+        slot.m_collided = true;
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+bool ApsEntityIdAllocator::observeFrame( Eui48 const &server_link_mac, Frame const &frame, uint32_t time_in_seconds )
+{
+    if ( frame.getEtherType() == JDKSAVDECC_AVTP_ETHERTYPE && frame.getPayloadLength() >= JDKSAVDECC_ADPDU_LEN )
+    {
+        uint8_t const *p = frame.getPayload();
+
+        // subtype and message_type of the common control header
+        if ( ( p[0] & 0x7f ) == ( JDKSAVDECC_SUBTYPE_ADP & 0x7f )
+             && ( p[1] & 0x0f ) == JDKSAVDECC_ADP_MESSAGE_TYPE_ENTITY_AVAILABLE )
+        {
+            Eui64 entity_id( &p[JDKSAVDECC_COMMON_CONTROL_HEADER_OFFSET_STREAM_ID] );
+            return observeEntityId( server_link_mac, entity_id, frame.getSA(), time_in_seconds );
+        }
+    }
+    return false;
+}
+
+void ApsEntityIdAllocator::onTimeTick( uint32_t time_in_seconds )
+{
+    bool changed = false;
+
+    while ( !m_expiries.empty() && int32_t( time_in_seconds - m_expiries.front().m_expires ) >= 0 )
+    {
+        Expiry e = m_expiries.front();
+        m_expiries.pop_front();
+
+        Slot &slot = m_slots[e.m_index];
+        if ( isLive( e ) )
+        {
+            if ( slot.m_state == INDEX_LEASED )
+            {
+                take( e.m_index );
+                eraseLease( e.m_index );
+            }
+            makeFree( e.m_index );
+            writeRecord( e.m_index );
+            changed = true;
+        }
+    }
+
+    if ( changed && m_storage )
+    {
+        m_storage->flush();
+    }
+}
+
+Eui64 ApsEntityIdAllocator::makeEntityId( Eui48 const &server_link_mac, uint16_t index )
+{
+    Eui64 r;
+    r.value[0] = server_link_mac.value[0];
+    r.value[1] = server_link_mac.value[1];
+    r.value[2] = server_link_mac.value[2];
+    r.value[3] = uint8_t( ( index >> 8 ) & 0xff );
+    r.value[4] = uint8_t( ( index >> 0 ) & 0xff );
+    r.value[5] = server_link_mac.value[3];
+    r.value[6] = server_link_mac.value[4];
+    r.value[7] = server_link_mac.value[5];
+    return r;
+}
+
+uint16_t ApsEntityIdAllocator::getIndex( Eui48 const &server_link_mac, Eui64 const &entity_id ) const
+{
+    uint16_t index = 0;
+
+    if ( entity_id.value[0] == server_link_mac.value[0] && entity_id.value[1] == server_link_mac.value[1]
+         && entity_id.value[2] == server_link_mac.value[2] && entity_id.value[5] == server_link_mac.value[3]
+         && entity_id.value[6] == server_link_mac.value[4] && entity_id.value[7] == server_link_mac.value[5] )
+    {
+        index = uint16_t( ( entity_id.value[3] << 8 ) | entity_id.value[4] );
+        if ( index > m_max_ids )
+        {
+            index = 0;
+        }
+    }
+    return index;
+}
+
+void ApsEntityIdAllocator::take( uint16_t index )
+{
+    Slot &slot = m_slots[index];
+
+    if ( slot.m_state == INDEX_LEASED )
+    {
+        --m_leased_count;
+    }
+    unlinkFree( index );
+    slot.m_state = INDEX_FREE;
+    slot.m_collided = false;
+}
+
+void ApsEntityIdAllocator::makeFree( uint16_t index )
+{
+    Slot &slot = m_slots[index];
+
+    slot.m_state = INDEX_FREE;
+    slot.m_collided = false;
+    if ( !slot.m_in_free_list )
+    {
+        slot.m_free_prev = m_free_last;
+        slot.m_free_next = 0;
+        if ( m_free_last != 0 )
+        {
+            m_slots[m_free_last].m_free_next = index;
+        }
+        else
+        {
+            m_free_first = index;
+        }
+        m_free_last = index;
+        ++m_free_count;
+        slot.m_in_free_list = true;
+    }
+}
+
+void ApsEntityIdAllocator::unlinkFree( uint16_t index )
+{
+    Slot &slot = m_slots[index];
+
+    if ( slot.m_in_free_list )
+    {
+        if ( slot.m_free_prev != 0 )
+        {
+            m_slots[slot.m_free_prev].m_free_next = slot.m_free_next;
+        }
+        else
+        {
+            m_free_first = slot.m_free_next;
+        }
+        if ( slot.m_free_next != 0 )
+        {
+            m_slots[slot.m_free_next].m_free_prev = slot.m_free_prev;
+        }
+        else
+        {
+            m_free_last = slot.m_free_prev;
+        }
+        --m_free_count;
+        slot.m_in_free_list = false;
+    }
+}
+
+void ApsEntityIdAllocator::startExpiry( uint16_t index, uint8_t state, uint32_t time_in_seconds )
+{
+    Slot &slot = m_slots[index];
+    Expiry e;
+
+    unlinkFree( index );
+    slot.m_state = state;
+    slot.m_expires = time_in_seconds + m_lease_time;
+    e.m_index = index;
+    e.m_expires = slot.m_expires;
+    m_expiries.push_back( e );
+}
+
+bool ApsEntityIdAllocator::isLive( Expiry const &e ) const
+{
+    // Entries for slots that were taken or restarted since are stale
+    Slot const &slot = m_slots[e.m_index];
+    return slot.m_expires == e.m_expires && ( slot.m_state == INDEX_LEASED || slot.m_state == INDEX_COLLIDED );
+}
+
+size_t ApsEntityIdAllocator::hashMac( Eui48 const &mac ) const
+{
+    uint64_t v = mac.convertToUint64() * 0x9e3779b97f4a7c15ULL;
+    return size_t( v >> 32 ) & m_lease_table_mask;
+}
+
+uint16_t ApsEntityIdAllocator::findLease( Eui48 const &apc_link_mac ) const
+{
+    for ( size_t pos = hashMac( apc_link_mac );; pos = ( pos + 1 ) & m_lease_table_mask )
+    {
+        uint16_t index = m_lease_table[pos];
+        if ( index == 0 || m_slots[index].m_apc_link_mac == apc_link_mac )
+        {
+            return index;
+        }
+    }
+}
+
+void ApsEntityIdAllocator::insertLease( uint16_t index )
+{
+    size_t pos = hashMac( m_slots[index].m_apc_link_mac );
+
+    while ( m_lease_table[pos] != 0 )
+    {
+        pos = ( pos + 1 ) & m_lease_table_mask;
+    }
+    m_lease_table[pos] = index;
+}
+
+void ApsEntityIdAllocator::eraseLease( uint16_t index )
+{
+    size_t pos = hashMac( m_slots[index].m_apc_link_mac );
+
+    while ( m_lease_table[pos] != index )
+    {
+        if ( m_lease_table[pos] == 0 )
+        {
+            return;
+        }
+        pos = ( pos + 1 ) & m_lease_table_mask;
+    }
+
+    // Shift the following entries back so that no probe sequence is broken
+    size_t hole = pos;
+    for ( pos = ( pos + 1 ) & m_lease_table_mask; m_lease_table[pos] != 0; pos = ( pos + 1 ) & m_lease_table_mask )
+    {
+        size_t home = hashMac( m_slots[m_lease_table[pos]].m_apc_link_mac );
+        if ( ( ( pos - home ) & m_lease_table_mask ) >= ( ( pos - hole ) & m_lease_table_mask ) )
+        {
+            m_lease_table[hole] = m_lease_table[pos];
+            hole = pos;
+        }
+    }
+    m_lease_table[hole] = 0;
+}
+
+bool ApsEntityIdAllocator::readHeader()
+{
+    uint8_t buf[HEADER_SIZE];
+
+    return m_storage->read( m_base_offset, buf, HEADER_SIZE )
+           && PersistentStorage::crc8( buf, HEADER_SIZE - 1 ) == buf[HEADER_SIZE - 1]
+           && jdksavdecc_uint32_get( buf, 0 ) == MAGIC && buf[4] == VERSION && jdksavdecc_uint16_get( buf, 6 ) == m_max_ids;
+}
+
+void ApsEntityIdAllocator::writeHeader()
+{
+    uint8_t buf[HEADER_SIZE];
+
+    memset( buf, 0, sizeof( buf ) );
+    jdksavdecc_uint32_set( MAGIC, buf, 0 );
+    buf[4] = VERSION;
+    jdksavdecc_uint16_set( m_max_ids, buf, 6 );
+    buf[HEADER_SIZE - 1] = PersistentStorage::crc8( buf, HEADER_SIZE - 1 );
+    m_storage->write( m_base_offset, buf, HEADER_SIZE );
+    ++m_write_count;
+}
+
+void ApsEntityIdAllocator::writeRecord( uint16_t index )
+{
+    if ( m_storage )
+    {
+        Slot const &slot = m_slots[index];
+        uint8_t buf[RECORD_SIZE];
+
+        // Only the index that an APC gets back on reconnect is a lease
+        memset( buf, 0, sizeof( buf ) );
+        if ( ( slot.m_state == INDEX_ASSIGNED || slot.m_state == INDEX_LEASED ) && !slot.m_collided
+             && findLease( slot.m_apc_link_mac ) == index )
+        {
+            buf[0] = INDEX_LEASED;
+            slot.m_apc_link_mac.store( buf, 1 );
+        }
+        buf[RECORD_SIZE - 1] = PersistentStorage::crc8( buf, RECORD_SIZE - 1 );
+        m_storage->write( m_base_offset + HEADER_SIZE + uint32_t( index - 1 ) * RECORD_SIZE, buf, RECORD_SIZE );
+        ++m_write_count;
+    }
+}
+}
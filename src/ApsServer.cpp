@@ -0,0 +1,982 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/ApsServer.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+ApsServerConnection::ApsServerConnection( ApsServerCore *server, std::string const &path )
+    : ApsStateMachine( &m_server_variables,
+                       &m_server_actions,
+                       &m_server_events,
+                       &m_server_states,
+                       server->getActiveEntityIdCount(),
+                       server->getActiveConnections() )
+    , m_server( server )
+    , m_server_events( &m_http_parser, path )
+    , m_http_parser( &m_server_events )
+    , m_shared_head( 0 )
+    , m_shared_tail( 0 )
+    , m_shared_dropped_count( 0 )
+    , m_shared_high_water_mark( 0 )
+    , m_closed( false )
+    , m_nop_timer( this, &ApsServerConnection::onNopTimer )
+    , m_liveness_timer( this, &ApsServerConnection::onLivenessTimer )
+    , m_last_sent_time( 0 )
+    , m_last_received_time( 0 )
+    , m_nop_due( false )
+    , m_ready( false )
+{
+}
+
+ApsServerConnection::~ApsServerConnection() { clearShared(); }
+
+void ApsServerConnection::clear()
+{
+    ApsStateMachine::clear();
+    clearShared();
+    cancelTimers();
+    m_closed = false;
+    m_nop_due = false;
+}
+
+bool ApsServerConnection::run()
+{
+    // Idle connections are not ticked, catch up before running
+    if ( getVariables()->m_currentTime != m_server->getCurrentTime() )
+    {
+        onTimeTick( m_server->getCurrentTime() );
+    }
+    return ApsStateMachine::run();
+}
+
+void ApsServerConnection::onIncomingTcpConnection()
+{
+    m_last_received_time = m_server->getNow();
+    if ( m_server->getLivenessTimeout() > 0 )
+    {
+        m_server->getTimers().schedule( &m_liveness_timer, m_last_received_time + m_server->getLivenessTimeout() );
+    }
+    ApsStateMachine::onIncomingTcpConnection();
+}
+
+ssize_t ApsServerConnection::onIncomingTcpData( const uint8_t *data, ssize_t len )
+{
+    // The liveness timer catches up with this when it expires
+    m_last_received_time = m_server->getNow();
+    return ApsStateMachine::onIncomingTcpData( data, len );
+}
+
+bool ApsServerConnection::isTransferring() const
+{
+    ApsStateVariables const *v = getVariables();
+    return !m_closed && v->m_tcpConnected && !v->m_incomingTcpClosed && v->m_requestValid == 200;
+}
+
+bool ApsServerConnection::enqueueShared( ApsSharedMessage *msg )
+{
+    bool r = true;
+
+    if ( getSharedQueueSize() >= JDKSAVDECCMCU_APS_SERVER_SHARED_QUEUE_DEPTH )
+    {
+        // Slow APC, drop the oldest message
+        popShared()->release();
+        ++m_shared_dropped_count;
+        r = false;
+    }
+
+    msg->addRef();
+    m_shared[m_shared_head % JDKSAVDECCMCU_APS_SERVER_SHARED_QUEUE_DEPTH] = msg;
+    ++m_shared_head;
+
+    if ( getSharedQueueSize() > m_shared_high_water_mark )
+    {
+        m_shared_high_water_mark = getSharedQueueSize();
+    }
+    return r;
+}
+
+ApsSharedMessage *ApsServerConnection::popShared()
+{
+    ApsSharedMessage *msg = 0;
+    if ( hasSharedMessages() )
+    {
+        msg = m_shared[m_shared_tail % JDKSAVDECCMCU_APS_SERVER_SHARED_QUEUE_DEPTH];
+        ++m_shared_tail;
+    }
+    return msg;
+}
+
+void ApsServerConnection::clearShared()
+{
+    while ( hasSharedMessages() )
+    {
+        popShared()->release();
+    }
+}
+
+void ApsServerConnection::sendSharedMessage( ApsSharedMessage *msg ) { sendTcpData( msg->getData(), msg->getLength() ); }
+
+void ApsServerConnection::sendAvdeccToL2( Frame const &frame ) { m_server->sendAvdeccToL2( frame ); }
+
+void ApsServerConnection::closeTcpConnection()
+{
+    ApsStateMachine::closeTcpConnection();
+    clearShared();
+    cancelTimers();
+    m_closed = true;
+}
+
+void ApsServerConnection::restartNopTimer()
+{
+    m_nop_due = false;
+    m_last_sent_time = m_server->getNow();
+    if ( !m_nop_timer.isScheduled() )
+    {
+        m_server->getTimers().schedule( &m_nop_timer, m_last_sent_time + JDKSAVDECCMCU_APS_NOP_INTERVAL_MS );
+    }
+}
+
+void ApsServerConnection::onNopTimer( jdksavdecc_timestamp_in_milliseconds now )
+{
+    jdksavdecc_timestamp_in_milliseconds due = m_last_sent_time + JDKSAVDECCMCU_APS_NOP_INTERVAL_MS;
+
+    if ( now < due )
+    {
+        // Something was sent since the timer was scheduled
+        m_server->getTimers().schedule( &m_nop_timer, due );
+    }
+    else
+    {
+        m_nop_due = true;
+        run();
+    }
+}
+
+void ApsServerConnection::onLivenessTimer( jdksavdecc_timestamp_in_milliseconds now )
+{
+    uint32_t timeout = m_server->getLivenessTimeout();
+
+    if ( timeout > 0 && !m_closed )
+    {
+        jdksavdecc_timestamp_in_milliseconds due = m_last_received_time + timeout;
+
+        if ( now < due )
+        {
+            m_server->getTimers().schedule( &m_liveness_timer, due );
+        }
+        else
+        {
+            m_server->onLivenessTimeout( this );
+        }
+    }
+}
+
+void ApsServerConnection::cancelTimers()
+{
+    m_nop_timer.cancel();
+    m_liveness_timer.cancel();
+}
+
+bool ApsServerConnection::Variables::hasL2Msg() const
+{
+    ApsServerConnection const *c = static_cast<ApsServerConnection const *>( m_owner );
+    return ApsStateVariables::hasL2Msg() || ( c->hasSharedMessages() && !c->isOutputBackpressured() );
+}
+
+uint32_t ApsServerConnection::Variables::getL2BatchLimit() const
+{
+    return ApsStateVariables::getL2BatchLimit() + JDKSAVDECCMCU_APS_SERVER_SHARED_QUEUE_DEPTH;
+}
+
+void ApsServerConnection::Variables::restartNopTimer()
+{
+    ApsStateVariables::restartNopTimer();
+    static_cast<ApsServerConnection *>( m_owner )->restartNopTimer();
+}
+
+bool ApsServerConnection::Variables::isNopDue() const { return static_cast<ApsServerConnection const *>( m_owner )->m_nop_due; }
+
+void ApsServerConnection::States::goToTransferToApc()
+{
+    ApsStateVariables *v = getVariables();
+    ApsServerConnection *c = static_cast<ApsServerConnection *>( getOwner() );
+
+    if ( !v->ApsStateVariables::hasL2Msg() && c->hasSharedMessages() && !c->isOutputBackpressured() )
+    {
+        m_current_state = &States::doTransferToApc;
+
+        // Already in wire format, send it as is
+        ApsSharedMessage *msg = c->popShared();
+        c->sendSharedMessage( msg );
+        msg->release();
+
+        v->restartNopTimer();
+        --m_L2_transfer_budget;
+    }
+    else
+    {
+        ApsStates::goToTransferToApc();
+    }
+}
+
+ApsServerCore::ApsServerCore( Eui48 link_mac, RawSocket *net, size_t shared_message_count )
+    : m_link_mac( link_mac )
+    , m_link_status( true )
+    , m_net( net )
+    , m_pool( shared_message_count )
+    , m_active_entity_id_count( 0 )
+    , m_entity_id_allocator( &m_default_entity_id_allocator )
+    , m_current_time( 0 )
+    , m_now( 0 )
+    , m_encoded_count( 0 )
+    , m_delivered_count( 0 )
+    , m_liveness_timeout( JDKSAVDECCMCU_APS_LIVENESS_TIMEOUT_MS )
+    , m_liveness_timeout_count( 0 )
+{
+}
+
+ApsServerCore::~ApsServerCore() {}
+
+void ApsServerCore::addConnection( ApsServerConnection *connection )
+{
+    connection->setup();
+    connection->setEntityIdAllocator( m_entity_id_allocator );
+    connection->setLinkMac( m_link_mac );
+    connection->onNetLinkStatusUpdated( m_link_mac, m_link_status );
+    connection->onTimeTick( m_current_time );
+
+    // Run through initialization so that the connection is waiting
+    // for onIncomingTcpConnection()
+    connection->run();
+    m_connections.push_back( connection );
+}
+
+void ApsServerCore::removeConnection( ApsServerConnection *connection )
+{
+    for ( size_t i = 0; i < m_connections.size(); ++i )
+    {
+        if ( m_connections[i] == connection )
+        {
+            m_connections[i] = m_connections.back();
+            m_connections.pop_back();
+            connection->clearShared();
+            connection->cancelTimers();
+            break;
+        }
+    }
+
+    if ( connection->m_ready )
+    {
+        connection->m_ready = false;
+        m_ready.erase( std::find( m_ready.begin(), m_ready.end(), connection ) );
+    }
+}
+
+void ApsServerCore::onNetAvdeccMessageReceived( Frame const &frame )
+{
+    ApsSharedMessage *msg = m_pool.allocate();
+
+    if ( msg )
+    {
+        if ( msg->setAvdeccFromAps( frame ) )
+        {
+            ++m_encoded_count;
+            for ( size_t i = 0; i < m_connections.size(); ++i )
+            {
+                ApsServerConnection *c = m_connections[i];
+                if ( c->isTransferring() )
+                {
+                    c->enqueueShared( msg );
+                    ++m_delivered_count;
+                    wake( c );
+                }
+            }
+        }
+
+        // Drop our own reference, the connections hold theirs
+        msg->release();
+    }
+}
+
+void ApsServerCore::onNetLinkStatusUpdated( Eui48 link_mac, bool link_status )
+{
+    m_link_mac = link_mac;
+    m_link_status = link_status;
+    for ( size_t i = 0; i < m_connections.size(); ++i )
+    {
+        m_connections[i]->onNetLinkStatusUpdated( link_mac, link_status );
+        wake( m_connections[i] );
+    }
+}
+
+void ApsServerCore::onTimeTick( uint32_t time_in_seconds )
+{
+    if ( time_in_seconds != m_current_time )
+    {
+        // Connections catch up with the time when they run
+        m_current_time = time_in_seconds;
+        m_entity_id_allocator->onTimeTick( time_in_seconds );
+    }
+}
+
+void ApsServerCore::run()
+{
+    for ( size_t i = 0; i < m_connections.size(); ++i )
+    {
+        m_connections[i]->run();
+    }
+}
+
+void ApsServerCore::wake( ApsServerConnection *connection )
+{
+    if ( !connection->m_ready )
+    {
+        connection->m_ready = true;
+        m_ready.push_back( connection );
+    }
+}
+
+void ApsServerCore::runReady()
+{
+    // Connections woken while these run wait for the next call
+    m_running.swap( m_ready );
+    for ( size_t i = 0; i < m_running.size(); ++i )
+    {
+        ApsServerConnection *c = m_running[i];
+        c->m_ready = false;
+        c->run();
+
+        // More shared messages than one run() sends
+        if ( c->isTransferring() && c->hasSharedMessages() && !c->isOutputBackpressured() )
+        {
+            wake( c );
+        }
+    }
+    m_running.clear();
+}
+
+void ApsServerCore::onLivenessTimeout( ApsServerConnection *connection )
+{
+    ++m_liveness_timeout_count;
+    connection->onTcpConnectionClosed();
+    connection->run();
+}
+
+void ApsServerCore::sendAvdeccToL2( Frame const &frame )
+{
+    if ( m_net )
+    {
+        m_net->sendFrame( frame );
+    }
+}
+
+void ApsServerCore::tick( jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    m_now = timestamp;
+    onTimeTick( uint32_t( timestamp / 1000 ) );
+    m_timers.advance( timestamp );
+    runReady();
+}
+
+bool ApsServerCore::receivedPDU( RawSocket *incoming_socket, Frame &frame )
+{
+    (void)incoming_socket;
+
+    m_entity_id_allocator->observeFrame( m_link_mac, frame, m_current_time );
+
+    // Forward the AVDECC subtypes listed in Table C.6
+    if ( frame.getEtherType() == JDKSAVDECC_AVTP_ETHERTYPE && frame.getPayloadLength() > 0 )
+    {
+        uint8_t subtype = frame.getPayload()[0] & 0x7f;
+        if ( subtype == JDKSAVDECC_SUBTYPE_ADP || subtype == JDKSAVDECC_SUBTYPE_AECP || subtype == JDKSAVDECC_SUBTYPE_ACMP )
+        {
+            onNetAvdeccMessageReceived( frame );
+        }
+    }
+
+    // Let the other handlers see it too
+    return false;
+}
+
+#if JDKSAVDECCMCU_ENABLE_EPOLL
+
+ApsServerEpoll::ApsServerEpoll( Eui48 link_mac,
+                                RawSocket *net,
+                                std::string const &path,
+                                size_t max_connections,
+                                size_t shared_message_count,
+                                size_t output_buffer_count )
+    : ApsServerCore( link_mac, net, shared_message_count )
+    , m_epoll_fd( epoll_create1( EPOLL_CLOEXEC ) )
+    , m_listen_fd( -1 )
+    , m_wakeup_fd( eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) )
+    , m_reuse_port( false )
+    , m_path( path )
+    , m_max_connections( max_connections )
+    , m_output_pool( output_buffer_count )
+    , m_slow_consumer_count( 0 )
+    , m_reap_pending( false )
+{
+    m_now = JDKSAvdeccMCU::getTimeInMilliseconds();
+
+    if ( m_epoll_fd >= 0 && m_wakeup_fd >= 0 )
+    {
+        struct epoll_event ev;
+        memset( &ev, 0, sizeof( ev ) );
+        ev.events = EPOLLIN;
+        ev.data.ptr = &m_wakeup_fd;
+        epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &ev );
+    }
+}
+
+ApsServerEpoll::~ApsServerEpoll()
+{
+    close();
+    if ( m_wakeup_fd >= 0 )
+    {
+        ::close( m_wakeup_fd );
+    }
+    if ( m_epoll_fd >= 0 )
+    {
+        ::close( m_epoll_fd );
+    }
+}
+
+bool ApsServerEpoll::listen( uint16_t port, const char *bind_address )
+{
+    bool r = false;
+    struct addrinfo hints;
+    struct addrinfo *res = 0;
+    char port_str[8];
+
+    memset( &hints, 0, sizeof( hints ) );
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    sprintf( port_str, "%u", (unsigned)port );
+
+    if ( m_epoll_fd >= 0 && m_listen_fd < 0 && getaddrinfo( bind_address, port_str, &hints, &res ) == 0 )
+    {
+        for ( struct addrinfo *ai = res; ai && !r; ai = ai->ai_next )
+        {
+            int fd = socket( ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol );
+            if ( fd >= 0 )
+            {
+                int on = 1;
+                setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+                if ( m_reuse_port )
+                {
+                    setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof( on ) );
+                }
+
+                struct epoll_event ev;
+                memset( &ev, 0, sizeof( ev ) );
+                ev.events = EPOLLIN;
+                ev.data.ptr = 0;
+
+                if ( bind( fd, ai->ai_addr, ai->ai_addrlen ) == 0 && ::listen( fd, SOMAXCONN ) == 0
+                     && epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, fd, &ev ) == 0 )
+                {
+                    m_listen_fd = fd;
+                    r = true;
+                }
+                else
+                {
+                    ::close( fd );
+                }
+            }
+        }
+        freeaddrinfo( res );
+    }
+    return r;
+}
+
+uint16_t ApsServerEpoll::getPort() const
+{
+    uint16_t r = 0;
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof( addr );
+
+    if ( m_listen_fd >= 0 && getsockname( m_listen_fd, (struct sockaddr *)&addr, &addr_len ) == 0 )
+    {
+        if ( addr.ss_family == AF_INET )
+        {
+            r = ntohs( ( (struct sockaddr_in *)&addr )->sin_port );
+        }
+        else if ( addr.ss_family == AF_INET6 )
+        {
+            r = ntohs( ( (struct sockaddr_in6 *)&addr )->sin6_port );
+        }
+    }
+    return r;
+}
+
+int ApsServerEpoll::poll( int timeout_ms )
+{
+    struct epoll_event events[64];
+
+    int n = epoll_wait( m_epoll_fd, events, 64, getPollTimeout( timeout_ms ) );
+    if ( n < 0 )
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    m_now = JDKSAvdeccMCU::getTimeInMilliseconds();
+    Trace::beginLoop();
+
+    for ( int i = 0; i < n; ++i )
+    {
+        if ( events[i].data.ptr == &m_wakeup_fd )
+        {
+            uint64_t count;
+            if ( read( m_wakeup_fd, &count, sizeof( count ) ) == sizeof( count ) )
+            {
+                onWakeup();
+            }
+            continue;
+        }
+
+        Connection *c = static_cast<Connection *>( events[i].data.ptr );
+
+        if ( !c )
+        {
+            acceptConnections();
+            continue;
+        }
+        if ( c->m_peer_closed )
+        {
+            continue;
+        }
+        if ( events[i].events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) )
+        {
+            readConnection( c );
+        }
+        if ( ( events[i].events & EPOLLOUT ) && !c->m_peer_closed )
+        {
+            // The socket drained, write regardless of coalescing
+            if ( !c->flush( m_now ) )
+            {
+                closePeer( c );
+            }
+            updateEvents( c );
+            afterFlush( c );
+        }
+    }
+
+    tick( m_now );
+    flushConnections();
+    reapClosedConnections();
+    Trace::endLoop();
+    return n;
+}
+
+void ApsServerEpoll::wakeup()
+{
+    uint64_t one = 1;
+
+    // Only fails when the counter would overflow, and then poll() sees it anyway
+    ssize_t r = write( m_wakeup_fd, &one, sizeof( one ) );
+    (void)r;
+}
+
+void ApsServerEpoll::close()
+{
+    m_pending_output.clear();
+    while ( !m_connections.empty() )
+    {
+        Connection *c = static_cast<Connection *>( m_connections.back() );
+        removeConnection( c );
+        delete c;
+    }
+    if ( m_listen_fd >= 0 )
+    {
+        ::close( m_listen_fd );
+        m_listen_fd = -1;
+    }
+}
+
+void ApsServerEpoll::acceptConnections()
+{
+    for ( ;; )
+    {
+        int fd = accept4( m_listen_fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC );
+        if ( fd < 0 )
+        {
+            break;
+        }
+        if ( m_connections.size() >= m_max_connections )
+        {
+            ::close( fd );
+            continue;
+        }
+
+        int on = 1;
+        setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof( on ) );
+
+        Connection *c = new Connection( this, fd );
+
+        struct epoll_event ev;
+        memset( &ev, 0, sizeof( ev ) );
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if ( epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, fd, &ev ) != 0 )
+        {
+            delete c;
+            continue;
+        }
+
+        addConnection( c );
+        c->onIncomingTcpConnection();
+        c->run();
+    }
+}
+
+void ApsServerEpoll::readConnection( Connection *c )
+{
+    uint8_t buf[16384];
+    bool closed = false;
+
+    // epoll is level triggered, so a busy APC is read again on the next
+    // poll() instead of keeping the others and the wakeups waiting
+    for ( int reads = 0; !closed && !c->m_peer_closed && !c->m_close_pending && reads < JDKSAVDECCMCU_APS_SERVER_READS_PER_POLL;
+          ++reads )
+    {
+        ssize_t len = read( c->m_fd, buf, sizeof( buf ) );
+        if ( len > 0 )
+        {
+            // A negative result is a protocol error
+            closed = c->onIncomingTcpData( buf, len ) < 0;
+        }
+        else if ( len < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+        {
+            break;
+        }
+        else if ( len < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        else
+        {
+            closed = true;
+        }
+    }
+
+    if ( closed )
+    {
+        closePeer( c );
+    }
+    c->run();
+}
+
+void ApsServerEpoll::updateEvents( Connection *c )
+{
+    bool want_write = c->m_want_write && !c->m_output.isEmpty() && !c->m_peer_closed;
+
+    if ( want_write != c->m_epollout )
+    {
+        struct epoll_event ev;
+        memset( &ev, 0, sizeof( ev ) );
+        ev.events = EPOLLIN | ( want_write ? EPOLLOUT : 0 );
+        ev.data.ptr = c;
+        epoll_ctl( m_epoll_fd, EPOLL_CTL_MOD, c->m_fd, &ev );
+        c->m_epollout = want_write;
+    }
+}
+
+void ApsServerEpoll::addPendingOutput( Connection *c )
+{
+    if ( !c->m_output_pending )
+    {
+        c->m_output_pending = true;
+        m_pending_output.push_back( c );
+    }
+}
+
+void ApsServerEpoll::removePendingOutput( Connection *c )
+{
+    if ( c->m_output_pending )
+    {
+        c->m_output_pending = false;
+        m_pending_output.erase( std::find( m_pending_output.begin(), m_pending_output.end(), c ) );
+    }
+}
+
+void ApsServerEpoll::afterFlush( Connection *c )
+{
+    if ( !c->m_peer_closed && c->hasSharedMessages() && !c->isOutputBackpressured() )
+    {
+        wake( c );
+    }
+}
+
+void ApsServerEpoll::flushConnections()
+{
+    for ( size_t i = 0; i < m_pending_output.size(); )
+    {
+        Connection *c = m_pending_output[i];
+
+        if ( !c->m_peer_closed && !c->m_want_write && c->m_output.shouldFlush( m_now ) )
+        {
+            if ( c->flush( m_now ) )
+            {
+                updateEvents( c );
+                afterFlush( c );
+            }
+            else
+            {
+                closePeer( c );
+            }
+        }
+        if ( !c->m_peer_closed && c->m_output.isSlowConsumer( m_now ) )
+        {
+            ++m_slow_consumer_count;
+            closePeer( c );
+        }
+
+        if ( c->m_peer_closed || c->m_output.isEmpty() )
+        {
+            // Swap with the last one, which is visited next
+            c->m_output_pending = false;
+            m_pending_output[i] = m_pending_output.back();
+            m_pending_output.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+int ApsServerEpoll::getPollTimeout( int timeout_ms ) const
+{
+    jdksavdecc_timestamp_in_milliseconds now = JDKSAvdeccMCU::getTimeInMilliseconds();
+
+    for ( size_t i = 0; i < m_pending_output.size(); ++i )
+    {
+        Connection const *c = m_pending_output[i];
+
+        // Connections waiting for EPOLLOUT are woken by epoll
+        if ( !c->m_want_write )
+        {
+            int32_t delay = c->m_output.getFlushDelay( now );
+            if ( delay >= 0 && ( timeout_ms < 0 || delay < timeout_ms ) )
+            {
+                timeout_ms = delay;
+            }
+        }
+    }
+
+    // Woken connections run on the next tick()
+    int32_t delay = m_ready.empty() ? m_timers.getNextDelay( now ) : 0;
+    if ( delay >= 0 && ( timeout_ms < 0 || delay < timeout_ms ) )
+    {
+        timeout_ms = delay;
+    }
+    return timeout_ms;
+}
+
+void ApsServerEpoll::closePeer( Connection *c )
+{
+    if ( !c->m_peer_closed )
+    {
+        c->m_peer_closed = true;
+        c->m_output.clear();
+        c->onTcpConnectionClosed();
+
+        // Let the state machine close, releasing its entity_id, before it is reaped
+        c->run();
+        m_reap_pending = true;
+    }
+}
+
+void ApsServerEpoll::onLivenessTimeout( ApsServerConnection *connection )
+{
+    ++m_liveness_timeout_count;
+    closePeer( static_cast<Connection *>( connection ) );
+}
+
+void ApsServerEpoll::reapClosedConnections()
+{
+    if ( !m_reap_pending )
+    {
+        return;
+    }
+    m_reap_pending = false;
+
+    for ( size_t i = 0; i < m_connections.size(); ++i )
+    {
+        Connection *c = static_cast<Connection *>( m_connections[i] );
+
+        // Close the connections whose output overflowed now that their
+        // state machines are not running, so they release their entity_id
+        if ( c->m_close_pending )
+        {
+            c->m_close_pending = false;
+            closePeer( c );
+        }
+    }
+
+    for ( size_t i = 0; i < m_connections.size(); )
+    {
+        Connection *c = static_cast<Connection *>( m_connections[i] );
+
+        // The state machine may still be waiting for the HTTP request
+        // when the peer goes away, so a closed peer is reaped as well
+        if ( c->isClosed() || c->m_peer_closed )
+        {
+            removePendingOutput( c );
+            removeConnection( c );
+            delete c;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+ApsServerEpoll::Connection::Connection( ApsServerEpoll *server, int fd )
+    : ApsServerConnection( server, server->m_path )
+    , m_fd( fd )
+    , m_peer_closed( false )
+    , m_close_pending( false )
+    , m_want_write( false )
+    , m_epollout( false )
+    , m_output_pending( false )
+    , m_output( server->m_output_pool, server->m_output_settings )
+{
+}
+
+ApsServerEpoll::Connection::~Connection()
+{
+    m_output.clear();
+    if ( m_fd >= 0 )
+    {
+        ::close( m_fd );
+    }
+}
+
+void ApsServerEpoll::Connection::sendTcpData( const uint8_t *data, ssize_t len )
+{
+    ApsServerEpoll *server = static_cast<ApsServerEpoll *>( m_server );
+
+    if ( !m_peer_closed && !m_close_pending && len > 0 )
+    {
+        if ( m_output.append( data, size_t( len ), server->m_now ) )
+        {
+            server->addPendingOutput( this );
+        }
+        else
+        {
+            // No buffer for the output, the stream can not be kept intact.
+            // The state machine is running, so it is closed when reaped
+            m_output.clear();
+            m_close_pending = true;
+            server->m_reap_pending = true;
+        }
+    }
+}
+
+void ApsServerEpoll::Connection::sendSharedMessage( ApsSharedMessage *msg )
+{
+    ApsServerEpoll *server = static_cast<ApsServerEpoll *>( m_server );
+
+    if ( !m_peer_closed && !m_close_pending )
+    {
+        m_output.append( msg, server->m_now );
+        server->addPendingOutput( this );
+    }
+}
+
+void ApsServerEpoll::Connection::closeTcpConnection()
+{
+    ApsServerConnection::closeTcpConnection();
+    static_cast<ApsServerEpoll *>( m_server )->m_reap_pending = true;
+}
+
+bool ApsServerEpoll::Connection::flush( jdksavdecc_timestamp_in_milliseconds now )
+{
+    TcpOutputBuffer::Segment segments[64];
+    struct iovec iov[64];
+
+    m_want_write = false;
+    while ( !m_output.isEmpty() )
+    {
+        size_t count = m_output.gather( segments, 64 );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            iov[i].iov_base = const_cast<uint8_t *>( segments[i].m_data );
+            iov[i].iov_len = segments[i].m_length;
+        }
+
+        struct msghdr msg;
+        memset( &msg, 0, sizeof( msg ) );
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t sent = sendmsg( m_fd, &msg, MSG_NOSIGNAL );
+        if ( sent > 0 )
+        {
+            m_output.consume( size_t( sent ), now );
+        }
+        else if ( sent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+        {
+            m_want_write = true;
+            break;
+        }
+        else if ( sent < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
+}
@@ -0,0 +1,401 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/ApsServerSharded.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_EPOLL && JDKSAVDECCMCU_ENABLE_THREADS
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace JDKSAvdeccMCU
+{
+
+static uint64_t packLinkState( Eui48 link_mac, bool link_status )
+{
+    return link_mac.convertToUint64() | ( link_status ? ( uint64_t( 1 ) << 48 ) : 0 );
+}
+
+uint16_t ApsEntityIdAllocatorLocked::assign( Eui48 const &apc_link_mac, uint16_t requested_index, uint32_t time_in_seconds )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return ApsEntityIdAllocator::assign( apc_link_mac, requested_index, time_in_seconds );
+}
+
+uint16_t ApsEntityIdAllocatorLocked::reassign( uint16_t index,
+                                               Eui48 const &apc_link_mac,
+                                               uint16_t requested_index,
+                                               uint32_t time_in_seconds )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return ApsEntityIdAllocator::reassign( index, apc_link_mac, requested_index, time_in_seconds );
+}
+
+void ApsEntityIdAllocatorLocked::release( uint16_t index, uint32_t time_in_seconds )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    ApsEntityIdAllocator::release( index, time_in_seconds );
+}
+
+bool ApsEntityIdAllocatorLocked::observeEntityId( Eui48 const &server_link_mac,
+                                                  Eui64 const &entity_id,
+                                                  Eui48 const &source_mac,
+                                                  uint32_t time_in_seconds )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return ApsEntityIdAllocator::observeEntityId( server_link_mac, entity_id, source_mac, time_in_seconds );
+}
+
+void ApsEntityIdAllocatorLocked::onTimeTick( uint32_t time_in_seconds )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    ApsEntityIdAllocator::onTimeTick( time_in_seconds );
+}
+
+///
+/// \brief The ApsServerSharded::Worker class
+///
+/// One shard of the connections, run by its own thread
+///
+class ApsServerSharded::Worker : public ApsServerEpoll
+{
+  public:
+    Worker( ApsServerSharded *owner,
+            std::string const &path,
+            size_t max_connections,
+            size_t shared_message_count,
+            size_t queue_depth )
+        : ApsServerEpoll( owner->m_link_mac, 0, path, max_connections, shared_message_count )
+        , m_owner( owner )
+        , m_rx( queue_depth )
+        , m_link_state( owner->m_link_state.load() )
+    {
+        m_rx_wakeup_pending.store( false );
+    }
+
+    ///
+    /// \brief signal Wake the worker for new frames or link status, called by the owner thread
+    ///
+    void signal()
+    {
+        // Only the first frame since the worker last woke costs a syscall
+        if ( !m_rx_wakeup_pending.exchange( true ) )
+        {
+            wakeup();
+        }
+    }
+
+    void threadMain()
+    {
+        while ( m_owner->m_running.load() )
+        {
+            poll( -1 );
+        }
+    }
+
+    virtual void sendAvdeccToL2( Frame const &frame ) override { m_owner->pushTx( frame ); }
+
+    ApsServerSharded *m_owner;
+    SpscQueue<L2Frame> m_rx;
+    std::atomic<bool> m_rx_wakeup_pending;
+    uint64_t m_link_state;
+    std::thread m_thread;
+
+  protected:
+    virtual void onWakeup() override
+    {
+        // Frames queued after this are signalled again
+        m_rx_wakeup_pending.exchange( false );
+
+        uint64_t link_state = m_owner->m_link_state.load();
+        if ( link_state != m_link_state )
+        {
+            m_link_state = link_state;
+            onNetLinkStatusUpdated( Eui48( link_state & 0xffffffffffffULL ), ( link_state >> 48 ) != 0 );
+        }
+
+        // Leave the rest for the next poll() so a busy network does not starve the sockets
+        size_t count = m_rx.getCapacity();
+        for ( L2Frame *item = m_rx.front(); item; item = m_rx.front() )
+        {
+            Frame frame( item->m_time, item->m_data, sizeof( item->m_data ) );
+            frame.setLength( item->m_length );
+            onNetAvdeccMessageReceived( frame );
+            m_rx.pop();
+
+            if ( --count == 0 )
+            {
+                wakeup();
+                break;
+            }
+        }
+    }
+};
+
+ApsServerSharded::ApsServerSharded( Eui48 link_mac,
+                                    RawSocket *net,
+                                    size_t worker_count,
+                                    std::string const &path,
+                                    size_t max_connections,
+                                    size_t shared_message_count,
+                                    size_t queue_depth )
+    : m_link_mac( link_mac )
+    , m_net( net )
+    , m_entity_id_allocator( &m_default_entity_id_allocator )
+    , m_tx( queue_depth )
+    , m_tx_event_fd( eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) )
+    , m_current_time( 0 )
+    , m_rx_dropped_count( 0 )
+    , m_tx_count( 0 )
+{
+    m_running.store( false );
+    m_link_state.store( packLinkState( link_mac, true ) );
+    m_tx_wakeup_pending.store( false );
+    m_tx_dropped_count.store( 0 );
+
+    for ( size_t i = 0; i < worker_count; ++i )
+    {
+        Worker *w = new Worker( this, path, max_connections, shared_message_count, queue_depth );
+        w->setEntityIdAllocator( m_entity_id_allocator );
+        w->setReusePort( true );
+        m_workers.push_back( w );
+    }
+}
+
+ApsServerSharded::~ApsServerSharded()
+{
+    stop();
+    for ( size_t i = 0; i < m_workers.size(); ++i )
+    {
+        delete m_workers[i];
+    }
+    if ( m_tx_event_fd >= 0 )
+    {
+        close( m_tx_event_fd );
+    }
+}
+
+bool ApsServerSharded::listen( uint16_t port, const char *bind_address )
+{
+    bool r = !m_workers.empty();
+
+    for ( size_t i = 0; i < m_workers.size() && r; ++i )
+    {
+        r = m_workers[i]->listen( port, bind_address );
+
+        // The others share whatever port the first one got
+        port = m_workers[i]->getPort();
+    }
+    return r;
+}
+
+uint16_t ApsServerSharded::getPort() const { return m_workers.empty() ? 0 : m_workers[0]->getPort(); }
+
+bool ApsServerSharded::start()
+{
+    bool r = true;
+
+    if ( !m_running.exchange( true ) )
+    {
+        for ( size_t i = 0; i < m_workers.size(); ++i )
+        {
+            try
+            {
+                m_workers[i]->m_thread = std::thread( &Worker::threadMain, m_workers[i] );
+            }
+            catch ( std::system_error const & )
+            {
+                r = false;
+                break;
+            }
+        }
+        if ( !r )
+        {
+            stop();
+        }
+    }
+    return r;
+}
+
+void ApsServerSharded::stop()
+{
+    m_running.store( false );
+    for ( size_t i = 0; i < m_workers.size(); ++i )
+    {
+        Worker *w = m_workers[i];
+        if ( w->m_thread.joinable() )
+        {
+            w->wakeup();
+            w->m_thread.join();
+        }
+    }
+}
+
+void ApsServerSharded::onNetAvdeccMessageReceived( Frame const &frame )
+{
+    if ( frame.getLength() > sizeof( L2Frame().m_data ) )
+    {
+        return;
+    }
+
+    for ( size_t i = 0; i < m_workers.size(); ++i )
+    {
+        Worker *w = m_workers[i];
+        L2Frame *item = w->m_rx.beginPush();
+
+        if ( item )
+        {
+            item->m_time = frame.getTimeInMilliseconds();
+            item->m_length = frame.getLength();
+            memcpy( item->m_data, frame.getBuf(), frame.getLength() );
+            w->m_rx.commitPush();
+            w->signal();
+        }
+        else
+        {
+            ++m_rx_dropped_count;
+        }
+    }
+}
+
+void ApsServerSharded::onNetLinkStatusUpdated( Eui48 link_mac, bool link_status )
+{
+    m_link_mac = link_mac;
+    m_link_state.store( packLinkState( link_mac, link_status ) );
+    for ( size_t i = 0; i < m_workers.size(); ++i )
+    {
+        m_workers[i]->signal();
+    }
+}
+
+void ApsServerSharded::pushTx( Frame const &frame )
+{
+    size_t ticket = 0;
+    L2Frame *item = 0;
+
+    if ( frame.getLength() <= sizeof( L2Frame().m_data ) )
+    {
+        // Hold the worker, and through TCP its APCs, until the owner thread catches up
+        while ( ( item = m_tx.beginPush( ticket ) ) == 0 && m_running.load() )
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    if ( item )
+    {
+        item->m_time = frame.getTimeInMilliseconds();
+        item->m_length = frame.getLength();
+        memcpy( item->m_data, frame.getBuf(), frame.getLength() );
+        m_tx.commitPush( ticket );
+
+        if ( !m_tx_wakeup_pending.exchange( true ) )
+        {
+            uint64_t one = 1;
+            ssize_t r = write( m_tx_event_fd, &one, sizeof( one ) );
+            (void)r;
+        }
+    }
+    else
+    {
+        ++m_tx_dropped_count;
+    }
+}
+
+size_t ApsServerSharded::processTx()
+{
+    size_t count = 0;
+    uint64_t events;
+
+    // Reset the eventfd before looking at the queue so that no push is missed
+    ssize_t r = read( m_tx_event_fd, &events, sizeof( events ) );
+    (void)r;
+    m_tx_wakeup_pending.exchange( false );
+
+    for ( L2Frame *item = m_tx.front(); item; item = m_tx.front() )
+    {
+        Frame frame( item->m_time, item->m_data, sizeof( item->m_data ) );
+        frame.setLength( item->m_length );
+        sendAvdeccToL2( frame );
+        m_tx.pop();
+        ++count;
+    }
+    m_tx_count += uint32_t( count );
+    return count;
+}
+
+void ApsServerSharded::sendAvdeccToL2( Frame const &frame )
+{
+    if ( m_net )
+    {
+        m_net->sendFrame( frame );
+    }
+}
+
+void ApsServerSharded::tick( jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    m_current_time = uint32_t( timestamp / 1000 );
+    processTx();
+}
+
+bool ApsServerSharded::receivedPDU( RawSocket *incoming_socket, Frame &frame )
+{
+    (void)incoming_socket;
+
+    m_entity_id_allocator->observeFrame( m_link_mac, frame, m_current_time );
+
+    // Forward the AVDECC subtypes listed in Table C.6
+    if ( frame.getEtherType() == JDKSAVDECC_AVTP_ETHERTYPE && frame.getPayloadLength() > 0 )
+    {
+        uint8_t subtype = frame.getPayload()[0] & 0x7f;
+        if ( subtype == JDKSAVDECC_SUBTYPE_ADP || subtype == JDKSAVDECC_SUBTYPE_AECP || subtype == JDKSAVDECC_SUBTYPE_ACMP )
+        {
+            onNetAvdeccMessageReceived( frame );
+        }
+    }
+
+    // Let the other handlers see it too
+    return false;
+}
+
+void ApsServerSharded::setEntityIdAllocator( ApsEntityIdAllocatorLocked *allocator )
+{
+    m_entity_id_allocator = allocator;
+    for ( size_t i = 0; i < m_workers.size(); ++i )
+    {
+        m_workers[i]->setEntityIdAllocator( allocator );
+    }
+}
+
+ApsServerEpoll *ApsServerSharded::getWorker( size_t n ) { return m_workers[n]; }
+}
+
+#endif
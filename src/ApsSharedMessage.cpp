@@ -0,0 +1,110 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/ApsSharedMessage.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+bool ApsSharedMessage::setAvdeccFromAps( const Frame &frame )
+{
+    uint16_t payload_length = frame.getPayloadLength();
+
+    if ( payload_length > JDKSAVDECC_APPDU_MAX_PAYLOAD_LENGTH )
+    {
+        return false;
+    }
+
+    m_data[JDKSAVDECC_APPDU_OFFSET_VERSION] = JDKSAVDECC_APPDU_VERSION;
+    m_data[JDKSAVDECC_APPDU_OFFSET_MESSAGE_TYPE] = JDKSAVDECC_APPDU_MESSAGE_TYPE_AVDECC_FROM_APS;
+    jdksavdecc_uint16_set( payload_length, m_data, JDKSAVDECC_APPDU_OFFSET_PAYLOAD_LENGTH );
+    jdksavdecc_eui48_set( frame.getSA(), m_data, JDKSAVDECC_APPDU_OFFSET_ADDRESS );
+    jdksavdecc_uint16_set( 0, m_data, JDKSAVDECC_APPDU_OFFSET_RESERVED );
+    memcpy( m_data + JDKSAVDECC_APPDU_OFFSET_PAYLOAD, frame.getPayload(), payload_length );
+    m_length = uint16_t( JDKSAVDECC_APPDU_HEADER_LEN + payload_length );
+    return true;
+}
+
+bool ApsSharedMessage::append( uint8_t const *data, uint16_t len )
+{
+    if ( len > getCapacity() - m_length )
+    {
+        return false;
+    }
+    memcpy( m_data + m_length, data, len );
+    m_length = uint16_t( m_length + len );
+    return true;
+}
+
+void ApsSharedMessage::release()
+{
+    if ( m_refcount > 0 && --m_refcount == 0 && m_pool )
+    {
+        m_pool->recycle( this );
+    }
+}
+
+ApsSharedMessagePool::ApsSharedMessagePool( size_t count )
+    : m_messages( count ), m_free_list( 0 ), m_available_count( 0 ), m_exhausted_count( 0 )
+{
+    for ( size_t i = 0; i < m_messages.size(); ++i )
+    {
+        m_messages[i].m_pool = this;
+        recycle( &m_messages[i] );
+    }
+}
+
+ApsSharedMessage *ApsSharedMessagePool::allocate()
+{
+    ApsSharedMessage *msg = m_free_list;
+    if ( msg )
+    {
+        m_free_list = msg->m_next_free;
+        msg->m_next_free = 0;
+        msg->m_refcount = 1;
+        msg->m_length = 0;
+        --m_available_count;
+    }
+    else
+    {
+        ++m_exhausted_count;
+    }
+    return msg;
+}
+
+void ApsSharedMessagePool::recycle( ApsSharedMessage *msg )
+{
+    msg->m_next_free = m_free_list;
+    m_free_list = msg;
+    ++m_available_count;
+}
+}
@@ -0,0 +1,687 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1 && JDKSAVDECCMCU_ENABLE_MMAP == 1
+#include <stdexcept>
+#if JDKSAVDECCMCU_ENABLE_THREADS
+#include <thread>
+#endif
+
+#include "JDKSAvdeccMCU/CaptureAnalyzer.hpp"
+#include "JDKSAvdeccMCU/Helpers.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+CaptureAnalyzer::LatencyHistogram::LatencyHistogram() : m_count( 0 ), m_sum( 0 ), m_min( ~uint64_t( 0 ) ), m_max( 0 )
+{
+    memset( m_buckets, 0, sizeof( m_buckets ) );
+}
+
+void CaptureAnalyzer::LatencyHistogram::add( uint64_t latency_in_microseconds )
+{
+    ++m_count;
+    m_sum += latency_in_microseconds;
+    m_min = std::min( m_min, latency_in_microseconds );
+    m_max = std::max( m_max, latency_in_microseconds );
+    ++m_buckets[bucketOf( latency_in_microseconds )];
+}
+
+void CaptureAnalyzer::LatencyHistogram::merge( LatencyHistogram const &other )
+{
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_min = std::min( m_min, other.m_min );
+    m_max = std::max( m_max, other.m_max );
+    for ( size_t i = 0; i < bucket_count; ++i )
+    {
+        m_buckets[i] += other.m_buckets[i];
+    }
+}
+
+uint64_t CaptureAnalyzer::LatencyHistogram::getPercentile( double percentile ) const
+{
+    uint64_t r = 0;
+    if ( m_count )
+    {
+        uint64_t rank = uint64_t( ceil( percentile / 100.0 * double( m_count ) ) );
+        rank = std::max( rank, uint64_t( 1 ) );
+        uint64_t seen = 0;
+        size_t i = 0;
+        while ( i < bucket_count - 1 && seen + m_buckets[i] < rank )
+        {
+            seen += m_buckets[i];
+            ++i;
+        }
+        r = std::max( std::min( bucketUpperBound( i ), m_max ), m_min );
+    }
+    return r;
+}
+
+bool CaptureAnalyzer::LatencyHistogram::operator==( LatencyHistogram const &other ) const
+{
+    return m_count == other.m_count && m_sum == other.m_sum && m_min == other.m_min && m_max == other.m_max
+           && memcmp( m_buckets, other.m_buckets, sizeof( m_buckets ) ) == 0;
+}
+
+size_t CaptureAnalyzer::LatencyHistogram::bucketOf( uint64_t latency_in_microseconds )
+{
+    size_t r = size_t( latency_in_microseconds );
+    if ( latency_in_microseconds >= 8 )
+    {
+        // The octave is the highest bit set, the next two bits pick the quarter
+        size_t octave = 3;
+        while ( octave < 63 && ( latency_in_microseconds >> ( octave + 1 ) ) != 0 )
+        {
+            ++octave;
+        }
+        r = 8 + ( octave - 3 ) * 4 + size_t( ( latency_in_microseconds >> ( octave - 2 ) ) & 3 );
+        r = std::min( r, size_t( bucket_count - 1 ) );
+    }
+    return r;
+}
+
+uint64_t CaptureAnalyzer::LatencyHistogram::bucketUpperBound( size_t bucket )
+{
+    uint64_t r = bucket;
+    if ( bucket >= 8 )
+    {
+        size_t octave = ( bucket - 8 ) / 4 + 3;
+        uint64_t quarter = uint64_t( 1 ) << ( octave - 2 );
+        r = ( 4 + ( bucket - 8 ) % 4 ) * quarter + quarter - 1;
+    }
+    return r;
+}
+
+CaptureAnalyzer::CommandStats::CommandStats()
+    : m_commands( 0 )
+    , m_responses( 0 )
+    , m_timeouts( 0 )
+    , m_retries( 0 )
+    , m_late_responses( 0 )
+    , m_unmatched_responses( 0 )
+    , m_in_progress( 0 )
+{
+}
+
+void CaptureAnalyzer::CommandStats::merge( CommandStats const &other )
+{
+    m_commands += other.m_commands;
+    m_responses += other.m_responses;
+    m_timeouts += other.m_timeouts;
+    m_retries += other.m_retries;
+    m_late_responses += other.m_late_responses;
+    m_unmatched_responses += other.m_unmatched_responses;
+    m_in_progress += other.m_in_progress;
+    m_latency.merge( other.m_latency );
+}
+
+bool CaptureAnalyzer::CommandStats::operator==( CommandStats const &other ) const
+{
+    return m_commands == other.m_commands && m_responses == other.m_responses && m_timeouts == other.m_timeouts
+           && m_retries == other.m_retries && m_late_responses == other.m_late_responses
+           && m_unmatched_responses == other.m_unmatched_responses && m_in_progress == other.m_in_progress
+           && m_latency == other.m_latency;
+}
+
+CaptureAnalyzer::EntityStats::EntityStats()
+    : m_adp_available( 0 ), m_adp_departing( 0 ), m_unsolicited( 0 ), m_first_seen( ~uint64_t( 0 ) ), m_last_seen( 0 )
+{
+}
+
+void CaptureAnalyzer::EntityStats::merge( EntityStats const &other )
+{
+    m_adp_available += other.m_adp_available;
+    m_adp_departing += other.m_adp_departing;
+    m_aem.merge( other.m_aem );
+    m_aa.merge( other.m_aa );
+    m_acmp.merge( other.m_acmp );
+    m_unsolicited += other.m_unsolicited;
+    m_connect_time.merge( other.m_connect_time );
+    m_first_seen = std::min( m_first_seen, other.m_first_seen );
+    m_last_seen = std::max( m_last_seen, other.m_last_seen );
+}
+
+bool CaptureAnalyzer::EntityStats::operator==( EntityStats const &other ) const
+{
+    return m_adp_available == other.m_adp_available && m_adp_departing == other.m_adp_departing && m_aem == other.m_aem
+           && m_aa == other.m_aa && m_acmp == other.m_acmp && m_unsolicited == other.m_unsolicited
+           && m_connect_time == other.m_connect_time && m_first_seen == other.m_first_seen
+           && m_last_seen == other.m_last_seen;
+}
+
+CaptureAnalyzer::Totals::Totals() : m_packets( 0 ), m_adp( 0 ), m_aecp( 0 ), m_acmp( 0 ), m_other( 0 ), m_malformed( 0 ) {}
+
+void CaptureAnalyzer::Totals::merge( Totals const &other )
+{
+    m_packets += other.m_packets;
+    m_adp += other.m_adp;
+    m_aecp += other.m_aecp;
+    m_acmp += other.m_acmp;
+    m_other += other.m_other;
+    m_malformed += other.m_malformed;
+}
+
+bool CaptureAnalyzer::CommandKey::operator<( CommandKey const &other ) const
+{
+    bool r;
+    if ( m_target_entity_id != other.m_target_entity_id )
+    {
+        r = m_target_entity_id < other.m_target_entity_id;
+    }
+    else if ( m_controller_entity_id != other.m_controller_entity_id )
+    {
+        r = m_controller_entity_id < other.m_controller_entity_id;
+    }
+    else if ( m_sequence_id != other.m_sequence_id )
+    {
+        r = m_sequence_id < other.m_sequence_id;
+    }
+    else if ( m_protocol != other.m_protocol )
+    {
+        r = m_protocol < other.m_protocol;
+    }
+    else
+    {
+        r = m_command < other.m_command;
+    }
+    return r;
+}
+
+CaptureAnalyzer::CaptureAnalyzer( PcapMappedReader const &reader, Settings const &settings )
+    : m_reader( reader ), m_settings( settings ), m_shard_count( 0 )
+{
+}
+
+uint64_t CaptureAnalyzer::getDuration() const
+{
+    size_t count = m_reader.getPacketCount();
+    return count ? m_reader.getTimestamp( count - 1 ) : 0;
+}
+
+void CaptureAnalyzer::run()
+{
+    size_t packets = m_reader.getPacketCount();
+    size_t shard_count = std::max( m_settings.m_thread_count, uint32_t( 1 ) );
+    if ( m_settings.m_min_packets_per_thread )
+    {
+        shard_count = std::min( shard_count, packets / m_settings.m_min_packets_per_thread );
+    }
+    shard_count = std::max( shard_count, size_t( 1 ) );
+
+    std::vector<Shard> shards( shard_count );
+    for ( size_t i = 0; i < shard_count; ++i )
+    {
+        shards[i].m_begin = packets * i / shard_count;
+        shards[i].m_end = packets * ( i + 1 ) / shard_count;
+    }
+
+#if JDKSAVDECCMCU_ENABLE_THREADS
+    // The calling thread takes the first range
+    std::vector<std::thread> threads;
+    for ( size_t i = 1; i < shard_count; ++i )
+    {
+        threads.push_back( std::thread( analyzeShard, &m_reader, &m_settings, &shards[i] ) );
+    }
+    analyzeShard( &m_reader, &m_settings, &shards[0] );
+    for ( size_t i = 0; i < threads.size(); ++i )
+    {
+        threads[i].join();
+    }
+#else
+    for ( size_t i = 0; i < shard_count; ++i )
+    {
+        analyzeShard( &m_reader, &m_settings, &shards[i] );
+    }
+#endif
+
+    m_shard_count = shard_count;
+    merge( shards );
+}
+
+void CaptureAnalyzer::analyzeShard( PcapMappedReader const *reader, Settings const *settings, Shard *shard )
+{
+    for ( size_t n = shard->m_begin; n < shard->m_end; ++n )
+    {
+        ++shard->m_totals.m_packets;
+        if ( reader->getLinkType( n ) == 1 )
+        {
+            analyzePacket( *settings, *shard, reader->getTimestamp( n ), reader->getFrame( n ) );
+        }
+        else
+        {
+            ++shard->m_totals.m_other;
+        }
+    }
+}
+
+void CaptureAnalyzer::analyzePacket( Settings const &settings, Shard &shard, uint64_t time, Frame const &frame )
+{
+    uint8_t subtype = 0;
+    if ( frame.getLength() > JDKSAVDECC_FRAME_HEADER_LEN && frame.getEtherType() == JDKSAVDECC_AVTP_ETHERTYPE )
+    {
+        subtype = frame.getOctet( JDKSAVDECC_FRAME_HEADER_LEN );
+    }
+
+    if ( subtype == JDKSAVDECC_1722A_SUBTYPE_ADP )
+    {
+        ++shard.m_totals.m_adp;
+        jdksavdecc_adpdu_common_control_header header;
+        if ( jdksavdecc_adpdu_common_control_header_read( &header, frame.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN, frame.getLength() )
+             > 0 )
+        {
+            if ( header.message_type == JDKSAVDECC_ADP_MESSAGE_TYPE_ENTITY_AVAILABLE )
+            {
+                ++entity( shard.m_entities, jdksavdecc_eui64_convert_to_uint64( &header.entity_id ), time ).m_adp_available;
+            }
+            else if ( header.message_type == JDKSAVDECC_ADP_MESSAGE_TYPE_ENTITY_DEPARTING )
+            {
+                ++entity( shard.m_entities, jdksavdecc_eui64_convert_to_uint64( &header.entity_id ), time ).m_adp_departing;
+            }
+        }
+        else
+        {
+            ++shard.m_totals.m_malformed;
+        }
+    }
+    else if ( subtype == JDKSAVDECC_1722A_SUBTYPE_AECP )
+    {
+        ++shard.m_totals.m_aecp;
+        jdksavdecc_aecpdu_aem aem;
+        jdksavdecc_aecp_aa aa;
+        CommandKey key;
+        jdksavdecc_aecpdu_common const *common = 0;
+
+        if ( parseAEM( &aem, frame ) )
+        {
+            common = &aem.aecpdu_header;
+            key.m_protocol = PROTOCOL_AEM;
+            key.m_command = uint16_t( aem.command_type & 0x7fff );
+        }
+        else if ( parseAA( &aa, frame ) )
+        {
+            common = &aa.aecpdu_header;
+            key.m_protocol = PROTOCOL_AA;
+            key.m_command = 0;
+        }
+
+        if ( common )
+        {
+            key.m_controller_entity_id = jdksavdecc_eui64_convert_to_uint64( &common->controller_entity_id );
+            key.m_target_entity_id = jdksavdecc_eui64_convert_to_uint64( &common->header.target_entity_id );
+            key.m_sequence_id = common->sequence_id;
+
+            uint8_t message_type = common->header.message_type;
+            if ( message_type == JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_COMMAND
+                 || message_type == JDKSAVDECC_AECP_MESSAGE_TYPE_ADDRESS_ACCESS_COMMAND )
+            {
+                command( shard, key, time, settings.m_aecp_timeout_in_microseconds );
+            }
+            else if ( key.m_protocol == PROTOCOL_AEM && ( ( aem.command_type >> 15 ) & 1 ) )
+            {
+                ++entity( shard.m_entities, key.m_target_entity_id, time ).m_unsolicited;
+            }
+            else if ( key.m_protocol == PROTOCOL_AEM && common->header.status == JDKSAVDECC_AEM_STATUS_IN_PROGRESS )
+            {
+                inProgress( settings, shard, key, time );
+            }
+            else
+            {
+                response( shard, key, time, common->header.status == JDKSAVDECC_AEM_STATUS_SUCCESS );
+            }
+        }
+        else
+        {
+            // Vendor unique and other AECP message types are not analyzed
+            ++shard.m_totals.m_other;
+        }
+    }
+    else if ( subtype == JDKSAVDECC_1722A_SUBTYPE_ACMP )
+    {
+        ++shard.m_totals.m_acmp;
+        jdksavdecc_acmpdu acmpdu;
+        uint8_t message_type = 0xff;
+        if ( parseACMP( &acmpdu, frame ) )
+        {
+            message_type = acmpdu.header.message_type;
+        }
+
+        uint64_t timeout_in_ms = 0;
+        bool to_talker = false;
+        switch ( message_type & ~1 )
+        {
+        case JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_TX_COMMAND:
+            timeout_in_ms = JDKSAVDECC_ACMP_TIMEOUT_CONNECT_TX_COMMAND_MS;
+            to_talker = true;
+            break;
+        case JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_TX_COMMAND:
+            timeout_in_ms = JDKSAVDECC_ACMP_TIMEOUT_DISCONNECT_TX_COMMAND_MS;
+            to_talker = true;
+            break;
+        case JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_TX_STATE_COMMAND:
+            timeout_in_ms = JDKSAVDECC_ACMP_TIMEOUT_GET_TX_STATE_COMMAND;
+            to_talker = true;
+            break;
+        case JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_TX_CONNECTION_COMMAND:
+            timeout_in_ms = JDKSAVDECC_ACMP_TIMEOUT_GET_TX_CONNECTION_COMMAND;
+            to_talker = true;
+            break;
+        case JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND:
+            timeout_in_ms = JDKSAVDECC_ACMP_TIMEOUT_CONNECT_RX_COMMAND_MS;
+            break;
+        case JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_RX_COMMAND:
+            timeout_in_ms = JDKSAVDECC_ACMP_TIMEOUT_DISCONNECT_RX_COMMAND_MS;
+            break;
+        case JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_RX_STATE_COMMAND:
+            timeout_in_ms = JDKSAVDECC_ACMP_TIMEOUT_GET_RX_STATE_COMMAND_MS;
+            break;
+        default:
+            break;
+        }
+
+        if ( timeout_in_ms )
+        {
+            CommandKey key;
+            key.m_controller_entity_id = jdksavdecc_eui64_convert_to_uint64( &acmpdu.controller_entity_id );
+            key.m_target_entity_id
+                = jdksavdecc_eui64_convert_to_uint64( to_talker ? &acmpdu.talker_entity_id : &acmpdu.listener_entity_id );
+            key.m_sequence_id = acmpdu.sequence_id;
+            key.m_protocol = PROTOCOL_ACMP;
+            key.m_command = uint16_t( message_type & ~1 );
+
+            if ( ( message_type & 1 ) == 0 )
+            {
+                command( shard, key, time, timeout_in_ms * 1000 );
+            }
+            else
+            {
+                response( shard, key, time, acmpdu.header.status == JDKSAVDECC_ACMP_STATUS_SUCCESS );
+            }
+        }
+        else
+        {
+            ++shard.m_totals.m_malformed;
+        }
+    }
+    else
+    {
+        ++shard.m_totals.m_other;
+    }
+}
+
+void CaptureAnalyzer::command( Shard &shard, CommandKey const &key, uint64_t time, uint64_t timeout )
+{
+    CommandStats &stats = commandStats( entity( shard.m_entities, key.m_target_entity_id, time ), key.m_protocol );
+    ++stats.m_commands;
+
+    Pending pending;
+    pending.m_time = time;
+    pending.m_timeout = timeout;
+
+    std::map<CommandKey, std::pair<bool, Pending> >::iterator i = shard.m_state.find( key );
+    if ( i == shard.m_state.end() )
+    {
+        // Whether this is a retry is known when the ranges are merged
+        Head head = {key, time, HEAD_COMMAND, false};
+        shard.m_heads.push_back( head );
+        shard.m_state.insert( std::make_pair( key, std::make_pair( true, pending ) ) );
+    }
+    else
+    {
+        if ( i->second.first )
+        {
+            ++stats.m_retries;
+            ++stats.m_timeouts;
+        }
+        i->second = std::make_pair( true, pending );
+    }
+}
+
+void CaptureAnalyzer::response( Shard &shard, CommandKey const &key, uint64_t time, bool success )
+{
+    EntityStats &target = entity( shard.m_entities, key.m_target_entity_id, time );
+
+    std::map<CommandKey, std::pair<bool, Pending> >::iterator i = shard.m_state.find( key );
+    if ( i == shard.m_state.end() )
+    {
+        // The command may be pending from an earlier range
+        Head head = {key, time, HEAD_RESPONSE, success};
+        shard.m_heads.push_back( head );
+        shard.m_state.insert( std::make_pair( key, std::make_pair( false, Pending() ) ) );
+    }
+    else if ( i->second.first )
+    {
+        matched( target, key, i->second.second, time, success );
+        i->second.first = false;
+    }
+    else
+    {
+        ++commandStats( target, key.m_protocol ).m_unmatched_responses;
+    }
+}
+
+void CaptureAnalyzer::inProgress( Settings const &settings, Shard &shard, CommandKey const &key, uint64_t time )
+{
+    ++entity( shard.m_entities, key.m_target_entity_id, time ).m_aem.m_in_progress;
+
+    // The controller waits for the final response as long again from now
+    std::map<CommandKey, std::pair<bool, Pending> >::iterator i = shard.m_state.find( key );
+    if ( i == shard.m_state.end() )
+    {
+        Head head = {key, time, HEAD_IN_PROGRESS, false};
+        shard.m_heads.push_back( head );
+    }
+    else if ( i->second.first )
+    {
+        i->second.second.m_timeout = time - i->second.second.m_time + settings.m_aecp_timeout_in_microseconds;
+    }
+}
+
+CaptureAnalyzer::EntityStats &CaptureAnalyzer::entity( entities_type &entities, uint64_t entity_id, uint64_t time )
+{
+    EntityStats &r = entities[entity_id];
+    r.m_first_seen = std::min( r.m_first_seen, time );
+    r.m_last_seen = std::max( r.m_last_seen, time );
+    return r;
+}
+
+CaptureAnalyzer::CommandStats &CaptureAnalyzer::commandStats( EntityStats &entity, uint8_t protocol )
+{
+    return protocol == PROTOCOL_AEM ? entity.m_aem : protocol == PROTOCOL_AA ? entity.m_aa : entity.m_acmp;
+}
+
+void CaptureAnalyzer::matched( EntityStats &entity, CommandKey const &key, Pending const &pending, uint64_t time, bool success )
+{
+    CommandStats &stats = commandStats( entity, key.m_protocol );
+    uint64_t latency = time - pending.m_time;
+    if ( latency > pending.m_timeout )
+    {
+        ++stats.m_late_responses;
+        ++stats.m_timeouts;
+    }
+    else
+    {
+        ++stats.m_responses;
+    }
+    stats.m_latency.add( latency );
+
+    if ( key.m_protocol == PROTOCOL_ACMP && key.m_command == JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND && success )
+    {
+        entity.m_connect_time.add( latency );
+    }
+}
+
+void CaptureAnalyzer::merge( std::vector<Shard> &shards )
+{
+    m_totals = Totals();
+    m_entities.clear();
+
+    // The commands pending at the end of the ranges merged so far
+    pending_type carry;
+
+    for ( size_t s = 0; s < shards.size(); ++s )
+    {
+        Shard &shard = shards[s];
+        m_totals.merge( shard.m_totals );
+        for ( entities_type::const_iterator e = shard.m_entities.begin(); e != shard.m_entities.end(); ++e )
+        {
+            m_entities[e->first].merge( e->second );
+        }
+
+        for ( size_t h = 0; h < shard.m_heads.size(); ++h )
+        {
+            Head const &head = shard.m_heads[h];
+            EntityStats &target = m_entities[head.m_key.m_target_entity_id];
+            pending_type::iterator i = carry.find( head.m_key );
+
+            if ( head.m_kind == HEAD_IN_PROGRESS )
+            {
+                if ( i != carry.end() )
+                {
+                    i->second.m_timeout = head.m_time - i->second.m_time + m_settings.m_aecp_timeout_in_microseconds;
+                }
+            }
+            else if ( i != carry.end() )
+            {
+                if ( head.m_kind == HEAD_COMMAND )
+                {
+                    CommandStats &stats = commandStats( target, head.m_key.m_protocol );
+                    ++stats.m_retries;
+                    ++stats.m_timeouts;
+                }
+                else
+                {
+                    matched( target, head.m_key, i->second, head.m_time, head.m_success );
+                }
+                carry.erase( i );
+            }
+            else if ( head.m_kind == HEAD_RESPONSE )
+            {
+                ++commandStats( target, head.m_key.m_protocol ).m_unmatched_responses;
+            }
+        }
+
+        // Every command seen in this range replaces what was pending before it
+        std::map<CommandKey, std::pair<bool, Pending> >::const_iterator i;
+        for ( i = shard.m_state.begin(); i != shard.m_state.end(); ++i )
+        {
+            if ( i->second.first )
+            {
+                carry[i->first] = i->second.second;
+            }
+            else
+            {
+                carry.erase( i->first );
+            }
+        }
+        shard.m_state.clear();
+        shard.m_entities.clear();
+    }
+
+    // The commands still pending at the end have timed out if the capture went on long enough
+    uint64_t end = getDuration();
+    for ( pending_type::const_iterator i = carry.begin(); i != carry.end(); ++i )
+    {
+        if ( end - i->second.m_time > i->second.m_timeout )
+        {
+            ++commandStats( m_entities[i->first.m_target_entity_id], i->first.m_protocol ).m_timeouts;
+        }
+    }
+}
+
+namespace
+{
+
+void printCommands( std::ostream &o, char const *name, CaptureAnalyzer::CommandStats const &stats )
+{
+    if ( stats.m_commands || stats.m_unmatched_responses )
+    {
+        CaptureAnalyzer::LatencyHistogram const &latency = stats.m_latency;
+        o << "  " << std::left << std::setw( 5 ) << name << std::right << stats.m_commands << " commands, " << stats.m_responses
+          << " responses, " << stats.m_timeouts << " timeouts, " << stats.m_retries << " retries, " << stats.m_late_responses
+          << " late, " << stats.m_unmatched_responses << " unmatched";
+        if ( stats.m_in_progress )
+        {
+            o << ", " << stats.m_in_progress << " in progress";
+        }
+        o << std::endl;
+        if ( latency.getCount() )
+        {
+            o << "        latency us: min " << latency.getMin() << " p50 " << latency.getPercentile( 50.0 ) << " p90 "
+              << latency.getPercentile( 90.0 ) << " p99 " << latency.getPercentile( 99.0 ) << " max " << latency.getMax()
+              << " mean " << latency.getMean() << std::endl;
+        }
+    }
+}
+}
+
+void CaptureAnalyzer::print( std::ostream &o ) const
+{
+    double duration = double( getDuration() ) / 1e6;
+    std::ios::fmtflags flags = o.flags();
+    std::streamsize precision = o.precision();
+
+    o << std::fixed << std::setprecision( 3 );
+    o << m_totals.m_packets << " packets in " << duration << " s: " << m_totals.m_adp << " ADP, " << m_totals.m_aecp << " AECP, "
+      << m_totals.m_acmp << " ACMP, " << m_totals.m_other << " other, " << m_totals.m_malformed << " malformed" << std::endl;
+    o << m_entities.size() << " entities" << std::endl;
+
+    for ( entities_type::const_iterator i = m_entities.begin(); i != m_entities.end(); ++i )
+    {
+        EntityStats const &e = i->second;
+        o << Eui64( i->first ) << " seen " << double( e.m_first_seen ) / 1e6 << " s to " << double( e.m_last_seen ) / 1e6
+          << " s, " << e.m_adp_available << " ENTITY_AVAILABLE, " << e.m_adp_departing << " ENTITY_DEPARTING, "
+          << e.m_unsolicited << " unsolicited";
+        if ( duration > 0.0 )
+        {
+            o << " (" << double( e.m_unsolicited ) / duration << "/s)";
+        }
+        o << std::endl;
+
+        printCommands( o, "AEM", e.m_aem );
+        printCommands( o, "AA", e.m_aa );
+        printCommands( o, "ACMP", e.m_acmp );
+        if ( e.m_connect_time.getCount() )
+        {
+            o << "  CONNECT_RX " << e.m_connect_time.getCount() << " connects, us: min " << e.m_connect_time.getMin() << " p50 "
+              << e.m_connect_time.getPercentile( 50.0 ) << " p99 " << e.m_connect_time.getPercentile( 99.0 ) << " max "
+              << e.m_connect_time.getMax() << std::endl;
+        }
+    }
+
+    o.flags( flags );
+    o.precision( precision );
+}
+}
+
+#endif
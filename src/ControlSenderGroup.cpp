@@ -0,0 +1,243 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/ControlSenderGroup.hpp"
+#include "JDKSAvdeccMCU/HandlerGroup.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+ControlSenderGroup::ControlSenderGroup( ControllerEntity &controller_entity,
+                                        SenderState *sender_storage,
+                                        uint16_t max_senders,
+                                        TargetStatistics *target_storage,
+                                        uint16_t max_targets,
+                                        uint16_t max_in_flight_per_target )
+    : m_controller_entity( controller_entity )
+    , m_senders( sender_storage )
+    , m_num_senders( 0 )
+    , m_max_senders( max_senders )
+    , m_targets( target_storage )
+    , m_num_targets( 0 )
+    , m_max_targets( max_targets )
+    , m_max_in_flight_per_target( max_in_flight_per_target > 0 ? max_in_flight_per_target : 1 )
+    , m_next_sender( 0 )
+{
+}
+
+bool ControlSenderGroup::add( ControlSender *sender )
+{
+    bool r = false;
+    if ( m_num_senders < m_max_senders )
+    {
+        uint16_t target_index = findTarget( sender->getTargetEntityID() );
+        if ( target_index == m_num_targets && m_num_targets < m_max_targets )
+        {
+            // First sender for this target, allocate its statistics
+            m_targets[target_index].clear();
+            m_targets[target_index].m_target_entity_id = sender->getTargetEntityID();
+            ++m_num_targets;
+        }
+
+        if ( target_index < m_num_targets )
+        {
+            SenderState &state = m_senders[m_num_senders++];
+            state = SenderState();
+            state.m_sender = sender;
+            state.m_target_index = target_index;
+            r = true;
+        }
+    }
+    return r;
+}
+
+void ControlSenderGroup::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    for ( uint16_t i = 0; i < m_num_senders; ++i )
+    {
+        SenderState &state = m_senders[i];
+        TargetStatistics &target = m_targets[state.m_target_index];
+        ControlValueHolder *holder = state.m_sender->getHolder();
+
+        // Expire a SET_CONTROL that was never acknowledged. The current value
+        // is sent again on this tick with the change time of the expired
+        // one, which is the oldest, so the retry shows up in the latency
+        if ( state.m_in_flight && wasTimeOutHit( time_in_millis, state.m_sent_time, JDKSAVDECC_AEM_TIMEOUT_IN_MS ) )
+        {
+            state.m_in_flight = false;
+            --target.m_in_flight_count;
+            ++target.m_timeout_count;
+            state.m_pending = true;
+            state.m_change_time = state.m_in_flight_change_time;
+        }
+
+        if ( holder->isDirty() )
+        {
+            holder->clearDirty();
+            if ( state.m_pending )
+            {
+                // The value that was waiting to go out is replaced by the new one
+                ++target.m_superseded_count;
+            }
+            else
+            {
+                state.m_pending = true;
+                state.m_change_time = time_in_millis;
+            }
+        }
+        else if ( !state.m_pending && !state.m_in_flight
+                  && wasTimeOutHit( time_in_millis, state.m_sent_time, state.m_sender->getUpdateRateInMillis() ) )
+        {
+            // Periodic refresh of the unchanged value
+            state.m_pending = true;
+            state.m_change_time = time_in_millis;
+        }
+    }
+
+    sendPending( time_in_millis );
+}
+
+void ControlSenderGroup::sendPending( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    if ( m_num_senders == 0 )
+    {
+        return;
+    }
+
+    uint16_t first = m_next_sender < m_num_senders ? m_next_sender : 0;
+    for ( uint16_t n = 0; n < m_num_senders; ++n )
+    {
+        uint16_t i = ( first + n ) % m_num_senders;
+        SenderState &state = m_senders[i];
+        TargetStatistics &target = m_targets[state.m_target_index];
+
+        // A sender with a command still in flight waits for its response, its
+        // newer value stays pending
+        if ( state.m_pending && !state.m_in_flight && target.m_in_flight_count < m_max_in_flight_per_target )
+        {
+            // Send untracked by the ControllerEntity, the response is matched
+            // here by sequence_id
+            state.m_sender->sendSetControl( false );
+            state.m_sequence_id = m_controller_entity.getOutgoingSequenceId();
+            state.m_sent_time = time_in_millis;
+            state.m_in_flight_change_time = state.m_change_time;
+            state.m_pending = false;
+            state.m_in_flight = true;
+            ++target.m_in_flight_count;
+            ++target.m_sent_count;
+            m_next_sender = uint16_t( i + 1 );
+        }
+    }
+}
+
+bool ControlSenderGroup::receivedPDU( RawSocket *incoming_socket, Frame &frame )
+{
+    (void)incoming_socket;
+    bool r = false;
+    jdksavdecc_aecpdu_aem aem;
+
+    if ( m_num_senders > 0 && parseAEM( &aem, frame ) && isAEMForController( aem, m_controller_entity.getEntityID() ) )
+    {
+        // Only solicited SET_CONTROL responses are ours
+        if ( aem.command_type == JDKSAVDECC_AEM_COMMAND_SET_CONTROL )
+        {
+            Eui64 target_entity_id( aem.aecpdu_header.header.target_entity_id );
+            uint16_t target_index = findTarget( target_entity_id );
+
+            for ( uint16_t i = 0; target_index < m_num_targets && i < m_num_senders; ++i )
+            {
+                SenderState &state = m_senders[i];
+                if ( state.m_in_flight && state.m_target_index == target_index
+                     && state.m_sequence_id == aem.aecpdu_header.sequence_id )
+                {
+                    TargetStatistics &target = m_targets[target_index];
+                    state.m_in_flight = false;
+                    --target.m_in_flight_count;
+
+                    if ( aem.aecpdu_header.header.status == JDKSAVDECC_AEM_STATUS_SUCCESS )
+                    {
+                        jdksavdecc_timestamp_in_milliseconds latency
+                            = m_controller_entity.getRawSocket().getTimeInMilliseconds() - state.m_in_flight_change_time;
+
+                        if ( target.m_ack_count == 0 || latency < target.m_latency_min )
+                        {
+                            target.m_latency_min = latency;
+                        }
+                        if ( latency > target.m_latency_max )
+                        {
+                            target.m_latency_max = latency;
+                        }
+                        target.m_latency_total += latency;
+                        ++target.m_ack_count;
+                    }
+                    else
+                    {
+                        ++target.m_error_count;
+                    }
+                    r = true;
+                    break;
+                }
+            }
+        }
+    }
+    return r;
+}
+
+void ControlSenderGroup::addToHandlerGroup( HandlerGroup &group ) { group.add( this ); }
+
+ControlSenderGroup::TargetStatistics const *ControlSenderGroup::findTargetStatistics( Eui64 const &target_entity_id ) const
+{
+    uint16_t target_index = findTarget( target_entity_id );
+    return target_index < m_num_targets ? &m_targets[target_index] : 0;
+}
+
+void ControlSenderGroup::clearStatistics()
+{
+    for ( uint16_t i = 0; i < m_num_targets; ++i )
+    {
+        m_targets[i].clearCounters();
+    }
+}
+
+uint16_t ControlSenderGroup::findTarget( Eui64 const &target_entity_id ) const
+{
+    uint16_t i;
+    for ( i = 0; i < m_num_targets; ++i )
+    {
+        if ( m_targets[i].m_target_entity_id == target_entity_id )
+        {
+            break;
+        }
+    }
+    return i;
+}
+}
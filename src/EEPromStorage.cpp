@@ -33,8 +33,54 @@
 #include "JDKSAvdeccMCU/EEPromStorage.hpp"
 
 #ifdef __avr__
-#include "EEProm.h"
+#include <avr/eeprom.h>
+#endif
+
+namespace JDKSAvdeccMCU
+{
+
+#ifndef __avr__
+static uint8_t jdksavdeccmcu_eeprom_emulation[JDKSAVDECCMCU_EEPROM_SIZE];
+#endif
+
+EEPromStorage::EEPromStorage( uint32_t base_address, uint32_t size ) : m_base_address( base_address ), m_size( size )
+{
+    if ( m_base_address > JDKSAVDECCMCU_EEPROM_SIZE )
+    {
+        m_base_address = JDKSAVDECCMCU_EEPROM_SIZE;
+    }
+    if ( m_size > JDKSAVDECCMCU_EEPROM_SIZE - m_base_address )
+    {
+        m_size = JDKSAVDECCMCU_EEPROM_SIZE - m_base_address;
+    }
+}
 
+bool EEPromStorage::read( uint32_t offset, uint8_t *buf, uint16_t len )
+{
+    if ( uint32_t( offset + len ) > m_size || offset > m_size )
+    {
+        return false;
+    }
+#ifdef __avr__
+    eeprom_read_block( buf, (void const *)( m_base_address + offset ), len );
+#else
+    memcpy( buf, &jdksavdeccmcu_eeprom_emulation[m_base_address + offset], len );
+#endif
+    return true;
+}
+
+bool EEPromStorage::write( uint32_t offset, uint8_t const *buf, uint16_t len )
+{
+    if ( uint32_t( offset + len ) > m_size || offset > m_size )
+    {
+        return false;
+    }
+#ifdef __avr__
+    // eeprom_update_block skips the bytes that already have the value
+    eeprom_update_block( buf, (void *)( m_base_address + offset ), len );
 #else
-const char *jdksavdeccmcu_eepromstorage_file = __FILE__;
+    memcpy( &jdksavdeccmcu_eeprom_emulation[m_base_address + offset], buf, len );
 #endif
+    return true;
+}
+}
@@ -33,6 +33,7 @@
 
 #include "JDKSAvdeccMCU/Entity.hpp"
 #include "JDKSAvdeccMCU/EntityState.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
 
 namespace JDKSAvdeccMCU
 {
@@ -72,6 +73,11 @@ void Entity::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
     {
         if ( wasTimeOutHit( time_in_millis, m_locked_time, JDKSAVDECC_AEM_LOCK_TIMEOUT_MS ) )
         {
+            Trace::record( TRACE_ENTITY_LOCK_TIMED_OUT,
+                           0,
+                           getEntityID().convertToUint64(),
+                           m_locked_by_controller_entity_id.convertToUint64(),
+                           0 );
             m_locked_by_controller_entity_id.clear();
         }
     }
@@ -87,6 +93,13 @@ void Entity::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
     if ( cmd != JDKSAVDECC_AEM_COMMAND_EXPANSION
          && wasTimeOutHit( time_in_millis, m_last_sent_command_time, JDKSAVDECC_AEM_TIMEOUT_IN_MS ) )
     {
+#if JDKSAVDECCMCU_ENABLE_METRICS
+        // A ControllerEntity forgets the target of a command when its response comes
+        if ( isSet( m_last_sent_command_target_entity_id ) )
+        {
+            ++m_metrics.m_command_timeouts;
+        }
+#endif
         m_last_sent_command_type = JDKSAVDECC_AEM_COMMAND_EXPANSION; // clear knowledge of sent
                                                                      // command
 
@@ -96,6 +109,11 @@ void Entity::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
             // Yes, this means that the old controller goes away and the new one
             // is approved
             m_acquired_by_controller_entity_id = m_acquire_in_progress_by_controller_entity_id;
+            Trace::record( TRACE_ENTITY_ACQUIRE_TRANSFERRED,
+                           0,
+                           getEntityID().convertToUint64(),
+                           m_acquired_by_controller_entity_id.convertToUint64(),
+                           0 );
             // Also clear any lock that may have been there
             m_locked_by_controller_entity_id = Eui64();
             // TODO: Formulate and send reply to the new controller
@@ -124,6 +142,30 @@ void Entity::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
     }
 }
 
+jdksavdecc_timestamp_in_milliseconds Entity::nextTickTime( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    jdksavdecc_timestamp_in_milliseconds r = Handler::nextTickTime( time_in_millis );
+
+    // wasTimeOutHit() is true one millisecond after the timeout
+    if ( isSet( m_locked_by_controller_entity_id ) && m_locked_time + JDKSAVDECC_AEM_LOCK_TIMEOUT_MS + 1 < r )
+    {
+        r = m_locked_time + JDKSAVDECC_AEM_LOCK_TIMEOUT_MS + 1;
+    }
+    if ( m_last_sent_command_type != JDKSAVDECC_AEM_COMMAND_EXPANSION
+         && m_last_sent_command_time + JDKSAVDECC_AEM_TIMEOUT_IN_MS + 1 < r )
+    {
+        r = m_last_sent_command_time + JDKSAVDECC_AEM_TIMEOUT_IN_MS + 1;
+    }
+
+    // The ACMP state machines keep their own timers, tick them often enough for their retries
+    if ( ( m_acmp_controller_group_handler || m_acmp_talker_group_handler || m_acmp_listener_group_handler )
+         && time_in_millis + 10 < r )
+    {
+        r = time_in_millis + 10;
+    }
+    return r;
+}
+
 void Entity::commandTimedOut( Eui64 const &target_entity_id, uint16_t command_type, uint16_t sequence_id )
 {
     (void)target_entity_id;
@@ -152,6 +194,15 @@ bool Entity::receivedPDU( RawSocket *incoming_socket, Frame &frame )
             {
                 status_code = receivedAEMCommand( incoming_socket, aem, frame );
                 r = true;
+                Trace::record( status_code == JDKSAVDECC_AEM_STATUS_SUCCESS ? TRACE_AEM_COMMAND_ACCEPTED
+                                                                           : TRACE_AEM_COMMAND_REJECTED,
+                               aem.command_type & 0x7fff,
+                               getEntityID().convertToUint64(),
+                               jdksavdecc_eui64_convert_to_uint64( &aem.aecpdu_header.controller_entity_id ),
+                               status_code | ( uint32_t( aem.aecpdu_header.sequence_id ) << 16 ) );
+#if JDKSAVDECCMCU_ENABLE_METRICS
+                m_metrics.countAEMCommand( aem.command_type & 0x7fff, status_code );
+#endif
             }
         }
     }
@@ -168,6 +219,9 @@ bool Entity::receivedPDU( RawSocket *incoming_socket, Frame &frame )
             {
                 status_code = receivedAACommand( incoming_socket, aa, frame );
                 r = true;
+#if JDKSAVDECCMCU_ENABLE_METRICS
+                ++m_metrics.m_aa_commands;
+#endif
             }
         }
     }
@@ -183,6 +237,9 @@ bool Entity::receivedPDU( RawSocket *incoming_socket, Frame &frame )
             {
                 status_code = receivedACMPMessage( incoming_socket, acmpdu, frame );
                 r = true;
+#if JDKSAVDECCMCU_ENABLE_METRICS
+                ++m_metrics.m_acmp_messages;
+#endif
             }
         }
     }
@@ -202,6 +259,10 @@ uint8_t Entity::receivedAEMCommand( RawSocket *incoming_socket, jdksavdecc_aecpd
     // commands that change state will set command_is_set_something to true
     bool command_is_set_something = false;
 
+    // data sent after the pdu without copying it into the pdu
+    uint8_t const *additional_data = 0;
+    uint16_t additional_data_length = 0;
+
     switch ( actual_command_type )
     {
     case JDKSAVDECC_AEM_COMMAND_ACQUIRE_ENTITY:
@@ -225,9 +286,31 @@ uint8_t Entity::receivedAEMCommand( RawSocket *incoming_socket, jdksavdecc_aecpd
                 = jdksavdecc_aem_command_read_descriptor_get_descriptor_type( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN );
             uint16_t descriptor_index
                 = jdksavdecc_aem_command_read_descriptor_get_descriptor_index( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN );
+            uint16_t control_data_length = 0;
 
-            response_status
-                = m_entity_state->receiveReadDescriptorCommand( pdu, configuration_index, descriptor_type, descriptor_index );
+            // A pre-built response goes out after the AECP header of the command, straight from the storage
+            additional_data = m_entity_state->getReadDescriptorResponse(
+                configuration_index, descriptor_type, descriptor_index, &control_data_length, &additional_data_length );
+
+            if ( additional_data )
+            {
+                pdu.setLength( JDKSAVDECC_FRAME_HEADER_LEN
+                               + JDKSAVDECC_AEM_COMMAND_READ_DESCRIPTOR_RESPONSE_OFFSET_CONFIGURATION_INDEX );
+                response_status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+            }
+            else
+            {
+                response_status
+                    = m_entity_state->receiveReadDescriptorCommand( pdu, configuration_index, descriptor_type, descriptor_index );
+                control_data_length
+                    = uint16_t( pdu.getLength() - JDKSAVDECC_FRAME_HEADER_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN );
+            }
+
+            if ( response_status == JDKSAVDECC_AEM_STATUS_SUCCESS )
+            {
+                jdksavdecc_common_control_header_set_control_data_length(
+                    control_data_length, pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN );
+            }
         }
         break;
     case JDKSAVDECC_AEM_COMMAND_SET_CONFIGURATION:
@@ -300,13 +383,19 @@ uint8_t Entity::receivedAEMCommand( RawSocket *incoming_socket, jdksavdecc_aecpd
         break;
     }
 
-    // fill in the new response status
+    // turn the command into a response and fill in the new response status
+    pdu.setOctet( JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE, JDKSAVDECC_FRAME_HEADER_LEN + 1 );
     pdu.setOctet( ( pdu.getOctet( JDKSAVDECC_FRAME_HEADER_LEN + 2 ) & 0x7 ) + ( response_status << 3 ),
                   JDKSAVDECC_FRAME_HEADER_LEN + 2 );
 
     // Send the response to either just the requesting controller or it and all
     // registered controllers
-    sendResponses( false, command_is_set_something && response_status == JDKSAVDECC_AECP_STATUS_SUCCESS, response_status, pdu );
+    sendResponses( false,
+                   command_is_set_something && response_status == JDKSAVDECC_AECP_STATUS_SUCCESS,
+                   response_status,
+                   pdu,
+                   additional_data,
+                   additional_data_length );
 
     return response_status;
 }
@@ -406,6 +495,7 @@ uint8_t Entity::receivedAACommand( RawSocket *incoming_socket, jdksavdecc_aecp_a
     }
     // Send the response to either just the requesting controller or it and all
     // registered controllers
+    pdu.setOctet( JDKSAVDECC_AECP_MESSAGE_TYPE_ADDRESS_ACCESS_RESPONSE, JDKSAVDECC_FRAME_HEADER_LEN + 1 );
     pdu.setOctet( ( pdu.getOctet( JDKSAVDECC_FRAME_HEADER_LEN + 2 ) & 0x7 ) + ( aa_status << 3 ), JDKSAVDECC_FRAME_HEADER_LEN + 2 );
 
     // Only send responses to the requesting controller
@@ -433,6 +523,7 @@ uint8_t Entity::receivedACMPMessage( RawSocket *incoming_socket, const jdksavdec
     if ( m_acmp_talker_group_handler && acmpdu.talker_entity_id == getEntityID() )
     {
         if ( acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_TX_COMMAND
+             || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_TX_COMMAND
              || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_TX_CONNECTION_COMMAND
              || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_TX_STATE_COMMAND )
         {
@@ -443,7 +534,9 @@ uint8_t Entity::receivedACMPMessage( RawSocket *incoming_socket, const jdksavdec
     {
         if ( acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_RX_COMMAND
              || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_RX_COMMAND
-             || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_RX_STATE_COMMAND )
+             || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_GET_RX_STATE_COMMAND
+             || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_CONNECT_TX_RESPONSE
+             || acmpdu.header.message_type == JDKSAVDECC_ACMP_MESSAGE_TYPE_DISCONNECT_TX_RESPONSE )
         {
             status = m_acmp_listener_group_handler->receivedACMPDU( incoming_socket, acmpdu, pdu );
         }
@@ -578,6 +671,9 @@ void Entity::sendCommand( Eui64 const &target_entity_id,
         m_last_sent_command_time = getRawSocket().getTimeInMilliseconds();
         m_last_sent_command_type = aem_command_type;
         m_last_sent_command_target_entity_id = target_entity_id;
+#if JDKSAVDECCMCU_ENABLE_METRICS
+        ++m_metrics.m_commands_sent;
+#endif
     }
 }
 
@@ -647,6 +743,8 @@ uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, F
     bool has_current_owner;
     has_current_owner = ( isSet( m_acquired_by_controller_entity_id ) != 0 );
 
+    uint64_t controller_entity_id = jdksavdecc_eui64_convert_to_uint64( &aem.aecpdu_header.controller_entity_id );
+
     // First, make sure this is entity level:
     if ( jdksavdecc_aem_command_acquire_entity_get_descriptor_index( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN ) == 0
          && jdksavdecc_aem_command_acquire_entity_get_descriptor_type( pdu.getBuf(), JDKSAVDECC_FRAME_HEADER_LEN )
@@ -665,6 +763,7 @@ uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, F
                 // clear current acquire state
                 m_acquired_by_controller_entity_id = Eui64();
                 status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+                Trace::record( TRACE_ENTITY_RELEASED, 0, getEntityID().convertToUint64(), controller_entity_id, status );
             }
             else
             {
@@ -681,6 +780,7 @@ uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, F
             {
                 // Yes, success.
                 status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+                Trace::record( TRACE_ENTITY_ACQUIRED, 0, getEntityID().convertToUint64(), controller_entity_id, status );
             }
             else
             {
@@ -710,6 +810,8 @@ uint8_t Entity::receiveAcquireEntityCommand( jdksavdecc_aecpdu_aem const &aem, F
                     // when the owning controller responds, or
                     // if it times out.
                     status = JDKSAVDECC_AEM_STATUS_IN_PROGRESS;
+                    Trace::record(
+                        TRACE_ENTITY_ACQUIRE_IN_PROGRESS, 0, getEntityID().convertToUint64(), controller_entity_id, status );
                 }
             }
         }
@@ -755,6 +857,14 @@ bool Entity::receiveControllerAvailableResponse( jdksavdecc_aecpdu_aem const &ae
     // TODO: Send a failed message to the controller that was attempting to
     // acquire me
     // cancel any acquire in progress
+    if ( isSet( m_acquire_in_progress_by_controller_entity_id ) )
+    {
+        Trace::record( TRACE_ENTITY_ACQUIRE_CANCELLED,
+                       0,
+                       getEntityID().convertToUint64(),
+                       m_acquire_in_progress_by_controller_entity_id.convertToUint64(),
+                       0 );
+    }
     m_acquire_in_progress_by_controller_entity_id = Eui64();
     return false;
 }
@@ -61,33 +61,71 @@ uint8_t EntityState::receiveReadDescriptorCommand( Frame &pdu,
 {
     uint8_t status = JDKSAVDECC_AECP_STATUS_NOT_IMPLEMENTED;
 
-    switch ( descriptor_type )
+    if ( m_descriptor_storage )
     {
-    case JDKSAVDECC_DESCRIPTOR_ENTITY:
-        status = readDescriptorEntity( pdu, configuration_index, descriptor_index );
-        break;
-    case JDKSAVDECC_DESCRIPTOR_CONFIGURATION:
-        status = readDescriptorConfiguration( pdu, configuration_index, descriptor_index );
-        break;
-    case JDKSAVDECC_DESCRIPTOR_AVB_INTERFACE:
-        status = readDescriptorAvbInterface( pdu, configuration_index, descriptor_index );
-        break;
-    case JDKSAVDECC_DESCRIPTOR_CONTROL:
-        status = readDescriptorControl( pdu, configuration_index, descriptor_index );
-        break;
-    case JDKSAVDECC_DESCRIPTOR_LOCALE:
-        status = readDescriptorLocale( pdu, configuration_index, descriptor_index );
-        break;
-    case JDKSAVDECC_DESCRIPTOR_STRINGS:
-        status = readDescriptorStrings( pdu, configuration_index, descriptor_index );
-        break;
-    case JDKSAVDECC_DESCRIPTOR_MEMORY_OBJECT:
-        status = readDescriptorMemoryObject( pdu, configuration_index, descriptor_index );
-        break;
+        uint16_t length = 0;
+        uint8_t const *descriptor = jdksavdecc_descriptor_storage_buffer_get_descriptor(
+            m_descriptor_storage, configuration_index, descriptor_type, descriptor_index, &length );
+
+        status = JDKSAVDECC_AEM_STATUS_NO_SUCH_DESCRIPTOR;
+        if ( descriptor )
+        {
+            // The descriptor follows the configuration_index and reserved fields of the command
+            pdu.setLength( JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_AEM_COMMAND_READ_DESCRIPTOR_RESPONSE_OFFSET_DESCRIPTOR );
+            status = JDKSAVDECC_AEM_STATUS_ENTITY_MISBEHAVING;
+            if ( pdu.canPut( length ) )
+            {
+                pdu.putBuf( descriptor, length );
+                status = JDKSAVDECC_AEM_STATUS_SUCCESS;
+            }
+        }
+    }
+    else
+    {
+        switch ( descriptor_type )
+        {
+        case JDKSAVDECC_DESCRIPTOR_ENTITY:
+            status = readDescriptorEntity( pdu, configuration_index, descriptor_index );
+            break;
+        case JDKSAVDECC_DESCRIPTOR_CONFIGURATION:
+            status = readDescriptorConfiguration( pdu, configuration_index, descriptor_index );
+            break;
+        case JDKSAVDECC_DESCRIPTOR_AVB_INTERFACE:
+            status = readDescriptorAvbInterface( pdu, configuration_index, descriptor_index );
+            break;
+        case JDKSAVDECC_DESCRIPTOR_CONTROL:
+            status = readDescriptorControl( pdu, configuration_index, descriptor_index );
+            break;
+        case JDKSAVDECC_DESCRIPTOR_LOCALE:
+            status = readDescriptorLocale( pdu, configuration_index, descriptor_index );
+            break;
+        case JDKSAVDECC_DESCRIPTOR_STRINGS:
+            status = readDescriptorStrings( pdu, configuration_index, descriptor_index );
+            break;
+        case JDKSAVDECC_DESCRIPTOR_MEMORY_OBJECT:
+            status = readDescriptorMemoryObject( pdu, configuration_index, descriptor_index );
+            break;
+        }
     }
     return status;
 }
 
+uint8_t const *EntityState::getReadDescriptorResponse( uint16_t configuration_index,
+                                                      uint16_t descriptor_type,
+                                                      uint16_t descriptor_index,
+                                                      uint16_t *control_data_length,
+                                                      uint16_t *payload_length )
+{
+    uint8_t const *r = 0;
+
+    if ( m_descriptor_storage )
+    {
+        r = jdksavdecc_descriptor_storage_buffer_get_read_descriptor_response(
+            m_descriptor_storage, configuration_index, descriptor_type, descriptor_index, control_data_length, payload_length );
+    }
+    return r;
+}
+
 uint8_t EntityState::receiveSetConfigurationCommand( Frame &pdu )
 {
     (void)pdu;
@@ -40,6 +40,11 @@ Handler::~Handler() {}
 
 void Handler::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis ) { (void)time_in_millis; }
 
+jdksavdecc_timestamp_in_milliseconds Handler::nextTickTime( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    return time_in_millis + JDKSAVDECCMCU_HANDLER_MAX_TICK_INTERVAL_MS;
+}
+
 bool Handler::receivedPDU( RawSocket *incoming_socket, Frame &frame )
 {
     (void)frame;
@@ -31,12 +31,21 @@
 
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/HandlerGroup.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
 
 namespace JDKSAvdeccMCU
 {
 
 HandlerGroup::HandlerGroup( Frame *frame, Handler **item_storage, uint16_t max_items )
-    : m_num_items( 0 ), m_max_items( max_items ), m_item( item_storage ), m_rx_count( 0 ), m_handled_count( 0 ), m_frame( frame )
+    : m_num_items( 0 )
+    , m_max_items( max_items )
+    , m_item( item_storage )
+    , m_rx_count( 0 )
+    , m_handled_count( 0 )
+    , m_frame( frame )
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    , m_item_metrics( 0 )
+#endif
 {
 }
 
@@ -55,21 +64,63 @@ bool HandlerGroup::add( Handler *v )
 /// and poll incoming network for PDU's and dispatch them
 void HandlerGroup::tick( jdksavdecc_timestamp_in_milliseconds time_in_millis )
 {
-    // TODO:
+    // TODO: poll the network, until then the RawSocket dispatches to receivedPDU()
+    Trace::beginLoop();
+    for ( uint16_t i = 0; i < m_num_items; ++i )
+    {
+        m_item[i]->tick( time_in_millis );
+    }
+    Trace::endLoop();
+}
+
+jdksavdecc_timestamp_in_milliseconds HandlerGroup::nextTickTime( jdksavdecc_timestamp_in_milliseconds time_in_millis )
+{
+    jdksavdecc_timestamp_in_milliseconds r = Handler::nextTickTime( time_in_millis );
+    for ( uint16_t i = 0; i < m_num_items; ++i )
+    {
+        jdksavdecc_timestamp_in_milliseconds t = m_item[i]->nextTickTime( time_in_millis );
+        if ( t < r )
+        {
+            r = t;
+        }
+    }
+    return r;
 }
 
 /// Send ReceivedPDU message to each handler until one returns true.
 bool HandlerGroup::receivedPDU( RawSocket *incoming_socket, Frame &frame )
 {
     bool r = false;
+    ++m_rx_count;
+    Trace::beginFrame( incoming_socket, frame, frame.getLength() );
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    bool timed = m_rx_count % JDKSAVDECCMCU_METRICS_LATENCY_SAMPLE_INTERVAL == 0;
+    uint64_t start = timed ? metricsTimeInNanoseconds() : 0;
+#endif
     for ( uint16_t i = 0; i < m_num_items; ++i )
     {
-        if ( m_item[i]->receivedPDU( incoming_socket, frame ) )
+        bool handled = m_item[i]->receivedPDU( incoming_socket, frame );
+#if JDKSAVDECCMCU_ENABLE_METRICS
+        if ( m_item_metrics )
         {
+            ++m_item_metrics[i].m_invocations;
+            m_item_metrics[i].m_handled += handled;
+        }
+#endif
+        if ( handled )
+        {
+            ++m_handled_count;
             r = true;
             break;
         }
     }
+#if JDKSAVDECCMCU_ENABLE_METRICS
+    if ( timed )
+    {
+        m_latency.record( metricsTimeInNanoseconds() - start );
+    }
+#endif
+    Trace::endFrame();
     return r;
 }
 }
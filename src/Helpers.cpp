@@ -198,6 +198,28 @@ bool parseACMP( jdksavdecc_acmpdu *acmpdu, Frame const &pdu )
     return r;
 }
 
+bool formACMP( Frame *frame, Eui48 const &src_mac, jdksavdecc_acmpdu const &acmpdu )
+{
+    bool r = false;
+    if ( frame->getMaxLength() >= JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_ACMPDU_LEN )
+    {
+        jdksavdecc_acmpdu msg = acmpdu;
+        msg.header.cd = 1;
+        msg.header.subtype = JDKSAVDECC_SUBTYPE_ACMP;
+        msg.header.sv = 0;
+        msg.header.version = 0;
+        msg.header.control_data_length = JDKSAVDECC_ACMPDU_LEN - JDKSAVDECC_COMMON_CONTROL_HEADER_LEN;
+
+        frame->setDA( jdksavdecc_multicast_adp_acmp );
+        frame->setSA( src_mac );
+        frame->setEtherType( JDKSAVDECC_AVTP_ETHERTYPE );
+        jdksavdecc_acmpdu_write( &msg, frame->getBuf(), JDKSAVDECC_FRAME_HEADER_LEN, frame->getMaxLength() );
+        frame->setLength( JDKSAVDECC_FRAME_HEADER_LEN + JDKSAVDECC_ACMPDU_LEN );
+        r = true;
+    }
+    return r;
+}
+
 bool isACMPInvolvingTarget( jdksavdecc_acmpdu const &acmpdu, Eui64 const &entity_id )
 {
     bool r = false;
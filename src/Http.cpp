@@ -34,6 +34,13 @@
 
 #if JDKSAVDECCMCU_ENABLE_HTTP
 
+#if defined( __SSE2__ ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#include <emmintrin.h>
+#define JDKSAVDECCMCU_HTTP_SSE2 1
+#else
+#define JDKSAVDECCMCU_HTTP_SSE2 0
+#endif
+
 namespace JDKSAvdeccMCU
 {
 
@@ -393,9 +400,21 @@ ssize_t HttpServerParserSimple::onIncomingHttpData( const uint8_t *data, ssize_t
     return r;
 }
 
-void HttpServerParser::clear() { m_request->clear(); }
+void HttpServerParser::clear()
+{
+    if ( m_request )
+    {
+        m_request->clear();
+    }
+}
 
-void HttpClientParser::clear() { m_response->clear(); }
+void HttpClientParser::clear()
+{
+    if ( m_response )
+    {
+        m_response->clear();
+    }
+}
 
 void HttpClientParserSimple::clear()
 {
@@ -572,6 +591,328 @@ bool HttpServerHandler::onIncomingHttpRequest( const HttpRequest &request )
     }
     return r;
 }
+
+bool HttpServerHandler::onIncomingHttpRequestHead( const HttpHead &head )
+{
+    HttpRequest request;
+    head.getRequest( &request );
+    return onIncomingHttpRequest( request );
+}
+
+bool HttpClientHandler::onIncomingHttpResponseHead( const HttpHead &head )
+{
+    HttpResponse response;
+    head.getResponse( &response );
+    return onIncomingHttpResponse( response );
+}
+
+static char http_tolower( char c ) { return ( c >= 'A' && c <= 'Z' ) ? char( c - 'A' + 'a' ) : c; }
+
+bool HttpSpan::equals( const char *s ) const
+{
+    size_t len = strlen( s );
+    return len == m_length && memcmp( m_data, s, len ) == 0;
+}
+
+bool HttpSpan::equalsIgnoreCase( const char *s ) const
+{
+    uint16_t i = 0;
+    for ( ; i < m_length && s[i]; ++i )
+    {
+        if ( http_tolower( m_data[i] ) != http_tolower( s[i] ) )
+        {
+            return false;
+        }
+    }
+    return i == m_length && s[i] == 0;
+}
+
+bool HttpSpan::startsWith( const char *s ) const
+{
+    size_t len = strlen( s );
+    return len <= m_length && memcmp( m_data, s, len ) == 0;
+}
+
+///
+/// Find the next LF in [p, end), 16 octets at a time when SSE2 is available
+///
+static char const *http_find_lf( char const *p, char const *end )
+{
+#if JDKSAVDECCMCU_HTTP_SSE2
+    __m128i const lf = _mm_set1_epi8( '\n' );
+    while ( end - p >= 16 )
+    {
+        int mask = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( reinterpret_cast<__m128i const *>( p ) ), lf ) );
+        if ( mask )
+        {
+            return p + __builtin_ctz( mask );
+        }
+        p += 16;
+    }
+#endif
+    char const *r = static_cast<char const *>( memchr( p, '\n', size_t( end - p ) ) );
+    return r ? r : end;
+}
+
+///
+/// Find the next SP in [p, end)
+///
+static char const *http_find_sp( char const *p, char const *end )
+{
+    char const *r = static_cast<char const *>( memchr( p, ' ', size_t( end - p ) ) );
+    return r ? r : end;
+}
+
+static HttpSpan http_span( char const *begin, char const *end )
+{
+    HttpSpan span;
+    span.m_data = begin;
+    span.m_length = uint16_t( end - begin );
+    return span;
+}
+
+static bool http_is_visible( char const *begin, char const *end )
+{
+    for ( char const *p = begin; p < end; ++p )
+    {
+        unsigned char c = (unsigned char)*p;
+        if ( ( c < 0x20 && c != '\t' ) || c == 0x7f )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HttpHead::clear()
+{
+    m_is_request = true;
+    for ( int i = 0; i < 3; ++i )
+    {
+        m_start[i].m_data = "";
+        m_start[i].m_length = 0;
+    }
+    m_field_count = 0;
+}
+
+bool HttpHead::parse( const char *data, size_t len, bool is_request )
+{
+    char const *end = data + len;
+    char const *line = data;
+    bool first = true;
+
+    clear();
+    m_is_request = is_request;
+
+    while ( line < end )
+    {
+        char const *lf = http_find_lf( line, end );
+        if ( lf == end )
+        {
+            // The head must end with a blank line
+            return false;
+        }
+
+        char const *eol = ( lf > line && lf[-1] == '\r' ) ? lf - 1 : lf;
+        if ( !http_is_visible( line, eol ) )
+        {
+            return false;
+        }
+
+        if ( eol == line )
+        {
+            // The blank line, done if the start line was seen
+            return !first;
+        }
+
+        if ( first )
+        {
+            // request-line = method SP request-target SP HTTP-version
+            // status-line = HTTP-version SP status-code SP reason-phrase
+            char const *sp1 = http_find_sp( line, eol );
+            char const *sp2 = sp1 < eol ? http_find_sp( sp1 + 1, eol ) : eol;
+            if ( sp1 == line || sp1 == eol || ( is_request && ( sp2 == eol || sp2 == sp1 + 1 ) ) )
+            {
+                return false;
+            }
+            m_start[0] = http_span( line, sp1 );
+            m_start[1] = http_span( sp1 + 1, sp2 );
+            m_start[2] = http_span( sp2 < eol ? sp2 + 1 : eol, eol );
+            first = false;
+        }
+        else
+        {
+            // field-name ":" OWS field-value OWS, no obs-fold
+            char const *colon = static_cast<char const *>( memchr( line, ':', size_t( eol - line ) ) );
+            if ( !colon || colon == line || *line == ' ' || *line == '\t' || colon[-1] == ' ' || colon[-1] == '\t'
+                 || m_field_count >= JDKSAVDECCMCU_HTTP_MAX_HEADER_FIELDS )
+            {
+                return false;
+            }
+            char const *value = colon + 1;
+            char const *value_end = eol;
+            while ( value < value_end && ( *value == ' ' || *value == '\t' ) )
+            {
+                ++value;
+            }
+            while ( value_end > value && ( value_end[-1] == ' ' || value_end[-1] == '\t' ) )
+            {
+                --value_end;
+            }
+            m_fields[m_field_count].m_name = http_span( line, colon );
+            m_fields[m_field_count].m_value = http_span( value, value_end );
+            ++m_field_count;
+        }
+        line = lf + 1;
+    }
+    return false;
+}
+
+const HttpSpan *HttpHead::findField( const char *name ) const
+{
+    for ( uint16_t i = 0; i < m_field_count; ++i )
+    {
+        if ( m_fields[i].m_name.equalsIgnoreCase( name ) )
+        {
+            return &m_fields[i].m_value;
+        }
+    }
+    return 0;
+}
+
+void HttpHead::getRequest( HttpRequest *request ) const
+{
+    request->clear();
+    request->m_method = getMethod().toString();
+    request->m_path = getPath().toString();
+    request->m_version = getVersion().toString();
+    for ( uint16_t i = 0; i < m_field_count; ++i )
+    {
+        request->m_headers.push_back( std::string( m_fields[i].m_name.m_data,
+                                                   m_fields[i].m_value.m_data + m_fields[i].m_value.m_length ) );
+    }
+}
+
+void HttpHead::getResponse( HttpResponse *response ) const
+{
+    response->clear();
+    response->m_version = getVersion().toString();
+    response->m_status_code = getStatusCode().toString();
+    response->m_reason_phrase = getReasonPhrase().toString();
+    for ( uint16_t i = 0; i < m_field_count; ++i )
+    {
+        response->m_headers.push_back( std::string( m_fields[i].m_name.m_data,
+                                                    m_fields[i].m_value.m_data + m_fields[i].m_value.m_length ) );
+    }
+}
+
+void HttpHeadParser::clear()
+{
+    m_complete = false;
+    m_buffered = 0;
+    m_line_length = 0;
+    m_line_last = 0;
+    m_head.clear();
+}
+
+ssize_t HttpHeadParser::parse( const uint8_t *data, ssize_t len )
+{
+    if ( m_complete )
+    {
+        return 0;
+    }
+    if ( len <= 0 )
+    {
+        // EOF before the end of the head
+        return -1;
+    }
+
+    char const *begin = reinterpret_cast<char const *>( data );
+    char const *end = begin + len;
+    char const *p = begin;
+    char const *head_end = 0;
+
+    // Look for a line that is empty apart from an optional CR
+    while ( p < end )
+    {
+        char const *lf = http_find_lf( p, end );
+        if ( lf == end )
+        {
+            m_line_length = uint16_t( m_line_length + ( end - p ) );
+            m_line_last = end[-1];
+            break;
+        }
+        uint16_t line_length = uint16_t( m_line_length + ( lf - p ) );
+        char last = lf > p ? lf[-1] : m_line_last;
+        if ( line_length == 0 || ( line_length == 1 && last == '\r' ) )
+        {
+            head_end = lf + 1;
+            break;
+        }
+        m_line_length = 0;
+        m_line_last = 0;
+        p = lf + 1;
+    }
+
+    size_t consumed = size_t( ( head_end ? head_end : end ) - begin );
+
+    if ( head_end && m_buffered == 0 )
+    {
+        // The whole head is in the caller's buffer, tokenize it there
+        if ( consumed > JDKSAVDECCMCU_HTTP_MAX_HEAD_LENGTH || !m_head.parse( begin, consumed, m_is_request ) )
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        if ( m_buffered + consumed > JDKSAVDECCMCU_HTTP_MAX_HEAD_LENGTH )
+        {
+            return -1;
+        }
+        memcpy( m_buf + m_buffered, begin, consumed );
+        m_buffered = uint16_t( m_buffered + consumed );
+        if ( head_end && !m_head.parse( m_buf, m_buffered, m_is_request ) )
+        {
+            return -1;
+        }
+    }
+
+    m_complete = head_end != 0;
+    return ssize_t( consumed );
+}
+
+void HttpServerParserInPlace::clear()
+{
+    HttpServerParser::clear();
+    m_parser.clear();
+}
+
+ssize_t HttpServerParserInPlace::onIncomingHttpData( const uint8_t *data, ssize_t len )
+{
+    ssize_t r = m_parser.parse( data, len );
+    if ( r > 0 && m_parser.isComplete() && !m_handler->onIncomingHttpRequestHead( m_parser.getHead() ) )
+    {
+        r = -1;
+    }
+    return r;
+}
+
+void HttpClientParserInPlace::clear()
+{
+    HttpClientParser::clear();
+    m_parser.clear();
+}
+
+ssize_t HttpClientParserInPlace::onIncomingHttpData( const uint8_t *data, ssize_t len )
+{
+    ssize_t r = m_parser.parse( data, len );
+    if ( r > 0 && m_parser.isComplete() && !m_handler->onIncomingHttpResponseHead( m_parser.getHead() ) )
+    {
+        r = -1;
+    }
+    return r;
+}
 }
 #else
 extern const char *jdksavdeccmcu_http_file = __FILE__;
@@ -0,0 +1,354 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Metrics.hpp"
+#include "JDKSAvdeccMCU/HandlerGroup.hpp"
+#include "JDKSAvdeccMCU/Entity.hpp"
+#include "JDKSAvdeccMCU/RawSocket.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_METRICS
+
+#include <sstream>
+
+namespace JDKSAvdeccMCU
+{
+
+void MetricsHistogram::clear()
+{
+    m_count = 0;
+    m_sum = 0;
+    m_min = ~uint64_t( 0 );
+    m_max = 0;
+    for ( size_t i = 0; i < bucket_count; ++i )
+    {
+        m_buckets[i] = 0;
+    }
+}
+
+void MetricsHistogram::merge( MetricsHistogram const &other )
+{
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_min = std::min( m_min, other.m_min );
+    m_max = std::max( m_max, other.m_max );
+    for ( size_t i = 0; i < bucket_count; ++i )
+    {
+        m_buckets[i] += other.m_buckets[i];
+    }
+}
+
+uint64_t MetricsHistogram::getPercentile( double percentile ) const
+{
+    uint64_t r = 0;
+    if ( m_count )
+    {
+        uint64_t rank = uint64_t( ceil( percentile / 100.0 * double( m_count ) ) );
+        rank = std::max( rank, uint64_t( 1 ) );
+        uint64_t seen = 0;
+        size_t i = 0;
+        for ( ; i < bucket_count - 1; ++i )
+        {
+            seen += m_buckets[i];
+            if ( seen >= rank )
+            {
+                break;
+            }
+        }
+        r = std::max( std::min( getBucketUpperBound( i ), m_max ), getMin() );
+    }
+    return r;
+}
+
+uint64_t MetricsHistogram::getCountAtOrBelow( uint64_t value_in_nanoseconds ) const
+{
+    uint64_t r = 0;
+    for ( size_t i = 0; i < bucket_count - 1 && getBucketUpperBound( i ) <= value_in_nanoseconds; ++i )
+    {
+        r += m_buckets[i];
+    }
+    return r;
+}
+
+uint64_t MetricsHistogram::getBucketLowerBound( size_t bucket )
+{
+    uint64_t r = bucket;
+    if ( bucket >= sub_bucket_count )
+    {
+        size_t shift = ( bucket - sub_bucket_count ) / sub_bucket_count;
+        r = uint64_t( sub_bucket_count + ( bucket - sub_bucket_count ) % sub_bucket_count ) << shift;
+    }
+    return r;
+}
+
+uint64_t MetricsHistogram::getBucketUpperBound( size_t bucket )
+{
+    return bucket + 1 < bucket_count ? getBucketLowerBound( bucket + 1 ) - 1 : ~uint64_t( 0 );
+}
+
+void MetricsSnapshot::addHandlerGroup( std::string const &name, HandlerGroup const &group )
+{
+    m_handler_groups.push_back( HandlerGroupEntry() );
+    HandlerGroupEntry &entry = m_handler_groups.back();
+    entry.m_name = name;
+    entry.m_rx_count = group.getRxCount();
+    entry.m_handled_count = group.getHandledCount();
+    if ( group.getHandlerMetrics() )
+    {
+        entry.m_handlers.assign( group.getHandlerMetrics(), group.getHandlerMetrics() + group.getHandlerCount() );
+    }
+    entry.m_latency = group.getLatencyHistogram();
+}
+
+void MetricsSnapshot::addEntity( std::string const &name, Entity const &entity )
+{
+    m_entities.push_back( EntityEntry() );
+    EntityEntry &entry = m_entities.back();
+    entry.m_name = name;
+    entry.m_entity_id = entity.getEntityID();
+    entry.m_metrics = entity.getMetrics();
+    entry.m_commands_in_flight = entity.getCommandsInFlight();
+}
+
+void MetricsSnapshot::addRawSocket( std::string const &name, RawSocket const &socket )
+{
+    m_raw_sockets.push_back( RawSocketEntry() );
+    RawSocketEntry &entry = m_raw_sockets.back();
+    entry.m_name = name;
+    entry.m_mac_address = socket.getMACAddress();
+    entry.m_tx_frames = socket.getTxFrameCount();
+    entry.m_tx_octets = socket.getTxOctetCount();
+}
+
+namespace
+{
+
+/// Escape a label value as the text exposition format requires
+std::string labelValue( std::string const &s )
+{
+    std::string r;
+    for ( size_t i = 0; i < s.size(); ++i )
+    {
+        if ( s[i] == '\\' || s[i] == '"' )
+        {
+            r += '\\';
+            r += s[i];
+        }
+        else if ( s[i] == '\n' )
+        {
+            r += "\\n";
+        }
+        else
+        {
+            r += s[i];
+        }
+    }
+    return r;
+}
+
+std::string entityLabels( MetricsSnapshot::EntityEntry const &entry )
+{
+    std::ostringstream r;
+    r << "entity=\"" << labelValue( entry.m_name ) << "\",entity_id=\"" << entry.m_entity_id << "\"";
+    return r.str();
+}
+
+void writeFamily( std::ostream &o, std::string const &name, char const *type, char const *help )
+{
+    o << "# HELP " << name << " " << help << "\n";
+    o << "# TYPE " << name << " " << type << "\n";
+}
+
+/// The bounds of the exported latency histograms, in nanoseconds
+uint64_t const latency_bounds[] = {1000,
+                                   2000,
+                                   5000,
+                                   10000,
+                                   20000,
+                                   50000,
+                                   100000,
+                                   200000,
+                                   500000,
+                                   1000000,
+                                   2000000,
+                                   5000000,
+                                   10000000,
+                                   100000000,
+                                   1000000000};
+}
+
+void MetricsSnapshot::writePrometheus( std::ostream &o, std::string const &prefix ) const
+{
+    std::string name;
+    std::streamsize precision = o.precision( 9 );
+
+    // The HandlerGroups
+    name = prefix + "_handler_group_received_frames_total";
+    writeFamily( o, name, "counter", "Frames dispatched to the handler group" );
+    for ( size_t i = 0; i < m_handler_groups.size(); ++i )
+    {
+        o << name << "{group=\"" << labelValue( m_handler_groups[i].m_name ) << "\"} " << m_handler_groups[i].m_rx_count
+          << "\n";
+    }
+
+    name = prefix + "_handler_group_handled_frames_total";
+    writeFamily( o, name, "counter", "Frames that a handler of the group handled" );
+    for ( size_t i = 0; i < m_handler_groups.size(); ++i )
+    {
+        o << name << "{group=\"" << labelValue( m_handler_groups[i].m_name ) << "\"} " << m_handler_groups[i].m_handled_count
+          << "\n";
+    }
+
+    name = prefix + "_handler_invocations_total";
+    writeFamily( o, name, "counter", "Frames given to each handler of the group" );
+    for ( size_t i = 0; i < m_handler_groups.size(); ++i )
+    {
+        for ( size_t j = 0; j < m_handler_groups[i].m_handlers.size(); ++j )
+        {
+            o << name << "{group=\"" << labelValue( m_handler_groups[i].m_name ) << "\",handler=\"" << j << "\"} "
+              << m_handler_groups[i].m_handlers[j].m_invocations << "\n";
+        }
+    }
+
+    name = prefix + "_handler_handled_total";
+    writeFamily( o, name, "counter", "Frames that each handler of the group handled" );
+    for ( size_t i = 0; i < m_handler_groups.size(); ++i )
+    {
+        for ( size_t j = 0; j < m_handler_groups[i].m_handlers.size(); ++j )
+        {
+            o << name << "{group=\"" << labelValue( m_handler_groups[i].m_name ) << "\",handler=\"" << j << "\"} "
+              << m_handler_groups[i].m_handlers[j].m_handled << "\n";
+        }
+    }
+
+    name = prefix + "_handler_group_latency_seconds";
+    writeFamily( o, name, "histogram", "Time taken to dispatch a sampled received frame to the handlers of the group" );
+    for ( size_t i = 0; i < m_handler_groups.size(); ++i )
+    {
+        MetricsHistogram const &latency = m_handler_groups[i].m_latency;
+        std::string group = labelValue( m_handler_groups[i].m_name );
+        for ( size_t j = 0; j < sizeof( latency_bounds ) / sizeof( latency_bounds[0] ); ++j )
+        {
+            o << name << "_bucket{group=\"" << group << "\",le=\"" << double( latency_bounds[j] ) / 1e9 << "\"} "
+              << latency.getCountAtOrBelow( latency_bounds[j] ) << "\n";
+        }
+        o << name << "_bucket{group=\"" << group << "\",le=\"+Inf\"} " << latency.getCount() << "\n";
+        o << name << "_sum{group=\"" << group << "\"} " << double( latency.getSum() ) / 1e9 << "\n";
+        o << name << "_count{group=\"" << group << "\"} " << latency.getCount() << "\n";
+    }
+
+    // The Entities, only the AEM command types that were received are written
+    name = prefix + "_entity_aem_commands_total";
+    writeFamily( o, name, "counter", "AEM commands received by the entity" );
+    for ( size_t i = 0; i < m_entities.size(); ++i )
+    {
+        for ( size_t j = 0; j < EntityMetrics::aem_command_type_count; ++j )
+        {
+            if ( m_entities[i].m_metrics.m_aem_commands[j] )
+            {
+                char const *command = j + 1 < EntityMetrics::aem_command_type_count
+                                          ? jdksavdecc_get_name_for_uint16_value( jdksavdecc_aem_print_command, uint16_t( j ) )
+                                          : 0;
+                o << name << "{" << entityLabels( m_entities[i] ) << ",command=\""
+                  << ( command ? command : "OTHER" ) << "\"} " << m_entities[i].m_metrics.m_aem_commands[j] << "\n";
+            }
+        }
+    }
+
+    name = prefix + "_entity_aem_command_failures_total";
+    writeFamily( o, name, "counter", "AEM commands received by the entity and responded to with a status other than SUCCESS" );
+    for ( size_t i = 0; i < m_entities.size(); ++i )
+    {
+        for ( size_t j = 0; j < EntityMetrics::aem_command_type_count; ++j )
+        {
+            if ( m_entities[i].m_metrics.m_aem_commands[j] )
+            {
+                char const *command = j + 1 < EntityMetrics::aem_command_type_count
+                                          ? jdksavdecc_get_name_for_uint16_value( jdksavdecc_aem_print_command, uint16_t( j ) )
+                                          : 0;
+                o << name << "{" << entityLabels( m_entities[i] ) << ",command=\""
+                  << ( command ? command : "OTHER" ) << "\"} " << m_entities[i].m_metrics.m_aem_failures[j] << "\n";
+            }
+        }
+    }
+
+    struct EntityCounter
+    {
+        char const *m_suffix;
+        char const *m_type;
+        char const *m_help;
+    };
+    static EntityCounter const entity_counters[] = {
+        {"_entity_aa_commands_total", "counter", "Address Access commands received by the entity"},
+        {"_entity_acmp_messages_total", "counter", "ACMP messages involving the entity"},
+        {"_entity_commands_sent_total", "counter", "AEM commands sent by the entity that wait for a response"},
+        {"_entity_command_timeouts_total", "counter", "AEM commands sent by the entity that were not answered in time"},
+        {"_entity_commands_in_flight", "gauge", "AEM commands sent by the entity that wait for a response now"}};
+
+    for ( size_t k = 0; k < sizeof( entity_counters ) / sizeof( entity_counters[0] ); ++k )
+    {
+        name = prefix + entity_counters[k].m_suffix;
+        writeFamily( o, name, entity_counters[k].m_type, entity_counters[k].m_help );
+        for ( size_t i = 0; i < m_entities.size(); ++i )
+        {
+            EntityEntry const &entry = m_entities[i];
+            uint32_t values[] = {entry.m_metrics.m_aa_commands,
+                                 entry.m_metrics.m_acmp_messages,
+                                 entry.m_metrics.m_commands_sent,
+                                 entry.m_metrics.m_command_timeouts,
+                                 entry.m_commands_in_flight};
+            o << name << "{" << entityLabels( entry ) << "} " << values[k] << "\n";
+        }
+    }
+
+    // The RawSockets
+    name = prefix + "_socket_tx_frames_total";
+    writeFamily( o, name, "counter", "Frames sent by the raw socket" );
+    for ( size_t i = 0; i < m_raw_sockets.size(); ++i )
+    {
+        o << name << "{socket=\"" << labelValue( m_raw_sockets[i].m_name ) << "\",mac=\"" << m_raw_sockets[i].m_mac_address
+          << "\"} " << m_raw_sockets[i].m_tx_frames << "\n";
+    }
+
+    name = prefix + "_socket_tx_octets_total";
+    writeFamily( o, name, "counter", "Octets of the frames sent by the raw socket, without padding" );
+    for ( size_t i = 0; i < m_raw_sockets.size(); ++i )
+    {
+        o << name << "{socket=\"" << labelValue( m_raw_sockets[i].m_name ) << "\",mac=\"" << m_raw_sockets[i].m_mac_address
+          << "\"} " << m_raw_sockets[i].m_tx_octets << "\n";
+    }
+    o.precision( precision );
+}
+}
+
+#else
+const char *jdksavdeccmcu_metrics_file = __FILE__;
+#endif
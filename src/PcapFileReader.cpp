@@ -108,7 +108,7 @@ bool PcapFileReader::ReadPacket( uint64_t *timestamp_in_microseconds, PcapFilePa
             throw std::runtime_error( std::string( "Error reading packet from: " ) + m_filename );
         }
 
-        *timestamp_in_microseconds = ( packet_header.ts_sec * 1000000 ) + ( packet_header.ts_usec );
+        *timestamp_in_microseconds = ( uint64_t( packet_header.ts_sec ) * 1000000 ) + ( packet_header.ts_usec );
 
         results.resize( (size_t)packet_header.incl_len );
         if ( fread( &results[0], results.size(), 1, m_file.get() ) != 1 )
@@ -39,48 +39,266 @@
 namespace JDKSAvdeccMCU
 {
 
-PcapFileWriter::PcapFileWriter( std::string const &filename ) : m_file( filename, "rb" ), m_filename( filename )
+namespace
 {
+
+/// Room for the largest record and the file header in front of it
+const size_t min_buffer_size = 128 * 1024;
+
+/// The longest packet a record holds, longer ones are cut short
+const size_t max_captured_length = 0xffff;
+
+const uint32_t pcapng_section_header_block = 0x0a0d0d0a;
+const uint32_t pcapng_byte_order_magic = 0x1a2b3c4d;
+const uint32_t pcapng_interface_description_block = 1;
+const uint32_t pcapng_enhanced_packet_block = 6;
+const uint16_t pcapng_option_end = 0;
+const uint16_t pcapng_option_if_name = 2;
+const uint16_t pcapng_option_if_tsresol = 9;
+const size_t pcapng_max_interface_name = 256;
+
+size_t pad4( size_t length ) { return ( length + 3 ) & ~size_t( 3 ); }
+
+PcapFile *openFile( std::string const &filename, char const *mode )
+{
+    PcapFile *file = new PcapFile( filename, mode );
+    if ( !file->get() )
+    {
+        delete file;
+        throw std::runtime_error( std::string( "Error creating pcap file: " ) + filename );
+    }
+
+    /* The records are already buffered, so stdio does not need to copy them again */
+    setvbuf( file->get(), 0, _IONBF, 0 );
+    return file;
+}
+}
+
+PcapFileWriter::PcapFileWriter( std::string const &filename ) : m_filename( filename ), m_file( 0 )
+{
+    bool append = false;
+
     /* Did it already exist ?*/
-    if ( m_file.get() )
     {
-        /* yes, so close and re-open in append mode */
-        m_file = PcapFile( filename, "a+b" );
-        if ( !m_file.get() )
+        PcapFile existing( filename, "rb" );
+        if ( existing.get() && fseek( existing.get(), 0, SEEK_END ) == 0 && ftell( existing.get() ) > 0 )
         {
-            throw std::runtime_error( std::string( "Error appending to pcap file: " ) + filename );
+            append = true;
         }
     }
-    else
+    init( append );
+}
+
+PcapFileWriter::PcapFileWriter( std::string const &filename, Settings const &settings )
+    : m_filename( filename ), m_settings( settings ), m_file( 0 )
+{
+    init( false );
+}
+
+void PcapFileWriter::init( bool append )
+{
+    m_file_number = 0;
+    m_file_length = 0;
+    m_file_first_time_in_microseconds = 0;
+    m_file_has_packets = false;
+    m_buffer_first_time_in_microseconds = 0;
+    m_buffer_has_packets = false;
+    m_packet_count = 0;
+    m_dropped_count = 0;
+
+    m_settings.m_buffer_size = std::max( m_settings.m_buffer_size, min_buffer_size );
+    size_t buffer_count = 1;
+
+#if JDKSAVDECCMCU_ENABLE_THREADS
+    m_full = 0;
+    m_free = 0;
+    m_stop.store( false );
+    m_failed.store( false );
+    if ( m_settings.m_async )
     {
-        /* The file does not already exist, so create the file and add a
-         * wireshark pcap header */
-        /* create data logging file in current directory */
-        m_file = PcapFile( filename, "wb" );
-
-        if ( m_file.get() )
-        {
-            pcap_hdr_t header;
-            header.magic_number = 0xa1b2c3d4;
-            header.version_major = 2;
-            header.version_minor = 2;
-            header.thiszone = 0;
-            header.sigfigs = 0;
-            header.snaplen = 0xffff;
-            header.network = 1;
-            if ( fwrite( &header, sizeof( header ), 1, m_file.get() ) )
-            {
-                throw std::runtime_error( std::string( "Error writing pcap file: " ) + filename );
-            }
+        buffer_count = std::max( m_settings.m_buffer_count, size_t( 2 ) );
+    }
+#else
+    m_settings.m_async = false;
+#endif
+
+    m_buffers.resize( buffer_count );
+    for ( size_t i = 0; i < buffer_count; ++i )
+    {
+        m_buffers[i].m_data.resize( m_settings.m_buffer_size );
+    }
+    m_current = &m_buffers[0];
+
+    Interface ethernet;
+    ethernet.m_link_type = 1;
+    m_interfaces.push_back( ethernet );
+
+    /* An existing pcap file gets more records, an existing pcapng file gets a new section */
+    m_file = openFile( m_filename, append ? "ab" : "wb" );
+    if ( !append || m_settings.m_format == FORMAT_PCAPNG )
+    {
+        putFileHeader();
+    }
+
+#if JDKSAVDECCMCU_ENABLE_THREADS
+    if ( m_settings.m_async )
+    {
+        m_full = new SpscQueue<Buffer *>( buffer_count );
+        m_free = new SpscQueue<Buffer *>( buffer_count );
+        for ( size_t i = 1; i < buffer_count; ++i )
+        {
+            *m_free->beginPush() = &m_buffers[i];
+            m_free->commitPush();
+        }
+        m_thread = std::thread( &PcapFileWriter::threadMain, this );
+    }
+#endif
+}
+
+PcapFileWriter::~PcapFileWriter()
+{
+    try
+    {
+        Flush();
+    }
+    catch ( std::runtime_error const & )
+    {
+    }
+
+#if JDKSAVDECCMCU_ENABLE_THREADS
+    if ( m_thread.joinable() )
+    {
+        m_stop.store( true, std::memory_order_release );
+        m_wake.notify_one();
+        m_thread.join();
+    }
+    delete m_full;
+    delete m_free;
+#endif
+    delete m_file;
+}
+
+std::string PcapFileWriter::GetFileName( uint32_t file_number ) const
+{
+    std::string name = m_filename;
+    if ( file_number > 0 )
+    {
+        size_t slash = name.find_last_of( "/\\" );
+        size_t dot = name.rfind( '.' );
+        if ( dot == std::string::npos || ( slash != std::string::npos && dot < slash ) )
+        {
+            dot = name.length();
+        }
+
+        char suffix[16];
+#if defined( _WIN32 )
+        sprintf_s( suffix, sizeof( suffix ), "-%u", unsigned( file_number ) );
+#else
+        sprintf( suffix, "-%u", unsigned( file_number ) );
+#endif
+        name.insert( dot, suffix );
+    }
+    return name;
+}
+
+uint32_t PcapFileWriter::AddInterface( std::string const &name, uint16_t link_type )
+{
+    uint32_t r = 0;
+    checkFailed();
+    if ( m_settings.m_format == FORMAT_PCAPNG )
+    {
+        Interface interface;
+        interface.m_name = name.substr( 0, pcapng_max_interface_name );
+        interface.m_link_type = link_type;
+
+        /* Packets on the new interface may follow at once, so wait for a buffer */
+        if ( reserve( 32 + 4 + pad4( interface.m_name.length() ), true ) )
+        {
+            m_interfaces.push_back( interface );
+            r = uint32_t( m_interfaces.size() - 1 );
+            putInterfaceBlock( interface );
         }
         else
         {
-            throw std::runtime_error( std::string( "Error creating pcap file: " ) + filename );
+            ++m_dropped_count;
+        }
+    }
+    return r;
+}
+
+void PcapFileWriter::put( void const *data, size_t length )
+{
+    memcpy( &m_current->m_data[m_current->m_length], data, length );
+    m_current->m_length += length;
+    m_file_length += length;
+}
+
+void PcapFileWriter::putFileHeader()
+{
+    if ( m_settings.m_format == FORMAT_PCAPNG )
+    {
+        put32( pcapng_section_header_block );
+        put32( 28 );
+        put32( pcapng_byte_order_magic );
+        put16( 1 );
+        put16( 0 );
+        /* The section length is not known */
+        put32( 0xffffffff );
+        put32( 0xffffffff );
+        put32( 28 );
+
+        for ( size_t i = 0; i < m_interfaces.size(); ++i )
+        {
+            putInterfaceBlock( m_interfaces[i] );
         }
     }
+    else
+    {
+        pcap_hdr_t header;
+        header.magic_number = 0xa1b2c3d4;
+        header.version_major = 2;
+        header.version_minor = 4;
+        header.thiszone = 0;
+        header.sigfigs = 0;
+        header.snaplen = max_captured_length;
+        header.network = 1;
+        put( &header, sizeof( header ) );
+    }
 }
 
-PcapFileWriter::~PcapFileWriter() {}
+void PcapFileWriter::putInterfaceBlock( Interface const &interface )
+{
+    static uint8_t const zeros[4] = {0, 0, 0, 0};
+    size_t name_length = interface.m_name.length();
+    /* Header, if_tsresol, end of options and the trailing length */
+    uint32_t block_length = uint32_t( 16 + 8 + 4 + 4 );
+    if ( name_length > 0 )
+    {
+        block_length += uint32_t( 4 + pad4( name_length ) );
+    }
+
+    put32( pcapng_interface_description_block );
+    put32( block_length );
+    put16( interface.m_link_type );
+    put16( 0 );
+    put32( max_captured_length );
+    if ( name_length > 0 )
+    {
+        put16( pcapng_option_if_name );
+        put16( uint16_t( name_length ) );
+        put( interface.m_name.data(), name_length );
+        put( zeros, pad4( name_length ) - name_length );
+    }
+    /* Timestamps are in nanoseconds */
+    put16( pcapng_option_if_tsresol );
+    put16( 1 );
+    uint8_t resolution = 9;
+    put( &resolution, 1 );
+    put( zeros, 3 );
+    put16( pcapng_option_end );
+    put16( 0 );
+    put32( block_length );
+}
 
 void PcapFileWriter::WritePacket( PcapFilePacket const &packet )
 {
@@ -94,19 +312,9 @@ void PcapFileWriter::WritePacket( uint64_t time_in_micros, PcapFilePacket const
 {
     if ( packet.size() > 14 )
     {
-        pcaprec_hdr_t pktheader;
-        pktheader.ts_sec = uint32_t( time_in_micros / 1000000 );
-        pktheader.ts_usec = uint32_t( time_in_micros % 1000000 );
-        pktheader.incl_len = uint32_t( packet.size() );
-        pktheader.orig_len = pktheader.incl_len;
-        if ( fwrite( &pktheader, sizeof( pktheader ), 1, m_file.get() ) != 1 )
-        {
-            throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
-        }
-        if ( fwrite( &packet[0], packet.size(), 1, m_file.get() ) != 1 )
-        {
-            throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
-        }
+        uint8_t const *part = &packet[0];
+        size_t length = packet.size();
+        WritePacketParts( time_in_micros * 1000, 0, &part, &length, 1 );
     }
 }
 
@@ -124,45 +332,288 @@ void PcapFileWriter::WritePacket( uint64_t packet_time_in_micros,
                                   uint16_t ethertype,
                                   PcapFilePacket const &packet_payload )
 {
-    pcaprec_hdr_t pktheader;
-    pktheader.ts_sec = uint32_t( packet_time_in_micros / 1000000 );
-    pktheader.ts_usec = uint32_t( packet_time_in_micros % 1000000 );
-    pktheader.incl_len = int( packet_payload.size() + 14 );
-    pktheader.orig_len = pktheader.incl_len;
-    ssize_t n;
-    n = fwrite( &pktheader, sizeof( pktheader ), 1, m_file.get() );
-    if ( n != 1 )
-    {
-#if defined( _MSC_VER )
-        char errbuf[1024];
-        strerror_s( errbuf, errno );
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename + " " + errbuf );
+    uint8_t header[14];
+    memcpy( &header[0], da, 6 );
+    memcpy( &header[6], sa, 6 );
+    header[12] = uint8_t( ethertype >> 8 );
+    header[13] = uint8_t( ethertype & 0xff );
+
+    uint8_t const *parts[2] = {header, packet_payload.empty() ? 0 : &packet_payload[0]};
+    size_t lengths[2] = {sizeof( header ), packet_payload.size()};
+    WritePacketParts( packet_time_in_micros * 1000, 0, parts, lengths, 2 );
+}
+
+bool PcapFileWriter::WritePacketParts( uint64_t time_in_nanoseconds,
+                                       uint32_t interface_id,
+                                       uint8_t const *const *parts,
+                                       size_t const *lengths,
+                                       size_t count )
+{
+    checkFailed();
+
+    uint64_t time_in_microseconds = time_in_nanoseconds / 1000;
+    size_t original_length = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        original_length += lengths[i];
+    }
+    size_t captured_length = std::min( original_length, max_captured_length );
+    size_t record_length = m_settings.m_format == FORMAT_PCAPNG ? 32 + pad4( captured_length )
+                                                                 : sizeof( pcaprec_hdr_t ) + captured_length;
+
+    bool rotate = false;
+    if ( m_file_has_packets )
+    {
+        if ( m_settings.m_rotate_size && m_file_length + record_length > m_settings.m_rotate_size )
+        {
+            rotate = true;
+        }
+        if ( m_settings.m_rotate_interval_in_microseconds && time_in_microseconds >= m_file_first_time_in_microseconds
+             && time_in_microseconds - m_file_first_time_in_microseconds >= m_settings.m_rotate_interval_in_microseconds )
+        {
+            rotate = true;
+        }
+    }
+
+    if ( m_buffer_has_packets && m_settings.m_flush_interval_in_microseconds
+         && time_in_microseconds >= m_buffer_first_time_in_microseconds
+         && time_in_microseconds - m_buffer_first_time_in_microseconds >= m_settings.m_flush_interval_in_microseconds )
+    {
+        handOff();
+    }
+
+    if ( ( rotate && !startFile() ) || !reserve( record_length, false ) )
+    {
+        ++m_dropped_count;
+        return false;
+    }
+
+    if ( interface_id >= m_interfaces.size() )
+    {
+        interface_id = 0;
+    }
+
+    if ( m_settings.m_format == FORMAT_PCAPNG )
+    {
+        put32( pcapng_enhanced_packet_block );
+        put32( uint32_t( record_length ) );
+        put32( interface_id );
+        put32( uint32_t( time_in_nanoseconds >> 32 ) );
+        put32( uint32_t( time_in_nanoseconds ) );
+        put32( uint32_t( captured_length ) );
+        put32( uint32_t( original_length ) );
+    }
+    else
+    {
+        pcaprec_hdr_t header;
+        header.ts_sec = uint32_t( time_in_microseconds / 1000000 );
+        header.ts_usec = uint32_t( time_in_microseconds % 1000000 );
+        header.incl_len = int32_t( captured_length );
+        header.orig_len = int32_t( original_length );
+        put( &header, sizeof( header ) );
+    }
+
+    size_t remaining = captured_length;
+    for ( size_t i = 0; i < count && remaining > 0; ++i )
+    {
+        size_t length = std::min( lengths[i], remaining );
+        if ( length > 0 )
+        {
+            put( parts[i], length );
+            remaining -= length;
+        }
+    }
+
+    if ( m_settings.m_format == FORMAT_PCAPNG )
+    {
+        static uint8_t const zeros[4] = {0, 0, 0, 0};
+        put( zeros, pad4( captured_length ) - captured_length );
+        put32( uint32_t( record_length ) );
+    }
+
+    if ( !m_buffer_has_packets )
+    {
+        m_buffer_has_packets = true;
+        m_buffer_first_time_in_microseconds = time_in_microseconds;
+    }
+    if ( !m_file_has_packets )
+    {
+        m_file_has_packets = true;
+        m_file_first_time_in_microseconds = time_in_microseconds;
+    }
+    ++m_packet_count;
+    return true;
+}
+
+void PcapFileWriter::Flush()
+{
+    checkFailed();
+    if ( m_current && m_current->m_length > 0 )
+    {
+        handOff();
+    }
+}
+
+void PcapFileWriter::Rotate()
+{
+    checkFailed();
+    reserve( 0, true );
+    startFile();
+}
+
+bool PcapFileWriter::startFile()
+{
+    bool r = false;
+
+    /* The records so far go to the old file */
+    if ( m_current && m_current->m_length > 0 )
+    {
+        handOff();
+    }
+    if ( reserve( 0, false ) )
+    {
+        m_current->m_new_file = true;
+        m_current->m_file_number = ++m_file_number;
+        m_file_length = 0;
+        m_file_has_packets = false;
+        putFileHeader();
+        r = true;
+    }
+    return r;
+}
+
+bool PcapFileWriter::reserve( size_t length, bool wait )
+{
+    if ( m_current && m_current->m_length + length > m_current->m_data.size() )
+    {
+        handOff();
+    }
+
+#if JDKSAVDECCMCU_ENABLE_THREADS
+    while ( !m_current && m_free )
+    {
+        Buffer **free_buffer = m_free->front();
+        if ( free_buffer )
+        {
+            m_current = *free_buffer;
+            m_free->pop();
+        }
+        else if ( wait && !m_failed.load( std::memory_order_acquire ) )
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            break;
+        }
+    }
 #else
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename + " " + strerror( errno ) );
+    (void)wait;
 #endif
+
+    return m_current != 0;
+}
+
+void PcapFileWriter::handOff()
+{
+    bool queued = false;
+    m_buffer_has_packets = false;
+
+#if JDKSAVDECCMCU_ENABLE_THREADS
+    if ( m_full )
+    {
+        /* The queue has a slot for every buffer, so there is always room */
+        *m_full->beginPush() = m_current;
+        m_full->commitPush();
+        m_wake.notify_one();
+        m_current = 0;
+        reserve( 0, false );
+        queued = true;
     }
-    if ( fwrite( da, 6, 1, m_file.get() ) != 1 )
+#endif
+
+    if ( !queued )
     {
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
+        output( m_current );
     }
+}
 
-    if ( fwrite( sa, 6, 1, m_file.get() ) != 1 )
+void PcapFileWriter::output( Buffer *buffer )
+{
+    if ( buffer->m_new_file )
     {
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
+        delete m_file;
+        m_file = 0;
+        if ( m_settings.m_max_files && buffer->m_file_number >= m_settings.m_max_files )
+        {
+            remove( GetFileName( uint32_t( buffer->m_file_number - m_settings.m_max_files ) ).c_str() );
+        }
+        m_file = openFile( GetFileName( buffer->m_file_number ), "wb" );
+        buffer->m_new_file = false;
     }
-    if ( fputc( ( ethertype >> 8 ) & 0xff, m_file.get() ) == EOF )
+
+    size_t length = buffer->m_length;
+    buffer->m_length = 0;
+    if ( length > 0 && ( !m_file || fwrite( &buffer->m_data[0], length, 1, m_file->get() ) != 1 ) )
     {
         throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
     }
-    if ( fputc( ( ethertype >> 0 ) & 0xff, m_file.get() ) == EOF )
+}
+
+void PcapFileWriter::checkFailed()
+{
+#if JDKSAVDECCMCU_ENABLE_THREADS
+    if ( m_failed.load( std::memory_order_acquire ) )
     {
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
+        throw std::runtime_error( m_failure );
     }
-    if ( fwrite( &packet_payload[0], packet_payload.size(), 1, m_file.get() ) != 1 )
+#endif
+}
+
+#if JDKSAVDECCMCU_ENABLE_THREADS
+void PcapFileWriter::threadMain()
+{
+    for ( ;; )
     {
-        throw std::runtime_error( std::string( "Error writing to pcap file: " ) + m_filename );
+        Buffer **full_buffer = m_full->front();
+        if ( full_buffer )
+        {
+            Buffer *buffer = *full_buffer;
+            m_full->pop();
+            if ( !m_failed.load( std::memory_order_relaxed ) )
+            {
+                try
+                {
+                    output( buffer );
+                }
+                catch ( std::runtime_error const &e )
+                {
+                    m_failure = e.what();
+                    m_failed.store( true, std::memory_order_release );
+                }
+            }
+            buffer->m_length = 0;
+            buffer->m_new_file = false;
+            *m_free->beginPush() = buffer;
+            m_free->commitPush();
+        }
+        else if ( m_stop.load( std::memory_order_acquire ) )
+        {
+            /* Stop only when nothing was queued before the stop */
+            if ( !m_full->front() )
+            {
+                break;
+            }
+        }
+        else
+        {
+            /* A notify between front() and the wait is only late by the timeout */
+            std::unique_lock<std::mutex> lock( m_wake_mutex );
+            m_wake.wait_for( lock, std::chrono::milliseconds( 10 ) );
+        }
     }
 }
+#endif
 }
 
 #else
@@ -0,0 +1,377 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1 && JDKSAVDECCMCU_ENABLE_MMAP == 1
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "JDKSAvdeccMCU/PcapMappedReader.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+namespace
+{
+
+uint32_t get32( uint8_t const *p, bool swap )
+{
+    uint32_t v;
+    memcpy( &v, p, sizeof( v ) );
+    return swap ? PcapFileSwap( v ) : v;
+}
+
+uint16_t get16( uint8_t const *p, bool swap )
+{
+    uint16_t v;
+    memcpy( &v, p, sizeof( v ) );
+    return swap ? uint16_t( ( v >> 8 ) | ( v << 8 ) ) : v;
+}
+
+const uint32_t pcapng_section_header_block = 0x0a0d0d0a;
+const uint32_t pcapng_byte_order_magic = 0x1a2b3c4d;
+const uint32_t pcapng_interface_description_block = 1;
+const uint32_t pcapng_packet_block = 2;
+const uint32_t pcapng_enhanced_packet_block = 6;
+const uint16_t pcapng_option_if_tsresol = 9;
+
+/// Offset of the captured octets in a pcapng packet block, the same in
+/// Enhanced Packet Blocks and Packet Blocks
+const size_t pcapng_packet_data_offset = 28;
+}
+
+PcapMappedReader::PcapMappedReader( std::string const &filename )
+    : m_filename( filename )
+    , m_data( 0 )
+    , m_length( 0 )
+    , m_format( FORMAT_PCAP )
+    , m_first_timestamp_in_microseconds( 0 )
+    , m_position( 0 )
+{
+    int fd = open( filename.c_str(), O_RDONLY );
+    if ( fd < 0 )
+    {
+        throw std::runtime_error( std::string( "Error opening pcap file: " ) + filename );
+    }
+
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || st.st_size < off_t( sizeof( pcap_hdr_t ) ) )
+    {
+        close( fd );
+        throw std::runtime_error( std::string( "Error reading pcap file header: " ) + filename );
+    }
+
+    m_length = size_t( st.st_size );
+    void *p = mmap( 0, m_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( p == MAP_FAILED )
+    {
+        throw std::runtime_error( std::string( "Error mapping pcap file: " ) + filename );
+    }
+    m_data = static_cast<uint8_t *>( p );
+    madvise( m_data, m_length, MADV_SEQUENTIAL );
+
+    try
+    {
+        if ( get32( m_data, false ) == pcapng_section_header_block )
+        {
+            m_format = FORMAT_PCAPNG;
+            indexPcapng();
+        }
+        else
+        {
+            indexPcap();
+        }
+    }
+    catch ( ... )
+    {
+        munmap( m_data, m_length );
+        throw;
+    }
+
+    madvise( m_data, m_length, MADV_RANDOM );
+
+    if ( !m_index.empty() )
+    {
+        Interface const *interface;
+        uint32_t captured_length;
+        getRecord( 0, &interface, &captured_length );
+        m_first_timestamp_in_microseconds = ticksToMicroseconds( getTicks( 0 ), *interface );
+    }
+}
+
+PcapMappedReader::~PcapMappedReader() { munmap( m_data, m_length ); }
+
+void PcapMappedReader::indexPcap()
+{
+    Interface interface;
+    uint32_t magic = get32( m_data, false );
+
+    if ( magic == 0xa1b2c3d4 || magic == 0xa1b23c4d )
+    {
+        interface.m_swap = false;
+    }
+    else if ( magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1 )
+    {
+        interface.m_swap = true;
+    }
+    else
+    {
+        throw std::runtime_error( std::string( "Error pcap file header is incompatible: " ) + m_filename );
+    }
+
+    magic = get32( m_data, interface.m_swap );
+    interface.m_ticks_per_second = magic == 0xa1b23c4d ? 1000000000 : 1000000;
+    interface.m_link_type = uint16_t( get32( m_data + offsetof( pcap_hdr_t, network ), interface.m_swap ) );
+    m_interfaces.push_back( interface );
+
+    /* A record cut short at the end of the file ends the capture */
+    size_t pos = sizeof( pcap_hdr_t );
+    while ( pos + sizeof( pcaprec_hdr_t ) <= m_length )
+    {
+        uint32_t incl_len = get32( m_data + pos + offsetof( pcaprec_hdr_t, incl_len ), interface.m_swap );
+        size_t next = pos + sizeof( pcaprec_hdr_t ) + incl_len;
+        if ( next > m_length || next < pos )
+        {
+            break;
+        }
+        addPacket( pos, 0 );
+        pos = next;
+    }
+}
+
+void PcapMappedReader::indexPcapng()
+{
+    size_t section_first_interface = 0;
+    bool swap = false;
+    size_t pos = 0;
+
+    while ( pos + 12 <= m_length )
+    {
+        uint32_t block_type = get32( m_data + pos, false );
+
+        if ( block_type == pcapng_section_header_block )
+        {
+            uint32_t byte_order = get32( m_data + pos + 8, false );
+            if ( byte_order == pcapng_byte_order_magic )
+            {
+                swap = false;
+            }
+            else if ( byte_order == PcapFileSwap( pcapng_byte_order_magic ) )
+            {
+                swap = true;
+            }
+            else
+            {
+                throw std::runtime_error( std::string( "Error pcapng section header is incompatible: " ) + m_filename );
+            }
+            section_first_interface = m_interfaces.size();
+        }
+        else
+        {
+            block_type = get32( m_data + pos, swap );
+        }
+
+        uint32_t block_length = get32( m_data + pos + 4, swap );
+        if ( block_length < 12 || ( block_length & 3 ) != 0 || block_length > m_length - pos )
+        {
+            break;
+        }
+        uint8_t const *block = m_data + pos;
+
+        if ( block_type == pcapng_interface_description_block && block_length >= 20 )
+        {
+            Interface interface;
+            interface.m_swap = swap;
+            interface.m_link_type = get16( block + 8, swap );
+            interface.m_ticks_per_second = 1000000;
+
+            /* Options run from after the snaplen to the trailing block length */
+            size_t opt = 16;
+            while ( opt + 4 <= block_length - 4 )
+            {
+                uint16_t code = get16( block + opt, swap );
+                uint16_t len = get16( block + opt + 2, swap );
+                if ( code == 0 || opt + 4 + len > block_length - 4 )
+                {
+                    break;
+                }
+                if ( code == pcapng_option_if_tsresol && len >= 1 )
+                {
+                    uint8_t resolution = block[opt + 4];
+                    uint64_t ticks = 1;
+                    for ( uint8_t i = 0; i < ( resolution & 0x7f ) && ticks <= 1000000000000ULL; ++i )
+                    {
+                        ticks *= ( resolution & 0x80 ) ? 2 : 10;
+                    }
+                    interface.m_ticks_per_second = ticks;
+                }
+                opt += 4 + ( ( len + 3 ) & ~3 );
+            }
+            m_interfaces.push_back( interface );
+        }
+        else if ( ( block_type == pcapng_enhanced_packet_block || block_type == pcapng_packet_block )
+                  && block_length >= pcapng_packet_data_offset + 4 )
+        {
+            size_t interface_number = section_first_interface
+                                      + ( block_type == pcapng_enhanced_packet_block ? get32( block + 8, swap )
+                                                                                     : get16( block + 8, swap ) );
+            uint32_t captured_length = get32( block + 20, swap );
+            if ( interface_number < m_interfaces.size()
+                 && captured_length <= block_length - pcapng_packet_data_offset - 4 )
+            {
+                addPacket( pos, interface_number );
+            }
+        }
+        pos += block_length;
+    }
+}
+
+void PcapMappedReader::addPacket( uint64_t offset, size_t interface_number )
+{
+    m_index.push_back( offset | ( uint64_t( interface_number ) << 48 ) );
+}
+
+uint64_t PcapMappedReader::getRecord( size_t packet_number, Interface const **interface, uint32_t *captured_length ) const
+{
+    uint64_t entry = m_index[packet_number];
+    uint64_t offset = entry & offset_mask;
+    *interface = &m_interfaces[size_t( entry >> 48 )];
+
+    if ( m_format == FORMAT_PCAP )
+    {
+        *captured_length = get32( m_data + offset + offsetof( pcaprec_hdr_t, incl_len ), ( *interface )->m_swap );
+        offset += sizeof( pcaprec_hdr_t );
+    }
+    else
+    {
+        *captured_length = get32( m_data + offset + 20, ( *interface )->m_swap );
+        offset += pcapng_packet_data_offset;
+    }
+    return offset;
+}
+
+uint64_t PcapMappedReader::getTicks( size_t packet_number ) const
+{
+    uint64_t entry = m_index[packet_number];
+    uint8_t const *record = m_data + ( entry & offset_mask );
+    bool swap = m_interfaces[size_t( entry >> 48 )].m_swap;
+    uint64_t ticks;
+
+    if ( m_format == FORMAT_PCAP )
+    {
+        ticks = uint64_t( get32( record, swap ) ) * m_interfaces[0].m_ticks_per_second + get32( record + 4, swap );
+    }
+    else
+    {
+        ticks = ( uint64_t( get32( record + 12, swap ) ) << 32 ) | get32( record + 16, swap );
+    }
+    return ticks;
+}
+
+uint64_t PcapMappedReader::ticksToMicroseconds( uint64_t ticks, Interface const &interface ) const
+{
+    uint64_t tps = interface.m_ticks_per_second;
+    return tps == 1000000 ? ticks : ( ticks / tps ) * 1000000 + ( ticks % tps ) * 1000000 / tps;
+}
+
+uint64_t PcapMappedReader::getTimestamp( size_t packet_number ) const
+{
+    uint64_t entry = m_index[packet_number];
+    uint64_t t = ticksToMicroseconds( getTicks( packet_number ), m_interfaces[size_t( entry >> 48 )] );
+    return t > m_first_timestamp_in_microseconds ? t - m_first_timestamp_in_microseconds : 0;
+}
+
+uint16_t PcapMappedReader::getLinkType( size_t packet_number ) const
+{
+    return m_interfaces[size_t( m_index[packet_number] >> 48 )].m_link_type;
+}
+
+uint8_t *PcapMappedReader::getPacket( size_t packet_number, uint32_t *captured_length ) const
+{
+    Interface const *interface;
+    return m_data + getRecord( packet_number, &interface, captured_length );
+}
+
+Frame PcapMappedReader::getFrame( size_t packet_number ) const
+{
+    uint32_t captured_length;
+    uint8_t *data = getPacket( packet_number, &captured_length );
+    uint16_t len = uint16_t( std::min<uint32_t>( captured_length, 0xffff ) );
+    Frame frame( getTimestamp( packet_number ) / 1000, data, len );
+    frame.setLength( len );
+    return frame;
+}
+
+size_t PcapMappedReader::seekToTime( uint64_t timestamp_in_microseconds )
+{
+    size_t first = 0;
+    size_t count = m_index.size();
+
+    while ( count > 0 )
+    {
+        size_t step = count / 2;
+        if ( getTimestamp( first + step ) < timestamp_in_microseconds )
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    m_position = first;
+    return first;
+}
+
+bool PcapMappedReader::readPacket( uint64_t *timestamp_in_microseconds, uint8_t **data, uint32_t *captured_length )
+{
+    bool r = false;
+    if ( m_position < m_index.size() )
+    {
+        *timestamp_in_microseconds = getTimestamp( m_position );
+        *data = getPacket( m_position, captured_length );
+        ++m_position;
+        r = true;
+    }
+    return r;
+}
+}
+
+#else
+const char *jdksavdeccmcu_pcapmappedreader_file = __FILE__;
+
+#endif
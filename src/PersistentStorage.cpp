@@ -0,0 +1,123 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/PersistentStorage.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+uint8_t PersistentStorage::crc8( uint8_t const *p, uint16_t len )
+{
+    uint8_t crc = 0xff;
+    for ( uint16_t i = 0; i < len; ++i )
+    {
+        crc ^= p[i];
+        for ( int bit = 0; bit < 8; ++bit )
+        {
+            crc = ( crc & 0x80 ) ? uint8_t( ( crc << 1 ) ^ 0x07 ) : uint8_t( crc << 1 );
+        }
+    }
+    return crc;
+}
+}
+
+#if JDKSAVDECCMCU_ENABLE_STRING
+#include <stdexcept>
+
+namespace JDKSAvdeccMCU
+{
+
+PersistentStorageFile::PersistentStorageFile( std::string const &filename, uint32_t size )
+    : m_f( 0 ), m_filename( filename ), m_size( size )
+{
+#if defined( _WIN32 )
+    fopen_s( &m_f, filename.c_str(), "r+b" );
+    if ( !m_f )
+    {
+        fopen_s( &m_f, filename.c_str(), "w+b" );
+    }
+#else
+    m_f = fopen( filename.c_str(), "r+b" );
+    if ( !m_f )
+    {
+        m_f = fopen( filename.c_str(), "w+b" );
+    }
+#endif
+    if ( !m_f )
+    {
+        throw std::runtime_error( std::string( "Error opening storage file: " ) + filename );
+    }
+}
+
+PersistentStorageFile::~PersistentStorageFile()
+{
+    if ( m_f )
+    {
+        fclose( m_f );
+        m_f = 0;
+    }
+}
+
+bool PersistentStorageFile::read( uint32_t offset, uint8_t *buf, uint16_t len )
+{
+    if ( uint64_t( offset ) + len > m_size )
+    {
+        return false;
+    }
+
+    size_t got = 0;
+    if ( fseek( m_f, long( offset ), SEEK_SET ) == 0 )
+    {
+        got = fread( buf, 1, len, m_f );
+    }
+
+    // Anything not yet written reads as zero
+    memset( buf + got, 0, len - got );
+    return true;
+}
+
+bool PersistentStorageFile::write( uint32_t offset, uint8_t const *buf, uint16_t len )
+{
+    if ( uint64_t( offset ) + len > m_size )
+    {
+        return false;
+    }
+    if ( fseek( m_f, long( offset ), SEEK_SET ) != 0 )
+    {
+        return false;
+    }
+    return fwrite( buf, 1, len, m_f ) == len;
+}
+
+bool PersistentStorageFile::flush() { return fflush( m_f ) == 0; }
+}
+#endif
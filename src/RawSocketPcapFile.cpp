@@ -31,12 +31,33 @@
 
 #include "JDKSAvdeccMCU/World.hpp"
 #include "JDKSAvdeccMCU/RawSocketPcapFile.hpp"
+#include "JDKSAvdeccMCU/HandlerGroup.hpp"
 
 #if JDKSAVDECCMCU_ENABLE_RAWSOCKETPCAPFILE && JDKSAVDECCMCU_ENABLE_PCAPFILE
 
 namespace JDKSAvdeccMCU
 {
 
+#if JDKSAVDECCMCU_ENABLE_MMAP
+/// A missing input file, or one shorter than a pcap header like a
+/// capture that is still being written, is an empty input
+static PcapMappedReader *openInput( std::string const &filename )
+{
+    PcapMappedReader *r = 0;
+    FILE *f = fopen( filename.c_str(), "rb" );
+    if ( f )
+    {
+        bool has_header = fseek( f, 0, SEEK_END ) == 0 && ftell( f ) >= long( sizeof( pcap_hdr_t ) );
+        fclose( f );
+        if ( has_header )
+        {
+            r = new PcapMappedReader( filename );
+        }
+    }
+    return r;
+}
+#endif
+
 RawSocketPcapFile::RawSocketPcapFile( uint16_t ethertype,
                                       Eui48 my_mac,
                                       Eui48 default_dest_mac,
@@ -48,10 +69,17 @@ RawSocketPcapFile::RawSocketPcapFile( uint16_t ethertype,
     , m_my_mac( my_mac )
     , m_default_dest_mac( default_dest_mac )
     , m_join_multicast( join_multicast )
+#if JDKSAVDECCMCU_ENABLE_MMAP
+    , m_pcap_file_reader( openInput( input_file ) )
+#else
     , m_pcap_file_reader( input_file )
+#endif
     , m_pcap_file_writer( output_file )
     , m_current_time( 0 )
     , m_time_granularity_in_ms( time_granularity_in_ms )
+    , m_event_driven( false )
+    , m_replayed_count( 0 )
+    , m_handler_group( 0 )
 {
     if ( readNextIncomingFrame() )
     {
@@ -59,17 +87,26 @@ RawSocketPcapFile::RawSocketPcapFile( uint16_t ethertype,
     }
 }
 
-RawSocketPcapFile::~RawSocketPcapFile() {}
+RawSocketPcapFile::~RawSocketPcapFile()
+{
+#if JDKSAVDECCMCU_ENABLE_MMAP
+    delete m_pcap_file_reader;
+#endif
+}
 
 jdksavdecc_timestamp_in_milliseconds RawSocketPcapFile::getTimeInMilliseconds() const
 {
     jdksavdecc_timestamp_in_milliseconds t = m_current_time;
-    m_current_time += m_time_granularity_in_ms;
-    if ( m_next_incoming_frame.getLength() > 0 )
+    // When replaying, only replayStep() moves the clock
+    if ( !m_event_driven )
     {
-        if ( m_current_time >= m_next_incoming_frame.getTimeInMilliseconds() )
+        m_current_time += m_time_granularity_in_ms;
+        if ( m_next_incoming_frame.getLength() > 0 )
         {
-            m_current_time = m_next_incoming_frame.getTimeInMilliseconds();
+            if ( m_current_time >= m_next_incoming_frame.getTimeInMilliseconds() )
+            {
+                m_current_time = m_next_incoming_frame.getTimeInMilliseconds();
+            }
         }
     }
     return t;
@@ -94,70 +131,46 @@ bool RawSocketPcapFile::recvFrame( Frame *frame )
 bool RawSocketPcapFile::sendFrame( const Frame &frame, const uint8_t *data1, uint16_t len1, const uint8_t *data2, uint16_t len2 )
 {
     Eui48 da = frame.getDA();
-    Eui48 sa = m_my_mac;
     if ( isUnset( da ) )
     {
         da = m_default_dest_mac;
     }
-    PcapFilePacket packet;
-    packet.reserve( frame.getLength() + len1 + len2 - JDKSAVDECC_FRAME_HEADER_LEN );
-    for ( size_t i = JDKSAVDECC_FRAME_HEADER_LEN; i < frame.getLength(); ++i )
-    {
-        packet.push_back( frame.getOctet( i ) );
-    }
-    if ( data1 )
-    {
-        for ( size_t i = 0; i < len1; ++i )
-        {
-            packet.push_back( data1[i] );
-        }
-    }
-    if ( data2 )
-    {
-        for ( size_t i = 0; i < len1; ++i )
-        {
-            packet.push_back( data2[i] );
-        }
-    }
-
-    m_pcap_file_writer.WritePacket( m_current_time * 1000, da.value, sa.value, m_ethertype, packet );
+    writeFrame( da, frame, data1, len1, data2, len2 );
+    countTxFrame( frame, len1, len2, &da );
     return true;
 }
 
 bool RawSocketPcapFile::sendReplyFrame( Frame &frame, const uint8_t *data1, uint16_t len1, const uint8_t *data2, uint16_t len2 )
 {
     Eui48 da = frame.getSA();
-    Eui48 sa = m_my_mac;
     if ( da.value[0] & 0x1 )
     {
         // squash multicast
         da.value[0] &= 0xfe;
     }
-    PcapFilePacket packet;
-    packet.resize( frame.getLength() + len1 + len2 - JDKSAVDECC_FRAME_HEADER_LEN );
-    for ( size_t i = JDKSAVDECC_FRAME_HEADER_LEN; i < frame.getLength(); ++i )
-    {
-        packet.push_back( frame.getOctet( i ) );
-    }
-    if ( data1 )
-    {
-        for ( size_t i = 0; i < len1; ++i )
-        {
-            packet.push_back( data1[i] );
-        }
-    }
-    if ( data2 )
-    {
-        for ( size_t i = 0; i < len1; ++i )
-        {
-            packet.push_back( data2[i] );
-        }
-    }
-
-    m_pcap_file_writer.WritePacket( m_current_time * 1000, da.value, sa.value, m_ethertype, packet );
+    writeFrame( da, frame, data1, len1, data2, len2 );
+    countTxFrame( frame, len1, len2, &da );
     return true;
 }
 
+void RawSocketPcapFile::writeFrame(
+    Eui48 const &da, Frame const &frame, const uint8_t *data1, uint16_t len1, const uint8_t *data2, uint16_t len2 )
+{
+    uint8_t header[JDKSAVDECC_FRAME_HEADER_LEN];
+    memcpy( &header[JDKSAVDECC_FRAME_HEADER_DA_OFFSET], da.value, 6 );
+    memcpy( &header[JDKSAVDECC_FRAME_HEADER_SA_OFFSET], m_my_mac.value, 6 );
+    jdksavdecc_uint16_set( m_ethertype, header, JDKSAVDECC_FRAME_HEADER_ETHERTYPE_OFFSET );
+
+    // The frame's payload and the additional data are written straight into the capture buffer
+    uint8_t const *parts[4] = {header, frame.getBuf() + JDKSAVDECC_FRAME_HEADER_LEN, data1, data2};
+    size_t lengths[4] = {sizeof( header ),
+                         size_t( std::max( frame.getLength(), uint16_t( JDKSAVDECC_FRAME_HEADER_LEN ) ) )
+                             - JDKSAVDECC_FRAME_HEADER_LEN,
+                         size_t( data1 ? len1 : 0 ),
+                         size_t( data2 ? len2 : 0 )};
+    m_pcap_file_writer.WritePacketParts( uint64_t( m_current_time ) * 1000000, 0, parts, lengths, 4 );
+}
+
 bool RawSocketPcapFile::joinMulticast( const Eui48 &multicast_mac )
 {
     m_join_multicast = multicast_mac;
@@ -171,34 +184,94 @@ bool RawSocketPcapFile::readNextIncomingFrame()
 {
     bool r = false;
     uint64_t timestamp_in_microseconds = 0;
-    PcapFilePacket frame_data;
-    // try read the pcap file
-    if ( m_pcap_file_reader.ReadPacket( &timestamp_in_microseconds, frame_data ) )
+    uint8_t const *data;
+    size_t len;
+    m_next_incoming_frame.setLength( 0 );
+
+    // Skip the frames that do not fit or are not of our ethertype
+    while ( !r && readPacket( &timestamp_in_microseconds, &data, &len ) )
     {
-        // we got a frame fromt he file, does it fit?
-        if ( frame_data.size() <= m_next_incoming_frame.getMaxLength() )
+        if ( len >= JDKSAVDECC_FRAME_HEADER_LEN && len <= m_next_incoming_frame.getMaxLength()
+             && jdksavdecc_uint16_get( data, JDKSAVDECC_FRAME_HEADER_ETHERTYPE_OFFSET ) == m_ethertype )
         {
-            // yes, so copy the frame into the next incoming frame buffer and
-            // track the time
             m_next_incoming_frame.setTimeInMilliseconds( timestamp_in_microseconds / 1000 );
-            memcpy( m_next_incoming_frame.getBuf(), &frame_data[0], m_next_incoming_frame.getMaxLength() );
+            memcpy( m_next_incoming_frame.getBuf(), data, len );
+            m_next_incoming_frame.setLength( uint16_t( len ) );
+            r = true;
+        }
+    }
+    return r;
+}
 
-            // make sure it is an ethertype that we care about
-            if ( m_next_incoming_frame.getEtherType() == m_ethertype )
-            {
-                m_next_incoming_frame.setLength( frame_data.size() );
+bool RawSocketPcapFile::readPacket( uint64_t *timestamp_in_microseconds, uint8_t const **data, size_t *len )
+{
+    bool r = false;
+#if JDKSAVDECCMCU_ENABLE_MMAP
+    uint8_t *packet;
+    uint32_t captured_length;
+    if ( m_pcap_file_reader && m_pcap_file_reader->readPacket( timestamp_in_microseconds, &packet, &captured_length ) )
+    {
+        // The times of PcapMappedReader count from the first packet, PcapFileReader gives them since the epoch
+        *timestamp_in_microseconds += m_pcap_file_reader->getFirstTimestamp();
+        *data = packet;
+        *len = captured_length;
+        r = true;
+    }
+#else
+    if ( m_pcap_file_reader.ReadPacket( timestamp_in_microseconds, m_next_incoming_packet ) )
+    {
+        *data = m_next_incoming_packet.empty() ? 0 : &m_next_incoming_packet[0];
+        *len = m_next_incoming_packet.size();
+        r = true;
+    }
+#endif
+    return r;
+}
 
-                r = true;
-            }
-            else
-            {
-                // it isn't a packet we care about, so drop it
-                m_next_incoming_frame.setLength( 0 );
-            }
+bool RawSocketPcapFile::replayStep( jdksavdecc_timestamp_in_milliseconds end_time )
+{
+    bool r = false;
+    m_event_driven = true;
+
+    if ( m_handler_group && m_current_time <= end_time )
+    {
+        // Frames with the same timestamp are delivered together, then the handlers are ticked once
+        while ( m_next_incoming_frame.getLength() > 0 && m_next_incoming_frame.getTimeInMilliseconds() <= m_current_time )
+        {
+            m_handler_group->receivedPDU( this, m_next_incoming_frame );
+            ++m_replayed_count;
+            readNextIncomingFrame();
+        }
+        m_handler_group->tick( m_current_time );
+
+        bool have_frame = m_next_incoming_frame.getLength() > 0;
+        jdksavdecc_timestamp_in_milliseconds next = m_handler_group->nextTickTime( m_current_time );
+        if ( have_frame && m_next_incoming_frame.getTimeInMilliseconds() < next )
+        {
+            next = m_next_incoming_frame.getTimeInMilliseconds();
+        }
+        if ( next <= m_current_time )
+        {
+            next = m_current_time + 1;
+        }
+
+        if ( next <= end_time && ( have_frame || end_time != ~jdksavdecc_timestamp_in_milliseconds( 0 ) ) )
+        {
+            m_current_time = next;
+            r = true;
         }
     }
     return r;
 }
+
+uint64_t RawSocketPcapFile::replay( jdksavdecc_timestamp_in_milliseconds end_time )
+{
+    uint64_t first = m_replayed_count;
+    while ( replayStep( end_time ) )
+    {
+    }
+    return m_replayed_count - first;
+}
 }
 
 #else
@@ -0,0 +1,149 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/RawSocketVirtual.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+RawSocketVirtual::RawSocketVirtual( VirtualNetwork &network,
+                                    uint16_t ethertype,
+                                    Eui48 const &mac_address,
+                                    Eui48 const *multicast_to_join )
+    : m_network( network )
+    , m_ethertype( ethertype )
+    , m_mac_address( mac_address )
+    , m_default_dest_mac_address( jdksavdecc_multicast_adp_acmp )
+    , m_handler_group( 0 )
+    , m_port( 0 )
+    , m_sent_count( 0 )
+    , m_received_count( 0 )
+{
+    m_port = m_network.attach( this );
+    if ( multicast_to_join )
+    {
+        m_default_dest_mac_address = *multicast_to_join;
+        joinMulticast( *multicast_to_join );
+    }
+}
+
+RawSocketVirtual::~RawSocketVirtual() { m_network.detach( this ); }
+
+bool RawSocketVirtual::recvFrame( Frame *frame )
+{
+    bool r = false;
+
+    if ( !m_queue.empty() )
+    {
+        VirtualNetwork::Packet const &packet = m_network.m_packets[m_queue.front()];
+        if ( packet.m_length <= frame->getMaxLength() )
+        {
+            memcpy( frame->getBuf(), packet.m_data, packet.m_length );
+            frame->setLength( packet.m_length );
+            frame->setTimeInMilliseconds( m_network.getTimeInMilliseconds() );
+            r = true;
+        }
+        m_network.releasePacket( m_queue.front() );
+        m_queue.pop_front();
+    }
+    return r;
+}
+
+bool RawSocketVirtual::sendFrame( Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 )
+{
+    Eui48 da = frame.getDA();
+    if ( isUnset( da ) )
+    {
+        da = m_default_dest_mac_address;
+    }
+    return send( frame, da, data1, len1, data2, len2 );
+}
+
+bool RawSocketVirtual::sendReplyFrame( Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 )
+{
+    Eui48 da = frame.getSA();
+
+    // make sure it was not a multicast
+    da.value[0] &= 0xfe;
+    return send( frame, da, data1, len1, data2, len2 );
+}
+
+bool RawSocketVirtual::joinMulticast( const Eui48 &multicast_mac )
+{
+    m_network.join( this, multicast_mac );
+    return true;
+}
+
+bool RawSocketVirtual::send(
+    Frame const &frame, Eui48 const &da, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 )
+{
+    uint8_t buffer[1500 + JDKSAVDECC_FRAME_HEADER_LEN];
+    uint16_t length = frame.getLength();
+
+    if ( length < JDKSAVDECC_FRAME_HEADER_LEN || size_t( length ) + len1 + len2 > sizeof( buffer ) )
+    {
+        return false;
+    }
+
+    memcpy( buffer, frame.getBuf(), length );
+    if ( data1 && len1 )
+    {
+        memcpy( &buffer[length], data1, len1 );
+        length += len1;
+    }
+    if ( data2 && len2 )
+    {
+        memcpy( &buffer[length], data2, len2 );
+        length += len2;
+    }
+
+    memcpy( &buffer[JDKSAVDECC_FRAME_HEADER_DA_OFFSET], da.value, 6 );
+    memcpy( &buffer[JDKSAVDECC_FRAME_HEADER_SA_OFFSET], m_mac_address.value, 6 );
+    buffer[JDKSAVDECC_FRAME_HEADER_ETHERTYPE_OFFSET] = uint8_t( m_ethertype >> 8 );
+    buffer[JDKSAVDECC_FRAME_HEADER_ETHERTYPE_OFFSET + 1] = uint8_t( m_ethertype );
+
+    // pad the buffer with zeros to fill in the minimum payload size
+    if ( length < JDKSAVDECCMCU_RAWSOCKET_MIN_FRAME_LENGTH )
+    {
+        memset( &buffer[length], 0, JDKSAVDECCMCU_RAWSOCKET_MIN_FRAME_LENGTH - length );
+        length = JDKSAVDECCMCU_RAWSOCKET_MIN_FRAME_LENGTH;
+    }
+
+    bool r = m_network.send( this, buffer, length );
+    if ( r )
+    {
+        ++m_sent_count;
+        countTxFrame( frame, data1 ? len1 : 0, data2 ? len2 : 0, &da );
+    }
+    return r;
+}
+}
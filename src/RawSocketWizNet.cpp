@@ -189,6 +189,10 @@ bool RawSocketWizNet::sendFrame( Frame const &frame, uint8_t const *data1, uint1
 
         W5100.writeSnIR( 0, SnIR::SEND_OK );
     }
+    if ( done )
+    {
+        countTxFrame( frame, data1 ? len1 : 0, data2 ? len2 : 0 );
+    }
     return done;
 }
 
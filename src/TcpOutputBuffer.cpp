@@ -0,0 +1,221 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/TcpOutputBuffer.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+TcpOutputBuffer::TcpOutputBuffer( ApsSharedMessagePool &pool, Settings const &settings )
+    : m_pool( pool )
+    , m_settings( settings )
+    , m_queued_bytes( 0 )
+    , m_copy_buffer_count( 0 )
+    , m_backpressured( false )
+    , m_backpressured_since( 0 )
+    , m_total_queued_bytes( 0 )
+    , m_total_written_bytes( 0 )
+    , m_max_queued_bytes( 0 )
+    , m_write_count( 0 )
+    , m_backpressure_count( 0 )
+    , m_copy_failure_count( 0 )
+    , m_flush_latency_count( 0 )
+    , m_flush_latency_max( 0 )
+    , m_flush_latency_sum( 0 )
+{
+}
+
+TcpOutputBuffer::~TcpOutputBuffer() { clear(); }
+
+void TcpOutputBuffer::clear()
+{
+    while ( !m_entries.empty() )
+    {
+        m_entries.front().m_msg->release();
+        m_entries.pop_front();
+    }
+    m_queued_bytes = 0;
+    m_copy_buffer_count = 0;
+    m_backpressured = false;
+}
+
+bool TcpOutputBuffer::append( const uint8_t *data, size_t len, jdksavdecc_timestamp_in_milliseconds now )
+{
+    while ( len > 0 )
+    {
+        // Coalesce into our own buffer at the tail if there is room
+        if ( m_entries.empty() || !m_entries.back().m_private
+             || m_entries.back().m_msg->getLength() == m_entries.back().m_msg->getCapacity() )
+        {
+            ApsSharedMessage *msg = 0;
+            if ( m_settings.m_max_copy_buffers == 0 || m_copy_buffer_count < m_settings.m_max_copy_buffers )
+            {
+                msg = m_pool.allocate();
+            }
+            if ( !msg )
+            {
+                ++m_copy_failure_count;
+                return false;
+            }
+            Entry e;
+            e.m_msg = msg;
+            e.m_offset = 0;
+            e.m_private = true;
+            e.m_queued_time = now;
+            m_entries.push_back( e );
+            ++m_copy_buffer_count;
+        }
+
+        ApsSharedMessage *tail = m_entries.back().m_msg;
+        uint16_t chunk = uint16_t( std::min<size_t>( len, tail->getCapacity() - tail->getLength() ) );
+        tail->append( data, chunk );
+        data += chunk;
+        len -= chunk;
+        m_queued_bytes += chunk;
+        m_total_queued_bytes += chunk;
+    }
+    updateBackpressure( now );
+    return true;
+}
+
+void TcpOutputBuffer::append( ApsSharedMessage *msg, jdksavdecc_timestamp_in_milliseconds now )
+{
+    Entry e;
+    msg->addRef();
+    e.m_msg = msg;
+    e.m_offset = 0;
+    e.m_private = false;
+    e.m_queued_time = now;
+    m_entries.push_back( e );
+    m_queued_bytes += msg->getLength();
+    m_total_queued_bytes += msg->getLength();
+    updateBackpressure( now );
+}
+
+bool TcpOutputBuffer::shouldFlush( jdksavdecc_timestamp_in_milliseconds now ) const
+{
+    return getFlushDelay( now ) == 0;
+}
+
+int32_t TcpOutputBuffer::getFlushDelay( jdksavdecc_timestamp_in_milliseconds now ) const
+{
+    if ( m_entries.empty() )
+    {
+        return -1;
+    }
+    if ( m_queued_bytes >= m_settings.m_coalesce_bytes )
+    {
+        return 0;
+    }
+
+    jdksavdecc_timestamp_in_milliseconds waited = now - m_entries.front().m_queued_time;
+    if ( waited >= m_settings.m_latency_budget_ms )
+    {
+        return 0;
+    }
+    return int32_t( m_settings.m_latency_budget_ms - waited );
+}
+
+size_t TcpOutputBuffer::gather( Segment *segments, size_t max_segments ) const
+{
+    size_t n = 0;
+    for ( std::deque<Entry>::const_iterator i = m_entries.begin(); i != m_entries.end() && n < max_segments; ++i )
+    {
+        segments[n].m_data = i->m_msg->getData() + i->m_offset;
+        segments[n].m_length = i->m_msg->getLength() - i->m_offset;
+        ++n;
+    }
+    return n;
+}
+
+void TcpOutputBuffer::consume( size_t len, jdksavdecc_timestamp_in_milliseconds now )
+{
+    ++m_write_count;
+    m_total_written_bytes += len;
+
+    while ( len > 0 && !m_entries.empty() )
+    {
+        Entry &e = m_entries.front();
+        size_t remaining = e.m_msg->getLength() - e.m_offset;
+
+        if ( len < remaining )
+        {
+            e.m_offset = uint16_t( e.m_offset + len );
+            m_queued_bytes -= len;
+            break;
+        }
+
+        uint32_t latency = uint32_t( now - e.m_queued_time );
+        ++m_flush_latency_count;
+        m_flush_latency_sum += latency;
+        if ( latency > m_flush_latency_max )
+        {
+            m_flush_latency_max = latency;
+        }
+
+        len -= remaining;
+        m_queued_bytes -= remaining;
+        if ( e.m_private )
+        {
+            --m_copy_buffer_count;
+        }
+        e.m_msg->release();
+        m_entries.pop_front();
+    }
+    updateBackpressure( now );
+}
+
+bool TcpOutputBuffer::isSlowConsumer( jdksavdecc_timestamp_in_milliseconds now ) const
+{
+    return m_backpressured && m_settings.m_slow_consumer_timeout_ms != 0
+           && ( now - m_backpressured_since ) >= m_settings.m_slow_consumer_timeout_ms;
+}
+
+void TcpOutputBuffer::updateBackpressure( jdksavdecc_timestamp_in_milliseconds now )
+{
+    if ( m_queued_bytes > m_max_queued_bytes )
+    {
+        m_max_queued_bytes = m_queued_bytes;
+    }
+
+    if ( !m_backpressured && m_queued_bytes > m_settings.m_high_watermark )
+    {
+        m_backpressured = true;
+        m_backpressured_since = now;
+        ++m_backpressure_count;
+    }
+    else if ( m_backpressured && m_queued_bytes <= m_settings.m_low_watermark )
+    {
+        m_backpressured = false;
+    }
+}
+}
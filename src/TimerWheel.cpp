@@ -0,0 +1,225 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/TimerWheel.hpp"
+
+namespace JDKSAvdeccMCU
+{
+
+Timer::~Timer() { cancel(); }
+
+void Timer::cancel()
+{
+    if ( m_wheel )
+    {
+        m_wheel->cancel( this );
+    }
+}
+
+TimerWheel::TimerWheel( Timer **slots, uint16_t slot_count, uint32_t resolution_ms )
+    : m_slots( slots )
+    , m_slot_count( slot_count ? slot_count : 1 )
+    , m_resolution( resolution_ms ? resolution_ms : 1 )
+    , m_now( 0 )
+    , m_tick( 0 )
+    , m_count( 0 )
+    , m_serial( 0 )
+{
+    for ( uint16_t i = 0; i < m_slot_count; ++i )
+    {
+        m_slots[i] = 0;
+    }
+}
+
+TimerWheel::~TimerWheel() { cancelAll(); }
+
+void TimerWheel::schedule( Timer *timer, jdksavdecc_timestamp_in_milliseconds expiry )
+{
+    if ( timer->m_wheel )
+    {
+        timer->m_wheel->unlink( timer );
+    }
+    timer->m_expiry = expiry;
+    link( timer );
+}
+
+void TimerWheel::cancel( Timer *timer )
+{
+    if ( timer->m_wheel == this )
+    {
+        unlink( timer );
+    }
+}
+
+void TimerWheel::cancelAll()
+{
+    for ( uint16_t i = 0; i < m_slot_count; ++i )
+    {
+        while ( m_slots[i] )
+        {
+            unlink( m_slots[i] );
+        }
+    }
+}
+
+void TimerWheel::link( Timer *timer )
+{
+    uint64_t tick = timer->m_expiry / m_resolution;
+
+    // Ticks that have fully passed are not visited again
+    if ( tick <= m_tick )
+    {
+        tick = m_tick + 1;
+    }
+
+    Timer **head = &m_slots[getSlot( tick )];
+    timer->m_next = *head;
+    timer->m_pprev = head;
+    if ( *head )
+    {
+        ( *head )->m_pprev = &timer->m_next;
+    }
+    *head = timer;
+    timer->m_wheel = this;
+    timer->m_serial = m_serial++;
+    ++m_count;
+}
+
+void TimerWheel::unlink( Timer *timer )
+{
+    *timer->m_pprev = timer->m_next;
+    if ( timer->m_next )
+    {
+        timer->m_next->m_pprev = timer->m_pprev;
+    }
+    timer->m_next = 0;
+    timer->m_pprev = 0;
+    timer->m_wheel = 0;
+    --m_count;
+}
+
+uint32_t TimerWheel::advance( jdksavdecc_timestamp_in_milliseconds now )
+{
+    uint64_t target = now / m_resolution;
+    uint32_t fired = 0;
+
+    if ( now > m_now )
+    {
+        m_now = now;
+    }
+
+    // Visit the slots from the first tick that has not fully passed up
+    // to the current one. The current tick may still hold timers that
+    // expire later in it, so it is only marked passed once time has
+    // moved beyond it and is visited again by the next advance(). The
+    // first slot also holds the timers that were scheduled after their
+    // expiry time. Visiting every slot once covers any jump in time
+    uint64_t first = m_tick + 1;
+    uint64_t steps = target > m_tick ? target - m_tick : 1;
+    if ( steps > m_slot_count )
+    {
+        steps = m_slot_count;
+    }
+    if ( target > m_tick + 1 )
+    {
+        m_tick = target - 1;
+    }
+
+    // Timers that the callbacks schedule are left for the next advance()
+    uint32_t serial = m_serial;
+
+    for ( uint64_t i = 0; i < steps; ++i )
+    {
+        Timer **head = &m_slots[getSlot( first + i )];
+        Timer *t = *head;
+
+        while ( t )
+        {
+            if ( t->m_expiry <= now && int32_t( t->m_serial - serial ) < 0 )
+            {
+                unlink( t );
+                ++fired;
+                t->onTimerExpired( now );
+
+                // The callback may have changed the slot, start over
+                t = *head;
+            }
+            else
+            {
+                t = t->m_next;
+            }
+        }
+    }
+    return fired;
+}
+
+int32_t TimerWheel::getNextDelay( jdksavdecc_timestamp_in_milliseconds now ) const
+{
+    if ( m_count == 0 )
+    {
+        return -1;
+    }
+
+    for ( uint64_t tick = m_tick + 1; tick <= m_tick + m_slot_count; ++tick )
+    {
+        jdksavdecc_timestamp_in_milliseconds start = tick * m_resolution;
+        jdksavdecc_timestamp_in_milliseconds due = 0;
+        bool found = false;
+
+        for ( Timer const *t = m_slots[getSlot( tick )]; t; t = t->m_next )
+        {
+            // Timers from later revolutions share the slot. The slot of
+            // the first tick is visited by every advance(), the later
+            // ones only hold timers that expire within their tick
+            if ( t->m_expiry / m_resolution <= tick )
+            {
+                jdksavdecc_timestamp_in_milliseconds when = t->m_expiry > now ? t->m_expiry : now;
+                if ( !found || when < due )
+                {
+                    due = when;
+                    found = true;
+                }
+            }
+        }
+
+        if ( found || tick == m_tick + m_slot_count )
+        {
+            if ( !found )
+            {
+                due = start;
+            }
+            return due > now ? int32_t( due - now ) : 0;
+        }
+    }
+    return 0;
+}
+}
@@ -0,0 +1,493 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/Trace.hpp"
+#include "JDKSAvdeccMCU/Frame.hpp"
+#include "JDKSAvdeccMCU/RawSocket.hpp"
+
+#if JDKSAVDECCMCU_ENABLE_TRACE
+
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+
+namespace JDKSAvdeccMCU
+{
+
+namespace
+{
+
+static_assert( ( JDKSAVDECCMCU_TRACE_BUFFER_EVENTS & ( JDKSAVDECCMCU_TRACE_BUFFER_EVENTS - 1 ) ) == 0,
+               "JDKSAVDECCMCU_TRACE_BUFFER_EVENTS must be a power of two" );
+static_assert( sizeof( TraceEvent ) == 40, "TraceEvent must have no padding" );
+
+char const *const trace_event_type_names[TRACE_EVENT_TYPE_COUNT] = {"NONE",
+                                                                     "FRAME_RX",
+                                                                     "FRAME_TX",
+                                                                     "AEM_COMMAND_ACCEPTED",
+                                                                     "AEM_COMMAND_REJECTED",
+                                                                     "ENTITY_ACQUIRED",
+                                                                     "ENTITY_RELEASED",
+                                                                     "ENTITY_ACQUIRE_IN_PROGRESS",
+                                                                     "ENTITY_ACQUIRE_TRANSFERRED",
+                                                                     "ENTITY_ACQUIRE_CANCELLED",
+                                                                     "ENTITY_LOCK_TIMED_OUT",
+                                                                     "ACMP_LISTENER_STATE",
+                                                                     "ACMP_TALKER_STATE",
+                                                                     "ACMP_CONTROLLER_STATE",
+                                                                     "APS_STATE",
+                                                                     "APC_STATE"};
+
+char const *const trace_aps_state_names[TRACE_APS_STATE_COUNT] = {"INITIALIZE",
+                                                                   "WAIT_FOR_CONNECT",
+                                                                   "ACCEPT",
+                                                                   "REJECT",
+                                                                   "CLOSED",
+                                                                   "START_TRANSFER",
+                                                                   "WAITING",
+                                                                   "LINK_STATUS",
+                                                                   "TRANSFER_TO_L2",
+                                                                   "TRANSFER_TO_APC",
+                                                                   "ASSIGN_ENTITY_ID",
+                                                                   "SEND_NOP",
+                                                                   "CLOSE_AND_FINISH",
+                                                                   "FINISH"};
+
+char const *const trace_apc_state_names[TRACE_APC_STATE_COUNT] = {"INITIALIZE",
+                                                                   "WAIT_FOR_CONNECT",
+                                                                   "CONNECTED",
+                                                                   "START_TRANSFER",
+                                                                   "WAITING",
+                                                                   "CLOSED",
+                                                                   "LINK_STATUS",
+                                                                   "RECEIVE_MSG",
+                                                                   "SEND_MSG",
+                                                                   "ENTITY_ID_ASSIGNED",
+                                                                   "SEND_NOP",
+                                                                   "FINISH"};
+
+///
+/// One event in a ring, a seqlock over the plain payload: m_sequence is
+/// 0 while the writer changes the payload and the number of the event
+/// plus one when it is complete. A reader copies the payload and then
+/// checks that m_sequence did not change while it did
+///
+struct TraceSlot
+{
+    std::atomic<uint64_t> m_sequence;
+
+    /// m_time, m_source, m_id and m_value | m_type << 32 | m_arg << 48
+    uint64_t m_payload[4];
+};
+
+struct TraceBuffer
+{
+    TraceBuffer( uint32_t index ) : m_head( 0 ), m_in_use( true ), m_index( index ), m_shared_ticks( 0 )
+    {
+        for ( size_t i = 0; i < JDKSAVDECCMCU_TRACE_BUFFER_EVENTS; ++i )
+        {
+            m_slots[i].m_sequence.store( 0, std::memory_order_relaxed );
+        }
+    }
+
+    /// Only called by the thread that uses the buffer
+    void write( uint64_t time, uint16_t type, uint16_t arg, uint64_t source, uint64_t id, uint32_t value )
+    {
+        uint64_t position = m_head.load( std::memory_order_relaxed );
+        TraceSlot &slot = m_slots[position & ( JDKSAVDECCMCU_TRACE_BUFFER_EVENTS - 1 )];
+
+        slot.m_sequence.store( 0, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+        slot.m_payload[0] = time;
+        slot.m_payload[1] = source;
+        slot.m_payload[2] = id;
+        slot.m_payload[3] = value | ( uint64_t( type ) << 32 ) | ( uint64_t( arg ) << 48 );
+        slot.m_sequence.store( position + 1, std::memory_order_release );
+        m_head.store( position + 1, std::memory_order_release );
+    }
+
+    /// Copy the events that are not overwritten while they are read
+    void read( TraceThreadEvents *events ) const
+    {
+        uint64_t head = m_head.load( std::memory_order_acquire );
+        uint64_t first = head > JDKSAVDECCMCU_TRACE_BUFFER_EVENTS ? head - JDKSAVDECCMCU_TRACE_BUFFER_EVENTS : 0;
+
+        events->m_buffer_index = m_index;
+        events->m_lost = first;
+        events->m_events.clear();
+        events->m_events.reserve( size_t( head - first ) );
+
+        for ( uint64_t position = first; position < head; ++position )
+        {
+            TraceSlot const &slot = m_slots[position & ( JDKSAVDECCMCU_TRACE_BUFFER_EVENTS - 1 )];
+            TraceEvent event;
+
+            uint64_t sequence = slot.m_sequence.load( std::memory_order_acquire );
+            uint64_t payload[4];
+            memcpy( payload, slot.m_payload, sizeof( payload ) );
+            std::atomic_thread_fence( std::memory_order_acquire );
+
+            if ( sequence != position + 1 || slot.m_sequence.load( std::memory_order_relaxed ) != sequence )
+            {
+                // The writer went around the ring while the event was read
+                ++events->m_lost;
+                continue;
+            }
+            event.m_sequence = position;
+            event.m_time = payload[0];
+            event.m_source = payload[1];
+            event.m_id = payload[2];
+            event.m_value = uint32_t( payload[3] );
+            event.m_type = uint16_t( payload[3] >> 32 );
+            event.m_arg = uint16_t( payload[3] >> 48 );
+            events->m_events.push_back( event );
+        }
+    }
+
+    std::atomic<uint64_t> m_head;
+
+    /// false after the thread that used it exits
+    std::atomic<bool> m_in_use;
+
+    uint32_t m_index;
+
+    /// The time of the frame or loop iteration that the thread is
+    /// handling, 0 outside of Trace::beginFrame() and Trace::endFrame()
+    /// or Trace::beginLoop() and Trace::endLoop()
+    uint64_t m_shared_ticks;
+
+    TraceSlot m_slots[JDKSAVDECCMCU_TRACE_BUFFER_EVENTS];
+};
+
+///
+/// The buffers of all threads, they are never freed so that the events
+/// of a thread that exited can still be dumped
+///
+struct TraceRegistry
+{
+    TraceRegistry()
+        : m_start_ticks( Trace::getTicks() )
+        , m_start_ns( uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::system_clock::now().time_since_epoch() ).count() ) )
+    {
+    }
+
+    std::mutex m_mutex;
+    std::vector<TraceBuffer *> m_buffers;
+    uint64_t m_start_ticks;
+    uint64_t m_start_ns;
+};
+
+TraceRegistry &getTraceRegistry()
+{
+    static TraceRegistry *registry = new TraceRegistry;
+    return *registry;
+}
+
+thread_local TraceBuffer *trace_buffer = 0;
+thread_local bool trace_thread_exited = false;
+
+/// Gives the buffer of a thread back when the thread exits
+struct TraceBufferRelease
+{
+    ~TraceBufferRelease()
+    {
+        trace_thread_exited = true;
+        if ( trace_buffer )
+        {
+            trace_buffer->m_in_use.store( false, std::memory_order_release );
+            trace_buffer = 0;
+        }
+    }
+};
+
+thread_local TraceBufferRelease trace_buffer_release;
+
+TraceBuffer *acquireTraceBuffer()
+{
+    if ( trace_thread_exited )
+    {
+        return 0;
+    }
+
+    TraceRegistry &registry = getTraceRegistry();
+    TraceBuffer *buffer = 0;
+    {
+        std::lock_guard<std::mutex> lock( registry.m_mutex );
+        for ( size_t i = 0; i < registry.m_buffers.size() && !buffer; ++i )
+        {
+            bool in_use = false;
+            if ( registry.m_buffers[i]->m_in_use.compare_exchange_strong( in_use, true, std::memory_order_acquire ) )
+            {
+                buffer = registry.m_buffers[i];
+            }
+        }
+        if ( !buffer )
+        {
+            buffer = new TraceBuffer( uint32_t( registry.m_buffers.size() ) );
+            registry.m_buffers.push_back( buffer );
+        }
+    }
+
+    // Using it registers the release at thread exit
+    (void)&trace_buffer_release;
+    buffer->m_shared_ticks = 0;
+    trace_buffer = buffer;
+    return buffer;
+}
+
+void writeTraceFile( FILE *f, void const *data, size_t length, std::string const &filename )
+{
+    if ( length && fwrite( data, length, 1, f ) != 1 )
+    {
+        fclose( f );
+        throw std::runtime_error( std::string( "Error writing trace file: " ) + filename );
+    }
+}
+
+void readTraceFile( FILE *f, void *data, size_t length, std::string const &filename )
+{
+    if ( length && fread( data, length, 1, f ) != 1 )
+    {
+        fclose( f );
+        throw std::runtime_error( std::string( "Error reading trace file: " ) + filename );
+    }
+}
+
+char const trace_file_magic[8] = {'J', 'D', 'K', 'S', 'T', 'R', 'C', '1'};
+}
+
+char const *getTraceEventTypeName( uint16_t type ) { return type < TRACE_EVENT_TYPE_COUNT ? trace_event_type_names[type] : 0; }
+
+char const *getTraceApsStateName( uint16_t state ) { return state < TRACE_APS_STATE_COUNT ? trace_aps_state_names[state] : 0; }
+
+char const *getTraceApcStateName( uint16_t state ) { return state < TRACE_APC_STATE_COUNT ? trace_apc_state_names[state] : 0; }
+
+uint64_t TraceDump::getNanoseconds( uint64_t ticks ) const
+{
+    if ( m_end_ticks == m_start_ticks )
+    {
+        return m_start_ns;
+    }
+    double ns_per_tick = double( m_end_ns - m_start_ns ) / double( m_end_ticks - m_start_ticks );
+    return m_start_ns + uint64_t( double( int64_t( ticks - m_start_ticks ) ) * ns_per_tick );
+}
+
+uint64_t TraceDump::getEventCount() const
+{
+    uint64_t count = 0;
+    for ( size_t i = 0; i < m_threads.size(); ++i )
+    {
+        count += m_threads[i].m_events.size();
+    }
+    return count;
+}
+
+void TraceDump::write( std::string const &filename ) const
+{
+    FILE *f = fopen( filename.c_str(), "wb" );
+    if ( !f )
+    {
+        throw std::runtime_error( std::string( "Error creating trace file: " ) + filename );
+    }
+
+    uint32_t version[2] = {file_version, uint32_t( sizeof( TraceEvent ) )};
+    uint64_t times[4] = {m_start_ticks, m_start_ns, m_end_ticks, m_end_ns};
+    uint32_t thread_count[2] = {uint32_t( m_threads.size() ), 0};
+    writeTraceFile( f, trace_file_magic, sizeof( trace_file_magic ), filename );
+    writeTraceFile( f, version, sizeof( version ), filename );
+    writeTraceFile( f, times, sizeof( times ), filename );
+    writeTraceFile( f, thread_count, sizeof( thread_count ), filename );
+
+    for ( size_t i = 0; i < m_threads.size(); ++i )
+    {
+        TraceThreadEvents const &thread = m_threads[i];
+        uint32_t index[2] = {thread.m_buffer_index, 0};
+        uint64_t counts[2] = {thread.m_lost, uint64_t( thread.m_events.size() )};
+        writeTraceFile( f, index, sizeof( index ), filename );
+        writeTraceFile( f, counts, sizeof( counts ), filename );
+        writeTraceFile( f, thread.m_events.data(), thread.m_events.size() * sizeof( TraceEvent ), filename );
+    }
+
+    if ( fclose( f ) != 0 )
+    {
+        throw std::runtime_error( std::string( "Error writing trace file: " ) + filename );
+    }
+}
+
+void TraceDump::read( std::string const &filename )
+{
+    FILE *f = fopen( filename.c_str(), "rb" );
+    if ( !f )
+    {
+        throw std::runtime_error( std::string( "Error opening trace file: " ) + filename );
+    }
+
+    char magic[8];
+    uint32_t version[2];
+    uint64_t times[4];
+    uint32_t thread_count[2];
+    readTraceFile( f, magic, sizeof( magic ), filename );
+    readTraceFile( f, version, sizeof( version ), filename );
+    if ( memcmp( magic, trace_file_magic, sizeof( magic ) ) != 0 || version[0] != file_version
+         || version[1] != sizeof( TraceEvent ) )
+    {
+        fclose( f );
+        throw std::runtime_error( std::string( "Not a trace file of this version and byte order: " ) + filename );
+    }
+    readTraceFile( f, times, sizeof( times ), filename );
+    readTraceFile( f, thread_count, sizeof( thread_count ), filename );
+
+    m_start_ticks = times[0];
+    m_start_ns = times[1];
+    m_end_ticks = times[2];
+    m_end_ns = times[3];
+    m_threads.clear();
+    m_threads.resize( thread_count[0] );
+
+    for ( size_t i = 0; i < m_threads.size(); ++i )
+    {
+        TraceThreadEvents &thread = m_threads[i];
+        uint32_t index[2];
+        uint64_t counts[2];
+        readTraceFile( f, index, sizeof( index ), filename );
+        readTraceFile( f, counts, sizeof( counts ), filename );
+        if ( counts[1] > JDKSAVDECCMCU_TRACE_BUFFER_EVENTS * 1024 )
+        {
+            fclose( f );
+            throw std::runtime_error( std::string( "Bad event count in trace file: " ) + filename );
+        }
+        thread.m_buffer_index = index[0];
+        thread.m_lost = counts[0];
+        thread.m_events.resize( size_t( counts[1] ) );
+        readTraceFile( f, thread.m_events.data(), thread.m_events.size() * sizeof( TraceEvent ), filename );
+    }
+    fclose( f );
+}
+
+std::atomic<bool> Trace::m_enabled( true );
+
+void Trace::snapshot( TraceDump *dump )
+{
+    TraceRegistry &registry = getTraceRegistry();
+    std::vector<TraceBuffer *> buffers;
+    {
+        std::lock_guard<std::mutex> lock( registry.m_mutex );
+        buffers = registry.m_buffers;
+    }
+
+    dump->m_start_ticks = registry.m_start_ticks;
+    dump->m_start_ns = registry.m_start_ns;
+    dump->m_threads.resize( buffers.size() );
+    for ( size_t i = 0; i < buffers.size(); ++i )
+    {
+        buffers[i]->read( &dump->m_threads[i] );
+    }
+    dump->m_end_ticks = getTicks();
+    dump->m_end_ns = uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::system_clock::now().time_since_epoch() ).count() );
+}
+
+void Trace::dump( std::string const &filename )
+{
+    TraceDump dump;
+    snapshot( &dump );
+    dump.write( filename );
+}
+
+void Trace::endFrame()
+{
+    TraceBuffer *buffer = trace_buffer;
+    if ( buffer )
+    {
+        buffer->m_shared_ticks = 0;
+    }
+}
+
+void Trace::endLoop() { endFrame(); }
+
+void Trace::recordEvent( TraceEventType type, uint16_t arg, uint64_t source, uint64_t id, uint32_t value )
+{
+    TraceBuffer *buffer = trace_buffer;
+    if ( !buffer )
+    {
+        buffer = acquireTraceBuffer();
+        if ( !buffer )
+        {
+            return;
+        }
+    }
+    uint64_t time = buffer->m_shared_ticks;
+    buffer->write( time ? time : getTicks(), uint16_t( type ), arg, source, id, value );
+}
+
+void Trace::beginLoopTime()
+{
+    TraceBuffer *buffer = trace_buffer;
+    if ( !buffer )
+    {
+        buffer = acquireTraceBuffer();
+        if ( !buffer )
+        {
+            return;
+        }
+    }
+    buffer->m_shared_ticks = getTicks();
+}
+
+void Trace::beginFrameEvent( RawSocket const *socket, Frame const &frame, uint32_t length )
+{
+    beginLoopTime();
+    recordFrameEvent( TRACE_FRAME_RX, socket, frame, length, 0 );
+}
+
+void Trace::recordFrameEvent(
+    TraceEventType type, RawSocket const *socket, Frame const &frame, uint32_t length, Eui48 const *peer )
+{
+    uint32_t value = length > 0xffff ? 0xffff : length;
+    if ( frame.getLength() > JDKSAVDECC_FRAME_HEADER_LEN + 1 )
+    {
+        value |= uint32_t( frame.getOctet( JDKSAVDECC_FRAME_HEADER_LEN ) ) << 16;
+        value |= uint32_t( frame.getOctet( JDKSAVDECC_FRAME_HEADER_LEN + 1 ) ) << 24;
+    }
+    Eui48 address = peer ? *peer : type == TRACE_FRAME_TX ? frame.getDA() : frame.getSA();
+    recordEvent( type,
+                 frame.getEtherType(),
+                 socket ? socket->getMACAddress().convertToUint64() : 0,
+                 address.convertToUint64(),
+                 value );
+}
+}
+
+#else
+const char *jdksavdeccmcu_trace_file = __FILE__;
+#endif
@@ -0,0 +1,397 @@
+/*
+  Copyright (c) 2015, J.D. Koftinoff Software, Ltd.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+   3. Neither the name of J.D. Koftinoff Software, Ltd. nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JDKSAvdeccMCU/World.hpp"
+#include "JDKSAvdeccMCU/VirtualNetwork.hpp"
+#include "JDKSAvdeccMCU/RawSocketVirtual.hpp"
+#include "JDKSAvdeccMCU/HandlerGroup.hpp"
+
+#include <algorithm>
+
+namespace JDKSAvdeccMCU
+{
+
+VirtualNetwork::VirtualNetwork( Settings const &settings, uint32_t seed )
+    : m_settings( settings )
+    , m_random_state( seed ? seed : 1 )
+    , m_now( 0 )
+    , m_sequence( 0 )
+    , m_port_count( 0 )
+    , m_sent_count( 0 )
+    , m_delivered_count( 0 )
+    , m_lost_count( 0 )
+    , m_congestion_drop_count( 0 )
+    , m_overflow_count( 0 )
+{
+}
+
+VirtualNetwork::~VirtualNetwork() {}
+
+void VirtualNetwork::advance( uint64_t time_in_microseconds )
+{
+    while ( !m_events.empty() && m_events.front().m_time <= time_in_microseconds )
+    {
+        Event event = m_events.front();
+        std::pop_heap( m_events.begin(), m_events.end() );
+        m_events.pop_back();
+
+        m_now = event.m_time;
+        dispatch( event );
+    }
+    if ( time_in_microseconds > m_now )
+    {
+        m_now = time_in_microseconds;
+    }
+}
+
+void VirtualNetwork::tick( jdksavdecc_timestamp_in_milliseconds timestamp )
+{
+    advance( uint64_t( timestamp ) * 1000 );
+
+    // Ports may come and go while their handlers run
+    for ( size_t i = 0; i < m_ports.size(); ++i )
+    {
+        RawSocketVirtual *socket = m_ports[i].m_socket;
+        if ( socket && socket->m_handler_group )
+        {
+            socket->m_handler_group->tick( timestamp );
+        }
+    }
+}
+
+uint32_t VirtualNetwork::attach( RawSocketVirtual *socket )
+{
+    Port port;
+    port.m_socket = socket;
+    port.m_tx_busy_until = 0;
+    port.m_rx_busy_until = 0;
+    port.m_last_arrival = 0;
+
+    uint32_t index = uint32_t( m_ports.size() );
+    m_ports.push_back( port );
+    ++m_port_count;
+
+    if ( isUnset( socket->m_mac_address ) )
+    {
+        // Locally administered unicast addresses, 02:00:00 followed by the port number
+        uint32_t n = index + 1;
+        socket->m_mac_address = Eui48( 0x02, 0x00, 0x00, uint8_t( n >> 16 ), uint8_t( n >> 8 ), uint8_t( n ) );
+    }
+    m_unicast[socket->m_mac_address.convertToUint64()] = index;
+    return index;
+}
+
+void VirtualNetwork::detach( RawSocketVirtual *socket )
+{
+    uint32_t index = socket->m_port;
+
+    m_ports[index].m_socket = 0;
+    --m_port_count;
+
+    std::map<uint64_t, uint32_t>::iterator u = m_unicast.find( socket->m_mac_address.convertToUint64() );
+    if ( u != m_unicast.end() && u->second == index )
+    {
+        m_unicast.erase( u );
+    }
+    for ( std::map<uint64_t, std::vector<uint32_t> >::iterator m = m_multicast.begin(); m != m_multicast.end(); ++m )
+    {
+        std::vector<uint32_t> &members = m->second;
+        members.erase( std::remove( members.begin(), members.end(), index ), members.end() );
+    }
+
+    Port &port = m_ports[index];
+    while ( !port.m_egress.empty() )
+    {
+        releasePacket( port.m_egress.front() );
+        port.m_egress.pop_front();
+    }
+
+    while ( !socket->m_queue.empty() )
+    {
+        releasePacket( socket->m_queue.front() );
+        socket->m_queue.pop_front();
+    }
+}
+
+void VirtualNetwork::join( RawSocketVirtual *socket, Eui48 const &multicast_mac )
+{
+    std::vector<uint32_t> &members = m_multicast[multicast_mac.convertToUint64()];
+    if ( std::find( members.begin(), members.end(), socket->m_port ) == members.end() )
+    {
+        members.push_back( socket->m_port );
+    }
+}
+
+bool VirtualNetwork::send( RawSocketVirtual *sender, uint8_t const *data, uint16_t length )
+{
+    Port &port = m_ports[sender->m_port];
+    uint64_t start = std::max( m_now, port.m_tx_busy_until );
+
+    if ( length > MAX_FRAME_SIZE || ( m_settings.m_max_queue_us && start - m_now > m_settings.m_max_queue_us ) )
+    {
+        ++m_congestion_drop_count;
+        return false;
+    }
+
+    port.m_tx_busy_until = start + getSerializationTime( length );
+
+    Event event;
+    event.m_time = port.m_tx_busy_until + m_settings.m_latency_us;
+    if ( m_settings.m_jitter_us )
+    {
+        event.m_time += random() % ( m_settings.m_jitter_us + 1 );
+    }
+
+    // A switch does not reorder the frames from one port
+    event.m_time = std::max( event.m_time, port.m_last_arrival );
+    port.m_last_arrival = event.m_time;
+
+    event.m_sequence = m_sequence++;
+    event.m_packet = allocatePacket();
+    event.m_port = NO_PORT;
+
+    Packet &packet = m_packets[event.m_packet];
+    packet.m_sender = sender->m_port;
+    packet.m_length = length;
+    memcpy( packet.m_data, data, length );
+
+    m_events.push_back( event );
+    std::push_heap( m_events.begin(), m_events.end() );
+    ++m_sent_count;
+    return true;
+}
+
+void VirtualNetwork::dispatch( Event const &event )
+{
+    if ( event.m_port != NO_PORT )
+    {
+        // The receiver's link is free now
+        deliverEgress( event.m_port );
+    }
+    else
+    {
+        Eui48 da( m_packets[event.m_packet].m_data );
+        uint32_t sender = m_packets[event.m_packet].m_sender;
+
+        if ( da.value[0] & 0x01 )
+        {
+            if ( da == Eui48( 0xff, 0xff, 0xff, 0xff, 0xff, 0xff ) )
+            {
+                for ( uint32_t i = 0; i < m_ports.size(); ++i )
+                {
+                    if ( i != sender )
+                    {
+                        deliverToPort( i, event.m_packet, false );
+                    }
+                }
+            }
+            else
+            {
+                std::map<uint64_t, std::vector<uint32_t> >::iterator m = m_multicast.find( da.convertToUint64() );
+                if ( m != m_multicast.end() )
+                {
+                    // Handlers may join groups while the frame is delivered
+                    std::vector<uint32_t> &members = m->second;
+                    for ( size_t i = 0; i < members.size(); ++i )
+                    {
+                        if ( members[i] != sender )
+                        {
+                            deliverToPort( members[i], event.m_packet, false );
+                        }
+                    }
+                }
+            }
+        }
+        else
+        {
+            std::map<uint64_t, uint32_t>::iterator u = m_unicast.find( da.convertToUint64() );
+            if ( u != m_unicast.end() && u->second != sender )
+            {
+                deliverToPort( u->second, event.m_packet, false );
+            }
+        }
+        releasePacket( event.m_packet );
+    }
+}
+
+void VirtualNetwork::deliverToPort( uint32_t index, uint32_t packet, bool queued )
+{
+    RawSocketVirtual *socket = m_ports[index].m_socket;
+
+    if ( !socket )
+    {
+        return;
+    }
+
+    if ( !queued )
+    {
+        uint16_t ethertype = uint16_t( ( m_packets[packet].m_data[JDKSAVDECC_FRAME_HEADER_ETHERTYPE_OFFSET] << 8 )
+                                       + m_packets[packet].m_data[JDKSAVDECC_FRAME_HEADER_ETHERTYPE_OFFSET + 1] );
+        if ( ethertype != socket->m_ethertype )
+        {
+            return;
+        }
+
+        if ( m_settings.m_loss_ppm && random() % 1000000 < m_settings.m_loss_ppm )
+        {
+            ++m_lost_count;
+            return;
+        }
+
+        Port &port = m_ports[index];
+        if ( port.m_rx_busy_until > m_now )
+        {
+            // Wait in the switch for the receiver's link
+            if ( m_settings.m_max_queue_us && port.m_rx_busy_until - m_now > m_settings.m_max_queue_us )
+            {
+                ++m_congestion_drop_count;
+                return;
+            }
+
+            // Only the head of the queue has an event, so a burst to many
+            // ports does not grow the event heap by one event per delivery
+            if ( port.m_egress.empty() )
+            {
+                Event event;
+                event.m_time = port.m_rx_busy_until;
+                event.m_sequence = m_sequence++;
+                event.m_packet = packet;
+                event.m_port = index;
+                m_events.push_back( event );
+                std::push_heap( m_events.begin(), m_events.end() );
+            }
+            ++m_packets[packet].m_refs;
+            port.m_egress.push_back( packet );
+
+            port.m_rx_busy_until += getSerializationTime( m_packets[packet].m_length );
+            return;
+        }
+        port.m_rx_busy_until = m_now + getSerializationTime( m_packets[packet].m_length );
+    }
+
+    ++m_delivered_count;
+    ++socket->m_received_count;
+
+    if ( socket->m_handler_group )
+    {
+        Packet const &p = m_packets[packet];
+        m_frame.setTimeInMilliseconds( getTimeInMilliseconds() );
+        memcpy( m_frame.getBuf(), p.m_data, p.m_length );
+        m_frame.setLength( p.m_length );
+        socket->m_handler_group->receivedPDU( socket, m_frame );
+    }
+    else if ( socket->m_queue.size() < JDKSAVDECCMCU_VIRTUALNETWORK_RECV_QUEUE_DEPTH )
+    {
+        ++m_packets[packet].m_refs;
+        socket->m_queue.push_back( packet );
+    }
+    else
+    {
+        ++m_overflow_count;
+    }
+}
+
+void VirtualNetwork::deliverEgress( uint32_t index )
+{
+    Port &port = m_ports[index];
+
+    if ( port.m_egress.empty() )
+    {
+        // The port was detached
+        return;
+    }
+
+    uint32_t packet = port.m_egress.front();
+    port.m_egress.pop_front();
+
+    if ( !port.m_egress.empty() )
+    {
+        // The next one goes once this one is through
+        Event event;
+        event.m_time = m_now + getSerializationTime( m_packets[packet].m_length );
+        event.m_sequence = m_sequence++;
+        event.m_packet = port.m_egress.front();
+        event.m_port = index;
+        m_events.push_back( event );
+        std::push_heap( m_events.begin(), m_events.end() );
+    }
+
+    deliverToPort( index, packet, true );
+    releasePacket( packet );
+}
+
+uint64_t VirtualNetwork::getSerializationTime( uint16_t length ) const
+{
+    uint64_t r = 0;
+    if ( m_settings.m_bandwidth_bps )
+    {
+        uint64_t bits = uint64_t( std::max( uint16_t( MIN_WIRE_FRAME ), length ) + WIRE_OVERHEAD ) * 8;
+        r = ( bits * 1000000 + m_settings.m_bandwidth_bps - 1 ) / m_settings.m_bandwidth_bps;
+    }
+    return r;
+}
+
+uint32_t VirtualNetwork::allocatePacket()
+{
+    uint32_t r;
+    if ( !m_free_packets.empty() )
+    {
+        r = m_free_packets.back();
+        m_free_packets.pop_back();
+    }
+    else
+    {
+        r = uint32_t( m_packets.size() );
+        m_packets.push_back( Packet() );
+    }
+    m_packets[r].m_refs = 1;
+    return r;
+}
+
+void VirtualNetwork::releasePacket( uint32_t packet )
+{
+    if ( --m_packets[packet].m_refs == 0 )
+    {
+        m_free_packets.push_back( packet );
+    }
+}
+
+uint32_t VirtualNetwork::random()
+{
+    // xorshift32
+    uint32_t x = m_random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    m_random_state = x;
+    return x;
+}
+}
@@ -0,0 +1,218 @@
+#include "JDKSAvdeccMCU.hpp"
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Checks that an ApsEntityIdAllocator gives a reconnecting APC its
+/// entity_id back, frees indexes when their lease expires and reuses
+/// them last, honours requested indexes, takes colliding indexes out of
+/// use, and restores the leases from storage after a restart.
+///
+
+static Eui48 const server_mac( 0x70, 0xb3, 0xd5, 0xed, 0xc0, 0x00 );
+
+static Eui48 apcMac( uint8_t n ) { return Eui48( 0x70, 0xb3, 0xd5, 0xed, 0xc1, n ); }
+
+///
+/// \brief The MemoryStorage class
+///
+/// PersistentStorage in memory that counts the flushes
+///
+class MemoryStorage : public PersistentStorage
+{
+  public:
+    MemoryStorage( uint32_t size ) : m_data( size, 0 ), m_flush_count( 0 ) {}
+
+    virtual uint32_t getSize() const override { return uint32_t( m_data.size() ); }
+
+    virtual bool read( uint32_t offset, uint8_t *buf, uint16_t len ) override
+    {
+        if ( size_t( offset ) + len > m_data.size() )
+        {
+            return false;
+        }
+        memcpy( buf, &m_data[offset], len );
+        return true;
+    }
+
+    virtual bool write( uint32_t offset, uint8_t const *buf, uint16_t len ) override
+    {
+        if ( size_t( offset ) + len > m_data.size() )
+        {
+            return false;
+        }
+        memcpy( &m_data[offset], buf, len );
+        return true;
+    }
+
+    virtual bool flush() override
+    {
+        ++m_flush_count;
+        return true;
+    }
+
+    std::vector<uint8_t> m_data;
+    uint32_t m_flush_count;
+};
+
+static int failures = 0;
+
+static void check( bool ok, char const *what, uint32_t value, uint32_t expected )
+{
+    std::cout << ( ok ? "ok:   " : "FAIL: " ) << what << " " << value << " expected " << expected << std::endl;
+    if ( !ok )
+    {
+        ++failures;
+    }
+}
+
+static void checkIndex( uint16_t index, uint16_t expected, char const *what )
+{
+    check( index == expected, what, index, expected );
+}
+
+/// A reconnecting APC gets its entity_id back while other APCs get others
+static void testReconnect()
+{
+    ApsEntityIdAllocator allocator( 4, 10 );
+
+    uint16_t a = allocator.assign( apcMac( 1 ), 0, 100 );
+    checkIndex( a, 1, "first APC gets the oldest free index" );
+    allocator.release( a, 100 );
+    check( allocator.getState( a ) == ApsEntityIdAllocator::INDEX_LEASED, "released index is leased", allocator.getState( a ), 2 );
+
+    checkIndex( allocator.assign( apcMac( 2 ), 0, 101 ), 2, "another APC does not get the leased index" );
+    checkIndex( allocator.assign( apcMac( 1 ), 0, 105 ), a, "reconnecting APC gets its index back" );
+    checkIndex( allocator.reassign( a, apcMac( 1 ), 0, 106 ), a, "APC that asks again keeps its index" );
+    check( allocator.getAssignedCount() == 2, "assigned", allocator.getAssignedCount(), 2 );
+    check( allocator.getLeasedCount() == 0, "leased", allocator.getLeasedCount(), 0 );
+}
+
+/// An expired lease puts its index at the end of the free list
+static void testExpiry()
+{
+    ApsEntityIdAllocator allocator( 3, 10 );
+
+    uint16_t a = allocator.assign( apcMac( 1 ), 0, 0 );
+    allocator.release( a, 0 );
+    allocator.onTimeTick( 9 );
+    check( allocator.getState( a ) == ApsEntityIdAllocator::INDEX_LEASED,
+           "lease kept until it expires",
+           allocator.getState( a ),
+           ApsEntityIdAllocator::INDEX_LEASED );
+    allocator.onTimeTick( 10 );
+    check( allocator.getState( a ) == ApsEntityIdAllocator::INDEX_FREE, "lease expired", allocator.getState( a ), 0 );
+    check( allocator.getLeasedCount() == 0, "leased", allocator.getLeasedCount(), 0 );
+
+    checkIndex( allocator.assign( apcMac( 2 ), 0, 11 ), 2, "oldest free index first" );
+    checkIndex( allocator.assign( apcMac( 3 ), 0, 11 ), 3, "next free index" );
+    checkIndex( allocator.assign( apcMac( 1 ), 0, 11 ), a, "expired index reused last, also by its old APC" );
+    checkIndex( allocator.assign( apcMac( 4 ), 0, 11 ), 0, "nothing left" );
+    check( allocator.getExhaustedCount() == 1, "exhausted", allocator.getExhaustedCount(), 1 );
+}
+
+/// A requested free index is given, and leaves the free list so that it is still reused last
+static void testRequestedIndex()
+{
+    ApsEntityIdAllocator allocator( 4, 10 );
+
+    checkIndex( allocator.assign( apcMac( 1 ), 3, 0 ), 3, "requested free index" );
+    checkIndex( allocator.assign( apcMac( 2 ), 3, 0 ), 1, "requested index in use, oldest free index instead" );
+    checkIndex( allocator.assign( apcMac( 3 ), 9, 0 ), 2, "requested index out of range, oldest free index instead" );
+
+    allocator.release( 3, 0 );
+    allocator.onTimeTick( 10 );
+    checkIndex( allocator.assign( apcMac( 4 ), 0, 10 ), 4, "free index that was never taken" );
+    checkIndex( allocator.assign( apcMac( 5 ), 0, 10 ), 3, "requested index reused after it was freed" );
+
+    // A full allocator reclaims the oldest lease for a new APC
+    allocator.release( 1, 20 );
+    allocator.release( 2, 21 );
+    checkIndex( allocator.assign( apcMac( 6 ), 0, 22 ), 1, "oldest lease reclaimed" );
+    check( allocator.getReclaimedCount() == 1, "reclaimed", allocator.getReclaimedCount(), 1 );
+    checkIndex( allocator.assign( apcMac( 3 ), 0, 22 ), 2, "newer lease kept for its APC" );
+}
+
+/// An entity_id of ours advertised by another station is taken out of use
+static void testCollision()
+{
+    ApsEntityIdAllocator allocator( 3, 10 );
+    Eui48 other_mac( 0x70, 0xb3, 0xd5, 0xed, 0xc2, 0x00 );
+
+    check( allocator.observeEntityId( server_mac, ApsEntityIdAllocator::makeEntityId( server_mac, 1 ), other_mac, 0 ),
+           "collision with a free index",
+           1,
+           1 );
+    check( !allocator.observeEntityId( server_mac, Eui64( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xc2, 0x00 ), other_mac, 0 ),
+           "entity_id of another range",
+           0,
+           0 );
+    checkIndex( allocator.assign( apcMac( 1 ), 1, 1 ), 2, "collided index not assigned" );
+
+    // The APC itself advertises its entity_id, someone else collides with it while it is assigned
+    Eui64 assigned_id = ApsEntityIdAllocator::makeEntityId( server_mac, 2 );
+    check( !allocator.observeEntityId( server_mac, assigned_id, apcMac( 1 ), 1 ), "APC advertising its own entity_id", 0, 0 );
+    check( allocator.observeEntityId( server_mac, assigned_id, other_mac, 1 ), "collision with an assigned index", 1, 1 );
+    allocator.release( 2, 2 );
+    check( allocator.getState( 2 ) == ApsEntityIdAllocator::INDEX_COLLIDED, "collided when released", allocator.getState( 2 ), 3 );
+    checkIndex( allocator.assign( apcMac( 1 ), 0, 3 ), 3, "reconnecting APC does not get a collided index" );
+
+    allocator.onTimeTick( 12 );
+    check( allocator.getState( 1 ) == ApsEntityIdAllocator::INDEX_FREE, "collision expired", allocator.getState( 1 ), 0 );
+    check( allocator.getState( 2 ) == ApsEntityIdAllocator::INDEX_FREE, "collision expired", allocator.getState( 2 ), 0 );
+    check( allocator.getCollisionCount() == 2, "collisions", allocator.getCollisionCount(), 2 );
+}
+
+/// The leases survive a restart of the server, and reassign() saves once
+static void testRestore()
+{
+    MemoryStorage storage( ApsEntityIdAllocator::HEADER_SIZE + 4 * ApsEntityIdAllocator::RECORD_SIZE );
+
+    {
+        ApsEntityIdAllocator allocator( 4, 10, &storage );
+        uint32_t restored = allocator.restore( 0 );
+        check( restored == 0, "nothing to restore in new storage", restored, 0 );
+        checkIndex( allocator.assign( apcMac( 1 ), 2, 0 ), 2, "requested index" );
+        checkIndex( allocator.assign( apcMac( 2 ), 0, 0 ), 1, "oldest free index" );
+        checkIndex( allocator.assign( apcMac( 3 ), 0, 0 ), 3, "next free index" );
+        allocator.release( 3, 1 );
+        allocator.onTimeTick( 11 );
+
+        uint32_t flushes = storage.m_flush_count;
+        checkIndex( allocator.reassign( 2, apcMac( 1 ), 0, 12 ), 2, "reassigned index" );
+        check( storage.m_flush_count == flushes + 1, "one flush for a reassign", storage.m_flush_count - flushes, 1 );
+    }
+
+    // The server restarts with the APCs still connected to it elsewhere
+    {
+        ApsEntityIdAllocator allocator( 4, 10, &storage );
+        uint32_t restored = allocator.restore( 100 );
+        check( restored == 2, "leases restored", restored, 2 );
+        check( allocator.getState( 3 ) == ApsEntityIdAllocator::INDEX_FREE,
+               "expired lease not restored",
+               allocator.getState( 3 ),
+               ApsEntityIdAllocator::INDEX_FREE );
+        checkIndex( allocator.assign( apcMac( 4 ), 0, 101 ), 3, "new APC does not get a restored lease" );
+        checkIndex( allocator.assign( apcMac( 2 ), 0, 101 ), 1, "restored lease" );
+        checkIndex( allocator.assign( apcMac( 1 ), 0, 101 ), 2, "restored lease" );
+    }
+
+    // Storage of another size is not restored
+    {
+        ApsEntityIdAllocator allocator( 3, 10, &storage );
+        uint32_t restored = allocator.restore( 200 );
+        check( restored == 0, "storage of another size", restored, 0 );
+    }
+}
+
+int main()
+{
+    testReconnect();
+    testExpiry();
+    testRequestedIndex();
+    testCollision();
+    testRestore();
+
+    std::cout << ( failures ? "FAILED" : "OK" ) << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+#include "JDKSAvdeccMCU.hpp"
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Checks that an ApsStateMachine sends every AVDECC_FROM_APC message to
+/// layer 2 in the order they arrived: messages that arrive before the
+/// transfer starts wait in m_outQueue, and messages given to it while
+/// it sends one are sent after it.
+///
+
+static Eui48 const server_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 );
+
+/// Lets the test give messages to the state machine as the parser does
+class TestEvents : public ApsStateEvents
+{
+  public:
+    TestEvents( HttpServerParser *http_parser ) : ApsStateEvents( http_parser, "/" ) {}
+
+    using ApsStateEvents::onAppMessageView;
+};
+
+///
+/// \brief The TestAps class
+///
+/// Keeps the first octet of the payload of each frame sent to layer 2,
+/// and can give it another message from inside sendAvdeccToL2()
+///
+class TestAps : public ApsStateMachine
+{
+  public:
+    TestAps()
+        : ApsStateMachine( &m_test_variables,
+                           &m_test_actions,
+                           &m_test_events,
+                           &m_test_states,
+                           m_active_entity_id_count,
+                           m_active_connections )
+        , m_test_events( &m_http_parser )
+        , m_http_parser( &m_test_events )
+        , m_active_entity_id_count( 0 )
+        , m_reentrant_message( 0 )
+    {
+    }
+
+    virtual void sendTcpData( uint8_t const *data, ssize_t len ) override
+    {
+        (void)data;
+        (void)len;
+    }
+
+    virtual void sendAvdeccToL2( Frame const &frame ) override
+    {
+        m_sent.push_back( frame.getOctet( JDKSAVDECC_FRAME_HEADER_LEN ) );
+        if ( m_reentrant_message )
+        {
+            uint8_t n = m_reentrant_message;
+            m_reentrant_message = 0;
+            fromApc( n );
+        }
+    }
+
+    /// An AVDECC_FROM_APC message with n as the first octet of its payload
+    void fromApc( uint8_t n )
+    {
+        FrameWithMTU frame( 0, Eui48( 0x91, 0xe0, 0xf0, 0x01, 0x00, 0x00 ), server_mac, JDKSAVDECC_AVTP_ETHERTYPE );
+        frame.putOctet( n );
+        for ( uint8_t i = 0; i < 40; ++i )
+        {
+            frame.putOctet( i );
+        }
+        AppMessage msg;
+        msg.setAvdeccFromApc( frame );
+        m_test_events.onAppMessageView( AppMessageView( msg ) );
+    }
+
+    ApsStateVariables m_test_variables;
+    ApsStateActions m_test_actions;
+    TestEvents m_test_events;
+    ApsStates m_test_states;
+    HttpServerParserInPlace m_http_parser;
+    uint16_t m_active_entity_id_count;
+    active_connections_type m_active_connections;
+    std::vector<uint8_t> m_sent;
+    uint8_t m_reentrant_message;
+};
+
+static int failures = 0;
+
+static void checkSent( TestAps const &aps, uint8_t const *expected, size_t count, char const *what )
+{
+    bool ok = aps.m_sent.size() == count && std::equal( expected, expected + count, aps.m_sent.begin() );
+    std::cout << ( ok ? "ok:   " : "FAIL: " ) << what << ":";
+    for ( size_t i = 0; i < aps.m_sent.size(); ++i )
+    {
+        std::cout << " " << int( aps.m_sent[i] );
+    }
+    std::cout << std::endl;
+    if ( !ok )
+    {
+        ++failures;
+    }
+}
+
+int main()
+{
+    static char const connect[] = "CONNECT / HTTP/1.1\r\n\r\n";
+    TestAps aps;
+
+    aps.setup();
+    aps.setLinkMac( server_mac );
+    aps.run();
+    aps.onIncomingTcpConnection();
+    aps.run();
+
+    // Before the CONNECT request the messages can not be sent yet
+    aps.fromApc( 1 );
+    aps.fromApc( 2 );
+    aps.fromApc( 3 );
+    checkSent( aps, 0, 0, "nothing sent before the transfer starts" );
+
+    aps.onIncomingTcpData( reinterpret_cast<uint8_t const *>( connect ), sizeof( connect ) - 1 );
+    aps.run();
+    static uint8_t const queued[] = {1, 2, 3};
+    checkSent( aps, queued, 3, "queued messages sent in order" );
+
+    // A message that arrives while one is being sent goes after it
+    aps.m_reentrant_message = 5;
+    aps.fromApc( 4 );
+    aps.fromApc( 6 );
+    static uint8_t const reentrant[] = {1, 2, 3, 4, 5, 6};
+    checkSent( aps, reentrant, 6, "message given while sending sent after it" );
+    bool idle = !aps.getVariables()->m_apcMsg && aps.getVariables()->m_outQueue.isEmpty();
+    std::cout << ( idle ? "ok:   " : "FAIL: " ) << "nothing left to send" << std::endl;
+    failures += idle ? 0 : 1;
+
+    std::cout << ( failures ? "FAILED" : "OK" ) << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+#include "JDKSAvdeccMCU.hpp"
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Checks the latency from value change to ACK that ControlSenderGroup
+/// records when the value changes while a SET_CONTROL is in flight, and
+/// when an unacknowledged SET_CONTROL is re-sent.
+///
+
+static Eui48 const controller_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf0 );
+static Eui64 const controller_entity_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf0 );
+static Eui48 const target_mac( 0x70, 0xb3, 0xd5, 0xed, 0xcf, 0xf1 );
+static Eui64 const target_entity_id( 0x70, 0xb3, 0xd5, 0xff, 0xfe, 0xed, 0xcf, 0xf1 );
+
+///
+/// \brief The TestSocket class
+///
+/// Keeps the last frame sent and lets the test set the time
+///
+class TestSocket : public RawSocket
+{
+  public:
+    TestSocket() : m_now( 0 ), m_sent( 0 ), m_last( 0 ) {}
+
+    virtual void setHandlerGroup( HandlerGroup *handler_group ) override { (void)handler_group; }
+
+    virtual jdksavdecc_timestamp_in_milliseconds getTimeInMilliseconds() const override { return m_now; }
+
+    virtual bool recvFrame( Frame *frame ) override
+    {
+        (void)frame;
+        return false;
+    }
+
+    virtual bool sendFrame( Frame const &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        m_last.setLength( 0 );
+        m_last.putBuf( frame.getBuf(), frame.getLength() );
+        m_last.putBuf( data1, len1 );
+        m_last.putBuf( data2, len2 );
+        ++m_sent;
+        return true;
+    }
+
+    virtual bool sendReplyFrame( Frame &frame, uint8_t const *data1, uint16_t len1, uint8_t const *data2, uint16_t len2 ) override
+    {
+        return sendFrame( frame, data1, len1, data2, len2 );
+    }
+
+    virtual bool joinMulticast( const Eui48 &multicast_mac ) override
+    {
+        (void)multicast_mac;
+        return false;
+    }
+
+    virtual Eui48 const &getMACAddress() const override { return controller_mac; }
+
+    jdksavdecc_timestamp_in_milliseconds m_now;
+    uint32_t m_sent;
+    FrameWithMTU m_last;
+};
+
+static int failures = 0;
+
+static void check( bool ok, char const *what, uint64_t value, uint64_t expected )
+{
+    std::cout << ( ok ? "ok:   " : "FAIL: " ) << what << " " << value << " expected " << expected << std::endl;
+    if ( !ok )
+    {
+        ++failures;
+    }
+}
+
+///
+/// \brief acknowledge Feed the SUCCESS response to a SET_CONTROL command to the group
+/// \param group The ControlSenderGroup
+/// \param net The socket that the command was sent with
+/// \param command The command
+/// \return true if the group took the response
+///
+static bool acknowledge( ControlSenderGroup &group, TestSocket &net, Frame const &command )
+{
+    FrameWithMTU response( net.m_now );
+    response.putBuf( command.getBuf(), command.getLength() );
+    response.setOctet( JDKSAVDECC_AECP_MESSAGE_TYPE_AEM_RESPONSE, JDKSAVDECC_FRAME_HEADER_LEN + 1 );
+    return group.receivedPDU( &net, response );
+}
+
+int main()
+{
+    TestSocket net;
+    ADPManager adp( net, controller_entity_id, ADPCoreInfo( Eui64(), 0, JDKSAVDECC_ADP_CONTROLLER_CAPABILITY_IMPLEMENTED ) );
+    RegisteredControllersStorage<1> registered_controllers;
+    ControllerEntity controller( adp, &registered_controllers, 0 );
+    ControlValueHolderWithStorage<uint8_t, 1> holder;
+    ControlSender sender( controller, target_entity_id, target_mac, 0, 10000, &holder );
+    ControlSenderGroupWithSize<1> group( controller );
+    ControlSenderGroup::TargetStatistics const &stats = group.getTargetStatistics( 0 );
+    FrameWithMTU first;
+    FrameWithMTU second;
+
+    group.add( &sender );
+
+    // The initial value changes at 100 and is sent at once
+    net.m_now = 100;
+    group.tick( net.m_now );
+    check( net.m_sent == 1, "SET_CONTROL sent for the first change", net.m_sent, 1 );
+    first.putBuf( net.m_last );
+
+    // The value changes again at 130, while the first command is in flight
+    net.m_now = 130;
+    holder.setValueOctet( 1 );
+    group.tick( net.m_now );
+    check( net.m_sent == 1, "no SET_CONTROL sent while one is in flight", net.m_sent, 1 );
+
+    // The first ACK is measured from the first change, not the second
+    net.m_now = 150;
+    check( acknowledge( group, net, first ), "first response taken", 1, 1 );
+    check( stats.m_latency_max == 50, "latency of the first change", stats.m_latency_max, 50 );
+
+    // The second change goes out now and is measured from 130
+    group.tick( net.m_now );
+    check( net.m_sent == 2, "SET_CONTROL sent for the second change", net.m_sent, 2 );
+    second.putBuf( net.m_last );
+    net.m_now = 190;
+    check( acknowledge( group, net, second ), "second response taken", 1, 1 );
+    check( stats.m_latency_min == 50, "minimum latency", stats.m_latency_min, 50 );
+    check( stats.m_latency_max == 60, "latency of the second change", stats.m_latency_max, 60 );
+
+    // A change at 200 times out, with another change at 210 while it is in flight.
+    // The retry is measured from the change that timed out
+    net.m_now = 200;
+    holder.setValueOctet( 2 );
+    group.tick( net.m_now );
+    net.m_now = 210;
+    holder.setValueOctet( 3 );
+    group.tick( net.m_now );
+    net.m_now = 200 + JDKSAVDECC_AEM_TIMEOUT_IN_MS + 1;
+    group.tick( net.m_now );
+    check( stats.m_timeout_count == 1, "timeouts", stats.m_timeout_count, 1 );
+    check( net.m_sent == 4, "SET_CONTROL re-sent after the timeout", net.m_sent, 4 );
+    net.m_now += 20;
+    check( acknowledge( group, net, net.m_last ), "retry response taken", 1, 1 );
+    check( stats.m_latency_max == JDKSAVDECC_AEM_TIMEOUT_IN_MS + 21,
+           "latency of the retry",
+           stats.m_latency_max,
+           JDKSAVDECC_AEM_TIMEOUT_IN_MS + 21 );
+    check( stats.m_ack_count == 3, "acknowledged", stats.m_ack_count, 3 );
+    check( stats.m_in_flight_count == 0, "in flight", stats.m_in_flight_count, 0 );
+
+    std::cout << ( failures ? "FAILED" : "OK" ) << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+#include "JDKSAvdeccMCU.hpp"
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Checks that TimerWheel timers fire at their expiry time, not a tick
+/// or a revolution late, and that getNextDelay() lets an event loop
+/// sleep until then, with ticks of 1, 10 and 250 milliseconds.
+///
+
+class TestTimer : public Timer
+{
+  public:
+    TestTimer() : m_fired_count( 0 ), m_fired_at( 0 ) {}
+
+    virtual void onTimerExpired( jdksavdecc_timestamp_in_milliseconds now )
+    {
+        ++m_fired_count;
+        m_fired_at = now;
+    }
+
+    int m_fired_count;
+    jdksavdecc_timestamp_in_milliseconds m_fired_at;
+};
+
+static int failures = 0;
+
+static void check( bool ok, char const *what, jdksavdecc_timestamp_in_milliseconds a, jdksavdecc_timestamp_in_milliseconds b )
+{
+    if ( !ok )
+    {
+        std::cout << "FAIL: " << what << " (" << a << ", " << b << ")" << std::endl;
+        ++failures;
+    }
+}
+
+///
+/// \brief testEveryMillisecond
+///
+/// Advance the wheel one millisecond at a time and check that each
+/// timer fires exactly at its expiry and that getNextDelay() counts
+/// down to it
+///
+static void testEveryMillisecond( TimerWheel &wheel, char const *name )
+{
+    static const jdksavdecc_timestamp_in_milliseconds expiries[] = {105, 110, 119, 3, 731, 2000};
+    static const size_t count = sizeof( expiries ) / sizeof( expiries[0] );
+    TestTimer timers[count];
+
+    std::cout << name << ": every millisecond" << std::endl;
+
+    wheel.advance( 0 );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        wheel.schedule( &timers[i], expiries[i] );
+    }
+
+    for ( jdksavdecc_timestamp_in_milliseconds now = 1; now <= 2100; ++now )
+    {
+        int32_t delay = wheel.getNextDelay( now );
+        jdksavdecc_timestamp_in_milliseconds next = 0;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            if ( timers[i].isScheduled() && ( next == 0 || expiries[i] < next ) )
+            {
+                next = expiries[i];
+            }
+        }
+
+        // The delay may be shorter than the next expiry, never longer, and only 0 when a timer is due
+        check( next == 0 || ( delay >= 0 && now + jdksavdecc_timestamp_in_milliseconds( delay ) <= next ),
+               "getNextDelay() passes the next expiry",
+               now,
+               next );
+        check( delay != 0 || ( next != 0 && next <= now ), "getNextDelay() is 0 while no timer is due", now, next );
+
+        wheel.advance( now );
+    }
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+        check( timers[i].m_fired_count == 1,
+               "fired once",
+               expiries[i],
+               jdksavdecc_timestamp_in_milliseconds( timers[i].m_fired_count ) );
+        check( timers[i].m_fired_at == expiries[i], "fired at its expiry", expiries[i], timers[i].m_fired_at );
+    }
+    check( wheel.getCount() == 0, "no timers left", wheel.getCount(), 0 );
+}
+
+///
+/// \brief testEventLoop
+///
+/// Sleep for getNextDelay() between each advance(), like an epoll loop,
+/// scheduling timers in the middle of a tick
+///
+static void testEventLoop( TimerWheel &wheel, char const *name )
+{
+    TestTimer first;
+    TestTimer same_tick;
+    TestTimer overdue;
+    TestTimer later;
+    int polls = 0;
+
+    std::cout << name << ": event loop" << std::endl;
+
+    jdksavdecc_timestamp_in_milliseconds now = 5001;
+    wheel.advance( now );
+    wheel.schedule( &first, now + 4 );
+    wheel.schedule( &same_tick, now + 7 );
+    wheel.schedule( &overdue, now - 1 );
+    wheel.schedule( &later, now + 1234 );
+
+    while ( wheel.getCount() > 0 && polls < 1000 )
+    {
+        int32_t delay = wheel.getNextDelay( now );
+        check( delay >= 0, "getNextDelay() with timers scheduled", now, 0 );
+        now += jdksavdecc_timestamp_in_milliseconds( delay );
+        ++polls;
+
+        // A zero delay must have something to fire, otherwise the loop spins
+        uint32_t fired = wheel.advance( now );
+        check( delay != 0 || fired != 0, "advance() fires after a zero delay", now, 0 );
+    }
+
+    check( overdue.m_fired_at == 5001, "overdue timer fired at once", overdue.m_fired_at, 5001 );
+    check( first.m_fired_at == 5005, "timer fired at its expiry", first.m_fired_at, 5005 );
+    check( same_tick.m_fired_at == 5008, "timer fired at its expiry", same_tick.m_fired_at, 5008 );
+    check( later.m_fired_at == 6235, "timer fired at its expiry", later.m_fired_at, 6235 );
+    check( polls < 1000, "event loop finished", jdksavdecc_timestamp_in_milliseconds( polls ), 1000 );
+}
+
+int main()
+{
+    {
+        TimerWheelWithSize<64> wheel;
+        testEveryMillisecond( wheel, "64 slots of 1 ms" );
+    }
+    {
+        TimerWheelWithSize<64, 10> wheel;
+        testEveryMillisecond( wheel, "64 slots of 10 ms" );
+    }
+    {
+        TimerWheelWithSize<64> wheel;
+        testEventLoop( wheel, "64 slots of 1 ms" );
+    }
+    {
+        TimerWheelWithSize<64, 10> wheel;
+        testEventLoop( wheel, "64 slots of 10 ms" );
+    }
+    {
+        TimerWheelWithSize<8, 250> wheel;
+        testEventLoop( wheel, "8 slots of 250 ms" );
+    }
+
+    std::cout << ( failures ? "FAILED" : "OK" ) << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#include "JDKSAvdeccMCU.hpp"
+
+#include <chrono>
+#if JDKSAVDECCMCU_ENABLE_THREADS
+#include <thread>
+#endif
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Analyzes the AVDECC messages in pcap or pcapng captures with
+/// CaptureAnalyzer and prints the statistics of every entity.
+///
+/// Usage: JDKSAvdeccMCU_AnalyzeCapture [-j threads] [-t aecp_timeout_ms] capture...
+///
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1 && JDKSAVDECCMCU_ENABLE_MMAP == 1
+
+static int usage()
+{
+    std::cerr << "Usage: JDKSAvdeccMCU_AnalyzeCapture [-j threads] [-t aecp_timeout_ms] capture..." << std::endl;
+    return 1;
+}
+
+int main( int argc, char **argv )
+{
+    CaptureAnalyzer::Settings settings;
+#if JDKSAVDECCMCU_ENABLE_THREADS
+    settings.m_thread_count = std::max( std::thread::hardware_concurrency(), 1U );
+#endif
+    std::vector<std::string> names;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string arg( argv[i] );
+        if ( arg == "-j" && i + 1 < argc )
+        {
+            settings.m_thread_count = uint32_t( atoi( argv[++i] ) );
+        }
+        else if ( arg == "-t" && i + 1 < argc )
+        {
+            settings.m_aecp_timeout_in_microseconds = uint64_t( atoi( argv[++i] ) ) * 1000;
+        }
+        else if ( arg.size() > 1 && arg[0] == '-' )
+        {
+            return usage();
+        }
+        else
+        {
+            names.push_back( arg );
+        }
+    }
+    if ( names.empty() )
+    {
+        return usage();
+    }
+
+    int r = 0;
+    for ( size_t i = 0; i < names.size(); ++i )
+    {
+        try
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            PcapMappedReader reader( names[i] );
+            CaptureAnalyzer analyzer( reader, settings );
+            analyzer.run();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            std::cout << names[i] << ": analyzed in " << std::fixed << std::setprecision( 3 ) << elapsed.count() << " s with "
+                      << analyzer.getShardCount() << " threads" << std::endl;
+            std::cout.unsetf( std::ios::floatfield );
+            analyzer.print( std::cout );
+        }
+        catch ( std::runtime_error const &e )
+        {
+            std::cerr << names[i] << ": " << e.what() << std::endl;
+            r = 1;
+        }
+    }
+    return r;
+}
+
+#else
+
+int main()
+{
+    std::cerr << "JDKSAvdeccMCU_AnalyzeCapture needs JDKSAVDECCMCU_ENABLE_PCAPFILE and JDKSAVDECCMCU_ENABLE_MMAP" << std::endl;
+    return 1;
+}
+
+#endif
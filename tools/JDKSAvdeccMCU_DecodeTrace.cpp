@@ -0,0 +1,297 @@
+#include "JDKSAvdeccMCU.hpp"
+
+#include <ctime>
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Prints the events of trace files written by Trace::dump(), one line
+/// per event in time order across all threads, or the count of each
+/// event type per thread with --summary.
+///
+/// Usage: JDKSAvdeccMCU_DecodeTrace [--summary] trace...
+///
+
+#if JDKSAVDECCMCU_ENABLE_TRACE
+
+static int usage()
+{
+    std::cerr << "Usage: JDKSAvdeccMCU_DecodeTrace [--summary] trace..." << std::endl;
+    return 1;
+}
+
+static char const *const listener_state_names[] = {"WAITING", "CONNECT", "DISCONNECT"};
+static char const *const talker_state_names[] = {"WAITING", "CONNECT", "DISCONNECT", "GET_STATE", "GET_CONNECTION"};
+static char const *const controller_state_names[] = {"PENDING", "IN_FLIGHT", "SUCCEEDED", "FAILED", "TIMED_OUT"};
+
+/// Print the name of v from a table of count names, or v
+static void printState( std::ostream &o, char const *const *names, size_t count, uint32_t v )
+{
+    if ( v < count )
+    {
+        o << names[v];
+    }
+    else
+    {
+        o << v;
+    }
+}
+
+/// Print the name of v from a jdksavdecc name table, or v
+static void printName( std::ostream &o, jdksavdecc_uint16_name const *names, uint32_t v )
+{
+    char const *name = jdksavdecc_get_name_for_uint16_value( names, uint16_t( v ) );
+    if ( name )
+    {
+        o << name;
+    }
+    else
+    {
+        o << v;
+    }
+}
+
+static void printTime( std::ostream &o, uint64_t ns )
+{
+    time_t seconds = time_t( ns / 1000000000 );
+    struct tm *t = gmtime( &seconds );
+    char buf[32];
+    strftime( buf, sizeof( buf ), "%Y-%m-%d %H:%M:%S", t );
+    o << buf << "." << std::setw( 9 ) << std::setfill( '0' ) << ns % 1000000000 << std::setfill( ' ' );
+}
+
+static void printFrame( std::ostream &o, TraceEvent const &e )
+{
+    uint8_t subtype = uint8_t( e.m_value >> 16 );
+    uint8_t message_type = uint8_t( e.m_value >> 24 ) & 0x0f;
+
+    o << "socket=" << Eui48( e.m_source ) << ( e.m_type == TRACE_FRAME_RX ? " sa=" : " da=" ) << Eui48( e.m_id )
+      << " ethertype=0x" << std::hex << std::setw( 4 ) << std::setfill( '0' ) << e.m_arg << std::dec << std::setfill( ' ' )
+      << " length=" << ( e.m_value & 0xffff );
+
+    if ( e.m_arg == JDKSAVDECC_AVTP_ETHERTYPE )
+    {
+        o << " ";
+        switch ( subtype )
+        {
+        case JDKSAVDECC_1722A_SUBTYPE_ADP:
+            o << "ADP ";
+            printName( o, jdksavdecc_adpdu_print_message_type, message_type );
+            break;
+        case JDKSAVDECC_1722A_SUBTYPE_AECP:
+            o << "AECP ";
+            printName( o, jdksavdecc_aecp_print_message_type, message_type );
+            break;
+        case JDKSAVDECC_1722A_SUBTYPE_ACMP:
+            o << "ACMP ";
+            printName( o, jdksavdecc_acmpdu_print_message_type, message_type );
+            break;
+        default:
+            o << "subtype=0x" << std::hex << uint32_t( subtype ) << std::dec;
+            break;
+        }
+    }
+}
+
+static void printEvent( std::ostream &o, TraceEvent const &e )
+{
+    switch ( e.m_type )
+    {
+    case TRACE_FRAME_RX:
+    case TRACE_FRAME_TX:
+        printFrame( o, e );
+        break;
+    case TRACE_AEM_COMMAND_ACCEPTED:
+    case TRACE_AEM_COMMAND_REJECTED:
+        o << "entity=" << Eui64( e.m_source ) << " controller=" << Eui64( e.m_id ) << " command=";
+        printName( o, jdksavdecc_aem_print_command, e.m_arg );
+        o << " status=";
+        printName( o, jdksavdecc_aecp_aem_print_status, e.m_value & 0xff );
+        o << " sequence_id=" << ( e.m_value >> 16 );
+        break;
+    case TRACE_ENTITY_ACQUIRED:
+    case TRACE_ENTITY_RELEASED:
+    case TRACE_ENTITY_ACQUIRE_IN_PROGRESS:
+    case TRACE_ENTITY_ACQUIRE_TRANSFERRED:
+    case TRACE_ENTITY_ACQUIRE_CANCELLED:
+    case TRACE_ENTITY_LOCK_TIMED_OUT:
+        o << "entity=" << Eui64( e.m_source ) << " controller=" << Eui64( e.m_id );
+        break;
+    case TRACE_ACMP_LISTENER_STATE:
+        o << "listener=" << Eui64( e.m_source ) << " unique_id=" << e.m_arg << " talker=" << Eui64( e.m_id ) << " ";
+        printState( o, listener_state_names, 3, e.m_value & 0xff );
+        o << " -> ";
+        printState( o, listener_state_names, 3, ( e.m_value >> 8 ) & 0xff );
+        o << " connected=" << ( ( e.m_value >> 16 ) & 1 );
+        break;
+    case TRACE_ACMP_TALKER_STATE:
+        o << "talker=" << Eui64( e.m_source ) << " unique_id=" << e.m_arg << " listener=" << Eui64( e.m_id ) << " ";
+        printState( o, talker_state_names, 5, e.m_value & 0xff );
+        o << " ";
+        printName( o, jdksavdecc_acmpdu_print_message_type, ( e.m_value >> 16 ) & 0xff );
+        o << " status=";
+        printName( o, jdksavdecc_acmpdu_print_status, ( e.m_value >> 8 ) & 0xff );
+        break;
+    case TRACE_ACMP_CONTROLLER_STATE:
+        o << "controller=" << Eui64( e.m_source ) << " listener=" << Eui64( e.m_id ) << " unique_id=" << e.m_arg << " ";
+        printState( o, controller_state_names, 5, e.m_value & 0xff );
+        o << " ";
+        printName( o, jdksavdecc_acmpdu_print_message_type, ( e.m_value >> 16 ) & 0xff );
+        o << " status=";
+        printName( o, jdksavdecc_acmpdu_print_status, ( e.m_value >> 8 ) & 0xff );
+        o << " retries=" << ( e.m_value >> 24 );
+        break;
+    case TRACE_APS_STATE:
+    case TRACE_APC_STATE:
+    {
+        char const *name = e.m_type == TRACE_APS_STATE ? getTraceApsStateName( e.m_arg ) : getTraceApcStateName( e.m_arg );
+        o << "session=0x" << std::hex << e.m_source << std::dec << " entity_id=" << Eui64( e.m_id ) << " state=";
+        if ( name )
+        {
+            o << name;
+        }
+        else
+        {
+            o << e.m_arg;
+        }
+        break;
+    }
+    default:
+        o << "source=0x" << std::hex << e.m_source << " id=0x" << e.m_id << " arg=0x" << e.m_arg << " value=0x" << e.m_value
+          << std::dec;
+        break;
+    }
+}
+
+struct EventRef
+{
+    uint64_t m_time;
+    uint32_t m_thread;
+    TraceEvent const *m_event;
+
+    bool operator<( EventRef const &other ) const { return m_time < other.m_time; }
+};
+
+static void printEvents( std::ostream &o, TraceDump const &dump )
+{
+    std::vector<EventRef> events;
+    events.reserve( size_t( dump.getEventCount() ) );
+    for ( size_t t = 0; t < dump.m_threads.size(); ++t )
+    {
+        TraceThreadEvents const &thread = dump.m_threads[t];
+        for ( size_t i = 0; i < thread.m_events.size(); ++i )
+        {
+            EventRef ref = {thread.m_events[i].m_time, thread.m_buffer_index, &thread.m_events[i]};
+            events.push_back( ref );
+        }
+    }
+    // The events of a thread are already in order, keep them so when their ticks are equal
+    std::stable_sort( events.begin(), events.end() );
+
+    for ( size_t i = 0; i < events.size(); ++i )
+    {
+        TraceEvent const &e = *events[i].m_event;
+        char const *type_name = getTraceEventTypeName( e.m_type );
+
+        printTime( o, dump.getNanoseconds( e.m_time ) );
+        o << " T" << events[i].m_thread << " #" << e.m_sequence << " " << ( type_name ? type_name : "UNKNOWN" ) << " ";
+        printEvent( o, e );
+        o << "\n";
+    }
+}
+
+static void printSummary( std::ostream &o, TraceDump const &dump )
+{
+    for ( size_t t = 0; t < dump.m_threads.size(); ++t )
+    {
+        TraceThreadEvents const &thread = dump.m_threads[t];
+        uint64_t counts[TRACE_EVENT_TYPE_COUNT + 1] = {0};
+        for ( size_t i = 0; i < thread.m_events.size(); ++i )
+        {
+            ++counts[std::min<uint16_t>( thread.m_events[i].m_type, TRACE_EVENT_TYPE_COUNT )];
+        }
+
+        o << "T" << thread.m_buffer_index << ": " << thread.m_events.size() << " events, " << thread.m_lost << " lost";
+        if ( !thread.m_events.empty() )
+        {
+            o << ", ";
+            printTime( o, dump.getNanoseconds( thread.m_events.front().m_time ) );
+            o << " to ";
+            printTime( o, dump.getNanoseconds( thread.m_events.back().m_time ) );
+        }
+        o << "\n";
+        for ( uint16_t type = 0; type <= TRACE_EVENT_TYPE_COUNT; ++type )
+        {
+            if ( counts[type] )
+            {
+                char const *type_name = getTraceEventTypeName( type );
+                o << "    " << std::left << std::setw( 28 ) << ( type_name ? type_name : "UNKNOWN" ) << std::right
+                  << counts[type] << "\n";
+            }
+        }
+    }
+}
+
+int main( int argc, char **argv )
+{
+    bool summary = false;
+    std::vector<std::string> names;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string arg( argv[i] );
+        if ( arg == "--summary" )
+        {
+            summary = true;
+        }
+        else if ( arg.size() > 1 && arg[0] == '-' )
+        {
+            return usage();
+        }
+        else
+        {
+            names.push_back( arg );
+        }
+    }
+    if ( names.empty() )
+    {
+        return usage();
+    }
+
+    int r = 0;
+    for ( size_t i = 0; i < names.size(); ++i )
+    {
+        try
+        {
+            TraceDump dump;
+            dump.read( names[i] );
+            if ( summary )
+            {
+                std::cout << names[i] << ": " << dump.m_threads.size() << " threads, " << dump.getEventCount() << " events"
+                          << std::endl;
+                printSummary( std::cout, dump );
+            }
+            else
+            {
+                printEvents( std::cout, dump );
+            }
+            std::cout.flush();
+        }
+        catch ( std::runtime_error const &e )
+        {
+            std::cerr << names[i] << ": " << e.what() << std::endl;
+            r = 1;
+        }
+    }
+    return r;
+}
+
+#else
+
+int main()
+{
+    std::cerr << "JDKSAvdeccMCU_DecodeTrace needs JDKSAVDECCMCU_ENABLE_TRACE" << std::endl;
+    return 1;
+}
+
+#endif
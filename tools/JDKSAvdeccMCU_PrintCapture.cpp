@@ -0,0 +1,97 @@
+#include "JDKSAvdeccMCU.hpp"
+
+using namespace JDKSAvdeccMCU;
+
+///
+/// Prints the ADP, AECP and ACMP messages in pcap or pcapng captures as
+/// JSON with jdksavdecc_json_printer, one object per line (NDJSON) or
+/// one JSON array per capture with --json.
+///
+/// Usage: JDKSAvdeccMCU_PrintCapture [--json] capture...
+///
+
+#if JDKSAVDECCMCU_ENABLE_PCAPFILE == 1 && JDKSAVDECCMCU_ENABLE_MMAP == 1
+
+static int usage()
+{
+    std::cerr << "Usage: JDKSAvdeccMCU_PrintCapture [--json] capture..." << std::endl;
+    return 1;
+}
+
+static int writeToFile( void *context, char const *buf, size_t len )
+{
+    return fwrite( buf, 1, len, static_cast<FILE *>( context ) ) == len;
+}
+
+int main( int argc, char **argv )
+{
+    bool ndjson = true;
+    std::vector<std::string> names;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string arg( argv[i] );
+        if ( arg == "--json" )
+        {
+            ndjson = false;
+        }
+        else if ( arg.size() > 1 && arg[0] == '-' )
+        {
+            return usage();
+        }
+        else
+        {
+            names.push_back( arg );
+        }
+    }
+    if ( names.empty() )
+    {
+        return usage();
+    }
+
+    std::vector<char> buf( 256 * 1024 );
+    int r = 0;
+    for ( size_t i = 0; i < names.size(); ++i )
+    {
+        try
+        {
+            PcapMappedReader reader( names[i] );
+            jdksavdecc_json_printer printer;
+            jdksavdecc_json_printer_init( &printer, &buf[0], buf.size(), ndjson ? 1 : 0, writeToFile, stdout );
+
+            for ( size_t n = 0; n < reader.getPacketCount(); ++n )
+            {
+                if ( reader.getLinkType( n ) == 1 )
+                {
+                    uint32_t len;
+                    uint8_t const *data = reader.getPacket( n, &len );
+                    jdksavdecc_json_printer_print_frame(
+                        &printer, reader.getFirstTimestamp() + reader.getTimestamp( n ), data, len );
+                }
+            }
+            jdksavdecc_json_printer_finish( &printer );
+            if ( printer.flush_errors )
+            {
+                std::cerr << names[i] << ": error writing output" << std::endl;
+                r = 1;
+            }
+        }
+        catch ( std::runtime_error const &e )
+        {
+            std::cerr << names[i] << ": " << e.what() << std::endl;
+            r = 1;
+        }
+    }
+    fflush( stdout );
+    return r;
+}
+
+#else
+
+int main()
+{
+    std::cerr << "JDKSAvdeccMCU_PrintCapture needs JDKSAVDECCMCU_ENABLE_PCAPFILE and JDKSAVDECCMCU_ENABLE_MMAP" << std::endl;
+    return 1;
+}
+
+#endif